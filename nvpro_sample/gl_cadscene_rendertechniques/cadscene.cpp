@@ -53,8 +53,13 @@ static void recursiveHierarchy(NodeTree& tree, CSFile *csf, int idx, int cloneof
 
 bool CadScene::loadCSF( const char* filename, int clones, int cloneaxis)
 {
+  CSFLoaderConfig config = {0};
+  config.gltfFindUniqueGeometries = 1;
+  // offset and node fixup, as well as inflating .csf.gz, use all cores
+  config.numThreads = -1;
+
   CSFile* csf;
-  CSFileMemoryPTR mem = CSFileMemory_new();
+  CSFileMemoryPTR mem = CSFileMemory_newCfg(&config);
   if (CSFile_loadExt(&csf,filename,mem) != CADSCENEFILE_NOERROR || !(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES)){
     CSFileMemory_delete(mem);
     return false;
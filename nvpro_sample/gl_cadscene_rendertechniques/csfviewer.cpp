@@ -32,6 +32,7 @@
 #include <nvh/cameracontrol.hpp>
 #include <nvh/fileoperations.hpp>
 #include <nvh/geometry.hpp>
+#include <nvh/jobsystem.hpp>
 #include <nvh/misc.hpp>
 
 #include <nvgl/appwindowprofiler_gl.hpp>
@@ -40,11 +41,14 @@
 #include <nvgl/programmanager_gl.hpp>
 
 #include "transformsystem.hpp"
+#include "transformsystemcpu.hpp"
 
 #include "cadscene.hpp"
 #include "renderer.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <thread>
 
 #include "common.h"
 
@@ -65,6 +69,7 @@ public:
     GUI_MSAA,
     GUI_SHADE,
     GUI_STRATEGY,
+    GUI_CULLFRUSTUM,
   };
 
   struct
@@ -109,19 +114,22 @@ public:
 
   struct Tweak
   {
-    int       renderer      = 0;
-    ShadeType shade         = SHADE_SOLID;
-    Strategy  strategy      = STRATEGY_GROUPS;
-    int       clones        = 0;
-    bool      cloneaxisX    = true;
-    bool      cloneaxisY    = true;
-    bool      cloneaxisZ    = false;
-    bool      animateActive = false;
-    float     animateMin    = 1;
-    float     animateDelta  = 1;
-    int       zoom          = 100;
-    int       msaa          = 0;
-    bool      noUI          = false;
+    int         renderer      = 0;
+    ShadeType   shade         = SHADE_SOLID;
+    Strategy    strategy      = STRATEGY_GROUPS;
+    int         clones        = 0;
+    bool        cloneaxisX    = true;
+    bool        cloneaxisY    = true;
+    bool        cloneaxisZ    = false;
+    bool        animateActive = false;
+    bool        animateCPU    = false;
+    bool        animateCheck  = false;
+    CullFrustum cullFrustum   = CULL_FRUSTUM_GPU;
+    float       animateMin    = 1;
+    float       animateDelta  = 1;
+    int         zoom          = 100;
+    int         msaa          = 0;
+    bool        noUI          = false;
   };
 
   nvgl::ProgramManager m_progManager;
@@ -138,6 +146,15 @@ public:
   CadScene        m_scene;
   TransformSystem m_transformSystem;
 
+  // host-side xplode, m_xplodeMatrices is uploaded to m_scene.m_matricesGL
+  nvh::JobSystem                   m_jobSystem;
+  TransformSystemCPU               m_transformSystemCPU;
+  std::vector<CadScene::MatrixNode> m_xplodeMatrices;
+
+  // debug check of the host-side xplode against TransformSystem
+  std::vector<CadScene::MatrixNode> m_xplodeReadback;
+  float                             m_xplodeCheckDifference = 0;
+
   GLuint m_xplodeGroupSize;
 
   std::vector<unsigned int> m_renderersSorted;
@@ -160,6 +177,9 @@ public:
   void getScanPrograms(ScanSystem::Programs& scanprograms);
   void getTransformPrograms(TransformSystem::Programs& xfromPrograms);
 
+  void xplodeGPU(float scale);
+  void checkXplodeCPU();
+
   void updatedPrograms();
 
   void setupConfigParameters();
@@ -327,6 +347,7 @@ bool Sample::initProgram()
 bool Sample::initScene(const char* filename, int clones, int cloneaxis)
 {
   m_scene.unload();
+  m_xplodeMatrices.clear();
 
   if(buffers.scene_ubo && has_GL_NV_shader_buffer_load)
   {
@@ -556,6 +577,10 @@ bool Sample::begin()
     m_ui.enumAdd(GUI_MSAA, 2, "2x");
     m_ui.enumAdd(GUI_MSAA, 4, "4x");
     m_ui.enumAdd(GUI_MSAA, 8, "8x");
+
+    m_ui.enumAdd(GUI_CULLFRUSTUM, CULL_FRUSTUM_GPU, "GPU");
+    m_ui.enumAdd(GUI_CULLFRUSTUM, CULL_FRUSTUM_CPU, "CPU");
+    m_ui.enumAdd(GUI_CULLFRUSTUM, CULL_FRUSTUM_COMPARE, "CPU & GPU compare");
   }
 
 
@@ -583,12 +608,99 @@ bool Sample::begin()
   getTransformPrograms(xformprogs);
   m_transformSystem.init(xformprogs);
 
+  m_jobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
 
   initRenderer(m_tweak.renderer, m_tweak.strategy);
 
   return validated;
 }
 
+void Sample::xplodeGPU(float scale)
+{
+  {
+    NV_PROFILE_GL_SECTION("Xplode");
+
+    GLuint totalNodes = GLuint(m_scene.m_matrices.size());
+    GLuint groupsize  = m_xplodeGroupSize;
+
+    glUseProgram(m_progManager.get(programs.xplode));
+    glUniform1f(0, scale);
+    glUniform1i(1, totalNodes);
+
+    nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, m_scene.m_matricesOrigTexGL);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_scene.m_matricesGL);
+
+    glDispatchCompute((totalNodes + groupsize - 1) / groupsize, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glUseProgram(0);
+  }
+
+  {
+    NV_PROFILE_GL_SECTION("Tree");
+    TransformSystem::Buffer ids;
+    TransformSystem::Buffer world;
+    TransformSystem::Buffer object;
+
+    ids.buffer = m_scene.m_parentIDsGL;
+    ids.offset = 0;
+    ids.size   = sizeof(GLuint) * m_scene.m_matrices.size();
+
+    world.buffer = m_scene.m_matricesGL;
+    world.offset = 0;
+    world.size   = sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size();
+
+    object.buffer = m_scene.m_matricesGL;
+    object.offset = 0;
+    object.size   = sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size();
+
+    m_transformSystem.process(m_scene.m_nodeTree, ids, object, world);
+  }
+}
+
+// compares m_xplodeMatrices against what xplodeGPU left in m_matricesGL
+void Sample::checkXplodeCPU()
+{
+  NV_PROFILE_GL_SECTION("Xplode Check");
+
+  size_t numNodes = m_xplodeMatrices.size();
+  m_xplodeReadback.resize(numNodes);
+  // the transform shaders wrote the buffer as storage buffer
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glGetNamedBufferSubData(m_scene.m_matricesGL, 0, sizeof(CadScene::MatrixNode) * numNodes, m_xplodeReadback.data());
+
+  // all four matrices of every node, relative to the magnitude of the GPU value
+  const size_t floatsPerNode = sizeof(CadScene::MatrixNode) / sizeof(float);
+  float        maxDifference = 0;
+  size_t       maxNode       = 0;
+  for(size_t i = 0; i < numNodes; i++)
+  {
+    const float* cpu = m_xplodeMatrices[i].worldMatrix.mat_array;
+    const float* gpu = m_xplodeReadback[i].worldMatrix.mat_array;
+    for(size_t f = 0; f < floatsPerNode; f++)
+    {
+      float difference = fabsf(cpu[f] - gpu[f]) / std::max(1.0f, fabsf(gpu[f]));
+      if(std::isnan(difference))
+      {
+        difference = INFINITY;
+      }
+      if(difference > maxDifference)
+      {
+        maxDifference = difference;
+        maxNode       = i;
+      }
+    }
+  }
+
+  m_xplodeCheckDifference = maxDifference;
+  if(maxDifference > 1.0e-3f)
+  {
+    LOGW("xplode check: CPU and GPU matrices differ by %g at node %zu\n", maxDifference, maxNode);
+  }
+}
+
 void Sample::processUI(double time)
 {
   int width  = m_windowState.m_winSize[0];
@@ -609,6 +721,16 @@ void Sample::processUI(double time)
     m_ui.enumCombobox(GUI_STRATEGY, "strategy", &m_tweak.strategy);
     m_ui.enumCombobox(GUI_SHADE, "shademode", &m_tweak.shade);
     ImGui::Checkbox("xplode via GPU", &m_tweak.animateActive);
+    ImGui::Checkbox("xplode via CPU", &m_tweak.animateCPU);
+    if(m_tweak.animateCPU)
+    {
+      // reads back the GPU results every frame, debugging only
+      ImGui::Checkbox("xplode check CPU vs GPU", &m_tweak.animateCheck);
+      if(m_tweak.animateCheck)
+      {
+        ImGui::Text("max relative difference %g", m_xplodeCheckDifference);
+      }
+    }
     ImGui::SliderFloat("xplode min", &m_tweak.animateMin, 0, 16.0f);
     ImGui::SliderFloat("xplode delta", &m_tweak.animateDelta, 0, 16.0f);
     ImGuiH::InputIntClamped("clones", &m_tweak.clones, 0, 255, 1, 10, ImGuiInputTextFlags_EnterReturnsTrue);
@@ -616,6 +738,7 @@ void Sample::processUI(double time)
     ImGui::Checkbox("clone Y", &m_tweak.cloneaxisY);
     ImGui::Checkbox("clone Z", &m_tweak.cloneaxisZ);
     m_ui.enumCombobox(GUI_MSAA, "msaa", &m_tweak.msaa);
+    m_ui.enumCombobox(GUI_CULLFRUSTUM, "cull frustum", &m_tweak.cullFrustum);
   }
   if(!m_tweak.cloneaxisX && !m_tweak.cloneaxisY && !m_tweak.cloneaxisZ)
   {
@@ -666,7 +789,7 @@ void Sample::think(double time)
 
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
+    m_progManager.reloadChangedPrograms();
     Renderer::getRegistry()[m_tweak.renderer]->updatedPrograms(m_progManager);
     updatedPrograms();
   }
@@ -691,7 +814,7 @@ void Sample::think(double time)
     initRenderer(m_tweak.renderer, m_tweak.strategy);
   }
 
-  if(!m_tweak.animateActive && m_lastTweak.animateActive)
+  if(!m_tweak.animateActive && !m_tweak.animateCPU && (m_lastTweak.animateActive || m_lastTweak.animateCPU))
   {
     m_scene.resetMatrices();
   }
@@ -743,51 +866,53 @@ void Sample::think(double time)
     glDisable(GL_CULL_FACE);
   }
 
-  if(m_tweak.animateActive)
+  if(m_tweak.animateCPU)
   {
-    {
-      NV_PROFILE_GL_SECTION("Xplode");
-
-      float  speed      = 0.5;
-      float  scale      = m_tweak.animateMin + (cosf(float(time) * speed) * 0.5f + 0.5f) * (m_tweak.animateDelta);
-      GLuint totalNodes = GLuint(m_scene.m_matrices.size());
-      GLuint groupsize  = m_xplodeGroupSize;
-
-      glUseProgram(m_progManager.get(programs.xplode));
-      glUniform1f(0, scale);
-      glUniform1i(1, totalNodes);
+    NV_PROFILE_GL_SECTION("Xplode CPU");
 
-      nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, m_scene.m_matricesOrigTexGL);
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_scene.m_matricesGL);
+    float  speed    = 0.5;
+    float  scale    = m_tweak.animateMin + (cosf(float(time) * speed) * 0.5f + 0.5f) * (m_tweak.animateDelta);
+    size_t numNodes = m_scene.m_matrices.size();
 
-      glDispatchCompute((totalNodes + groupsize - 1) / groupsize, 1, 1);
-      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-
-      nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, 0);
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
-      glUseProgram(0);
+    if(m_xplodeMatrices.size() != numNodes)
+    {
+      // new scene, the level 0 world matrices are taken from here
+      m_xplodeMatrices = m_scene.m_matrices;
+      m_transformSystemCPU.init(&m_jobSystem);
     }
 
+    // same as xplode-animation.comp.glsl
+    for(size_t i = 0; i < numNodes; i++)
     {
-      NV_PROFILE_GL_SECTION("Tree");
-      TransformSystem::Buffer ids;
-      TransformSystem::Buffer world;
-      TransformSystem::Buffer object;
-
-      ids.buffer = m_scene.m_parentIDsGL;
-      ids.offset = 0;
-      ids.size   = sizeof(GLuint) * m_scene.m_matrices.size();
-
-      world.buffer = m_scene.m_matricesGL;
-      world.offset = 0;
-      world.size   = sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size();
+      const CadScene::MatrixNode& orig = m_scene.m_matrices[i];
+      CadScene::MatrixNode&       node = m_xplodeMatrices[i];
+
+      node.objectMatrix   = orig.objectMatrix;
+      node.objectMatrixIT = orig.objectMatrixIT;
+      node.objectMatrix.a03 *= scale;
+      node.objectMatrix.a13 *= scale;
+      node.objectMatrix.a23 *= scale;
+      node.objectMatrixIT.a30 /= scale;
+      node.objectMatrixIT.a31 /= scale;
+      node.objectMatrixIT.a32 /= scale;
+    }
 
-      object.buffer = m_scene.m_matricesGL;
-      object.offset = 0;
-      object.size   = sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size();
+    m_transformSystemCPU.markAllDirty();
+    m_transformSystemCPU.process(m_scene.m_nodeTree, m_xplodeMatrices[0].worldMatrix.mat_array, sizeof(CadScene::MatrixNode));
 
-      m_transformSystem.process(m_scene.m_nodeTree, ids, object, world);
+    if(m_tweak.animateCheck)
+    {
+      xplodeGPU(scale);
+      checkXplodeCPU();
     }
+
+    glNamedBufferSubData(m_scene.m_matricesGL, 0, sizeof(CadScene::MatrixNode) * numNodes, m_xplodeMatrices.data());
+  }
+  else if(m_tweak.animateActive)
+  {
+    float speed = 0.5;
+    float scale = m_tweak.animateMin + (cosf(float(time) * speed) * 0.5f + 0.5f) * (m_tweak.animateDelta);
+    xplodeGPU(scale);
   }
 
   {
@@ -796,6 +921,8 @@ void Sample::think(double time)
     m_resources.cullView.viewPos        = m_sceneUbo.viewPos.get_value();
     m_resources.cullView.viewDir        = m_sceneUbo.viewDir.get_value();
     m_resources.cullView.viewProjMatrix = m_sceneUbo.viewProjMatrix.get_value();
+    m_resources.cullFrustum             = m_tweak.cullFrustum;
+    m_resources.cullMatrices            = m_tweak.animateCPU ? m_xplodeMatrices.data() : m_scene.m_matrices.data();
 
     m_renderer->draw(m_tweak.shade, m_resources, m_profiler, m_progManager);
   }
@@ -906,6 +1033,9 @@ void Sample::setupConfigParameters()
   m_parameterList.add("msaa", &m_tweak.msaa);
   m_parameterList.add("clones", &m_tweak.clones);
   m_parameterList.add("xplode", &m_tweak.animateActive);
+  m_parameterList.add("xplodecpu", &m_tweak.animateCPU);
+  m_parameterList.add("xplodecheck", &m_tweak.animateCheck);
+  m_parameterList.add("cullfrustum", (uint32_t*)&m_tweak.cullFrustum);
   m_parameterList.add("zoom", &m_tweak.zoom);
 }
 
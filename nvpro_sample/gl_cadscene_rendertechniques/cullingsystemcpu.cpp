@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "cullingsystemcpu.hpp"
+
+#include <NvFoundation.h>
+#include <nvh/jobsystem.hpp>
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+#if defined(NV_X86) || defined(NV_X64)
+#define CULLCPU_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define CULLCPU_USE_SSE 0
+#endif
+
+// objects per job when a JobSystem is used
+static const size_t CULL_GRAIN_SIZE = 1024;
+
+static inline size_t minDivide(size_t val, size_t alignment)
+{
+  return (val + alignment - 1) / alignment;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void CullingSystemCPU::DepthPyramid::build(const float* depth, int width, int height)
+{
+  int numLevels = 0;
+  int dim       = std::max(width, height);
+  while(dim)
+  {
+    numLevels++;
+    dim /= 2;
+  }
+
+  m_levels.resize(numLevels);
+  m_levels[0].width  = width;
+  m_levels[0].height = height;
+  m_levels[0].texels.assign(depth, depth + size_t(width) * size_t(height));
+
+  for(int level = 1; level < numLevels; level++)
+  {
+    const Level& src = m_levels[level - 1];
+    Level&       dst = m_levels[level];
+
+    dst.width  = std::max(1, width >> level);
+    dst.height = std::max(1, height >> level);
+    dst.texels.resize(size_t(dst.width) * size_t(dst.height));
+
+    bool srcEven = (src.width % 2 == 0) && (src.height % 2 == 0);
+
+    for(int y = 0; y < dst.height; y++)
+    {
+      for(int x = 0; x < dst.width; x++)
+      {
+        float maxDepth = 0;
+        if(srcEven)
+        {
+          for(int i = 0; i < 4; i++)
+          {
+            int sx   = std::min(x * 2 + (i & 1), src.width - 1);
+            int sy   = std::min(y * 2 + (i >> 1), src.height - 1);
+            maxDepth = std::max(maxDepth, src.texels[size_t(sy) * src.width + sx]);
+          }
+        }
+        else
+        {
+          // same conservative 3x3 footprint as the shader for non-power of two
+          float u = (float(x) + 0.5f) / float(dst.width);
+          float v = (float(y) + 0.5f) / float(dst.height);
+          for(int oy = -1; oy <= 1; oy++)
+          {
+            for(int ox = -1; ox <= 1; ox++)
+            {
+              int sx   = int((u + float(ox) / float(src.width)) * float(src.width));
+              int sy   = int((v + float(oy) / float(src.height)) * float(src.height));
+              sx       = std::min(std::max(sx, 0), src.width - 1);
+              sy       = std::min(std::max(sy, 0), src.height - 1);
+              maxDepth = std::max(maxDepth, src.texels[size_t(sy) * src.width + sx]);
+            }
+          }
+        }
+        dst.texels[size_t(y) * dst.width + x] = maxDepth;
+      }
+    }
+  }
+}
+
+float CullingSystemCPU::DepthPyramid::sample(float u, float v, float lod) const
+{
+  // also catches NaN
+  int level = lod > 0.0f ? std::min(int(lod), getNumLevels() - 1) : 0;
+
+  const Level& lvl = m_levels[level];
+  int          x   = int(floorf(u * float(lvl.width)));
+  int          y   = int(floorf(v * float(lvl.height)));
+  x                = std::min(std::max(x, 0), lvl.width - 1);
+  y                = std::min(std::max(y, 0), lvl.height - 1);
+  return lvl.texels[size_t(y) * lvl.width + x];
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// column-major, out = a * b
+static inline void matrixMultiply(float* NV_RESTRICT out, const float* NV_RESTRICT a, const float* NV_RESTRICT b)
+{
+#if CULLCPU_USE_SSE
+  __m128 a0 = _mm_loadu_ps(a + 0);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 a3 = _mm_loadu_ps(a + 12);
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[c * 4 + 0]));
+    col        = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[c * 4 + 1])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[c * 4 + 2])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[c * 4 + 3])));
+    _mm_storeu_ps(out + c * 4, col);
+  }
+#else
+  for(int c = 0; c < 4; c++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      out[c * 4 + r] = a[r] * b[c * 4 + 0] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+    }
+  }
+#endif
+}
+
+#if CULLCPU_USE_SSE
+static inline float horizontalMin(__m128 v)
+{
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMax(__m128 v)
+{
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_cvtss_f32(v);
+}
+#endif
+
+// clip-space bbox of the projected box corners, see cull-xfb.vert.glsl
+static inline void projectBox(const float* NV_RESTRICT mvp, const float* bboxMin, const float* bboxMax, float clipMin[3], float clipMax[3])
+{
+#if CULLCPU_USE_SSE
+  // four corners at a time, same order as getBoxCorner
+  __m128 x = _mm_setr_ps(bboxMin[0], bboxMax[0], bboxMin[0], bboxMax[0]);
+  __m128 y = _mm_setr_ps(bboxMin[1], bboxMin[1], bboxMax[1], bboxMax[1]);
+
+  __m128 vmin[3];
+  __m128 vmax[3];
+  for(int half = 0; half < 2; half++)
+  {
+    float z = half ? bboxMax[2] : bboxMin[2];
+
+    __m128 hpos[4];
+    for(int r = 0; r < 4; r++)
+    {
+      hpos[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mvp[r]), x), _mm_mul_ps(_mm_set1_ps(mvp[4 + r]), y)),
+                           _mm_set1_ps(mvp[8 + r] * z + mvp[12 + r]));
+    }
+
+    for(int r = 0; r < 3; r++)
+    {
+      __m128 projected = _mm_div_ps(hpos[r], hpos[3]);
+      vmin[r]          = half ? _mm_min_ps(vmin[r], projected) : projected;
+      vmax[r]          = half ? _mm_max_ps(vmax[r], projected) : projected;
+    }
+  }
+
+  for(int r = 0; r < 3; r++)
+  {
+    clipMin[r] = horizontalMin(vmin[r]);
+    clipMax[r] = horizontalMax(vmax[r]);
+  }
+#else
+  for(int n = 0; n < 8; n++)
+  {
+    float corner[3] = {(n & 1) ? bboxMax[0] : bboxMin[0], (n & 2) ? bboxMax[1] : bboxMin[1], (n & 4) ? bboxMax[2] : bboxMin[2]};
+
+    float hpos[4];
+    for(int r = 0; r < 4; r++)
+    {
+      hpos[r] = mvp[r] * corner[0] + mvp[4 + r] * corner[1] + mvp[8 + r] * corner[2] + mvp[12 + r];
+    }
+
+    for(int r = 0; r < 3; r++)
+    {
+      float projected = hpos[r] / hpos[3];
+      clipMin[r]      = n ? std::min(clipMin[r], projected) : projected;
+      clipMax[r]      = n ? std::max(clipMax[r], projected) : projected;
+    }
+  }
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void CullingSystemCPU::init(bool dualindex, nvh::JobSystem* jobSystem)
+{
+  m_dualindex = dualindex;
+  m_jobSystem = jobSystem;
+}
+
+void CullingSystemCPU::deinit()
+{
+  m_jobSystem = nullptr;
+}
+
+void CullingSystemCPU::testBboxes(MethodType method, Job& job, const View& view, size_t begin, size_t end)
+{
+  size_t matrixStride       = job.m_matrixStride ? job.m_matrixStride : sizeof(float) * 16 * 2;
+  size_t objectMatrixStride = job.m_objectMatrixStride ? job.m_objectMatrixStride : sizeof(int32_t);
+  size_t objectBboxStride   = job.m_objectBboxStride ? job.m_objectBboxStride : (m_dualindex ? sizeof(int32_t) : sizeof(float) * 4 * 2);
+
+  const uint8_t* matrices     = (const uint8_t*)job.m_matrices;
+  const uint8_t* objectMatrix = (const uint8_t*)job.m_objectMatrix;
+  const uint8_t* objectBbox   = (const uint8_t*)job.m_objectBbox;
+
+  const DepthPyramid* pyramid = job.m_depthPyramid;
+  float               texsize = 0;
+  if(method == METHOD_HIZ)
+  {
+    assert(pyramid && pyramid->getNumLevels());
+    texsize = float(std::max(pyramid->getWidth(0), pyramid->getHeight(0)));
+  }
+
+  for(size_t i = begin; i < end; i++)
+  {
+    int32_t      matrixIndex = *(const int32_t*)(objectMatrix + objectMatrixStride * i);
+    const float* worldTM     = (const float*)(matrices + matrixStride * size_t(matrixIndex));
+
+    const float* bboxMin;
+    const float* bboxMax;
+    if(m_dualindex)
+    {
+      int32_t bboxIndex = *(const int32_t*)(objectBbox + objectBboxStride * i);
+      bboxMin           = job.m_bboxes + size_t(bboxIndex) * 8;
+      bboxMax           = bboxMin + 4;
+    }
+    else
+    {
+      bboxMin = (const float*)(objectBbox + objectBboxStride * i);
+      bboxMax = bboxMin + 4;
+    }
+
+    float worldViewProjTM[16];
+    matrixMultiply(worldViewProjTM, view.viewProjMatrix, worldTM);
+
+    float clipmin[3];
+    float clipmax[3];
+    projectBox(worldViewProjTM, bboxMin, bboxMax, clipmin, clipmax);
+
+    bool isvisible = clipmin[0] <= 1 && clipmin[1] <= 1 && clipmin[2] <= 1 && clipmax[0] >= -1 && clipmax[1] >= -1
+                     && clipmax[2] >= -1;
+
+    if(isvisible && method == METHOD_HIZ)
+    {
+      for(int r = 0; r < 3; r++)
+      {
+        clipmin[r] = clipmin[r] * 0.5f + 0.5f;
+        clipmax[r] = clipmax[r] * 0.5f + 0.5f;
+      }
+      float maxsize  = std::max(clipmax[0] - clipmin[0], clipmax[1] - clipmin[1]) * texsize;
+      float miplevel = ceilf(log2f(maxsize));
+
+      float depth = pyramid->sample(clipmin[0], clipmin[1], miplevel);
+      depth       = std::max(depth, pyramid->sample(clipmax[0], clipmin[1], miplevel));
+      depth       = std::max(depth, pyramid->sample(clipmax[0], clipmax[1], miplevel));
+      depth       = std::max(depth, pyramid->sample(clipmin[0], clipmax[1], miplevel));
+
+      isvisible = clipmin[2] <= depth;
+    }
+
+    job.m_visOutput[i] = isvisible ? 1 : 0;
+  }
+}
+
+void CullingSystemCPU::buildOutput(MethodType method, Job& job, const View& view)
+{
+  size_t numObjects = size_t(job.m_numObjects);
+
+  if(m_jobSystem)
+  {
+    m_jobSystem->parallelFor(
+        0, numObjects, [&](size_t begin, size_t end, uint32_t) { testBboxes(method, job, view, begin, end); }, CULL_GRAIN_SIZE);
+  }
+  else
+  {
+    testBboxes(method, job, view, 0, numObjects);
+  }
+}
+
+void CullingSystemCPU::bitsFromOutput(Job& job, BitType type)
+{
+  size_t numObjects = size_t(job.m_numObjects);
+  size_t numInts    = minDivide(numObjects, 32);
+
+  const int32_t* NV_RESTRICT output = job.m_visOutput;
+  const uint32_t* NV_RESTRICT last  = job.m_visBitsLast;
+  uint32_t* NV_RESTRICT current     = job.m_visBitsCurrent;
+
+  for(size_t i = 0; i < numInts; i++)
+  {
+    uint32_t bits = 0;
+    if((i + 1) * 32 <= numObjects)
+    {
+#if CULLCPU_USE_SSE
+      // lowest bit of each integer, moved to the sign for movemask
+      for(int n = 0; n < 8; n++)
+      {
+        __m128i values = _mm_loadu_si128((const __m128i*)(output + i * 32 + n * 4));
+        bits |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(values, 31)))) << (n * 4);
+      }
+#else
+      for(int n = 0; n < 32; n++)
+      {
+        bits |= uint32_t(output[i * 32 + n] & 1) << n;
+      }
+#endif
+    }
+    else
+    {
+      for(size_t n = 0; n < numObjects - i * 32; n++)
+      {
+        bits |= uint32_t(output[i * 32 + n] & 1) << n;
+      }
+    }
+
+    if(type == BITS_CURRENT_AND_LAST)
+    {
+      // render what was visible in last frame and passes current test
+      bits &= last[i];
+    }
+    else if(type == BITS_CURRENT_AND_NOT_LAST)
+    {
+      // render what was not visible in last frame (already rendered), but is now visible
+      bits &= ~last[i];
+    }
+
+    current[i] = bits;
+  }
+}
+
+void CullingSystemCPU::resultFromBits(Job& job)
+{
+  job.resultFromBits(job.m_visBitsCurrent);
+}
+
+void CullingSystemCPU::resultClient(Job& job)
+{
+  job.resultClient();
+}
+
+void CullingSystemCPU::swapBits(Job& job)
+{
+  std::swap(job.m_visBitsCurrent, job.m_visBitsLast);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef CULLINGSYSTEMCPU_H__
+#define CULLINGSYSTEMCPU_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nvh {
+class JobSystem;
+}
+
+/*
+  Host-side counterpart of CullingSystem, it does not depend on GL.
+
+  The per-object results and the bit packing follow the same contract as
+  the shaders used by CullingSystem (cull-xfb.vert.glsl and cull-bitpack.vert.glsl):
+  one 32-bit integer per object in the output, which is then packed into
+  one bit per object, optionally combined with the last frame's bits.
+  This allows culling on otherwise idle cores and validating the GPU
+  results without a GPU.
+
+  Only the frustum and hiz methods exist, the hiz method tests against a
+  DepthPyramid built on the host, mirroring cull-downsample.frag.glsl.
+
+  All data is provided as pointers in the Job, strides are in bytes,
+  0 selects the same defaults as the GL system.
+*/
+
+class CullingSystemCPU
+{
+public:
+  enum MethodType
+  {
+    METHOD_FRUSTUM,
+    METHOD_HIZ,
+    NUM_METHODS,
+  };
+
+  enum BitType
+  {
+    BITS_CURRENT,
+    BITS_CURRENT_AND_LAST,
+    BITS_CURRENT_AND_NOT_LAST,
+    NUM_BITS,
+  };
+
+  class DepthPyramid
+  {
+  public:
+    // depth is window-space [0,1], row 0 is the bottom row (GL convention)
+    // every level stores the maximum depth of the texels it covers
+    void build(const float* depth, int width, int height);
+
+    int getNumLevels() const { return int(m_levels.size()); }
+    int getWidth(int level) const { return m_levels[level].width; }
+    int getHeight(int level) const { return m_levels[level].height; }
+
+    // like textureLod with GL_NEAREST_MIPMAP_NEAREST, but clamps to edge
+    float sample(float u, float v, float lod) const;
+
+  private:
+    struct Level
+    {
+      int                width;
+      int                height;
+      std::vector<float> texels;
+    };
+
+    std::vector<Level> m_levels;
+  };
+
+  class Job
+  {
+  public:
+    int m_numObjects = 0;
+
+    // world-space matrices {mat4 world, ...} column-major, default stride 2 x mat4
+    const float* m_matrices     = nullptr;
+    size_t       m_matrixStride = 0;
+    // only used in dualindex mode (2 x vec4)
+    const float* m_bboxes = nullptr;
+    // 1 32-bit integer per object (index)
+    const int32_t* m_objectMatrix       = nullptr;
+    size_t         m_objectMatrixStride = 0;
+    // object-space bounding box (2 x vec4)
+    // or 1 32-bit integer per object (dualindex mode)
+    const void* m_objectBbox       = nullptr;
+    size_t      m_objectBboxStride = 0;
+
+    // 1 32-bit integer per object
+    int32_t* m_visOutput = nullptr;
+
+    // 1 32-bit integer per 32 objects (1 bit per object)
+    uint32_t* m_visBitsCurrent = nullptr;
+    uint32_t* m_visBitsLast    = nullptr;
+
+    // for HiZ
+    const DepthPyramid* m_depthPyramid = nullptr;
+
+    // derive from this class and implement this function how you want to
+    // deal with the results that are provided in the bits
+    virtual void resultFromBits(const uint32_t* /*visBitsCurrent*/) {}
+    virtual void resultClient() {}
+  };
+
+  struct View
+  {
+    const float* viewProjMatrix;
+    const float* viewDir;
+    const float* viewPos;
+  };
+
+  // jobSystem is optional, without it everything runs on the calling thread
+  void init(bool dualindex, nvh::JobSystem* jobSystem = nullptr);
+  void deinit();
+
+  void buildOutput(MethodType method, Job& job, const View& view);
+
+  void bitsFromOutput(Job& job, BitType type);
+  void resultFromBits(Job& job);
+  void resultClient(Job& job);
+
+  // swaps the Current/Last bit array (for temporal coherent techniques)
+  void swapBits(Job& job);
+
+private:
+  void testBboxes(MethodType method, Job& job, const View& view, size_t begin, size_t end);
+
+  bool            m_dualindex = false;
+  nvh::JobSystem* m_jobSystem = nullptr;
+};
+
+#endif
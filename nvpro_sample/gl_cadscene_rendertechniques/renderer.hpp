@@ -62,6 +62,13 @@ namespace csfviewer {
 
   const char* toString(enum ShadeType st);
 
+  // where the frustum culling of the "cull" renderers runs
+  enum CullFrustum {
+    CULL_FRUSTUM_GPU,
+    CULL_FRUSTUM_CPU,     // CullingSystemCPU, only the bits are uploaded
+    CULL_FRUSTUM_COMPARE, // both, the GPU bits are read back and compared (slow, for debugging)
+  };
+
   struct Resources {
     GLuint    sceneUbo;
     GLuint64  sceneAddr;
@@ -81,6 +88,9 @@ namespace csfviewer {
     size_t    fboTextureChangeID;
 
     CullingSystem::View cullView;
+    CullFrustum         cullFrustum;
+    // host copy of the current matrices, used by CULL_FRUSTUM_CPU
+    const CadScene::MatrixNode* cullMatrices;
 
     // ugly hack
     mutable GLuint programUsed;
@@ -97,6 +107,8 @@ namespace csfviewer {
     Resources() {
       stateChangeID = 0;
       fboTextureChangeID = 0;
+      cullFrustum = CULL_FRUSTUM_GPU;
+      cullMatrices = nullptr;
     }
   };
 
@@ -22,6 +22,10 @@
 
 #include "tokenbase.hpp"
 #include "cullingsystem.hpp"
+#include "cullingsystemcpu.hpp"
+
+#include <nvh/jobsystem.hpp>
+#include <thread>
 
 #include <nvmath/nvmath_glsltypes.h>
 
@@ -31,6 +35,7 @@ namespace csfviewer
 {
   //////////////////////////////////////////////////////////////////////////
 
+// Resources::cullFrustum other than CULL_FRUSTUM_GPU always uses the frustum-only path
 #define USE_TEMPORALRASTER      1
 #define USE_OBJECTSORT_CULLING  1
 
@@ -185,10 +190,18 @@ namespace csfviewer
     std::vector<DrawItem>       m_drawItems;
 
     CullJobToken                m_culljob;
+    nvh::JobSystem              m_jobSystem;
+    CullingSystemCPU            m_cullsysCPU;
+    CullingSystemCPU::Job       m_culljobCPU;
+    std::vector<int32_t>        m_cpuVisOutput;
+    std::vector<uint32_t>       m_cpuVisBits;
+    std::vector<uint32_t>       m_gpuVisBits;
+    int                         m_lastMismatches;
     CullShade                   m_cullshades[NUM_SHADES];
     GLuint                      m_maxGrps;
 
     void PrepareCullJob(ShadeType shade);
+    void CompareCullBits();
 
 
     template <class T>
@@ -437,6 +450,26 @@ namespace csfviewer
     glClearNamedBufferData(m_culljob.m_bufferVisBitsLast.buffer,GL_R32UI,GL_RED_INTEGER,GL_UNSIGNED_INT,0);
 
     m_culljob.m_bufferVisOutput.create(sizeof(int)*roundedInts,NULL,0);
+
+    m_jobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    m_cullsysCPU.init(true, &m_jobSystem);
+
+    m_cpuVisOutput.resize(roundedInts);
+    m_cpuVisBits.resize(roundedBits);
+    m_gpuVisBits.resize(roundedBits);
+    m_lastMismatches = 0;
+
+    // same layout as the GL buffers above
+    m_culljobCPU.m_numObjects         = m_culljob.m_numObjects;
+    m_culljobCPU.m_matrices           = (const float*)m_scene->m_matrices.data();
+    m_culljobCPU.m_matrixStride       = sizeof(CadScene::MatrixNode);
+    m_culljobCPU.m_bboxes             = (const float*)m_scene->m_geometryBboxes.data();
+    m_culljobCPU.m_objectMatrix       = (const int32_t*)m_scene->m_objectAssigns.data();
+    m_culljobCPU.m_objectMatrixStride = sizeof(GLint)*2;
+    m_culljobCPU.m_objectBbox         = (const int32_t*)m_scene->m_objectAssigns.data() + 1;
+    m_culljobCPU.m_objectBboxStride   = sizeof(GLint)*2;
+    m_culljobCPU.m_visOutput          = m_cpuVisOutput.data();
+    m_culljobCPU.m_visBitsCurrent     = m_cpuVisBits.data();
     m_cullshades[SHADE_SOLIDWIRE_SPLIT] = m_cullshades[SHADE_SOLIDWIRE];
   }
 
@@ -458,6 +491,8 @@ namespace csfviewer
     glDeleteBuffers(1,&m_culljob.m_bufferVisBitsLast.buffer);
     glDeleteBuffers(1,&m_culljob.m_bufferVisOutput.buffer);
 
+    m_cullsysCPU.deinit();
+    m_jobSystem.deinit();
 
     TokenRendererBase::deinit();
     m_drawItems.clear();
@@ -476,6 +511,31 @@ namespace csfviewer
     job.tokenOut.size   = m_cullshades[shade].tokenOrig.size;
   }
 
+  void RendererCullSortToken::CompareCullBits()
+  {
+    // stalls on the GPU results, only meant for debugging
+    glGetNamedBufferSubData(m_culljob.m_bufferVisBitsCurrent.buffer, m_culljob.m_bufferVisBitsCurrent.offset,
+                            sizeof(uint32_t) * m_gpuVisBits.size(), m_gpuVisBits.data());
+
+    int mismatches = 0;
+    int firstMismatch = -1;
+    for (int i = 0; i < m_culljob.m_numObjects; i++){
+      uint32_t bitCPU = (m_cpuVisBits[i / 32] >> (i % 32)) & 1;
+      uint32_t bitGPU = (m_gpuVisBits[i / 32] >> (i % 32)) & 1;
+      if (bitCPU != bitGPU){
+        firstMismatch = firstMismatch < 0 ? i : firstMismatch;
+        mismatches++;
+      }
+    }
+
+    // objects touching the frustum planes may differ by float rounding,
+    // everything differs when the matrices are animated on the GPU only
+    if (mismatches != m_lastMismatches){
+      LOGI("cull compare: %d of %d objects differ between CPU and GPU (first %d)\n", mismatches, m_culljob.m_numObjects, firstMismatch);
+      m_lastMismatches = mismatches;
+    }
+  }
+
   void RendererCullSortToken::CullJobToken::resultFromBits( const CullingSystem::Buffer& bufferVisBitsCurrent )
   {
     // first compute sizes based on culling result
@@ -621,34 +681,56 @@ namespace csfviewer
     CullingSystem& cullSys = Renderer::s_cullsys;
 
 
-#if !USE_TEMPORALRASTER
-
+    if (!USE_TEMPORALRASTER || resources.cullFrustum != CULL_FRUSTUM_GPU)
     {
-      nvh::Profiler::Section section(profiler,"CullF");
-      cullSys.buildOutput( CullingSystem::METHOD_FRUSTUM, m_culljob, resources.cullView );
-      cullSys.bitsFromOutput( m_culljob, CullingSystem::BITS_CURRENT );
       {
-        nvh::Profiler::Section section(profiler,"ResF");
-        cullSys.resultFromBits( m_culljob );
-      }
+        nvh::Profiler::Section section(profiler,"CullF");
+        if (resources.cullFrustum != CULL_FRUSTUM_GPU)
+        {
+          // "CullFCpu" and "CullFGpu" time both sides in CULL_FRUSTUM_COMPARE
+          nvh::Profiler::Section section(profiler,"CullFCpu");
+          // without a host copy of the animated matrices, the unanimated ones are used
+          CullingSystemCPU::View view = { resources.cullView.viewProjMatrix, resources.cullView.viewDir, resources.cullView.viewPos };
+          m_culljobCPU.m_matrices = (const float*)(resources.cullMatrices ? resources.cullMatrices : m_scene->m_matrices.data());
+          m_cullsysCPU.buildOutput( CullingSystemCPU::METHOD_FRUSTUM, m_culljobCPU, view );
+          m_cullsysCPU.bitsFromOutput( m_culljobCPU, CullingSystemCPU::BITS_CURRENT );
+        }
+        if (resources.cullFrustum != CULL_FRUSTUM_CPU)
+        {
+          nvh::Profiler::Section section(profiler,"CullFGpu");
+          cullSys.buildOutput( CullingSystem::METHOD_FRUSTUM, m_culljob, resources.cullView );
+          cullSys.bitsFromOutput( m_culljob, CullingSystem::BITS_CURRENT );
+        }
 
-      if (m_emulate){
-        nvh::Profiler::Section read(profiler,"Read");
-        m_culljob.tokenOut.GetNamedBufferSubData(&m_tokenStream[m_culljob.tokenOut.offset]);
-        GLuint* first = (GLuint*)&m_tokenStream[m_culljob.tokenOut.offset];
-        first[0] = first[0];
-      }
-      else {
-        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_culljob.tokenOut.buffer);
-        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
-        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
-        //glFinish();
-      }
-    }
+        if (resources.cullFrustum == CULL_FRUSTUM_COMPARE){
+          CompareCullBits();
+        }
+        else if (resources.cullFrustum == CULL_FRUSTUM_CPU){
+          glNamedBufferSubData(m_culljob.m_bufferVisBitsCurrent.buffer, m_culljob.m_bufferVisBitsCurrent.offset,
+                               sizeof(uint32_t) * m_cpuVisBits.size(), m_cpuVisBits.data());
+        }
 
-    drawScene(shadetype,resources,profiler,progManager, "Last");
+        {
+          nvh::Profiler::Section section(profiler,"ResF");
+          cullSys.resultFromBits( m_culljob );
+        }
 
-#else
+        if (m_emulate){
+          nvh::Profiler::Section read(profiler,"Read");
+          void* data = &m_tokenStreams[shadetype][m_culljob.tokenOut.offset];
+          m_culljob.tokenOut.GetNamedBufferSubData(data);
+        }
+        else {
+          glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_culljob.tokenOut.buffer);
+          glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+          glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+          //glFinish();
+        }
+      }
+
+      drawScene(shadetype,resources,profiler,progManager, "Last");
+      return;
+    }
 
     {
       nvh::Profiler::Section section(profiler,"CullF");
@@ -709,7 +791,6 @@ namespace csfviewer
     }
 
     drawScene(shadetype,resources,profiler,progManager, "New");
-#endif
   }
 
 }
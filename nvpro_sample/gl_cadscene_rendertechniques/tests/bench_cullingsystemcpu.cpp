@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Throughput of CullingSystemCPU per object for the frustum and hiz methods
+// and the bit packing, with a growing number of threads. The GPU side of the
+// same work shows up as "CullFGpu" next to "CullFCpu" in the sample's
+// profiler when the cull frustum mode is "CPU & GPU compare".
+
+#include "cullingtestscene.hpp"
+
+#include <nvh/jobsystem.hpp>
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+template <typename T>
+static double nsPerObject(T&& fn, int numObjects, int iterations)
+{
+  fn();  // warm up
+  Clock::time_point begin = Clock::now();
+  for(int i = 0; i < iterations; i++)
+  {
+    fn();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / (double(numObjects) * double(iterations));
+}
+
+int main()
+{
+  const int      numObjects = 1 << 20;
+  const int      iterations = 10;
+  const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  TestScene scene;
+  makeScene(scene, numObjects, 4096, 1024);
+
+  int                   numBits = (numObjects + 31) / 32;
+  std::vector<int32_t>  output(numBits * 32);
+  std::vector<uint32_t> bitsCurrent(numBits);
+  std::vector<uint32_t> bitsLast(numBits);
+
+  std::vector<float> depth(1920 * 1080);
+  for(size_t i = 0; i < depth.size(); i++)
+  {
+    depth[i] = (i % 1920) < 960 ? 0.3f : 1.0f;
+  }
+
+  CullingSystemCPU::DepthPyramid pyramid;
+  double pyramidMs = nsPerObject([&]() { pyramid.build(depth.data(), 1920, 1080); }, 1, iterations) / 1.0e6;
+  printf("depth pyramid 1920x1080: %.2f ms\n\n", pyramidMs);
+
+  CullingSystemCPU::Job job;
+  setupJob(job, scene, output, bitsCurrent, bitsLast);
+  job.m_depthPyramid = &pyramid;
+
+  CullingSystemCPU::View view = {scene.viewProj, scene.viewDir, scene.viewPos};
+
+  printf("%d objects\n", numObjects);
+  printf("threads | frustum ns/object | hiz ns/object | bits ns/object\n");
+
+  for(uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+  {
+    nvh::JobSystem jobSystem;
+    jobSystem.init(numThreads - 1);
+
+    CullingSystemCPU cullsys;
+    cullsys.init(true, numThreads > 1 ? &jobSystem : nullptr);
+
+    double frustumTime =
+        nsPerObject([&]() { cullsys.buildOutput(CullingSystemCPU::METHOD_FRUSTUM, job, view); }, numObjects, iterations);
+    double hizTime = nsPerObject([&]() { cullsys.buildOutput(CullingSystemCPU::METHOD_HIZ, job, view); }, numObjects, iterations);
+    double bitsTime =
+        nsPerObject([&]() { cullsys.bitsFromOutput(job, CullingSystemCPU::BITS_CURRENT_AND_LAST); }, numObjects, iterations);
+
+    printf("%7u | %17.2f | %13.2f | %14.3f\n", numThreads, frustumTime, hizTime, bitsTime);
+
+    cullsys.deinit();
+    jobSystem.deinit();
+  }
+
+  return 0;
+}
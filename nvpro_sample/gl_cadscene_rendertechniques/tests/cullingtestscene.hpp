@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Random scene shared by test_cullingsystemcpu and bench_cullingsystemcpu.
+
+#ifndef CULLINGTESTSCENE_H__
+#define CULLINGTESTSCENE_H__
+
+#include "../cullingsystemcpu.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+// same layout as CadScene::MatrixNode
+struct MatrixNode
+{
+  float worldMatrix[16];
+  float worldMatrixIT[16];
+  float objectMatrix[16];
+  float objectMatrixIT[16];
+};
+
+struct TestScene
+{
+  std::vector<MatrixNode> matrices;
+  std::vector<float>      bboxes;   // min.xyzw, max.xyzw
+  std::vector<int32_t>    assigns;  // matrix, bbox (dualindex)
+  float                   viewProj[16];
+  float                   viewDir[4];
+  float                   viewPos[4];
+  int                     numObjects;
+};
+
+inline void multiply(float* out, const float* a, const float* b)
+{
+  for(int c = 0; c < 4; c++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      double sum = 0;
+      for(int k = 0; k < 4; k++)
+      {
+        sum += double(a[k * 4 + r]) * double(b[c * 4 + k]);
+      }
+      out[c * 4 + r] = float(sum);
+    }
+  }
+}
+
+inline void makeScene(TestScene& scene, int numObjects, int numMatrices, int numBoxes)
+{
+  std::mt19937                          rng(1);
+  std::uniform_real_distribution<float> rnd(-1.0f, 1.0f);
+
+  scene.numObjects = numObjects;
+
+  scene.matrices.resize(numMatrices);
+  for(MatrixNode& node : scene.matrices)
+  {
+    for(int i = 0; i < 16; i++)
+    {
+      node.worldMatrix[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+    node.worldMatrix[0]  = 1.0f + rnd(rng) * 0.5f;
+    node.worldMatrix[1]  = rnd(rng) * 0.3f;
+    node.worldMatrix[12] = rnd(rng) * 50.0f;
+    node.worldMatrix[13] = rnd(rng) * 50.0f;
+    node.worldMatrix[14] = rnd(rng) * 50.0f;
+  }
+
+  scene.bboxes.resize(numBoxes * 8);
+  for(int b = 0; b < numBoxes; b++)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      float center = rnd(rng) * 3.0f;
+      float extent = fabsf(rnd(rng)) * 2.0f;
+      scene.bboxes[b * 8 + i]     = center - extent;
+      scene.bboxes[b * 8 + 4 + i] = center + extent;
+    }
+    scene.bboxes[b * 8 + 3] = 1.0f;
+    scene.bboxes[b * 8 + 7] = 1.0f;
+  }
+
+  scene.assigns.resize(numObjects * 2);
+  for(int i = 0; i < numObjects; i++)
+  {
+    scene.assigns[i * 2 + 0] = int32_t(rng() % numMatrices);
+    scene.assigns[i * 2 + 1] = int32_t(rng() % numBoxes);
+  }
+
+  // perspective projection looking down -z from (0,0,30), column-major
+  float f        = 1.0f / tanf(0.5f);
+  float nearDist = 0.1f;
+  float farDist  = 200.0f;
+  float proj[16] = {f, 0, 0, 0, 0, f, 0, 0, 0, 0, (farDist + nearDist) / (nearDist - farDist), -1,
+                    0, 0, 2 * farDist * nearDist / (nearDist - farDist), 0};
+  float view[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -30, 1};
+  multiply(scene.viewProj, proj, view);
+
+  float dir[4] = {0, 0, -1, 0};
+  float pos[4] = {0, 0, 30, 1};
+  std::copy(dir, dir + 4, scene.viewDir);
+  std::copy(pos, pos + 4, scene.viewPos);
+}
+
+inline void setupJob(CullingSystemCPU::Job& job, TestScene& scene, std::vector<int32_t>& output, std::vector<uint32_t>& bitsCurrent, std::vector<uint32_t>& bitsLast)
+{
+  job.m_numObjects         = scene.numObjects;
+  job.m_matrices           = scene.matrices[0].worldMatrix;
+  job.m_matrixStride       = sizeof(MatrixNode);
+  job.m_bboxes             = scene.bboxes.data();
+  job.m_objectMatrix       = scene.assigns.data();
+  job.m_objectMatrixStride = sizeof(int32_t) * 2;
+  job.m_objectBbox         = scene.assigns.data() + 1;
+  job.m_objectBboxStride   = sizeof(int32_t) * 2;
+  job.m_visOutput          = output.data();
+  job.m_visBitsCurrent     = bitsCurrent.data();
+  job.m_visBitsLast        = bitsLast.data();
+}
+
+#endif
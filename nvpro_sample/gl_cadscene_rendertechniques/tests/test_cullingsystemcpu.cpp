@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// CullingSystemCPU against a straightforward double precision version of
+// cull-xfb.vert.glsl and cull-bitpack.vert.glsl, so the host culling can be
+// validated without a GPU. Objects within a small epsilon of the frustum
+// planes may go either way.
+
+#include "cullingtestscene.hpp"
+
+#include <nvh/jobsystem.hpp>
+
+#include <stdio.h>
+
+// 1 inside, 0 outside, -1 within epsilon of the frustum planes
+static int referenceFrustum(const TestScene& scene, int object, float epsilon)
+{
+  const float* world = scene.matrices[scene.assigns[object * 2 + 0]].worldMatrix;
+  const float* bmin  = &scene.bboxes[scene.assigns[object * 2 + 1] * 8];
+  const float* bmax  = bmin + 4;
+
+  float mvp[16];
+  multiply(mvp, scene.viewProj, world);
+
+  double clipMin[3];
+  double clipMax[3];
+  for(int n = 0; n < 8; n++)
+  {
+    double corner[3] = {(n & 1) ? bmax[0] : bmin[0], (n & 2) ? bmax[1] : bmin[1], (n & 4) ? bmax[2] : bmin[2]};
+    double hpos[4];
+    for(int r = 0; r < 4; r++)
+    {
+      hpos[r] = mvp[r] * corner[0] + mvp[4 + r] * corner[1] + mvp[8 + r] * corner[2] + mvp[12 + r];
+    }
+    for(int r = 0; r < 3; r++)
+    {
+      double v   = hpos[r] / hpos[3];
+      clipMin[r] = n ? std::min(clipMin[r], v) : v;
+      clipMax[r] = n ? std::max(clipMax[r], v) : v;
+    }
+  }
+
+  bool inside  = true;
+  bool outside = false;
+  for(int r = 0; r < 3; r++)
+  {
+    inside  = inside && clipMin[r] <= 1.0 - epsilon && clipMax[r] >= -1.0 + epsilon;
+    outside = outside || clipMin[r] > 1.0 + epsilon || clipMax[r] < -1.0 - epsilon;
+  }
+  return inside ? 1 : (outside ? 0 : -1);
+}
+
+static bool getBit(const std::vector<uint32_t>& bits, int i)
+{
+  return (bits[i / 32] >> (i % 32)) & 1;
+}
+
+static int testFrustumAndBits(TestScene& scene, nvh::JobSystem* jobSystem)
+{
+  int failed = 0;
+
+  int                   numBits = (scene.numObjects + 31) / 32;
+  std::vector<int32_t>  output(numBits * 32);
+  std::vector<uint32_t> bitsCurrent(numBits);
+  std::vector<uint32_t> bitsLast(numBits);
+
+  std::mt19937 rng(2);
+  for(uint32_t& bits : bitsLast)
+  {
+    bits = rng();
+  }
+
+  CullingSystemCPU::Job job;
+  setupJob(job, scene, output, bitsCurrent, bitsLast);
+
+  CullingSystemCPU cullsys;
+  cullsys.init(true, jobSystem);
+
+  CullingSystemCPU::View view = {scene.viewProj, scene.viewDir, scene.viewPos};
+  cullsys.buildOutput(CullingSystemCPU::METHOD_FRUSTUM, job, view);
+
+  int visible    = 0;
+  int mismatches = 0;
+  int ambiguous  = 0;
+  for(int i = 0; i < scene.numObjects; i++)
+  {
+    int ref = referenceFrustum(scene, i, 1.0e-4f);
+    visible += output[i] ? 1 : 0;
+    ambiguous += ref < 0 ? 1 : 0;
+    if(ref >= 0 && (output[i] != 0) != (ref != 0))
+    {
+      if(!mismatches)
+      {
+        printf("  object %d: got %d expected %d\n", i, output[i], ref);
+      }
+      mismatches++;
+    }
+  }
+  printf("frustum %s: %d of %d visible, %d near the planes, %d mismatches\n", jobSystem ? "threaded" : "single", visible,
+         scene.numObjects, ambiguous, mismatches);
+  failed += mismatches ? 1 : 0;
+
+  for(int type = 0; type < CullingSystemCPU::NUM_BITS; type++)
+  {
+    cullsys.bitsFromOutput(job, CullingSystemCPU::BitType(type));
+    for(int i = 0; i < scene.numObjects; i++)
+    {
+      bool expected = output[i] != 0;
+      if(type == CullingSystemCPU::BITS_CURRENT_AND_LAST)
+        expected = expected && getBit(bitsLast, i);
+      else if(type == CullingSystemCPU::BITS_CURRENT_AND_NOT_LAST)
+        expected = expected && !getBit(bitsLast, i);
+
+      if(getBit(bitsCurrent, i) != expected)
+      {
+        printf("  bits type %d: object %d wrong\n", type, i);
+        failed++;
+        break;
+      }
+    }
+    // bits past the last object must stay cleared
+    for(int i = scene.numObjects; i < numBits * 32; i++)
+    {
+      if(getBit(bitsCurrent, i))
+      {
+        printf("  bits type %d: padding bit %d set\n", type, i);
+        failed++;
+        break;
+      }
+    }
+  }
+
+  cullsys.deinit();
+  return failed;
+}
+
+static int testHiz(TestScene& scene, nvh::JobSystem* jobSystem)
+{
+  int failed = 0;
+
+  // odd size, the left half is covered by a wall
+  int                width  = 333;
+  int                height = 200;
+  std::vector<float> depth(width * height);
+  for(int y = 0; y < height; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      depth[y * width + x] = x < width / 2 ? 0.3f : 1.0f;
+    }
+  }
+
+  CullingSystemCPU::DepthPyramid pyramid;
+  pyramid.build(depth.data(), width, height);
+
+  // every level must be conservative against all level 0 texels it covers
+  for(int level = 1; level < pyramid.getNumLevels(); level++)
+  {
+    bool conservative = true;
+    for(int y = 0; y < height && conservative; y++)
+    {
+      for(int x = 0; x < width && conservative; x++)
+      {
+        float u      = (float(x) + 0.5f) / float(width);
+        float v      = (float(y) + 0.5f) / float(height);
+        conservative = pyramid.sample(u, v, float(level)) >= depth[y * width + x];
+      }
+    }
+    if(!conservative)
+    {
+      printf("  pyramid level %d not conservative\n", level);
+      failed++;
+    }
+  }
+
+  int                   numBits = (scene.numObjects + 31) / 32;
+  std::vector<int32_t>  output(numBits * 32);
+  std::vector<uint32_t> bitsCurrent(numBits);
+  std::vector<uint32_t> bitsLast(numBits);
+
+  CullingSystemCPU::Job job;
+  setupJob(job, scene, output, bitsCurrent, bitsLast);
+  job.m_depthPyramid = &pyramid;
+
+  CullingSystemCPU cullsys;
+  cullsys.init(true, jobSystem);
+
+  CullingSystemCPU::View view = {scene.viewProj, scene.viewDir, scene.viewPos};
+  cullsys.buildOutput(CullingSystemCPU::METHOD_FRUSTUM, job, view);
+  std::vector<int32_t> frustum(output);
+  cullsys.buildOutput(CullingSystemCPU::METHOD_HIZ, job, view);
+
+  // hiz may only remove objects
+  int visibleFrustum = 0;
+  int visibleHiz     = 0;
+  int hizOnly        = 0;
+  for(int i = 0; i < scene.numObjects; i++)
+  {
+    visibleFrustum += frustum[i] ? 1 : 0;
+    visibleHiz += output[i] ? 1 : 0;
+    hizOnly += (output[i] && !frustum[i]) ? 1 : 0;
+  }
+  printf("hiz %s: %d of %d frustum visible, %d only visible with hiz\n", jobSystem ? "threaded" : "single", visibleHiz,
+         visibleFrustum, hizOnly);
+  failed += hizOnly ? 1 : 0;
+  failed += visibleHiz < visibleFrustum ? 0 : 1;
+
+  cullsys.deinit();
+  return failed;
+}
+
+int main()
+{
+  TestScene scene;
+  makeScene(scene, 100003, 500, 300);
+
+  nvh::JobSystem jobSystem;
+  jobSystem.init(3);
+
+  int failed = 0;
+  failed += testFrustumAndBits(scene, nullptr);
+  failed += testFrustumAndBits(scene, &jobSystem);
+  failed += testHiz(scene, nullptr);
+  failed += testHiz(scene, &jobSystem);
+
+  jobSystem.deinit();
+
+  printf(failed ? "FAILED\n" : "passed\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// TransformSystemCPU against a straightforward double precision version of
+// transform-level.comp.glsl, for all ways of splitting the levels into level
+// passes and leaf chains, with and without job system. Partial updates must
+// only write the subtrees of dirty nodes: the inverse transposes of all other
+// nodes are set to NaN before and must still be NaN afterwards.
+
+#include "../transformsystemcpu.hpp"
+
+#include <nvh/jobsystem.hpp>
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// same layout as CadScene::MatrixNode
+struct MatrixNode
+{
+  float worldMatrix[16];
+  float worldMatrixIT[16];
+  float objectMatrix[16];
+  float objectMatrixIT[16];
+};
+
+static void multiplyRef(double* out, const double* a, const double* b)
+{
+  for(int c = 0; c < 4; c++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      double sum = 0;
+      for(int k = 0; k < 4; k++)
+      {
+        sum += a[k * 4 + r] * b[c * 4 + k];
+      }
+      out[c * 4 + r] = sum;
+    }
+  }
+}
+
+// Gauss-Jordan with partial pivoting, column-major
+static void invertRef(double* out, const double* m)
+{
+  double a[4][8];
+  for(int r = 0; r < 4; r++)
+  {
+    for(int c = 0; c < 4; c++)
+    {
+      a[r][c]     = m[c * 4 + r];
+      a[r][c + 4] = r == c ? 1.0 : 0.0;
+    }
+  }
+  for(int i = 0; i < 4; i++)
+  {
+    int pivot = i;
+    for(int r = i + 1; r < 4; r++)
+    {
+      if(fabs(a[r][i]) > fabs(a[pivot][i]))
+        pivot = r;
+    }
+    for(int c = 0; c < 8; c++)
+    {
+      std::swap(a[i][c], a[pivot][c]);
+    }
+    double d = a[i][i];
+    for(int c = 0; c < 8; c++)
+    {
+      a[i][c] /= d;
+    }
+    for(int r = 0; r < 4; r++)
+    {
+      if(r == i)
+        continue;
+      double f = a[r][i];
+      for(int c = 0; c < 8; c++)
+      {
+        a[r][c] -= f * a[i][c];
+      }
+    }
+  }
+  for(int r = 0; r < 4; r++)
+  {
+    for(int c = 0; c < 4; c++)
+    {
+      out[c * 4 + r] = a[r][c + 4];
+    }
+  }
+}
+
+// world = world[parent] * object, level 0 keeps its world matrices
+static void referenceTransforms(const NodeTree& tree, std::vector<MatrixNode>& matrices)
+{
+  std::vector<double> world(matrices.size() * 16);
+  for(int level = 0; level < tree.getNumUsedLevel(); level++)
+  {
+    for(NodeTree::nodeID node : tree.getUsedLevel(level)->nodes)
+    {
+      double* nodeWorld = &world[node * 16];
+      if(level == 0)
+      {
+        for(int i = 0; i < 16; i++)
+        {
+          nodeWorld[i] = matrices[node].worldMatrix[i];
+        }
+        continue;
+      }
+
+      double object[16];
+      for(int i = 0; i < 16; i++)
+      {
+        object[i] = matrices[node].objectMatrix[i];
+      }
+      multiplyRef(nodeWorld, &world[tree.getParentNode(node) * 16], object);
+
+      double inverse[16];
+      invertRef(inverse, nodeWorld);
+      for(int c = 0; c < 4; c++)
+      {
+        for(int r = 0; r < 4; r++)
+        {
+          matrices[node].worldMatrix[c * 4 + r]   = float(nodeWorld[c * 4 + r]);
+          matrices[node].worldMatrixIT[c * 4 + r] = float(inverse[r * 4 + c]);
+        }
+      }
+    }
+  }
+}
+
+// rotation, uniform scale around 1 and translation
+static void randomMatrix(std::mt19937& rng, float* m)
+{
+  std::uniform_real_distribution<float> rnd(-1.0f, 1.0f);
+
+  float q[4];
+  float length = 0;
+  for(int i = 0; i < 4; i++)
+  {
+    q[i] = rnd(rng);
+    length += q[i] * q[i];
+  }
+  length = sqrtf(length);
+  float x = q[0] / length, y = q[1] / length, z = q[2] / length, w = q[3] / length;
+  float s = 1.0f + 0.1f * rnd(rng);
+
+  float rot[9] = {1 - 2 * (y * y + z * z), 2 * (x * y + z * w),     2 * (x * z - y * w),
+                  2 * (x * y - z * w),     1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+                  2 * (x * z + y * w),     2 * (y * z - x * w),     1 - 2 * (x * x + y * y)};
+  for(int c = 0; c < 3; c++)
+  {
+    for(int r = 0; r < 3; r++)
+    {
+      m[c * 4 + r] = rot[c * 3 + r] * s;
+    }
+    m[c * 4 + 3] = 0;
+  }
+  m[12] = rnd(rng) * 10.0f;
+  m[13] = rnd(rng) * 10.0f;
+  m[14] = rnd(rng) * 10.0f;
+  m[15] = 1.0f;
+}
+
+// mixes deep chains and wide fans
+static void buildTree(NodeTree& tree, std::mt19937& rng, int numNodes, int numRoots)
+{
+  tree.clear();
+  tree.create(numNodes);
+  for(int i = 0; i < numNodes; i++)
+  {
+    NodeTree::nodeID parent = i < numRoots ? tree.getTreeRoot() : NodeTree::nodeID(rng() % 4 == 0 ? i - 1 : rng() % i);
+    tree.setNodeParent(i, parent);
+  }
+  for(int i = 0; i < numRoots; i++)
+  {
+    tree.addToTree(i);
+  }
+}
+
+static bool isDescendantOf(const NodeTree& tree, NodeTree::nodeID node, const std::vector<uint8_t>& marked)
+{
+  for(; node != NodeTree::ROOT; node = tree.getParentNode(node))
+  {
+    if(marked[node])
+      return true;
+  }
+  return false;
+}
+
+// compares the world matrices of all nodes, or of those in dirty's subtrees
+// and checks the others are untouched
+static int compareMatrices(const char* what, const NodeTree& tree, const std::vector<MatrixNode>& result,
+                           const std::vector<MatrixNode>& reference, const std::vector<uint8_t>* dirty)
+{
+  double maxError  = 0;
+  int    untouched = 0;
+  int    written   = 0;
+  for(int level = 0; level < tree.getNumUsedLevel(); level++)
+  {
+    for(NodeTree::nodeID node : tree.getUsedLevel(level)->nodes)
+    {
+      bool expectWrite = level > 0 && (!dirty || isDescendantOf(tree, node, *dirty));
+      if(!expectWrite)
+      {
+        // level 0 is never written, clean nodes keep their poisoned value
+        bool same = dirty ? isnan(result[node].worldMatrixIT[0]) :
+                            memcmp(result[node].worldMatrixIT, reference[node].worldMatrixIT, sizeof(float) * 16) == 0;
+        untouched += same ? 0 : 1;
+        continue;
+      }
+
+      written += isnan(result[node].worldMatrixIT[0]) ? 0 : 1;
+      for(int i = 0; i < 16; i++)
+      {
+        double errW  = fabs(result[node].worldMatrix[i] - reference[node].worldMatrix[i]);
+        double errIT = fabs(result[node].worldMatrixIT[i] - reference[node].worldMatrixIT[i]);
+        maxError     = std::max(maxError, errW / (1.0 + fabs(reference[node].worldMatrix[i])));
+        maxError     = std::max(maxError, errIT / (1.0 + fabs(reference[node].worldMatrixIT[i])));
+        if(isnan(errW) || isnan(errIT))
+          maxError = INFINITY;
+      }
+    }
+  }
+
+  bool ok = maxError < 1.0e-3 && untouched == 0;
+  if(!ok)
+  {
+    printf("  %s: max relative error %g, %d clean nodes modified, %d nodes written\n", what, maxError, untouched, written);
+  }
+  return ok ? 0 : 1;
+}
+
+static int testTree(std::mt19937& rng, int numNodes, int numRoots, nvh::JobSystem* jobSystem)
+{
+  int failed = 0;
+
+  NodeTree tree;
+  buildTree(tree, rng, numNodes, numRoots);
+  const NodeTree& constTree = tree;
+  int             numLevels = tree.getNumUsedLevel();
+
+  std::vector<MatrixNode> initial(numNodes);
+  for(MatrixNode& matrix : initial)
+  {
+    randomMatrix(rng, matrix.worldMatrix);
+    randomMatrix(rng, matrix.objectMatrix);
+    memset(matrix.worldMatrixIT, 0, sizeof(matrix.worldMatrixIT));
+    memset(matrix.objectMatrixIT, 0, sizeof(matrix.objectMatrixIT));
+  }
+  std::vector<MatrixNode> reference = initial;
+  referenceTransforms(tree, reference);
+
+  size_t numUpdated = size_t(tree.getNumActiveNodes()) - tree.getUsedLevel(0)->nodes.size();
+
+  // -1 automatic, 0 only level passes, up to all levels as leaf chains
+  std::vector<int> modes = {-1, 0, 1, 2, numLevels / 2, numLevels - 1, numLevels, numLevels + 10};
+  for(int chainLevels : modes)
+  {
+    char what[128];
+
+    TransformSystemCPU transforms;
+    transforms.init(jobSystem);
+    transforms.setChainLevels(chainLevels);
+
+    // everything
+    std::vector<MatrixNode> matrices = initial;
+    transforms.process(tree, matrices[0].worldMatrix);
+    snprintf(what, sizeof(what), "%d nodes %d levels, chain levels %d: all", numNodes, numLevels, chainLevels);
+    failed += compareMatrices(what, tree, matrices, reference, nullptr);
+    if(transforms.getStats().nodesUpdated != numUpdated)
+    {
+      printf("  %s: %zu nodes updated, expected %zu\n", what, transforms.getStats().nodesUpdated, numUpdated);
+      failed++;
+    }
+
+    // nothing dirty
+    transforms.process(tree, matrices[0].worldMatrix);
+    if(transforms.getStats().nodesUpdated != 0)
+    {
+      printf("  %s: %zu nodes updated without changes\n", what, transforms.getStats().nodesUpdated);
+      failed++;
+    }
+
+    // dirty subsets of growing size, including level 0 worlds and nested dirty nodes
+    std::vector<MatrixNode> changed = initial;
+    for(int numDirty : {1, 7, 100})
+    {
+      std::vector<uint8_t> dirty(numNodes, 0);
+      for(int d = 0; d < numDirty; d++)
+      {
+        NodeTree::nodeID node = NodeTree::nodeID(rng() % numNodes);
+        if(constTree.getNode(node).level == 0)
+        {
+          randomMatrix(rng, changed[node].worldMatrix);
+          memcpy(matrices[node].worldMatrix, changed[node].worldMatrix, sizeof(float) * 16);
+        }
+        else
+        {
+          randomMatrix(rng, changed[node].objectMatrix);
+          memcpy(matrices[node].objectMatrix, changed[node].objectMatrix, sizeof(float) * 16);
+        }
+        transforms.markDirty(node);
+        dirty[node] = 1;
+      }
+
+      std::vector<MatrixNode> changedReference = changed;
+      referenceTransforms(tree, changedReference);
+
+      size_t expectedUpdated = 0;
+      for(int n = 0; n < numNodes; n++)
+      {
+        if(constTree.getNode(n).level == 0 || !isDescendantOf(tree, n, dirty))
+        {
+          matrices[n].worldMatrixIT[0] = NAN;
+        }
+        else
+        {
+          expectedUpdated++;
+        }
+      }
+
+      transforms.process(tree, matrices[0].worldMatrix);
+      snprintf(what, sizeof(what), "%d nodes %d levels, chain levels %d: %d dirty", numNodes, numLevels, chainLevels, numDirty);
+      failed += compareMatrices(what, tree, matrices, changedReference, &dirty);
+      if(transforms.getStats().nodesUpdated != expectedUpdated)
+      {
+        printf("  %s: %zu nodes updated, expected %zu\n", what, transforms.getStats().nodesUpdated, expectedUpdated);
+        failed++;
+      }
+
+      matrices = changedReference;
+    }
+  }
+
+  printf("%d nodes in %d levels %s: %s\n", numNodes, numLevels, jobSystem ? "threaded" : "single", failed ? "FAILED" : "ok");
+  return failed;
+}
+
+// moving subtrees changes the hierarchy, after which all nodes are recomputed
+static int testReparent(std::mt19937& rng, nvh::JobSystem* jobSystem)
+{
+  int failed    = 0;
+  int numNodes  = 5000;
+  int numRounds = 20;
+
+  NodeTree tree;
+  buildTree(tree, rng, numNodes, 3);
+
+  std::vector<MatrixNode> matrices(numNodes);
+  for(MatrixNode& matrix : matrices)
+  {
+    randomMatrix(rng, matrix.worldMatrix);
+    randomMatrix(rng, matrix.objectMatrix);
+    memset(matrix.worldMatrixIT, 0, sizeof(matrix.worldMatrixIT));
+  }
+
+  // a stride larger than MatrixNode, the extra floats must stay untouched
+  const size_t       stride = sizeof(MatrixNode) + 16;
+  std::vector<float> strided(numNodes * stride / sizeof(float), -7.0f);
+  auto               store = [&](const std::vector<MatrixNode>& nodes) {
+    for(int n = 0; n < numNodes; n++)
+    {
+      memcpy(&strided[n * stride / sizeof(float)], &nodes[n], sizeof(MatrixNode));
+    }
+  };
+  auto load = [&](std::vector<MatrixNode>& nodes, bool& paddingIntact) {
+    paddingIntact = true;
+    nodes.resize(numNodes);
+    for(int n = 0; n < numNodes; n++)
+    {
+      memcpy(&nodes[n], &strided[n * stride / sizeof(float)], sizeof(MatrixNode));
+      for(size_t i = sizeof(MatrixNode) / sizeof(float); i < stride / sizeof(float); i++)
+      {
+        paddingIntact = paddingIntact && strided[n * stride / sizeof(float) + i] == -7.0f;
+      }
+    }
+  };
+
+  TransformSystemCPU transforms;
+  transforms.init(jobSystem);
+  store(matrices);
+  transforms.process(tree, strided.data(), stride);
+
+  for(int round = 0; round < numRounds; round++)
+  {
+    // move a node with its subtree below a node outside of it, or to the top
+    NodeTree::nodeID node = NodeTree::nodeID(rng() % numNodes);
+    NodeTree::nodeID newParent;
+    std::vector<uint8_t> subtree(numNodes, 0);
+    subtree[node] = 1;
+    do
+    {
+      newParent = (round % 5 == 0) ? tree.getTreeRoot() : NodeTree::nodeID(rng() % numNodes);
+    } while(newParent != tree.getTreeRoot() && isDescendantOf(tree, newParent, subtree));
+
+    bool wasTop = tree.getParentNode(node) == tree.getTreeRoot();
+    tree.removeFromTree(node);
+    tree.setNodeParent(node, newParent);
+    tree.addToTree(node);
+    if(wasTop && newParent != tree.getTreeRoot())
+    {
+      // its world matrix was an input until now
+      memcpy(&strided[node * stride / sizeof(float)], matrices[node].worldMatrix, sizeof(float) * 16);
+    }
+
+    std::vector<MatrixNode> reference;
+    bool                    paddingIntact;
+    load(reference, paddingIntact);
+    referenceTransforms(tree, reference);
+
+    transforms.process(tree, strided.data(), stride);
+
+    std::vector<MatrixNode> result;
+    load(result, paddingIntact);
+
+    char what[128];
+    snprintf(what, sizeof(what), "reparent round %d", round);
+    failed += compareMatrices(what, tree, result, reference, nullptr);
+    if(!paddingIntact)
+    {
+      printf("  %s: wrote past the matrices\n", what);
+      failed++;
+    }
+  }
+
+  printf("reparenting %s: %s\n", jobSystem ? "threaded" : "single", failed ? "FAILED" : "ok");
+  return failed;
+}
+
+int main()
+{
+  nvh::JobSystem jobSystem;
+  jobSystem.init(3);
+
+  std::mt19937 rng(1);
+
+  int failed = 0;
+  for(nvh::JobSystem* js : {(nvh::JobSystem*)nullptr, &jobSystem})
+  {
+    failed += testTree(rng, 2000, 1, js);
+    failed += testTree(rng, 2000, 3, js);
+    failed += testTree(rng, 50000, 2, js);
+    failed += testReparent(rng, js);
+  }
+
+  jobSystem.deinit();
+
+  printf(failed ? "FAILED\n" : "passed\n");
+  return failed ? 1 : 0;
+}
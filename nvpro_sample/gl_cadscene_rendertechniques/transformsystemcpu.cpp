@@ -0,0 +1,591 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "transformsystemcpu.hpp"
+
+#include <NvFoundation.h>
+#include <nvh/jobsystem.hpp>
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+
+#if defined(NV_X86) || defined(NV_X64)
+#define XFORMCPU_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define XFORMCPU_USE_SSE 0
+#endif
+
+// nodes per job of a level pass, and leaf chains per job
+static const size_t XFORM_LEVEL_GRAIN_SIZE = 256;
+static const size_t XFORM_CHAIN_GRAIN_SIZE = 64;
+
+// float offsets within the matrices of a node (CadScene::MatrixNode)
+static const size_t XFORM_WORLD    = 0;
+static const size_t XFORM_WORLDIT  = 16;
+static const size_t XFORM_OBJECT   = 32;
+static const size_t XFORM_MAXDEPTH = size_t(1) << NodeTree::LEVELBITS;
+
+//////////////////////////////////////////////////////////////////////////
+
+#if XFORMCPU_USE_SSE
+// 4 lanes, one per node, so the math below works on 4 matrices stored as SoA
+struct Float4
+{
+  __m128 v;
+
+  Float4() {}
+  Float4(__m128 f)
+      : v(f)
+  {
+  }
+  Float4(float f)
+      : v(_mm_set1_ps(f))
+  {
+  }
+};
+
+static inline Float4 operator+(Float4 a, Float4 b)
+{
+  return _mm_add_ps(a.v, b.v);
+}
+static inline Float4 operator-(Float4 a, Float4 b)
+{
+  return _mm_sub_ps(a.v, b.v);
+}
+static inline Float4 operator*(Float4 a, Float4 b)
+{
+  return _mm_mul_ps(a.v, b.v);
+}
+static inline Float4 operator/(Float4 a, Float4 b)
+{
+  return _mm_div_ps(a.v, b.v);
+}
+#endif
+
+// column-major, out = a * b, T is float or one lane per matrix
+template <class T>
+static inline void matrixMultiplyT(T* NV_RESTRICT out, const T* NV_RESTRICT a, const T* NV_RESTRICT b)
+{
+  for(int c = 0; c < 4; c++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      out[c * 4 + r] = a[r] * b[c * 4 + 0] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+    }
+  }
+}
+
+// out = transpose(inverse(m)), same as the shaders
+template <class T>
+static inline void matrixInverseTransposeT(T* NV_RESTRICT out, const T* NV_RESTRICT m)
+{
+  // aIJ is column I row J, the expressions work on either order, the result
+  // is then stored transposed
+  const T a00 = m[0], a01 = m[1], a02 = m[2], a03 = m[3];
+  const T a10 = m[4], a11 = m[5], a12 = m[6], a13 = m[7];
+  const T a20 = m[8], a21 = m[9], a22 = m[10], a23 = m[11];
+  const T a30 = m[12], a31 = m[13], a32 = m[14], a33 = m[15];
+
+  const T s0 = a00 * a11 - a10 * a01;
+  const T s1 = a00 * a12 - a10 * a02;
+  const T s2 = a00 * a13 - a10 * a03;
+  const T s3 = a01 * a12 - a11 * a02;
+  const T s4 = a01 * a13 - a11 * a03;
+  const T s5 = a02 * a13 - a12 * a03;
+
+  const T c5 = a22 * a33 - a32 * a23;
+  const T c4 = a21 * a33 - a31 * a23;
+  const T c3 = a21 * a32 - a31 * a22;
+  const T c2 = a20 * a33 - a30 * a23;
+  const T c1 = a20 * a32 - a30 * a22;
+  const T c0 = a20 * a31 - a30 * a21;
+
+  const T det    = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+  const T invdet = T(1.0f) / det;
+
+  out[0]  = (a11 * c5 - a12 * c4 + a13 * c3) * invdet;
+  out[4]  = (a02 * c4 - a01 * c5 - a03 * c3) * invdet;
+  out[8]  = (a31 * s5 - a32 * s4 + a33 * s3) * invdet;
+  out[12] = (a22 * s4 - a21 * s5 - a23 * s3) * invdet;
+  out[1]  = (a12 * c2 - a10 * c5 - a13 * c1) * invdet;
+  out[5]  = (a00 * c5 - a02 * c2 + a03 * c1) * invdet;
+  out[9]  = (a32 * s2 - a30 * s5 - a33 * s1) * invdet;
+  out[13] = (a20 * s5 - a22 * s2 + a23 * s1) * invdet;
+  out[2]  = (a10 * c4 - a11 * c2 + a13 * c0) * invdet;
+  out[6]  = (a01 * c2 - a00 * c4 - a03 * c0) * invdet;
+  out[10] = (a30 * s4 - a31 * s2 + a33 * s0) * invdet;
+  out[14] = (a21 * s2 - a20 * s4 - a23 * s0) * invdet;
+  out[3]  = (a11 * c1 - a10 * c3 - a12 * c0) * invdet;
+  out[7]  = (a00 * c3 - a01 * c1 + a02 * c0) * invdet;
+  out[11] = (a31 * s1 - a30 * s3 - a32 * s0) * invdet;
+  out[15] = (a20 * s3 - a21 * s1 + a22 * s0) * invdet;
+}
+
+// column-major, out = a * b
+static inline void matrixMultiply(float* NV_RESTRICT out, const float* NV_RESTRICT a, const float* NV_RESTRICT b)
+{
+#if XFORMCPU_USE_SSE
+  __m128 a0 = _mm_loadu_ps(a + 0);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 a3 = _mm_loadu_ps(a + 12);
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[c * 4 + 0]));
+    col        = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[c * 4 + 1])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[c * 4 + 2])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[c * 4 + 3])));
+    _mm_storeu_ps(out + c * 4, col);
+  }
+#else
+  matrixMultiplyT<float>(out, a, b);
+#endif
+}
+
+#if XFORMCPU_USE_SSE
+static inline void loadMatrices4(Float4* NV_RESTRICT soa, const float* const ptrs[4])
+{
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 r0 = _mm_loadu_ps(ptrs[0] + c * 4);
+    __m128 r1 = _mm_loadu_ps(ptrs[1] + c * 4);
+    __m128 r2 = _mm_loadu_ps(ptrs[2] + c * 4);
+    __m128 r3 = _mm_loadu_ps(ptrs[3] + c * 4);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    soa[c * 4 + 0] = r0;
+    soa[c * 4 + 1] = r1;
+    soa[c * 4 + 2] = r2;
+    soa[c * 4 + 3] = r3;
+  }
+}
+
+static inline void storeMatrices4(float* const ptrs[4], const Float4* NV_RESTRICT soa)
+{
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 r0 = soa[c * 4 + 0].v;
+    __m128 r1 = soa[c * 4 + 1].v;
+    __m128 r2 = soa[c * 4 + 2].v;
+    __m128 r3 = soa[c * 4 + 3].v;
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(ptrs[0] + c * 4, r0);
+    _mm_storeu_ps(ptrs[1] + c * 4, r1);
+    _mm_storeu_ps(ptrs[2] + c * 4, r2);
+    _mm_storeu_ps(ptrs[3] + c * 4, r3);
+  }
+}
+
+// lanes may reference the same node
+static inline void updateWorld4(float* const nodes[4], const float* const parents[4])
+{
+  const float* objectPtrs[4];
+  const float* parentPtrs[4];
+  float*       worldPtrs[4];
+  float*       worldITPtrs[4];
+  for(int i = 0; i < 4; i++)
+  {
+    objectPtrs[i]  = nodes[i] + XFORM_OBJECT;
+    parentPtrs[i]  = parents[i] + XFORM_WORLD;
+    worldPtrs[i]   = nodes[i] + XFORM_WORLD;
+    worldITPtrs[i] = nodes[i] + XFORM_WORLDIT;
+  }
+
+  Float4 parent[16];
+  Float4 object[16];
+  Float4 world[16];
+  Float4 worldIT[16];
+  loadMatrices4(parent, parentPtrs);
+  loadMatrices4(object, objectPtrs);
+  matrixMultiplyT(world, parent, object);
+  matrixInverseTransposeT(worldIT, world);
+  storeMatrices4(worldPtrs, world);
+  storeMatrices4(worldITPtrs, worldIT);
+}
+#endif
+
+static inline void updateWorld(float* NV_RESTRICT node, const float* NV_RESTRICT parentWorld)
+{
+  matrixMultiply(node + XFORM_WORLD, parentWorld, node + XFORM_OBJECT);
+  matrixInverseTransposeT<float>(node + XFORM_WORLDIT, node + XFORM_WORLD);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TransformSystemCPU::init(nvh::JobSystem* jobSystem)
+{
+  m_jobSystem = jobSystem;
+  m_cost      = Cost();
+  // initial guess, refined by the timings
+  m_cost.pass = jobSystem ? 5000.0 : 50.0;
+  m_tree      = nullptr;
+  m_allDirty  = true;
+}
+
+void TransformSystemCPU::deinit()
+{
+  m_jobSystem = nullptr;
+  m_tree      = nullptr;
+  m_parent.clear();
+  m_chainChild.clear();
+  m_dirty.clear();
+  m_updated.clear();
+  m_leaves.clear();
+  m_chainItems.clear();
+}
+
+void TransformSystemCPU::markDirty(NodeTree::nodeID nodeidx)
+{
+  if(nodeidx >= m_dirty.size())
+  {
+    m_dirty.resize(size_t(nodeidx) + 1, 0);
+  }
+  m_dirty[nodeidx] = 1;
+}
+
+void TransformSystemCPU::updateTree(const NodeTree& nodeTree)
+{
+  size_t numNodes = nodeTree.getTreeCompactNodes().size();
+  if(m_tree == &nodeTree && m_treeChangeID == nodeTree.getTreeParentChangeID()
+     && m_treeNodes == nodeTree.getNumActiveNodes() && m_parent.size() == numNodes)
+  {
+    return;
+  }
+
+  m_tree         = &nodeTree;
+  m_treeChangeID = nodeTree.getTreeParentChangeID();
+  m_treeNodes    = nodeTree.getNumActiveNodes();
+
+  m_parent.assign(numNodes, NodeTree::INVALID);
+  m_chainChild.assign(numNodes, NodeTree::INVALID);
+  m_updated.assign(numNodes, 0);
+  m_dirty.resize(numNodes, 0);
+
+  int numLevels = nodeTree.getNumUsedLevel();
+  for(int l = 0; l < numLevels; l++)
+  {
+    for(NodeTree::nodeID nodeidx : nodeTree.getUsedLevel(l)->nodes)
+    {
+      NodeTree::nodeID parentidx = nodeTree.getNode(nodeidx).parentidx;
+      m_parent[nodeidx]          = parentidx;
+      // first child in level order
+      if(l > 0 && m_chainChild[parentidx] == NodeTree::INVALID)
+      {
+        m_chainChild[parentidx] = nodeidx;
+      }
+    }
+  }
+
+  // derived here rather than from Level::leaves, as the chains rely on m_chainChild
+  m_leaves.resize(numLevels);
+  for(int l = 0; l < numLevels; l++)
+  {
+    m_leaves[l].clear();
+    for(NodeTree::nodeID nodeidx : nodeTree.getUsedLevel(l)->nodes)
+    {
+      if(m_chainChild[nodeidx] == NodeTree::INVALID)
+      {
+        m_leaves[l].push_back(nodeidx);
+      }
+    }
+  }
+
+  m_chainItemsLevels = 0;
+  m_allDirty         = true;
+}
+
+void TransformSystemCPU::setupChainItems(const NodeTree& nodeTree, int chainLevels)
+{
+  if(m_chainItemsLevels == chainLevels)
+    return;
+
+  // leaves of levels [1, chainLevels) and all nodes of the last level,
+  // every node in these levels is part of exactly one chain this way
+  m_chainItems.clear();
+  m_chainItemsSteps = 0;
+  for(int l = 1; l <= chainLevels; l++)
+  {
+    const std::vector<NodeTree::nodeID>& items = l == chainLevels ? nodeTree.getUsedLevel(l)->nodes : m_leaves[l];
+    m_chainItems.insert(m_chainItems.end(), items.begin(), items.end());
+    m_chainItemsSteps += items.size() * size_t(l);
+  }
+  m_chainItemsLevels = chainLevels;
+}
+
+int TransformSystemCPU::chooseChainLevels(const NodeTree& nodeTree) const
+{
+  int numLevels = nodeTree.getNumUsedLevel();
+  if(m_chainLevels >= 0)
+  {
+    return std::min(m_chainLevels, std::max(0, numLevels - 1));
+  }
+
+  // estimated time when levels [1, k] are done by leaf chains and the rest
+  // level by level
+  double levelsCost = 0;
+  for(int l = 1; l < numLevels; l++)
+  {
+    levelsCost += m_cost.pass + m_cost.levelNode * double(nodeTree.getUsedLevel(l)->nodes.size());
+  }
+
+  int    bestLevels = 0;
+  double bestCost   = levelsCost;
+  double leafSteps  = 0;
+  for(int k = 1; k < numLevels; k++)
+  {
+    levelsCost -= m_cost.pass + m_cost.levelNode * double(nodeTree.getUsedLevel(k)->nodes.size());
+
+    double steps = leafSteps + double(nodeTree.getUsedLevel(k)->nodes.size()) * double(k);
+    double cost  = m_cost.pass + m_cost.chainStep * steps + levelsCost;
+    if(cost < bestCost)
+    {
+      bestCost   = cost;
+      bestLevels = k;
+    }
+
+    leafSteps += double(m_leaves[k].size()) * double(k);
+  }
+
+  return bestLevels;
+}
+
+size_t TransformSystemCPU::parallelFor(size_t num, size_t grainSize, RangeFunc fn)
+{
+  if(m_jobSystem)
+  {
+    std::atomic<size_t> updated(0);
+    m_jobSystem->parallelFor(
+        0, num, [&](size_t begin, size_t end, uint32_t) { updated += (this->*fn)(begin, end); }, grainSize);
+    return updated;
+  }
+  else
+  {
+    return (this->*fn)(0, num);
+  }
+}
+
+size_t TransformSystemCPU::processLevel(size_t begin, size_t end)
+{
+  const NodeTree::nodeID* NV_RESTRICT nodes = m_level->nodes.data();
+
+  size_t updated = 0;
+#if XFORMCPU_USE_SSE
+  float*       batchNodes[4];
+  const float* batchParents[4];
+  int          batchCount = 0;
+#endif
+
+  for(size_t i = begin; i < end; i++)
+  {
+    NodeTree::nodeID nodeidx   = nodes[i];
+    NodeTree::nodeID parentidx = m_parent[nodeidx];
+
+    bool dirty         = m_allDirty || m_dirty[nodeidx] || m_updated[parentidx];
+    m_updated[nodeidx] = dirty ? 1 : 0;
+    if(!dirty)
+      continue;
+
+    updated++;
+#if XFORMCPU_USE_SSE
+    batchNodes[batchCount]   = getMatrices(nodeidx);
+    batchParents[batchCount] = getMatrices(parentidx);
+    if(++batchCount == 4)
+    {
+      updateWorld4(batchNodes, batchParents);
+      batchCount = 0;
+    }
+#else
+    updateWorld(getMatrices(nodeidx), getMatrices(parentidx) + XFORM_WORLD);
+#endif
+  }
+
+#if XFORMCPU_USE_SSE
+  if(batchCount)
+  {
+    // unused lanes repeat the last node
+    for(int i = batchCount; i < 4; i++)
+    {
+      batchNodes[i]   = batchNodes[batchCount - 1];
+      batchParents[i] = batchParents[batchCount - 1];
+    }
+    updateWorld4(batchNodes, batchParents);
+  }
+#endif
+
+  return updated;
+}
+
+size_t TransformSystemCPU::processChains(size_t begin, size_t end)
+{
+  NodeTree::nodeID chain[XFORM_MAXDEPTH];
+  float            temp[2][16];
+
+  size_t updated = 0;
+  for(size_t i = begin; i < end; i++)
+  {
+    // walk up to level 1, the chain writes its bottom-most nodes
+    // until it passes a node through another than its chain child
+    NodeTree::nodeID nodeidx = m_chainItems[i];
+    int              depth   = 0;
+    int              owned   = 1;
+    chain[0]                 = nodeidx;
+    while(m_tree->getNode(nodeidx).level > 1)
+    {
+      NodeTree::nodeID parentidx = m_parent[nodeidx];
+      if(owned == depth + 1 && m_chainChild[parentidx] == nodeidx)
+      {
+        owned++;
+      }
+      chain[++depth] = parentidx;
+      nodeidx        = parentidx;
+    }
+
+    // then multiply down, starting from the level 0 world matrix
+    NodeTree::nodeID rootidx     = m_parent[nodeidx];
+    const float*     parentWorld = getMatrices(rootidx) + XFORM_WORLD;
+    bool             dirty       = m_updated[rootidx] != 0;
+
+    for(int d = depth; d >= 0; d--)
+    {
+      nodeidx       = chain[d];
+      float* node   = getMatrices(nodeidx);
+      bool   isOwned = d < owned;
+
+      dirty = dirty || m_dirty[nodeidx];
+      if(dirty)
+      {
+        if(isOwned)
+        {
+          updateWorld(node, parentWorld);
+          parentWorld = node + XFORM_WORLD;
+          updated++;
+        }
+        else
+        {
+          // only needed for the children, owned by another chain
+          float* world = temp[d & 1];
+          matrixMultiply(world, parentWorld, node + XFORM_OBJECT);
+          parentWorld = world;
+        }
+      }
+      else
+      {
+        parentWorld = node + XFORM_WORLD;
+      }
+
+      if(isOwned)
+      {
+        m_updated[nodeidx] = dirty ? 1 : 0;
+      }
+    }
+  }
+
+  return updated;
+}
+
+void TransformSystemCPU::addLevelSample(size_t nodes, double nanoseconds)
+{
+  const double decay = 0.98;
+  double       n     = double(nodes);
+
+  Cost& cost     = m_cost;
+  cost.sumWeight = cost.sumWeight * decay + 1.0;
+  cost.sumN      = cost.sumN * decay + n;
+  cost.sumT      = cost.sumT * decay + nanoseconds;
+  cost.sumNN     = cost.sumNN * decay + n * n;
+  cost.sumNT     = cost.sumNT * decay + n * nanoseconds;
+
+  // needs levels of different size to separate both terms
+  double det = cost.sumWeight * cost.sumNN - cost.sumN * cost.sumN;
+  if(det > 0.01 * cost.sumWeight * cost.sumNN)
+  {
+    double levelNode = (cost.sumWeight * cost.sumNT - cost.sumN * cost.sumT) / det;
+    double pass      = (cost.sumT - levelNode * cost.sumN) / cost.sumWeight;
+    if(levelNode > 0 && pass > 0)
+    {
+      cost.levelNode = levelNode;
+      cost.pass      = pass;
+      return;
+    }
+  }
+
+  if(cost.sumN > 0)
+  {
+    cost.levelNode = std::max(0.1, (cost.sumT - cost.pass * cost.sumWeight) / cost.sumN);
+  }
+}
+
+void TransformSystemCPU::addChainSample(size_t steps, double nanoseconds)
+{
+  if(steps)
+  {
+    double chainStep = std::max(0.1, (nanoseconds - m_cost.pass) / double(steps));
+    m_cost.chainStep = m_cost.chainStep * 0.75 + chainStep * 0.25;
+  }
+}
+
+void TransformSystemCPU::process(const NodeTree& nodeTree, float* matrices, size_t matrixStride)
+{
+  typedef std::chrono::high_resolution_clock clock;
+
+  updateTree(nodeTree);
+
+  m_matrices     = matrices;
+  m_matrixStride = matrixStride ? matrixStride : sizeof(float) * 16 * 4;
+  m_stats        = Stats();
+
+  int numLevels = nodeTree.getNumUsedLevel();
+  if(numLevels)
+  {
+    // world matrices of level 0 are kept, only pass on their state
+    for(NodeTree::nodeID nodeidx : nodeTree.getUsedLevel(0)->nodes)
+    {
+      m_updated[nodeidx] = (m_allDirty || m_dirty[nodeidx]) ? 1 : 0;
+    }
+
+    int chainLevels = chooseChainLevels(nodeTree);
+    if(chainLevels)
+    {
+      setupChainItems(nodeTree, chainLevels);
+
+      clock::time_point begin = clock::now();
+      m_stats.nodesUpdated += parallelFor(m_chainItems.size(), XFORM_CHAIN_GRAIN_SIZE, &TransformSystemCPU::processChains);
+      addChainSample(m_chainItemsSteps, double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count()));
+    }
+
+    for(int l = chainLevels + 1; l < numLevels; l++)
+    {
+      m_level = nodeTree.getUsedLevel(l);
+
+      clock::time_point begin = clock::now();
+      m_stats.nodesUpdated += parallelFor(m_level->nodes.size(), XFORM_LEVEL_GRAIN_SIZE, &TransformSystemCPU::processLevel);
+      addLevelSample(m_level->nodes.size(), double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count()));
+    }
+
+    m_stats.chainLevels = chainLevels;
+    m_stats.levelPasses = std::max(0, numLevels - 1 - chainLevels);
+    m_level             = nullptr;
+  }
+
+  std::fill(m_dirty.begin(), m_dirty.end(), 0);
+  m_allDirty = false;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef TRANSFORMSYSTEMCPU_H__
+#define TRANSFORMSYSTEMCPU_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "nodetree.hpp"
+
+namespace nvh {
+class JobSystem;
+}
+
+/*
+  Host-side counterpart of TransformSystem, it does not depend on GL.
+
+  Computes world = world[parent] * object and its inverse transpose for all
+  nodes of the NodeTree, following the same contract as the shaders used
+  by TransformSystem (transform-level.comp.glsl and transform-leaves.comp.glsl).
+  Like there, the world matrices of level 0 are not modified.
+
+  Matrices are stored per node as {mat4 world, worldIT, object, objectIT}
+  column-major (CadScene::MatrixNode), the stride is in bytes, 0 selects
+  that default.
+
+  Only nodes that were marked dirty since the last process, and their
+  subtrees, are recomputed. After a change of the tree's hierarchy all
+  nodes are.
+
+  Two methods are combined, the same as in the GL system:
+  - per level: one parallel-for per level, every node reads the result of
+    its parent, 4 nodes at a time using SIMD.
+  - leaf chains: every leaf of the upper levels (and every node of the
+    last of them) walks up to level 1 and multiplies all matrices down
+    the chain, so the upper levels need only one parallel-for.
+  The number of levels covered by leaf chains is derived from timings
+  of the previous calls, or can be fixed via setChainLevels.
+*/
+
+class TransformSystemCPU
+{
+public:
+  struct Stats
+  {
+    int    chainLevels  = 0;  // levels processed as leaf chains
+    int    levelPasses  = 0;  // levels processed one by one
+    size_t nodesUpdated = 0;
+  };
+
+  // jobSystem is optional, without it everything runs on the calling thread
+  void init(nvh::JobSystem* jobSystem = nullptr);
+  void deinit();
+
+  // world matrices of the node and all its children are recomputed in the next process
+  void markDirty(NodeTree::nodeID nodeidx);
+  void markAllDirty() { m_allDirty = true; }
+
+  // -1 selects automatically (default), 0 processes all levels one by one
+  void setChainLevels(int levels) { m_chainLevels = levels; }
+  int  getChainLevels() const { return m_chainLevels; }
+
+  void process(const NodeTree& nodeTree, float* matrices, size_t matrixStride = 0);
+
+  const Stats& getStats() const { return m_stats; }
+
+private:
+  typedef size_t (TransformSystemCPU::*RangeFunc)(size_t begin, size_t end);
+
+  struct Cost
+  {
+    // estimates in nanoseconds
+    double levelNode = 40.0;  // per node of a level pass
+    double chainStep = 60.0;  // per node visited by a leaf chain
+    double pass      = 0.0;   // per parallel-for
+
+    // decayed sums for the least squares fit of level passes: time = pass + nodes * levelNode
+    double sumWeight = 0;
+    double sumN      = 0;
+    double sumT      = 0;
+    double sumNN     = 0;
+    double sumNT     = 0;
+  };
+
+  void updateTree(const NodeTree& nodeTree);
+  int  chooseChainLevels(const NodeTree& nodeTree) const;
+  void setupChainItems(const NodeTree& nodeTree, int chainLevels);
+
+  // return the number of updated nodes
+  size_t processLevel(size_t begin, size_t end);
+  size_t processChains(size_t begin, size_t end);
+  size_t parallelFor(size_t num, size_t grainSize, RangeFunc fn);
+
+  void addLevelSample(size_t nodes, double nanoseconds);
+  void addChainSample(size_t steps, double nanoseconds);
+
+  inline float* getMatrices(NodeTree::nodeID nodeidx) const
+  {
+    return reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(m_matrices) + m_matrixStride * nodeidx);
+  }
+
+  nvh::JobSystem* m_jobSystem   = nullptr;
+  int             m_chainLevels = -1;
+  Stats           m_stats;
+  Cost            m_cost;
+
+  // identifies the hierarchy the per node data below was built for
+  const NodeTree* m_tree         = nullptr;
+  unsigned int    m_treeChangeID = 0;
+  int             m_treeNodes    = 0;
+
+  // per node
+  std::vector<NodeTree::nodeID> m_parent;
+  std::vector<NodeTree::nodeID> m_chainChild;  // the only child whose leaf chain writes this node
+  std::vector<uint8_t>          m_dirty;       // input, set by markDirty
+  std::vector<uint8_t>          m_updated;     // output, world matrix was recomputed
+  bool                          m_allDirty = true;
+
+  // per level, nodes without children in the tree
+  std::vector<std::vector<NodeTree::nodeID>> m_leaves;
+  // items of the leaf chain pass, valid for m_chainItemsLevels
+  std::vector<NodeTree::nodeID> m_chainItems;
+  int                           m_chainItemsLevels = 0;
+  size_t                        m_chainItemsSteps  = 0;
+
+  // current process
+  const NodeTree::Level* m_level        = nullptr;
+  float*                 m_matrices     = nullptr;
+  size_t                 m_matrixStride = 0;
+};
+
+#endif
@@ -992,7 +992,7 @@ void Sample::think(double time)
 
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
+    m_progManager.reloadChangedPrograms();
     cmdlist.state.programChangeID++;
   }
   if(!m_progManager.areProgramsValid())
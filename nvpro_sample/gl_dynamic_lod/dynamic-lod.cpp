@@ -762,7 +762,7 @@ void Sample::think(double time)
 
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
+    m_progManager.reloadChangedPrograms();
     glGetProgramiv(m_progManager.get(programs.lodcontent_comp), GL_COMPUTE_WORK_GROUP_SIZE, (GLint*)m_workGroupSize);
   }
   if(!m_progManager.areProgramsValid())
@@ -1382,7 +1382,7 @@ void Sample::think(double time)
 
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
+    m_progManager.reloadChangedPrograms();
 
     ScanSystem::Programs scanprograms;
     getScanPrograms(scanprograms);
@@ -1027,7 +1027,7 @@ void Sample::think(double time)
 
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
+    m_progManager.reloadChangedPrograms();
   }
   if(!m_progManager.areProgramsValid())
   {
@@ -101,6 +101,9 @@ public:
   Node* getParent() { return m_parent; }
   void  setParent(Node* inParent) { m_parent = inParent; }
 
+  nvmath::vec3f& getPosition() { return m_position; }
+  nvmath::vec3f& getRotation() { return m_rotation; }
+
   void getTriangles(render::TriangleList& outTriangles);
 
   ID getID() { return m_id; }
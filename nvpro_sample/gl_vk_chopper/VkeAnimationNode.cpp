@@ -39,12 +39,12 @@ VkeAnimationNode::VkeAnimationNode(VkeAnimationNode::Name& inName, VkeSceneAnima
   m_scale.setParent(inParent);
 }
 
-VkeNodeData* VkeAnimationNode::getNode()
+Node* VkeAnimationNode::getNode()
 {
   return m_scene_node;
 }
 
-void VkeAnimationNode::setNode(VkeNodeData* inNode)
+void VkeAnimationNode::setNode(Node* inNode)
 {
   m_scene_node = inNode;
 }
@@ -72,9 +72,7 @@ VkeAnimationNode::Name& VkeAnimationNode::getName()
 
 void VkeAnimationNode::update()
 {
-  if(!m_scene_node)
-    return;
-  Node* node = m_scene_node->getNode();
+  Node* node = m_scene_node;
   if(!node)
     return;
 
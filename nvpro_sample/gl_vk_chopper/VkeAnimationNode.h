@@ -23,9 +23,10 @@
 #define __H_VKE_ANIMATION_NODE_
 
 #pragma once
+#include "Node.h"
 #include "VkeAnimationChannel.h"
-#include "VkeNodeData.h"
 #include <map>
+#include <string>
 
 class VkeAnimationNode
 {
@@ -44,8 +45,8 @@ public:
 
   Name& getName();
 
-  VkeNodeData* getNode();
-  void         setNode(VkeNodeData* inNode);
+  Node* getNode();
+  void  setNode(Node* inNode);
 
   void update();
 
@@ -60,6 +61,8 @@ public:
 
     void update();
 
+    VkeAnimationNode::Map& getData() { return m_data; }
+
   private:
     VkeAnimationNode::Map m_data;
   };
@@ -73,7 +76,7 @@ private:
 
   Name m_name;
 
-  VkeNodeData* m_scene_node;
+  Node* m_scene_node;
 };
 
 
@@ -0,0 +1,589 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Contact chebert@nvidia.com (Chris Hebert) for feedback */
+
+#include "VkeBakedAnimation.h"
+#include <NvFoundation.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#if defined(NV_X86) || defined(NV_X64)
+#define BAKEDANIM_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define BAKEDANIM_USE_SSE 0
+#endif
+
+/*
+	Math on 4 lanes, either 4 channels at once (SSE) or
+	one lane after the other.
+*/
+
+#if BAKEDANIM_USE_SSE
+struct Lanes
+{
+  __m128 v;
+
+  Lanes() {}
+  Lanes(__m128 f)
+      : v(f)
+  {
+  }
+  Lanes(float f)
+      : v(_mm_set1_ps(f))
+  {
+  }
+  Lanes(const float* f)
+      : v(_mm_loadu_ps(f))
+  {
+  }
+  void store(float* f) const { _mm_storeu_ps(f, v); }
+};
+
+static inline Lanes operator+(Lanes a, Lanes b)
+{
+  return _mm_add_ps(a.v, b.v);
+}
+static inline Lanes operator-(Lanes a, Lanes b)
+{
+  return _mm_sub_ps(a.v, b.v);
+}
+static inline Lanes operator*(Lanes a, Lanes b)
+{
+  return _mm_mul_ps(a.v, b.v);
+}
+static inline Lanes lanesMin(Lanes a, Lanes b)
+{
+  return _mm_min_ps(a.v, b.v);
+}
+
+static const int LANES_WIDTH = 4;
+#else
+struct Lanes
+{
+  float v;
+
+  Lanes() {}
+  Lanes(float f)
+      : v(f)
+  {
+  }
+  Lanes(const float* f)
+      : v(*f)
+  {
+  }
+  void store(float* f) const { *f = v; }
+};
+
+static inline Lanes operator+(Lanes a, Lanes b)
+{
+  return a.v + b.v;
+}
+static inline Lanes operator-(Lanes a, Lanes b)
+{
+  return a.v - b.v;
+}
+static inline Lanes operator*(Lanes a, Lanes b)
+{
+  return a.v * b.v;
+}
+static inline Lanes lanesMin(Lanes a, Lanes b)
+{
+  return a.v < b.v ? a.v : b.v;
+}
+
+static const int LANES_WIDTH = 1;
+#endif
+
+static const float BAKEDANIM_PI = 3.14159265358979f;
+
+/*
+	sin for [0, pi], the Taylor series up to x^11
+	is accurate to 6e-8 after folding into [0, pi/2].
+*/
+static inline Lanes lanesSin(Lanes inX)
+{
+  Lanes x  = lanesMin(inX, Lanes(BAKEDANIM_PI) - inX);
+  Lanes x2 = x * x;
+  Lanes p  = Lanes(-1.0f / 39916800.0f);
+  p        = p * x2 + Lanes(1.0f / 362880.0f);
+  p        = p * x2 + Lanes(-1.0f / 5040.0f);
+  p        = p * x2 + Lanes(1.0f / 120.0f);
+  p        = p * x2 + Lanes(-1.0f / 6.0f);
+  p        = p * x2 + Lanes(1.0f);
+  return p * x;
+}
+
+/*
+	Key pairs gathered for LANES_WIDTH channels, the
+	interpolation runs on all of them at once.
+*/
+struct KeyLanes
+{
+  float factor[4];
+  float a[4][4];  // component, lane
+  float b[4][4];
+  float angle[4];
+  float sine_inv[4];
+  float keep[4];  // 1 if the slerp degenerates to a
+};
+
+// a * (1 - c) + b * c, like cubicLerp in VkeAnimationChannel
+static inline void lerpLanes(KeyLanes& inKeys, float outValue[3][4], int inLane)
+{
+  Lanes c  = Lanes(&inKeys.factor[inLane]);
+  Lanes c1 = Lanes(1.0f) - c;
+  for(int i = 0; i < 3; ++i)
+  {
+    Lanes value = Lanes(&inKeys.a[i][inLane]) * c1 + Lanes(&inKeys.b[i][inLane]) * c;
+    value.store(&outValue[i][inLane]);
+  }
+}
+
+// same as nvmath::slerp_quats with the angle taken from the bake
+static inline void slerpLanes(KeyLanes& inKeys, float outValue[4][4], int inLane)
+{
+  Lanes c        = Lanes(&inKeys.factor[inLane]);
+  Lanes angle    = Lanes(&inKeys.angle[inLane]);
+  Lanes sine_inv = Lanes(&inKeys.sine_inv[inLane]);
+  Lanes c1       = lanesSin((Lanes(1.0f) - c) * angle) * sine_inv + Lanes(&inKeys.keep[inLane]);
+  Lanes c2       = lanesSin(c * angle) * sine_inv;
+  for(int i = 0; i < 4; ++i)
+  {
+    Lanes value = Lanes(&inKeys.a[i][inLane]) * c1 + Lanes(&inKeys.b[i][inLane]) * c2;
+    value.store(&outValue[i][inLane]);
+  }
+}
+
+// column-major, out = a * b
+static inline void multiplyMatrix(float* NV_RESTRICT out, const float* NV_RESTRICT a, const float* NV_RESTRICT b)
+{
+#if BAKEDANIM_USE_SSE
+  __m128 a0 = _mm_loadu_ps(a + 0);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 a3 = _mm_loadu_ps(a + 12);
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[c * 4 + 0]));
+    col        = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[c * 4 + 1])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[c * 4 + 2])));
+    col        = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[c * 4 + 3])));
+    _mm_storeu_ps(out + c * 4, col);
+  }
+#else
+  for(int c = 0; c < 4; c++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      out[c * 4 + r] = a[r] * b[c * 4 + 0] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+    }
+  }
+#endif
+}
+
+// translation * rotation, column-major, same as Transform::translate and Transform::rotate
+static inline void localMatrix(float* outMatrix, const float* inPosition, const float* inRotation)
+{
+  float x = inRotation[0];
+  float y = inRotation[1];
+  float z = inRotation[2];
+  float w = inRotation[3];
+
+  float x2 = x * 2;
+  float y2 = y * 2;
+  float z2 = z * 2;
+  float wx = x2 * w;
+  float wy = y2 * w;
+  float wz = z2 * w;
+  float xx = x2 * x;
+  float xy = y2 * x;
+  float xz = z2 * x;
+  float yy = y2 * y;
+  float yz = z2 * y;
+  float zz = z2 * z;
+
+  outMatrix[0]  = 1 - (yy + zz);
+  outMatrix[1]  = xy + wz;
+  outMatrix[2]  = xz - wy;
+  outMatrix[3]  = 0.0f;
+  outMatrix[4]  = xy - wz;
+  outMatrix[5]  = 1 - (xx + zz);
+  outMatrix[6]  = yz + wx;
+  outMatrix[7]  = 0.0f;
+  outMatrix[8]  = xz + wy;
+  outMatrix[9]  = yz - wx;
+  outMatrix[10] = 1 - (xx + yy);
+  outMatrix[11] = 0.0f;
+  outMatrix[12] = inPosition[0];
+  outMatrix[13] = inPosition[1];
+  outMatrix[14] = inPosition[2];
+  outMatrix[15] = 1.0f;
+}
+
+VkeBakedAnimation::VkeBakedAnimation()
+    : m_instance_count(0)
+    , m_start_time(0.0)
+    , m_end_time(0.0)
+{
+}
+
+VkeBakedAnimation::~VkeBakedAnimation() {}
+
+void VkeBakedAnimation::Channels::add(VkeAnimationKey::List& inKeys, ID inNode, bool inRotation)
+{
+  Count keyCount = Count(inKeys.m_data.size());
+  if(keyCount == 0)
+    return;
+
+  first.push_back(ID(time.size()));
+  count.push_back(keyCount);
+  node.push_back(inNode);
+
+  for(Count k = 0; k < keyCount; ++k)
+  {
+    VkeAnimationKey* key   = inKeys.m_data[k];
+    nvmath::vec4f    value = key->getValue();
+
+    time.push_back(float(key->getTime()));
+    x.push_back(value.x);
+    y.push_back(value.y);
+    z.push_back(value.z);
+    w.push_back(value.w);
+
+    if(!inRotation)
+      continue;
+
+    float keyAngle   = 0.0f;
+    float keySineInv = 0.0f;
+    if(k + 1 < keyCount)
+    {
+      nvmath::vec4f next   = inKeys.m_data[k + 1]->getValue();
+      float         cosine = value.x * next.x + value.y * next.y + value.z * next.z + value.w * next.w;
+      cosine               = std::min(std::max(cosine, -1.0f), 1.0f);
+      float a              = acosf(cosine);
+      if(fabsf(a) >= nv_eps)
+      {
+        keyAngle   = a;
+        keySineInv = 1.0f / sinf(a);
+      }
+    }
+    angle.push_back(keyAngle);
+    sine_inv.push_back(keySineInv);
+  }
+}
+
+void VkeBakedAnimation::addNode(Node* inNode, ID inParent)
+{
+  ID id = ID(m_nodes.size());
+  m_nodes.push_back(inNode);
+  m_parents.push_back(inParent);
+  m_node_ids[inNode] = id;
+
+  m_pose_position.resize(m_pose_position.size() + 3);
+  m_pose_rotation.resize(m_pose_rotation.size() + 4);
+  updatePose(inNode);
+
+  Node::List& children = inNode->ChildNodes().getData();
+  for(size_t i = 0; i < children.size(); ++i)
+  {
+    addNode(children[i], id);
+  }
+}
+
+void VkeBakedAnimation::bake(VkeSceneAnimation& inAnimation, Node::NodeList& inRootNodes)
+{
+  m_nodes.clear();
+  m_parents.clear();
+  m_node_ids.clear();
+  m_pose_position.clear();
+  m_pose_rotation.clear();
+  m_positions = Channels();
+  m_rotations = Channels();
+
+  // depth first, parents before their children
+  Node::List& roots = inRootNodes.getData();
+  for(size_t i = 0; i < roots.size(); ++i)
+  {
+    addNode(roots[i], INVALID_ID);
+  }
+
+  VkeAnimationNode::Map&          animNodes = inAnimation.Nodes().getData();
+  VkeAnimationNode::Map::iterator itr;
+  for(itr = animNodes.begin(); itr != animNodes.end(); ++itr)
+  {
+    VkeAnimationNode* animNode = itr->second;
+    if(!animNode || !animNode->getNode())
+      continue;
+
+    ID id = getNodeIndex(animNode->getNode());
+    if(id == INVALID_ID)
+      continue;
+
+    m_positions.add(animNode->Position().Keys(), id, false);
+    m_rotations.add(animNode->Rotation().Keys(), id, true);
+  }
+
+  m_start_time = inAnimation.getStartTime();
+  m_end_time   = inAnimation.getEndTime();
+
+  m_local_position.resize(m_pose_position.size());
+  m_local_rotation.resize(m_pose_rotation.size());
+
+  setInstanceCount(m_instance_count);
+}
+
+VkeBakedAnimation::ID VkeBakedAnimation::getNodeIndex(Node* inNode)
+{
+  std::map<Node*, ID>::iterator itr = m_node_ids.find(inNode);
+  if(itr == m_node_ids.end())
+    return INVALID_ID;
+  return itr->second;
+}
+
+void VkeBakedAnimation::updatePose(Node* inNode)
+{
+  ID id = getNodeIndex(inNode);
+  if(id == INVALID_ID)
+    return;
+
+  nvmath::vec3f position = inNode->getPosition();
+  nvmath::quatf rotation;
+  rotation.from_euler_xyz(inNode->getRotation());
+
+  m_pose_position[id * 3 + 0] = position.x;
+  m_pose_position[id * 3 + 1] = position.y;
+  m_pose_position[id * 3 + 2] = position.z;
+  m_pose_rotation[id * 4 + 0] = rotation.x;
+  m_pose_rotation[id * 4 + 1] = rotation.y;
+  m_pose_rotation[id * 4 + 2] = rotation.z;
+  m_pose_rotation[id * 4 + 3] = rotation.w;
+}
+
+void VkeBakedAnimation::setInstanceCount(Count inCount)
+{
+  m_instance_count = inCount;
+  m_cursors.assign(size_t(inCount) * (m_positions.size() + m_rotations.size()), 0);
+}
+
+inline VkeBakedAnimation::ID VkeBakedAnimation::findKey(Channels& inChannels, ID inChannel, float inTime, ID& inOutCursor, float& outFactor)
+{
+  ID           first = inChannels.first[inChannel];
+  Count        count = inChannels.count[inChannel];
+  const float* times = &inChannels.time[first];
+
+  // outside the keys the first or last key is used, same as VkeAnimationChannel
+  outFactor = 0.0f;
+  if(inTime < times[0])
+    return first;
+  if(inTime >= times[count - 1])
+    return first + count - 1;
+
+  // times[key] <= inTime < times[key + 1]
+  ID key = inOutCursor;
+  if(key >= count - 1 || times[key] > inTime)
+  {
+    // time went backwards, e.g. the animation looped
+    key = ID(std::upper_bound(times, times + count, inTime) - times) - 1;
+  }
+  while(times[key + 1] <= inTime)
+  {
+    key++;
+  }
+  inOutCursor = key;
+
+  float s   = (inTime - times[key]) / (times[key + 1] - times[key]);
+  outFactor = (3.0f - 2.0f * s) * s * s;
+  return first + key;
+}
+
+void VkeBakedAnimation::evaluatePositions(float inTime, ID* inOutCursors)
+{
+  Channels& ch    = m_positions;
+  Count     count = ch.size();
+
+  KeyLanes keys;
+  float    values[3][4];
+
+  for(ID c = 0; c < count; c += 4)
+  {
+    int lanes = int(std::min(Count(4), count - c));
+    for(int l = 0; l < 4; ++l)
+    {
+      // unused lanes repeat the first channel
+      ID    channel = c + (l < lanes ? l : 0);
+      float factor;
+      ID    a = findKey(ch, channel, inTime, inOutCursors[channel], factor);
+      ID    b = factor > 0.0f ? a + 1 : a;
+
+      keys.factor[l] = factor;
+      keys.a[0][l]   = ch.x[a];
+      keys.a[1][l]   = ch.y[a];
+      keys.a[2][l]   = ch.z[a];
+      keys.b[0][l]   = ch.x[b];
+      keys.b[1][l]   = ch.y[b];
+      keys.b[2][l]   = ch.z[b];
+    }
+
+    for(int l = 0; l < 4; l += LANES_WIDTH)
+    {
+      lerpLanes(keys, values, l);
+    }
+
+    for(int l = 0; l < lanes; ++l)
+    {
+      float* position = &m_local_position[ch.node[c + l] * 3];
+      position[0]     = values[0][l];
+      position[1]     = values[1][l];
+      position[2]     = values[2][l];
+    }
+  }
+}
+
+void VkeBakedAnimation::evaluateRotations(float inTime, ID* inOutCursors)
+{
+  Channels& ch    = m_rotations;
+  Count     count = ch.size();
+
+  KeyLanes keys;
+  float    values[4][4];
+
+  for(ID c = 0; c < count; c += 4)
+  {
+    int lanes = int(std::min(Count(4), count - c));
+    for(int l = 0; l < 4; ++l)
+    {
+      ID    channel = c + (l < lanes ? l : 0);
+      float factor;
+      ID    a = findKey(ch, channel, inTime, inOutCursors[channel], factor);
+      ID    b = factor > 0.0f ? a + 1 : a;
+
+      keys.factor[l] = factor;
+      if(factor > 0.0f)
+      {
+        keys.angle[l]    = ch.angle[a];
+        keys.sine_inv[l] = ch.sine_inv[a];
+      }
+      else
+      {
+        keys.angle[l]    = 0.0f;
+        keys.sine_inv[l] = 0.0f;
+      }
+      keys.keep[l] = keys.sine_inv[l] == 0.0f ? 1.0f : 0.0f;
+
+      keys.a[0][l] = ch.x[a];
+      keys.a[1][l] = ch.y[a];
+      keys.a[2][l] = ch.z[a];
+      keys.a[3][l] = ch.w[a];
+      keys.b[0][l] = ch.x[b];
+      keys.b[1][l] = ch.y[b];
+      keys.b[2][l] = ch.z[b];
+      keys.b[3][l] = ch.w[b];
+    }
+
+    for(int l = 0; l < 4; l += LANES_WIDTH)
+    {
+      slerpLanes(keys, values, l);
+    }
+
+    for(int l = 0; l < lanes; ++l)
+    {
+      float* rotation = &m_local_rotation[ch.node[c + l] * 4];
+      rotation[0]     = values[0][l];
+      rotation[1]     = values[1][l];
+      rotation[2]     = values[2][l];
+      rotation[3]     = values[3][l];
+    }
+  }
+}
+
+void VkeBakedAnimation::evaluateWorld(nvmath::mat4f* outWorld)
+{
+  Count count = getNodeCount();
+  float local[16];
+
+  for(ID n = 0; n < count; ++n)
+  {
+    float* world = outWorld[n].mat_array;
+    ID     p     = m_parents[n];
+    if(p == INVALID_ID)
+    {
+      localMatrix(world, &m_local_position[n * 3], &m_local_rotation[n * 4]);
+    }
+    else
+    {
+      // parents come first and are done already
+      localMatrix(local, &m_local_position[n * 3], &m_local_rotation[n * 4]);
+      multiplyMatrix(world, outWorld[p].mat_array, local);
+    }
+  }
+}
+
+void VkeBakedAnimation::evaluate(const double* inTimes, nvmath::mat4f* outWorld, ID inFirstInstance, Count inInstanceCount)
+{
+  Count channelCount = m_positions.size() + m_rotations.size();
+  Count nodeCount    = getNodeCount();
+
+  for(Count i = 0; i < inInstanceCount; ++i)
+  {
+    ID*   cursors = &m_cursors[size_t(inFirstInstance + i) * channelCount];
+    float time    = float(inTimes[i]);
+
+    memcpy(m_local_position.data(), m_pose_position.data(), sizeof(float) * m_pose_position.size());
+    memcpy(m_local_rotation.data(), m_pose_rotation.data(), sizeof(float) * m_pose_rotation.size());
+
+    evaluatePositions(time, cursors);
+    evaluateRotations(time, cursors + m_positions.size());
+    evaluateWorld(outWorld + size_t(i) * nodeCount);
+  }
+}
+
+double VkeBakedAnimation::benchmark(Count inInstanceCount, Count inFrames)
+{
+  Count instanceCount = m_instance_count;
+  setInstanceCount(inInstanceCount);
+
+  std::vector<nvmath::mat4f> world(size_t(inInstanceCount) * getNodeCount());
+  std::vector<double>        times(inInstanceCount);
+
+  double duration = std::max(m_end_time - m_start_time, 1.0);
+  double step     = duration / 240.0;
+
+  double total = 0.0;
+  for(Count f = 0; f < inFrames; ++f)
+  {
+    // every instance runs at a different phase of the animation
+    for(Count i = 0; i < inInstanceCount; ++i)
+    {
+      double phase = duration * double(i) / double(inInstanceCount);
+      times[i]     = m_start_time + fmod(phase + step * double(f), duration);
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    evaluate(times.data(), world.data(), 0, inInstanceCount);
+    total += double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+
+  setInstanceCount(instanceCount);
+
+  return inFrames ? total / (1e6 * double(inFrames)) : 0.0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Contact chebert@nvidia.com (Chris Hebert) for feedback */
+
+#ifndef __H_VKE_BAKED_ANIMATION_
+#define __H_VKE_BAKED_ANIMATION_
+
+#pragma once
+
+#include "Node.h"
+#include "VkeSceneAnimation.h"
+#include <map>
+#include <nvmath/nvmath.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+	Flattened copy of a VkeSceneAnimation and the node hierarchy
+	it animates, to evaluate many instances of the animation per frame.
+
+	- Keys are stored per channel in flat arrays, rotation keys also
+	  store the slerp angle to their next key.
+	- Every instance keeps a key cursor per channel, so advancing the
+	  time only steps over the keys in between.
+	- Channels are interpolated 4 at a time with SIMD.
+	- Nodes are sorted parents first, so world matrices are computed
+	  in one linear pass.
+
+	The result matches VkeAnimationNode::update followed by Node::update,
+	world = parent world * translation * rotation, scale keys are
+	ignored just like there. Channels without keys keep the node's pose.
+
+	VulkanAppContext evaluates one instance per frame and the node
+	uniforms are filled from its world matrices, see
+	VkeNodeData::List::update. tests/test_bakedanimation.cpp compares
+	against the VkeAnimationNode path, tests/bench_bakedanimation.cpp
+	measures both.
+*/
+
+class VkeBakedAnimation
+{
+public:
+  typedef uint32_t ID;
+  typedef uint32_t Count;
+
+  static const ID INVALID_ID = ~0u;
+
+  VkeBakedAnimation();
+  ~VkeBakedAnimation();
+
+  void bake(VkeSceneAnimation& inAnimation, Node::NodeList& inRootNodes);
+
+  // resets the key cursors of all instances
+  void setInstanceCount(Count inCount);
+
+  // evaluates instances [inFirstInstance, inFirstInstance + inInstanceCount),
+  // inTimes has one time per evaluated instance, outWorld getNodeCount() matrices per instance
+  void evaluate(const double* inTimes, nvmath::mat4f* outWorld, ID inFirstInstance, Count inInstanceCount);
+
+  Count getNodeCount() { return Count(m_nodes.size()); }
+  Count getInstanceCount() { return m_instance_count; }
+
+  // index within the matrices of an instance
+  ID getNodeIndex(Node* inNode);
+
+  // takes over position and rotation of a node moved by the application,
+  // animated channels still override them
+  void updatePose(Node* inNode);
+
+  double& getStartTime() { return m_start_time; }
+  double& getEndTime() { return m_end_time; }
+
+  // evaluates inInstanceCount instances over inFrames frames,
+  // returns the average time per frame in milliseconds,
+  // the previous instance count is restored with its key cursors reset
+  double benchmark(Count inInstanceCount, Count inFrames);
+
+private:
+  struct Channels
+  {
+    // per channel
+    std::vector<ID>    first;
+    std::vector<Count> count;
+    std::vector<ID>    node;
+
+    // per key
+    std::vector<float> time;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> w;
+
+    // per key, rotations only: slerp angle to the next key and 1/sin(angle),
+    // both 0 when the keys are too close to slerp
+    std::vector<float> angle;
+    std::vector<float> sine_inv;
+
+    Count size() { return Count(first.size()); }
+    void  add(VkeAnimationKey::List& inKeys, ID inNode, bool inRotation);
+  };
+
+  void addNode(Node* inNode, ID inParent);
+
+  // returns the key to interpolate from, advances inOutCursor,
+  // outFactor 0 selects that key alone
+  inline ID findKey(Channels& inChannels, ID inChannel, float inTime, ID& inOutCursor, float& outFactor);
+
+  void evaluatePositions(float inTime, ID* inOutCursors);
+  void evaluateRotations(float inTime, ID* inOutCursors);
+  void evaluateWorld(nvmath::mat4f* outWorld);
+
+  // per node, sorted parents first
+  std::vector<Node*>  m_nodes;
+  std::vector<ID>     m_parents;
+  std::map<Node*, ID> m_node_ids;
+
+  // per node, the pose without animation
+  std::vector<float> m_pose_position;  // xyz
+  std::vector<float> m_pose_rotation;  // quaternion xyzw
+
+  Channels m_positions;
+  Channels m_rotations;
+
+  // per instance and channel, positions first
+  std::vector<ID> m_cursors;
+  Count           m_instance_count;
+
+  // scratch for one instance, per node
+  std::vector<float> m_local_position;
+  std::vector<float> m_local_rotation;
+
+  double m_start_time;
+  double m_end_time;
+};
+
+#endif
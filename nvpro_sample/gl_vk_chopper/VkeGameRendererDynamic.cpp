@@ -526,7 +526,7 @@ void vkeGameRendererDynamic::update()
     m_flight_paths[i]->update(matPtr, sTime);
   }
 
-  m_node_data->update((VkeNodeUniform*)m_uniforms_local, m_instance_count);
+  m_node_data->update((VkeNodeUniform*)m_uniforms_local, ctxt->getNodeWorld(), m_instance_count);
 
   m_camera->setViewport(0, 0, (float)m_width, (float)m_height);
   m_camera->update();
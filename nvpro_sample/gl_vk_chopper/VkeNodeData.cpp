@@ -26,6 +26,7 @@
 VkeNodeData::VkeNodeData()
     : VkeBuffer()
     , m_layer(0)
+    , m_world_index(~0u)
     , m_needs_buffer_update(true)
 {
   //initNodeData();
@@ -35,6 +36,7 @@ VkeNodeData::VkeNodeData()
 VkeNodeData::VkeNodeData(const ID& inID)
     : VkeBuffer()
     , m_layer(0)
+    , m_world_index(~0u)
     , m_needs_buffer_update(true)
 {
 
@@ -139,6 +141,22 @@ void VkeNodeData::updateFromNode(Node* const inNode, VkeNodeUniform* inData, uin
   updateVKBufferData(inData);
 }
 
+void VkeNodeData::updateFromWorld(const nvmath::mat4f& inWorld, VkeNodeUniform* inData, uint32_t inInstanceCount)
+{
+  // same as Transform::update
+  nvmath::mat4f normal = nvmath::transpose(nvmath::invert(inWorld));
+  normal.a30           = 0.0;
+  normal.a31           = 0.0;
+  normal.a32           = 0.0;
+
+  m_backing_store->view_matrix   = inWorld;
+  m_backing_store->normal_matrix = normal;
+  m_backing_store->lookup.x      = m_mesh->getMaterialID();
+  m_backing_store->lookup.y      = inInstanceCount;
+
+  updateVKBufferData(inData);
+}
+
 void VkeNodeData::updateConstantVKBufferData(VkCommandBuffer* inBuffer)
 {
 
@@ -222,6 +240,23 @@ void VkeNodeData::List::update(VkeNodeUniform* inData, uint32_t inInstanceCount)
   }
 }
 
+void VkeNodeData::List::update(VkeNodeUniform* inData, const nvmath::mat4f* inWorld, uint32_t inInstanceCount)
+{
+  size_t sz = m_data.size();
+  for(size_t i = 0; i < sz; ++i)
+  {
+    uint32_t index = m_data[i]->getWorldIndex();
+    if(inWorld && index != ~0u)
+    {
+      m_data[i]->updateFromWorld(inWorld[index], inData, inInstanceCount);
+    }
+    else
+    {
+      m_data[i]->updateFromNode(inData, inInstanceCount);
+    }
+  }
+}
+
 void VkeNodeData::List::getDescriptors(VkDescriptorBufferInfo* outDescriptors)
 {
   VkeNodeData::Map::iterator itr;
@@ -60,6 +60,8 @@ public:
     VkeNodeData* getData(const ID& inID);
     void         update();
     void         update(VkeNodeUniform* inData, uint32_t inInstanceCount = 1);
+    // nodes with a world index take their world matrix from inWorld, the others use Node::update
+    void update(VkeNodeUniform* inData, const nvmath::mat4f* inWorld, uint32_t inInstanceCount = 1);
 
     ID    nextID();
     Count count();
@@ -89,6 +91,10 @@ public:
 
   inline void setIndex(size_t inIndex) { m_index = inIndex; }
 
+  // index of the node's world matrix passed to List::update, ~0u to use Node::update
+  void     setWorldIndex(uint32_t inIndex) { m_world_index = inIndex; }
+  uint32_t getWorldIndex() { return m_world_index; }
+
   void initNodeData();
   void initNodeDataSubAlloc();
   void updateFromNode();
@@ -96,6 +102,7 @@ public:
   void updateFromNode(VkCommandBuffer* inBuffer);
   void updateFromNode(Node* const inNode, VkeNodeUniform* inData, uint32_t inInstanceCount = 1);
   void updateFromNode(VkeNodeUniform* inData, uint32_t inInstanceCount = 1);
+  void updateFromWorld(const nvmath::mat4f& inWorld, VkeNodeUniform* inData, uint32_t inInstanceCount = 1);
   void updateConstantVKBufferData(VkCommandBuffer* inBuffer = NULL);
 
   void updateVKBufferData(VkeNodeUniform* inData);
@@ -110,6 +117,7 @@ public:
   VkeMesh* m_mesh;
 
   uint32_t m_layer;
+  uint32_t m_world_index;
 
   bool m_needs_buffer_update;
 };
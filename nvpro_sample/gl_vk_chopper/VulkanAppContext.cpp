@@ -174,6 +174,20 @@ void VulkanAppContext::loadVKSScene(std::string& inFileName)
     addVKSNode(&vkFile, nodesProcessed);
   }
 
+  /*
+		The scene is one instance of the baked animation,
+		its world matrices replace Node::update per frame.
+	*/
+  m_baked_animation.bake(m_animation, m_scene_graph->Nodes());
+  m_baked_animation.setInstanceCount(1);
+  m_node_world.resize(m_baked_animation.getNodeCount());
+
+  for(VkeNodeData::Count i = 0; i < m_node_data.count(); ++i)
+  {
+    VkeNodeData* data = m_node_data.getData(i);
+    data->setWorldIndex(m_baked_animation.getNodeIndex(data->getNode()));
+  }
+
 
   m_node_data.sortByOpacity();
 }
@@ -214,7 +228,7 @@ void VulkanAppContext::addVKSNode(VKSFile* inFile, uint32_t& inNodesProcessed, N
   VkeAnimationNode* animNode = m_animation.Nodes().getNode(nameStr);
   if(animNode)
   {
-    animNode->setNode(m_node_data.getData(node->getID()));
+    animNode->setNode(node);
   }
 
   if(nameStr == "main_rotor_parts02")
@@ -305,8 +319,14 @@ void VulkanAppContext::render()
   if(m_rotor_node)
   {
     m_rotor_node->getNode()->setRotation(0.0, 0.0, -m_rot_y * 32.0);
+    m_baked_animation.updatePose(m_rotor_node->getNode());
   }
 
+  double startTime = m_baked_animation.getStartTime();
+  double duration  = m_baked_animation.getEndTime() - startTime;
+  double animTime  = duration > 0.0 ? startTime + fmod(seconds_since_start, duration) : 0.0;
+  m_baked_animation.evaluate(&animTime, m_node_world.data(), 0, 1);
+
   m_renderer->update();
 }
 
@@ -31,6 +31,7 @@
 #include "VkeMaterial.h"
 #include "VkeMesh.h"
 #include "VkeNodeData.h"
+#include "VkeBakedAnimation.h"
 #include "VkeSceneAnimation.h"
 #include "vkaUtils.h"
 
@@ -68,7 +69,7 @@ public:
   nvmath::vec4f getRotorPos()
   {
     nvmath::vec4f pos(0.0f, 0.0f, -1.0f, 1.0f);
-    return m_rotor_node->getNode()->worldPosition(pos);
+    return m_node_world[m_rotor_node->getWorldIndex()] * pos;
   }
 
   VkeVBO* getVBO() { return &m_global_vbo; }
@@ -78,6 +79,11 @@ public:
 
   float getOpacity(uint32_t inMatID) { return m_materials.getMaterial(inMatID)->getBackingStore()->opacity; }
 
+  VkeBakedAnimation& getBakedAnimation() { return m_baked_animation; }
+
+  // world matrices of the current frame, per baked animation node
+  const nvmath::mat4f* getNodeWorld() { return m_node_world.empty() ? NULL : m_node_world.data(); }
+
 private:
   VkInstance m_vk_instance;
 
@@ -98,6 +104,9 @@ private:
 
   bool              m_ready;
   VkeSceneAnimation m_animation;
+  VkeBakedAnimation m_baked_animation;
+
+  std::vector<nvmath::mat4f> m_node_world;
 
   VkeVBO m_global_vbo;
   VkeIBO m_global_ibo;
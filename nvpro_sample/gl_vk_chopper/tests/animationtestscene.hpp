@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Random node hierarchy and animation shared by test_bakedanimation and
+// bench_bakedanimation, plus the per node evaluation the sample used before
+// VkeBakedAnimation: VkeAnimationNode::update followed by Node::update.
+
+#ifndef ANIMATIONTESTSCENE_H__
+#define ANIMATIONTESTSCENE_H__
+
+#include "../VkeBakedAnimation.h"
+
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+
+struct AnimationTestScene
+{
+  Node::NodeList     roots;
+  std::vector<Node*> nodes;  // in creation order
+  std::vector<Node*> posed;  // without VkeAnimationNode
+  VkeSceneAnimation  animation;
+};
+
+inline float randomSigned(std::mt19937& rng)
+{
+  return std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+}
+
+inline nvmath::vec4f randomQuat(std::mt19937& rng)
+{
+  nvmath::vec4f q(randomSigned(rng), randomSigned(rng), randomSigned(rng), randomSigned(rng));
+  float         length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+  return q / length;
+}
+
+// Every third node has no animation and keeps its pose. The others get
+// 1 to maxKeys keys per channel, the legacy path resets channels without
+// keys rather than keeping the pose. Rotation keys sometimes repeat, which
+// VkeBakedAnimation does not slerp.
+inline void buildAnimationTestScene(AnimationTestScene& scene, std::mt19937& rng, int numRoots, int numNodes, int maxKeys)
+{
+  for(int i = 0; i < numNodes; i++)
+  {
+    Node* node = i < numRoots ? scene.roots.newNode(i) : scene.nodes[rng() % scene.nodes.size()]->newChild(Node::ID(i));
+    node->setPosition(randomSigned(rng) * 3.0f, randomSigned(rng) * 3.0f, randomSigned(rng) * 3.0f);
+    node->setRotation(randomSigned(rng) * 3.0f, randomSigned(rng) * 1.5f, randomSigned(rng) * 3.0f);
+    scene.nodes.push_back(node);
+
+    if(i % 3 == 0)
+    {
+      scene.posed.push_back(node);
+      continue;
+    }
+
+    std::string       name     = "node" + std::to_string(i);
+    VkeAnimationNode* animNode = scene.animation.newNode(name);
+    animNode->setNode(node);
+
+    int    keys = 1 + int(rng() % maxKeys);
+    double time = 0.0;
+    for(int k = 0; k < keys; k++)
+    {
+      time += 0.1 + double(rng() % 100) / 50.0;
+      nvmath::vec4f position(randomSigned(rng) * 5.0f, randomSigned(rng) * 5.0f, randomSigned(rng) * 5.0f, 1.0f);
+      animNode->Position().newKey(time, position);
+    }
+
+    keys            = 1 + int(rng() % maxKeys);
+    time            = 0.0;
+    nvmath::vec4f q = randomQuat(rng);
+    for(int k = 0; k < keys; k++)
+    {
+      time += 0.1 + double(rng() % 100) / 50.0;
+      if(rng() % 4)
+      {
+        q = randomQuat(rng);
+      }
+      animNode->Rotation().newKey(time, q);
+    }
+  }
+}
+
+// the sample's evaluation before VkeBakedAnimation, matrices are stored in the
+// order of baked.getNodeIndex, getNodeCount() per instance
+inline void evaluateLegacy(AnimationTestScene& scene, VkeBakedAnimation& baked, const double* times, nvmath::mat4f* outWorld, uint32_t instanceCount)
+{
+  uint32_t nodeCount = baked.getNodeCount();
+  for(uint32_t i = 0; i < instanceCount; i++)
+  {
+    double time = times[i];
+    scene.animation.setCurrentTime(time);
+    scene.animation.update();
+
+    Node::List& roots = scene.roots.getData();
+    for(size_t r = 0; r < roots.size(); r++)
+    {
+      roots[r]->update(true);
+    }
+
+    for(size_t n = 0; n < scene.nodes.size(); n++)
+    {
+      outWorld[size_t(i) * nodeCount + baked.getNodeIndex(scene.nodes[n])] = scene.nodes[n]->GetTransform().getTransform();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// CPU cost per frame of VkeBakedAnimation::evaluate compared to the per node
+// path the sample used before, VkeAnimationNode::update + Node::update for
+// every instance. Instances run at different phases of the animation and
+// advance by a fixed step per frame, like VkeBakedAnimation::benchmark.
+
+#include "animationtestscene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+int main()
+{
+  const uint32_t instanceCounts[] = {1, 16, 256, 1024};
+  const uint32_t frames           = 20;
+
+  std::mt19937       rng(1);
+  AnimationTestScene scene;
+  // about the size of the chopper
+  buildAnimationTestScene(scene, rng, 1, 64, 60);
+
+  VkeBakedAnimation baked;
+  baked.bake(scene.animation, scene.roots);
+  uint32_t nodeCount = baked.getNodeCount();
+
+  double duration = baked.getEndTime() - baked.getStartTime();
+  double step     = duration / 240.0;
+
+  printf("%d nodes, %.1f s animation\n", nodeCount, duration);
+  printf("instances | per node ms/frame | baked ms/frame | speedup | max difference\n");
+
+  bool identical = true;
+  for(uint32_t instances : instanceCounts)
+  {
+    baked.setInstanceCount(instances);
+
+    std::vector<nvmath::mat4f> world(size_t(nodeCount) * instances);
+    std::vector<nvmath::mat4f> reference(size_t(nodeCount) * instances);
+    std::vector<double>        times(instances);
+
+    // per node, baked
+    double total[2] = {0.0, 0.0};
+    double maxDiff  = 0.0;
+    for(uint32_t f = 0; f < frames; f++)
+    {
+      for(uint32_t i = 0; i < instances; i++)
+      {
+        double phase = duration * double(i) / double(instances);
+        times[i]     = baked.getStartTime() + fmod(phase + step * double(f), duration);
+      }
+
+      Clock::time_point begin = Clock::now();
+      evaluateLegacy(scene, baked, times.data(), reference.data(), instances);
+      Clock::time_point end = Clock::now();
+      total[0] += std::chrono::duration<double>(end - begin).count();
+
+      begin = Clock::now();
+      baked.evaluate(times.data(), world.data(), 0, instances);
+      end = Clock::now();
+      total[1] += std::chrono::duration<double>(end - begin).count();
+
+      for(size_t m = 0; m < world.size(); m++)
+      {
+        for(int c = 0; c < 16; c++)
+        {
+          maxDiff = std::max(maxDiff, double(fabsf(world[m].mat_array[c] - reference[m].mat_array[c])));
+        }
+      }
+    }
+
+    identical = identical && maxDiff < 1.0e-2;
+    printf("%9d | %17.3f | %14.3f | %7.1f | %g\n", instances, total[0] * 1e3 / frames, total[1] * 1e3 / frames,
+           total[0] / total[1], maxDiff);
+  }
+
+  if(!identical)
+  {
+    printf("results differ\n");
+  }
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// VkeBakedAnimation against VkeAnimationNode::update + Node::update on random
+// hierarchies: several instances with looping, jumping and out of range times,
+// evaluating subsets of the instances, and poses changed by the application
+// the way VulkanAppContext spins the rotor.
+
+#include "animationtestscene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+static double maxDifference(const nvmath::mat4f* a, const nvmath::mat4f* b, size_t count)
+{
+  double maxDiff = 0.0;
+  for(size_t m = 0; m < count; m++)
+  {
+    for(int i = 0; i < 16; i++)
+    {
+      double diff = fabs(double(a[m].mat_array[i]) - double(b[m].mat_array[i])) / (1.0 + fabs(double(b[m].mat_array[i])));
+      maxDiff     = std::isnan(diff) ? INFINITY : std::max(maxDiff, diff);
+    }
+  }
+  return maxDiff;
+}
+
+static int testScene(std::mt19937& rng, int numRoots, int numNodes, int maxKeys)
+{
+  const uint32_t instances = 7;
+  const int      frames    = 300;
+  const double   tolerance = 1.0e-3;
+
+  int failed = 0;
+
+  AnimationTestScene scene;
+  buildAnimationTestScene(scene, rng, numRoots, numNodes, maxKeys);
+
+  VkeBakedAnimation baked;
+  baked.bake(scene.animation, scene.roots);
+  uint32_t nodeCount = baked.getNodeCount();
+  if(nodeCount != uint32_t(numNodes))
+  {
+    printf("  %d nodes baked, expected %d\n", nodeCount, numNodes);
+    return 1;
+  }
+
+  baked.setInstanceCount(instances);
+  std::vector<nvmath::mat4f> world(nodeCount * instances);
+  std::vector<nvmath::mat4f> reference(nodeCount * instances);
+  std::vector<nvmath::mat4f> subset(nodeCount * instances);
+
+  double duration = baked.getEndTime() - baked.getStartTime();
+  double maxDiff  = 0.0;
+  int    mismatch = 0;
+  for(int f = 0; f < frames; f++)
+  {
+    // instances step forward at different speeds and loop, starting before the
+    // first key, the last one jumps around, also past the last key
+    double times[instances];
+    for(uint32_t i = 0; i < instances; i++)
+    {
+      times[i] = i + 1 == instances ? double(rng() % 1000) / 1000.0 * (duration + 2.0) - 1.0 :
+                                      fmod(f * 0.037 * (i + 1), duration + 1.0) - 0.5;
+    }
+
+    // the poses of nodes without animation may change at any time
+    if(f % 50 == 49)
+    {
+      for(Node* node : scene.posed)
+      {
+        node->setPosition(randomSigned(rng) * 3.0f, randomSigned(rng) * 3.0f, randomSigned(rng) * 3.0f);
+        node->setRotation(randomSigned(rng) * 3.0f, randomSigned(rng) * 1.5f, randomSigned(rng) * 3.0f);
+        baked.updatePose(node);
+      }
+    }
+
+    baked.evaluate(times, world.data(), 0, instances);
+    evaluateLegacy(scene, baked, times, reference.data(), instances);
+    maxDiff = std::max(maxDiff, maxDifference(world.data(), reference.data(), world.size()));
+
+    // instances are independent of each other, evaluating them in parts gives the same matrices
+    baked.evaluate(times, subset.data(), 0, 2);
+    baked.evaluate(times + 2, subset.data() + 2 * nodeCount, 2, instances - 2);
+    mismatch += memcmp(subset.data(), world.data(), sizeof(nvmath::mat4f) * world.size()) ? 1 : 0;
+  }
+
+  if(maxDiff > tolerance)
+  {
+    printf("  max relative difference %g\n", maxDiff);
+    failed++;
+  }
+  if(mismatch)
+  {
+    printf("  %d frames differ when evaluated in parts\n", mismatch);
+    failed++;
+  }
+
+  // restores the instance count
+  baked.benchmark(3, 2);
+  if(baked.getInstanceCount() != instances)
+  {
+    printf("  benchmark changed the instance count to %d\n", baked.getInstanceCount());
+    failed++;
+  }
+
+  printf("%d nodes, %d roots, up to %d keys: max difference %g, %s\n", numNodes, numRoots, maxKeys, maxDiff,
+         failed ? "FAILED" : "ok");
+  return failed;
+}
+
+int main()
+{
+  std::mt19937 rng(7);
+
+  int failed = 0;
+  failed += testScene(rng, 1, 10, 1);
+  failed += testScene(rng, 1, 40, 6);
+  failed += testScene(rng, 2, 60, 3);
+  failed += testScene(rng, 3, 200, 12);
+  failed += testScene(rng, 1, 500, 40);
+
+  printf(failed ? "FAILED\n" : "passed\n");
+  return failed ? 1 : 0;
+}
@@ -116,6 +116,9 @@ class Sample : public nvgl::AppWindowProfilerGL
   Tweak tweak;
   Tweak tweakLast;
 
+  // number of instances for the animation benchmark, 0 disables it
+  uint32_t animBenchmark;
+
   struct
   {
     GLuint scene;
@@ -138,7 +141,14 @@ class Sample : public nvgl::AppWindowProfilerGL
 
   bool initFramebuffers(int width, int height, int samples);
 
+  void benchmarkAnimation();
+
 public:
+  Sample()
+      : animBenchmark(0)
+  {
+    m_parameterList.add("animbenchmark", &animBenchmark);
+  }
 };
 
 
@@ -189,6 +199,17 @@ bool Sample::initScene()
   return true;
 }
 
+void Sample::benchmarkAnimation()
+{
+  VkeBakedAnimation& animation = VulkanAppContext::GetInstance()->getBakedAnimation();
+
+  const uint32_t frames = 100;
+  double         ms     = animation.benchmark(animBenchmark, frames);
+
+  LOGI("animation benchmark: %d instances, %d nodes, %d frames\n", animBenchmark, animation.getNodeCount(), frames);
+  LOGI("  %.3f ms per frame, %.1f ns per instance\n", ms, ms * 1e6 / double(animBenchmark));
+}
+
 bool Sample::initFramebuffers(int width, int height, int samples)
 {
 
@@ -246,6 +267,11 @@ bool Sample::begin()
 
   initVulkan();
 
+  if(animBenchmark)
+  {
+    benchmarkAnimation();
+  }
+
   m_control.m_sceneOrbit     = vec3(0.0f);
   m_control.m_sceneDimension = float(1.0);
   nvmath::vec3f scenePos     = nvmath::vec3f(20.0, -1.0, 8.0);
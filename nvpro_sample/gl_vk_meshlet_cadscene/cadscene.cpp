@@ -25,11 +25,15 @@
 #include "config.h"
 #include "nvmeshlet_array.hpp"
 #include "nvmeshlet_packbasic.hpp"
+#include "nvmeshlet_vertexpack.hpp"
 #include <nvh/geometry.hpp>
+#include <nvh/jobsystem.hpp>
 #include <nvh/misc.hpp>
+#include <nvp/nvpsystem.hpp>
 
 #include <algorithm>
 #include <assert.h>
+#include <thread>
 #include <platform.h>
 
 #define USE_CACHECOMBINE 1
@@ -100,7 +104,12 @@ bool CadScene::loadCSF(const char* filename, const LoadConfig& cfg, int clones,
     return false;
 
 
-  CSFileMemoryPTR csfmem = CSFileMemory_new();
+  CSFLoaderConfig config          = {0};
+  config.gltfFindUniqueGeometries = 1;
+  // offset and node fixup, as well as inflating .csf.gz, use all cores
+  config.numThreads = -1;
+
+  CSFileMemoryPTR csfmem = CSFileMemory_newCfg(&config);
 
   if(CSFile_loadExt(&csf, filename, csfmem) != CADSCENEFILE_NOERROR
      || !(csf->fileFlags & (CADSCENEFILE_FLAG_UNIQUENODES | CADSCENEFILE_FLAG_STRIPS)))
@@ -546,225 +555,505 @@ void CadScene::unload()
 }
 
 
-size_t fillIndexBuffer(int useShorts, const std::vector<unsigned int>& vertexindices, void*& storage)
+// Meshlets are built in chunks of at most LoadConfig::meshSplitTriangles, so
+// large geometries are spread across workers as well. Every worker builds into
+// its own arena, afterwards each geometry's buffers are stitched together from
+// the running sums over its chunks. Meshlets never cross a chunk boundary.
+
+#define MESHLET_ERRORCHECK 0
+
+struct MeshletChunk
+{
+  uint32_t geometry;
+  uint32_t part;
+  uint32_t indexBegin;
+  uint32_t numIndices;
+
+  // filled in by the building worker
+  uint32_t slot;
+  uint32_t processedIndices;
+  size_t   descBegin;
+  size_t   numDescs;
+  // packs for PackBasic, primitive indices for Array
+  size_t primBegin;
+  size_t numPrims;
+  size_t vertBegin;
+  size_t numVerts;
+  // compressed vertex streams in words, offsets start at descBegin
+  size_t vpackBegin;
+  size_t numVpack;
+};
+
+template <class TGeometry>
+struct MeshletArena
+{
+  // cleared per chunk, offsets within are chunk relative
+  TGeometry scratch;
+  // reordered chunk indices
+  std::vector<uint32_t> indices;
+  std::vector<uint32_t> indicesTemp;
+  // compressed vertex streams, cleared per chunk
+  std::vector<uint32_t> vpackScratch;
+  // results of all chunks this worker built
+  TGeometry             data;
+  std::vector<uint32_t> vpackData;
+  std::vector<uint32_t> vpackOffsets;
+  size_t                vpackVertices = 0;
+  NVMeshlet::Stats      stats;
+};
+
+typedef MeshletArena<NVMeshlet::PackBasicBuilder::MeshletGeometry>       MeshletArenaPackBasic;
+typedef MeshletArena<NVMeshlet::ArrayBuilder<uint32_t>::MeshletGeometry> MeshletArenaArray;
+
+template <class T>
+static void appendAndClear(std::vector<T>& dst, std::vector<T>& src, size_t& begin, size_t& num)
+{
+  begin = dst.size();
+  num   = src.size();
+  dst.insert(dst.end(), src.begin(), src.end());
+  src.clear();
+}
+
+static void appendArena(MeshletArenaPackBasic& arena, MeshletChunk& chunk)
+{
+  appendAndClear(arena.data.meshletDescriptors, arena.scratch.meshletDescriptors, chunk.descBegin, chunk.numDescs);
+  appendAndClear(arena.data.meshletPacks, arena.scratch.meshletPacks, chunk.primBegin, chunk.numPrims);
+  arena.scratch.meshletBboxes.clear();
+  chunk.vertBegin = 0;
+  chunk.numVerts  = 0;
+}
+
+static void appendArena(MeshletArenaArray& arena, MeshletChunk& chunk)
+{
+  appendAndClear(arena.data.meshletDescriptors, arena.scratch.meshletDescriptors, chunk.descBegin, chunk.numDescs);
+  appendAndClear(arena.data.primitiveIndices, arena.scratch.primitiveIndices, chunk.primBegin, chunk.numPrims);
+  appendAndClear(arena.data.vertexIndices, arena.scratch.vertexIndices, chunk.vertBegin, chunk.numVerts);
+  arena.scratch.meshletBboxes.clear();
+}
+
+static void fillMeshletTopology(const std::vector<MeshletArenaPackBasic>& arenas,
+                                MeshletChunk*                             chunks,
+                                size_t                                    numChunks,
+                                CadScene::MeshletTopology&                topo,
+                                int /*useShorts*/)
 {
-  size_t vidxSize;
+  size_t numDescs = 0;
+  size_t numPacks = 0;
+  for(size_t c = 0; c < numChunks; c++)
+  {
+    numDescs += chunks[c].numDescs;
+    numPacks += chunks[c].numPrims;
+  }
+
+  topo.vertSize = 0;
+  topo.descSize = 0;
+  topo.primSize = 0;
+  if(!numDescs)
+    return;
+
+  topo.vertSize = NVMESHLET_PACK_ALIGNMENT;
+  topo.descSize = sizeof(NVMeshlet::MeshletPackBasicDesc) * numDescs;
+  topo.primSize = sizeof(NVMeshlet::PackBasicType) * numPacks;
+
+  topo.descData = malloc(topo.descSize);
+  topo.primData = malloc(topo.primSize);
+
+  NVMeshlet::MeshletPackBasicDesc* descs = (NVMeshlet::MeshletPackBasicDesc*)topo.descData;
+  NVMeshlet::PackBasicType*        packs = (NVMeshlet::PackBasicType*)topo.primData;
 
-  if(useShorts)
+  size_t descOffset = 0;
+  size_t packOffset = 0;
+  for(size_t c = 0; c < numChunks; c++)
   {
-    vidxSize = sizeof(uint16_t) * vertexindices.size();
+    const MeshletChunk&                                 chunk = chunks[c];
+    const NVMeshlet::PackBasicBuilder::MeshletGeometry& data  = arenas[chunk.slot].data;
 
-    uint16_t* vertexindices16 = (uint16_t*)malloc(vidxSize);
-    for(size_t i = 0; i < vertexindices.size(); i++)
+    for(size_t i = 0; i < chunk.numDescs; i++)
     {
-      vertexindices16[i] = vertexindices[i];
+      NVMeshlet::MeshletPackBasicDesc desc = data.meshletDescriptors[chunk.descBegin + i];
+      desc.setPackOffset(desc.getPackOffset() + uint32_t(packOffset));
+      descs[descOffset + i] = desc;
     }
+    memcpy(packs + packOffset, data.meshletPacks.data() + chunk.primBegin, sizeof(NVMeshlet::PackBasicType) * chunk.numPrims);
 
-    storage = vertexindices16;
+    descOffset += chunk.numDescs;
+    packOffset += chunk.numPrims;
   }
-  else
+}
+
+static void fillMeshletTopology(const std::vector<MeshletArenaArray>& arenas,
+                                MeshletChunk*                         chunks,
+                                size_t                                numChunks,
+                                CadScene::MeshletTopology&            topo,
+                                int                                   useShorts)
+{
+  size_t numDescs = 0;
+  size_t numPrims = 0;
+  size_t numVerts = 0;
+  for(size_t c = 0; c < numChunks; c++)
   {
-    vidxSize = sizeof(uint32_t) * vertexindices.size();
+    MeshletChunk& chunk = chunks[c];
+    // the 20 bit begins limit how much a single geometry can address, a chunk
+    // crossing the limit is split after its last meshlet that still starts within
+    if(!NVMeshlet::MeshletArrayDesc::isPrimBeginLegal(uint32_t(numPrims + chunk.numPrims))
+       || !NVMeshlet::MeshletArrayDesc::isVertexBeginLegal(uint32_t(numVerts + chunk.numVerts)))
+    {
+      const MeshletArenaArray&           arena = arenas[chunk.slot];
+      const NVMeshlet::MeshletArrayDesc* desc  = arena.data.meshletDescriptors.data() + chunk.descBegin;
 
-    uint32_t* vertexindices32 = (uint32_t*)malloc(vidxSize);
-    memcpy(vertexindices32, vertexindices.data(), vidxSize);
+      size_t numFit     = 0;
+      size_t numIndices = 0;
+      for(; numFit < chunk.numDescs; numFit++)
+      {
+        if(!NVMeshlet::MeshletArrayDesc::isPrimBeginLegal(uint32_t(numPrims + desc[numFit].getPrimBegin()))
+           || !NVMeshlet::MeshletArrayDesc::isVertexBeginLegal(uint32_t(numVerts + desc[numFit].getVertexBegin())))
+          break;
+        numIndices += desc[numFit].getNumPrims() * 3;
+      }
 
-    storage = vertexindices32;
+      if(numFit < chunk.numDescs)
+      {
+        // the remainder cannot be addressed and is reported as incomplete
+        chunk.processedIndices = uint32_t(numIndices);
+        chunk.numDescs         = numFit;
+        chunk.numPrims         = desc[numFit].getPrimBegin();
+        chunk.numVerts         = desc[numFit].getVertexBegin();
+        if(!arena.vpackOffsets.empty())
+        {
+          chunk.numVpack = arena.vpackOffsets[chunk.descBegin + numFit];
+        }
+      }
+    }
+    numDescs += chunk.numDescs;
+    numPrims += chunk.numPrims;
+    numVerts += chunk.numVerts;
   }
 
-  return vidxSize;
-}
-
-void fillMeshletTopology(NVMeshlet::ArrayBuilder<uint32_t>::MeshletGeometry& geometry, CadScene::MeshletTopology& topo, int useShorts)
-{
-  if(geometry.meshletDescriptors.empty())
+  topo.vertSize = 0;
+  topo.descSize = 0;
+  topo.primSize = 0;
+  if(!numDescs)
     return;
 
-  topo.vertSize = fillIndexBuffer(useShorts, geometry.vertexIndices, topo.vertData);
-
-  topo.descSize = sizeof(NVMeshlet::MeshletArrayDesc) * geometry.meshletDescriptors.size();
-  topo.primSize = sizeof(NVMeshlet::PrimitiveIndexType) * geometry.primitiveIndices.size();
+  topo.vertSize = (useShorts ? sizeof(uint16_t) : sizeof(uint32_t)) * numVerts;
+  topo.descSize = sizeof(NVMeshlet::MeshletArrayDesc) * numDescs;
+  topo.primSize = sizeof(NVMeshlet::PrimitiveIndexType) * numPrims;
 
+  topo.vertData = malloc(topo.vertSize);
   topo.descData = malloc(topo.descSize);
   topo.primData = malloc(topo.primSize);
 
-  memcpy(topo.descData, geometry.meshletDescriptors.data(), topo.descSize);
-  memcpy(topo.primData, geometry.primitiveIndices.data(), topo.primSize);
+  NVMeshlet::MeshletArrayDesc*   descs = (NVMeshlet::MeshletArrayDesc*)topo.descData;
+  NVMeshlet::PrimitiveIndexType* prims = (NVMeshlet::PrimitiveIndexType*)topo.primData;
+
+  size_t descOffset = 0;
+  size_t primOffset = 0;
+  size_t vertOffset = 0;
+  for(size_t c = 0; c < numChunks; c++)
+  {
+    const MeshletChunk&                                       chunk = chunks[c];
+    const NVMeshlet::ArrayBuilder<uint32_t>::MeshletGeometry& data  = arenas[chunk.slot].data;
+
+    for(size_t i = 0; i < chunk.numDescs; i++)
+    {
+      NVMeshlet::MeshletArrayDesc desc = data.meshletDescriptors[chunk.descBegin + i];
+      desc.offsetBegins(uint32_t(vertOffset), uint32_t(primOffset));
+      descs[descOffset + i] = desc;
+    }
+    memcpy(prims + primOffset, data.primitiveIndices.data() + chunk.primBegin,
+           sizeof(NVMeshlet::PrimitiveIndexType) * chunk.numPrims);
+
+    const uint32_t* vertexIndices = data.vertexIndices.data() + chunk.vertBegin;
+    if(useShorts)
+    {
+      uint16_t* vertexIndices16 = (uint16_t*)topo.vertData + vertOffset;
+      for(size_t i = 0; i < chunk.numVerts; i++)
+      {
+        vertexIndices16[i] = uint16_t(vertexIndices[i]);
+      }
+    }
+    else
+    {
+      memcpy((uint32_t*)topo.vertData + vertOffset, vertexIndices, sizeof(uint32_t) * chunk.numVerts);
+    }
+
+    descOffset += chunk.numDescs;
+    primOffset += chunk.numPrims;
+    vertOffset += chunk.numVerts;
+  }
 }
 
-void fillMeshletTopology(NVMeshlet::PackBasicBuilder::MeshletGeometry& geometry, CadScene::MeshletTopology& topo, int useShorts)
+template <class TArena>
+static void fillMeshletVertexPack(const std::vector<TArena>& arenas, const MeshletChunk* chunks, size_t numChunks, CadScene::MeshletTopology& topo)
 {
-  if(geometry.meshletDescriptors.empty())
+  size_t numDescs = 0;
+  size_t numWords = 0;
+  for(size_t c = 0; c < numChunks; c++)
+  {
+    numDescs += chunks[c].numDescs;
+    numWords += chunks[c].numVpack;
+  }
+
+  topo.vpackSize = 0;
+  if(!numDescs)
     return;
 
-  topo.vertSize = NVMESHLET_PACK_ALIGNMENT;
-  topo.descSize = sizeof(NVMeshlet::MeshletPackBasicDesc) * geometry.meshletDescriptors.size();
-  topo.primSize = sizeof(NVMeshlet::PackBasicType) * geometry.meshletPacks.size();
+  size_t headerWords = NVMeshlet::alignedSize(uint32_t(numDescs), NVMeshlet::VERTEXPACK_ALIGNMENT);
+  topo.vpackSize     = sizeof(uint32_t) * (headerWords + numWords);
+  topo.vpackData     = malloc(topo.vpackSize);
 
-  topo.descData = malloc(topo.descSize);
-  topo.primData = malloc(topo.primSize);
+  uint32_t* offsets = (uint32_t*)topo.vpackData;
+  memset(offsets + numDescs, 0, sizeof(uint32_t) * (headerWords - numDescs));
 
-  memcpy(topo.descData, geometry.meshletDescriptors.data(), topo.descSize);
-  memcpy(topo.primData, geometry.meshletPacks.data(), topo.primSize);
-}
+  size_t descOffset = 0;
+  size_t wordOffset = headerWords;
+  for(size_t c = 0; c < numChunks; c++)
+  {
+    const MeshletChunk& chunk = chunks[c];
+    const TArena&       arena = arenas[chunk.slot];
+
+    for(size_t i = 0; i < chunk.numDescs; i++)
+    {
+      offsets[descOffset + i] = arena.vpackOffsets[chunk.descBegin + i] + uint32_t(wordOffset);
+    }
+    memcpy(offsets + wordOffset, arena.vpackData.data() + chunk.vpackBegin, sizeof(uint32_t) * chunk.numVpack);
 
+    descOffset += chunk.numDescs;
+    wordOffset += chunk.numVpack;
+  }
+}
 
-void CadScene::buildMeshletTopology(const CSFile* csf)
+// returns the number of triangles processed
+template <class TBuilder>
+static size_t buildMeshletChunks(CadScene&         scene,
+                                 const CSFile*     csf,
+                                 const TBuilder&   builder,
+                                 nvh::JobSystem&   jobSystem,
+                                 NVMeshlet::Stats& stats,
+                                 size_t&           vpackVertices)
 {
-  NVMeshlet::Stats statsGlobal;
-  uint32_t         groups              = 0;
-  size_t           meshActualSizeTotal = 0;
+  typedef MeshletArena<typename TBuilder::MeshletGeometry> Arena;
 
-#define MESHLET_ERRORCHECK 0
+  const uint32_t splitIndices = scene.m_cfg.meshSplitTriangles ? scene.m_cfg.meshSplitTriangles * 3 : ~0u;
 
-  if(m_cfg.meshBuilder == MESHLET_BUILDER_PACKBASIC)
+  // every part gets at least one chunk, so part ranges can be derived from them
+  std::vector<MeshletChunk> chunks;
+  std::vector<size_t>       geometryChunks(csf->numGeometries + 1);
+  size_t                    numTriangles = 0;
+  for(int g = 0; g < csf->numGeometries; g++)
   {
-    NVMeshlet::PackBasicBuilder meshletBuilder;
-    meshletBuilder.setup(m_cfg.meshVertexCount, m_cfg.meshPrimitiveCount, false);
+    const CSFGeometry* csfgeom = csf->geometries + g;
+    geometryChunks[g]          = chunks.size();
 
-#pragma omp parallel for
-    for(int g = 0; g < csf->numGeometries; g++)
+    uint32_t indexOffset = 0;
+    for(int p = 0; p < csfgeom->numParts; p++)
     {
-      const CSFGeometry*    csfgeom = csf->geometries + g;
-      Geometry&             geom    = m_geometry[g];
+      uint32_t numIndex = csfgeom->parts[p].numIndexSolid;
+      uint32_t begin    = 0;
+      do
+      {
+        MeshletChunk chunk = {};
+        chunk.geometry     = uint32_t(g);
+        chunk.part         = uint32_t(p);
+        chunk.indexBegin   = indexOffset + begin;
+        chunk.numIndices   = std::min(numIndex - begin, splitIndices);
+        chunks.push_back(chunk);
 
-      NVMeshlet::PackBasicBuilder::MeshletGeometry meshletGeometry;
+        begin += chunk.numIndices;
+      } while(begin < numIndex);
 
-      uint32_t               numMeshlets = 0;
-      uint32_t               indexOffset = 0;
-      const unsigned int*    indices     = csfgeom->indexSolid;
-      const CSFGeometryPart* parts       = csfgeom->parts;
-      for(size_t p = 0; p < geom.parts.size(); p++)
-      {
-        uint32_t numIndex              = parts[p].numIndexSolid;
-        geom.parts[p].meshSolid.offset = numMeshlets;
+      indexOffset += numIndex;
+    }
+    numTriangles += indexOffset / 3;
+  }
+  geometryChunks[csf->numGeometries] = chunks.size();
+
+  std::vector<Arena> arenas(jobSystem.getNumSlots());
+
+  NVMeshlet::VertexPackBuilder vertexPack;
+  if(scene.m_cfg.meshVertexPackBits)
+  {
+    vertexPack.setup(std::min(scene.m_cfg.meshVertexPackBits, 16u));
+  }
+
+  jobSystem.parallelFor(0, chunks.size(), [&](size_t begin, size_t end, uint32_t slot) {
+    Arena& arena = arenas[slot];
+    for(size_t c = begin; c < end; c++)
+    {
+      MeshletChunk&         chunk   = chunks[c];
+      const CSFGeometry*    csfgeom = csf->geometries + chunk.geometry;
+      const CadScene::BBox& bbox    = scene.m_bboxes[chunk.geometry];
+      const unsigned int*   indices = csfgeom->indexSolid + chunk.indexBegin;
 
-        uint32_t processedIndices =
-          meshletBuilder.buildMeshlets<uint32_t>(meshletGeometry, numIndex, indices + indexOffset);
-        if(processedIndices != numIndex)
+      if(scene.m_cfg.meshOrder != MESHLET_ORDER_INPUT)
+      {
+        arena.indices.resize(chunk.numIndices);
+        arena.indicesTemp.resize(chunk.numIndices);
+        if(scene.m_cfg.meshOrder == MESHLET_ORDER_LOCALITY)
         {
-          LOGE("warning: geometry meshlet incomplete %d\n", g);
+          // vertex cache order provides the seeds
+          NVMeshlet::optimizeVertexCache(chunk.numIndices, indices, arena.indicesTemp.data());
+          NVMeshlet::optimizeLocality(builder.getMaxVertexCount(), builder.getMaxPrimitiveCount(), chunk.numIndices,
+                                      arena.indicesTemp.data(), (const float*)csfgeom->vertex, sizeof(float) * 3,
+                                      arena.indices.data());
         }
-
-        geom.parts[p].meshSolid.count = (uint32_t)meshletGeometry.meshletDescriptors.size() - numMeshlets;
-        numMeshlets                   = (uint32_t)meshletGeometry.meshletDescriptors.size();
-        indexOffset += numIndex;
+        else
+        {
+          NVMeshlet::optimizeVertexCache(chunk.numIndices, indices, arena.indices.data());
+        }
+        indices = arena.indices.data();
       }
 
-      geom.meshlet.numMeshlets = int(meshletGeometry.meshletDescriptors.size());
+      chunk.slot             = slot;
+      chunk.processedIndices = builder.buildMeshlets(arena.scratch, chunk.numIndices, indices);
 
-      meshletBuilder.buildMeshletEarlyCulling(meshletGeometry, m_bboxes[g].min.vec_array, m_bboxes[g].max.vec_array,
-        (const float*)csfgeom->vertex, sizeof(float) * 3);
-      if(m_cfg.verbose)
+      builder.buildMeshletEarlyCulling(arena.scratch, bbox.min.vec_array, bbox.max.vec_array,
+                                       (const float*)csfgeom->vertex, sizeof(float) * 3);
+      if(scene.m_cfg.verbose)
       {
 #if MESHLET_ERRORCHECK
-        NVMeshlet::StatusCode errorcode = meshletBuilder.errorCheck<uint32_t>(meshletGeometry, 0, csfgeom->numVertices - 1,
-          csfgeom->numIndexSolid, csfgeom->indexSolid);
+        NVMeshlet::StatusCode errorcode =
+            builder.errorCheck(arena.scratch, 0, csfgeom->numVertices - 1, chunk.processedIndices, indices);
         if(errorcode)
         {
-          LOGE("geometry %d: meshlet error %d\n", g, errorcode);
+          LOGE("geometry %d: meshlet error %d\n", chunk.geometry, errorcode);
         }
 #endif
+        // load averages are accumulated per chunk
+        builder.appendStats(arena.scratch, arena.stats);
+      }
 
-        NVMeshlet::Stats statsLocal;
-        meshletBuilder.appendStats(meshletGeometry, statsLocal);
-
-#pragma omp critical
+      if(scene.m_cfg.meshVertexPackBits)
+      {
+        // offsets are relative to the chunk's stream
+        vertexPack.encodeGeometry(builder, arena.scratch, bbox.min.vec_array, bbox.max.vec_array,
+                                  (const float*)csfgeom->vertex, sizeof(float) * 3, (const float*)csfgeom->normal,
+                                  sizeof(float) * 3, arena.vpackScratch, arena.vpackOffsets);
+#if MESHLET_ERRORCHECK
+        NVMeshlet::StatusCode errorcode = vertexPack.errorCheckGeometry(
+            builder, arena.scratch, bbox.min.vec_array, bbox.max.vec_array, (const float*)csfgeom->vertex, sizeof(float) * 3,
+            (const float*)csfgeom->normal, sizeof(float) * 3, arena.vpackScratch.data(),
+            arena.vpackOffsets.data() + arena.vpackOffsets.size() - arena.scratch.meshletDescriptors.size());
+        if(errorcode)
+        {
+          LOGE("geometry %d: meshlet vertex pack error %d\n", chunk.geometry, errorcode);
+        }
+#endif
+        for(const auto& desc : arena.scratch.meshletDescriptors)
         {
-          statsGlobal.append(statsLocal);
+          arena.vpackVertices += desc.getNumVertices();
         }
+        appendAndClear(arena.vpackData, arena.vpackScratch, chunk.vpackBegin, chunk.numVpack);
       }
 
-      fillMeshletTopology(meshletGeometry, geom.meshlet, geom.useShorts);
-
-      geom.meshSize        = geom.meshlet.descSize;
-      geom.meshIndicesSize = geom.meshlet.primSize + geom.meshlet.vertSize;
+      appendArena(arena, chunk);
+    }
+  });
 
-      size_t meshActualSize = geom.meshlet.descSize + geom.meshlet.primSize + geom.meshlet.vertSize;
+  jobSystem.parallelFor(0, size_t(csf->numGeometries), [&](size_t begin, size_t end, uint32_t) {
+    for(size_t g = begin; g < end; g++)
+    {
+      CadScene::Geometry& geom      = scene.m_geometry[g];
+      MeshletChunk*       geomChunk = chunks.data() + geometryChunks[g];
+      size_t              numChunks = geometryChunks[g + 1] - geometryChunks[g];
 
-#pragma omp critical
+      fillMeshletTopology(arenas, geomChunk, numChunks, geom.meshlet, geom.useShorts);
+      if(scene.m_cfg.meshVertexPackBits)
       {
-        m_meshSize += geom.meshSize + geom.meshIndicesSize;
-        groups += numMeshlets;
-        meshActualSizeTotal += meshActualSize;
+        fillMeshletVertexPack(arenas, geomChunk, numChunks, geom.meshlet);
       }
-    }
-  }
-  else
-  {
-    NVMeshlet::ArrayBuilder<uint32_t> meshletBuilder;
-    meshletBuilder.setup(m_cfg.meshVertexCount, m_cfg.meshPrimitiveCount, false);
-
 
-#pragma omp parallel for
-    for(int g = 0; g < csf->numGeometries; g++)
-    {
-      const CSFGeometry*    csfgeom = csf->geometries + g;
-      Geometry&             geom    = m_geometry[g];
+      for(size_t p = 0; p < geom.parts.size(); p++)
+      {
+        geom.parts[p].meshSolid.count = 0;
+      }
 
-      NVMeshlet::ArrayBuilder<uint32_t>::MeshletGeometry meshletGeometry;
+      size_t missingIndices = 0;
+      for(size_t c = 0; c < numChunks; c++)
+      {
+        geom.parts[geomChunk[c].part].meshSolid.count += uint32_t(geomChunk[c].numDescs);
+        missingIndices += geomChunk[c].numIndices - geomChunk[c].processedIndices;
+      }
+      if(missingIndices)
+      {
+        LOGE("warning: geometry meshlet incomplete %d, %zu triangles exceed the meshlet index limits\n", int(g),
+             missingIndices / 3);
+      }
 
-      uint32_t               numMeshlets = 0;
-      uint32_t               indexOffset = 0;
-      const unsigned int*    indices     = csfgeom->indexSolid;
-      const CSFGeometryPart* parts       = csfgeom->parts;
+      uint32_t numMeshlets = 0;
       for(size_t p = 0; p < geom.parts.size(); p++)
       {
-        uint32_t numIndex              = parts[p].numIndexSolid;
         geom.parts[p].meshSolid.offset = numMeshlets;
+        numMeshlets += geom.parts[p].meshSolid.count;
+      }
+      geom.meshlet.numMeshlets = int(numMeshlets);
+    }
+  });
 
-        uint32_t processedIndices = meshletBuilder.buildMeshlets(meshletGeometry, numIndex, indices + indexOffset);
-        if(processedIndices != numIndex)
-        {
-          LOGE("warning: geometry meshlet incomplete %d\n", g);
-        }
+  for(const Arena& arena : arenas)
+  {
+    stats.append(arena.stats);
+    vpackVertices += arena.vpackVertices;
+  }
 
-        geom.parts[p].meshSolid.count = (uint32_t)meshletGeometry.meshletDescriptors.size() - numMeshlets;
-        numMeshlets                   = (uint32_t)meshletGeometry.meshletDescriptors.size();
-        indexOffset += numIndex;
-      }
+  return numTriangles;
+}
 
-      geom.meshlet.numMeshlets = int(meshletGeometry.meshletDescriptors.size());
 
-      meshletBuilder.buildMeshletEarlyCulling(meshletGeometry, m_bboxes[g].min.vec_array, m_bboxes[g].max.vec_array,
-                                              csfgeom->vertex, sizeof(float) * 3);
-      if(m_cfg.verbose)
-      {
-#if MESHLET_ERRORCHECK
-        NVMeshlet::StatusCode errorcode = meshletBuilder.errorCheck(meshletGeometry, 0, csfgeom->numVertices - 1,
-                                                                    csfgeom->numIndexSolid, csfgeom->indexSolid);
-        if(errorcode)
-        {
-          LOGE("geometry %d: meshlet error %d\n", g, errorcode);
-        }
-#endif
+void CadScene::buildMeshletTopology(const CSFile* csf)
+{
+  NVMeshlet::Stats statsGlobal;
+  uint32_t         groups              = 0;
+  size_t           meshActualSizeTotal = 0;
+  size_t           vpackVertices       = 0;
+  size_t           vpackSizeTotal      = 0;
 
-        NVMeshlet::Stats statsLocal;
-        meshletBuilder.appendStats(meshletGeometry, statsLocal);
+  double timeBegin = NVPSystem::getTime();
 
-#pragma omp critical
-        {
-          statsGlobal.append(statsLocal);
-        }
-      }
+  nvh::JobSystem jobSystem;
+  jobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
 
-      fillMeshletTopology(meshletGeometry, geom.meshlet, geom.useShorts);
+  size_t numTriangles;
+  if(m_cfg.meshBuilder == MESHLET_BUILDER_PACKBASIC)
+  {
+    NVMeshlet::PackBasicBuilder meshletBuilder;
+    meshletBuilder.setup(m_cfg.meshVertexCount, m_cfg.meshPrimitiveCount, false);
 
-      geom.meshSize        = geom.meshlet.descSize;
-      geom.meshIndicesSize = NVMeshlet::arrayIndicesAlignedSize(geom.meshlet.primSize) + geom.meshlet.vertSize;
+    numTriangles = buildMeshletChunks(*this, csf, meshletBuilder, jobSystem, statsGlobal, vpackVertices);
+  }
+  else
+  {
+    NVMeshlet::ArrayBuilder<uint32_t> meshletBuilder;
+    meshletBuilder.setup(m_cfg.meshVertexCount, m_cfg.meshPrimitiveCount, false);
 
-      size_t meshActualSize = geom.meshlet.descSize + geom.meshlet.primSize + geom.meshlet.vertSize;
+    numTriangles = buildMeshletChunks(*this, csf, meshletBuilder, jobSystem, statsGlobal, vpackVertices);
+  }
 
-#pragma omp critical
-      {
-        m_meshSize += geom.meshSize + geom.meshIndicesSize;
-        groups += numMeshlets;
-        meshActualSizeTotal += meshActualSize;
-      }
+  double timeBuild = NVPSystem::getTime() - timeBegin;
+
+  for(int g = 0; g < csf->numGeometries; g++)
+  {
+    Geometry& geom = m_geometry[g];
+
+    geom.meshSize = geom.meshlet.descSize;
+    if(m_cfg.meshBuilder == MESHLET_BUILDER_PACKBASIC)
+    {
+      geom.meshIndicesSize = geom.meshlet.primSize + geom.meshlet.vertSize;
     }
+    else
+    {
+      geom.meshIndicesSize = NVMeshlet::arrayIndicesAlignedSize(geom.meshlet.primSize) + geom.meshlet.vertSize;
+    }
+
+    m_meshSize += geom.meshSize + geom.meshIndicesSize;
+    groups += geom.meshlet.numMeshlets;
+    meshActualSizeTotal += geom.meshlet.descSize + geom.meshlet.primSize + geom.meshlet.vertSize;
+    vpackSizeTotal += geom.meshlet.vpackSize;
   }
 
   LOGI("meshlet config: %d vertices, %d primitives\n", m_cfg.meshVertexCount, m_cfg.meshPrimitiveCount);
+  LOGI("meshlet build: %.2f ms, %.2f M triangles/s, %d threads\n", timeBuild * 1000.0,
+       double(numTriangles) / (timeBuild * 1000000.0), jobSystem.getNumSlots());
 
   if(m_cfg.verbose)
   {
@@ -773,5 +1062,11 @@ void CadScene::buildMeshletTopology(const CSFile* csf)
 
   LOGI("meshlet total: %9d meshlets, %7d KB (w %.2f)\n", groups, m_meshSize / 1024,
        (double(m_meshSize) / double(meshActualSizeTotal) - 1.0));
+
+  if(m_cfg.meshVertexPackBits && vpackVertices)
+  {
+    LOGI("meshlet vertex pack: %2d bits, %7d KB, %.2f bits per meshlet vertex (host only, not rendered)\n",
+         std::min(m_cfg.meshVertexPackBits, 16u), int(vpackSizeTotal / 1024), double(vpackSizeTotal * 8) / double(vpackVertices));
+  }
 }
 
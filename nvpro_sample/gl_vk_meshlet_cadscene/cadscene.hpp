@@ -198,8 +198,18 @@ public:
     void* vertData = nullptr;
     void* descData = nullptr;
 
+    // optional compressed copy, see nvmeshlet_vertexpack.hpp
+    // { u32 offset[numMeshlets] in words, padding..., meshlet streams... }
+    // host only, cadscene_vk/gl do not upload it
+    size_t vpackSize = 0;
+    void*  vpackData = nullptr;
+
     ~MeshletTopology()
     {
+      if(vpackData)
+      {
+        free(vpackData);
+      }
       if(primData)
       {
         free(primData);
@@ -287,6 +297,14 @@ public:
     uint32_t           meshPrimitiveCount = 126;
 
     MeshletBuilderType meshBuilder        = MESHLET_BUILDER_PACKBASIC;
+    // large parts are split for parallel building, 0 disables.
+    // Meshlets never cross a split, so splitting changes the output slightly.
+    uint32_t meshSplitTriangles = 0;
+    // triangle reordering prior building
+    MeshletOrderType meshOrder = MESHLET_ORDER_INPUT;
+    // position bits of the compressed vertex streams, 0 disables.
+    // Encoder only, the streams are not used for rendering.
+    uint32_t meshVertexPackBits = 0;
   };
 
   std::vector<Material>   m_materials;
@@ -70,6 +70,12 @@
     MESHLET_BUILDER_ARRAYS,
   };
 
+  enum MeshletOrderType {
+    MESHLET_ORDER_INPUT,
+    MESHLET_ORDER_VERTEXCACHE,
+    MESHLET_ORDER_LOCALITY,
+  };
+
 #endif
 
 #endif
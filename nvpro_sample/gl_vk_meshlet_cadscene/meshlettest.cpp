@@ -173,6 +173,7 @@ class Sample
     GUI_VIEWPOINT,
     GUI_RENDERER,
     GUI_SUPERSAMPLE,
+    GUI_MESHLETORDER,
   };
 
 public:
@@ -592,6 +593,10 @@ bool Sample::begin()
     m_ui.enumAdd(GUI_SUPERSAMPLE, 2, "4x");
     m_ui.enumAdd(GUI_SUPERSAMPLE, 3, "9x");
     m_ui.enumAdd(GUI_SUPERSAMPLE, 4, "16x");
+
+    m_ui.enumAdd(GUI_MESHLETORDER, MESHLET_ORDER_INPUT, "input");
+    m_ui.enumAdd(GUI_MESHLETORDER, MESHLET_ORDER_VERTEXCACHE, "vertex cache");
+    m_ui.enumAdd(GUI_MESHLETORDER, MESHLET_ORDER_LOCALITY, "locality");
   }
 
   m_control.m_sceneUp        = m_modelUpVector;
@@ -685,6 +690,9 @@ void Sample::processUI(int width, int height, double time)
     ImGuiH::InputIntClamped("meshlet vertices", &m_modelConfig.meshVertexCount, 32, 256, 32, 32, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGuiH::InputIntClamped("meshlet primitives", &m_modelConfig.meshPrimitiveCount, 32, 256, 32, 32,
                             ImGuiInputTextFlags_EnterReturnsTrue);
+    m_ui.enumCombobox(GUI_MESHLETORDER, "meshlet order", &m_modelConfig.meshOrder);
+    ImGuiH::InputIntClamped("meshlet vertex pack bits", &m_modelConfig.meshVertexPackBits, 0, 16, 1, 4,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
     ImGuiH::InputIntClamped("extra v4 attributes", &m_modelConfig.extraAttributes, 0, 7);
     ImGui::Checkbox("model fp16 attributes", &m_modelConfig.fp16);
     ImGuiH::InputIntClamped("model copies", &m_tweak.copies, 1, 256, 1, 10, ImGuiInputTextFlags_EnterReturnsTrue);
@@ -1013,6 +1021,9 @@ void Sample::setupConfigParameters()
   m_parameterList.add("shaderprepend", &m_shaderprepend);
 
   m_parameterList.add("meshlet", &m_modelConfig.meshVertexCount, nullptr, 2);
+  m_parameterList.add("meshletsplit", &m_modelConfig.meshSplitTriangles);
+  m_parameterList.add("meshletorder", (uint32_t*)&m_modelConfig.meshOrder);
+  m_parameterList.add("meshletvertexpack", &m_modelConfig.meshVertexPackBits);
   m_parameterList.add("meshshadercull", &m_tweak.useMeshShaderCull);
   m_parameterList.add("backfacecull", &m_tweak.useBackFaceCull);
 
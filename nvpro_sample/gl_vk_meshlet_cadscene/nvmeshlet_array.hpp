@@ -165,6 +165,17 @@ struct MeshletArrayDesc
     fieldW |= pack(begin / ARRAY_PRIMITIVE_PACKING_ALIGNMENT, 20, 0);
   }
 
+  // moves the meshlet within the index arrays, used when appending geometries
+  void offsetBegins(uint32_t vertexOffset, uint32_t primOffset)
+  {
+    uint32_t vertexBegin = getVertexBegin() + vertexOffset;
+    uint32_t primBegin   = getPrimBegin() + primOffset;
+    fieldZ &= ~pack(~0u, 20, 0);
+    fieldW &= ~pack(~0u, 20, 0);
+    setVertexBegin(vertexBegin);
+    setPrimBegin(primBegin);
+  }
+
   // positions are relative to object's bbox treated as UNORM
   void setBBox(uint8_t const bboxMin[3], uint8_t const bboxMax[3])
   {
@@ -282,6 +293,10 @@ public:
     }
   }
 
+  // effective limits after setup, the primitive count may be reduced
+  uint32_t getMaxVertexCount() const { return m_maxVertexCount; }
+  uint32_t getMaxPrimitiveCount() const { return m_maxPrimitiveCount; }
+
   //////////////////////////////////////////////////////////////////////////
   // generate meshlets
 private:
@@ -373,6 +388,34 @@ public:
     }
   }
 
+  //////////////////////////////////////////////////////////////////////////
+  // unpack a meshlet back into the representation used while building
+
+public:
+  void extractMeshlet(const MeshletGeometry& geometry, size_t index, PrimitiveCache& cache) const
+  {
+    const MeshletArrayDesc& meshlet = geometry.meshletDescriptors[index];
+
+    uint32_t primBegin   = meshlet.getPrimBegin();
+    uint32_t vertexBegin = meshlet.getVertexBegin();
+
+    cache.reset();
+    cache.numVertices = meshlet.getNumVertices();
+    cache.numPrims    = meshlet.getNumPrims();
+
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      cache.vertices[v] = geometry.vertexIndices[vertexBegin + v];
+    }
+
+    for(uint32_t p = 0; p < cache.numPrims; p++)
+    {
+      cache.primitives[p][0] = geometry.primitiveIndices[primBegin + p * 3 + 0];
+      cache.primitives[p][1] = geometry.primitiveIndices[primBegin + p * 3 + 1];
+      cache.primitives[p][2] = geometry.primitiveIndices[primBegin + p * 3 + 2];
+    }
+  }
+
   //////////////////////////////////////////////////////////////////////////
   // generate early culling per meshlet
 
@@ -653,6 +696,11 @@ public:
       int8_t coneAngle;
       meshlet.getCone(coneX, coneY, coneAngle);
       stats.backfaceTotal += coneAngle < 0 ? 1 : 0;
+
+      uint8_t bboxMin[3];
+      uint8_t bboxMax[3];
+      meshlet.getBBox(bboxMin, bboxMax);
+      stats.bboxVolume += bboxVolumeUnorm(bboxMin, bboxMax);
     }
 
     stats.meshletsTotal += meshletsTotal;
@@ -64,6 +64,17 @@ inline uint32_t alignedSize(uint32_t v, uint32_t align) {
   return (v + align - 1) & (~(align-1));
 }
 
+// volume of a meshlet bbox stored as UNORM relative to the object's bbox
+inline double bboxVolumeUnorm(const uint8_t bboxMin[3], const uint8_t bboxMax[3])
+{
+  double volume = 1.0;
+  for(int i = 0; i < 3; i++)
+  {
+    volume *= double(bboxMax[i] - bboxMin[i] + 1) / 256.0;
+  }
+  return volume;
+}
+
 
 // opaque type, all builders will specialize this, but fit within
 struct MeshletDesc
@@ -95,6 +106,8 @@ enum StatusCode
   STATUS_PRIM_OUT_OF_BOUNDS,
   STATUS_VERTEX_OUT_OF_BOUNDS,
   STATUS_MISMATCH_INDICES,
+  STATUS_POSITION_MISMATCH,
+  STATUS_NORMAL_MISMATCH,
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -118,6 +131,9 @@ struct Stats
 
   size_t posBitTotal  = 0;
 
+  // sum of meshlet bbox volumes relative to their object's bbox
+  double bboxVolume = 0;
+
   // used when we sum multiple stats into a single to
   // compute averages of the averages/variances below.
 
@@ -138,6 +154,7 @@ struct Stats
     vertexIndices += other.vertexIndices;
     vertexTotal += other.vertexTotal;
     primTotal += other.primTotal;
+    bboxVolume += other.bboxVolume;
 
     appended += other.appended;
     primloadAvg += other.primloadAvg;
@@ -163,9 +180,14 @@ struct Stats
     double vertexWaste  = double(vertexIndices) / double(vertexTotal) - 1.0;
     double meshletWaste = double(meshletsStored) / double(meshletsTotal) - 1.0;
 
+    // triangles referencing a meshlet vertex on average
+    double vertexReuse = double(primTotal * 3) / double(vertexTotal);
+    double bboxAvg     = bboxVolume / statsNum;
+
     fprintf(log,
-            "meshlets; %7zd; prim; %9zd; %.2f; vertex; %9zd; %.2f; backface; %.2f; waste; v; %.2f; p; %.2f; m; %.2f;\n", meshletsTotal,
-            primTotal, fprimloadAvg, vertexTotal, fvertexloadAvg, backfaceAvg, vertexWaste, primWaste, meshletWaste);
+            "meshlets; %7zd; prim; %9zd; %.2f; vertex; %9zd; %.2f; backface; %.2f; waste; v; %.2f; p; %.2f; m; %.2f; reuse; %.2f; bbox; %.2e;\n",
+            meshletsTotal, primTotal, fprimloadAvg, vertexTotal, fvertexloadAvg, backfaceAvg, vertexWaste, primWaste,
+            meshletWaste, vertexReuse, bboxAvg);
   }
 };
 
@@ -438,7 +460,8 @@ inline uint32_t findMSB(uint32_t value)
 #else
 inline uint32_t findMSB(uint32_t value)
 {
-  uint32_t idx = __builtin_clz(value);
+  // same as _BitScanReverse, 0 yields 0
+  uint32_t idx = value ? 31 - __builtin_clz(value) : 0;
   return idx;
 }
 #endif
@@ -604,6 +627,384 @@ struct PrimitiveCache
   }
 };
 
+//////////////////////////////////////////////////////////////////////////
+// Triangle reordering
+//
+// Optional preprocessing of an index buffer prior `buildMeshlets`. Triangles
+// are only permuted, the generated meshlets are valid for the original mesh.
+// Degenerate triangles are moved to the end (the builders skip them anyway).
+// Input and output must not alias.
+
+struct TriangleAdjacency
+{
+  //  Compacts the vertices referenced by the triangles, as index buffers
+  //  of a chunk may use only a small range of a large vertex buffer,
+  //  and builds the vertex to triangle lists.
+
+  uint32_t numTris     = 0;
+  uint32_t numVertices = 0;
+
+  // per triangle 3 local vertices
+  std::vector<uint32_t> triVertices;
+  // per local vertex range within triangles
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+  // non-degenerate triangles
+  std::vector<uint8_t> valid;
+
+  template <class VertexIndexType>
+  void build(uint32_t numIndices, const VertexIndexType* NV_RESTRICT indices)
+  {
+    numTris = numIndices / 3;
+
+    std::vector<uint32_t> unique(indices, indices + numTris * 3);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    numVertices = uint32_t(unique.size());
+
+    triVertices.resize(numTris * 3);
+    valid.resize(numTris);
+    offsets.assign(numVertices + 1, 0);
+    for(uint32_t t = 0; t < numTris; t++)
+    {
+      const VertexIndexType* tri = indices + t * 3;
+      valid[t] = tri[0] != tri[1] && tri[0] != tri[2] && tri[1] != tri[2];
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        uint32_t v = uint32_t(std::lower_bound(unique.begin(), unique.end(), uint32_t(tri[k])) - unique.begin());
+        triVertices[t * 3 + k] = v;
+        offsets[v + 1] += valid[t];
+      }
+    }
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      offsets[v + 1] += offsets[v];
+    }
+
+    triangles.resize(offsets[numVertices]);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(uint32_t t = 0; t < numTris; t++)
+    {
+      for(uint32_t k = 0; valid[t] && k < 3; k++)
+      {
+        triangles[fill[triVertices[t * 3 + k]]++] = t;
+      }
+    }
+  }
+
+  template <class VertexIndexType>
+  static void copyTriangle(VertexIndexType* NV_RESTRICT outIndices, uint32_t& outTris, const VertexIndexType* NV_RESTRICT indices, uint32_t t)
+  {
+    outIndices[outTris * 3 + 0] = indices[t * 3 + 0];
+    outIndices[outTris * 3 + 1] = indices[t * 3 + 1];
+    outIndices[outTris * 3 + 2] = indices[t * 3 + 2];
+    outTris++;
+  }
+};
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation", consecutive
+// triangles share vertices and are typically spatially close.
+template <class VertexIndexType>
+inline void optimizeVertexCache(uint32_t numIndices, const VertexIndexType* NV_RESTRICT indices, VertexIndexType* NV_RESTRICT outIndices)
+{
+  static const int   CACHE_SIZE     = 32;
+  static const float DECAY_POWER    = 1.5f;
+  static const float LAST_TRI_SCORE = 0.75f;
+  static const float VALENCE_SCALE  = 2.0f;
+  static const float VALENCE_POWER  = 0.5f;
+
+  TriangleAdjacency adjacency;
+  adjacency.build(numIndices, indices);
+
+  const uint32_t numTris = adjacency.numTris;
+
+  std::vector<int32_t>  cachePos(adjacency.numVertices, -1);
+  std::vector<uint32_t> remaining(adjacency.numVertices);
+  std::vector<float>    vertexScore(adjacency.numVertices);
+  std::vector<float>    triScore(numTris, 0.0f);
+  std::vector<uint8_t>  emitted(numTris, 0);
+
+  auto computeScore = [&](uint32_t v) {
+    if(!remaining[v])
+      return -1.0f;
+
+    float score = 0.0f;
+    int   pos   = cachePos[v];
+    if(pos >= 0)
+    {
+      score = pos < 3 ? LAST_TRI_SCORE : powf(1.0f - float(pos - 3) / float(CACHE_SIZE - 3), DECAY_POWER);
+    }
+    return score + VALENCE_SCALE * powf(float(remaining[v]), -VALENCE_POWER);
+  };
+
+  for(uint32_t v = 0; v < adjacency.numVertices; v++)
+  {
+    remaining[v]   = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    vertexScore[v] = computeScore(v);
+  }
+
+  uint32_t best      = ~0u;
+  float    bestScore = -1.0f;
+  for(uint32_t t = 0; t < numTris; t++)
+  {
+    if(!adjacency.valid[t])
+      continue;
+
+    const uint32_t* tri = &adjacency.triVertices[t * 3];
+    triScore[t]         = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    if(triScore[t] > bestScore)
+    {
+      best      = t;
+      bestScore = triScore[t];
+    }
+  }
+
+  uint32_t cache[CACHE_SIZE + 3];
+  uint32_t cacheSize = 0;
+  uint32_t outTris   = 0;
+  uint32_t cursor    = 0;
+
+  while(true)
+  {
+    if(best == ~0u)
+    {
+      // nothing connected left in the cache, continue in input order
+      while(cursor < numTris && (emitted[cursor] || !adjacency.valid[cursor]))
+      {
+        cursor++;
+      }
+      if(cursor == numTris)
+        break;
+      best = cursor;
+    }
+
+    const uint32_t* tri = &adjacency.triVertices[best * 3];
+    emitted[best]       = 1;
+    TriangleAdjacency::copyTriangle(outIndices, outTris, indices, best);
+
+    // new cache: triangle vertices first, followed by the previous content
+    uint32_t newCache[CACHE_SIZE + 3];
+    uint32_t newSize = 0;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      newCache[newSize++] = tri[k];
+      remaining[tri[k]]--;
+    }
+    for(uint32_t i = 0; i < cacheSize; i++)
+    {
+      uint32_t v = cache[i];
+      if(v != tri[0] && v != tri[1] && v != tri[2])
+      {
+        newCache[newSize++] = v;
+      }
+    }
+
+    for(uint32_t i = 0; i < newSize; i++)
+    {
+      cachePos[newCache[i]] = i < CACHE_SIZE ? int32_t(i) : -1;
+    }
+    for(uint32_t i = 0; i < newSize; i++)
+    {
+      vertexScore[newCache[i]] = computeScore(newCache[i]);
+    }
+
+    // only triangles touching the cache changed their score
+    best      = ~0u;
+    bestScore = -1.0f;
+    for(uint32_t i = 0; i < newSize; i++)
+    {
+      uint32_t v = newCache[i];
+      for(uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++)
+      {
+        uint32_t t = adjacency.triangles[a];
+        if(emitted[t])
+          continue;
+
+        const uint32_t* other = &adjacency.triVertices[t * 3];
+        triScore[t]           = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+        if(triScore[t] > bestScore)
+        {
+          best      = t;
+          bestScore = triScore[t];
+        }
+      }
+    }
+
+    cacheSize = std::min(newSize, uint32_t(CACHE_SIZE));
+    memcpy(cache, newCache, sizeof(uint32_t) * cacheSize);
+  }
+
+  for(uint32_t t = 0; t < numTris; t++)
+  {
+    if(!adjacency.valid[t])
+    {
+      TriangleAdjacency::copyTriangle(outIndices, outTris, indices, t);
+    }
+  }
+}
+
+// Grows every meshlet from a seed triangle, by picking among the triangles
+// adjacent to the meshlet the one that shares the most vertices and grows
+// its bounding box the least. The output is laid out so that the greedy
+// builders (using the same effective limits, see `getMaxVertexCount` etc.)
+// cut exactly these meshlets. Seeds are taken in input order, so running
+// `optimizeVertexCache` before is beneficial.
+template <class VertexIndexType>
+inline void optimizeLocality(uint32_t                           maxVertexCount,
+                             uint32_t                           maxPrimitiveCount,
+                             uint32_t                           numIndices,
+                             const VertexIndexType* NV_RESTRICT indices,
+                             const float* NV_RESTRICT           positions,
+                             size_t                             positionStride,
+                             VertexIndexType* NV_RESTRICT       outIndices)
+{
+  assert((positionStride % sizeof(float)) == 0);
+
+  size_t positionMul = positionStride / sizeof(float);
+
+  TriangleAdjacency adjacency;
+  adjacency.build(numIndices, indices);
+
+  const uint32_t numTris = adjacency.numTris;
+
+  // stamps hold the meshlet index + 1 a vertex/candidate was last added to
+  std::vector<uint32_t> vertexStamp(adjacency.numVertices, 0);
+  std::vector<uint32_t> candidateStamp(numTris, 0);
+  std::vector<uint8_t>  emitted(numTris, 0);
+  std::vector<uint32_t> candidates;
+
+  uint32_t meshlet     = 1;
+  uint32_t numVertices = 0;
+  uint32_t numPrims    = 0;
+  vec      bboxMin     = vec(FLT_MAX);
+  vec      bboxMax     = vec(-FLT_MAX);
+
+  uint32_t outTris = 0;
+  uint32_t cursor  = 0;
+
+  auto sharedVertices = [&](uint32_t t) {
+    const uint32_t* tri = &adjacency.triVertices[t * 3];
+    return uint32_t(vertexStamp[tri[0]] == meshlet) + uint32_t(vertexStamp[tri[1]] == meshlet)
+           + uint32_t(vertexStamp[tri[2]] == meshlet);
+  };
+
+  auto addTriangle = [&](uint32_t t) {
+    emitted[t] = 1;
+    numVertices += 3 - sharedVertices(t);
+    numPrims++;
+    TriangleAdjacency::copyTriangle(outIndices, outTris, indices, t);
+
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t v     = adjacency.triVertices[t * 3 + k];
+      vertexStamp[v] = meshlet;
+
+      vec pos = vec(&positions[indices[t * 3 + k] * positionMul]);
+      bboxMin = vec_min(bboxMin, pos);
+      bboxMax = vec_max(bboxMax, pos);
+
+      for(uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++)
+      {
+        uint32_t other = adjacency.triangles[a];
+        if(!emitted[other] && candidateStamp[other] != meshlet)
+        {
+          candidateStamp[other] = meshlet;
+          candidates.push_back(other);
+        }
+      }
+    }
+  };
+
+  auto flush = [&]() {
+    meshlet++;
+    numVertices = 0;
+    numPrims    = 0;
+    bboxMin     = vec(FLT_MAX);
+    bboxMax     = vec(-FLT_MAX);
+    candidates.clear();
+  };
+
+  while(true)
+  {
+    if(numPrims == maxPrimitiveCount)
+    {
+      flush();
+    }
+
+    vec   extent    = bboxMax - bboxMin;
+    vec   center    = (bboxMin + bboxMax) * 0.5f;
+    float extentSum = numPrims ? std::max(extent.x + extent.y + extent.z, FLT_MIN) : 1.0f;
+
+    uint32_t best      = ~0u;
+    float    bestScore = -FLT_MAX;
+    for(size_t i = 0; i < candidates.size();)
+    {
+      uint32_t t = candidates[i];
+      if(emitted[t])
+      {
+        candidates[i] = candidates.back();
+        candidates.pop_back();
+        continue;
+      }
+      i++;
+
+      uint32_t shared = sharedVertices(t);
+      if(numVertices + 3 - shared > maxVertexCount)
+        continue;
+
+      vec triMin = vec(FLT_MAX);
+      vec triMax = vec(-FLT_MAX);
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        vec pos = vec(&positions[indices[t * 3 + k] * positionMul]);
+        triMin  = vec_min(triMin, pos);
+        triMax  = vec_max(triMax, pos);
+      }
+      vec   newExtent = vec_max(bboxMax, triMax) - vec_min(bboxMin, triMin);
+      float growth    = (newExtent.x + newExtent.y + newExtent.z) / extentSum - 1.0f;
+
+      // among equals prefer compact meshlets over long strips
+      vec   triCenter = (triMin + triMax) * 0.5f - center;
+      float distance  = (fabsf(triCenter.x) + fabsf(triCenter.y) + fabsf(triCenter.z)) / extentSum;
+
+      float score = float(shared) - growth - distance * 0.25f;
+      // ties resolve to input order, keeps the result deterministic
+      if(score > bestScore || (score == bestScore && t < best))
+      {
+        best      = t;
+        bestScore = score;
+      }
+    }
+
+    if(best == ~0u)
+    {
+      // nothing adjacent fits, continue with the next seed in input order
+      while(cursor < numTris && (emitted[cursor] || !adjacency.valid[cursor]))
+      {
+        cursor++;
+      }
+      if(cursor == numTris)
+        break;
+
+      best = cursor;
+      if(numVertices + 3 - sharedVertices(best) > maxVertexCount)
+      {
+        flush();
+      }
+    }
+
+    addTriangle(best);
+  }
+
+  for(uint32_t t = 0; t < numTris; t++)
+  {
+    if(!adjacency.valid[t])
+    {
+      TriangleAdjacency::copyTriangle(outIndices, outTris, indices, t);
+    }
+  }
+}
+
 }  // namespace NVMeshlet
 
 #endif
@@ -146,12 +146,12 @@ struct MeshletPackBasicDesc
   void getBBox(uint8_t bboxMin[3], uint8_t bboxMax[3]) const
   {
     bboxMin[0] = unpack(fieldX, 8, 0);
-    bboxMin[0] = unpack(fieldX, 8, 8);
-    bboxMin[0] = unpack(fieldX, 8, 16);
+    bboxMin[1] = unpack(fieldX, 8, 8);
+    bboxMin[2] = unpack(fieldX, 8, 16);
 
     bboxMax[0] = unpack(fieldY, 8, 0);
-    bboxMax[0] = unpack(fieldY, 8, 8);
-    bboxMax[0] = unpack(fieldY, 8, 16);
+    bboxMax[1] = unpack(fieldY, 8, 8);
+    bboxMax[2] = unpack(fieldY, 8, 16);
   }
 
   // uses octant encoding for cone Normal
@@ -306,6 +306,10 @@ public:
     }
   }
 
+  // effective limits after setup, the primitive count may be reduced
+  uint32_t getMaxVertexCount() const { return m_maxVertexCount; }
+  uint32_t getMaxPrimitiveCount() const { return m_maxPrimitiveCount; }
+
   //////////////////////////////////////////////////////////////////////////
   // generate meshlets
 private:
@@ -395,6 +399,33 @@ public:
     }
   }
 
+  //////////////////////////////////////////////////////////////////////////
+  // unpack a meshlet back into the representation used while building
+
+public:
+  void extractMeshlet(const MeshletGeometry& geometry, size_t index, PrimitiveCache& cache) const
+  {
+    const MeshletPackBasicDesc& meshlet = geometry.meshletDescriptors[index];
+    const MeshletPackBasic*     pack    = (const MeshletPackBasic*)&geometry.meshletPacks[meshlet.getPackOffset()];
+
+    uint32_t primStart  = meshlet.getPrimStart();
+    uint32_t vertexPack = meshlet.getNumVertexPack();
+
+    cache.reset();
+    cache.numVertices = meshlet.getNumVertices();
+    cache.numPrims    = meshlet.getNumPrims();
+
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      cache.vertices[v] = pack->getVertexIndex(v, vertexPack);
+    }
+
+    for(uint32_t p = 0; p < cache.numPrims; p++)
+    {
+      pack->getPrimIndices(p, primStart, cache.primitives[p]);
+    }
+  }
+
   //////////////////////////////////////////////////////////////////////////
   // generate early culling per meshlet
 
@@ -672,6 +703,11 @@ public:
       int8_t coneAngle;
       meshlet.getCone(coneX, coneY, coneAngle);
       stats.backfaceTotal += coneAngle < 0 ? 1 : 0;
+
+      uint8_t bboxMin[3];
+      uint8_t bboxMax[3];
+      meshlet.getBBox(bboxMin, bboxMax);
+      stats.bboxVolume += bboxVolumeUnorm(bboxMin, bboxMax);
     }
 
     stats.meshletsTotal += meshletsTotal;
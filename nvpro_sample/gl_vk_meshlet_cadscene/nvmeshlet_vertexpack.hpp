@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2017-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2017-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef _NV_MESHLET_VERTEXPACK_H__
+#define _NV_MESHLET_VERTEXPACK_H__
+
+#include "nvmeshlet_builder.hpp"
+
+#include <float.h>
+#include <math.h>
+
+namespace NVMeshlet {
+
+// The vertex pack is a self-contained, compressed copy of a meshlet:
+// its topology plus per-vertex positions and normals. Positions are
+// quantized relative to the meshlet's bbox as stored in the descriptor
+// (which is relative to the object's bbox), normals are octahedral.
+//
+// Each meshlet is a sequence of 32-bit words, aligned to VERTEXPACK_ALIGNMENT
+//
+//  word | bits  | content
+//  -----|-------|--------------------------------
+//   0   |  0- 7 | numVertices - 1
+//   0   |  8-15 | numPrims - 1
+//   0   | 16-21 | vertex delta bits [0,32]
+//   0   | 22-25 | primitive index bits [1,8]
+//   1   |  0- 4 | position bits per component [1,16]
+//   1   |  5- 9 | normal bits per component [2,16]
+//   2   |  0-31 | vertex base, minimum vertex index
+//   3.. |       | bitstream, LSB first:
+//       |       |   vertex index - base,       numVertices * delta bits
+//       |       |   primitive indices,         numPrims * 3 * primitive bits
+//       |       |   position xyz, unorm,       numVertices * 3 * position bits
+//       |       |   normal xy, octahedral,     numVertices * 2 * normal bits
+
+static const uint32_t VERTEXPACK_ALIGNMENT   = 4;  // in words
+static const uint32_t VERTEXPACK_HEADER_SIZE = 3;  // in words
+
+class BitWriter
+{
+public:
+  BitWriter(std::vector<uint32_t>& words)
+      : m_words(words)
+  {
+  }
+
+  void write(uint32_t value, uint32_t width)
+  {
+    assert(width <= 32);
+    if(!width)
+      return;
+
+    m_acc |= uint64_t(value & (uint32_t(~0ull >> (64 - width)))) << m_accBits;
+    m_accBits += width;
+    if(m_accBits >= 32)
+    {
+      m_words.push_back(uint32_t(m_acc));
+      m_acc >>= 32;
+      m_accBits -= 32;
+    }
+  }
+
+  void flush()
+  {
+    if(m_accBits)
+    {
+      m_words.push_back(uint32_t(m_acc));
+      m_acc     = 0;
+      m_accBits = 0;
+    }
+  }
+
+private:
+  std::vector<uint32_t>& m_words;
+  uint64_t               m_acc     = 0;
+  uint32_t               m_accBits = 0;
+};
+
+class BitReader
+{
+public:
+  BitReader(const uint32_t* words)
+      : m_words(words)
+  {
+  }
+
+  uint32_t read(uint32_t width)
+  {
+    assert(width <= 32);
+    if(!width)
+      return 0;
+
+    if(m_accBits < width)
+    {
+      m_acc |= uint64_t(*m_words++) << m_accBits;
+      m_accBits += 32;
+    }
+    uint32_t value = uint32_t(m_acc & (~0ull >> (64 - width)));
+    m_acc >>= width;
+    m_accBits -= width;
+    return value;
+  }
+
+private:
+  const uint32_t* m_words;
+  uint64_t        m_acc     = 0;
+  uint32_t        m_accBits = 0;
+};
+
+inline uint32_t bitsForValue(uint32_t value)
+{
+  return value ? findMSB(value) + 1 : 0;
+}
+
+class VertexPackBuilder
+{
+private:
+  uint32_t m_positionBits = 12;
+  uint32_t m_normalBits   = 8;
+
+public:
+  void setup(uint32_t positionBits, uint32_t normalBits = 8)
+  {
+    assert(positionBits >= 1 && positionBits <= 16);
+    assert(normalBits >= 2 && normalBits <= 16);
+
+    m_positionBits = positionBits;
+    m_normalBits   = normalBits;
+  }
+
+  uint32_t getPositionBits() const { return m_positionBits; }
+  uint32_t getNormalBits() const { return m_normalBits; }
+
+  // the meshlet bbox as seen by the shaders, see decodeBbox in nvmeshlet_utils.glsl
+  static void getMeshletBBox(const float   objectBboxMin[3],
+                             const float   objectBboxMax[3],
+                             const uint8_t gridMin[3],
+                             const uint8_t gridMax[3],
+                             float         bboxMin[3],
+                             float         bboxMax[3])
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      float extent = objectBboxMax[i] - objectBboxMin[i];
+      bboxMin[i]   = float(gridMin[i]) / 255.0f * extent + objectBboxMin[i];
+      bboxMax[i]   = float(gridMax[i]) / 255.0f * extent + objectBboxMin[i];
+    }
+  }
+
+  // worst case position error per component
+  float getPositionTolerance(const float bboxMin[3], const float bboxMax[3]) const
+  {
+    float extent = std::max(bboxMax[0] - bboxMin[0], std::max(bboxMax[1] - bboxMin[1], bboxMax[2] - bboxMin[2]));
+    return extent * (0.5f / float((1 << m_positionBits) - 1)) + extent * FLT_EPSILON * 4.0f;
+  }
+
+  // worst case normal error as 1 - cosine
+  float getNormalTolerance() const
+  {
+    // half a grid cell on the octahedron, distortion at the folds is up to 2x,
+    // plus the float round-off of 1 - cosine, which dominates beyond 12 bits
+    float cell = 2.0f / float((1 << (m_normalBits - 1)) - 1);
+    return cell * cell + FLT_EPSILON * 4.0f;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+
+  // Appends the meshlet to the stream, returns its offset in words.
+  // The cache holds the meshlet's vertices and primitives, see the builders' extractMeshlet.
+  uint32_t encodeMeshlet(std::vector<uint32_t>&   stream,
+                         const PrimitiveCache&    cache,
+                         const float              bboxMin[3],
+                         const float              bboxMax[3],
+                         const float* NV_RESTRICT positions,
+                         size_t                   positionStride,
+                         const float* NV_RESTRICT normals,
+                         size_t                   normalStride) const
+  {
+    assert((positionStride % sizeof(float)) == 0);
+    assert((normalStride % sizeof(float)) == 0);
+    assert(cache.numVertices && cache.numPrims);
+
+    size_t positionMul = positionStride / sizeof(float);
+    size_t normalMul   = normalStride / sizeof(float);
+
+    uint32_t offset = uint32_t(stream.size());
+
+    uint32_t vertexBase = ~0u;
+    uint32_t vertexMax  = 0;
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      vertexBase = std::min(vertexBase, cache.vertices[v]);
+      vertexMax  = std::max(vertexMax, cache.vertices[v]);
+    }
+
+    uint32_t deltaBits = bitsForValue(vertexMax - vertexBase);
+    uint32_t primBits  = std::max(1u, bitsForValue(cache.numVertices - 1));
+
+    stream.push_back(pack(cache.numVertices - 1, 8, 0) | pack(cache.numPrims - 1, 8, 8) | pack(deltaBits, 6, 16)
+                     | pack(primBits, 4, 22));
+    stream.push_back(pack(m_positionBits, 5, 0) | pack(m_normalBits, 5, 5));
+    stream.push_back(vertexBase);
+
+    BitWriter writer(stream);
+
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      writer.write(cache.vertices[v] - vertexBase, deltaBits);
+    }
+
+    for(uint32_t p = 0; p < cache.numPrims; p++)
+    {
+      writer.write(cache.primitives[p][0], primBits);
+      writer.write(cache.primitives[p][1], primBits);
+      writer.write(cache.primitives[p][2], primBits);
+    }
+
+    const float positionLast = float((1 << m_positionBits) - 1);
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      const float* pos = &positions[cache.vertices[v] * positionMul];
+      for(int i = 0; i < 3; i++)
+      {
+        float extent = bboxMax[i] - bboxMin[i];
+        float unorm  = extent > 0 ? (pos[i] - bboxMin[i]) / extent : 0.0f;
+        writer.write(uint32_t(std::max(0.0f, std::min(positionLast, roundf(unorm * positionLast)))), m_positionBits);
+      }
+    }
+
+    const float normalMax = float((1 << (m_normalBits - 1)) - 1);
+    for(uint32_t v = 0; v < cache.numVertices; v++)
+    {
+      vec normal = vec(&normals[cache.vertices[v] * normalMul]);
+      float len  = vec_length(normal);
+      normal     = len > FLT_EPSILON ? normal * (1.0f / len) : vec(0.0f, 0.0f, 1.0f);
+
+      vec oct = float32x3_to_octn_precise(normal, m_normalBits * 2);
+      writer.write(uint32_t(int32_t(roundf(oct.x * normalMax)) + int32_t(normalMax)), m_normalBits);
+      writer.write(uint32_t(int32_t(roundf(oct.y * normalMax)) + int32_t(normalMax)), m_normalBits);
+    }
+
+    writer.flush();
+
+    while(stream.size() % VERTEXPACK_ALIGNMENT)
+    {
+      stream.push_back(0);
+    }
+
+    return offset;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+
+  struct DecodedMeshlet
+  {
+    uint32_t           numVertices;
+    uint32_t           numPrims;
+    uint32_t           vertices[MAX_VERTEX_COUNT_LIMIT];
+    PrimitiveIndexType primitives[MAX_PRIMITIVE_COUNT_LIMIT][3];
+    float              positions[MAX_VERTEX_COUNT_LIMIT][3];
+    float              normals[MAX_VERTEX_COUNT_LIMIT][3];
+  };
+
+  // returns the number of words used by the meshlet, including alignment
+  static uint32_t decodeMeshlet(const uint32_t* meshletWords, const float bboxMin[3], const float bboxMax[3], DecodedMeshlet& meshlet)
+  {
+    uint32_t header0    = meshletWords[0];
+    uint32_t header1    = meshletWords[1];
+    uint32_t vertexBase = meshletWords[2];
+
+    meshlet.numVertices = unpack(header0, 8, 0) + 1;
+    meshlet.numPrims    = unpack(header0, 8, 8) + 1;
+
+    uint32_t deltaBits    = unpack(header0, 6, 16);
+    uint32_t primBits     = unpack(header0, 4, 22);
+    uint32_t positionBits = unpack(header1, 5, 0);
+    uint32_t normalBits   = unpack(header1, 5, 5);
+
+    BitReader reader(meshletWords + VERTEXPACK_HEADER_SIZE);
+
+    for(uint32_t v = 0; v < meshlet.numVertices; v++)
+    {
+      meshlet.vertices[v] = vertexBase + reader.read(deltaBits);
+    }
+
+    for(uint32_t p = 0; p < meshlet.numPrims; p++)
+    {
+      meshlet.primitives[p][0] = PrimitiveIndexType(reader.read(primBits));
+      meshlet.primitives[p][1] = PrimitiveIndexType(reader.read(primBits));
+      meshlet.primitives[p][2] = PrimitiveIndexType(reader.read(primBits));
+    }
+
+    const float positionLast = float((1 << positionBits) - 1);
+    for(uint32_t v = 0; v < meshlet.numVertices; v++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        float unorm             = float(reader.read(positionBits)) / positionLast;
+        meshlet.positions[v][i] = bboxMin[i] + unorm * (bboxMax[i] - bboxMin[i]);
+      }
+    }
+
+    const float normalMax = float((1 << (normalBits - 1)) - 1);
+    for(uint32_t v = 0; v < meshlet.numVertices; v++)
+    {
+      float x = (float(reader.read(normalBits)) - normalMax) / normalMax;
+      float y = (float(reader.read(normalBits)) - normalMax) / normalMax;
+
+      vec normal            = oct_to_float32x3(vec(x, y, 0.0f));
+      meshlet.normals[v][0] = normal.x;
+      meshlet.normals[v][1] = normal.y;
+      meshlet.normals[v][2] = normal.z;
+    }
+
+    uint32_t bits = meshlet.numVertices * (deltaBits + 3 * positionBits + 2 * normalBits) + meshlet.numPrims * 3 * primBits;
+    return alignedSize(VERTEXPACK_HEADER_SIZE + (bits + 31) / 32, VERTEXPACK_ALIGNMENT);
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+
+  // round-trip test of an encoded meshlet against its source
+  StatusCode errorCheck(const uint32_t*          meshletWords,
+                        const PrimitiveCache&    cache,
+                        const float              bboxMin[3],
+                        const float              bboxMax[3],
+                        const float* NV_RESTRICT positions,
+                        size_t                   positionStride,
+                        const float* NV_RESTRICT normals,
+                        size_t                   normalStride) const
+  {
+    size_t positionMul = positionStride / sizeof(float);
+    size_t normalMul   = normalStride / sizeof(float);
+
+    DecodedMeshlet meshlet;
+    decodeMeshlet(meshletWords, bboxMin, bboxMax, meshlet);
+
+    if(meshlet.numVertices != cache.numVertices || meshlet.numPrims != cache.numPrims)
+    {
+      return STATUS_MISMATCH_INDICES;
+    }
+
+    for(uint32_t p = 0; p < meshlet.numPrims; p++)
+    {
+      if(meshlet.primitives[p][0] != cache.primitives[p][0] || meshlet.primitives[p][1] != cache.primitives[p][1]
+         || meshlet.primitives[p][2] != cache.primitives[p][2])
+      {
+        return STATUS_MISMATCH_INDICES;
+      }
+    }
+
+    float positionTolerance = getPositionTolerance(bboxMin, bboxMax);
+    float normalTolerance   = getNormalTolerance();
+
+    for(uint32_t v = 0; v < meshlet.numVertices; v++)
+    {
+      if(meshlet.vertices[v] != cache.vertices[v])
+      {
+        return STATUS_MISMATCH_INDICES;
+      }
+
+      const float* pos = &positions[cache.vertices[v] * positionMul];
+      for(int i = 0; i < 3; i++)
+      {
+        if(fabsf(meshlet.positions[v][i] - pos[i]) > positionTolerance)
+        {
+          return STATUS_POSITION_MISMATCH;
+        }
+      }
+
+      vec normal = vec(&normals[cache.vertices[v] * normalMul]);
+      float len  = vec_length(normal);
+      if(len > FLT_EPSILON && 1.0f - vec_dot(normal * (1.0f / len), vec(meshlet.normals[v])) > normalTolerance)
+      {
+        return STATUS_NORMAL_MISMATCH;
+      }
+    }
+
+    return STATUS_NO_ERROR;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+
+  // Encodes all meshlets of a builder's geometry, after buildMeshletEarlyCulling
+  // computed their bboxes. Appends one offset per meshlet descriptor, unset
+  // (padding) meshlets get a valid but meaningless entry.
+  template <class TBuilder>
+  void encodeGeometry(const TBuilder&                          builder,
+                      const typename TBuilder::MeshletGeometry& geometry,
+                      const float                              objectBboxMin[3],
+                      const float                              objectBboxMax[3],
+                      const float* NV_RESTRICT                 positions,
+                      size_t                                   positionStride,
+                      const float* NV_RESTRICT                 normals,
+                      size_t                                   normalStride,
+                      std::vector<uint32_t>&                   stream,
+                      std::vector<uint32_t>&                   offsets) const
+  {
+    PrimitiveCache cache;
+
+    for(size_t i = 0; i < geometry.meshletDescriptors.size(); i++)
+    {
+      uint8_t gridMin[3];
+      uint8_t gridMax[3];
+      float   bboxMin[3];
+      float   bboxMax[3];
+      geometry.meshletDescriptors[i].getBBox(gridMin, gridMax);
+      getMeshletBBox(objectBboxMin, objectBboxMax, gridMin, gridMax, bboxMin, bboxMax);
+
+      builder.extractMeshlet(geometry, i, cache);
+      offsets.push_back(encodeMeshlet(stream, cache, bboxMin, bboxMax, positions, positionStride, normals, normalStride));
+    }
+  }
+
+  template <class TBuilder>
+  StatusCode errorCheckGeometry(const TBuilder&                          builder,
+                                const typename TBuilder::MeshletGeometry& geometry,
+                                const float                              objectBboxMin[3],
+                                const float                              objectBboxMax[3],
+                                const float* NV_RESTRICT                 positions,
+                                size_t                                   positionStride,
+                                const float* NV_RESTRICT                 normals,
+                                size_t                                   normalStride,
+                                const uint32_t*                          stream,
+                                const uint32_t*                          offsets) const
+  {
+    PrimitiveCache cache;
+
+    for(size_t i = 0; i < geometry.meshletDescriptors.size(); i++)
+    {
+      uint8_t gridMin[3];
+      uint8_t gridMax[3];
+      float   bboxMin[3];
+      float   bboxMax[3];
+      // skip unset
+      if(geometry.meshletDescriptors[i].getNumVertices() == 1)
+        continue;
+
+      geometry.meshletDescriptors[i].getBBox(gridMin, gridMax);
+      getMeshletBBox(objectBboxMin, objectBboxMax, gridMin, gridMax, bboxMin, bboxMax);
+
+      builder.extractMeshlet(geometry, i, cache);
+      StatusCode status = errorCheck(stream + offsets[i], cache, bboxMin, bboxMax, positions, positionStride, normals, normalStride);
+      if(status != STATUS_NO_ERROR)
+      {
+        return status;
+      }
+    }
+
+    return STATUS_NO_ERROR;
+  }
+};
+
+}  // namespace NVMeshlet
+
+#endif
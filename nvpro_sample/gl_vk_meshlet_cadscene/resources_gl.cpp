@@ -177,8 +177,16 @@ bool ResourcesGL::initPrograms(const std::string& path, const std::string& prepe
 
 void ResourcesGL::reloadPrograms(const std::string& prepend)
 {
-  m_progManager.m_prepend = prepend;
-  m_progManager.reloadPrograms();
+  // with the same defines, only the programs whose files changed need to be compiled again
+  if(m_progManager.m_prepend == prepend)
+  {
+    m_progManager.reloadChangedPrograms();
+  }
+  else
+  {
+    m_progManager.m_prepend = prepend;
+    m_progManager.reloadPrograms();
+  }
   updatedPrograms();
 }
 
@@ -545,8 +545,18 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
 
 void ResourcesVK::reloadPrograms(const std::string& prepend)
 {
-  m_shaderManager.m_prepend = std::string("#define IS_VULKAN 1\n") + prepend;
-  m_shaderManager.reloadShaderModules();
+  std::string fullPrepend = std::string("#define IS_VULKAN 1\n") + prepend;
+
+  // with the same defines, only the modules whose files changed need to be compiled again
+  if(m_shaderManager.m_prepend == fullPrepend)
+  {
+    m_shaderManager.reloadChangedShaderModules();
+  }
+  else
+  {
+    m_shaderManager.m_prepend = fullPrepend;
+    m_shaderManager.reloadShaderModules();
+  }
   updatedPrograms();
 }
 
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Round-trip accuracy of the NVMeshlet vertex pack. Meshlets are encoded and
+// decoded for all supported position and normal bit widths, topology must
+// survive exactly, positions and normals within the builder's tolerances.
+// Whole geometries are checked through both meshlet builders.
+
+#include "../nvmeshlet_array.hpp"
+#include "../nvmeshlet_packbasic.hpp"
+#include "../nvmeshlet_vertexpack.hpp"
+
+#include <random>
+#include <stdio.h>
+
+using namespace NVMeshlet;
+
+static std::mt19937 s_rng(5);
+
+static float randomFloat(float lo, float hi)
+{
+  return std::uniform_real_distribution<float>(lo, hi)(s_rng);
+}
+
+struct Mesh
+{
+  std::vector<float>    positions;
+  std::vector<float>    normals;
+  std::vector<uint32_t> indices;
+  float                 bboxMin[3];
+  float                 bboxMax[3];
+};
+
+// a bumpy grid, so meshlets get varying bboxes and normals
+static Mesh makeGrid(uint32_t width, uint32_t height)
+{
+  Mesh mesh;
+  for(uint32_t y = 0; y < height; y++)
+  {
+    for(uint32_t x = 0; x < width; x++)
+    {
+      float fx = float(x) * 0.37f;
+      float fy = float(y) * 0.21f;
+      float fz = sinf(fx) * cosf(fy) * 2.0f;
+      mesh.positions.insert(mesh.positions.end(), {fx, fy, fz});
+
+      float nx = -cosf(fx) * cosf(fy) * 2.0f * 0.37f;
+      float ny = sinf(fx) * sinf(fy) * 2.0f * 0.21f;
+      float len = sqrtf(nx * nx + ny * ny + 1.0f);
+      mesh.normals.insert(mesh.normals.end(), {nx / len, ny / len, 1.0f / len});
+    }
+  }
+  for(uint32_t y = 0; y + 1 < height; y++)
+  {
+    for(uint32_t x = 0; x + 1 < width; x++)
+    {
+      uint32_t v = y * width + x;
+      mesh.indices.insert(mesh.indices.end(), {v, v + 1, v + width, v + 1, v + width + 1, v + width});
+    }
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    mesh.bboxMin[i] = FLT_MAX;
+    mesh.bboxMax[i] = -FLT_MAX;
+  }
+  for(size_t v = 0; v < mesh.positions.size(); v += 3)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      mesh.bboxMin[i] = std::min(mesh.bboxMin[i], mesh.positions[v + i]);
+      mesh.bboxMax[i] = std::max(mesh.bboxMax[i], mesh.positions[v + i]);
+    }
+  }
+  return mesh;
+}
+
+// random meshlets with random attributes, also checks the measured errors stay within tolerance
+static bool testMeshlets(uint32_t positionBits, uint32_t normalBits)
+{
+  VertexPackBuilder vertexPack;
+  vertexPack.setup(positionBits, normalBits);
+
+  static PrimitiveCache                    cache;
+  static VertexPackBuilder::DecodedMeshlet decoded;
+
+  float maxPositionError = 0;
+  float maxNormalError   = 0;
+
+  for(int iteration = 0; iteration < 200; iteration++)
+  {
+    uint32_t numVertices = 1 + s_rng() % 64;
+    uint32_t numPrims    = 1 + s_rng() % 126;
+    // sparse and dense vertex ranges, small and big bases
+    uint32_t vertexBase  = (iteration % 3 == 0) ? s_rng() : s_rng() % 1000;
+    uint32_t vertexRange = (iteration % 2 == 0) ? numVertices * 4 : (1u << 24);
+    vertexRange          = std::min(vertexRange, ~0u - vertexBase);
+
+    cache.reset();
+    cache.numVertices = numVertices;
+    cache.numPrims    = numPrims;
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      cache.vertices[v] = vertexBase + uint32_t(s_rng() % (vertexRange + 1ull));
+    }
+    for(uint32_t p = 0; p < numPrims; p++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        cache.primitives[p][i] = PrimitiveIndexType(s_rng() % numVertices);
+      }
+    }
+
+    // attributes are looked up by vertex index, so give each meshlet vertex its own slot
+    std::vector<float> positions(numVertices * 3);
+    std::vector<float> normals(numVertices * 3);
+    float              bboxMin[3];
+    float              bboxMax[3];
+    for(int i = 0; i < 3; i++)
+    {
+      bboxMin[i] = randomFloat(-100.0f, 100.0f);
+      // flat meshlets have no extent along one axis
+      bboxMax[i] = (iteration % 17 == i) ? bboxMin[i] : bboxMin[i] + randomFloat(0.001f, 50.0f);
+    }
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        positions[v * 3 + i] = randomFloat(bboxMin[i], bboxMax[i]);
+        normals[v * 3 + i]   = randomFloat(-1.0f, 1.0f);
+      }
+      // degenerate normals are encoded as +z
+      if(iteration % 23 == 0 && v == 0)
+      {
+        normals[0] = normals[1] = normals[2] = 0.0f;
+      }
+    }
+
+    // encode with indices remapped to the local attribute arrays
+    PrimitiveCache local = cache;
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      local.vertices[v] = v;
+    }
+
+    std::vector<uint32_t> stream(s_rng() % 4 * VERTEXPACK_ALIGNMENT, 0xDEADBEEF);
+    size_t   streamBegin = stream.size();
+    uint32_t offset      = vertexPack.encodeMeshlet(stream, local, bboxMin, bboxMax, positions.data(), sizeof(float) * 3,
+                                               normals.data(), sizeof(float) * 3);
+    if(offset != streamBegin || stream.size() % VERTEXPACK_ALIGNMENT)
+    {
+      printf("position %u normal %u: bad stream offset\n", positionBits, normalBits);
+      return false;
+    }
+
+    uint32_t numWords = VertexPackBuilder::decodeMeshlet(stream.data() + offset, bboxMin, bboxMax, decoded);
+    if(numWords != stream.size() - offset)
+    {
+      printf("position %u normal %u: decoded %u words, encoded %zu\n", positionBits, normalBits, numWords, stream.size() - offset);
+      return false;
+    }
+
+    if(vertexPack.errorCheck(stream.data() + offset, local, bboxMin, bboxMax, positions.data(), sizeof(float) * 3,
+                             normals.data(), sizeof(float) * 3)
+       != STATUS_NO_ERROR)
+    {
+      printf("position %u normal %u: errorCheck failed, iteration %d\n", positionBits, normalBits, iteration);
+      return false;
+    }
+
+    // the same topology with the original, big vertex indices
+    stream.clear();
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      local.vertices[v] = cache.vertices[v] - vertexBase;
+    }
+    std::vector<float> spread;
+    if(vertexRange <= 4096)
+    {
+      spread.resize(size_t(vertexRange + 1) * 3);
+      for(uint32_t v = 0; v < numVertices; v++)
+      {
+        memcpy(&spread[local.vertices[v] * 3], &positions[v * 3], sizeof(float) * 3);
+      }
+      vertexPack.encodeMeshlet(stream, local, bboxMin, bboxMax, spread.data(), sizeof(float) * 3, spread.data(), sizeof(float) * 3);
+      VertexPackBuilder::decodeMeshlet(stream.data(), bboxMin, bboxMax, decoded);
+      for(uint32_t v = 0; v < numVertices; v++)
+      {
+        if(decoded.vertices[v] != local.vertices[v])
+        {
+          printf("position %u normal %u: vertex index mismatch\n", positionBits, normalBits);
+          return false;
+        }
+      }
+    }
+    else
+    {
+      // only the indices matter here, all vertices read the same attributes
+      vertexPack.encodeMeshlet(stream, local, bboxMin, bboxMax, positions.data(), 0, normals.data(), 0);
+      VertexPackBuilder::decodeMeshlet(stream.data(), bboxMin, bboxMax, decoded);
+      for(uint32_t v = 0; v < numVertices; v++)
+      {
+        if(decoded.vertices[v] != local.vertices[v])
+        {
+          printf("position %u normal %u: vertex index mismatch\n", positionBits, normalBits);
+          return false;
+        }
+      }
+    }
+    for(uint32_t p = 0; p < numPrims; p++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        if(decoded.primitives[p][i] != cache.primitives[p][i])
+        {
+          printf("position %u normal %u: primitive mismatch\n", positionBits, normalBits);
+          return false;
+        }
+      }
+    }
+
+    // measured errors of the first encoding
+    stream.clear();
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      local.vertices[v] = v;
+    }
+    vertexPack.encodeMeshlet(stream, local, bboxMin, bboxMax, positions.data(), sizeof(float) * 3, normals.data(), sizeof(float) * 3);
+    VertexPackBuilder::decodeMeshlet(stream.data(), bboxMin, bboxMax, decoded);
+    float extent = std::max(bboxMax[0] - bboxMin[0], std::max(bboxMax[1] - bboxMin[1], bboxMax[2] - bboxMin[2]));
+    for(uint32_t v = 0; v < numVertices; v++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        maxPositionError = std::max(maxPositionError, fabsf(decoded.positions[v][i] - positions[v * 3 + i]) / extent);
+      }
+      vec   normal = vec(&normals[v * 3]);
+      float len    = vec_length(normal);
+      if(len > FLT_EPSILON)
+      {
+        maxNormalError = std::max(maxNormalError, 1.0f - vec_dot(normal * (1.0f / len), vec(decoded.normals[v])));
+      }
+    }
+  }
+
+  printf("position %2u bits: max error %.3g of extent | normal %2u bits: max 1-cos %.3g\n", positionBits,
+         maxPositionError, normalBits, maxNormalError);
+  return true;
+}
+
+template <class TBuilder>
+static bool testGeometry(const char* name, const Mesh& mesh, uint32_t positionBits)
+{
+  TBuilder builder;
+  builder.setup(64, 126);
+
+  typename TBuilder::MeshletGeometry geometry;
+  uint32_t processed = builder.buildMeshlets(geometry, uint32_t(mesh.indices.size()), mesh.indices.data());
+  if(processed != mesh.indices.size())
+  {
+    printf("%s: built %u of %zu indices\n", name, processed, mesh.indices.size());
+    return false;
+  }
+  builder.buildMeshletEarlyCulling(geometry, mesh.bboxMin, mesh.bboxMax, mesh.positions.data(), sizeof(float) * 3);
+
+  VertexPackBuilder vertexPack;
+  vertexPack.setup(positionBits);
+
+  std::vector<uint32_t> stream;
+  std::vector<uint32_t> offsets;
+  vertexPack.encodeGeometry(builder, geometry, mesh.bboxMin, mesh.bboxMax, mesh.positions.data(), sizeof(float) * 3,
+                            mesh.normals.data(), sizeof(float) * 3, stream, offsets);
+
+  if(offsets.size() != geometry.meshletDescriptors.size())
+  {
+    printf("%s: %zu offsets for %zu meshlets\n", name, offsets.size(), geometry.meshletDescriptors.size());
+    return false;
+  }
+
+  StatusCode status = vertexPack.errorCheckGeometry(builder, geometry, mesh.bboxMin, mesh.bboxMax, mesh.positions.data(),
+                                                    sizeof(float) * 3, mesh.normals.data(), sizeof(float) * 3,
+                                                    stream.data(), offsets.data());
+  if(status != STATUS_NO_ERROR)
+  {
+    printf("%s: errorCheckGeometry %d with %u position bits\n", name, int(status), positionBits);
+    return false;
+  }
+
+  return true;
+}
+
+int main()
+{
+  bool ok = true;
+
+  for(uint32_t positionBits = 1; positionBits <= 16; positionBits++)
+  {
+    ok = ok && testMeshlets(positionBits, std::max(2u, std::min(16u, positionBits)));
+  }
+  for(uint32_t normalBits = 2; normalBits <= 16; normalBits += 2)
+  {
+    ok = ok && testMeshlets(12, normalBits);
+  }
+
+  Mesh mesh = makeGrid(97, 61);
+  for(uint32_t positionBits : {4u, 8u, 12u, 16u})
+  {
+    ok = ok && testGeometry<ArrayBuilder<uint32_t>>("ArrayBuilder", mesh, positionBits);
+    ok = ok && testGeometry<PackBasicBuilder>("PackBasicBuilder", mesh, positionBits);
+  }
+
+  printf("test_vertexpack: %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -25,6 +25,8 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <future>
+#include <string.h>
 
 #define USE_CACHECOMBINE 1
 
@@ -102,14 +104,35 @@ inline nvmath::vec3f float32x3_to_octn_precise(nvmath::vec3f v, const int n) {
 
 bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 {
+  // the previous scene's index data may still reference its file
+  unload();
+
+  // keep vertex and index data within the file mapping, instead of
+  // loading the file into memory, the mapping's pages are faulted in on demand.
+  // Only raw .csf files are mapped, otherwise the data is copied and the csf released.
+  CSFLoaderConfig config          = {0};
+  config.secondariesReadOnly      = 1;
+  config.gltfFindUniqueGeometries = 1;
+  // inflating .csf.gz as well as decoding .csfz geometry batches use all cores
+  config.numThreads = -1;
+
+  // .csfz files only decode the first batch of geometries at load time,
+  // the next batch is decoded in the background while the current one is converted
+  const int geometryBatch = 256;
+  size_t    filenameLen   = strlen(filename);
+  bool      isCSFZ        = filenameLen > 5 && strcmp(filename + filenameLen - 5, ".csfz") == 0;
+  config.geometryNum      = isCSFZ ? geometryBatch : 0;
+
   CSFile*         csf;
-  CSFileMemoryPTR mem = CSFileMemory_new();
+  CSFileMemoryPTR mem = CSFileMemory_newCfg(&config);
   if(CSFile_loadExt(&csf, filename, mem) != CADSCENEFILE_NOERROR || !(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES))
   {
     CSFileMemory_delete(mem);
     return false;
   }
 
+  bool isMapped = CSFileMemory_isFileMapped(mem) != 0;
+
   int copies = clones + 1;
 
   CSFile_transform(csf);
@@ -138,8 +161,34 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
   int numGeoms = csf->numGeometries;
   m_geometry.resize(csf->numGeometries * copies);
   m_geometryBboxes.resize(csf->numGeometries * copies);
+
+  std::future<int> decodeNext;
   for(int n = 0; n < csf->numGeometries; n++)
   {
+    if(isCSFZ && (n % geometryBatch) == 0)
+    {
+      int result = decodeNext.valid() ? decodeNext.get() : CADSCENEFILE_NOERROR;
+      if(result == CADSCENEFILE_NOERROR && n + geometryBatch < numGeoms)
+      {
+        decodeNext = std::async(std::launch::async, CSFile_loadGeometries, csf, mem, n + geometryBatch, geometryBatch);
+      }
+      if(result != CADSCENEFILE_NOERROR)
+      {
+        for(int i = 0; i < n; i++)
+        {
+          delete[] m_geometry[i].vboData;
+          if(!m_geometry[i].iboMapped)
+          {
+            delete[] m_geometry[i].iboData;
+          }
+        }
+        m_geometry.clear();
+        m_geometryBboxes.clear();
+        CSFileMemory_delete(mem);
+        return false;
+      }
+    }
+
     CSFGeometry* csfgeom = &csf->geometries[n];
     Geometry&    geom    = m_geometry[n];
     geom.cloneIdx        = -1;
@@ -179,14 +228,25 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     geom.vboSize = sizeof(Vertex) * csfgeom->numVertices;
 
 
-    unsigned int* indices = new unsigned int[csfgeom->numIndexSolid + csfgeom->numIndexWire];
-    memcpy(&indices[0], csfgeom->indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
-    if(csfgeom->indexWire)
+    // use the mapped file's indices directly if solid and wire are stored consecutively
+    CSFSpan<const unsigned int> fileIndices = CSFGeometry_viewIndexCombined(csfgeom);
+    if(isMapped && !fileIndices.empty())
     {
-      memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(unsigned int) * csfgeom->numIndexWire);
+      geom.iboData   = fileIndices.data;
+      geom.iboMapped = true;
     }
+    else
+    {
+      unsigned int* indices = new unsigned int[csfgeom->numIndexSolid + csfgeom->numIndexWire];
+      memcpy(&indices[0], csfgeom->indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
+      if(csfgeom->indexWire)
+      {
+        memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(unsigned int) * csfgeom->numIndexWire);
+      }
 
-    geom.iboData = indices;
+      geom.iboData   = indices;
+      geom.iboMapped = false;
+    }
     geom.iboSize = sizeof(unsigned int) * (csfgeom->numIndexSolid + csfgeom->numIndexWire);
 
 
@@ -422,10 +482,49 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     }
   }
 
-  CSFileMemory_delete(mem);
+  if(isMapped)
+  {
+    m_csf       = csf;
+    m_csfMemory = mem;
+  }
+  else
+  {
+    CSFileMemory_delete(mem);
+  }
   return true;
 }
 
+void CadScene::adviseGeometries(size_t geometryFrom, size_t geometryNum, bool willNeed) const
+{
+  if(!m_csf)
+    return;
+
+  CSFAdvice advice = willNeed ? CSFADVICE_WILLNEED : CSFADVICE_DONTNEED;
+
+  // clones map back to the file's geometries, merge consecutive ones
+  int fileFrom = 0;
+  int fileNum  = 0;
+  for(size_t g = geometryFrom; g < std::min(geometryFrom + geometryNum, m_geometry.size()); g++)
+  {
+    int fileIndex = m_geometry[g].cloneIdx >= 0 ? m_geometry[g].cloneIdx : int(g);
+    if(fileNum && fileIndex == fileFrom + fileNum)
+    {
+      fileNum++;
+      continue;
+    }
+    if(fileNum)
+    {
+      CSFile_adviseGeometries(m_csf, m_csfMemory, fileFrom, fileNum, advice);
+    }
+    fileFrom = fileIndex;
+    fileNum  = 1;
+  }
+  if(fileNum)
+  {
+    CSFile_adviseGeometries(m_csf, m_csfMemory, fileFrom, fileNum, advice);
+  }
+}
+
 
 struct ListItem
 {
@@ -547,6 +646,10 @@ void CadScene::updateObjectDrawCache(Object& object)
 
 void CadScene::unload()
 {
+  CSFileMemory_delete(m_csfMemory);
+  m_csfMemory = nullptr;
+  m_csf       = nullptr;
+
   if(m_geometry.empty())
     return;
 
@@ -557,7 +660,10 @@ void CadScene::unload()
       continue;
 
     delete[] m_geometry[i].vboData;
-    delete[] m_geometry[i].iboData;
+    if(!m_geometry[i].iboMapped)
+    {
+      delete[] m_geometry[i].iboData;
+    }
   }
 
   m_matrices.clear();
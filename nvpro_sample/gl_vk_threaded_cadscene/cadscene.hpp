@@ -24,6 +24,7 @@
 #ifndef CADSCENE_H__
 #define CADSCENE_H__
 
+#include <fileformats/cadscenefile.h>
 #include <nvmath/nvmath.h>
 #include <vector>
 #include <cstdint>
@@ -174,8 +175,10 @@ public:
     size_t vboSize;
     size_t iboSize;
 
-    Vertex*       vboData;
-    unsigned int* iboData;
+    Vertex*             vboData;
+    const unsigned int* iboData;
+    // iboData points directly into the csf file mapping
+    bool iboMapped;
 
     std::vector<GeometryPart> parts;
 
@@ -212,11 +215,19 @@ public:
 
   BBox m_bbox;
 
+  // only kept while loaded if the file is memory mapped, index data is then used directly from it
+  CSFile*         m_csf       = nullptr;
+  CSFileMemoryPTR m_csfMemory = nullptr;
+
 
   void updateObjectDrawCache(Object& object);
 
   bool loadCSF(const char* filename, int clones = 0, int cloneaxis = 3);
   void unload();
+
+  // hints that the file data of the geometries is accessed soon or no longer needed
+  // (only has an effect when the file was memory mapped)
+  void adviseGeometries(size_t geometryFrom, size_t geometryNum, bool willNeed) const;
 };
 
 
@@ -137,8 +137,16 @@ void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevic
 
   ScopeStaging staging(&m_memAllocator, queue, queueFamilyIndex);
 
+  // index data is read directly from the file mapping, prefetch ahead of the copies
+  const size_t prefetchBatch = 256;
+
   for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
   {
+    if(g % prefetchBatch == 0)
+    {
+      cadscene.adviseGeometries(g, prefetchBatch * 2, true);
+    }
+
     const CadScene::Geometry&      cadgeom = cadscene.m_geometry[g];
     Geometry&                      geom    = m_geometry[g];
     const GeometryMemoryVK::Chunk& chunk   = m_geometryMem.getChunk(geom.allocation);
@@ -41,6 +41,7 @@
 #include <nvh/geometry.hpp>
 
 #include "renderer.hpp"
+#include <thread>
 
 
 namespace csfthreaded {
@@ -113,6 +114,7 @@ public:
 
   std::string m_modelFilename = "geforce.csf.gz";
   double      m_animBeginTime;
+  int         m_maxThreads = 1;
 
   double m_lastFrameTime = 0;
   double m_frames        = 0;
@@ -326,9 +328,8 @@ bool Sample::begin()
   m_renderer  = NULL;
   m_resources = NULL;
 
-  int maxthreads = ThreadPool::sysGetNumCores();
-
-  Renderer::s_threadpool.init(maxthreads);
+  // renderers record with threads-1 workers plus the main thread
+  m_maxThreads = std::max(1, int(std::thread::hardware_concurrency()));
 
   ImGuiH::Init(m_windowState.m_winSize[0], m_windowState.m_winSize[1], this);
 
@@ -453,7 +454,7 @@ void Sample::processUI(int width, int height, double time)
     ImGui::SliderFloat("pct visible", &m_tweak.percent, 0.0f, 1.001f);
     ImGui::PushItemWidth(ImGuiH::dpiScaled(100));
     ImGuiH::InputIntClamped("copies", &m_tweak.copies, 1, 16, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
-    ImGuiH::InputIntClamped("threaded: worker threads", &m_tweak.threads, 1, Renderer::s_threadpool.getNumThreads());
+    ImGuiH::InputIntClamped("threaded: worker threads", &m_tweak.threads, 1, m_maxThreads);
     ImGuiH::InputIntClamped("threaded: workingset", &m_tweak.workingSet, 128, 16 * 1024, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::Checkbox("threaded: batched submit", &m_tweak.batchedSubmit);
     ImGui::Checkbox("sorted", &m_tweak.sorted);
@@ -656,6 +657,7 @@ void Sample::setupConfigParameters()
 {
   m_parameterList.addFilename(".csf", &m_modelFilename);
   m_parameterList.addFilename(".csf.gz", &m_modelFilename);
+  m_parameterList.addFilename(".csfz", &m_modelFilename);
   m_parameterList.addFilename(".gltf", &m_modelFilename);
 
   m_parameterList.add("vkdevice", &Resources::s_vkDevice);
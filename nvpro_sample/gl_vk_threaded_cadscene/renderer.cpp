@@ -229,6 +229,4 @@ void Renderer::fillDrawItems(std::vector<DrawItem>& drawItems, const Config& con
   LOGI("draw calls:      %9d\n", uint32_t(drawItems.size()));
   LOGI("triangles total: %9d\n", sumTriangles);
 }
-
-ThreadPool Renderer::s_threadpool;
 }  // namespace csfthreaded
@@ -31,8 +31,6 @@
 #include "resources.hpp"
 #include <nvh/profiler.hpp>
 
-#include "threadpool.hpp"
-
 
 // disable state filtering for buffer binds
 #define USE_NOFILTER 0
@@ -105,8 +103,6 @@ public:
     return s_registry;
   }
 
-  static ThreadPool s_threadpool;
-
 public:
   virtual void init(const CadScene* NV_RESTRICT scene, Resources* resources, const Config& config) {}
   virtual void deinit() {}
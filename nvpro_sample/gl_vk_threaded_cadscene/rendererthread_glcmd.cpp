@@ -25,9 +25,9 @@
 #include <algorithm>
 #include <assert.h>
 #include <mutex>
-#include <queue>
 
 #include <nvgl/contextwindow_gl.hpp>
+#include <nvh/jobsystem.hpp>
 #include <nvmath/nvmath_glsltypes.h>
 #include <nvpwindow.hpp>
 
@@ -96,20 +96,13 @@ private:
     unsigned char* NV_RESTRICT bufferData;
   };
 
+  // per-worker state of the job system, accessed without locking
   struct ThreadJob
   {
-    RendererThreadedGLCMD* renderer;
-    int                    index;
-
     GLuint        m_buffers[NUM_FRAMES];
     PointerStream m_streams[NUM_FRAMES];
     std::string   m_tokens[NUM_FRAMES];
 
-    int                     m_frame;
-    std::condition_variable m_hasWorkCond;
-    std::mutex              m_hasWorkMutex;
-    volatile int            m_hasWork;
-
     size_t                     m_scIdx;
     std::vector<ShadeCommand*> m_scs;
 
@@ -142,58 +135,15 @@ private:
   int       m_frame;
   GLsync    m_syncs[NUM_FRAMES];
 
-  ThreadJob* m_jobs;
-
-  volatile int    m_hadPrint;
-  volatile int    m_ready;
-  volatile int    m_stopThreads;
-  volatile size_t m_numCurItems;
-
-  std::condition_variable m_readyCond;
-  std::mutex              m_readyMutex;
+  nvh::JobSystem m_jobSystem;
+  ThreadJob*     m_jobs;
 
-  size_t                    m_numEnqueues;
-  std::queue<ShadeCommand*> m_drawQueue;
-
-  std::mutex m_workMutex;
-  std::mutex m_drawMutex;
-
-  static void threadMaster(void* arg)
-  {
-    ThreadJob* job = (ThreadJob*)arg;
-    job->renderer->RunThread(job->index);
-  }
+  // one command per workingSet chunk, drawn in order
+  std::vector<ShadeCommand*> m_chunkCommands;
 
-  bool getWork_ts(size_t& start, size_t& num)
-  {
-    std::lock_guard<std::mutex> lock(m_workMutex);
-    bool                        hasWork = false;
+  size_t m_numEnqueues;
 
-    const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
-
-    if(m_numCurItems < total)
-    {
-      size_t batch = std::min(total - m_numCurItems, chunkSize);
-      start        = m_numCurItems;
-      num          = batch;
-      m_numCurItems += batch;
-      hasWork = true;
-    }
-    else
-    {
-      hasWork = false;
-      start   = 0;
-      num     = 0;
-    }
-
-    return hasWork;
-  }
-
-  void         RunThread(int index);
-  unsigned int RunThreadFrame(ShadeType shadetype, ThreadJob& job);
-
-  void enqueueShadeCommand_ts(ShadeCommand* sc);
+  void RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex);
 
 
   template <class T, ShadeType shade, bool sorted>
@@ -384,23 +334,19 @@ void RendererThreadedGLCMD::init(const CadScene* NV_RESTRICT scene, Resources* r
   m_resources  = (const ResourcesGL*)resources;
   m_numThreads = config.threads;
 
-  // make jobs
-  m_ready       = 0;
-  m_jobs        = new ThreadJob[m_numThreads];
-  m_stopThreads = 0;
+  // the thread calling draw generates tokens as well
+  m_jobSystem.init(uint32_t(std::max(m_numThreads, 1) - 1));
+  m_jobs = new ThreadJob[m_jobSystem.getNumSlots()];
 
   for(int f = 0; f < NUM_FRAMES; f++)
   {
     m_syncs[f] = 0;
   }
 
-  for(int i = 0; i < m_numThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
     ThreadJob& job = m_jobs[i];
-    job.index      = i;
-    job.renderer   = this;
-    job.m_hasWork  = -1;
-    job.m_frame    = 0;
+    job.m_scIdx    = 0;
 
     if(m_mode == MODE_BUFFER_PERS)
     {
@@ -412,8 +358,6 @@ void RendererThreadedGLCMD::init(const CadScene* NV_RESTRICT scene, Resources* r
                               worstCaseSize);
       }
     }
-
-    s_threadpool.activateJob(i, threadMaster, &m_jobs[i]);
   }
 
   m_frame = 0;
@@ -421,29 +365,6 @@ void RendererThreadedGLCMD::init(const CadScene* NV_RESTRICT scene, Resources* r
 
 void RendererThreadedGLCMD::deinit()
 {
-  m_stopThreads = 1;
-  m_ready       = 0;
-
-  NV_BARRIER();
-  for(int i = 0; i < m_numThreads; i++)
-  {
-    std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-    m_jobs[i].m_hasWork = m_frame;
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
-
-  std::this_thread::yield();
-
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    while(m_ready < m_numThreads)
-    {
-      m_readyCond.wait(lock);
-    }
-  }
-
-  NV_BARRIER();
-
   for(int f = 0; f < NUM_FRAMES; f++)
   {
     if(m_syncs[f])
@@ -452,7 +373,7 @@ void RendererThreadedGLCMD::deinit()
     }
   }
 
-  for(int i = 0; i < m_numThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
     if(m_mode == MODE_BUFFER_PERS)
     {
@@ -471,136 +392,36 @@ void RendererThreadedGLCMD::deinit()
 
   delete[] m_jobs;
 
-  m_drawItems.clear();
-}
+  // workers are idle outside of draw
+  m_jobSystem.deinit();
 
-void RendererThreadedGLCMD::enqueueShadeCommand_ts(ShadeCommand* sc)
-{
-  std::lock_guard<std::mutex> lock(m_drawMutex);
-  m_drawQueue.push(sc);
+  m_drawItems.clear();
+  m_chunkCommands.clear();
 }
 
-unsigned int RendererThreadedGLCMD::RunThreadFrame(ShadeType shadetype, ThreadJob& job)
+void RendererThreadedGLCMD::RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex)
 {
-  unsigned int dispatches = 0;
-
-  bool   first = true;
-  size_t tnum  = 0;
-  size_t begin = 0;
-  size_t num   = 0;
-
-  size_t offset = 0;
-  job.resetFrame();
+  ThreadJob& job      = m_jobs[workerIndex];
+  int        subframe = m_frame % NUM_FRAMES;
 
-  int subframe = job.m_frame % NUM_FRAMES;
-  job.m_streams[subframe].clear();
+  ShadeCommand* sc = job.getFrameCommand();
+  sc->bufferData   = job.m_streams[subframe].dataptr;
 
-  while(getWork_ts(begin, num))
+  if(m_mode == MODE_BUFFER_PERS)
   {
-    ShadeCommand* sc = job.getFrameCommand();
-    sc->bufferData   = job.m_streams[subframe].dataptr;
-
-    if(m_mode == MODE_BUFFER_PERS)
-    {
-      sc->bufferOffset = job.m_streams[subframe].size();
-    }
-
-    GenerateTokens<PointerStream>(job.m_streams[subframe], *sc, shadetype, &m_drawItems[begin], num, m_resources,
-                                  m_config.sorted);
-    sc->bufferSize = job.m_streams[subframe].size() - sc->bufferOffset;
-
-    if(m_mode == MODE_BUFFER_PERS)
-    {
-      sc->buffer = job.m_buffers[subframe];
-    }
-
-    enqueueShadeCommand_ts(sc);
-    dispatches += 1;
-
-    tnum += num;
+    sc->bufferOffset = job.m_streams[subframe].size();
   }
 
-  // NULL signals we are done
-  enqueueShadeCommand_ts(NULL);
-
-  return dispatches;
-}
-
-void RendererThreadedGLCMD::RunThread(int tid)
-{
-  ThreadJob& job = m_jobs[tid];
-  ShadeType  shadetype;
+  GenerateTokens<PointerStream>(job.m_streams[subframe], *sc, m_shade, &m_drawItems[begin], end - begin, m_resources,
+                                m_config.sorted);
+  sc->bufferSize = job.m_streams[subframe].size() - sc->bufferOffset;
 
-  double timeWork    = 0;
-  double timeFrame   = 0;
-  int    timerFrames = 0;
-  size_t dispatches  = 0;
-
-  double timePrint = NVPSystem::getTime();
-
-  while(!m_stopThreads)
+  if(m_mode == MODE_BUFFER_PERS)
   {
-    //NV_BARRIER();
-
-    double beginFrame = NVPSystem::getTime();
-    timeFrame -= NVPSystem::getTime();
-
-    {
-      std::unique_lock<std::mutex> lock(job.m_hasWorkMutex);
-      while(job.m_hasWork != job.m_frame)
-      {
-        job.m_hasWorkCond.wait(lock);
-      }
-
-      shadetype = m_shade;
-    }
-
-    if(m_stopThreads)
-    {
-      break;
-    }
-
-    double beginWork = NVPSystem::getTime();
-    timeWork -= NVPSystem::getTime();
-
-    dispatches += RunThreadFrame(shadetype, job);
-
-    job.m_frame++;
-
-    timeWork += NVPSystem::getTime();
-
-    double currentTime = NVPSystem::getTime();
-    timeFrame += currentTime;
-
-    timerFrames++;
-
-    if(timerFrames && (currentTime - timePrint) > 2.0)
-    {
-      timeFrame /= double(timerFrames);
-      timeWork /= double(timerFrames);
-
-      timeFrame *= 1000000.0;
-      timeWork *= 1000000.0;
-
-      timePrint = currentTime;
-
-      GLuint avgdispatch = GLuint(double(dispatches) / double(timerFrames));
-#if PRINT_TIMER_STATS
-      LOGI("thread %d: work %6d [us] dispatches %5d\n", tid, GLuint(timeWork), GLuint(avgdispatch));
-#endif
-      timeFrame = 0;
-      timeWork  = 0;
-
-      timerFrames = 0;
-      dispatches  = 0;
-    }
+    sc->buffer = job.m_buffers[subframe];
   }
 
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    m_ready++;
-    m_readyCond.notify_all();
-  }
+  m_chunkCommands[begin / m_workingSet] = sc;
 }
 
 void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global)
@@ -629,30 +450,15 @@ void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT res
 
   glNamedBufferSubData(res->m_common.view, 0, sizeof(SceneData), &global.sceneUbo);
 
-  m_workingSet  = global.workingSet;
+  m_workingSet  = std::max(global.workingSet, 1);
   m_shade       = shadetype;
-  m_numCurItems = 0;
   m_numEnqueues = 0;
 
-  // generate & tokens/cmdbuffers in parallel
-
-  NV_BARRIER();
-
-  // start to dispatch threads
-  for(int i = 0; i < m_numThreads; i++)
-  {
-    {
-      std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-      m_jobs[i].m_hasWork = m_frame;
-    }
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
-
-
   int subframe = m_frame % NUM_FRAMES;
 
   if(m_mode == MODE_BUFFER_PERS)
   {
+    // the persistent token buffers of this subframe are rewritten below
     if(m_syncs[subframe])
     {
       GLenum ret = glClientWaitSync(m_syncs[subframe], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
@@ -660,47 +466,30 @@ void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT res
       m_syncs[subframe] = 0;
     }
   }
-  // dispatch drawing here
-  {
-    int numTerminated = 0;
-    while(true)
-    {
-      bool          hadEntry = false;
-      ShadeCommand* sc       = NULL;
 
-      {
-        std::lock_guard<std::mutex> lock(m_drawMutex);
-        if(!m_drawQueue.empty())
-        {
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
+  {
+    m_jobs[i].resetFrame();
+    m_jobs[i].m_streams[subframe].clear();
+  }
+  m_chunkCommands.assign((m_drawItems.size() + m_workingSet - 1) / m_workingSet, nullptr);
 
-          sc = m_drawQueue.front();
-          m_drawQueue.pop();
+  // generate tokens in parallel, idle workers steal chunks of workingSet drawitems
+  // from the busy ones, this thread generates as well until all are done
 
-          hadEntry = true;
-        }
-      }
+  m_jobSystem.parallelFor(
+      0, m_drawItems.size(), [&](size_t begin, size_t end, uint32_t workerIndex) { RunThreadChunk(begin, end, workerIndex); },
+      m_workingSet);
 
-      if(hadEntry)
-      {
-        if(sc)
-        {
-          NV_BARRIER();
-          m_numEnqueues++;
-          glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
-          glDrawCommandsStatesNV(sc->buffer, &sc->offsets[0], &sc->sizes[0], &sc->states[0], &sc->fbos[0],
-                                 (uint32_t)sc->sizes.size());
-        }
-        else
-        {
-          numTerminated++;
-        }
-      }
-
-      if(numTerminated == m_numThreads)
-      {
-        break;
-      }
-      std::this_thread::yield();
+  // dispatch drawing here
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  for(ShadeCommand* sc : m_chunkCommands)
+  {
+    if(!sc->sizes.empty())
+    {
+      m_numEnqueues++;
+      glDrawCommandsStatesNV(sc->buffer, &sc->offsets[0], &sc->sizes[0], &sc->states[0], &sc->fbos[0],
+                             (uint32_t)sc->sizes.size());
     }
   }
 
@@ -24,10 +24,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <mutex>
-#include <queue>
 
 #include "renderer.hpp"
 #include "resources_vk.hpp"
+#include <nvh/jobsystem.hpp>
 #include <nvh/nvprint.hpp>
 #include <nvpwindow.hpp>
 
@@ -101,23 +101,21 @@ private:
   };
 
 
+  // per-worker state of the job system, accessed without locking
   struct ThreadJob
   {
-    RendererThreadedVK* renderer;
-    int                 index;
-
     nvvk::RingCommandPool m_pool;
 
-    int                     m_frame;
-    std::condition_variable m_hasWorkCond;
-    std::mutex              m_hasWorkMutex;
-    volatile int            m_hasWork;
-
     size_t                     m_scIdx;
     std::vector<ShadeCommand*> m_scs;
+    ShadeCommand*              m_batched;
 
 
-    void resetFrame() { m_scIdx = 0; }
+    void resetFrame()
+    {
+      m_scIdx   = 0;
+      m_batched = nullptr;
+    }
 
     ShadeCommand* getFrameCommand()
     {
@@ -149,60 +147,21 @@ private:
   int       m_frame;
   uint32_t  m_cycleCurrent;
 
-  ThreadJob* m_jobs;
-
-  volatile int    m_ready;
-  volatile int    m_stopThreads;
-  volatile size_t m_numCurItems;
-
-  std::condition_variable m_readyCond;
-  std::mutex              m_readyMutex;
-
-  size_t                    m_numEnqueues;
-  std::queue<ShadeCommand*> m_drawQueue;
+  nvh::JobSystem m_jobSystem;
+  ThreadJob*     m_jobs;
 
-  std::mutex              m_workMutex;
-  std::mutex              m_drawMutex;
-  std::condition_variable m_drawMutexCondition;
+  // non-batched main submit: one command per workingSet chunk, executed in list order
+  // as soon as all chunks before it are done
+  std::vector<ShadeCommand*> m_chunkCommands;
+  size_t                     m_chunkNext;
+  VkCommandBuffer            m_primary;
 
-  VkCommandBuffer m_primary;
+  size_t     m_numEnqueues;
+  std::mutex m_drawMutex;
 
-  static void threadMaster(void* arg)
-  {
-    ThreadJob* job = (ThreadJob*)arg;
-    job->renderer->RunThread(job->index);
-  }
-
-  bool getWork_ts(size_t& start, size_t& num)
-  {
-    std::lock_guard<std::mutex> lock(m_workMutex);
-    bool                        hasWork = false;
+  void RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex);
 
-    const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
-
-    if(m_numCurItems < total)
-    {
-      size_t batch = std::min(total - m_numCurItems, chunkSize);
-      start        = m_numCurItems;
-      num          = batch;
-      m_numCurItems += batch;
-      hasWork = true;
-    }
-    else
-    {
-      hasWork = false;
-      start   = 0;
-      num     = 0;
-    }
-
-    return hasWork;
-  }
-
-  void         RunThread(int index);
-  unsigned int RunThreadFrame(ShadeType shadetype, ThreadJob& job);
-
-  void enqueueShadeCommand_ts(ShadeCommand* sc);
+  void executeChunks_ts(size_t chunkIndex, ShadeCommand* sc);
   void submitShadeCommand_ts(ShadeCommand* sc);
 
   template <ShadeType shadetype, bool sorted>
@@ -434,22 +393,17 @@ void RendererThreadedVK::init(const CadScene* NV_RESTRICT scene, Resources* reso
   m_resources  = (ResourcesVK*)resources;
   m_numThreads = config.threads;
 
-  // make jobs
-  m_ready       = 0;
-  m_jobs        = new ThreadJob[m_numThreads];
-  m_stopThreads = 0;
+  // the thread calling draw records as well
+  m_jobSystem.init(uint32_t(std::max(m_numThreads, 1) - 1));
+  m_jobs = new ThreadJob[m_jobSystem.getNumSlots()];
 
-  for(int i = 0; i < m_numThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
     ThreadJob& job = m_jobs[i];
-    job.index      = i;
-    job.renderer   = this;
-    job.m_hasWork  = -1;
-    job.m_frame    = 0;
+    job.m_scIdx    = 0;
+    job.m_batched  = nullptr;
 
     job.m_pool.init(res->m_device, res->m_context->m_queueGCT);
-
-    s_threadpool.activateJob(i, threadMaster, &m_jobs[i]);
   }
 
   m_frame = 0;
@@ -457,31 +411,7 @@ void RendererThreadedVK::init(const CadScene* NV_RESTRICT scene, Resources* reso
 
 void RendererThreadedVK::deinit()
 {
-  m_stopThreads = 1;
-  m_ready       = 0;
-
-  NV_BARRIER();
-  for(int i = 0; i < m_numThreads; i++)
-  {
-    std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-    m_jobs[i].m_hasWork = m_frame;
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
-  m_drawMutexCondition.notify_all();
-
-  std::this_thread::yield();
-
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    while(m_ready < m_numThreads)
-    {
-      m_readyCond.wait(lock);
-    }
-  }
-
-  NV_BARRIER();
-
-  for(int i = 0; i < m_numThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
     for(size_t s = 0; s < m_jobs[i].m_scs.size(); s++)
     {
@@ -492,15 +422,11 @@ void RendererThreadedVK::deinit()
 
   delete[] m_jobs;
 
-  m_drawItems.clear();
-}
-
-void RendererThreadedVK::enqueueShadeCommand_ts(ShadeCommand* sc)
-{
-  std::unique_lock<std::mutex> lock(m_drawMutex);
+  // workers are idle outside of draw
+  m_jobSystem.deinit();
 
-  m_drawQueue.push(sc);
-  m_drawMutexCondition.notify_one();
+  m_drawItems.clear();
+  m_chunkCommands.clear();
 }
 
 
@@ -519,146 +445,50 @@ void RendererThreadedVK::submitShadeCommand_ts(ShadeCommand* sc)
   sc->cmdbuffers.clear();
 }
 
-unsigned int RendererThreadedVK::RunThreadFrame(ShadeType shadetype, ThreadJob& job)
+void RendererThreadedVK::executeChunks_ts(size_t chunkIndex, ShadeCommand* sc)
 {
-  unsigned int dispatches = 0;
-
-  bool   first = true;
-  size_t tnum  = 0;
-  size_t begin = 0;
-  size_t num   = 0;
+  // whoever completes the next chunk in list order appends it and all
+  // consecutive finished ones to the primary, so the primary is built
+  // while the remaining chunks are still being recorded
+  std::lock_guard<std::mutex> lock(m_drawMutex);
 
-  size_t offset = 0;
+  m_chunkCommands[chunkIndex] = sc;
+  while(m_chunkNext < m_chunkCommands.size() && m_chunkCommands[m_chunkNext])
+  {
+    ShadeCommand* next = m_chunkCommands[m_chunkNext++];
+    m_numEnqueues++;
+    vkCmdExecuteCommands(m_primary, (uint32_t)next->cmdbuffers.size(), next->cmdbuffers.data());
+    next->cmdbuffers.clear();
+  }
+}
 
-  job.resetFrame();
-  job.m_pool.setCycle(m_cycleCurrent);
+void RendererThreadedVK::RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex)
+{
+  ThreadJob& job = m_jobs[workerIndex];
 
   if(m_batchedSubmit)
   {
     // batched helps performance when workersubmit is chosen, as we make less vkQueueSubmits
-    ShadeCommand* sc = job.getFrameCommand();
-    while(getWork_ts(begin, num))
+    if(!job.m_batched)
     {
-      GenerateCmdBuffers(*sc, shadetype, job.m_pool, &m_drawItems[begin], num, m_resources);
-      tnum += num;
-    }
-    if(!sc->cmdbuffers.empty())
-    {
-      if(m_mode == MODE_CMD_MAINSUBMIT)
-      {
-        enqueueShadeCommand_ts(sc);
-      }
-      else if(m_mode == MODE_CMD_WORKERSUBMIT)
-      {
-        submitShadeCommand_ts(sc);
-      }
-      dispatches += 1;
+      job.m_batched = job.getFrameCommand();
     }
+    GenerateCmdBuffers(*job.m_batched, m_shade, job.m_pool, &m_drawItems[begin], end - begin, m_resources);
   }
   else
   {
-    while(getWork_ts(begin, num))
-    {
-      ShadeCommand* sc = job.getFrameCommand();
-      GenerateCmdBuffers(*sc, shadetype, job.m_pool, &m_drawItems[begin], num, m_resources);
-
-      if(!sc->cmdbuffers.empty())
-      {
-        if(m_mode == MODE_CMD_MAINSUBMIT)
-        {
-          enqueueShadeCommand_ts(sc);
-        }
-        else if(m_mode == MODE_CMD_WORKERSUBMIT)
-        {
-          submitShadeCommand_ts(sc);
-        }
-        dispatches += 1;
-      }
-      tnum += num;
-    }
-  }
-
-  // NULL signals we are done
-  enqueueShadeCommand_ts(NULL);
-
-  return dispatches;
-}
-
-void RendererThreadedVK::RunThread(int tid)
-{
-  ThreadJob& job = m_jobs[tid];
-  ShadeType  shadetype;
-
-  double timeWork    = 0;
-  double timeFrame   = 0;
-  int    timerFrames = 0;
-  size_t dispatches  = 0;
-
-  double timePrint = NVPSystem::getTime();
-
-  while(!m_stopThreads)
-  {
-    //NV_BARRIER();
-
-    double beginFrame = NVPSystem::getTime();
-    timeFrame -= NVPSystem::getTime();
-    {
-      std::unique_lock<std::mutex> lock(job.m_hasWorkMutex);
-      while(job.m_hasWork != job.m_frame)
-      {
-        job.m_hasWorkCond.wait(lock);
-      }
-
-      shadetype = m_shade;
-    }
+    ShadeCommand* sc = job.getFrameCommand();
+    GenerateCmdBuffers(*sc, m_shade, job.m_pool, &m_drawItems[begin], end - begin, m_resources);
 
-    if(m_stopThreads)
+    if(m_mode == MODE_CMD_MAINSUBMIT)
     {
-      break;
+      executeChunks_ts(begin / m_workingSet, sc);
     }
-
-    double beginWork = NVPSystem::getTime();
-    timeWork -= NVPSystem::getTime();
-
-    dispatches += RunThreadFrame(shadetype, job);
-
-    job.m_frame++;
-
-    timeWork += NVPSystem::getTime();
-
-    double currentTime = NVPSystem::getTime();
-    timeFrame += currentTime;
-
-    timerFrames++;
-
-    if(timerFrames && (currentTime - timePrint) > 2.0)
+    else if(m_mode == MODE_CMD_WORKERSUBMIT)
     {
-      timeFrame /= double(timerFrames);
-      timeWork /= double(timerFrames);
-
-      timeFrame *= 1000000.0;
-      timeWork *= 1000000.0;
-
-      timePrint = currentTime;
-
-      float avgdispatch = float(double(dispatches) / double(timerFrames));
-
-#if PRINT_TIMER_STATS
-      LOGI("thread %d: work %6d [us] dispatches %5.1f\n", tid, uint32_t(timeWork), avgdispatch);
-#endif
-      timeFrame = 0;
-      timeWork  = 0;
-
-      timerFrames = 0;
-      dispatches  = 0;
+      submitShadeCommand_ts(sc);
     }
   }
-
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    m_ready++;
-    m_readyCond.notify_all();
-  }
 }
 
 void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global)
@@ -690,76 +520,56 @@ void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resour
   }
 
   m_batchedSubmit    = global.batchedSubmit;
-  m_workingSet       = global.workingSet;
+  m_workingSet       = std::max(global.workingSet, 1);
   m_shade            = shadetype;
-  m_numCurItems      = 0;
   m_numEnqueues      = 0;
   m_cycleCurrent     = res->m_ringFences.getCycleIndex();
 
-  // generate cmdbuffers in parallel
-
-  NV_BARRIER();
-
-  // start to dispatch threads
-  for(int i = 0; i < m_numThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
-    {
-      std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-      m_jobs[i].m_hasWork = m_frame;
-    }
-    m_jobs[i].m_hasWorkCond.notify_one();
+    m_jobs[i].resetFrame();
+    m_jobs[i].m_pool.setCycle(m_cycleCurrent);
   }
-
-  // dequeue drawing here
+  m_chunkCommands.assign((m_drawItems.size() + m_workingSet - 1) / m_workingSet, nullptr);
+  m_chunkNext = 0;
+  m_primary   = primary;
+
+  // generate cmdbuffers in parallel, idle workers steal chunks of workingSet drawitems
+  // from the busy ones, this thread records as well until all are done
+
+  m_jobSystem.parallelFor(
+      0, m_drawItems.size(),
+      [&](size_t begin, size_t end, uint32_t workerIndex) {
+        // recorded per thread, shows up in the profiler stats
+        nvh::Profiler::Section section(res->m_profilerVK, "Chunk");
+        RunThreadChunk(begin, end, workerIndex);
+      },
+      m_workingSet);
+
+  // batched commands collect all chunks of a thread, so they can only be handed out now
+  if(m_batchedSubmit)
   {
-    int numTerminated = 0;
-    while(true)
+    for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
     {
-      bool          hadEntry = false;
-      ShadeCommand* sc       = NULL;
-      {
-        std::unique_lock<std::mutex> lock(m_drawMutex);
-        if(m_drawQueue.empty())
-        {
-          m_drawMutexCondition.wait(lock);
-        }
-        if(!m_drawQueue.empty())
-        {
-
-          sc = m_drawQueue.front();
-          m_drawQueue.pop();
-
-          hadEntry = true;
-        }
-      }
+      ShadeCommand* sc = m_jobs[i].m_batched;
+      if(!sc || sc->cmdbuffers.empty())
+        continue;
 
-      if(hadEntry)
+      m_numEnqueues++;
+      if(m_mode == MODE_CMD_MAINSUBMIT)
       {
-        if(sc)
-        {
-          assert(m_mode == MODE_CMD_MAINSUBMIT);
-          m_numEnqueues++;
-          vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
-          sc->cmdbuffers.clear();
-        }
-        else
-        {
-          numTerminated++;
-        }
+        vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+        sc->cmdbuffers.clear();
       }
-
-      if(numTerminated == m_numThreads)
+      else
       {
-        break;
+        submitShadeCommand_ts(sc);
       }
-      std::this_thread::yield();
     }
   }
 
   m_frame++;
 
-  NV_BARRIER();
-
   if(m_mode == MODE_CMD_MAINSUBMIT)
   {
     vkCmdEndRenderPass(primary);
@@ -155,14 +155,24 @@ bool ResourcesGL::initPrograms(const std::string& path, const std::string& prepe
 
 void ResourcesGL::reloadPrograms(const std::string& prepend)
 {
-  m_progManager.m_prepend = prepend;
+  std::string fullPrepend = prepend;
   if(m_cmdlist)
   {
-    m_progManager.m_prepend += std::string(
+    fullPrepend += std::string(
         "#extension GL_NV_gpu_shader5 : require\n#extension GL_NV_command_list : require \nlayout(commandBindableNV) "
         "uniform;\n");
   }
-  m_progManager.reloadPrograms();
+
+  // with the same defines, only the programs whose files changed need to be compiled again
+  if(m_progManager.m_prepend == fullPrepend)
+  {
+    m_progManager.reloadChangedPrograms();
+  }
+  else
+  {
+    m_progManager.m_prepend = fullPrepend;
+    m_progManager.reloadPrograms();
+  }
   updatedPrograms();
 }
 
@@ -30,9 +30,13 @@
 // prior implementation include, supports following options
 //
 // CSF_SUPPORT_ZLIB         0/1 (uses zlib)
+// CSF_SUPPORT_ZSTD         0/1 (uses zstd, for .csfz)
 // CSF_SUPPORT_GLTF2        0/1 (uses cgltf)
 // CSF_SUPPORT_FILEMAPPING  0/1 (default uses nvh)
 // specify CSF_FILEMAPPING_READTYPE, otherwise defaults to nvh::FileReadMapping
+// CSF_FILEMAPPING_ADVISE   0/1 if CSF_FILEMAPPING_READTYPE provides
+//                          advise(offset, size, nvh::FileMapping::Advice),
+//                          default 1 if nvh::FileReadMapping is used
 
 extern "C" {
 
@@ -166,6 +170,26 @@ typedef struct _CSFLoaderConfig
   // (only relevant if CSF_SUPPORT_GLTF2 was enabled, otherwise
   // ignored)
   int gltfFindUniqueGeometries;
+
+  // number of threads used for loading .csf and .csf.gz files
+  // default = 0
+  // 0 or 1: all work is done serially on the calling thread
+  // > 1: offset fixup, geometry channel setup and node fixup
+  //      are split into batches processed by a pool of worker threads.
+  //      .csf.gz files are inflated on a dedicated thread
+  //      while the already available data is being parsed.
+  // < 0: uses std::thread::hardware_concurrency()
+  int numThreads;
+
+  // restricts which geometries of a .csfz file have their data
+  // decoded at load time to [geometryFrom, geometryFrom + geometryNum).
+  // The other geometries keep their counts, but all their data pointers
+  // are null until decoded via CSFile_loadGeometries.
+  // default = 0, 0 (geometryNum == 0 decodes all)
+  // (only relevant if CSF_SUPPORT_ZSTD was enabled, otherwise
+  // ignored)
+  int geometryFrom;
+  int geometryNum;
 } CSFLoaderConfig;
 
 typedef unsigned long long CSFoffset;
@@ -589,10 +613,15 @@ CSFAPI void* CSFileMemory_alloc(CSFileMemoryPTR mem, size_t sz, const void* fill
 CSFAPI void* CSFileMemory_allocPartial(CSFileMemoryPTR mem, size_t sz, size_t szPartial, const void* fillPartial);
 // all allocations within will be freed
 CSFAPI void CSFileMemory_delete(CSFileMemoryPTR mem);
+// returns 1 if the loaded csf data lives within a file mapping (secondariesReadOnly
+// with a raw .csf file), 0 if it was loaded or decoded into memory
+CSFAPI int CSFileMemory_isFileMapped(CSFileMemoryPTR mem);
 
 // The data pointed to is modified, therefore the raw load operation can be executed only once.
 // It must be preserved for as long as the csf and its internals are accessed
 CSFAPI int CSFile_loadRaw(CSFile** outcsf, size_t sz, void* data);
+// same as above, config can be null, uses config->numThreads
+CSFAPI int CSFile_loadRawCfg(CSFile** outcsf, size_t sz, void* data, const CSFLoaderConfig* config);
 
 // All allocations are done within the provided file memory.
 // It must be preserved for as long as the csf and its internals are accessed
@@ -637,13 +666,135 @@ CSFAPI const CSFBytePacket* CSFile_getMaterialBytePacket(const CSFile* csf, int
 
 CSFAPI int CSFile_transform(CSFile* csf);  // requires unique nodes
 
-// can support gltf/.gz if appropraite CSF_SUPPORT was set
+// can support gltf/.gz/.csfz if appropraite CSF_SUPPORT was set
 CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 CSFAPI int CSFile_saveExt(CSFile* csf, const char* filename);
 
+// .csfz files store the data of every geometry in an independent zstd frame.
+// Decodes the geometries within [geometryFrom, geometryFrom + geometryNum)
+// that were not decoded at load time (see CSFLoaderConfig::geometryFrom),
+// in parallel according to CSFLoaderConfig::numThreads.
+// mem must be the one used for loading the csf. Calls must not overlap
+// in their geometry ranges.
+CSFAPI int CSFile_loadGeometries(CSFile* csf, CSFileMemoryPTR mem, int geometryFrom, int geometryNum);
+
 CSFAPI void CSFMatrix_identity(float*);
+
+typedef enum _CSFAdvice
+{
+  // data will be accessed soon, start reading it in
+  CSFADVICE_WILLNEED,
+  // data is not needed for now, can leave the working set
+  CSFADVICE_DONTNEED,
+} CSFAdvice;
+
+// Only has an effect if the csf was loaded with secondariesReadOnly (requires
+// CSF_SUPPORT_FILEMAPPING), in which case all geometry data is accessed directly
+// within the file mapping and faulted in on demand.
+// Hints the OS which geometries' data is accessed next, or no longer needed.
+// returns CADSCENEFILE_ERROR_OPERATION if there is no file mapping
+CSFAPI int CSFile_adviseGeometries(const CSFile* csf, CSFileMemoryPTR mem, int geometryFrom, int geometryNum, CSFAdvice advice);
 };
 
+//////////////////////////////////////////////////////////////////////////
+// Typed views on geometry data. They point to where the data lives after
+// loading, which is the file mapping when secondariesReadOnly was used,
+// so no copies are made.
+
+template <class T>
+struct CSFSpan
+{
+  T*     data  = nullptr;
+  size_t count = 0;
+
+  CSFSpan() {}
+  CSFSpan(T* data_, size_t count_)
+      : data(data_)
+      , count(data_ ? count_ : 0)
+  {
+  }
+
+  T*     begin() const { return data; }
+  T*     end() const { return data + count; }
+  size_t size() const { return count; }
+  size_t sizeInBytes() const { return sizeof(T) * count; }
+  bool   empty() const { return count == 0; }
+  T&     operator[](size_t i) const { return data[i]; }
+};
+
+typedef struct _CSFVector3
+{
+  float x;
+  float y;
+  float z;
+} CSFVector3;
+
+typedef struct _CSFGeometryPartRange
+{
+  // first index within indexSolid
+  int firstIndexSolid;
+  int numIndexSolid;
+  // first index within indexWire
+  int firstIndexWire;
+  int numIndexWire;
+} CSFGeometryPartRange;
+
+inline CSFSpan<const CSFVector3> CSFGeometry_viewPositions(const CSFGeometry* geo)
+{
+  return CSFSpan<const CSFVector3>((const CSFVector3*)geo->vertex, size_t(geo->numVertices));
+}
+
+inline CSFSpan<const CSFVector3> CSFGeometry_viewNormals(const CSFGeometry* geo,
+                                                         CSFGeometryNormalChannel channel = CSFGEOMETRY_NORMALCHANNEL_NORMAL)
+{
+  return CSFSpan<const CSFVector3>((const CSFVector3*)CSFGeometry_getNormalChannel(geo, channel), size_t(geo->numVertices));
+}
+
+inline CSFSpan<const unsigned int> CSFGeometry_viewIndexSolid(const CSFGeometry* geo)
+{
+  return CSFSpan<const unsigned int>(geo->indexSolid, size_t(geo->numIndexSolid));
+}
+
+inline CSFSpan<const unsigned int> CSFGeometry_viewIndexWire(const CSFGeometry* geo)
+{
+  return CSFSpan<const unsigned int>(geo->indexWire, size_t(geo->numIndexWire));
+}
+
+// solid and wire indices as one range, only valid if the file stored
+// indexWire directly after indexSolid (the default for saved files),
+// otherwise empty.
+inline CSFSpan<const unsigned int> CSFGeometry_viewIndexCombined(const CSFGeometry* geo)
+{
+  if(geo->numIndexWire && geo->numIndexSolid && geo->indexWire != geo->indexSolid + geo->numIndexSolid)
+  {
+    return CSFSpan<const unsigned int>();
+  }
+  return CSFSpan<const unsigned int>(geo->numIndexSolid ? geo->indexSolid : geo->indexWire,
+                                     size_t(geo->numIndexSolid + geo->numIndexWire));
+}
+
+inline CSFSpan<const CSFGeometryPart> CSFGeometry_viewParts(const CSFGeometry* geo)
+{
+  return CSFSpan<const CSFGeometryPart>(geo->parts, size_t(geo->numParts));
+}
+
+// ranges must provide geo->numParts entries
+inline void CSFGeometry_getPartRanges(const CSFGeometry* geo, CSFGeometryPartRange* ranges)
+{
+  int offsetSolid = 0;
+  int offsetWire  = 0;
+  for(int p = 0; p < geo->numParts; p++)
+  {
+    ranges[p].firstIndexSolid = offsetSolid;
+    ranges[p].numIndexSolid   = geo->parts[p].numIndexSolid;
+    ranges[p].firstIndexWire  = offsetWire;
+    ranges[p].numIndexWire    = geo->parts[p].numIndexWire;
+
+    offsetSolid += geo->parts[p].numIndexSolid;
+    offsetWire += geo->parts[p].numIndexWire;
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////
 #if defined(CSF_IMPLEMENTATION)
 #include <assert.h>
@@ -655,8 +806,16 @@ CSFAPI void CSFMatrix_identity(float*);
 #if CSF_SUPPORT_ZLIB
 #include <zlib.h>
 #endif
+#if CSF_SUPPORT_ZSTD
+#include <string>
+#include <zstd.h>
+#endif
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 #include <stddef.h>  // for memcpy
 #include <string.h>  // for memcpy
@@ -665,10 +824,14 @@ CSFAPI void CSFMatrix_identity(float*);
 #ifndef CSF_FILEMAPPING_READTYPE
 #include <nvh/filemapping.hpp>
 #define CSF_FILEMAPPING_READTYPE nvh::FileReadMapping
+#ifndef CSF_FILEMAPPING_ADVISE
+#define CSF_FILEMAPPING_ADVISE 1
+#endif
 #endif
 #endif
 
 #define CADSCENEFILE_MAGIC 1567262451
+#define CADSCENEFILE_ZSTD_MAGIC 1567262452
 
 #ifdef WIN32
 #define FREAD(a, b, c, d, e) fread_s(a, b, c, d, e)
@@ -684,6 +847,46 @@ CSFAPI void CSFMatrix_identity(float*);
 #define xfseek(f, pos, encoded) fseek(f, (long)pos, encoded)
 #endif
 
+#if CSF_SUPPORT_ZSTD
+/*
+  .csfz layout
+  ------------
+
+  CSFZHeader
+  zstd frame: csf without geometry data, pointers of all
+              CSFGeometry are null
+  zstd frame per geometry: CSFGeometry followed by its data,
+              the geometry's offsets are relative to the frame start
+  CSFZGeometryBlock * numGeometries
+*/
+
+typedef struct _CSFZHeader
+{
+  int       magic;
+  int       version;
+  int       numGeometries;
+  int       _reserved;
+  CSFoffset skeletonOFFSET;
+  CSFoffset skeletonCompressedSize;
+  CSFoffset skeletonSize;
+  CSFoffset blocksOFFSET;
+} CSFZHeader;
+
+typedef struct _CSFZGeometryBlock
+{
+  CSFoffset offset;
+  CSFoffset compressedSize;
+  CSFoffset size;
+} CSFZGeometryBlock;
+
+struct CSFZContainer
+{
+  std::string                    m_filename;
+  std::vector<CSFZGeometryBlock> m_blocks;
+  std::vector<uint8_t>           m_decoded;
+};
+#endif
+
 struct CSFileMemory_s
 {
   CSFLoaderConfig m_config;
@@ -694,6 +897,9 @@ struct CSFileMemory_s
 #if CSF_SUPPORT_FILEMAPPING
   std::vector<CSF_FILEMAPPING_READTYPE> m_readMappings;
 #endif
+#if CSF_SUPPORT_ZSTD
+  CSFZContainer m_zstd;
+#endif
 
   void* alloc(size_t size, const void* indata = nullptr, size_t indataSize = 0)
   {
@@ -723,6 +929,9 @@ struct CSFileMemory_s
   CSFileMemory_s()
   {
     m_config.secondariesReadOnly = 0;
+    m_config.numThreads          = 0;
+    m_config.geometryFrom        = 0;
+    m_config.geometryNum         = 0;
 #if CSF_SUPPORT_GLTF2
     m_config.gltfFindUniqueGeometries = 1;
 #endif
@@ -756,6 +965,15 @@ CSFAPI void CSFileMemory_delete(CSFileMemoryPTR mem)
   delete mem;
 }
 
+CSFAPI int CSFileMemory_isFileMapped(CSFileMemoryPTR mem)
+{
+#if CSF_SUPPORT_FILEMAPPING
+  return mem->m_readMappings.empty() ? 0 : 1;
+#else
+  return 0;
+#endif
+}
+
 CSFAPI void* CSFileMemory_alloc(CSFileMemoryPTR mem, size_t sz, const void* fill)
 {
   return mem->alloc(sz, fill);
@@ -802,7 +1020,87 @@ static void fixPointer(T*& ptr, CSFoffset offset, void* base)
   }
 }
 
-static void CSFile_fixSecondaryPointers(CSFile* csf, void* base)
+static int CSFile_getNumThreads(const CSFLoaderConfig* config)
+{
+  if(!config || config->numThreads == 0)
+  {
+    return 1;
+  }
+  if(config->numThreads < 0)
+  {
+    return std::max(1, int(std::thread::hardware_concurrency()));
+  }
+  return config->numThreads;
+}
+
+// Splits [0,numItems) into batches of batchSize items that are
+// processed by numThreads threads (including the calling one).
+// fn(begin, end) must be safe to call concurrently for disjoint ranges.
+template <typename T>
+static void CSFile_parallelBatches(int numThreads, size_t numItems, size_t batchSize, const T& fn)
+{
+  size_t numBatches = (numItems + batchSize - 1) / batchSize;
+  if(numThreads <= 1 || numBatches <= 1)
+  {
+    if(numItems)
+    {
+      fn(size_t(0), numItems);
+    }
+    return;
+  }
+
+  numThreads = int(std::min(size_t(numThreads), numBatches));
+
+  std::atomic<size_t> nextBatch(0);
+  auto                worker = [&]() {
+    size_t batch;
+    while((batch = nextBatch.fetch_add(1, std::memory_order_relaxed)) < numBatches)
+    {
+      size_t begin = batch * batchSize;
+      fn(begin, std::min(begin + batchSize, numItems));
+    }
+  };
+
+  std::vector<std::thread> threads(numThreads - 1);
+  for(size_t t = 0; t < threads.size(); t++)
+  {
+    threads[t] = std::thread(worker);
+  }
+  worker();
+  for(size_t t = 0; t < threads.size(); t++)
+  {
+    threads[t].join();
+  }
+}
+
+enum
+{
+  CSF_LOADER_BATCH_POINTERS   = 1024 * 64,
+  CSF_LOADER_BATCH_GEOMETRIES = 1024 * 4,
+  CSF_LOADER_BATCH_NODES      = 1024 * 4,
+};
+
+static void CSFGeometry_fixPointers(CSFGeometry& geo, void* base)
+{
+  fixPointer(geo.vertex, geo.vertexOFFSET, base);
+  fixPointer(geo.normal, geo.normalOFFSET, base);
+  fixPointer(geo.indexSolid, geo.indexSolidOFFSET, base);
+  fixPointer(geo.indexWire, geo.indexWireOFFSET, base);
+  fixPointer(geo.tex, geo.texOFFSET, base);
+  fixPointer(geo.parts, geo.partsOFFSET, base);
+  fixPointer(geo.auxStorageOrder, geo.auxStorageOrderOFFSET, base);
+  fixPointer(geo.aux, geo.auxOFFSET, base);
+  fixPointer(geo.perpart, geo.perpartOFFSET, base);
+  fixPointer(geo.perpartStorageOrder, geo.perpartStorageOrderOFFSET, base);
+}
+
+static void CSFNode_fixPointers(CSFNode& node, void* base)
+{
+  fixPointer(node.children, node.childrenOFFSET, base);
+  fixPointer(node.parts, node.partsOFFSET, base);
+}
+
+static void CSFile_fixSecondaryPointers(CSFile* csf, void* base, int numThreads = 1)
 {
   // setup pointers
   for(int m = 0; m < csf->numMaterials; m++)
@@ -810,26 +1108,18 @@ static void CSFile_fixSecondaryPointers(CSFile* csf, void* base)
     CSFMaterial& material = csf->materials[m];
     fixPointer(material.bytes, material.bytesOFFSET, base);
   }
-  for(int g = 0; g < csf->numGeometries; g++)
-  {
-    CSFGeometry& geo = csf->geometries[g];
-    fixPointer(geo.vertex, geo.vertexOFFSET, base);
-    fixPointer(geo.normal, geo.normalOFFSET, base);
-    fixPointer(geo.indexSolid, geo.indexSolidOFFSET, base);
-    fixPointer(geo.indexWire, geo.indexWireOFFSET, base);
-    fixPointer(geo.tex, geo.texOFFSET, base);
-    fixPointer(geo.parts, geo.partsOFFSET, base);
-    fixPointer(geo.auxStorageOrder, geo.auxStorageOrderOFFSET, base);
-    fixPointer(geo.aux, geo.auxOFFSET, base);
-    fixPointer(geo.perpart, geo.perpartOFFSET, base);
-    fixPointer(geo.perpartStorageOrder, geo.perpartStorageOrderOFFSET, base);
-  }
-  for(int n = 0; n < csf->numNodes; n++)
-  {
-    CSFNode& node = csf->nodes[n];
-    fixPointer(node.children, node.childrenOFFSET, base);
-    fixPointer(node.parts, node.partsOFFSET, base);
-  }
+  CSFile_parallelBatches(numThreads, size_t(csf->numGeometries), CSF_LOADER_BATCH_GEOMETRIES, [&](size_t begin, size_t end) {
+    for(size_t g = begin; g < end; g++)
+    {
+      CSFGeometry_fixPointers(csf->geometries[g], base);
+    }
+  });
+  CSFile_parallelBatches(numThreads, size_t(csf->numNodes), CSF_LOADER_BATCH_NODES, [&](size_t begin, size_t end) {
+    for(size_t n = begin; n < end; n++)
+    {
+      CSFNode_fixPointers(csf->nodes[n], base);
+    }
+  });
   if(CSFile_getGeometryMetas(csf))
   {
     for(int g = 0; g < csf->numGeometries; g++)
@@ -853,7 +1143,42 @@ static void CSFile_fixSecondaryPointers(CSFile* csf, void* base)
   }
 }
 
-CSFAPI int CSFile_loadRaw(CSFile** outcsf, size_t size, void* dataraw)
+// applies the version dependent fixups to a range of geometries,
+// pointers must have been resolved already
+static void CSFile_fixupGeometries(CSFile* csf, size_t begin, size_t end)
+{
+  for(size_t g = begin; g < end; g++)
+  {
+    CSFGeometry& geo = csf->geometries[g];
+    if(csf->version < CADSCENEFILE_VERSION_GEOMETRYCHANNELS)
+    {
+      CSFGeometry_setupDefaultChannels(&geo);
+    }
+    memset(geo._deprecated, 0, sizeof(geo._deprecated));
+    for(int p = 0; p < geo.numParts; p++)
+    {
+      geo.parts[p]._deprecated = 0;
+    }
+  }
+}
+
+// applies the version dependent fixups to a range of nodes,
+// pointers must have been resolved already
+static void CSFile_fixupNodes(CSFile* csf, size_t begin, size_t end)
+{
+  if(csf->version < CADSCENEFILE_VERSION_PARTNODEIDX)
+  {
+    for(size_t i = begin; i < end; i++)
+    {
+      for(int p = 0; p < csf->nodes[i].numParts; p++)
+      {
+        csf->nodes[i].parts[p].nodeIDX = -1;
+      }
+    }
+  }
+}
+
+static int CSFile_loadRawInternal(CSFile** outcsf, size_t size, void* dataraw, int numThreads, bool fixupGeometries)
 {
   char*   data = (char*)dataraw;
   CSFile* csf  = (CSFile*)data;
@@ -876,31 +1201,24 @@ CSFAPI int CSFile_loadRaw(CSFile** outcsf, size_t size, void* dataraw)
   }
 
   csf->pointersOFFSET += (CSFoffset)csf;
-  for(int i = 0; i < csf->numPointers; i++)
-  {
-    CSFoffset* ptr = (CSFoffset*)(data + csf->pointers[i]);
-    *(ptr) += (CSFoffset)csf;
-  }
-
-  if(csf->version < CADSCENEFILE_VERSION_PARTNODEIDX)
-  {
-    for(int i = 0; i < csf->numNodes; i++)
+  // every pointer location is unique, so the table can be processed in any order
+  CSFile_parallelBatches(numThreads, size_t(csf->numPointers), CSF_LOADER_BATCH_POINTERS, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; i++)
     {
-      for(int p = 0; p < csf->nodes[i].numParts; p++)
-      {
-        csf->nodes[i].parts[p].nodeIDX = -1;
-      }
+      CSFoffset* ptr = (CSFoffset*)(data + csf->pointers[i]);
+      *(ptr) += (CSFoffset)csf;
     }
-  }
+  });
 
-  if(csf->version < CADSCENEFILE_VERSION_GEOMETRYCHANNELS)
+  CSFile_parallelBatches(numThreads, size_t(csf->numNodes), CSF_LOADER_BATCH_NODES,
+                         [&](size_t begin, size_t end) { CSFile_fixupNodes(csf, begin, end); });
+
+  if(fixupGeometries)
   {
-    CSFile_setupDefaultChannels(csf);
+    CSFile_parallelBatches(numThreads, size_t(csf->numGeometries), CSF_LOADER_BATCH_GEOMETRIES,
+                           [&](size_t begin, size_t end) { CSFile_fixupGeometries(csf, begin, end); });
   }
 
-  CSFile_clearDeprecated(csf);
-
-
   csf->numPointers = 0;
   csf->pointers    = nullptr;
 
@@ -909,6 +1227,16 @@ CSFAPI int CSFile_loadRaw(CSFile** outcsf, size_t size, void* dataraw)
   return CADSCENEFILE_NOERROR;
 }
 
+CSFAPI int CSFile_loadRawCfg(CSFile** outcsf, size_t size, void* dataraw, const CSFLoaderConfig* config)
+{
+  return CSFile_loadRawInternal(outcsf, size, dataraw, CSFile_getNumThreads(config), true);
+}
+
+CSFAPI int CSFile_loadRaw(CSFile** outcsf, size_t size, void* dataraw)
+{
+  return CSFile_loadRawCfg(outcsf, size, dataraw, nullptr);
+}
+
 #if CSF_SUPPORT_FILEMAPPING
 int CSFile_loadReadOnly(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem)
 {
@@ -945,7 +1273,7 @@ int CSFile_loadReadOnly(CSFile** outcsf, const char* filename, CSFileMemoryPTR m
     CSFile_setupDefaultChannels(csf);
   }
 
-  CSFile_fixSecondaryPointers(csf, const_cast<void*>((const void*)base));
+  CSFile_fixSecondaryPointers(csf, const_cast<void*>((const void*)base), CSFile_getNumThreads(&mem->m_config));
 
   mem->m_readMappings.push_back(std::move(file));
 
@@ -1005,7 +1333,423 @@ CSFAPI int CSFile_load(CSFile** outcsf, const char* filename, CSFileMemoryPTR me
   FREAD(data, size, size, 1, file);
   fclose(file);
 
-  return CSFile_loadRaw(outcsf, size, data);
+  return CSFile_loadRawCfg(outcsf, size, data, &mem->m_config);
+}
+
+#if CSF_SUPPORT_ZLIB
+// Inflates a gz file into a preallocated buffer on a dedicated thread.
+// Consumers wait for the byte range they need, which lets parsing
+// overlap with decompression.
+struct CSFInflateStream
+{
+  gzFile                  m_file      = nullptr;
+  char*                   m_data      = nullptr;
+  size_t                  m_size      = 0;
+  size_t                  m_available = 0;
+  bool                    m_failed    = false;
+  std::mutex              m_mutex;
+  std::condition_variable m_cond;
+  std::thread             m_thread;
+
+  void start(gzFile file, char* data, size_t size, size_t available)
+  {
+    m_file      = file;
+    m_data      = data;
+    m_size      = size;
+    m_available = available;
+    m_thread    = std::thread([this]() { inflate(); });
+  }
+
+  void inflate()
+  {
+    const size_t chunkSize = 1024 * 1024 * 4;
+
+    size_t cur    = m_available;
+    bool   failed = false;
+    while(cur < m_size && !failed)
+    {
+      size_t chunk = std::min(chunkSize, m_size - cur);
+      int    read  = gzread(m_file, m_data + cur, (unsigned int)chunk);
+      if(read <= 0)
+      {
+        failed = true;
+      }
+      else
+      {
+        cur += size_t(read);
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_available = cur;
+        m_failed    = failed;
+      }
+      m_cond.notify_all();
+    }
+  }
+
+  // returns false if the stream ended before the requested range
+  bool waitFor(CSFoffset begin, size_t rangeSize)
+  {
+    size_t end = size_t(begin) + rangeSize;
+    if(end > m_size)
+    {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [&]() { return m_available >= end || m_failed; });
+    return m_available >= end;
+  }
+
+  // returns false if the file was not inflated completely
+  bool finish()
+  {
+    if(m_thread.joinable())
+    {
+      m_thread.join();
+    }
+    return !m_failed && m_available == m_size;
+  }
+};
+
+static int CSFile_loadStreamedGZ(CSFile** outcsf, gzFile filegz, const CSFile& header, size_t size, CSFileMemoryPTR mem)
+{
+  int numThreads = CSFile_getNumThreads(&mem->m_config);
+
+  char*   data = (char*)mem->alloc(size);
+  CSFile* csf  = (CSFile*)data;
+  void*   base = data;
+
+  memcpy(data, &header, sizeof(CSFile));
+
+  CSFInflateStream stream;
+  stream.start(filegz, data, size, sizeof(CSFile));
+
+  // The pointer table is stored at the end of the file, so instead of using it,
+  // pointers are resolved per struct (as in the read-only path) as soon as the
+  // arrays they live in have been inflated. The untouched header provides the
+  // array offsets, as csf's own offsets are overwritten by the pointers.
+  bool valid = true;
+
+  if(csf->version < CADSCENEFILE_VERSION_FILEFLAGS)
+  {
+    csf->fileFlags = csf->fileFlags ? CADSCENEFILE_FLAG_UNIQUENODES : 0;
+  }
+
+  fixPointer(csf->geometries, csf->geometriesOFFSET, base);
+  fixPointer(csf->materials, csf->materialsOFFSET, base);
+  fixPointer(csf->nodes, csf->nodesOFFSET, base);
+  if(csf->version >= CADSCENEFILE_VERSION_META)
+  {
+    fixPointer(csf->nodeMetas, csf->nodeMetasOFFSET, base);
+    fixPointer(csf->geometryMetas, csf->geometryMetasOFFSET, base);
+    fixPointer(csf->fileMeta, csf->fileMetaOFFSET, base);
+  }
+
+  // geometries
+  if(valid && csf->numGeometries)
+  {
+    valid = stream.waitFor(header.geometriesOFFSET, sizeof(CSFGeometry) * csf->numGeometries);
+
+    std::atomic<size_t> partsEnd(0);
+    if(valid)
+    {
+      CSFile_parallelBatches(numThreads, size_t(csf->numGeometries), CSF_LOADER_BATCH_GEOMETRIES, [&](size_t begin, size_t end) {
+        size_t batchEnd = 0;
+        for(size_t g = begin; g < end; g++)
+        {
+          CSFGeometry& geo = csf->geometries[g];
+          if(csf->version < CADSCENEFILE_VERSION_GEOMETRYCHANNELS)
+          {
+            CSFGeometry_setupDefaultChannels(&geo);
+          }
+          if(geo.partsOFFSET)
+          {
+            batchEnd = std::max(batchEnd, size_t(geo.partsOFFSET) + sizeof(CSFGeometryPart) * geo.numParts);
+          }
+          CSFGeometry_fixPointers(geo, base);
+        }
+        size_t prev = partsEnd.load();
+        while(prev < batchEnd && !partsEnd.compare_exchange_weak(prev, batchEnd))
+        {
+        }
+      });
+    }
+
+    // parts are needed for clearing deprecated values
+    valid = valid && stream.waitFor(0, partsEnd.load());
+    if(valid)
+    {
+      CSFile_parallelBatches(numThreads, size_t(csf->numGeometries), CSF_LOADER_BATCH_GEOMETRIES,
+                             [&](size_t begin, size_t end) { CSFile_fixupGeometries(csf, begin, end); });
+    }
+  }
+
+  // materials
+  if(valid && csf->numMaterials)
+  {
+    valid = stream.waitFor(header.materialsOFFSET, sizeof(CSFMaterial) * csf->numMaterials);
+    for(int m = 0; valid && m < csf->numMaterials; m++)
+    {
+      CSFMaterial& material = csf->materials[m];
+      fixPointer(material.bytes, material.bytesOFFSET, base);
+    }
+  }
+
+  // nodes
+  if(valid && csf->numNodes)
+  {
+    valid = stream.waitFor(header.nodesOFFSET, sizeof(CSFNode) * csf->numNodes);
+
+    std::atomic<size_t> nodePartsEnd(0);
+    if(valid)
+    {
+      CSFile_parallelBatches(numThreads, size_t(csf->numNodes), CSF_LOADER_BATCH_NODES, [&](size_t begin, size_t end) {
+        size_t batchEnd = 0;
+        for(size_t n = begin; n < end; n++)
+        {
+          CSFNode& node = csf->nodes[n];
+          if(node.partsOFFSET)
+          {
+            batchEnd = std::max(batchEnd, size_t(node.partsOFFSET) + sizeof(CSFNodePart) * node.numParts);
+          }
+          CSFNode_fixPointers(node, base);
+        }
+        size_t prev = nodePartsEnd.load();
+        while(prev < batchEnd && !nodePartsEnd.compare_exchange_weak(prev, batchEnd))
+        {
+        }
+      });
+    }
+
+    if(valid && csf->version < CADSCENEFILE_VERSION_PARTNODEIDX)
+    {
+      valid = stream.waitFor(0, nodePartsEnd.load());
+      if(valid)
+      {
+        CSFile_parallelBatches(numThreads, size_t(csf->numNodes), CSF_LOADER_BATCH_NODES,
+                               [&](size_t begin, size_t end) { CSFile_fixupNodes(csf, begin, end); });
+      }
+    }
+  }
+
+  // metas
+  if(valid && CSFile_getGeometryMetas(csf))
+  {
+    valid = stream.waitFor(header.geometryMetasOFFSET, sizeof(CSFMeta) * csf->numGeometries);
+    for(int g = 0; valid && g < csf->numGeometries; g++)
+    {
+      CSFMeta& meta = csf->geometryMetas[g];
+      fixPointer(meta.bytes, meta.bytesOFFSET, base);
+    }
+  }
+  if(valid && CSFile_getNodeMetas(csf))
+  {
+    valid = stream.waitFor(header.nodeMetasOFFSET, sizeof(CSFMeta) * csf->numNodes);
+    for(int n = 0; valid && n < csf->numNodes; n++)
+    {
+      CSFMeta& meta = csf->nodeMetas[n];
+      fixPointer(meta.bytes, meta.bytesOFFSET, base);
+    }
+  }
+  if(valid && CSFile_getFileMeta(csf))
+  {
+    valid = stream.waitFor(header.fileMetaOFFSET, sizeof(CSFMeta));
+    if(valid)
+    {
+      CSFMeta& meta = csf->fileMeta[0];
+      fixPointer(meta.bytes, meta.bytesOFFSET, base);
+    }
+  }
+
+  // payloads referenced by the pointers must be complete as well
+  valid = stream.finish() && valid;
+  gzclose(filegz);
+
+  if(!valid)
+  {
+    *outcsf = 0;
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  csf->numPointers = 0;
+  csf->pointers    = nullptr;
+
+  *outcsf = csf;
+
+  return CADSCENEFILE_NOERROR;
+}
+#endif
+
+#if CSF_SUPPORT_ZSTD
+static FILE* CSFile_openRead(const char* filename)
+{
+  FILE* file;
+#ifdef WIN32
+  if(fopen_s(&file, filename, "rb"))
+#else
+  if((file = fopen(filename, "rb")) == nullptr)
+#endif
+  {
+    return nullptr;
+  }
+  return file;
+}
+
+static int CSFile_decodeGeometries(CSFile* csf, CSFileMemoryPTR mem, int geometryFrom, int geometryNum)
+{
+  CSFZContainer& container = mem->m_zstd;
+  if(container.m_blocks.size() != size_t(csf->numGeometries))
+  {
+    return CADSCENEFILE_ERROR_OPERATION;
+  }
+
+  geometryFrom = std::max(0, std::min(geometryFrom, csf->numGeometries));
+  geometryNum  = std::max(0, std::min(geometryNum, csf->numGeometries - geometryFrom));
+  if(!geometryNum)
+  {
+    return CADSCENEFILE_NOERROR;
+  }
+
+  // frames are stored consecutively, read the compressed range in one go
+  const CSFZGeometryBlock& first = container.m_blocks[geometryFrom];
+  const CSFZGeometryBlock& last  = container.m_blocks[geometryFrom + geometryNum - 1];
+  size_t compressedSize          = size_t(last.offset + last.compressedSize - first.offset);
+
+  FILE* file = CSFile_openRead(container.m_filename.c_str());
+  if(!file)
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  std::vector<uint8_t> compressed(compressedSize);
+  xfseek(file, first.offset, SEEK_SET);
+  size_t read = compressedSize ? FREAD(compressed.data(), compressedSize, compressedSize, 1, file) : 1;
+  fclose(file);
+  if(read != 1)
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  std::atomic<int> result(CADSCENEFILE_NOERROR);
+
+  CSFile_parallelBatches(CSFile_getNumThreads(&mem->m_config), size_t(geometryNum), 64, [&](size_t begin, size_t end) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    for(size_t i = begin; i < end; i++)
+    {
+      size_t g = size_t(geometryFrom) + i;
+      if(container.m_decoded[g])
+      {
+        continue;
+      }
+
+      const CSFZGeometryBlock& block = container.m_blocks[g];
+
+      void*  data = mem->alloc(size_t(block.size));
+      size_t size = ZSTD_decompressDCtx(dctx, data, size_t(block.size), compressed.data() + (block.offset - first.offset),
+                                        size_t(block.compressedSize));
+      if(ZSTD_isError(size) || size != block.size || size < sizeof(CSFGeometry))
+      {
+        result = CADSCENEFILE_ERROR_VERSION;
+        continue;
+      }
+
+      // frame starts with the complete geometry, its offsets are relative to the frame
+      CSFGeometry* geo = (CSFGeometry*)data;
+      CSFGeometry_fixPointers(*geo, data);
+      csf->geometries[g]          = *geo;
+      container.m_decoded[g]      = 1;
+    }
+    ZSTD_freeDCtx(dctx);
+  });
+
+  return result;
+}
+
+static int CSFile_loadZSTD(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem)
+{
+  *outcsf = 0;
+
+  FILE* file = CSFile_openRead(filename);
+  if(!file)
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  CSFZHeader header = {0};
+  if(!FREAD(&header, sizeof(header), sizeof(header), 1, file) || header.magic != CADSCENEFILE_ZSTD_MAGIC
+     || header.version < CADSCENEFILE_VERSION_COMPAT || header.version > CADSCENEFILE_VERSION || header.numGeometries < 0)
+  {
+    fclose(file);
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  CSFZContainer& container = mem->m_zstd;
+  container.m_filename     = filename;
+  container.m_blocks.resize(header.numGeometries);
+  container.m_decoded.clear();
+  container.m_decoded.resize(header.numGeometries, 0);
+
+  std::vector<uint8_t> skeletonCompressed(size_t(header.skeletonCompressedSize));
+
+  bool valid = true;
+  xfseek(file, header.skeletonOFFSET, SEEK_SET);
+  valid = valid && FREAD(skeletonCompressed.data(), skeletonCompressed.size(), skeletonCompressed.size(), 1, file);
+  if(header.numGeometries)
+  {
+    size_t blocksSize = sizeof(CSFZGeometryBlock) * header.numGeometries;
+    xfseek(file, header.blocksOFFSET, SEEK_SET);
+    valid = valid && FREAD(container.m_blocks.data(), blocksSize, blocksSize, 1, file);
+  }
+  fclose(file);
+
+  if(!valid)
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  size_t skeletonSize = size_t(header.skeletonSize);
+  void*  skeleton     = mem->alloc(skeletonSize);
+  size_t size         = ZSTD_decompress(skeleton, skeletonSize, skeletonCompressed.data(), skeletonCompressed.size());
+  if(ZSTD_isError(size) || size != skeletonSize)
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  // the skeleton is always stored in the current version and its
+  // geometries have no data yet, so no geometry fixups are required
+  CSFile* csf = nullptr;
+  int     result = CSFile_loadRawInternal(&csf, skeletonSize, skeleton, CSFile_getNumThreads(&mem->m_config), false);
+  if(result != CADSCENEFILE_NOERROR)
+  {
+    return result;
+  }
+  if(csf->numGeometries != header.numGeometries)
+  {
+    return CADSCENEFILE_ERROR_VERSION;
+  }
+
+  int geometryFrom = mem->m_config.geometryFrom;
+  int geometryNum  = mem->m_config.geometryNum ? mem->m_config.geometryNum : csf->numGeometries;
+
+  result = CSFile_decodeGeometries(csf, mem, geometryFrom, geometryNum);
+  if(result != CADSCENEFILE_NOERROR)
+  {
+    return result;
+  }
+
+  *outcsf = csf;
+  return CADSCENEFILE_NOERROR;
+}
+#endif
+
+CSFAPI int CSFile_loadGeometries(CSFile* csf, CSFileMemoryPTR mem, int geometryFrom, int geometryNum)
+{
+#if CSF_SUPPORT_ZSTD
+  return CSFile_decodeGeometries(csf, mem, geometryFrom, geometryNum);
+#else
+  return CADSCENEFILE_ERROR_OPERATION;
+#endif
 }
 
 #if CSF_SUPPORT_GLTF2
@@ -1038,6 +1782,10 @@ CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR
       return CADSCENEFILE_ERROR_VERSION;
     }
 
+    if(CSFile_getNumThreads(&mem->m_config) > 1 && sizeshould >= sizeof(CSFile))
+    {
+      return CSFile_loadStreamedGZ(outcsf, filegz, header, sizeshould, mem);
+    }
 
     gzseek(filegz, 0, SEEK_SET);
     char* data = (char*)CSFileMemory_alloc(mem, sizeshould, 0);
@@ -1049,7 +1797,14 @@ CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR
     }
     gzclose(filegz);
 
-    return CSFile_loadRaw(outcsf, sizeshould, data);
+    return CSFile_loadRawCfg(outcsf, sizeshould, data, &mem->m_config);
+  }
+  else
+#endif
+#if CSF_SUPPORT_ZSTD
+      if(len > 5 && strcmp(filename + len - 5, ".csfz") == 0)
+  {
+    return CSFile_loadZSTD(outcsf, filename, mem);
   }
   else
 #endif
@@ -1073,7 +1828,7 @@ struct OutputFILE
 #ifdef WIN32
     return fopen_s(&m_file, filename, "wb");
 #else
-    return (m_file = fopen(filename, "wb")) ? 1 : 0;
+    return (m_file = fopen(filename, "wb")) ? 0 : 1;
 #endif
   }
   void close() { fclose(m_file); }
@@ -1239,15 +1994,11 @@ struct CSFOffsetMgr
   }
 };
 
+// storeGeometryPayloads = false only dumps the geometry array itself,
+// its pointers are stored as is and not added to the pointer table
 template <class T>
-static int CSFile_saveInternal(const CSFile* csf, const char* filename)
+static void CSFile_storeInternal(const CSFile* csf, T& file, bool storeGeometryPayloads)
 {
-  T file;
-  if(file.open(filename))
-  {
-    return CADSCENEFILE_ERROR_NOFILE;
-  }
-
   CSFOffsetMgr<T> mgr(file);
 
   CSFile dump = {0};
@@ -1263,7 +2014,7 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
   {
     size_t geomOFFSET = mgr.store(offsetof(CSFile, geometriesOFFSET), csf->geometries, sizeof(CSFGeometry) * csf->numGeometries);
 
-    for(int i = 0; i < csf->numGeometries; i++, geomOFFSET += sizeof(CSFGeometry))
+    for(int i = 0; storeGeometryPayloads && i < csf->numGeometries; i++, geomOFFSET += sizeof(CSFGeometry))
     {
       const CSFGeometry* geo = csf->geometries + i;
 
@@ -1390,6 +2141,18 @@ static int CSFile_saveInternal(const CSFile* csf, const char* filename)
   }
 
   mgr.finalize(offsetof(CSFile, numPointers), offsetof(CSFile, pointersOFFSET));
+}
+
+template <class T>
+static int CSFile_saveInternal(const CSFile* csf, const char* filename)
+{
+  T file;
+  if(file.open(filename))
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  CSFile_storeInternal(csf, file, true);
 
   file.close();
 
@@ -1401,6 +2164,145 @@ CSFAPI int CSFile_save(const CSFile* csf, const char* filename)
   return CSFile_saveInternal<OutputFILE>(csf, filename);
 }
 
+#if CSF_SUPPORT_ZSTD
+static void CSFGeometry_clearPointers(CSFGeometry& geo)
+{
+  geo.vertex              = nullptr;
+  geo.normal              = nullptr;
+  geo.tex                 = nullptr;
+  geo.aux                 = nullptr;
+  geo.auxStorageOrder     = nullptr;
+  geo.indexSolid          = nullptr;
+  geo.indexWire           = nullptr;
+  geo.perpartStorageOrder = nullptr;
+  geo.perpart             = nullptr;
+  geo.parts               = nullptr;
+}
+
+// frame content: geometry header with offsets relative to the frame, followed by the data
+static void CSFGeometry_storeBlock(const CSFGeometry* geo, OutputBuf& buf)
+{
+  CSFGeometry header = *geo;
+  CSFGeometry_clearPointers(header);
+  memset(header._deprecated, 0, sizeof(header._deprecated));
+
+  buf.write(&header, sizeof(CSFGeometry));
+
+  auto store = [&](CSFoffset& offset, const void* data, size_t dataSize) {
+    if(data && dataSize)
+    {
+      offset = CSFoffset(buf.m_cur);
+      buf.write(data, dataSize);
+    }
+  };
+
+  if(geo->numVertices)
+  {
+    store(header.vertexOFFSET, geo->vertex, sizeof(float) * 3 * geo->numVertices);
+    store(header.normalOFFSET, geo->normal, sizeof(float) * 3 * geo->numVertices * geo->numNormalChannels);
+    store(header.texOFFSET, geo->tex, sizeof(float) * 2 * geo->numVertices * geo->numTexChannels);
+    store(header.auxOFFSET, geo->aux, sizeof(float) * 4 * geo->numVertices * geo->numAuxChannels);
+  }
+  store(header.auxStorageOrderOFFSET, geo->auxStorageOrder, sizeof(CSFGeometryAuxChannel) * geo->numAuxChannels);
+  store(header.indexSolidOFFSET, geo->indexSolid, sizeof(int) * geo->numIndexSolid);
+  store(header.indexWireOFFSET, geo->indexWire, sizeof(int) * geo->numIndexWire);
+  store(header.perpartStorageOrderOFFSET, geo->perpartStorageOrder, sizeof(CSFGeometryPartChannel) * geo->numPartChannels);
+  if(geo->numPartChannels)
+  {
+    store(header.perpartOFFSET, geo->perpart, CSFGeometry_getPerPartSize(geo));
+  }
+  store(header.partsOFFSET, geo->parts, sizeof(CSFGeometryPart) * geo->numParts);
+
+  buf.seek(0, SEEK_SET);
+  buf.write(&header, sizeof(CSFGeometry));
+  buf.seek(0, SEEK_END);
+}
+
+static int CSFile_saveZSTD(const CSFile* csf, const char* filename)
+{
+  OutputFILE file;
+  if(file.open(filename))
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  const int level = ZSTD_CLEVEL_DEFAULT;
+
+  CSFZHeader header    = {0};
+  header.magic         = CADSCENEFILE_ZSTD_MAGIC;
+  header.version       = CADSCENEFILE_VERSION;
+  header.numGeometries = csf->numGeometries;
+
+  size_t offset = sizeof(CSFZHeader);
+  file.write(&header, sizeof(CSFZHeader));
+
+  std::vector<uint8_t> compressed;
+  auto                 compress = [&](const void* data, size_t dataSize, ZSTD_CCtx* cctx) {
+    compressed.resize(ZSTD_compressBound(dataSize));
+    size_t size = ZSTD_compressCCtx(cctx, compressed.data(), compressed.size(), data, dataSize, level);
+    file.write(compressed.data(), size);
+    offset += size;
+    return CSFoffset(size);
+  };
+
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+
+  // skeleton, geometries without any data
+  {
+    CSFile skeleton = *csf;
+
+    std::vector<CSFGeometry> geometries(csf->geometries, csf->geometries + csf->numGeometries);
+    for(size_t g = 0; g < geometries.size(); g++)
+    {
+      CSFGeometry_clearPointers(geometries[g]);
+      memset(geometries[g]._deprecated, 0, sizeof(geometries[g]._deprecated));
+    }
+    skeleton.geometries = geometries.empty() ? nullptr : geometries.data();
+
+    OutputBuf buf;
+    buf.open(nullptr);
+    CSFile_storeInternal(&skeleton, buf, false);
+
+    header.skeletonOFFSET         = offset;
+    header.skeletonSize           = buf.m_used;
+    header.skeletonCompressedSize = compress(buf.m_data, buf.m_used, cctx);
+    buf.close();
+  }
+
+  // one frame per geometry
+  std::vector<CSFZGeometryBlock> blocks(csf->numGeometries);
+  {
+    OutputBuf buf;
+    buf.open(nullptr);
+    for(int g = 0; g < csf->numGeometries; g++)
+    {
+      buf.m_used = 0;
+      buf.m_cur  = 0;
+      CSFGeometry_storeBlock(csf->geometries + g, buf);
+
+      blocks[g].offset         = offset;
+      blocks[g].size           = buf.m_used;
+      blocks[g].compressedSize = compress(buf.m_data, buf.m_used, cctx);
+    }
+    buf.close();
+  }
+
+  ZSTD_freeCCtx(cctx);
+
+  header.blocksOFFSET = offset;
+  if(!blocks.empty())
+  {
+    file.write(blocks.data(), sizeof(CSFZGeometryBlock) * blocks.size());
+  }
+
+  file.seek(0, SEEK_SET);
+  file.write(&header, sizeof(CSFZHeader));
+  file.close();
+
+  return CADSCENEFILE_NOERROR;
+}
+#endif
+
 CSFAPI int CSFile_saveExt(CSFile* csf, const char* filename)
 {
   size_t len = strlen(filename);
@@ -1410,6 +2312,13 @@ CSFAPI int CSFile_saveExt(CSFile* csf, const char* filename)
     return CSFile_saveInternal<OutputGZ>(csf, filename);
   }
   else
+#endif
+#if CSF_SUPPORT_ZSTD
+      if(len > 5 && strcmp(filename + len - 5, ".csfz") == 0)
+  {
+    return CSFile_saveZSTD(csf, filename);
+  }
+  else
 #endif
   {
     return CSFile_saveInternal<OutputFILE>(csf, filename);
@@ -1653,6 +2562,100 @@ CSFAPI const void* CSFGeometry_getPartChannel(const CSFGeometry* geo, CSFGeometr
 }
 
 
+// calls fn(ptr, size) for every data array of the geometry
+template <class T>
+static void CSFGeometry_visitArrays(const CSFGeometry* geo, const T& fn)
+{
+  if(geo->numVertices)
+  {
+    fn(geo->vertex, sizeof(float) * 3 * geo->numVertices);
+    fn(geo->normal, sizeof(float) * 3 * geo->numVertices * geo->numNormalChannels);
+    fn(geo->tex, sizeof(float) * 2 * geo->numVertices * geo->numTexChannels);
+    fn(geo->aux, sizeof(float) * 4 * geo->numVertices * geo->numAuxChannels);
+  }
+  fn(geo->auxStorageOrder, sizeof(CSFGeometryAuxChannel) * geo->numAuxChannels);
+  fn(geo->indexSolid, sizeof(int) * geo->numIndexSolid);
+  fn(geo->indexWire, sizeof(int) * geo->numIndexWire);
+  fn(geo->perpartStorageOrder, sizeof(CSFGeometryPartChannel) * geo->numPartChannels);
+  if(geo->numPartChannels && geo->perpartStorageOrder)
+  {
+    fn(geo->perpart, CSFGeometry_getPerPartSize(geo));
+  }
+  fn(geo->parts, sizeof(CSFGeometryPart) * geo->numParts);
+}
+
+CSFAPI int CSFile_adviseGeometries(const CSFile* csf, CSFileMemoryPTR mem, int geometryFrom, int geometryNum, CSFAdvice advice)
+{
+#if CSF_SUPPORT_FILEMAPPING && CSF_FILEMAPPING_ADVISE
+  if(mem->m_readMappings.empty())
+  {
+    return CADSCENEFILE_ERROR_OPERATION;
+  }
+
+  geometryFrom = std::max(0, std::min(geometryFrom, csf->numGeometries));
+  geometryNum  = std::max(0, std::min(geometryNum, csf->numGeometries - geometryFrom));
+
+  nvh::FileMapping::Advice mappingAdvice =
+      advice == CSFADVICE_WILLNEED ? nvh::FileMapping::ADVICE_WILLNEED : nvh::FileMapping::ADVICE_DONTNEED;
+
+  for(size_t m = 0; m < mem->m_readMappings.size(); m++)
+  {
+    const CSF_FILEMAPPING_READTYPE& mapping = mem->m_readMappings[m];
+    const uint8_t*                  base    = (const uint8_t*)mapping.data();
+    size_t                          size    = mapping.size();
+
+    // geometry data is typically stored consecutively, so neighboring
+    // geometries are merged into one range
+    size_t rangeBegin = 0;
+    size_t rangeEnd   = 0;
+
+    for(int g = geometryFrom; g < geometryFrom + geometryNum; g++)
+    {
+      size_t begin = ~size_t(0);
+      size_t end   = 0;
+      CSFGeometry_visitArrays(csf->geometries + g, [&](const void* ptr, size_t ptrSize) {
+        const uint8_t* data = (const uint8_t*)ptr;
+        if(data && ptrSize && data >= base && data + ptrSize <= base + size)
+        {
+          begin = std::min(begin, size_t(data - base));
+          end   = std::max(end, size_t(data - base) + ptrSize);
+        }
+      });
+
+      if(begin >= end)
+      {
+        continue;
+      }
+
+      if(rangeEnd > rangeBegin && begin <= rangeEnd && end >= rangeBegin)
+      {
+        rangeBegin = std::min(rangeBegin, begin);
+        rangeEnd   = std::max(rangeEnd, end);
+      }
+      else
+      {
+        if(rangeEnd > rangeBegin)
+        {
+          mapping.advise(rangeBegin, rangeEnd - rangeBegin, mappingAdvice);
+        }
+        rangeBegin = begin;
+        rangeEnd   = end;
+      }
+    }
+
+    if(rangeEnd > rangeBegin)
+    {
+      mapping.advise(rangeBegin, rangeEnd - rangeBegin, mappingAdvice);
+    }
+  }
+
+  return CADSCENEFILE_NOERROR;
+#else
+  return CADSCENEFILE_ERROR_OPERATION;
+#endif
+}
+
+
 #if CSF_SUPPORT_GLTF2
 
 #include "cgltf.h"
@@ -38,12 +38,30 @@
 // include the Zstd, Zlib, and Basis Universal headers respectively, and to
 // enable reading these formats. This will also enable writing Zstd and
 // Basis Universal-compressed formats.
+//
+// KTX2 files can also be decoded from memory or from a memory-mapped file
+// (readFromMemory, readFromMappedFile). In that case, mips are inflated and
+// transcoded in parallel, and ReadSettings::subresource_destination can be
+// used to write the decoded subresources directly into the application's
+// memory (e.g. a mapped staging buffer) instead of the KTXImage:
+// ReadSettings settings;
+// settings.first_mip               = 2;  // skip the two largest mips
+// settings.subresource_destination = [&](uint32_t mip, uint32_t layer, uint32_t face, size_t size) -> char* {
+//   // called from the decoding threads, concurrently for different subresources
+//   return stagingPointer + offsetOf(mip, layer, face);
+// };
+// ErrorWithText maybe_error = image.readFromMappedFile("data/image.ktx2", settings);
+//
+// readFromMappedFile depends on nvh::FileReadMapping and is only available
+// if NV_KTX_SUPPORTS_FILEMAPPING is defined to 1, which nvpro_core does for
+// everything that links it.
 //-----------------------------------------------------------------------------
 
 #ifndef __NV_KTX_H__
 #define __NV_KTX_H__
 
 #include <array>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <optional>
@@ -51,6 +69,10 @@
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+#ifndef NV_KTX_SUPPORTS_FILEMAPPING
+#define NV_KTX_SUPPORTS_FILEMAPPING 0
+#endif
+
 namespace nv_ktx {
 // These functions return an empty std::optional if they succeeded, and a
 // value with text describing the error if they failed.
@@ -70,6 +92,18 @@ using KeyValueData = std::map<std::string, std::vector<char>>;
 // return a string; if it succeeds, it should return {}.
 using CustomExportSizeFuncPtr = ErrorWithText (*)(size_t, size_t, size_t, VkFormat, size_t&);
 
+// Apps can provide the memory that decoded subresources are written to.
+// Functions of this type take in the mip, layer, and face of a subresource
+// and its size in bytes, and return a pointer to at least that many bytes.
+// Returning nullptr stores the subresource in the KTXImage as usual.
+// It is called at most once per subresource, and only for the mips selected
+// by ReadSettings::first_mip and mip_count. For KTX2 data, readFromMemory and
+// readFromMappedFile call it from their worker threads (see
+// ReadSettings::num_threads), concurrently for different subresources, so it
+// must be thread-safe; the memory must not be accessed before the read
+// returns. readFromStream calls it on the calling thread.
+using SubresourceDestinationFunc = std::function<char*(uint32_t mip, uint32_t layer, uint32_t face, size_t size)>;
+
 // Configurable settings for reading files. This is a struct so that it can
 // be extended in the future.
 struct ReadSettings
@@ -92,6 +126,20 @@ struct ReadSettings
   // By default, UASTC is transcoded to BC7 instead of ASTC. Setting this to
   // true will transcode UASTC to ASTC.
   bool device_supports_astc = false;
+  // Only decodes the mips in [first_mip, first_mip + mip_count); the
+  // subresources of other mips are left empty, but num_mips still reports
+  // the number of mips in the file. This allows e.g. streaming in the
+  // smaller mips first.
+  uint32_t first_mip = 0;
+  uint32_t mip_count = UINT32_MAX;
+  // See docs for SubresourceDestinationFunc; may be called concurrently from
+  // worker threads. Subresources written to application memory are left empty
+  // in the KTXImage.
+  SubresourceDestinationFunc subresource_destination;
+  // The number of threads used to decode the mips of KTX2 files read from
+  // memory. 0 uses std::thread::hardware_concurrency(), 1 decodes everything
+  // on the calling thread. Streams are always decoded on the calling thread.
+  uint32_t num_threads = 0;
 };
 
 enum class WriteSupercompressionType
@@ -215,6 +263,20 @@ public:
   ErrorWithText readFromFile(const char*         filename,       // The .ktx or .ktx2 file to read from.
                              const ReadSettings& readSettings);  // Settings for the reader
 
+  // Reads this structure from KTX data in memory. For KTX2 data, the mips
+  // are decoded in parallel, and uncompressed data is copied directly from
+  // the input to the subresources. The memory must stay valid during the call.
+  ErrorWithText readFromMemory(const void*         input,          // The start of the KTX data
+                               size_t              inputSize,      // The size of the KTX data in bytes
+                               const ReadSettings& readSettings);  // Settings for the reader
+
+#if NV_KTX_SUPPORTS_FILEMAPPING
+  // Wrapper for readFromMemory for a filename, mapping the file into memory
+  // instead of reading it.
+  ErrorWithText readFromMappedFile(const char*         filename,       // The .ktx or .ktx2 file to read from.
+                                   const ReadSettings& readSettings);  // Settings for the reader
+#endif
+
   // Writes this structure in KTX2 format to a stream.
   ErrorWithText writeKTX2Stream(std::ostream&        output,  // The output stream, at the point to start writing
                                 const WriteSettings& writeSettings);  // Settings for the writer
@@ -283,7 +345,22 @@ private:
   // Private functions used by readFromStream after it determines whether the
   // stream is a KTX1 or KTX2 stream.
   ErrorWithText readFromKTX1Stream(std::istream& input, const ReadSettings& readSettings);
-  ErrorWithText readFromKTX2Stream(std::istream& input, const ReadSettings& readSettings);
+  // If inputMemory is not nullptr, the stream reads from inputMemory, which
+  // holds inputMemorySize bytes starting with the KTX2 identifier, and the
+  // mips are decoded from inputMemory directly.
+  ErrorWithText readFromKTX2Stream(std::istream&       input,
+                                   const ReadSettings& readSettings,
+                                   const char*         inputMemory     = nullptr,
+                                   size_t              inputMemorySize = 0);
+
+  // Returns where to write a subresource of the given size: the memory given
+  // by ReadSettings::subresource_destination, or the resized subresource.
+  ErrorWithText getSubresourceDestination(const ReadSettings& readSettings,
+                                          uint32_t            mip,
+                                          uint32_t            layer,
+                                          uint32_t            face,
+                                          size_t              size,
+                                          char*&              destination);
 
   // Whether the loaded file was a KTX1 (1) or KTX2 (2) file.
   uint32_t read_ktx_version = 1;
@@ -4,10 +4,15 @@
 #include <array>
 #include <atomic>
 #include <cassert>  // Some functions produce assertion errors to assist with debugging when NDEBUG is false.
+#include <cstring>
 #include <fstream>
 #include <mutex>
 #include <sstream>
+#include <thread>
 #include <vulkan/vulkan.h>
+#if NV_KTX_SUPPORTS_FILEMAPPING
+#include <nvh/filemapping.hpp>
+#endif
 #ifdef NVP_SUPPORTS_ZSTD
 #include <zstd.h>
 #endif
@@ -145,6 +150,35 @@ inline uint32_t KTXImage::getKTXVersion() const
     return unwrap_error_tmp;                                                                                           \
   }
 
+inline ErrorWithText KTXImage::getSubresourceDestination(const ReadSettings& readSettings,
+                                                         uint32_t            mip,
+                                                         uint32_t            layer,
+                                                         uint32_t            face,
+                                                         size_t              size,
+                                                         char*&              destination)
+{
+  destination = nullptr;
+  if(readSettings.subresource_destination)
+  {
+    destination = readSettings.subresource_destination(mip, layer, face, size);
+  }
+  if(destination == nullptr)
+  {
+    std::vector<char>& subresource_data = subresource(mip, layer, face);
+    UNWRAP_ERROR(ResizeVectorOrError(subresource_data, size));
+    destination = subresource_data.data();
+  }
+  return {};
+}
+
+// Computes the range of mips [firstMip, endMip) to decode from a file with
+// numMips mips, following ReadSettings::first_mip and mip_count.
+inline void GetMipReadRange(const ReadSettings& readSettings, uint32_t numMips, uint32_t& firstMip, uint32_t& endMip)
+{
+  firstMip = std::min(readSettings.first_mip, numMips);
+  endMip   = firstMip + std::min(readSettings.mip_count, numMips - firstMip);
+}
+
 inline size_t RoundUp(size_t value, size_t multiplier)
 {
   const size_t mod = value % multiplier;
@@ -1212,7 +1246,13 @@ inline ErrorWithText KTXImage::readFromKTX1Stream(std::istream& input, const Rea
   // Allocate table of subresources.
   UNWRAP_ERROR(allocate(num_mips, num_layers_possibly_0, num_faces));
 
-  for(uint32_t mip = 0; mip < header.numberOfMipmapLevels; mip++)
+  // Mips are stored from largest to smallest, so we can stop after the last
+  // mip to decode, and skip over the ones before the first.
+  uint32_t firstMip = 0;
+  uint32_t endMip   = 0;
+  GetMipReadRange(readSettings, header.numberOfMipmapLevels, firstMip, endMip);
+
+  for(uint32_t mip = 0; mip < endMip; mip++)
   {
     // Read the image size. We use this for mip padding later on, and rely on
     // ExportSize for individual subresources.
@@ -1245,25 +1285,36 @@ inline ErrorWithText KTXImage::readFromKTX1Stream(std::istream& input, const Rea
     {
       for(uint32_t face = 0; face < header.numberOfFaces; face++)
       {
-        // Allocate storage for the encoded face
-        std::vector<char>& faceBuffer = subresource(mip, array_element, face);
-        ErrorWithText      maybeError = ResizeVectorOrError(faceBuffer, faceSizeBytes);
-        if(maybeError.has_value())
+        if(mip < firstMip)
         {
-          return "Allocating encoded data for mip " + std::to_string(mip) + " layer " + std::to_string(array_element)
-                 + " face " + std::to_string(face) + " failed (probably out of memory).";
+          if(!input.seekg(static_cast<std::streamoff>(faceSizeBytes), std::ios_base::cur))
+          {
+            return "Skipping mip " + std::to_string(mip) + " layer " + std::to_string(array_element) + " face "
+                   + std::to_string(face) + " failed (is the file truncated)?";
+          }
         }
-
-        if(!input.read(faceBuffer.data(), faceSizeBytes))
+        else
         {
-          return "Reading mip " + std::to_string(mip) + " layer " + std::to_string(array_element) + " face "
-                 + std::to_string(face) + " failed (is the file truncated)?";
-        }
+          // Get storage for the encoded face
+          char*         faceData   = nullptr;
+          ErrorWithText maybeError = getSubresourceDestination(readSettings, mip, array_element, face, faceSizeBytes, faceData);
+          if(maybeError.has_value())
+          {
+            return "Allocating encoded data for mip " + std::to_string(mip) + " layer " + std::to_string(array_element)
+                   + " face " + std::to_string(face) + " failed (probably out of memory).";
+          }
 
-        // Apply endianness swapping
-        if(needsSwapEndian)
-        {
-          SwapEndianGeneral(faceBuffer.size(), faceBuffer.data(), header.glTypeSize);
+          if(!input.read(faceData, faceSizeBytes))
+          {
+            return "Reading mip " + std::to_string(mip) + " layer " + std::to_string(array_element) + " face "
+                   + std::to_string(face) + " failed (is the file truncated)?";
+          }
+
+          // Apply endianness swapping
+          if(needsSwapEndian)
+          {
+            SwapEndianGeneral(faceSizeBytes, faceData, header.glTypeSize);
+          }
         }
 
         // Handle cubePadding
@@ -1575,10 +1626,14 @@ struct BasisUSingleton
     if(!m_initialized.load())
     {
       std::lock_guard<std::mutex> lock(m_modificationMutex);
-      basist::basisu_transcoder_init();
-      basisu::basisu_encoder_init();
-      m_codebook = new basist::etc1_global_selector_codebook(basist::g_global_selector_cb_size, basist::g_global_selector_cb);
-      m_initialized.store(true);
+      // Another thread may have initialized Basis while we were waiting for the lock.
+      if(!m_initialized.load())
+      {
+        basist::basisu_transcoder_init();
+        basisu::basisu_encoder_init();
+        m_codebook = new basist::etc1_global_selector_codebook(basist::g_global_selector_cb_size, basist::g_global_selector_cb);
+        m_initialized.store(true);
+      }
     }
     return true;
   }
@@ -1606,6 +1661,22 @@ private:
 };
 #endif
 
+// Temporary buffers and decompression state used to decode KTX2 mips. Each
+// thread decoding mips uses its own.
+struct KTX2MipDecodeScratch
+{
+  // Inflated data for Zstd and Zlib supercompression
+  std::vector<char> inflatedData;
+#ifdef NVP_SUPPORTS_ZSTD
+  ScopedZstdDContext zstdDCtx;
+#endif
+#ifdef NVP_SUPPORTS_BASISU
+  // Persistent ETC1S transcoder state. Video P-frames only depend on the
+  // previous frames of the same mip, so this never needs to be shared.
+  basist::basisu_transcoder_state etc1sTranscoderState;
+#endif
+};
+
 #pragma pack(push, 1)
 struct KTX2TopLevelHeader
 {
@@ -1633,7 +1704,10 @@ static_assert(sizeof(VkFormat) == sizeof(uint32_t), "VkFormat size must match KT
 static_assert(sizeof(KTX2TopLevelHeader) == 68, "KTX2 top-level header size must match spec! Padding issue?");
 
 // Reads a KTX 2.0 file, *starting after the 12-byte identifier*.
-inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const ReadSettings& readSettings)
+inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream&       input,
+                                                  const ReadSettings& readSettings,
+                                                  const char*         inputMemory,
+                                                  size_t              inputMemorySize)
 {
   // Get the position of the start of the file in the stream so that we can add
   // padding correctly later.
@@ -2015,9 +2089,6 @@ inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const Rea
   }
 
 // Initialize supercompression
-#ifdef NVP_SUPPORTS_ZSTD
-  ScopedZstdDContext zstdDCtx;
-#endif
 #ifdef NVP_SUPPORTS_BASISU
   BasisLZDecompressionObjects basisLZDCtx;
   // Basis ETC1S supports a sort of video format, where there are I-frames
@@ -2070,14 +2141,8 @@ inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const Rea
   }
   else if(header.supercompressionScheme == 2)
   {
-    // Set up Zstandard
-#ifdef NVP_SUPPORTS_ZSTD
-    zstdDCtx.Init();
-    if(zstdDCtx.pCtx == nullptr)
-    {
-      return "Initializing Zstandard context failed.";
-    }
-#else
+// Zstandard contexts are created per thread when decoding, but check to ensure it's supported
+#ifndef NVP_SUPPORTS_ZSTD
     return "KTX2 stream uses Zstandard supercompression, but nv_ktx was built without Zstd.";
 #endif
   }
@@ -2114,29 +2179,29 @@ inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const Rea
   //   Then: if UASTC:
   //     For each subresource
   //       Transcode it from UASTC to the inflated VkFormat
+  //
+  // Each mip is independent of the others. When reading from memory, mips are
+  // decoded in parallel, and uncompressed data is used without reading it
+  // into a temporary buffer first.
 
   // First initialize the output:
   UNWRAP_ERROR(allocate(num_mips, num_layers_possibly_0, num_faces));
-  // Temporary buffers used for supercompressed data.
-  std::vector<char> supercompressedData;
-  std::vector<char> inflatedData;
-  // Traverse mips in reverse order following the spec
-  for(int mip = num_mips - 1; mip >= 0; mip--)
-  {
-    // Seek to the start of that mip's data and read it. Note that this skips
-    // over mipPadding.
+
+  uint32_t firstMip = 0;
+  uint32_t endMip   = 0;
+  GetMipReadRange(readSettings, num_mips, firstMip, endMip);
+
+  // Computes the size of each face of a mip in the inflated vkFormat (after
+  // inflation) and in the final vkFormat (after inflation and transcoding),
+  // and validates them.
+  auto getMipFaceSizes = [&](uint32_t mip, size_t& inflatedFaceSize, size_t& finalFaceSize) -> ErrorWithText {
     const LevelIndex& levelIndex = levelIndices[mip];
-    if(!input.seekg(levelIndex.byteOffset + start_pos, std::ios::beg))
-    {
-      return "Failed to seek to KTX2 mip " + std::to_string(mip) + " data!";
-    }
 
     const size_t mipWidth  = std::max(1u, header.pixelWidth >> mip);
     const size_t mipHeight = std::max(1u, header.pixelHeight >> mip);
     const size_t mipDepth  = std::max(1u, header.pixelDepth >> mip);
 
-    // The size of each face in the inflated vkFormat, after inflation.
-    size_t inflatedFaceSize = 0;
+    inflatedFaceSize = 0;
     if(header.vkFormat == VK_FORMAT_UNDEFINED)
     {
       // Check for the Basis UASTC and Universal cases. I don't know if ETC1S
@@ -2160,8 +2225,7 @@ inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const Rea
       UNWRAP_ERROR(ExportSizeExtended(mipWidth, mipHeight, mipDepth, header.vkFormat, inflatedFaceSize, readSettings.custom_size_callback));
     }
 
-    // The size of each face in the final vkFormat, after inflation and transcoding.
-    size_t finalFaceSize = 0;
+    finalFaceSize = 0;
     UNWRAP_ERROR(ExportSizeExtended(mipWidth, mipHeight, mipDepth, format, finalFaceSize, readSettings.custom_size_callback));
 
     if(finalFaceSize > readSettings.max_resource_size_in_bytes)
@@ -2203,204 +2267,325 @@ inline ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const Rea
         }
       }
     }
+    return {};
+  };
+
+  // The number of bytes of a mip's data in the file that we read.
+  // ETC1S files often have uncompressedByteLength set to 0 for some reason.
+  // In any case, we want to read the compressed byte length for
+  // supercompressed data.
+  auto getMipDataSize = [&](uint32_t mip) -> uint64_t {
+    const LevelIndex& levelIndex = levelIndices[mip];
+    return (header.supercompressionScheme == 0) ? levelIndex.uncompressedByteLength : levelIndex.byteLength;
+  };
+
+  // Inflates and transcodes a mip from its data in the file (mipData, which
+  // is mipDataSize bytes long) into its subresources.
+  //
+  //              decompression            transcoding
+  //    mipData -> scratch.inflatedData ----> subresource
+  //       |                                   ^
+  //       +-----------------------------------+
+  //       without Zstd or Zlib, we use the file data directly
+  //       (in the ETC1S case, it turns out ETC1S doesn't do anything per-level)
+  auto decodeMip = [&](uint32_t mip, size_t inflatedFaceSize, size_t finalFaceSize, const char* mipData,
+                       size_t mipDataSize, KTX2MipDecodeScratch& scratch) -> ErrorWithText {
+    const LevelIndex& levelIndex = levelIndices[mip];
+
+#ifdef NVP_SUPPORTS_BASISU
+    // Only needed for transcoding
+    const size_t mipWidth  = std::max(1u, header.pixelWidth >> mip);
+    const size_t mipHeight = std::max(1u, header.pixelHeight >> mip);
+    const size_t mipDepth  = std::max(1u, header.pixelDepth >> mip);
+#endif
 
-    // FAST PATH - if no supercompression and no UASTC, we can read directly:
-    if((header.supercompressionScheme == 0) && (!isBasisUASTC))
+    const char* inflatedData     = mipData;
+    size_t      inflatedDataSize = mipDataSize;
+    if(header.supercompressionScheme >= 2)
     {
-      for(uint32_t layer = 0; layer < header.layerCount; layer++)
+      // Inflate the supercompressed data. We must use another buffer for this.
+      UNWRAP_ERROR(ResizeVectorOrError(scratch.inflatedData, levelIndex.uncompressedByteLength));
+
+      if(header.supercompressionScheme == 2)
       {
-        for(uint32_t face = 0; face < header.faceCount; face++)
+        // Zstandard
+#ifdef NVP_SUPPORTS_ZSTD
+        if(scratch.zstdDCtx.pCtx == nullptr)
         {
-          std::vector<char>& subresource_data = subresource(mip, layer, face);
-          UNWRAP_ERROR(ResizeVectorOrError(subresource_data, finalFaceSize));
-          if(!input.read(subresource_data.data(), finalFaceSize))
+          scratch.zstdDCtx.Init();
+          if(scratch.zstdDCtx.pCtx == nullptr)
           {
-            return "Reading data for mip " + std::to_string(mip) + " layer " + std::to_string(layer) + " face "
-                   + std::to_string(face) + " from the stream failed. Is the stream truncated?";
+            return "Initializing Zstandard context failed.";
           }
         }
-      }
-    }
-    else
-    {
-      //               decompression     transcoding
-      // supercompressedData -> inflatedData -> subresource
-      //                             ^
-      //                             |
-      //                             in the ETC1S + UASTC case, we load file data into here directly
-      //                             (it turns out ETC1S doesn't do anything per-level)
-      if((header.supercompressionScheme == 0))
-      {
-        // UASTC, ETC1S: Load file data into inflatedData directly
-        UNWRAP_ERROR(ResizeVectorOrError(inflatedData, levelIndex.uncompressedByteLength));
-        if(!input.read(inflatedData.data(), levelIndex.uncompressedByteLength))
+        size_t zstdError = ZSTD_decompressDCtx(scratch.zstdDCtx.pCtx, scratch.inflatedData.data(),
+                                               scratch.inflatedData.size(), mipData, mipDataSize);
+        if(ZSTD_isError(zstdError))
         {
-          return "Reading mip " + std::to_string(mip) + "'s data failed.";
+          const char* zstdErrorName = ZSTD_getErrorName(zstdError);
+          return "Mip " + std::to_string(mip) + " Zstandard inflation failed with the message '"
+                 + std::string(zstdErrorName) + "' (code " + std::to_string(zstdError) + ").";
         }
+#else
+        assert(!"nv_ktx was compiled without Zstandard support, but the KTX stream was not rejected! This should never happen.");
+#endif
       }
-      else if(header.supercompressionScheme == 1)
+      else if(header.supercompressionScheme == 3)
       {
-        // ETC1S files often have uncompressedByteLength set to 0 for some reason.
-        // In any case, we want to read the compressed byte length.
-        UNWRAP_ERROR(ResizeVectorOrError(inflatedData, levelIndex.byteLength));
-        if(!input.read(inflatedData.data(), levelIndex.byteLength))
+        // Zlib
+#ifdef NVP_SUPPORTS_GZLIB
+        ScopedZlibDStream zlibStream;
+        int               zlibError = zlibStream.Init();
+        if(zlibError != Z_OK)
         {
-          return "Reading mip " + std::to_string(mip) + "'s data failed.";
+          return "Zlib initialization failed (error code " + std::to_string(zlibError) + ").";
         }
-      }
-      else
-      {
-        // Read into supercompressedData
-        UNWRAP_ERROR(ResizeVectorOrError(supercompressedData, levelIndex.byteLength));
-        if(!input.read(supercompressedData.data(), levelIndex.byteLength))
+        if(mipDataSize > UINT_MAX || scratch.inflatedData.size() > UINT_MAX)
+        {
+          return "Zlib compressed or decompressed data for mip " + std::to_string(mip) + " was larger than 4 GB.";
+        }
+        zlibStream.stream.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(mipData));
+        zlibStream.stream.avail_in  = static_cast<uInt>(mipDataSize);
+        zlibStream.stream.next_out  = reinterpret_cast<Bytef*>(scratch.inflatedData.data());
+        zlibStream.stream.avail_out = static_cast<uInt>(scratch.inflatedData.size());
+        zlibError                   = inflate(&zlibStream.stream, Z_NO_FLUSH);
+        if(zlibError != Z_OK)
         {
-          return "Reading mip " + std::to_string(mip) + "'s supercompressed data failed.";
+          return "Zlib inflation failed (error code " + std::to_string(zlibError) + ").";
         }
+        zlibStream.Free();
+#else
+        assert(!"nv_ktx was compiled without Zlib support, but the KTX stream was not rejected! This should never happen.");
+#endif
+      }
+
+      inflatedData     = scratch.inflatedData.data();
+      inflatedDataSize = scratch.inflatedData.size();
+    }
+
+    // Check size ahead of time to ensure we don't read out of bounds.
+    // This would otherwise result in an access violation on
+    // invalid_face_count_and_padding.ktx2, or on an otherwise truncated file.
+    // This doesn't apply to ETC1S, because it does inflation and transcoding
+    // all at once.
+    if(header.supercompressionScheme != 1)
+    {
+      const size_t expected_bytes_in_this_mip = inflatedFaceSize * size_t(header.layerCount) * size_t(header.faceCount);
+      if(expected_bytes_in_this_mip > inflatedDataSize)
+      {
+        return "Expected " + std::to_string(expected_bytes_in_this_mip) + " bytes in mip " + std::to_string(mip)
+               + ", but the inflated data was only " + std::to_string(inflatedDataSize) + " bytes long.";
+      }
+    }
 
-        // Inflate the supercompressed data. We must use another buffer for this.
-        UNWRAP_ERROR(ResizeVectorOrError(inflatedData, levelIndex.uncompressedByteLength));
+    // Write into each subresource, possibly transcoding from the source
+    // format to this->format (for UASTC and ETC1S)
+    size_t inflatedDataPos = 0;  // Read position in inflatedData
+    for(uint32_t layer = 0; layer < header.layerCount; layer++)
+    {
+      for(uint32_t face = 0; face < header.faceCount; face++)
+      {
+        char* subresource_data = nullptr;
+        UNWRAP_ERROR(getSubresourceDestination(readSettings, mip, layer, face, finalFaceSize, subresource_data));
 
-        if(header.supercompressionScheme == 2)
+        if(isBasisUASTC)
         {
-          // Zstandard
-#ifdef NVP_SUPPORTS_ZSTD
-          size_t zstdError = ZSTD_decompress(inflatedData.data(), inflatedData.size(),  //
-                                             supercompressedData.data(), supercompressedData.size());
-          if(ZSTD_isError(zstdError))
-          {
-            const char* zstdErrorName = ZSTD_getErrorName(zstdError);
-            return "Mip " + std::to_string(mip) + " Zstandard inflation failed with the message '"
-                   + std::string(zstdErrorName) + "' (code " + std::to_string(zstdError) + ").";
-          }
+#ifdef NVP_SUPPORTS_BASISU
+          BasisUSingleton::GetInstance().TranscodeUASTCToBC7OrASTC44(subresource_data, inflatedData + inflatedDataPos, mipWidth,
+                                                                     mipHeight, mipDepth, readSettings.device_supports_astc);
 #else
-          assert(!"nv_ktx was compiled without Zstandard support, but the KTX stream was not rejected! This should never happen.");
+          assert(!"nv_ktx was compiled without Basis support, but the KTX stream was not rejected! This should never happen.");
 #endif
         }
-        else if(header.supercompressionScheme == 3)
+        else if(isBasisETC1S)
         {
-          // Zlib
-#ifdef NVP_SUPPORTS_GZLIB
-          ScopedZlibDStream zlibStream;
-          int               zlibError = zlibStream.Init();
-          if(zlibError != Z_OK)
+#ifdef NVP_SUPPORTS_BASISU
+          // Get the ETC1S image description
+          const size_t etc1sImageIdx =
+              (std::max(1u, num_layers_possibly_0) * size_t(mip) + size_t(layer)) * size_t(num_faces) + size_t(face);
+          const basist::ktx2_etc1s_image_desc imageDesc  = basisLZDCtx.etc1sImageDescs[etc1sImageIdx];
+          const size_t                        numBlocksX = (mipWidth + 3) / 4;
+          const size_t                        numBlocksY = (mipHeight + 3) / 4;
+
+          if(!basisLZDCtx.etc1sTranscoder->transcode_image(
+                 basisDstFmt,                                       // Basis destination format
+                 subresource_data,                                  // Output data
+                 uint32_t(numBlocksX * numBlocksY),                 // Number of blocks in the output
+                 reinterpret_cast<const uint8_t*>(inflatedData),    // Compressed data for this level
+                 uint32_t(inflatedDataSize),                        // Compressed data length
+                 uint32_t(numBlocksX), uint32_t(numBlocksY),        // Block dimensions
+                 uint32_t(mipWidth), uint32_t(mipHeight),           // Pixel dimensions
+                 uint32_t(mip),                                     // Mip number
+                 imageDesc.m_rgb_slice_byte_offset, imageDesc.m_rgb_slice_byte_length,  // Range of first slice from the start of the compressed data
+                 imageDesc.m_alpha_slice_byte_offset, imageDesc.m_alpha_slice_byte_length,  // Range of second slice from the start of the compressed data
+                 0,                                      // No need for nonstandard decoder flags here
+                 (basisETC1SNumSlices == 2),             // Whether it has 2 slices or only 1
+                 isVideo,                                // Whether this is ETC1S video
+                 0,                                      // Output row pitch in blocks, or 0
+                 &scratch.etc1sTranscoderState,          // Persistent transcoder state
+                 false))                                 // Output in blocks, not pixels
           {
-            return "Zlib initialization failed (error code " + std::to_string(zlibError) + ").";
+            return "Failed to decompress BasisLZ+ETC1S mip " + std::to_string(mip) + ", layer " + std::to_string(layer)
+                   + ", face " + std::to_string(face) + "!";
           }
-          if(supercompressedData.size() > UINT_MAX || inflatedData.size() > UINT_MAX)
+#else
+          assert(!"nv_ktx was compiled without Basis support, but the KTX stream was not rejected! This should never happen.");
+#endif
+        }
+        else
+        {
+          // Not UASTC or ETC1S, no transcoding needed
+          // We've checked to make sure this is okay above, but double-check
+          // here in case the behavior above changes in future versions of
+          // the code.
+          if(header.supercompressionScheme == 1)
           {
-            return "Zlib compressed or decompressed data for mip " + std::to_string(mip) + " was larger than 4 GB.";
+            return "Failed to read KTX2 file: BasisLZ supercompression was enabled, but control reached the non-BasisLZ copy. This should never happen.";
           }
-          zlibStream.stream.next_in   = reinterpret_cast<Bytef*>(supercompressedData.data());
-          zlibStream.stream.avail_in  = static_cast<uInt>(supercompressedData.size());
-          zlibStream.stream.next_out  = reinterpret_cast<Bytef*>(inflatedData.data());
-          zlibStream.stream.avail_out = static_cast<uInt>(inflatedData.size());
-          zlibError                   = inflate(&zlibStream.stream, Z_NO_FLUSH);
-          if(zlibError != Z_OK)
+          if(inflatedDataPos + inflatedFaceSize > inflatedDataSize)
           {
-            return "Zlib inflation failed (error code " + std::to_string(zlibError) + ").";
+            return "Failed to read KTX2 file: the size of the inflated data didn't match the expected size.";
           }
-          zlibStream.Free();
-#else
-          assert(!"nv_ktx was compiled without Zlib support, but the KTX stream was not rejected! This should never happen.");
-#endif
+          memcpy(subresource_data, inflatedData + inflatedDataPos, inflatedFaceSize);
         }
+
+        // Advance to next image
+        inflatedDataPos += inflatedFaceSize;
       }
+    }
+    return {};
+  };
 
-      // Check size ahead of time to ensure we don't read out of bounds.
-      // This would otherwise result in an access violation on
-      // invalid_face_count_and_padding.ktx2, or on an otherwise truncated file.
-      // This doesn't apply to ETC1S, because it does inflation and transcoding
-      // all at once.
-      if(header.supercompressionScheme != 1)
+  if(inputMemory == nullptr)
+  {
+    KTX2MipDecodeScratch scratch;
+    std::vector<char>    mipData;
+    // Traverse mips in reverse order following the spec
+    for(uint32_t mipPlusOne = endMip; mipPlusOne > firstMip; mipPlusOne--)
+    {
+      const uint32_t mip = mipPlusOne - 1;
+      // Seek to the start of that mip's data and read it. Note that this skips
+      // over mipPadding.
+      const LevelIndex& levelIndex = levelIndices[mip];
+      if(!input.seekg(levelIndex.byteOffset + start_pos, std::ios::beg))
       {
-        const size_t inflatedDataSize           = inflatedData.size();
-        const size_t expected_bytes_in_this_mip = inflatedFaceSize * size_t(header.layerCount) * size_t(header.faceCount);
-        if(expected_bytes_in_this_mip > inflatedDataSize)
-        {
-          return "Expected " + std::to_string(expected_bytes_in_this_mip) + " bytes in mip " + std::to_string(mip)
-                 + ", but the inflated data was only " + std::to_string(inflatedDataSize) + " bytes long.";
-        }
+        return "Failed to seek to KTX2 mip " + std::to_string(mip) + " data!";
       }
 
-      // Write into each subresource, possibly transcoding from the source
-      // format to this->format (for UASTC and ETC1S)
-      size_t inflatedDataPos = 0;  // Read position in inflatedData
-      for(uint32_t layer = 0; layer < header.layerCount; layer++)
+      size_t inflatedFaceSize = 0;
+      size_t finalFaceSize    = 0;
+      UNWRAP_ERROR(getMipFaceSizes(mip, inflatedFaceSize, finalFaceSize));
+
+      // FAST PATH - if no supercompression and no UASTC, we can read directly:
+      if((header.supercompressionScheme == 0) && (!isBasisUASTC))
       {
-        for(uint32_t face = 0; face < header.faceCount; face++)
+        for(uint32_t layer = 0; layer < header.layerCount; layer++)
         {
-          std::vector<char>& subresource_data = subresource(mip, layer, face);
-          UNWRAP_ERROR(ResizeVectorOrError(subresource_data, finalFaceSize));
-
-          if(isBasisUASTC)
+          for(uint32_t face = 0; face < header.faceCount; face++)
           {
-#ifdef NVP_SUPPORTS_BASISU
-            BasisUSingleton::GetInstance().TranscodeUASTCToBC7OrASTC44(subresource_data.data(),
-                                                                       &inflatedData[inflatedDataPos], mipWidth, mipHeight,
-                                                                       mipDepth, readSettings.device_supports_astc);
-#else
-            assert(!"nv_ktx was compiled without Basis support, but the KTX stream was not rejected! This should never happen.");
-#endif
-          }
-          else if(isBasisETC1S)
-          {
-#ifdef NVP_SUPPORTS_BASISU
-            // Get the ETC1S image description
-            const size_t etc1sImageIdx =
-                (std::max(1u, num_layers_possibly_0) * size_t(mip) + size_t(layer)) * size_t(num_faces) + size_t(face);
-            const basist::ktx2_etc1s_image_desc imageDesc  = basisLZDCtx.etc1sImageDescs[etc1sImageIdx];
-            const size_t                        numBlocksX = (mipWidth + 3) / 4;
-            const size_t                        numBlocksY = (mipHeight + 3) / 4;
-
-            if(!basisLZDCtx.etc1sTranscoder->transcode_image(
-                   basisDstFmt,                                      // Basis destination format
-                   subresource_data.data(),                          // Output data
-                   uint32_t(numBlocksX * numBlocksY),                // Number of blocks in the output
-                   reinterpret_cast<uint8_t*>(inflatedData.data()),  // Compressed data for this level
-                   uint32_t(inflatedData.size()),                    // Compressed data length
-                   uint32_t(numBlocksX), uint32_t(numBlocksY),       // Block dimensions
-                   uint32_t(mipWidth), uint32_t(mipHeight),          // Pixel dimensions
-                   uint32_t(mip),                                    // Mip number
-                   imageDesc.m_rgb_slice_byte_offset, imageDesc.m_rgb_slice_byte_length,  // Range of first slice from the start of the compressed data
-                   imageDesc.m_alpha_slice_byte_offset, imageDesc.m_alpha_slice_byte_length,  // Range of second slice from the start of the compressed data
-                   0,                                                    // No need for nonstandard decoder flags here
-                   (basisETC1SNumSlices == 2),                           // Whether it has 2 slices or only 1
-                   isVideo,                                              // Whether this is ETC1S video
-                   0,                                                    // Output row pitch in blocks, or 0
-                   &basisLZDCtx.ktx2TranscoderState.m_transcoder_state,  // Persistent transcoder state
-                   false))                                               // Output in blocks, not pixels
+            char* subresource_data = nullptr;
+            UNWRAP_ERROR(getSubresourceDestination(readSettings, mip, layer, face, finalFaceSize, subresource_data));
+            if(!input.read(subresource_data, finalFaceSize))
             {
-              return "Failed to decompress BasisLZ+ETC1S mip " + std::to_string(mip) + ", layer "
-                     + std::to_string(layer) + ", face " + std::to_string(face) + "!";
+              return "Reading data for mip " + std::to_string(mip) + " layer " + std::to_string(layer) + " face "
+                     + std::to_string(face) + " from the stream failed. Is the stream truncated?";
             }
-#else
-            assert(!"nv_ktx was compiled without Basis support, but the KTX stream was not rejected! This should never happen.");
-#endif
-          }
-          else
-          {
-            // Not UASTC or ETC1S, no transcoding needed
-            // We've checked to make sure this is okay above, but double-check
-            // here in case the behavior above changes in future versions of
-            // the code.
-            if(header.supercompressionScheme == 1)
-            {
-              return "Failed to read KTX2 file: BasisLZ supercompression was enabled, but control reached the non-BasisLZ copy. This should never happen.";
-            }
-            if(inflatedDataPos + inflatedFaceSize > inflatedData.size())
-            {
-              return "Failed to read KTX2 file: the size of the inflated data didn't match the expected size.";
-            }
-            memcpy(subresource_data.data(), &inflatedData[inflatedDataPos], inflatedFaceSize);
           }
+        }
+      }
+      else
+      {
+        UNWRAP_ERROR(ResizeVectorOrError(mipData, getMipDataSize(mip)));
+        if(!input.read(mipData.data(), mipData.size()))
+        {
+          return "Reading mip " + std::to_string(mip) + "'s data failed.";
+        }
+        UNWRAP_ERROR(decodeMip(mip, inflatedFaceSize, finalFaceSize, mipData.data(), mipData.size(), scratch));
+      }
+    }
+    return {};
+  }
+
+  // Reading from memory: threads take the largest mips first, so that the
+  // most expensive ones do not end up last on a single thread, and stop at
+  // the first error.
+  const uint32_t             numMipsToRead = endMip - firstMip;
+  std::vector<ErrorWithText> mipErrors(num_mips);
+  std::atomic<uint32_t>      nextMipTask(0);
+  std::atomic<bool>          mipFailed(false);
 
-          // Advance to next image
-          inflatedDataPos += inflatedFaceSize;
+  auto decodeMipsFromMemory = [&]() {
+    KTX2MipDecodeScratch scratch;
+    while(!mipFailed.load())
+    {
+      const uint32_t task = nextMipTask.fetch_add(1);
+      if(task >= numMipsToRead)
+      {
+        break;
+      }
+      const uint32_t mip = firstMip + task;
+
+      ErrorWithText& mipError = mipErrors[mip];
+      size_t         inflatedFaceSize = 0;
+      size_t         finalFaceSize    = 0;
+      mipError = getMipFaceSizes(mip, inflatedFaceSize, finalFaceSize);
+      if(!mipError.has_value())
+      {
+        const LevelIndex& levelIndex  = levelIndices[mip];
+        const uint64_t    mipDataSize = getMipDataSize(mip);
+        if(levelIndex.byteOffset > inputMemorySize || mipDataSize > inputMemorySize - levelIndex.byteOffset)
+        {
+          mipError = "The KTX2 file said that mip " + std::to_string(mip) + "'s data was at bytes "
+                     + std::to_string(levelIndex.byteOffset) + " to " + std::to_string(levelIndex.byteOffset + mipDataSize)
+                     + ", but the input was only " + std::to_string(inputMemorySize) + " bytes long!";
+        }
+        else
+        {
+          mipError = decodeMip(mip, inflatedFaceSize, finalFaceSize, inputMemory + levelIndex.byteOffset,
+                               size_t(mipDataSize), scratch);
         }
       }
+      if(mipError.has_value())
+      {
+        mipFailed.store(true);
+      }
+    }
+  };
+
+  uint32_t numThreads = readSettings.num_threads;
+  if(numThreads == 0)
+  {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  numThreads = std::min(numThreads, numMipsToRead);
+
+  // The calling thread decodes mips as well. If creating a thread fails, the
+  // other threads do its work.
+  std::vector<std::thread> threads;
+  try
+  {
+    for(uint32_t t = 1; t < numThreads; t++)
+    {
+      threads.emplace_back(decodeMipsFromMemory);
     }
   }
+  catch(...)
+  {
+  }
+  decodeMipsFromMemory();
+  for(std::thread& thread : threads)
+  {
+    thread.join();
+  }
 
+  // Return the first error in file order, like the stream reader.
+  for(uint32_t mipPlusOne = endMip; mipPlusOne > firstMip; mipPlusOne--)
+  {
+    if(mipErrors[mipPlusOne - 1].has_value())
+    {
+      return mipErrors[mipPlusOne - 1];
+    }
+  }
   return {};
 }
 
@@ -3497,4 +3682,89 @@ inline ErrorWithText KTXImage::readFromFile(const char* filename, const ReadSett
   return readFromStream(input_stream, readSettings);
 }
 
+// A read-only stream buffer over memory, so that readFromMemory can parse the
+// headers using the same code as readFromStream.
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+  MemoryStreamBuffer(const char* data, size_t size)
+  {
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override
+  {
+    if(which & std::ios_base::out)
+    {
+      return pos_type(off_type(-1));
+    }
+    off_type pos = off;
+    if(dir == std::ios_base::cur)
+    {
+      pos += gptr() - eback();
+    }
+    else if(dir == std::ios_base::end)
+    {
+      pos += egptr() - eback();
+    }
+    if(pos < 0 || pos > egptr() - eback())
+    {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+  }
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
+inline ErrorWithText KTXImage::readFromMemory(const void* input, size_t inputSize, const ReadSettings& readSettings)
+{
+  const char*        inputMemory = reinterpret_cast<const char*>(input);
+  MemoryStreamBuffer inputBuffer(inputMemory, inputSize);
+  std::istream       input_stream(&inputBuffer);
+
+  // Read the identifier.
+  uint8_t identifier[IDENTIFIER_LEN]{};
+  if(!input_stream.read(reinterpret_cast<char*>(identifier), IDENTIFIER_LEN))
+  {
+    return "Reading the identifier failed!";
+  }
+
+  // KTX1 files are read like streams; KTX2 files decode their mips directly
+  // from memory.
+  if(memcmp(identifier, ktx1Identifier, IDENTIFIER_LEN) == 0)
+  {
+    read_ktx_version = 1;
+    return readFromKTX1Stream(input_stream, readSettings);
+  }
+  else if(memcmp(identifier, ktx2Identifier, IDENTIFIER_LEN) == 0)
+  {
+    read_ktx_version = 2;
+    return readFromKTX2Stream(input_stream, readSettings, inputMemory, inputSize);
+  }
+
+  // Otherwise,
+  return "Not a KTX1 or KTX2 file (first 12 bytes weren't a valid identifier).";
+}
+
+#if NV_KTX_SUPPORTS_FILEMAPPING
+inline ErrorWithText KTXImage::readFromMappedFile(const char* filename, const ReadSettings& readSettings)
+{
+  nvh::FileReadMapping mapping;
+  if(!mapping.open(filename))
+  {
+    return "Opening and mapping " + std::string(filename) + " failed.";
+  }
+  // Mips are decoded in parallel in no particular order, so ask for
+  // everything to be read in ahead of time.
+  mapping.advise(0, mapping.size(), nvh::FileMapping::ADVICE_WILLNEED);
+  return readFromMemory(mapping.data(), mapping.size(), readSettings);
+}
+#endif
+
 }  // namespace nv_ktx
@@ -74,6 +74,22 @@ nvh::Profiler::SectionID ProfilerGL::beginSection(const char* name, bool singleS
 
       gpuTime = double(endTime - beginTime) / double(1000);
 
+      if(isTracing())
+      {
+        if(m_calibrationFrame != getTotalFrames())
+        {
+          // the GL_TIMESTAMP get is the gpu clock now, recalibrate once per frame
+          GLint64 gpuNow;
+          double  cpuNow = getMicroSeconds();
+          glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+          cpuNow = (cpuNow + getMicroSeconds()) * 0.5;
+
+          m_gpuClockOffset   = cpuNow - double(gpuNow) / double(1000);
+          m_calibrationFrame = getTotalFrames();
+        }
+        setGpuBeginTime(i, queryFrame, double(beginTime) / double(1000) + m_gpuClockOffset, true);
+      }
+
       return true;
     }
     else
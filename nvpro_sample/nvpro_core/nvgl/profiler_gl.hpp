@@ -80,6 +80,10 @@ private:
   void resizeQueries();
 
   std::vector<GLuint> m_queries;
+
+  // maps GL_TIMESTAMP onto getMicroSeconds() for traces
+  uint32_t m_calibrationFrame = ~0u;
+  double   m_gpuClockOffset   = 0;
 };
 }  // namespace nvgl
 
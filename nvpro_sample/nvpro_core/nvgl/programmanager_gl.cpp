@@ -107,6 +107,7 @@ bool ProgramManager::setupProgram(Program& prog)
       definition.filetype = m_filetype;
     }
 
+    definition.dependencies.clear();
     if(m_rawOnly)
     {
       definition.content = getContent(definition.filename, definition.filenameFound);
@@ -146,7 +147,7 @@ bool ProgramManager::setupProgram(Program& prog)
       }
 
       definition.content = manualInclude(definition.filename, definition.filenameFound,
-                                         m_prepend + definition.prepend + std::string(strDefine), false);
+                                         m_prepend + definition.prepend + std::string(strDefine), false, &definition.dependencies);
     }
     allFound = allFound && !definition.content.empty();
   }
@@ -236,6 +237,7 @@ ProgramID ProgramManager::createProgram(const std::vector<ProgramManager::Defini
   Program prog;
   prog.definitions = definitions;
 
+  beginFileScan();
   setupProgram(prog);
 
   for(size_t i = 0; i < m_programs.size(); i++)
@@ -274,6 +276,12 @@ void ProgramManager::deletePrograms()
 }
 
 void ProgramManager::reloadProgram(ProgramID i)
+{
+  beginFileScan();
+  reloadProgramInScan(i);
+}
+
+void ProgramManager::reloadProgramInScan(ProgramID i)
 {
   if(!isValid(i))
     return;
@@ -298,14 +306,49 @@ void ProgramManager::reloadPrograms()
 {
   LOGI("Reloading programs...\n");
 
+  // shared includes are only checked once
+  beginFileScan();
   for(size_t i = 0; i < m_programs.size(); i++)
   {
-    reloadProgram((ProgramID)i);
+    reloadProgramInScan((ProgramID)i);
   }
 
   LOGI("done\n");
 }
 
+size_t ProgramManager::reloadChangedPrograms()
+{
+  beginFileScan();
+
+  size_t reloaded = 0;
+  for(size_t i = 0; i < m_programs.size(); i++)
+  {
+    Program& prog    = m_programs[i];
+    bool     changed = false;
+    for(size_t d = 0; d < prog.definitions.size() && !changed; d++)
+    {
+      changed = haveDependenciesChanged(prog.definitions[d].dependencies);
+    }
+
+    if(changed && isValid((ProgramID)i))
+    {
+      if(!reloaded)
+      {
+        LOGI("Reloading changed programs...\n");
+      }
+      reloadProgramInScan((ProgramID)i);
+      reloaded++;
+    }
+  }
+
+  if(reloaded)
+  {
+    LOGI("done, %d programs\n", int(reloaded));
+  }
+
+  return reloaded;
+}
+
 bool ProgramManager::isValid(ProgramID idx) const
 {
   return idx.isValid() && (m_programs[idx].definitions.empty() || m_programs[idx].program != 0);
@@ -57,6 +57,10 @@ namespace nvgl {
 
     glUseProgram(mgr.get(id));
     \endcode
+
+    reloadChangedPrograms only reloads the programs for which any of the
+    files they were loaded from (includes as well) changed, changes to
+    m_prepend or other state still require reloadPrograms.
   */
 
 
@@ -113,9 +117,11 @@ public:
   void destroyProgram(ProgramID idx);
   void reloadProgram(ProgramID idx);
 
-  void reloadPrograms();
-  void deletePrograms();
-  bool areProgramsValid();
+  void   reloadPrograms();
+  // returns the number of reloaded programs
+  size_t reloadChangedPrograms();
+  void   deletePrograms();
+  bool   areProgramsValid();
 
 
   bool         isValid(ProgramID idx) const;
@@ -148,6 +154,8 @@ public:
 
 private:
   bool setupProgram(Program& prog);
+  // reloadProgram without starting a new file scan
+  void reloadProgramInScan(ProgramID idx);
 
   bool        loadBinary(GLuint program, const std::string& combinedPrepend, const std::string& combinedFilenames);
   void        saveBinary(GLuint program, const std::string& combinedPrepend, const std::string& combinedFilenames);
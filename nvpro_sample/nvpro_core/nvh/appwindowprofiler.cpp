@@ -409,6 +409,7 @@ int AppWindowProfiler::run(const std::string& title, int argc, const char** argv
   }
   contextSync();
   exitScreenshot();
+  m_profiler.endTrace();
 
   if(quickExit)
   {
@@ -467,6 +468,18 @@ void AppWindowProfiler::parameterCallback(uint32_t param)
       nvprintSetLogFileName(logfileName.c_str());
     }
   }
+  else if(param == m_paramTrace)
+  {
+    std::string traceFileName = specialStrings(m_config.traceFilename.c_str());
+    if(traceFileName.empty())
+    {
+      m_profiler.endTrace();
+    }
+    else if(!m_profiler.beginTrace(traceFileName.c_str()))
+    {
+      LOGE("could not open profiler trace file: %s\n", traceFileName.c_str());
+    }
+  }
   else if(param == m_paramCfg || param == m_paramBat)
   {
     parseConfigFile(m_config.configFilename.c_str());
@@ -507,6 +520,8 @@ void AppWindowProfiler::setupParameters()
   m_paramWinsize = m_parameterList.add("winsize|Set window size (width and height)", m_config.winsize, callback, 2);
   m_paramVsync   = m_parameterList.add("vsync|Enable or disable vsync", &m_config.vsyncstate, callback);
   m_paramLog     = m_parameterList.addFilename("logfile|Set logfile", &m_config.logFilename, callback);
+  m_paramTrace   = m_parameterList.addFilename("profilertrace|Stream profiler sections into this Chrome trace json file",
+                                               &m_config.traceFilename, callback);
   m_paramCfg = m_parameterList.addFilename(".cfg|load parameters from this config file", &m_config.configFilename, callback);
   m_paramBat = m_parameterList.addFilename(".bat|load parameters from this batch file", &m_config.configFilename, callback);
   m_parameterList.add("winpos|Set window position (x and y)", m_config.winpos, nullptr, 2);
@@ -43,6 +43,7 @@ namespace nvh {
     - benchmark/automation mode using ParameterTools
     - screenshot creation
     - logfile based on devicename (depends on context)
+    - profiler trace capture (Chrome trace json) via "-profilertrace <file>"
     - optional context/swapchain interface
       the derived classes nvvk/appwindowprofiler_vk and nvgl/appwindowprofiler_gl make use of this
   */
@@ -211,6 +212,7 @@ private:
     std::string dumpatexitFilename;
     std::string screenshotFilename;
     std::string logFilename;
+    std::string traceFilename;
     std::string configFilename;
     uint32_t    clearColor[3] = {127, 0, 0};
 
@@ -242,6 +244,7 @@ private:
   uint32_t m_paramVsync;
   uint32_t m_paramScreenshot;
   uint32_t m_paramLog;
+  uint32_t m_paramTrace;
   uint32_t m_paramCfg;
   uint32_t m_paramBat;
   uint32_t m_paramClear;
@@ -19,9 +19,93 @@
 
 
 #include "bitarray.hpp"
+#include "cpufeatures.hpp"
 
 
 namespace nvh {
+
+enum BitOperation
+{
+  BITOP_AND,
+  BITOP_OR,
+  BITOP_XOR,
+  BITOP_ANDNOT,
+};
+
+template <BitOperation OP>
+inline BitArray::BitStorageType bitOperation(BitArray::BitStorageType a, BitArray::BitStorageType b)
+{
+  switch(OP)
+  {
+    case BITOP_AND:
+      return a & b;
+    case BITOP_OR:
+      return a | b;
+    case BITOP_XOR:
+      return a ^ b;
+    case BITOP_ANDNOT:
+      return a & ~b;
+  }
+  return 0;
+}
+
+#if NVH_CPU_AVX2
+template <BitOperation OP>
+NVH_TARGET_AVX2 inline __m256i bitOperation(__m256i a, __m256i b)
+{
+  switch(OP)
+  {
+    case BITOP_AND:
+      return _mm256_and_si256(a, b);
+    case BITOP_OR:
+      return _mm256_or_si256(a, b);
+    case BITOP_XOR:
+      return _mm256_xor_si256(a, b);
+    case BITOP_ANDNOT:
+      return _mm256_andnot_si256(b, a);
+  }
+  return a;
+}
+
+/** \brief processes whole groups of four elements, returns the number of elements processed **/
+template <BitOperation OP>
+NVH_TARGET_AVX2 static size_t bitOperationAVX2(BitArray::BitStorageType*       result,
+                                               const BitArray::BitStorageType* a,
+                                               const BitArray::BitStorageType* b,
+                                               size_t                          numElements)
+{
+  size_t index = 0;
+  for(; index + 4 <= numElements; index += 4)
+  {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + index));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + index));
+    _mm256_storeu_si256((__m256i*)(result + index), bitOperation<OP>(va, vb));
+  }
+  return index;
+}
+#endif
+
+/** \brief result[i] = a[i] OP b[i], result may alias a or b.
+    Uses AVX2 if the CPU supports it, regardless of the compiler's target flags. **/
+template <BitOperation OP>
+static void bitOperation(BitArray::BitStorageType* result,
+                         const BitArray::BitStorageType* a,
+                         const BitArray::BitStorageType* b,
+                         size_t                          numElements)
+{
+  size_t index = 0;
+#if NVH_CPU_AVX2
+  if(cpuSupportsAVX2())
+  {
+    index = bitOperationAVX2<OP>(result, a, b, numElements);
+  }
+#endif
+  for(; index < numElements; ++index)
+  {
+    result[index] = bitOperation<OP>(a[index], b[index]);
+  }
+}
+
 /** \brief Create a new BitVector.
   **/
 BitArray::BitArray()
@@ -108,11 +192,7 @@ BitArray BitArray::operator^(BitArray const& rhs)
   NV_ASSERT(getSize() == rhs.getSize());
 
   BitArray result(getSize());
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    result.m_bits[index] = m_bits[index] ^ rhs.m_bits[index];
-  }
-  clearUnusedBits();
+  bitOperation<BITOP_XOR>(result.m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return result;
 }
@@ -122,11 +202,7 @@ BitArray BitArray::operator|(BitArray const& rhs)
   NV_ASSERT(getSize() == rhs.getSize());
 
   BitArray result(getSize());
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    result.m_bits[index] = m_bits[index] | rhs.m_bits[index];
-  }
-  clearUnusedBits();
+  bitOperation<BITOP_OR>(result.m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return result;
 }
@@ -136,11 +212,7 @@ BitArray BitArray::operator&(BitArray const& rhs)
   NV_ASSERT(getSize() == rhs.getSize());
 
   BitArray result(getSize());
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    result.m_bits[index] = m_bits[index] & rhs.m_bits[index];
-  }
-  clearUnusedBits();
+  bitOperation<BITOP_AND>(result.m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return result;
 }
@@ -149,11 +221,7 @@ BitArray& BitArray::operator^=(BitArray const& rhs)
 {
   NV_ASSERT(getSize() == rhs.getSize());
 
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    m_bits[index] ^= rhs.m_bits[index];
-  }
-  clearUnusedBits();
+  bitOperation<BITOP_XOR>(m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return *this;
 }
@@ -162,10 +230,7 @@ BitArray& BitArray::operator|=(BitArray const& rhs)
 {
   NV_ASSERT(getSize() == rhs.getSize());
 
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    m_bits[index] |= rhs.m_bits[index];
-  }
+  bitOperation<BITOP_OR>(m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return *this;
 }
@@ -174,10 +239,16 @@ BitArray& BitArray::operator&=(BitArray const& rhs)
 {
   NV_ASSERT(getSize() == rhs.getSize());
 
-  for(size_t index = 0; index < determineNumberOfElements(); ++index)
-  {
-    m_bits[index] &= rhs.m_bits[index];
-  }
+  bitOperation<BITOP_AND>(m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
+
+  return *this;
+}
+
+BitArray& BitArray::andNot(BitArray const& rhs)
+{
+  NV_ASSERT(getSize() == rhs.getSize());
+
+  bitOperation<BITOP_ANDNOT>(m_bits, m_bits, rhs.m_bits, determineNumberOfElements());
 
   return *this;
 }
@@ -197,6 +268,52 @@ void BitArray::fill()
   }
 }
 
+void BitArray::setBits(size_t begin, size_t end, bool value)
+{
+  NV_ASSERT(begin <= end && end <= m_size);
+  if(begin == end)
+    return;
+
+  size_t         firstElement = begin / StorageBitsPerElement;
+  size_t         lastElement  = (end - 1) / StorageBitsPerElement;
+  BitStorageType firstMask    = ~BitStorageType(0) << (begin % StorageBitsPerElement);
+  BitStorageType lastMask = ~BitStorageType(0) >> ((StorageBitsPerElement - end % StorageBitsPerElement) & (StorageBitsPerElement - 1));
+
+  if(firstElement == lastElement)
+  {
+    firstMask &= lastMask;
+  }
+
+  if(value)
+  {
+    m_bits[firstElement] |= firstMask;
+    if(firstElement != lastElement)
+    {
+      std::fill(m_bits + firstElement + 1, m_bits + lastElement, ~BitStorageType(0));
+      m_bits[lastElement] |= lastMask;
+    }
+  }
+  else
+  {
+    m_bits[firstElement] &= ~firstMask;
+    if(firstElement != lastElement)
+    {
+      std::fill(m_bits + firstElement + 1, m_bits + lastElement, BitStorageType(0));
+      m_bits[lastElement] &= ~lastMask;
+    }
+  }
+}
+
+size_t BitArray::countBits() const
+{
+  size_t count = 0;
+  for(size_t index = 0; index < determineNumberOfElements(); ++index)
+  {
+    count += popcount(m_bits[index]);
+  }
+  return count;
+}
+
 size_t BitArray::countLeadingZeroes() const
 {
   size_t index = 0;
@@ -216,4 +333,75 @@ size_t BitArray::countLeadingZeroes() const
   return std::min(leadingZeroes, getSize());
 }
 
+void BitRankIndex::build(const BitArray& bits)
+{
+  m_bits        = bits.getBits();
+  m_size        = bits.getSize();
+  m_numElements = (m_size + BitArray::StorageBitsPerElement - 1) / BitArray::StorageBitsPerElement;
+
+  size_t numBlocks = (m_numElements + ElementsPerBlock - 1) / ElementsPerBlock;
+  m_blockRanks.resize(numBlocks + 1);
+
+  size_t count = 0;
+  for(size_t block = 0; block < numBlocks; block++)
+  {
+    m_blockRanks[block] = count;
+
+    size_t end = std::min(m_numElements, (block + 1) * ElementsPerBlock);
+    for(size_t element = block * ElementsPerBlock; element < end; element++)
+    {
+      count += popcount(m_bits[element]);
+    }
+  }
+  m_blockRanks[numBlocks] = count;
+}
+
+size_t BitRankIndex::rank(size_t index) const
+{
+  NV_ASSERT(index <= m_size);
+
+  size_t element = index / BitArray::StorageBitsPerElement;
+  size_t bit     = index % BitArray::StorageBitsPerElement;
+  size_t block   = element / ElementsPerBlock;
+
+  size_t count = m_blockRanks[block];
+  for(size_t e = block * ElementsPerBlock; e < element; e++)
+  {
+    count += popcount(m_bits[e]);
+  }
+  if(bit)
+  {
+    count += popcount(m_bits[element] & ((BitArray::BitStorageType(1) << bit) - 1));
+  }
+  return count;
+}
+
+size_t BitRankIndex::select(size_t n) const
+{
+  if(n >= getCount())
+    return m_size;
+
+  // last block with fewer than n+1 bits before it
+  size_t block = std::upper_bound(m_blockRanks.begin(), m_blockRanks.end(), n) - m_blockRanks.begin() - 1;
+  size_t count = m_blockRanks[block];
+
+  for(size_t element = block * ElementsPerBlock; element < m_numElements; element++)
+  {
+    BitArray::BitStorageType bits        = m_bits[element];
+    size_t                   numElemBits = popcount(bits);
+    if(n < count + numElemBits)
+    {
+      for(size_t i = count; i < n; i++)
+      {
+        bits &= bits - 1;
+      }
+      return element * BitArray::StorageBitsPerElement + ctz(bits);
+    }
+    count += numElemBits;
+  }
+
+  NV_ASSERT(0);
+  return m_size;
+}
+
 }  // namespace nvh
@@ -23,10 +23,14 @@
 
 #include <algorithm>
 #include <platform.h>
+#include <type_traits>
+#include <vector>
 #if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
 #include <intrin.h>
 #endif
 
+#include "jobsystem.hpp"
+
 namespace nvh {
 
 //////////////////////////////////////////////////////////////////////////
@@ -56,7 +60,16 @@ namespace nvh {
   
     MyVisitor visitor;
     modifiedObjects.traverseBits(visitor);
+
+    // combine masks word by word, AVX2 is used when the CPU supports it
+    visibleObjects &= modifiedObjects;
+    visibleObjects.andNot(culledObjects);
+    size_t numVisible = visibleObjects.countBits();
     \endcode
+
+    Large arrays can be traversed by multiple threads, every thread gets
+    whole storage elements, the visitor must therefore be thread-safe.
+    The nvh::BitRankIndex answers rank and select queries.
   */
 
 /** \brief Visitor which forwards the visitor operator with a fixed offset **/
@@ -78,32 +91,17 @@ private:
 
 
 #if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
-template <typename Visitor>
-inline void bitTraverse(uint32_t bits, Visitor& visitor)
-{
-  unsigned long localIndex;
-  while(_BitScanForward(&localIndex, bits))
-  {
-    visitor(localIndex);
-    bits ^= 1 << localIndex;  // clear the current bit so that the next one is being found by the bitscan
-  }
-}
-
-template <typename Visitor>
-inline void bitTraverse(uint64_t bits, Visitor& visitor)
-{
-  unsigned long localIndex;
-  while(_BitScanForward64(&localIndex, bits))
-  {
-    visitor(localIndex);
-    bits ^= uint64_t(1) << localIndex;  // clear the current bit so that the next one is being found by the bitscan
-  }
-}
-
 inline size_t ctz(uint64_t bits)
 {
   unsigned long localIndex;
+#if defined(NV_X64)
   return _BitScanForward64(&localIndex, bits) ? localIndex : 64;
+#else
+  // no 64-bit scan on x86
+  if(_BitScanForward(&localIndex, uint32_t(bits)))
+    return localIndex;
+  return _BitScanForward(&localIndex, uint32_t(bits >> 32)) ? localIndex + 32 : 64;
+#endif
 }
 
 inline size_t ctz(uint32_t bits)
@@ -111,10 +109,20 @@ inline size_t ctz(uint32_t bits)
   unsigned long localIndex;
   return _BitScanForward(&localIndex, bits) ? localIndex : 32;
 }
+
+inline size_t popcount(uint64_t bits)
+{
+#if defined(NV_X64)
+  return size_t(__popcnt64(bits));
+#else
+  // no 64-bit popcnt on x86
+  return size_t(__popcnt(uint32_t(bits)) + __popcnt(uint32_t(bits >> 32)));
+#endif
+}
 #else
 inline size_t ctz(uint64_t bits)
 {
-  return (bits != 0) ? __builtin_ctzl(bits) : 64;
+  return (bits != 0) ? __builtin_ctzll(bits) : 64;
 }
 
 inline size_t ctz(uint32_t bits)
@@ -122,37 +130,23 @@ inline size_t ctz(uint32_t bits)
   return (bits != 0) ? __builtin_ctz(bits) : 32;
 }
 
-// TODO implement GCC version!
+inline size_t popcount(uint64_t bits)
+{
+  return size_t(__builtin_popcountll(bits));
+}
+#endif
+
+/** \brief Call visitor(index) for each bit set in bits, one overload for all unsigned types up to 64 bits **/
 template <typename BitType, typename Visitor>
-inline void bitTraverse(BitType bits, Visitor visitor)
+inline typename std::enable_if<std::is_unsigned<BitType>::value>::type bitTraverse(BitType bits, Visitor& visitor)
 {
-  size_t index = 0;
+  static_assert(sizeof(BitType) <= sizeof(uint64_t), "at most 64 bits");
   while(bits)
   {
-    if(bits & 0xff)  // skip ifs if the byte is 0
-    {
-      if(bits & 0x01)
-        visitor(index + 0);
-      if(bits & 0x02)
-        visitor(index + 1);
-      if(bits & 0x04)
-        visitor(index + 2);
-      if(bits & 0x08)
-        visitor(index + 3);
-      if(bits & 0x10)
-        visitor(index + 4);
-      if(bits & 0x20)
-        visitor(index + 5);
-      if(bits & 0x40)
-        visitor(index + 6);
-      if(bits & 0x80)
-        visitor(index + 7);
-    }
-    bits >>= 8;
-    index += 8;
+    visitor(ctz(uint64_t(bits)));
+    bits &= bits - 1;  // clear the lowest set bit
   }
 }
-#endif
 
 /** \brief Call visitor(index) for each bit set **/
 template <typename BitType, typename Visitor>
@@ -189,10 +183,18 @@ public:
   BitArray& operator^=(BitArray const& rhs);
   BitArray& operator&=(BitArray const& rhs);
   BitArray& operator|=(BitArray const& rhs);
+  /** \brief this = this & ~rhs **/
+  BitArray& andNot(BitArray const& rhs);
 
   void clear();
   void fill();
 
+  /** \brief Set or clear all bits within [begin, end) **/
+  void setBits(size_t begin, size_t end, bool value);
+
+  /** \brief Number of set bits **/
+  size_t countBits() const;
+
   /** \brief Change the number of bits in this array. The state of remaining bits is being kept.
                New bits will be initialized to false.
         \param size New number of bits in this array
@@ -213,6 +215,12 @@ public:
   template <typename Visitor>
   void traverseBits(Visitor visitor);
 
+  /** \brief Same as traverseBits but splits the array on element boundaries across the jobSystem.
+        The visitor is shared by all threads. grainElements 0 lets the jobSystem pick a size.
+    **/
+  template <typename Visitor>
+  void traverseBitsParallel(Visitor& visitor, JobSystem& jobSystem, size_t grainElements = 0);
+
   size_t countLeadingZeroes() const;
 
 private:
@@ -300,6 +308,18 @@ inline void BitArray::traverseBits(Visitor visitor)
   bitTraverse(m_bits, determineNumberOfElements(), visitor);
 }
 
+template <typename Visitor>
+inline void BitArray::traverseBitsParallel(Visitor& visitor, JobSystem& jobSystem, size_t grainElements)
+{
+  jobSystem.parallelFor(
+      0, determineNumberOfElements(),
+      [&](size_t begin, size_t end, uint32_t) {
+        OffsetVisitor<Visitor> offsetVisitor(visitor, begin * StorageBitsPerElement);
+        bitTraverse(m_bits + begin, end - begin, offsetVisitor);
+      },
+      grainElements);
+}
+
 inline void BitArray::clearUnusedBits()
 {
   if(m_size)
@@ -318,6 +338,54 @@ inline void BitArray::setUnusedBits()
     m_bits[determineNumberOfElements() - 1] |= ~BitStorageType(0) << usedBitsInLastElement;
   }
 }
+
+//////////////////////////////////////////////////////////////////////////
+/**
+    \class nvh::BitRankIndex
+
+    \brief The nvh::BitRankIndex class stores the prefix population counts of a BitArray.
+
+    One count is kept per block of 8 storage elements (512 bits), so rank
+    needs at most 8 popcounts and select a binary search over the blocks.
+    The index references the array's bits and must be rebuilt after the
+    array was modified or resized.
+
+    \code{.cpp}
+    BitRankIndex rankIndex;
+    rankIndex.build(visibleObjects);
+
+    // compact index of a visible object within the list of visible objects
+    size_t compactIndex = rankIndex.rank(objectIndex);
+    // and back
+    size_t objectIndex = rankIndex.select(compactIndex);
+    \endcode
+  */
+
+class BitRankIndex
+{
+public:
+  void build(const BitArray& bits);
+
+  /** \brief Number of set bits before index, index can be up to getSize() **/
+  size_t rank(size_t index) const;
+  /** \brief Index of the n-th (zero based) set bit, getSize() if there are not enough **/
+  size_t select(size_t n) const;
+
+  size_t getCount() const { return m_blockRanks.empty() ? 0 : m_blockRanks.back(); }
+  size_t getSize() const { return m_size; }
+
+private:
+  enum
+  {
+    ElementsPerBlock = 8
+  };
+
+  const BitArray::BitStorageType* m_bits        = nullptr;
+  size_t                          m_size        = 0;
+  size_t                          m_numElements = 0;
+  // set bits before each block, last entry holds the total
+  std::vector<size_t> m_blockRanks;
+};
 }  // namespace nvh
 
 
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/// \nodoc (keyword to exclude this file from automatic README.md generation)
+
+#pragma once
+
+#ifndef NVH_CPUFEATURES_HPP
+#define NVH_CPUFEATURES_HPP 1
+
+#include <atomic>
+
+// NVH_CPU_AVX2 is 1 when AVX2 code can be compiled independently of the
+// compiler's target flags. Such functions must be marked with NVH_TARGET_AVX2
+// and only be called if nvh::cpuSupportsAVX2() returns true.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define NVH_CPU_AVX2 1
+#define NVH_TARGET_AVX2
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NVH_CPU_AVX2 1
+#define NVH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NVH_CPU_AVX2 0
+#define NVH_TARGET_AVX2
+#endif
+
+namespace nvh {
+namespace detail {
+inline bool cpuDetectAVX2()
+{
+#if defined(__AVX2__)
+  return true;
+#elif NVH_CPU_AVX2 && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7)
+  {
+    return false;
+  }
+  // AVX and OSXSAVE, then the OS must preserve the ymm registers
+  __cpuid(info, 1);
+  if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif NVH_CPU_AVX2
+  // also checks the OS support
+  return __builtin_cpu_supports("avx2") != 0;
+#else
+  return false;
+#endif
+}
+
+inline std::atomic<bool>& cpuAVX2State()
+{
+  static std::atomic<bool> state(cpuDetectAVX2());
+  return state;
+}
+}  // namespace detail
+
+// true if the CPU and OS support AVX2 and it was not disabled
+inline bool cpuSupportsAVX2()
+{
+  return detail::cpuAVX2State().load(std::memory_order_relaxed);
+}
+
+// forces the scalar fallbacks, to test and benchmark them on AVX2 machines
+inline void cpuDisableAVX2(bool disable)
+{
+  detail::cpuAVX2State().store(!disable && detail::cpuDetectAVX2(), std::memory_order_relaxed);
+}
+}  // namespace nvh
+
+#endif  // !NVH_CPUFEATURES_HPP
@@ -19,7 +19,9 @@
 
 
 #include "filemapping.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <stdint.h>
 
 #if defined(LINUX)
 #include <errno.h>
@@ -209,6 +211,37 @@ void FileMapping::close()
   }
 }
 
+bool FileMapping::advise(size_t offset, size_t size, Advice advice) const
+{
+  if(!m_isValid || offset >= m_mappingSize || !size)
+  {
+    return false;
+  }
+
+  size = std::min(size, m_mappingSize - offset);
+
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602)
+  if(advice == ADVICE_WILLNEED)
+  {
+    WIN32_MEMORY_RANGE_ENTRY entry;
+    entry.VirtualAddress = (uint8_t*)m_mappingPtr + offset;
+    entry.NumberOfBytes  = size;
+    return PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0) != 0;
+  }
+#endif
+  (void)advice;
+  return false;
+#elif defined(LINUX)
+  // mapping starts page aligned
+  size_t begin = offset & ~(g_pageSize - 1);
+  return madvise((uint8_t*)m_mappingPtr + begin, size + (offset - begin), advice == ADVICE_WILLNEED ? MADV_WILLNEED : MADV_DONTNEED) == 0;
+#else
+  (void)advice;
+  return false;
+#endif
+}
+
 size_t FileMapping::g_pageSize = 0;
 
 }  // namespace nvh
@@ -65,10 +65,21 @@ public:
     MAPPING_READOVERWRITE,  // creates new file with read/write access, overwriting existing files
   };
 
+  enum Advice
+  {
+    ADVICE_WILLNEED,  // range will be accessed soon, start reading it in
+    ADVICE_DONTNEED,  // range is not needed for now, its pages can leave the working set
+  };
+
   // fileSize only for write access
   bool open(const char* filename, MappingType mappingType, size_t fileSize = 0);
   void close();
 
+  // hint for upcoming accesses to [offset, offset + size) of the mapping,
+  // pages are always faulted in on demand regardless.
+  // returns false if the hint is not supported
+  bool advise(size_t offset, size_t size, Advice advice) const;
+
   const void* data() const { return m_mappingPtr; }
   void*       data() { return m_mappingPtr; }
   size_t      size() const { return m_mappingSize; }
@@ -106,6 +117,9 @@ public:
   const void* data() const { return m_mappingPtr; }
   size_t      size() const { return m_fileSize; }
   bool        valid() const { return m_isValid; }
+  bool        advise(size_t offset, size_t size, Advice advice) const { return FileMapping::advise(offset, size, advice); }
+
+  using FileMapping::Advice;
 };
 
 class FileReadOverWriteMapping : private FileMapping
@@ -19,12 +19,23 @@
 
 
 #include "gltfscene.hpp"
+#include "cpufeatures.hpp"
+#include "jobsystem.hpp"
 #include "nvprint.hpp"
+#include <NvFoundation.h>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 #include <limits>
 #include <set>
-#include <sstream>
+#include <type_traits>
+
+#if defined(NV_X86) || defined(NV_X64)
+#define GLTF_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define GLTF_USE_SSE 0
+#endif
 
 namespace nvh {
 
@@ -248,13 +259,10 @@ void GltfScene::importMaterials(const tinygltf::Model& tmodel)
 //--------------------------------------------------------------------------------------------------
 // Linearize the scene graph to world space nodes.
 //
-void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttributes attributes)
+void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttributes attributes, JobSystem* jobSystem)
 {
   checkRequiredExtensions(tmodel);
 
-  // Find the number of vertex(attributes) and index
-  //uint32_t nbVert{0};
-  uint32_t nbIndex{0};
   uint32_t meshCnt{0};  // use for mesh to new meshes
   uint32_t primCnt{0};  //  "   "  "  "
   for(const auto& mesh : tmodel.meshes)
@@ -264,34 +272,62 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
     {
       if(primitive.mode != 4)  // Triangle
         continue;
-      const auto& posAccessor = tmodel.accessors[primitive.attributes.find("POSITION")->second];
-      //nbVert += static_cast<uint32_t>(posAccessor.count);
-      if(primitive.indices > -1)
-      {
-        const auto& indexAccessor = tmodel.accessors[primitive.indices];
-        nbIndex += static_cast<uint32_t>(indexAccessor.count);
-      }
-      else
-      {
-        nbIndex += static_cast<uint32_t>(posAccessor.count);
-      }
       vprim.emplace_back(primCnt++);
     }
     m_meshToPrimMeshes[meshCnt++] = std::move(vprim);  // mesh-id = { prim0, prim1, ... }
   }
 
-  // Reserving memory
-  m_indices.reserve(nbIndex);
-
-  // Convert all mesh/primitives+ to a single primitive per mesh
+  // Sizing pass: convert all mesh/primitives+ to a single primitive per mesh,
+  // computing where the indices and the vertices of each primitive go
+  uint32_t                                vertexTotal = static_cast<uint32_t>(m_positions.size());
+  uint32_t                                indexTotal  = static_cast<uint32_t>(m_indices.size());
+  size_t                                  primBase    = m_primMeshes.size();
+  std::vector<const tinygltf::Primitive*> primitives;
+  std::vector<uint8_t>                    ownsVertices;
+  primitives.reserve(primCnt);
+  ownsVertices.reserve(primCnt);
+  m_primMeshes.reserve(primBase + primCnt);
   for(const auto& tmesh : tmodel.meshes)
   {
     for(const auto& tprimitive : tmesh.primitives)
     {
-      processMesh(tmodel, tprimitive, attributes, tmesh.name);
+      bool owns = false;
+      if(sizeMesh(tmodel, tprimitive, tmesh.name, vertexTotal, indexTotal, owns))
+      {
+        primitives.push_back(&tprimitive);
+        ownsVertices.push_back(owns ? 1 : 0);
+      }
     }
   }
 
+  m_indices.resize(indexTotal);
+  m_positions.resize(vertexTotal);
+  if((attributes & GltfAttributes::Normal) == GltfAttributes::Normal)
+    m_normals.resize(vertexTotal);
+  if((attributes & GltfAttributes::Texcoord_0) == GltfAttributes::Texcoord_0)
+    m_texcoords0.resize(vertexTotal);
+  if((attributes & GltfAttributes::Tangent) == GltfAttributes::Tangent)
+    m_tangents.resize(vertexTotal);
+  if((attributes & GltfAttributes::Color_0) == GltfAttributes::Color_0)
+    m_colors0.resize(vertexTotal);
+
+  // Decoding pass: primitives only write to their own ranges
+  JobSystem localJobs;
+  if(!jobSystem)
+  {
+    localJobs.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    jobSystem = &localJobs;
+  }
+  jobSystem->parallelFor(
+      0, primitives.size(),
+      [&](size_t begin, size_t end, uint32_t) {
+        for(size_t i = begin; i < end; i++)
+        {
+          processMesh(tmodel, *primitives[i], attributes, m_primMeshes[primBase + i], ownsVertices[i] != 0);
+        }
+      },
+      1);
+
   // Transforming the scene hierarchy to a flat list
   int         defaultScene = tmodel.defaultScene > -1 ? tmodel.defaultScene : 0;
   const auto& tscene       = tmodel.scenes[defaultScene];
@@ -304,9 +340,6 @@ void GltfScene::importDrawableNodes(const tinygltf::Model& tmodel, GltfAttribute
   computeCamera();
 
   m_meshToPrimMeshes.clear();
-  primitiveIndices32u.clear();
-  primitiveIndices16u.clear();
-  primitiveIndices8u.clear();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -379,109 +412,164 @@ void GltfScene::processNode(const tinygltf::Model& tmodel, int& nodeIdx, const n
 }
 
 //--------------------------------------------------------------------------------------------------
-// Extracting the values to a linear buffer
+// Hashing the attribute names and accessors of a primitive
+//
+size_t GltfScene::PrimKeyHash::operator()(const PrimKey& key) const
+{
+  // https://www.boost.org/doc/libs/1_35_0/doc/html/boost/hash_combine_id241013.html
+  size_t seed = 0;
+  for(const auto& attrib : key)
+  {
+    seed ^= std::hash<std::string>()(attrib.first) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= std::hash<int>()(attrib.second) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+  return seed;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Adding the primitive to m_primMeshes with the offsets of its indices and vertices.
+// Vertices are only added for the first primitive using a set of attributes,
+// in which case ownsVertices is set. Returns false if the primitive is skipped.
 //
-void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name)
+bool GltfScene::sizeMesh(const tinygltf::Model&     tmodel,
+                         const tinygltf::Primitive& tmesh,
+                         const std::string&         name,
+                         uint32_t&                  vertexTotal,
+                         uint32_t&                  indexTotal,
+                         bool&                      ownsVertices)
 {
   // Only triangles are supported
   // 0:point, 1:lines, 2:line_loop, 3:line_strip, 4:triangles, 5:triangle_strip, 6:triangle_fan
   if(tmesh.mode != 4)
-    return;
+    return false;
 
   GltfPrimMesh resultMesh;
   resultMesh.name          = name;
   resultMesh.materialIndex = std::max(0, tmesh.material);
-  resultMesh.vertexOffset  = static_cast<uint32_t>(m_positions.size());
-  resultMesh.firstIndex    = static_cast<uint32_t>(m_indices.size());
+  resultMesh.vertexOffset  = vertexTotal;
+  resultMesh.firstIndex    = indexTotal;
 
   // Create a key made of the attributes, to see if the primitive was already
   // processed. If it is, we will re-use the cache, but allow the material and
   // indices to be different.
-  std::stringstream o;
-  for(auto& a : tmesh.attributes)
-  {
-    o << a.first << a.second;
-  }
-  std::string key            = o.str();
-  bool        primMeshCached = false;
+  PrimKey key(tmesh.attributes.begin(), tmesh.attributes.end());
+  ownsVertices = true;
 
   // Found a cache - will not need to append vertex
   auto it = m_cachePrimMesh.find(key);
   if(it != m_cachePrimMesh.end())
   {
-    primMeshCached          = true;
-    GltfPrimMesh cacheMesh  = it->second;
-    resultMesh.vertexCount  = cacheMesh.vertexCount;
-    resultMesh.vertexOffset = cacheMesh.vertexOffset;
+    ownsVertices            = false;
+    resultMesh.vertexCount  = it->second.vertexCount;
+    resultMesh.vertexOffset = it->second.vertexOffset;
   }
 
+  // INDICES
+  if(tmesh.indices > -1)
+  {
+    const tinygltf::Accessor& indexAccessor = tmodel.accessors[tmesh.indices];
+    switch(indexAccessor.componentType)
+    {
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+        break;
+      default:
+        std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
+        return false;
+    }
+    resultMesh.indexCount = static_cast<uint32_t>(indexAccessor.count);
+  }
+  else
+  {
+    // Primitive without indices, they will be created
+    const auto& accessor  = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
+    resultMesh.indexCount = static_cast<uint32_t>(accessor.count);
+  }
 
+  if(ownsVertices)
+  {
+    // Keeping the size of this primitive (Spec says this is required information)
+    const auto& accessor   = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
+    resultMesh.vertexCount = static_cast<uint32_t>(accessor.count);
+    if(!accessor.minValues.empty())
+      resultMesh.posMin = nvmath::vec3f(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+    if(!accessor.maxValues.empty())
+      resultMesh.posMax = nvmath::vec3f(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+    vertexTotal += resultMesh.vertexCount;
+  }
+  indexTotal += resultMesh.indexCount;
+
+  // Keep result in cache
+  m_cachePrimMesh[std::move(key)] = resultMesh;
+
+  // Append prim mesh to the list of all primitive meshes
+  m_primMeshes.emplace_back(resultMesh);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Widening the indices of a primitive to 32 bit
+//
+template <typename T>
+static void copyIndices(const uint8_t* src, size_t count, uint32_t* dst)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    T index;
+    memcpy(&index, src + i * sizeof(T), sizeof(T));
+    dst[i] = index;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Filling the ranges of the primitive sized by sizeMesh, the vertices are only
+// written (and normals, texcoords, tangents generated) when it owns them.
+// Safe to call concurrently for different primitives.
+//
+void GltfScene::processMesh(const tinygltf::Model&     tmodel,
+                            const tinygltf::Primitive& tmesh,
+                            GltfAttributes             attributes,
+                            const GltfPrimMesh&        resultMesh,
+                            bool                       ownsVertices)
+{
   // INDICES
+  uint32_t* indices = m_indices.data() + resultMesh.firstIndex;
   if(tmesh.indices > -1)
   {
     const tinygltf::Accessor&   indexAccessor = tmodel.accessors[tmesh.indices];
     const tinygltf::BufferView& bufferView    = tmodel.bufferViews[indexAccessor.bufferView];
     const tinygltf::Buffer&     buffer        = tmodel.buffers[bufferView.buffer];
-
-    resultMesh.indexCount = static_cast<uint32_t>(indexAccessor.count);
+    const uint8_t*              data          = &buffer.data[indexAccessor.byteOffset + bufferView.byteOffset];
 
     switch(indexAccessor.componentType)
     {
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-        primitiveIndices32u.resize(indexAccessor.count);
-        memcpy(primitiveIndices32u.data(), &buffer.data[indexAccessor.byteOffset + bufferView.byteOffset],
-               indexAccessor.count * sizeof(uint32_t));
-        m_indices.insert(m_indices.end(), primitiveIndices32u.begin(), primitiveIndices32u.end());
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+        memcpy(indices, data, indexAccessor.count * sizeof(uint32_t));
         break;
-      }
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-        primitiveIndices16u.resize(indexAccessor.count);
-        memcpy(primitiveIndices16u.data(), &buffer.data[indexAccessor.byteOffset + bufferView.byteOffset],
-               indexAccessor.count * sizeof(uint16_t));
-        m_indices.insert(m_indices.end(), primitiveIndices16u.begin(), primitiveIndices16u.end());
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+        copyIndices<uint16_t>(data, indexAccessor.count, indices);
         break;
-      }
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-        primitiveIndices8u.resize(indexAccessor.count);
-        memcpy(primitiveIndices8u.data(), &buffer.data[indexAccessor.byteOffset + bufferView.byteOffset],
-               indexAccessor.count * sizeof(uint8_t));
-        m_indices.insert(m_indices.end(), primitiveIndices8u.begin(), primitiveIndices8u.end());
+      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+        copyIndices<uint8_t>(data, indexAccessor.count, indices);
         break;
-      }
-      default:
-        std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
-        return;
     }
   }
   else
   {
     // Primitive without indices, creating them
-    const auto& accessor = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
-    for(auto i = 0; i < accessor.count; i++)
-      m_indices.push_back(i);
-    resultMesh.indexCount = static_cast<uint32_t>(accessor.count);
+    std::iota(indices, indices + resultMesh.indexCount, 0u);
   }
 
-  if(primMeshCached == false)  // Need to add this primitive
+  if(ownsVertices)  // First primitive using these vertices
   {
-
     // POSITION
-    {
-      bool result = getAttribute<nvmath::vec3f>(tmodel, tmesh, m_positions, "POSITION");
-
-      // Keeping the size of this primitive (Spec says this is required information)
-      const auto& accessor   = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
-      resultMesh.vertexCount = static_cast<uint32_t>(accessor.count);
-      if(!accessor.minValues.empty())
-        resultMesh.posMin = nvmath::vec3f(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
-      if(!accessor.maxValues.empty())
-        resultMesh.posMax = nvmath::vec3f(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
-    }
+    getAttribute<nvmath::vec3f>(tmodel, tmesh, &m_positions[resultMesh.vertexOffset], resultMesh.vertexCount, "POSITION");
 
     // NORMAL
     if((attributes & GltfAttributes::Normal) == GltfAttributes::Normal)
     {
-      if(!getAttribute<nvmath::vec3f>(tmodel, tmesh, m_normals, "NORMAL"))
+      if(!getAttribute<nvmath::vec3f>(tmodel, tmesh, &m_normals[resultMesh.vertexOffset], resultMesh.vertexCount, "NORMAL"))
       {
         // Need to compute the normals
         std::vector<nvmath::vec3f> geonormal(resultMesh.vertexCount);
@@ -502,14 +590,14 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
         }
         for(auto& n : geonormal)
           n = nvmath::normalize(n);
-        m_normals.insert(m_normals.end(), geonormal.begin(), geonormal.end());
+        std::copy(geonormal.begin(), geonormal.end(), m_normals.begin() + resultMesh.vertexOffset);
       }
     }
 
     // TEXCOORD_0
     if((attributes & GltfAttributes::Texcoord_0) == GltfAttributes::Texcoord_0)
     {
-      if(!getAttribute<nvmath::vec2f>(tmodel, tmesh, m_texcoords0, "TEXCOORD_0"))
+      if(!getAttribute<nvmath::vec2f>(tmodel, tmesh, &m_texcoords0[resultMesh.vertexOffset], resultMesh.vertexCount, "TEXCOORD_0"))
       {
         // Set them all to zero
         //      m_texcoords0.insert(m_texcoords0.end(), resultMesh.vertexCount, nvmath::vec2f(0, 0));
@@ -587,7 +675,7 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
           float u = 0.5f * (uc / maxAxis + 1.0f);
           float v = 0.5f * (vc / maxAxis + 1.0f);
 
-          m_texcoords0.emplace_back(u, v);
+          m_texcoords0[resultMesh.vertexOffset + i] = nvmath::vec2f(u, v);
         }
       }
     }
@@ -596,7 +684,7 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
     // TANGENT
     if((attributes & GltfAttributes::Tangent) == GltfAttributes::Tangent)
     {
-      if(!getAttribute<nvmath::vec4f>(tmodel, tmesh, m_tangents, "TANGENT"))
+      if(!getAttribute<nvmath::vec4f>(tmodel, tmesh, &m_tangents[resultMesh.vertexOffset], resultMesh.vertexCount, "TANGENT"))
       {
         // #TODO - Should calculate tangents using default MikkTSpace algorithms
         // See: https://github.com/mmikk/MikkTSpace
@@ -676,7 +764,7 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
 
           // Calculate handedness
           float handedness = (nvmath::dot(nvmath::cross(n, t), b) < 0.0F) ? -1.0F : 1.0F;
-          m_tangents.emplace_back(otangent.x, otangent.y, otangent.z, handedness);
+          m_tangents[resultMesh.vertexOffset + a] = nvmath::vec4f(otangent.x, otangent.y, otangent.z, handedness);
         }
       }
     }
@@ -684,20 +772,15 @@ void GltfScene::processMesh(const tinygltf::Model& tmodel, const tinygltf::Primi
     // COLOR_0
     if((attributes & GltfAttributes::Color_0) == GltfAttributes::Color_0)
     {
-      if(!getAttribute<nvmath::vec4f>(tmodel, tmesh, m_colors0, "COLOR_0"))
+      if(!getAttribute<nvmath::vec4f>(tmodel, tmesh, &m_colors0[resultMesh.vertexOffset], resultMesh.vertexCount, "COLOR_0"))
       {
         // Set them all to one
-        m_colors0.insert(m_colors0.end(), resultMesh.vertexCount, nvmath::vec4f(1, 1, 1, 1));
+        std::fill_n(m_colors0.begin() + resultMesh.vertexOffset, resultMesh.vertexCount, nvmath::vec4f(1, 1, 1, 1));
       }
     }
   }
 
-  // Keep result in cache
-  m_cachePrimMesh[key] = resultMesh;
-
-  // Append prim mesh to the list of all primitive meshes
-  m_primMeshes.emplace_back(resultMesh);
-}  // namespace nvh
+}
 
 //--------------------------------------------------------------------------------------------------
 // Return the matrix of the node
@@ -751,9 +834,6 @@ void GltfScene::destroy()
   //m_weights0.clear();
   m_dimensions = {};
   m_meshToPrimMeshes.clear();
-  primitiveIndices32u.clear();
-  primitiveIndices16u.clear();
-  primitiveIndices8u.clear();
   m_cachePrimMesh.clear();
 }
 
@@ -892,6 +972,7 @@ void GltfScene::checkRequiredExtensions(const tinygltf::Model& tmodel)
       KHR_MATERIALS_VOLUME_EXTENSION_NAME,
       KHR_MATERIALS_TRANSMISSION_EXTENSION_NAME,
       KHR_TEXTURE_BASISU_NAME,
+      KHR_MESH_QUANTIZATION_EXTENSION_NAME,
   };
 
   for(auto& e : tmodel.extensionsRequired)
@@ -906,4 +987,302 @@ void GltfScene::checkRequiredExtensions(const tinygltf::Model& tmodel)
   }
 }
 
+//--------------------------------------------------------------------------------------------------
+// Attribute decoding
+//
+// The SIMD paths divide like the scalar one, so the results are identical.
+// Contiguous data with as many source as destination components is converted
+// as a flat array, other layouts are converted one element (up to 4 components)
+// at a time, reading and writing whole vectors as long as it stays within the
+// source elements and the destination array.
+//
+template <typename C>
+static inline float decodeComponent(C value, bool normalized)
+{
+  if constexpr(std::is_integral<C>::value)
+  {
+    if(normalized)
+    {
+      float result = float(value) / float(std::numeric_limits<C>::max());
+      return std::is_signed<C>::value ? std::max(result, -1.f) : result;
+    }
+  }
+  return float(value);
+}
+
+template <typename C>
+static void decodeScalar(float*         dst,
+                         uint32_t       dstComponents,
+                         const uint8_t* src,
+                         size_t         srcStride,
+                         uint32_t       numComponents,
+                         bool           normalized,
+                         size_t         begin,
+                         size_t         end)
+{
+  for(size_t i = begin; i < end; i++)
+  {
+    const uint8_t* element = src + i * srcStride;
+    float*         result  = dst + i * dstComponents;
+    for(uint32_t c = 0; c < numComponents; c++)
+    {
+      C value;
+      memcpy(&value, element + c * sizeof(C), sizeof(C));
+      result[c] = decodeComponent(value, normalized);
+    }
+    for(uint32_t c = numComponents; c < dstComponents; c++)
+    {
+      result[c] = c == 3 ? 1.f : 0.f;
+    }
+  }
+}
+
+#if GLTF_USE_SSE
+template <typename C>
+static inline __m128 decodeNormalized(__m128 value)
+{
+  value = _mm_div_ps(value, _mm_set1_ps(float(std::numeric_limits<C>::max())));
+  return std::is_signed<C>::value ? _mm_max_ps(value, _mm_set1_ps(-1.f)) : value;
+}
+
+// converts the 4 lowest components of v, which have been zero or sign extended to 32 bit
+template <typename C>
+static inline __m128 decodeInt32(__m128i v, bool normalized)
+{
+  __m128 value = _mm_cvtepi32_ps(v);
+  return normalized ? decodeNormalized<C>(value) : value;
+}
+
+// reads 4 components, that is 16 bytes for floats, 8 for shorts, 4 for bytes
+template <typename C>
+static inline __m128 decodeElement(const uint8_t* element, bool normalized)
+{
+  if constexpr(std::is_same<C, float>::value)
+  {
+    return _mm_loadu_ps(reinterpret_cast<const float*>(element));
+  }
+  else if constexpr(sizeof(C) == 2)
+  {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(element));
+    v = std::is_signed<C>::value ? _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16) : _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    return decodeInt32<C>(v, normalized);
+  }
+  else
+  {
+    int32_t bytes;
+    memcpy(&bytes, element, sizeof(bytes));
+    __m128i v = _mm_cvtsi32_si128(bytes);
+    if(std::is_signed<C>::value)
+    {
+      v = _mm_unpacklo_epi8(v, v);
+      v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+    }
+    else
+    {
+      v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+      v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    }
+    return decodeInt32<C>(v, normalized);
+  }
+}
+
+template <typename C>
+static size_t decodeElementsSSE(float*         dst,
+                                uint32_t       dstComponents,
+                                const uint8_t* src,
+                                size_t         srcStride,
+                                uint32_t       srcComponents,
+                                uint32_t       numComponents,
+                                bool           normalized,
+                                size_t         count)
+{
+  // last element that can be read and written as a whole vector
+  const size_t readSize = 4 * sizeof(C);
+  const size_t elemSize = srcComponents * sizeof(C);
+  size_t       end      = count;
+  while(end > 0 && (count - end) * srcStride + elemSize < readSize)
+  {
+    end--;
+  }
+  if(dstComponents == 3 && end == count && end > 0)
+  {
+    end--;
+  }
+
+  // components missing in the source get 0, and 1 for the fourth
+  static const uint32_t maskBits[4][4] = {{~0u, 0, 0, 0}, {~0u, ~0u, 0, 0}, {~0u, ~0u, ~0u, 0}, {~0u, ~0u, ~0u, ~0u}};
+  const __m128 mask     = _mm_loadu_ps(reinterpret_cast<const float*>(maskBits[numComponents - 1]));
+  const __m128 defaults = _mm_andnot_ps(mask, _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+
+  for(size_t i = 0; i < end; i++)
+  {
+    __m128 value  = decodeElement<C>(src + i * srcStride, normalized);
+    value         = _mm_or_ps(_mm_and_ps(value, mask), defaults);
+    float* result = dst + i * dstComponents;
+    switch(dstComponents)
+    {
+      case 1:
+        _mm_store_ss(result, value);
+        break;
+      case 2:
+        _mm_storel_pi(reinterpret_cast<__m64*>(result), value);
+        break;
+      default:
+        // with 3 components, the fourth is overwritten by the next element
+        _mm_storeu_ps(result, value);
+        break;
+    }
+  }
+  return end;
+}
+
+#if NVH_CPU_AVX2
+// flat array of 8 or 16 bit integers, eight at a time, returns how many were converted
+template <typename C>
+NVH_TARGET_AVX2 static size_t decodeFlatAVX2(float* dst, const C* src, bool normalized, size_t count)
+{
+  size_t       i     = 0;
+  const __m256 scale = _mm256_set1_ps(float(std::numeric_limits<C>::max()));
+  for(; i + 8 <= count; i += 8)
+  {
+    __m128i v = sizeof(C) == 2 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)) :
+                                 _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    __m256i v32;
+    if(sizeof(C) == 2)
+      v32 = std::is_signed<C>::value ? _mm256_cvtepi16_epi32(v) : _mm256_cvtepu16_epi32(v);
+    else
+      v32 = std::is_signed<C>::value ? _mm256_cvtepi8_epi32(v) : _mm256_cvtepu8_epi32(v);
+
+    __m256 value = _mm256_cvtepi32_ps(v32);
+    if(normalized)
+    {
+      value = _mm256_div_ps(value, scale);
+      if(std::is_signed<C>::value)
+        value = _mm256_max_ps(value, _mm256_set1_ps(-1.f));
+    }
+    _mm256_storeu_ps(dst + i, value);
+  }
+  return i;
+}
+#endif
+
+// flat array of integers, returns how many were converted.
+// Uses AVX2 if the CPU supports it, regardless of the compiler's target flags.
+template <typename C>
+static size_t decodeFlatSSE(float* dst, const C* src, bool normalized, size_t count)
+{
+  size_t i = 0;
+#if NVH_CPU_AVX2
+  if(cpuSupportsAVX2())
+  {
+    i = decodeFlatAVX2<C>(dst, src, normalized, count);
+  }
+#endif
+  const size_t step = 16 / sizeof(C);
+  for(; i + step <= count; i += step)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    // bytes are first widened to two vectors of shorts
+    const size_t numShorts = 3 - sizeof(C);
+    __m128i      v16[2];
+    if(sizeof(C) == 1)
+    {
+      v16[0] = std::is_signed<C>::value ? _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8) : _mm_unpacklo_epi8(v, _mm_setzero_si128());
+      v16[1] = std::is_signed<C>::value ? _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8) : _mm_unpackhi_epi8(v, _mm_setzero_si128());
+    }
+    else
+    {
+      v16[0] = v;
+    }
+    for(size_t h = 0; h < numShorts; h++)
+    {
+      __m128i lo = std::is_signed<C>::value ? _mm_srai_epi32(_mm_unpacklo_epi16(v16[h], v16[h]), 16) :
+                                              _mm_unpacklo_epi16(v16[h], _mm_setzero_si128());
+      __m128i hi = std::is_signed<C>::value ? _mm_srai_epi32(_mm_unpackhi_epi16(v16[h], v16[h]), 16) :
+                                              _mm_unpackhi_epi16(v16[h], _mm_setzero_si128());
+      _mm_storeu_ps(dst + i + h * 8 + 0, decodeInt32<C>(lo, normalized));
+      _mm_storeu_ps(dst + i + h * 8 + 4, decodeInt32<C>(hi, normalized));
+    }
+  }
+  return i;
+}
+#endif
+
+template <typename C>
+static void decodeTyped(float*         dst,
+                        uint32_t       dstComponents,
+                        const uint8_t* src,
+                        size_t         srcStride,
+                        uint32_t       srcComponents,
+                        bool           normalized,
+                        size_t         count)
+{
+  uint32_t numComponents = std::min(srcComponents, dstComponents);
+  size_t   begin         = 0;
+
+  if(srcComponents == dstComponents && srcStride == srcComponents * sizeof(C))
+  {
+    if constexpr(std::is_same<C, float>::value)
+    {
+      memcpy(dst, src, count * srcStride);
+      return;
+    }
+#if GLTF_USE_SSE
+    else if constexpr(sizeof(C) <= 2)
+    {
+      // convert as many whole elements as possible as a flat array
+      size_t flat = decodeFlatSSE<C>(dst, reinterpret_cast<const C*>(src), normalized, count * srcComponents);
+      begin       = flat / srcComponents;
+    }
+#endif
+  }
+#if GLTF_USE_SSE
+  else if constexpr(std::is_same<C, float>::value || sizeof(C) <= 2)
+  {
+    begin = decodeElementsSSE<C>(dst, dstComponents, src, srcStride, srcComponents, numComponents, normalized, count);
+  }
+#endif
+
+  decodeScalar<C>(dst, dstComponents, src, srcStride, numComponents, normalized, begin, count);
+}
+
+bool decodeAttribute(float*         dst,
+                     uint32_t       dstComponents,
+                     const uint8_t* src,
+                     size_t         srcStride,
+                     uint32_t       srcComponents,
+                     int            componentType,
+                     bool           normalized,
+                     size_t         count)
+{
+  if(dstComponents == 0 || dstComponents > 4 || srcComponents == 0 || srcComponents > 4)
+    return false;
+  if(count == 0)
+    return true;
+
+  switch(componentType)
+  {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      decodeTyped<float>(dst, dstComponents, src, srcStride, srcComponents, false, count);
+      return true;
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+      decodeTyped<int8_t>(dst, dstComponents, src, srcStride, srcComponents, normalized, count);
+      return true;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      decodeTyped<uint8_t>(dst, dstComponents, src, srcStride, srcComponents, normalized, count);
+      return true;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+      decodeTyped<int16_t>(dst, dstComponents, src, srcStride, srcComponents, normalized, count);
+      return true;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      decodeTyped<uint16_t>(dst, dstComponents, src, srcStride, srcComponents, normalized, count);
+      return true;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      decodeTyped<uint32_t>(dst, dstComponents, src, srcStride, srcComponents, normalized, count);
+      return true;
+    default:
+      return false;
+  }
+}
+
 }  // namespace nvh
@@ -44,6 +44,14 @@
   //   create descriptorSet for material using directly gltfScene.m_materials
   \endcode
 
+  importDrawableNodes first computes the offsets of all primitives, then
+  decodes them in parallel into the preallocated attribute arrays, using
+  the given nvh::JobSystem or a temporary one. The result is the same as
+  a serial import.
+
+  Attributes can be float or any KHR_mesh_quantization type, strided or not,
+  they are converted to float with SSE (AVX2 if the CPU supports it) by decodeAttribute.
+
 */
 
 #pragma once
@@ -59,6 +67,8 @@
 
 namespace nvh {
 
+class JobSystem;
+
 // https://github.com/KhronosGroup/glTF/blob/master/extensions/2.0/Khronos/KHR_materials_pbrSpecularGlossiness/README.md
 #define KHR_MATERIALS_PBRSPECULARGLOSSINESS_EXTENSION_NAME "KHR_materials_pbrSpecularGlossiness"
 struct KHR_materials_pbrSpecularGlossiness
@@ -153,6 +163,9 @@ struct KHR_texture_basisu
   int source{-1};
 };
 
+// https://github.com/KhronosGroup/glTF/tree/master/extensions/2.0/Khronos/KHR_mesh_quantization
+#define KHR_MESH_QUANTIZATION_EXTENSION_NAME "KHR_mesh_quantization"
+
 // https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#reference-material
 struct GltfMaterial
 {
@@ -270,7 +283,8 @@ inline GltfAttributes operator&(GltfAttributes lhs, GltfAttributes rhs)
 struct GltfScene
 {
   void importMaterials(const tinygltf::Model& tmodel);
-  void importDrawableNodes(const tinygltf::Model& tmodel, GltfAttributes attributes);
+  // jobSystem is optional, without it a temporary one is created
+  void importDrawableNodes(const tinygltf::Model& tmodel, GltfAttributes attributes, JobSystem* jobSystem = nullptr);
   void computeSceneDimensions();
   void destroy();
 
@@ -310,15 +324,26 @@ struct GltfScene
 
 private:
   void processNode(const tinygltf::Model& tmodel, int& nodeIdx, const nvmath::mat4f& parentMatrix);
-  void processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const std::string& name);
+  bool sizeMesh(const tinygltf::Model&     tmodel,
+                const tinygltf::Primitive& tmesh,
+                const std::string&         name,
+                uint32_t&                  vertexTotal,
+                uint32_t&                  indexTotal,
+                bool&                      ownsVertices);
+  void processMesh(const tinygltf::Model& tmodel, const tinygltf::Primitive& tmesh, GltfAttributes attributes, const GltfPrimMesh& resultMesh, bool ownsVertices);
+
+  // Attributes of a primitive as (name, accessor) pairs, primitives with
+  // the same attributes share their vertices
+  using PrimKey = std::vector<std::pair<std::string, int>>;
+  struct PrimKeyHash
+  {
+    size_t operator()(const PrimKey& key) const;
+  };
 
   // Temporary data
   std::unordered_map<int, std::vector<uint32_t>> m_meshToPrimMeshes;
-  std::vector<uint32_t>                          primitiveIndices32u;
-  std::vector<uint16_t>                          primitiveIndices16u;
-  std::vector<uint8_t>                           primitiveIndices8u;
 
-  std::unordered_map<std::string, GltfPrimMesh> m_cachePrimMesh;
+  std::unordered_map<PrimKey, GltfPrimMesh, PrimKeyHash> m_cachePrimMesh;
 
   void computeCamera();
   void checkRequiredExtensions(const tinygltf::Model& tmodel);
@@ -392,11 +417,28 @@ static inline void getTexId(const tinygltf::Value& value, const std::string& nam
   }
 }
 
-// Appending to \p attribVec, all the values of \p attribName
+// Converting \p count elements of \p srcComponents components of \p componentType
+// (TINYGLTF_COMPONENT_TYPE_*), \p srcStride bytes apart, to tightly packed elements
+// of \p dstComponents floats. Integers are converted like glTF normalized values
+// when \p normalized is set, as is otherwise (KHR_mesh_quantization). Destination
+// components missing in the source are 0, except the fourth which is 1.
+// Return false if the component type is not supported
+bool decodeAttribute(float*         dst,
+                     uint32_t       dstComponents,
+                     const uint8_t* src,
+                     size_t         srcStride,
+                     uint32_t       srcComponents,
+                     int            componentType,
+                     bool           normalized,
+                     size_t         count);
+
+// Writing to \p attribData, at most \p maxElems values of \p attribName
 // Return false if the attribute is missing
 template <typename T>
-static bool getAttribute(const tinygltf::Model& tmodel, const tinygltf::Primitive& primitive, std::vector<T>& attribVec, const std::string& attribName)
+static bool getAttribute(const tinygltf::Model& tmodel, const tinygltf::Primitive& primitive, T* attribData, size_t maxElems, const std::string& attribName)
 {
+  static_assert(sizeof(T) % sizeof(float) == 0, "attributes are made of floats");
+
   if(primitive.attributes.find(attribName) == primitive.attributes.end())
     return false;
 
@@ -404,76 +446,34 @@ static bool getAttribute(const tinygltf::Model& tmodel, const tinygltf::Primitiv
   const auto& accessor = tmodel.accessors[primitive.attributes.find(attribName)->second];
   const auto& bufView  = tmodel.bufferViews[accessor.bufferView];
   const auto& buffer   = tmodel.buffers[bufView.buffer];
-  const auto  bufData  = reinterpret_cast<const T*>(&(buffer.data[accessor.byteOffset + bufView.byteOffset]));
-  const auto  nbElems  = accessor.count;
+  const auto  bufData  = &(buffer.data[accessor.byteOffset + bufView.byteOffset]);
+  const auto  nbElems  = std::min(accessor.count, maxElems);
+  const int   stride   = accessor.ByteStride(bufView);
+  if(stride <= 0)
+    return false;
 
-  // Supporting KHR_mesh_quantization
-  assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+  // Float or KHR_mesh_quantization types, strided or not
+  bool result = decodeAttribute(reinterpret_cast<float*>(attribData), uint32_t(sizeof(T) / sizeof(float)), bufData, size_t(stride),
+                                uint32_t(tinygltf::GetNumComponentsInType(accessor.type)), accessor.componentType,
+                                accessor.normalized, nbElems);
+  assert(result && "KHR_mesh_quantization unsupported format");
+  (void)result;
 
-  // Copying the attributes
-  if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT)
-  {
-    if(bufView.byteStride == 0)
-    {
-      attribVec.insert(attribVec.end(), bufData, bufData + nbElems);
-    }
-    else
-    {
-      // With stride, need to add one by one the element
-      auto bufferByte = reinterpret_cast<const uint8_t*>(bufData);
-      for(size_t i = 0; i < nbElems; i++)
-      {
-        attribVec.push_back(*reinterpret_cast<const T*>(bufferByte));
-        bufferByte += bufView.byteStride;
-      }
-    }
-  }
-  else
-  {
-    // The component is smaller than float and need to be converted
-
-    // VEC3 or VEC4
-    int nbComponents = accessor.type == TINYGLTF_TYPE_VEC2 ? 2 : (accessor.type == TINYGLTF_TYPE_VEC3) ? 3 : 4;
-    // UNSIGNED_BYTE or UNSIGNED_SHORT
-    size_t strideComponent = accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE ? 1 : 2;
-
-    size_t byteStride = bufView.byteStride > 0 ? bufView.byteStride : size_t(nbComponents) * strideComponent;
-    auto   bufferByte = reinterpret_cast<const uint8_t*>(bufData);
-    for(size_t i = 0; i < nbElems; i++)
-    {
-      T vecValue;
-
-      auto bufferByteData = bufferByte;
-      for(int c = 0; c < nbComponents; c++)
-      {
-        float value = *reinterpret_cast<const float*>(bufferByteData);
-        switch(accessor.componentType)
-        {
-          case TINYGLTF_COMPONENT_TYPE_BYTE:
-            vecValue[c] = std::max(value / 127.f, -1.f);
-            break;
-          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-            vecValue[c] = value / 255.f;
-            break;
-          case TINYGLTF_COMPONENT_TYPE_SHORT:
-            vecValue[c] = std::max(value / 32767.f, -1.f);
-            break;
-          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-            vecValue[c] = value / 65535.f;
-            break;
-          default:
-            assert(!"KHR_mesh_quantization unsupported format");
-            break;
-        }
-        bufferByteData += strideComponent;
-      }
-      bufferByte += byteStride;
-      attribVec.push_back(vecValue);
-    }
-  }
+  return true;
+}
 
+// Appending to \p attribVec, all the values of \p attribName
+// Return false if the attribute is missing
+template <typename T>
+static bool getAttribute(const tinygltf::Model& tmodel, const tinygltf::Primitive& primitive, std::vector<T>& attribVec, const std::string& attribName)
+{
+  if(primitive.attributes.find(attribName) == primitive.attributes.end())
+    return false;
 
-  return true;
+  const auto&  accessor = tmodel.accessors[primitive.attributes.find(attribName)->second];
+  const size_t offset   = attribVec.size();
+  attribVec.resize(offset + accessor.count);
+  return getAttribute(tmodel, primitive, attribVec.data() + offset, accessor.count, attribName);
 }
 
 inline bool hasExtension(const tinygltf::ExtensionMap& extensions, const std::string& name)
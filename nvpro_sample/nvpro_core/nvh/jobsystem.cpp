@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "jobsystem.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace nvh {
+
+// identifies the workers of a system, threads outside use the last slot
+static thread_local const JobSystem* s_tlsSystem      = nullptr;
+static thread_local uint32_t         s_tlsWorkerIndex = 0;
+
+// how often an idle worker retries stealing before it goes to sleep
+static const uint32_t IDLE_SPIN_COUNT = 64;
+
+struct JobSystem::ForState
+{
+  const RangeFunc* fn;
+  size_t           grainSize;
+  Counter          counter;
+};
+
+void JobSystem::init(uint32_t numWorkers)
+{
+  deinit();
+
+  m_numWorkers = numWorkers;
+  m_stop       = false;
+  m_numQueued  = 0;
+  m_workers    = std::vector<Worker>(numWorkers + 1);
+  for(uint32_t i = 0; i < numWorkers + 1; i++)
+  {
+    m_workers[i].random = i * 0x9E3779B9 + 1;
+  }
+
+  m_threads.reserve(numWorkers);
+  for(uint32_t i = 0; i < numWorkers; i++)
+  {
+    m_threads.emplace_back(&JobSystem::threadProcess, this, i);
+  }
+}
+
+void JobSystem::deinit()
+{
+  if(m_workers.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_sleepCond.notify_all();
+
+  for(auto& thread : m_threads)
+  {
+    thread.join();
+  }
+
+  // without workers nobody else may have left jobs behind
+  assert(m_numWorkers == 0 || m_numQueued == 0);
+
+  m_threads.clear();
+  m_workers.clear();
+  m_deferred.clear();
+  m_numWorkers  = 0;
+  m_numDeferred = 0;
+}
+
+uint32_t JobSystem::getWorkerIndex() const
+{
+  return s_tlsSystem == this ? s_tlsWorkerIndex : m_numWorkers;
+}
+
+void JobSystem::run(JobFunc fn, Counter* counter)
+{
+  if(counter)
+  {
+    counter->m_pending++;
+  }
+  push(getWorkerIndex(), Job{std::move(fn), counter, nullptr, 0, 0});
+}
+
+void JobSystem::runAfter(Counter& dependency, JobFunc fn, Counter* counter)
+{
+  if(counter)
+  {
+    counter->m_pending++;
+  }
+
+  Job job{std::move(fn), counter, nullptr, 0, 0};
+  {
+    // finish() decrements the dependency before it looks at m_numDeferred,
+    // so either it sees our entry or we see the dependency being done
+    std::lock_guard<std::mutex> lock(m_deferredMutex);
+    m_numDeferred++;
+    if(!dependency.isDone())
+    {
+      m_deferred.push_back({&dependency, std::move(job)});
+      return;
+    }
+    m_numDeferred--;
+  }
+
+  push(getWorkerIndex(), std::move(job));
+}
+
+void JobSystem::wait(Counter& counter)
+{
+  uint32_t workerIndex = getWorkerIndex();
+  while(!counter.isDone())
+  {
+    if(!tryExecute(workerIndex))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, const RangeFunc& fn, size_t grainSize)
+{
+  if(begin >= end)
+    return;
+
+  if(!grainSize)
+  {
+    // small enough that thieves find work, lazy splitting keeps the job count low
+    grainSize = std::max(size_t(1), (end - begin) / (size_t(getNumSlots()) * 16));
+  }
+
+  ForState state;
+  state.fn        = &fn;
+  state.grainSize = grainSize;
+
+  forRange(&state, begin, end, getWorkerIndex());
+  wait(state.counter);
+}
+
+void JobSystem::forRange(ForState* state, size_t begin, size_t end, uint32_t workerIndex)
+{
+  const size_t grainSize = state->grainSize;
+  Worker&      worker    = m_workers[workerIndex];
+
+  while(end - begin > grainSize)
+  {
+    bool localEmpty;
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      localEmpty = worker.jobs.empty();
+    }
+
+    if(localEmpty && m_numWorkers)
+    {
+      // hand out the upper half, split on a grain boundary
+      size_t numGrains = (end - begin + grainSize - 1) / grainSize;
+      size_t mid       = begin + (numGrains / 2) * grainSize;
+
+      state->counter.m_pending++;
+      push(workerIndex, Job{nullptr, &state->counter, state, mid, end});
+      end = mid;
+    }
+    else
+    {
+      (*state->fn)(begin, begin + grainSize, workerIndex);
+      begin += grainSize;
+    }
+  }
+
+  if(begin < end)
+  {
+    (*state->fn)(begin, end, workerIndex);
+  }
+}
+
+void JobSystem::push(uint32_t workerIndex, Job&& job)
+{
+  // count first, so m_numQueued never underestimates what is in the deques
+  m_numQueued++;
+  {
+    Worker&                     worker = m_workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  }
+
+  if(m_numSleeping.load())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_sleepCond.notify_one();
+  }
+}
+
+bool JobSystem::pop(uint32_t workerIndex, Job& job)
+{
+  Worker&                     worker = m_workers[workerIndex];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if(worker.jobs.empty())
+    return false;
+
+  job = std::move(worker.jobs.back());
+  worker.jobs.pop_back();
+  m_numQueued--;
+  return true;
+}
+
+bool JobSystem::steal(uint32_t workerIndex, Job& job)
+{
+  uint32_t numSlots = getNumSlots();
+
+  // xorshift, only touched by the thread owning workerIndex
+  uint32_t& random = m_workers[workerIndex].random;
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+
+  uint32_t start = random % numSlots;
+  for(uint32_t i = 0; i < numSlots; i++)
+  {
+    uint32_t victim = (start + i) % numSlots;
+    if(victim == workerIndex)
+      continue;
+
+    Worker&                     worker = m_workers[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(!worker.jobs.empty())
+    {
+      job = std::move(worker.jobs.front());
+      worker.jobs.pop_front();
+      m_numQueued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JobSystem::tryExecute(uint32_t workerIndex)
+{
+  if(!m_numQueued.load())
+    return false;
+
+  Job job;
+  if(pop(workerIndex, job) || steal(workerIndex, job))
+  {
+    execute(workerIndex, job);
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::execute(uint32_t workerIndex, Job& job)
+{
+  if(job.forState)
+  {
+    forRange(job.forState, job.forBegin, job.forEnd, workerIndex);
+  }
+  else
+  {
+    job.fn(workerIndex);
+  }
+  finish(job.counter);
+}
+
+void JobSystem::finish(Counter* counter)
+{
+  if(!counter || counter->m_pending.fetch_sub(1) != 1 || !m_numDeferred.load())
+    return;
+
+  // counter is done, release the jobs depending on it. The counter itself
+  // must not be accessed anymore, a waiter may already have destroyed it.
+  std::vector<Job> released;
+  {
+    std::lock_guard<std::mutex> lock(m_deferredMutex);
+    for(size_t i = 0; i < m_deferred.size();)
+    {
+      if(m_deferred[i].dependency == counter)
+      {
+        released.push_back(std::move(m_deferred[i].job));
+        m_deferred[i] = std::move(m_deferred.back());
+        m_deferred.pop_back();
+      }
+      else
+      {
+        i++;
+      }
+    }
+    m_numDeferred -= uint32_t(released.size());
+  }
+
+  uint32_t workerIndex = getWorkerIndex();
+  for(auto& job : released)
+  {
+    push(workerIndex, std::move(job));
+  }
+}
+
+void JobSystem::threadProcess(uint32_t workerIndex)
+{
+  s_tlsSystem      = this;
+  s_tlsWorkerIndex = workerIndex;
+
+  while(true)
+  {
+    bool executed = false;
+    for(uint32_t i = 0; i < IDLE_SPIN_COUNT && !executed; i++)
+    {
+      executed = tryExecute(workerIndex);
+      if(!executed)
+      {
+        std::this_thread::yield();
+      }
+    }
+    if(executed)
+      continue;
+
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_numSleeping++;
+    m_sleepCond.wait(lock, [&] { return m_numQueued.load() || m_stop.load(); });
+    m_numSleeping--;
+
+    if(m_stop && !m_numQueued.load())
+      break;
+  }
+
+  s_tlsSystem = nullptr;
+}
+
+}  // namespace nvh
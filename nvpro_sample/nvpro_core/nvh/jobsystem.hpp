@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef NV_JOBSYSTEM_INCLUDED
+#define NV_JOBSYSTEM_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace nvh {
+
+//////////////////////////////////////////////////////////////////////////
+/**
+    \class nvh::JobSystem
+
+    \brief The nvh::JobSystem class is a work-stealing scheduler for small cpu jobs.
+
+    Every worker thread owns a deque, new jobs are pushed to the deque of the
+    thread that creates them and popped in LIFO order, idle workers steal
+    the oldest jobs from the other deques.
+
+    Jobs receive the index of the executing worker, so per-worker resources
+    (command pools, scratch memory...) can be accessed without locking.
+    Threads outside the system, that wait on a Counter, help executing jobs
+    and use the last index `getNumWorkers()`, therefore size per-worker
+    arrays with `getNumSlots()`. Only one such external thread should
+    wait at a time when per-worker resources are used.
+
+    Counters provide fork/join: every job enqueued with a counter increments
+    it and decrements it once finished. `runAfter` defers a job until a
+    counter reached zero, which allows to express dependencies.
+    A counter must not be reused before `wait` returned.
+
+    Example:
+    \code{.cpp}
+    nvh::JobSystem jobs;
+    jobs.init(std::thread::hardware_concurrency() - 1);
+
+    nvh::JobSystem::Counter loaded;
+    nvh::JobSystem::Counter processed;
+    for (auto& file : files) {
+      jobs.run([&](uint32_t workerIndex){ load(file); }, &loaded);
+    }
+    jobs.runAfter(loaded, [&](uint32_t workerIndex){ process(); }, &processed);
+
+    // items are handed out in ranges of at most 64
+    jobs.parallelFor(0, items.size(), [&](size_t begin, size_t end, uint32_t workerIndex){
+      for (size_t i = begin; i < end; i++) update(perWorker[workerIndex], items[i]);
+    }, 64);
+
+    jobs.wait(processed);
+    jobs.deinit();
+    \endcode
+  */
+
+class JobSystem
+{
+public:
+  typedef std::function<void(uint32_t workerIndex)>                         JobFunc;
+  typedef std::function<void(size_t begin, size_t end, uint32_t workerIndex)> RangeFunc;
+
+  class Counter
+  {
+  public:
+    bool isDone() const { return m_pending.load() == 0; }
+
+  private:
+    friend class JobSystem;
+    std::atomic_uint32_t m_pending{0};
+  };
+
+  // numWorkers can be 0, then all jobs are executed by the thread waiting on them
+  void init(uint32_t numWorkers);
+  void deinit();
+
+  ~JobSystem() { deinit(); }
+
+  uint32_t getNumWorkers() const { return m_numWorkers; }
+  // number of distinct worker indices passed to jobs
+  uint32_t getNumSlots() const { return m_numWorkers + 1; }
+
+  // index of the calling thread within this system
+  uint32_t getWorkerIndex() const;
+
+  void run(JobFunc fn, Counter* counter = nullptr);
+  // fn is enqueued once dependency is done
+  void runAfter(Counter& dependency, JobFunc fn, Counter* counter = nullptr);
+
+  // helps executing jobs until the counter is done
+  void wait(Counter& counter);
+
+  // blocking, calls fn with ranges of at most grainSize items, which start at multiples of
+  // grainSize relative to begin. Ranges are split lazily, only when the local deque runs dry,
+  // so thieves get the big halves. grainSize 0 derives a size from the number of workers.
+  void parallelFor(size_t begin, size_t end, const RangeFunc& fn, size_t grainSize = 0);
+
+private:
+  struct ForState;
+
+  struct Job
+  {
+    JobFunc  fn;
+    Counter* counter;
+    // parallelFor ranges avoid the JobFunc allocation
+    ForState* forState;
+    size_t    forBegin;
+    size_t    forEnd;
+  };
+
+  struct Deferred
+  {
+    Counter* dependency;
+    Job      job;
+  };
+
+  struct alignas(64) Worker
+  {
+    std::mutex      mutex;
+    std::deque<Job> jobs;
+    uint32_t        random;
+  };
+
+  uint32_t                 m_numWorkers = 0;
+  std::vector<Worker>      m_workers;
+  std::vector<std::thread> m_threads;
+
+  std::atomic_uint32_t m_numQueued{0};
+  std::atomic_uint32_t m_numSleeping{0};
+  std::atomic_bool     m_stop{false};
+
+  std::mutex              m_sleepMutex;
+  std::condition_variable m_sleepCond;
+
+  std::atomic_uint32_t  m_numDeferred{0};
+  std::mutex            m_deferredMutex;
+  std::vector<Deferred> m_deferred;
+
+  void push(uint32_t workerIndex, Job&& job);
+  bool pop(uint32_t workerIndex, Job& job);
+  bool steal(uint32_t workerIndex, Job& job);
+  bool tryExecute(uint32_t workerIndex);
+  void execute(uint32_t workerIndex, Job& job);
+  void finish(Counter* counter);
+
+  void forRange(ForState* state, size_t begin, size_t end, uint32_t workerIndex);
+
+  void threadProcess(uint32_t workerIndex);
+};
+
+}  // namespace nvh
+
+#endif
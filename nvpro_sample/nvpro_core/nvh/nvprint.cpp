@@ -20,7 +20,13 @@
 
 #include "nvprint.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <stddef.h>
+#include <string>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
@@ -38,6 +44,41 @@ static uint32_t            s_bPrintFileLogging    = ~0;
 static int                 s_printLevel           = -1;  // <0 mean no level prefix
 static PFN_NVPRINTCALLBACK s_printCallback        = nullptr;
 static std::mutex          s_mutex;
+static size_t              s_logFileSize          = 0;
+static size_t              s_rotateSize           = 0;
+static uint32_t            s_rotateBackups        = 1;
+
+// async mode, s_asyncHead is a lock-free stack the writer takes as a whole
+struct LogMessage
+{
+  LogMessage* next;
+  int         level;
+  size_t      size;
+  char        text[1];
+};
+
+static std::atomic<LogMessage*> s_asyncHead{nullptr};
+static std::atomic<size_t>      s_asyncBytes{0};
+static std::atomic<uint64_t>    s_asyncDropped{0};
+static std::atomic<bool>        s_async{false};
+static std::atomic<size_t>      s_asyncCapacity{0};
+static std::atomic<bool>        s_asyncBlock{false};
+// producers between their check of s_async and publishing the message
+static std::atomic<uint32_t>    s_asyncProducers{0};
+static bool                     s_asyncStop = false;
+static std::mutex               s_asyncMutex;
+static std::condition_variable  s_asyncCond;
+// signaled after every batch the writer finished, and when async mode ends
+static std::condition_variable  s_asyncDrained;
+static std::thread              s_asyncThread;
+
+static thread_local std::vector<char> s_tlsBuffer;
+
+// stops the writer before the other statics go away
+static struct AsyncShutdown
+{
+  ~AsyncShutdown() { nvprintSetAsync(false); }
+} s_asyncShutdown;
 
 void nvprintSetLogFileName(const char* name)
 {
@@ -88,6 +129,315 @@ void nvprintSetFileLogging(bool state, uint32_t mask)
   }
 }
 
+void nvprintSetLogRotation(size_t maxFileSize, uint32_t maxBackups)
+{
+  std::lock_guard<std::mutex> lockGuard(s_mutex);
+
+  s_rotateSize    = maxFileSize;
+  s_rotateBackups = maxBackups;
+}
+
+static void rotateLogFile()
+{
+  fclose(s_fd);
+
+  std::string name = s_logFileName;
+  if(s_rotateBackups)
+  {
+    remove((name + "." + std::to_string(s_rotateBackups)).c_str());
+    for(uint32_t i = s_rotateBackups - 1; i > 0; i--)
+    {
+      rename((name + "." + std::to_string(i)).c_str(), (name + "." + std::to_string(i + 1)).c_str());
+    }
+    rename(name.c_str(), (name + ".1").c_str());
+  }
+
+  s_fd          = fopen(s_logFileName, "wt");
+  s_logFileSize = 0;
+}
+
+// must hold s_mutex
+static void writeLogFile(const char* text, size_t size)
+{
+  if(s_bLogReady == false)
+  {
+    s_fd          = fopen(s_logFileName, "wt");
+    s_bLogReady   = true;
+    s_logFileSize = 0;
+  }
+  if(s_fd && s_rotateSize && s_logFileSize && s_logFileSize + size > s_rotateSize)
+  {
+    rotateLogFile();
+  }
+  if(s_fd)
+  {
+    fwrite(text, 1, size, s_fd);
+    s_logFileSize += size;
+  }
+}
+
+static void writeAsyncBatch(LogMessage* list, std::string& fileBatch, std::string& consoleBatch)
+{
+  // stack is newest first
+  LogMessage* ordered = nullptr;
+  while(list)
+  {
+    LogMessage* next = list->next;
+    list->next       = ordered;
+    ordered          = list;
+    list             = next;
+  }
+
+  fileBatch.clear();
+  consoleBatch.clear();
+
+  size_t bytes     = 0;
+  bool   wroteFile = false;
+  {
+    std::lock_guard<std::mutex> lockGuard(s_mutex);
+
+    for(LogMessage* msg = ordered; msg; msg = msg->next)
+    {
+#ifdef WIN32
+      OutputDebugStringA(msg->text);
+#endif
+      if(s_bPrintFileLogging & (1 << msg->level))
+      {
+        // with rotation the file may only be switched between messages
+        if(s_rotateSize)
+        {
+          writeLogFile(msg->text, msg->size);
+          wroteFile = true;
+        }
+        else
+        {
+          fileBatch.append(msg->text, msg->size);
+        }
+      }
+      if(s_printCallback)
+      {
+        s_printCallback(msg->level, msg->text);
+      }
+      consoleBatch.append(msg->text, msg->size);
+    }
+
+    if(!fileBatch.empty())
+    {
+      writeLogFile(fileBatch.data(), fileBatch.size());
+      wroteFile = true;
+    }
+    if(wroteFile && s_fd)
+    {
+      fflush(s_fd);
+    }
+  }
+
+  fwrite(consoleBatch.data(), 1, consoleBatch.size(), stdout);
+  fflush(stdout);
+
+  while(ordered)
+  {
+    LogMessage* next = ordered->next;
+    bytes += ordered->size;
+    free(ordered);
+    ordered = next;
+  }
+
+  s_asyncBytes.fetch_sub(bytes, std::memory_order_release);
+
+  // taking the lock orders the decrement before the waiters' predicate checks
+  {
+    std::lock_guard<std::mutex> lock(s_asyncMutex);
+  }
+  s_asyncDrained.notify_all();
+}
+
+static void asyncWriterThread()
+{
+  std::string fileBatch;
+  std::string consoleBatch;
+
+  while(true)
+  {
+    bool stop;
+    {
+      // producers notify without the lock, the timeout covers a missed wakeup
+      std::unique_lock<std::mutex> lock(s_asyncMutex);
+      s_asyncCond.wait_for(lock, std::chrono::milliseconds(20),
+                           [] { return s_asyncStop || s_asyncHead.load(std::memory_order_relaxed) != nullptr; });
+      stop = s_asyncStop;
+    }
+
+    LogMessage* list = s_asyncHead.exchange(nullptr, std::memory_order_acquire);
+    if(list)
+    {
+      writeAsyncBatch(list, fileBatch, consoleBatch);
+    }
+    else if(stop)
+    {
+      break;
+    }
+  }
+}
+
+void nvprintSetAsync(bool state, size_t queueBytes, bool blockWhenFull)
+{
+  std::unique_lock<std::mutex> lock(s_asyncMutex);
+
+  s_asyncCapacity.store(queueBytes, std::memory_order_relaxed);
+  s_asyncBlock.store(blockWhenFull, std::memory_order_relaxed);
+
+  if(state == s_async.load())
+    return;
+
+  if(state)
+  {
+    s_asyncStop = false;
+    s_async.store(true);
+    s_asyncThread = std::thread(asyncWriterThread);
+  }
+  else
+  {
+    // new messages take the synchronous path, the writer drains the rest
+    s_async.store(false);
+    s_asyncStop = true;
+    s_asyncCond.notify_one();
+
+    std::thread writer = std::move(s_asyncThread);
+    lock.unlock();
+    writer.join();
+
+    // wakes up blocked producers, they fall back to the synchronous path
+    {
+      std::lock_guard<std::mutex> drainedLock(s_asyncMutex);
+    }
+    s_asyncDrained.notify_all();
+
+    // producers that saw s_async before it was cleared may still publish
+    while(s_asyncProducers.load(std::memory_order_acquire))
+    {
+      std::this_thread::yield();
+    }
+
+    // messages of producers that raced with the shutdown
+    LogMessage* list = s_asyncHead.exchange(nullptr, std::memory_order_acquire);
+    if(list)
+    {
+      std::string fileBatch;
+      std::string consoleBatch;
+      writeAsyncBatch(list, fileBatch, consoleBatch);
+    }
+
+    // releases flushes and blocked producers
+    {
+      std::lock_guard<std::mutex> drainedLock(s_asyncMutex);
+    }
+    s_asyncDrained.notify_all();
+  }
+}
+
+void nvprintFlush()
+{
+  std::unique_lock<std::mutex> lock(s_asyncMutex);
+  s_asyncCond.notify_one();
+  s_asyncDrained.wait(lock, [] { return !s_async.load() || s_asyncBytes.load(std::memory_order_acquire) == 0; });
+}
+
+uint64_t nvprintGetNumDropped()
+{
+  return s_asyncDropped.load(std::memory_order_relaxed);
+}
+
+static size_t formatThreadLocal(va_list& vlist, const char* fmt)
+{
+  std::vector<char>& buffer = s_tlsBuffer;
+  if(buffer.empty())
+  {
+    buffer.resize(1024);
+  }
+
+  va_list copy;
+  va_copy(copy, vlist);
+  int size = vsnprintf(buffer.data(), buffer.size(), fmt, copy);
+  va_end(copy);
+
+  if(size < 0)
+  {
+    return 0;
+  }
+  if(size_t(size) >= buffer.size())
+  {
+    buffer.resize(size_t(size) + 1);
+    va_copy(copy, vlist);
+    vsnprintf(buffer.data(), buffer.size(), fmt, copy);
+    va_end(copy);
+  }
+
+  return size_t(size);
+}
+
+static bool nvprintfAsync(va_list& vlist, const char* fmt, int level)
+{
+  size_t size = formatThreadLocal(vlist, fmt);
+
+  // reserve queue space, a single oversized message is always let through
+  size_t capacity = s_asyncCapacity.load(std::memory_order_relaxed);
+  size_t queued   = s_asyncBytes.load(std::memory_order_relaxed);
+  while(true)
+  {
+    if(queued && queued + size > capacity)
+    {
+      if(!s_asyncBlock.load(std::memory_order_relaxed))
+      {
+        s_asyncDropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      // wait for the writer to make room
+      std::unique_lock<std::mutex> lock(s_asyncMutex);
+      s_asyncCond.notify_one();
+      s_asyncDrained.wait(lock, [&] {
+        queued = s_asyncBytes.load(std::memory_order_relaxed);
+        return !s_async.load() || !queued || queued + size <= capacity;
+      });
+      if(!s_async.load())
+      {
+        return false;
+      }
+    }
+    else if(s_asyncBytes.compare_exchange_weak(queued, queued + size, std::memory_order_relaxed))
+    {
+      break;
+    }
+  }
+
+  LogMessage* msg = (LogMessage*)malloc(offsetof(LogMessage, text) + size + 1);
+  if(!msg)
+  {
+    s_asyncBytes.fetch_sub(size, std::memory_order_relaxed);
+    s_asyncDropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  msg->level = level;
+  msg->size  = size;
+  memcpy(msg->text, s_tlsBuffer.data(), size + 1);
+
+  // msg belongs to the writer once published, only the local copy of the old head is used after
+  LogMessage* head = s_asyncHead.load(std::memory_order_relaxed);
+  do
+  {
+    msg->next = head;
+  } while(!s_asyncHead.compare_exchange_weak(head, msg, std::memory_order_release, std::memory_order_relaxed));
+
+  // only the first message of a batch wakes up the writer
+  if(!head)
+  {
+    s_asyncCond.notify_one();
+  }
+
+  return true;
+}
+
 void nvprintf2(va_list& vlist, const char* fmt, int level)
 {
   if(s_bPrintLogging == false)
@@ -95,6 +445,19 @@ void nvprintf2(va_list& vlist, const char* fmt, int level)
     return;
   }
 
+  if(s_async.load(std::memory_order_relaxed))
+  {
+    // the count is raised before s_async is checked again, so the shutdown
+    // either sees this producer or the producer sees the shutdown
+    s_asyncProducers.fetch_add(1);
+    bool queued = s_async.load() && nvprintfAsync(vlist, fmt, level);
+    s_asyncProducers.fetch_sub(1, std::memory_order_release);
+    if(queued)
+    {
+      return;
+    }
+  }
+
   std::lock_guard<std::mutex> lockGuard(s_mutex);
   if(s_strBuffer_sz == 0)
   {
@@ -122,15 +485,7 @@ void nvprintf2(va_list& vlist, const char* fmt, int level)
 
   if(s_bPrintFileLogging & (1 << level))
   {
-    if(s_bLogReady == false)
-    {
-      s_fd        = fopen(s_logFileName, "wt");
-      s_bLogReady = true;
-    }
-    if(s_fd)
-    {
-      fputs(s_strBuffer, s_fd);
-    }
+    writeLogFile(s_strBuffer, strlen(s_strBuffer));
   }
 
   if(s_printCallback)
@@ -41,6 +41,10 @@
   - nvprintSetLogFileName : sets log filename
   - nvprintSetLogging : sets file logging state
   - nvprintSetCallback : sets custom callback
+  - nvprintSetAsync : formats on the calling thread, a background thread does the output
+  - nvprintFlush : waits until the asynchronous output is done
+  - nvprintGetNumDropped : messages dropped because the asynchronous queue was full
+  - nvprintSetLogRotation : starts a new log file once the size is exceeded
   - LOGI : macro that does nvprintfLevel(LOGLEVEL_INFO)
   - LOGW : macro that does nvprintfLevel(LOGLEVEL_WARNING)
   - LOGE : macro that does nvprintfLevel(LOGLEVEL_ERROR)
@@ -110,5 +114,17 @@ void nvprintSetLogging(bool b);
 void nvprintSetFileLogging(bool state, uint32_t mask = ~0);
 void nvprintSetCallback(PFN_NVPRINTCALLBACK callback);
 
+// In async mode messages are formatted into a per-thread buffer and pushed lock-free
+// into a queue. A writer thread does the console, file and callback output in batches,
+// the callback is therefore invoked on the writer thread (still serialized).
+// queueBytes limits the memory of queued messages, when exceeded messages are
+// dropped, or the caller waits if blockWhenFull is set.
+void     nvprintSetAsync(bool state, size_t queueBytes = 4 * 1024 * 1024, bool blockWhenFull = false);
+void     nvprintFlush();
+uint64_t nvprintGetNumDropped();
+// 0 disables rotation, otherwise keeps the log file plus up to maxBackups
+// older ones with ".1", ".2"... appended to the name
+void nvprintSetLogRotation(size_t maxFileSize, uint32_t maxBackups = 1);
+
 
 #endif
@@ -25,6 +25,16 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_USE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_USE_TSC 1
+#else
+#define PROFILER_USE_TSC 0
+#endif
+
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -34,19 +44,59 @@ const uint32_t Profiler::CONFIG_DELAY;
 const uint32_t Profiler::FRAME_DELAY;
 const uint32_t Profiler::START_SECTIONS;
 const uint32_t Profiler::MAX_NUM_AVERAGE;
+const uint32_t Profiler::THREAD_SECTIONS;
+const uint32_t Profiler::THREAD_MAX_LEVELS;
+
+static std::atomic<uint64_t> s_dataUID{0};
+
+// last database the thread recorded into, avoids the lock in getThreadData
+static thread_local uint64_t s_tlsDataUID    = 0;
+static thread_local void*    s_tlsThreadData = nullptr;
+
+// timestamps of the sections on other threads, reading the time stamp counter
+// costs a fraction of a clock query. The ticks are mapped to microseconds
+// at endFrame, which assumes an invariant TSC (any x86 cpu of the last decade).
+static inline uint64_t getThreadTicks()
+{
+#if PROFILER_USE_TSC
+  return __rdtsc();
+#else
+  return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
 
 Profiler::Profiler(Profiler* master)
 {
-  m_data = master ? master->m_data : std::shared_ptr<Data>(new Data);
+  if(master)
+  {
+    m_data = master->m_data;
+    // same time base for trace events
+    m_clock = master->m_clock;
+  }
+  else
+  {
+    m_data      = std::shared_ptr<Data>(new Data);
+    m_data->uid = ++s_dataUID;
+  }
   grow(START_SECTIONS);
 }
 
 Profiler::Profiler(uint32_t startSections)
 {
-  m_data = std::shared_ptr<Data>(new Data);
+  m_data      = std::shared_ptr<Data>(new Data);
+  m_data->uid = ++s_dataUID;
   grow(startSections);
 }
 
+Profiler::Data::~Data()
+{
+  if(traceFile)
+  {
+    fprintf(traceFile, "\n]}\n");
+    fclose(traceFile);
+  }
+}
+
 void Profiler::setAveragingSize(uint32_t num)
 {
   assert(num <= MAX_NUM_AVERAGE);
@@ -58,6 +108,15 @@ void Profiler::setAveragingSize(uint32_t num)
     m_data->entries[i].gpuTime.init(num);
   }
   m_data->cpuTime.init(num);
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(auto& thread : m_data->threads)
+  {
+    for(ThreadEntry& entry : thread->entries)
+    {
+      entry.cpuTime.init(num);
+    }
+  }
 }
 
 void Profiler::beginFrame()
@@ -66,7 +125,16 @@ void Profiler::beginFrame()
   m_data->nextSection = 0;
   m_data->frameSections.clear();
 
-  m_data->cpuCurrentTime = -m_clock.getMicroSeconds();
+  m_data->frameThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+  m_data->cpuFrameBegin  = m_clock.getMicroSeconds();
+  m_data->cpuCurrentTime = -m_data->cpuFrameBegin;
+
+  if(!m_data->ticksBase)
+  {
+    m_data->ticksBase     = getThreadTicks();
+    m_data->ticksBaseTime = m_data->cpuFrameBegin;
+  }
 }
 
 void Profiler::endFrame()
@@ -75,6 +143,19 @@ void Profiler::endFrame()
 
   m_data->cpuCurrentTime += m_clock.getMicroSeconds();
 
+  if(m_data->traceFile)
+  {
+    traceEvent("Frame", TRACE_TID_FRAME, m_data->cpuFrameBegin, m_data->cpuCurrentTime);
+    for(uint32_t i : m_data->frameSections)
+    {
+      const Entry& entry = m_data->entries[i];
+      if(!entry.splitter)
+      {
+        traceEvent(entry.name, TRACE_TID_FRAME, entry.cpuBegins[entry.subFrame], entry.cpuTimes[entry.subFrame]);
+      }
+    }
+  }
+
   if(!m_data->frameSections.empty() && ((uint32_t)m_data->frameSections.size() != m_data->numLastEntries))
   {
     m_data->numLastEntries  = (uint32_t)m_data->frameSections.size();
@@ -82,7 +163,8 @@ void Profiler::endFrame()
     m_data->resetDelay      = CONFIG_DELAY;
   }
 
-  if(m_data->resetDelay)
+  bool reset = m_data->resetDelay != 0;
+  if(reset)
   {
     m_data->resetDelay--;
     for(uint32_t i = 0; i < m_data->entries.size(); i++)
@@ -116,9 +198,17 @@ void Profiler::endFrame()
         entry.cpuTime.add(entry.cpuTimes[queryFrame]);
         entry.gpuTime.add(entry.gpuTimes[queryFrame]);
         entry.numTimes++;
+
+        if(m_data->traceFile && entry.api && entry.gpuModes[queryFrame] != GPU_BEGIN_NONE)
+        {
+          m_data->traceGpuSections.push_back({entry.name, entry.cpuBegins[queryFrame], entry.gpuBegins[queryFrame],
+                                              entry.gpuTimes[queryFrame], entry.gpuModes[queryFrame]});
+        }
       }
     }
 
+    traceGpuSections();
+
     for(uint32_t i : m_data->singleSections)
     {
       Entry&   entry      = m_data->entries[i];
@@ -133,15 +223,133 @@ void Profiler::endFrame()
         entry.cpuTime.add(entry.cpuTimes[queryFrame]);
         entry.gpuTime.add(entry.gpuTimes[queryFrame]);
         entry.numTimes++;
+
+        if(m_data->traceFile)
+        {
+          traceEvent(entry.name, TRACE_TID_FRAME, entry.cpuBegins[queryFrame], entry.cpuTimes[queryFrame]);
+          if(entry.api && entry.gpuModes[queryFrame] != GPU_BEGIN_NONE)
+          {
+            m_data->traceGpuSections.push_back({entry.name, entry.cpuBegins[queryFrame], entry.gpuBegins[queryFrame],
+                                                entry.gpuTimes[queryFrame], entry.gpuModes[queryFrame]});
+            traceGpuSections();
+          }
+        }
       }
     }
 
     m_data->cpuTime.add(m_data->cpuCurrentTime);
   }
 
+  mergeThreadSections(reset);
+
   m_data->numFrames++;
 }
 
+void Profiler::mergeThreadSections(bool reset)
+{
+  // the longer the interval, the more accurate the rate
+  double   baseTime  = m_data->ticksBaseTime;
+  uint64_t baseTicks = m_data->ticksBase;
+  double   elapsed   = m_clock.getMicroSeconds() - baseTime;
+  uint64_t ticks     = getThreadTicks();
+  if(elapsed > 0 && ticks > baseTicks)
+  {
+    m_data->ticksPerMicroSecond = double(ticks - baseTicks) / elapsed;
+  }
+  double microSecondsPerTick = m_data->ticksPerMicroSecond > 0 ? 1.0 / m_data->ticksPerMicroSecond : 0.0;
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+  for(auto& thread : m_data->threads)
+  {
+    for(ThreadEntry& entry : thread->entries)
+    {
+      entry.frameTime  = 0;
+      entry.frameCount = 0;
+      if(reset)
+      {
+        entry.numTimes = 0;
+        entry.cpuTime.reset();
+      }
+    }
+
+    uint32_t read    = thread->read.load(std::memory_order_relaxed);
+    uint32_t written = thread->written.load(std::memory_order_acquire);
+    bool     added   = false;
+
+    // reported by print until the next frame
+    thread->droppedLastFrame = thread->dropped.exchange(0, std::memory_order_relaxed);
+
+    for(; read != written; read++)
+    {
+      const ThreadSection& section = thread->sections[read % THREAD_SECTIONS];
+
+      // few distinct sections per thread, linear search is fine
+      ThreadEntry* entry = nullptr;
+      for(ThreadEntry& it : thread->entries)
+      {
+        if(it.name == section.name && it.level == section.level)
+        {
+          entry = &it;
+          break;
+        }
+      }
+      if(!entry)
+      {
+        thread->entries.emplace_back();
+        entry        = &thread->entries.back();
+        entry->name  = section.name;
+        entry->level = section.level;
+        entry->cpuTime.init(m_data->numAveraging);
+        added = true;
+      }
+
+      double cpuBegin = baseTime + double(int64_t(section.ticksBegin - baseTicks)) * microSecondsPerTick;
+      double cpuTime  = double(section.ticksEnd - section.ticksBegin) * microSecondsPerTick;
+
+      if(!entry->frameCount)
+      {
+        entry->frameBegin = cpuBegin;
+      }
+      entry->frameTime += cpuTime;
+      entry->frameCount++;
+
+      if(m_data->traceFile)
+      {
+        if(!thread->traceNamed)
+        {
+          traceThreadName(TRACE_TID_THREADS + thread->index, "Thread", thread->index);
+          thread->traceNamed = true;
+        }
+        traceEvent(section.name, TRACE_TID_THREADS + thread->index, cpuBegin, cpuTime);
+      }
+    }
+
+    if(added)
+    {
+      // sections are published when they end, restore the begin order for printing
+      std::sort(thread->entries.begin(), thread->entries.end(),
+                [](const ThreadEntry& a, const ThreadEntry& b) { return a.frameBegin < b.frameBegin; });
+    }
+
+    // frees the slots for the producer
+    thread->read.store(read, std::memory_order_release);
+
+    if(m_data->numFrames > FRAME_DELAY)
+    {
+      for(ThreadEntry& entry : thread->entries)
+      {
+        if(entry.frameCount)
+        {
+          entry.cpuTime.add(entry.frameTime);
+          entry.accumulated = entry.frameCount > 1;
+          entry.numTimes++;
+        }
+      }
+    }
+  }
+}
+
 
 void Profiler::grow(uint32_t newsize)
 {
@@ -165,6 +373,13 @@ void Profiler::clear()
 {
   m_data->entries.clear();
   m_data->singleSections.clear();
+
+  // the ThreadData must stay alive, threads cache pointers to it
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(auto& thread : m_data->threads)
+  {
+    thread->entries.clear();
+  }
 }
 
 void Profiler::reset(uint32_t delay)
@@ -201,13 +416,11 @@ bool Profiler::getTimerInfo(uint32_t i, TimerInfo& info)
     return false;
   }
 
-  info.gpu.average     = entry.gpuTime.getAveraged();
-  info.cpu.average     = entry.cpuTime.getAveraged();
-  info.cpu.absMinValue = entry.cpuTime.absMinValue;
-  info.cpu.absMaxValue = entry.cpuTime.absMaxValue;
-  info.gpu.absMinValue = entry.gpuTime.absMinValue;
-  info.gpu.absMaxValue = entry.gpuTime.absMaxValue;
-  bool found           = false;
+  info.gpu.average = entry.gpuTime.getAveraged();
+  info.cpu.average = entry.cpuTime.getAveraged();
+  entry.cpuTime.getStats(info.cpu);
+  entry.gpuTime.getStats(info.gpu);
+  bool found = false;
   for(uint32_t n = i + 1; n < m_data->numLastSections; n++)
   {
     Entry& otherentry = m_data->entries[n];
@@ -220,6 +433,13 @@ bool Profiler::getTimerInfo(uint32_t i, TimerInfo& info)
       info.cpu.absMaxValue += entry.cpuTime.absMaxValue;
       info.gpu.absMinValue += entry.gpuTime.absMinValue;
       info.gpu.absMaxValue += entry.gpuTime.absMaxValue;
+      // approximation, the loop iterations are not independent
+      info.cpu.p50 += otherentry.cpuTime.getPercentile(0.50);
+      info.cpu.p95 += otherentry.cpuTime.getPercentile(0.95);
+      info.cpu.p99 += otherentry.cpuTime.getPercentile(0.99);
+      info.gpu.p50 += otherentry.gpuTime.getPercentile(0.50);
+      info.gpu.p95 += otherentry.gpuTime.getPercentile(0.95);
+      info.gpu.p99 += otherentry.gpuTime.getPercentile(0.99);
       otherentry.accumulated = true;
     }
 
@@ -242,10 +462,9 @@ bool Profiler::getTimerInfo(const char* name, TimerInfo& info)
     {
       return false;
     }
-    info.cpu.average     = m_data->cpuTime.getAveraged();
-    info.cpu.absMaxValue = m_data->cpuTime.absMaxValue;
-    info.cpu.absMinValue = m_data->cpuTime.absMinValue;
-    info.numAveraged     = m_data->cpuTime.numValid;
+    info.cpu.average = m_data->cpuTime.getAveraged();
+    info.numAveraged = m_data->cpuTime.numValid;
+    m_data->cpuTime.getStats(info.cpu);
 
     return true;
   }
@@ -274,6 +493,47 @@ bool Profiler::getTimerInfo(const char* name, TimerInfo& info)
   return false;
 }
 
+uint32_t Profiler::getNumThreads() const
+{
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  return (uint32_t)m_data->threads.size();
+}
+
+std::thread::id Profiler::getThreadID(uint32_t threadIndex) const
+{
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  return threadIndex < m_data->threads.size() ? m_data->threads[threadIndex]->id : std::thread::id();
+}
+
+bool Profiler::getThreadTimerInfo(uint32_t threadIndex, const char* name, TimerInfo& info)
+{
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+  if(threadIndex >= m_data->threads.size())
+  {
+    return false;
+  }
+
+  for(ThreadEntry& entry : m_data->threads[threadIndex]->entries)
+  {
+    if(strcmp(name, entry.name))
+      continue;
+
+    if(!entry.numTimes)
+      return false;
+
+    info                 = TimerInfo();
+    info.cpu.average     = entry.cpuTime.getAveraged();
+    info.gpu.absMinValue = 0;
+    info.accumulated     = entry.accumulated;
+    info.numAveraged     = entry.cpuTime.numValid;
+    entry.cpuTime.getStats(info.cpu);
+    return true;
+  }
+
+  return false;
+}
+
 void Profiler::print(std::string& stats)
 {
   stats.clear();
@@ -317,6 +577,143 @@ void Profiler::print(std::string& stats)
                       (uint32_t)(info.gpu.average), (uint32_t)(info.cpu.average), (uint32_t)entry.cpuTime.numValid);
     }
   }
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(auto& thread : m_data->threads)
+  {
+    static const char* spaces = "        ";  // 8
+
+    for(ThreadEntry& entry : thread->entries)
+    {
+      if(!entry.numTimes)
+        continue;
+
+      uint32_t level = 7 - (entry.level > 7 ? 7 : entry.level);
+
+      stats += format("%sTimer %s;\t Thread %2d; CPU %6d; (microseconds, %s %d)\n", &spaces[level], entry.name,
+                      thread->index, (uint32_t)(entry.cpuTime.getAveraged()),
+                      entry.accumulated ? "accumulated loop, avg" : "avg", (uint32_t)entry.cpuTime.numValid);
+    }
+
+    if(thread->droppedLastFrame)
+    {
+      stats += format("Thread %2d; dropped sections %d last frame (THREAD_SECTIONS exceeded)\n", thread->index,
+                      thread->droppedLastFrame);
+    }
+  }
+}
+
+bool Profiler::beginTrace(const char* filename)
+{
+  endTrace();
+
+#ifdef _WIN32
+  if(fopen_s(&m_data->traceFile, filename, "wt"))
+  {
+    m_data->traceFile = nullptr;
+  }
+#else
+  m_data->traceFile = fopen(filename, "wt");
+#endif
+  if(!m_data->traceFile)
+  {
+    return false;
+  }
+
+  m_data->traceFirst = true;
+  fprintf(m_data->traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  traceThreadName(TRACE_TID_FRAME, "Frame");
+  traceThreadName(TRACE_TID_GPU, "GPU");
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(auto& thread : m_data->threads)
+  {
+    thread->traceNamed = false;
+  }
+
+  return true;
+}
+
+void Profiler::endTrace()
+{
+  if(!m_data->traceFile)
+    return;
+
+  fprintf(m_data->traceFile, "\n]}\n");
+  fclose(m_data->traceFile);
+  m_data->traceFile = nullptr;
+  m_data->traceGpuSections.clear();
+}
+
+static void traceName(FILE* file, const char* name)
+{
+  // names are typically literals, only escape what json requires
+  fputc('"', file);
+  for(const char* c = name ? name : "null"; *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+    {
+      fputc('\\', file);
+    }
+    if((unsigned char)(*c) >= 0x20)
+    {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+void Profiler::traceEvent(const char* name, uint32_t tid, double begin, double duration)
+{
+  FILE* file = m_data->traceFile;
+
+  fprintf(file, m_data->traceFirst ? "{\"name\":" : ",\n{\"name\":");
+  traceName(file, name);
+  fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", tid, begin, duration);
+
+  m_data->traceFirst = false;
+}
+
+void Profiler::traceThreadName(uint32_t tid, const char* name, uint32_t index)
+{
+  FILE* file = m_data->traceFile;
+
+  fprintf(file, m_data->traceFirst ? "{" : ",\n{");
+  if(index != ~0u)
+  {
+    fprintf(file, "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", tid, name, index);
+  }
+  else
+  {
+    fprintf(file, "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", tid, name);
+  }
+
+  m_data->traceFirst = false;
+}
+
+void Profiler::traceGpuSections()
+{
+  std::vector<TraceGpuSection>& sections = m_data->traceGpuSections;
+
+  // without calibration, move the gpu timeline as little as needed so that
+  // no gpu work begins before the cpu recorded it.
+  double offset = -DBL_MAX;
+  for(const TraceGpuSection& section : sections)
+  {
+    if(section.mode == GPU_BEGIN_UNCALIBRATED)
+    {
+      offset = std::max(offset, section.cpuBegin - section.gpuBegin);
+    }
+  }
+
+  for(const TraceGpuSection& section : sections)
+  {
+    double begin = section.mode == GPU_BEGIN_CALIBRATED ? section.gpuBegin : section.gpuBegin + offset;
+    traceEvent(section.name, TRACE_TID_GPU, begin, section.gpuTime);
+  }
+
+  sections.clear();
 }
 
 uint32_t Profiler::getTotalFrames() const
@@ -370,6 +767,13 @@ Profiler::SectionID Profiler::getSectionID(bool singleShot, const char* name)
 
 Profiler::SectionID Profiler::beginSection(const char* name, const char* api, gpuTimeProvider_fn gpuTimeProvider, bool singleShot)
 {
+  if(!singleShot && std::this_thread::get_id() != m_data->frameThread.load(std::memory_order_relaxed))
+  {
+    // gpu timers are managed by the frame thread only
+    assert(api == nullptr);
+    return beginThreadSection(name);
+  }
+
   uint32_t  subFrame = m_data->numFrames % FRAME_DELAY;
   SectionID sec      = getSectionID(singleShot, name);
 
@@ -420,8 +824,10 @@ Profiler::SectionID Profiler::beginSection(const char* name, const char* api, gp
   }
 #endif
 
-  entry.cpuTimes[subFrame] = -getMicroSeconds();
-  entry.gpuTimes[subFrame] = 0;
+  entry.gpuTimes[subFrame]  = 0;
+  entry.gpuModes[subFrame]  = GPU_BEGIN_NONE;
+  entry.cpuBegins[subFrame] = getMicroSeconds();
+  entry.cpuTimes[subFrame]  = -entry.cpuBegins[subFrame];
 
   if(singleShot)
   {
@@ -434,6 +840,12 @@ Profiler::SectionID Profiler::beginSection(const char* name, const char* api, gp
 
 void Profiler::endSection(SectionID sec)
 {
+  if(sec & SECTION_THREAD_BIT)
+  {
+    endThreadSection(sec);
+    return;
+  }
+
   Entry& entry = m_data->entries[sec];
 
   entry.cpuTimes[entry.subFrame] += getMicroSeconds();
@@ -448,6 +860,98 @@ void Profiler::endSection(SectionID sec)
   }
 }
 
+Profiler::ThreadData* Profiler::getThreadData()
+{
+  if(s_tlsDataUID == m_data->uid)
+  {
+    return (ThreadData*)s_tlsThreadData;
+  }
+
+  // first section of this thread, or the thread switched between profiler databases
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+  std::thread::id id     = std::this_thread::get_id();
+  ThreadData*     thread = nullptr;
+  for(auto& it : m_data->threads)
+  {
+    if(it->id == id)
+    {
+      thread = it.get();
+      break;
+    }
+  }
+  if(!thread)
+  {
+    thread        = new ThreadData;
+    thread->id    = id;
+    thread->index = (uint32_t)m_data->threads.size();
+    m_data->threads.emplace_back(thread);
+  }
+
+  s_tlsDataUID    = m_data->uid;
+  s_tlsThreadData = thread;
+
+  return thread;
+}
+
+Profiler::SectionID Profiler::beginThreadSection(const char* name)
+{
+  ThreadData* thread = getThreadData();
+  uint32_t    level  = thread->level++;
+
+#ifdef NVP_SUPPORTS_NVTOOLSEXT
+  nvtxRangePushA(name);
+#endif
+
+  if(level < THREAD_MAX_LEVELS)
+  {
+    thread->levelNames[level] = name;
+    thread->levelTicks[level] = getThreadTicks();
+  }
+
+  return SECTION_THREAD_BIT | level;
+}
+
+void Profiler::endThreadSection(SectionID sec)
+{
+  uint64_t    ticksEnd = getThreadTicks();
+  ThreadData* thread   = getThreadData();
+  uint32_t    level    = --thread->level;
+
+  // sections must be ended on the thread that began them, in reverse order
+  assert((sec & ~SECTION_THREAD_BIT) == level);
+  (void)sec;
+
+#ifdef NVP_SUPPORTS_NVTOOLSEXT
+  nvtxRangePop();
+#endif
+
+  if(level >= THREAD_MAX_LEVELS)
+  {
+    return;
+  }
+
+  uint32_t written = thread->written.load(std::memory_order_relaxed);
+  if(written - thread->readCached >= THREAD_SECTIONS)
+  {
+    thread->readCached = thread->read.load(std::memory_order_acquire);
+    if(written - thread->readCached >= THREAD_SECTIONS)
+    {
+      thread->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  ThreadSection& section = thread->sections[written % THREAD_SECTIONS];
+  section.name           = thread->levelNames[level];
+  section.level          = level;
+  section.ticksBegin     = thread->levelTicks[level];
+  section.ticksEnd       = ticksEnd;
+
+  // publish to endFrame
+  thread->written.store(written + 1, std::memory_order_release);
+}
+
 Profiler::Clock::Clock()
 {
   m_init = std::chrono::high_resolution_clock::now();
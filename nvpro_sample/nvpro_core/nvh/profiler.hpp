@@ -23,14 +23,18 @@
 
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <float.h>  // DBL_MAX
 #include <functional>
+#include <math.h>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>  //memset
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifdef NVP_SUPPORTS_NVTOOLSEXT
@@ -55,6 +59,16 @@ namespace nvh {
     base class measuring only CPU time could be the master, and the api
     derived classes reference it to share the same database.
 
+    Recurring cpu sections may also be used from other threads than
+    the one calling beginFrame/endFrame. Such sections are recorded
+    lock-free into a ring buffer per thread and merged at endFrame,
+    their stats are kept per thread (see getThreadTimerInfo).
+    Sections with gpu times must stay on the frame thread.
+
+    beginTrace streams every section into a json file in the Chrome trace
+    event format, which chrome://tracing and https://ui.perfetto.dev load.
+    Cpu sections of all threads and the gpu sections share one timeline.
+
     Profiler::Clock can be used standalone for time measuring.
   */
 
@@ -69,6 +83,10 @@ public:
   static const uint32_t START_SECTIONS = 64;
   /// cyclic window for averaging
   static const uint32_t MAX_NUM_AVERAGE = 128;
+  /// sections a thread can record between two endFrame, excess sections are dropped
+  static const uint32_t THREAD_SECTIONS = 1024;
+  /// deeper nested sections of a thread are not recorded
+  static const uint32_t THREAD_MAX_LEVELS = 16;
 
 public:
   typedef uint32_t SectionID;
@@ -168,6 +186,12 @@ public:
     double average     = 0;
     double absMinValue = DBL_MAX;
     double absMaxValue = 0;
+
+    // percentiles of all values since the last reset,
+    // taken from a histogram with buckets of 1/8 power of two
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
   };
 
   struct TimerInfo
@@ -208,6 +232,24 @@ public:
     }
   }
 
+  // number of threads other than the frame thread that recorded sections
+  uint32_t getNumThreads() const;
+
+  std::thread::id getThreadID(uint32_t threadIndex) const;
+
+  // cpu timing of the sections a thread recorded, accumulated per frame
+  // returns true if found timer and it had valid values
+  bool getThreadTimerInfo(uint32_t threadIndex, const char* name, TimerInfo& info);
+
+  //////////////////////////////////////////////////////////////////////////
+
+  // streams all sections into a Chrome trace json file until endTrace,
+  // events are written at endFrame, so memory use does not grow with the capture.
+  // gpu sections show up FRAME_DELAY frames late.
+  bool beginTrace(const char* filename);
+  void endTrace();
+  bool isTracing() const { return m_data->traceFile != nullptr; }
+
   //////////////////////////////////////////////////////////////////////////
 
   // if a master is provided we use its database
@@ -234,13 +276,23 @@ protected:
 
   inline bool isSectionRecurring(SectionID slot) const { return m_data->entries[slot].level != LEVEL_SINGLESHOT; }
 
-private:
-  //////////////////////////////////////////////////////////////////////////
-
-  static const uint32_t LEVEL_SINGLESHOT = ~0;
+  // optional, lets traces show when the gpu work of a section started, call it from the gpuTimeProvider.
+  // calibrated times are in the domain of getMicroSeconds(), otherwise they are in any gpu
+  // clock domain and get aligned so the gpu work does not start before its cpu section.
+  inline void setGpuBeginTime(SectionID slot, uint32_t subFrame, double microSeconds, bool calibrated)
+  {
+    Entry& entry              = m_data->entries[slot];
+    entry.gpuBegins[subFrame] = microSeconds;
+    entry.gpuModes[subFrame]  = calibrated ? GPU_BEGIN_CALIBRATED : GPU_BEGIN_UNCALIBRATED;
+  }
 
+  // cyclic averaging window and histogram of the values of a timer
   struct TimeValues
   {
+    static const int32_t  HISTOGRAM_MIN_LOG2 = -4;  // 1/16 microsecond
+    static const uint32_t HISTOGRAM_STEPS    = 8;   // buckets per power of two
+    static const uint32_t HISTOGRAM_SIZE     = 256;
+
     double times[MAX_NUM_AVERAGE] = {0};
     double valueTotal             = 0;
     double absMinValue            = DBL_MAX;
@@ -250,6 +302,9 @@ private:
     uint32_t numCycle = MAX_NUM_AVERAGE;
     uint32_t numValid = 0;
 
+    uint32_t histogram[HISTOGRAM_SIZE] = {0};
+    uint32_t histogramCount            = 0;
+
     TimeValues(uint32_t cycleSize = MAX_NUM_AVERAGE) { init(cycleSize); }
 
     void init(uint32_t cycleSize)
@@ -266,6 +321,9 @@ private:
       index       = 0;
       numValid    = 0;
       memset(times, 0, sizeof(times));
+
+      histogramCount = 0;
+      memset(histogram, 0, sizeof(histogram));
     }
 
     void add(double time)
@@ -278,6 +336,46 @@ private:
 
       absMinValue = std::min(time, absMinValue);
       absMaxValue = std::max(time, absMaxValue);
+
+      histogram[getBucket(time)]++;
+      histogramCount++;
+    }
+
+    static uint32_t getBucket(double time)
+    {
+      double bucket = (log2(std::max(time, 1.0e-6)) - double(HISTOGRAM_MIN_LOG2)) * double(HISTOGRAM_STEPS);
+      return uint32_t(std::min(std::max(bucket, 0.0), double(HISTOGRAM_SIZE - 1)));
+    }
+
+    // fraction in [0,1], returns the center of the bucket, clamped to the observed range
+    double getPercentile(double fraction) const
+    {
+      if(!histogramCount)
+      {
+        return 0;
+      }
+
+      uint32_t target = std::max(uint32_t(ceil(fraction * double(histogramCount))), 1u);
+      uint32_t sum    = 0;
+      uint32_t bucket = 0;
+      for(; bucket < HISTOGRAM_SIZE - 1; bucket++)
+      {
+        sum += histogram[bucket];
+        if(sum >= target)
+          break;
+      }
+
+      double time = exp2(double(HISTOGRAM_MIN_LOG2) + (double(bucket) + 0.5) / double(HISTOGRAM_STEPS));
+      return std::min(std::max(time, absMinValue), absMaxValue);
+    }
+
+    void getStats(TimerStats& stats) const
+    {
+      stats.absMinValue = absMinValue;
+      stats.absMaxValue = absMaxValue;
+      stats.p50         = getPercentile(0.50);
+      stats.p95         = getPercentile(0.95);
+      stats.p99         = getPercentile(0.99);
     }
 
     double getAveraged()
@@ -293,6 +391,34 @@ private:
     }
   };
 
+private:
+  //////////////////////////////////////////////////////////////////////////
+
+  static const uint32_t LEVEL_SINGLESHOT = ~0;
+  // set in SectionIDs returned for sections of other threads
+  static const uint32_t SECTION_THREAD_BIT = 0x80000000;
+
+  enum GpuBeginMode
+  {
+    GPU_BEGIN_NONE,
+    GPU_BEGIN_UNCALIBRATED,
+    GPU_BEGIN_CALIBRATED,
+  };
+
+  // trace event thread ids, workers start at TRACE_TID_THREADS
+  static const uint32_t TRACE_TID_FRAME   = 0;
+  static const uint32_t TRACE_TID_GPU     = 1;
+  static const uint32_t TRACE_TID_THREADS = 16;
+
+  struct TraceGpuSection
+  {
+    const char* name;
+    double      cpuBegin;
+    double      gpuBegin;
+    double      gpuTime;
+    uint32_t    mode;
+  };
+
   struct Entry
   {
     const char*        name            = nullptr;
@@ -309,6 +435,11 @@ private:
     double cpuTimes[FRAME_DELAY] = {0};
     double gpuTimes[FRAME_DELAY] = {0};
 
+    // for trace capture
+    double   cpuBegins[FRAME_DELAY] = {0};
+    double   gpuBegins[FRAME_DELAY] = {0};
+    uint32_t gpuModes[FRAME_DELAY]  = {0};
+
     // number of times summed since last reset
     uint32_t numTimes = 0;
 
@@ -334,6 +465,56 @@ private:
     bool accumulated = false;
   };
 
+  struct ThreadSection
+  {
+    const char* name;
+    uint32_t    level;
+    // in getThreadTicks(), converted at endFrame
+    uint64_t ticksBegin;
+    uint64_t ticksEnd;
+  };
+
+  struct ThreadEntry
+  {
+    const char* name  = nullptr;
+    uint32_t    level = 0;
+
+    // sum of the current frame
+    double   frameBegin = 0;
+    double   frameTime  = 0;
+    uint32_t frameCount = 0;
+
+    // number of frames summed since last reset
+    uint32_t numTimes    = 0;
+    bool     accumulated = false;
+
+    TimeValues cpuTime;
+  };
+
+  struct ThreadData
+  {
+    std::thread::id id;
+    uint32_t        index = 0;
+
+    // only accessed by the owning thread
+    uint32_t    level = 0;
+    const char* levelNames[THREAD_MAX_LEVELS];
+    uint64_t    levelTicks[THREAD_MAX_LEVELS];
+    // last seen value of read, avoids touching the consumer's cache line per section
+    uint32_t readCached = 0;
+
+    // single producer (owning thread), single consumer (endFrame)
+    ThreadSection         sections[THREAD_SECTIONS];
+    std::atomic<uint32_t> written{0};
+    std::atomic<uint32_t> read{0};
+    std::atomic<uint32_t> dropped{0};
+
+    // only accessed by endFrame and the query functions
+    std::vector<ThreadEntry> entries;
+    uint32_t                 droppedLastFrame = 0;
+    bool                     traceNamed       = false;
+  };
+
   struct Data
   {
     uint32_t numAveraging = MAX_NUM_AVERAGE;
@@ -353,6 +534,24 @@ private:
     TimeValues cpuTime;
 
     std::vector<Entry> entries;
+
+    // identifies the database in the per-thread cache
+    uint64_t                     uid = 0;
+    std::atomic<std::thread::id> frameThread;
+    // guards the threads vector, not the recording itself
+    mutable std::mutex                       threadMutex;
+    std::vector<std::unique_ptr<ThreadData>> threads;
+    // maps getThreadTicks() to getMicroSeconds(), refined every endFrame
+    uint64_t ticksBase           = 0;
+    double   ticksBaseTime       = 0;
+    double   ticksPerMicroSecond = 0;
+
+    FILE*                        traceFile     = nullptr;
+    bool                         traceFirst    = true;
+    double                       cpuFrameBegin = 0;
+    std::vector<TraceGpuSection> traceGpuSections;
+
+    ~Data();
   };
 
 
@@ -363,6 +562,15 @@ private:
 
   bool getTimerInfo(uint32_t i, TimerInfo& info);
   void grow(uint32_t newsize);
+
+  ThreadData* getThreadData();
+  SectionID   beginThreadSection(const char* name);
+  void        endThreadSection(SectionID sec);
+  void        mergeThreadSections(bool reset);
+
+  void traceEvent(const char* name, uint32_t tid, double begin, double duration);
+  void traceThreadName(uint32_t tid, const char* name, uint32_t index = ~0u);
+  void traceGpuSections();
 };
 }  // namespace nvh
 
@@ -21,6 +21,24 @@
 #ifndef NV_RADIXSORT_INCLUDED
 #define NV_RADIXSORT_INCLUDED
 
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+#include <NvFoundation.h>
+
+#include "jobsystem.hpp"
+
+#if defined(NV_X86) || defined(NV_X64)
+#define RADIXSORT_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define RADIXSORT_USE_SSE 0
+#endif
+
 namespace nvh {
 
 /**
@@ -103,6 +121,367 @@ uint32_t* radixsort(uint32_t numIndices, const TKey* keys, uint32_t* indicesIn,
   return tempIn;
 }
 
+namespace radixsort_detail {
+
+// adds the digits of all passes of keys[0,num) to histogram[pass][digit]
+template <typename TKey, uint32_t DIGIT_BITS, uint32_t PASSES>
+inline void histogramDigits(const TKey* keys, size_t num, size_t* histogram)
+{
+  const uint32_t DIGIT_SIZE = 1 << DIGIT_BITS;
+  const uint32_t DIGIT_MASK = DIGIT_SIZE - 1;
+
+  size_t i = 0;
+#if RADIXSORT_USE_SSE
+  if(sizeof(TKey) == 4 || sizeof(TKey) == 8)
+  {
+    // one shift and mask extracts a digit of 16 bytes worth of keys
+    const size_t  KEYS = 16 / sizeof(TKey);
+    const __m128i mask = sizeof(TKey) == 4 ? _mm_set1_epi32(DIGIT_MASK) : _mm_set1_epi64x(DIGIT_MASK);
+    alignas(16) TKey digits[KEYS];
+
+    for(; i + KEYS <= num; i += KEYS)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(keys + i));
+      for(uint32_t p = 0; p < PASSES; p++)
+      {
+        __m128i count   = _mm_cvtsi32_si128(int(p * DIGIT_BITS));
+        __m128i shifted = sizeof(TKey) == 4 ? _mm_srl_epi32(v, count) : _mm_srl_epi64(v, count);
+        _mm_store_si128((__m128i*)digits, _mm_and_si128(shifted, mask));
+        for(size_t k = 0; k < KEYS; k++)
+        {
+          histogram[p * DIGIT_SIZE + size_t(digits[k])]++;
+        }
+      }
+    }
+  }
+#endif
+  for(; i < num; i++)
+  {
+    TKey key = keys[i];
+    for(uint32_t p = 0; p < PASSES; p++)
+    {
+      histogram[p * DIGIT_SIZE + ((key >> (p * DIGIT_BITS)) & DIGIT_MASK)]++;
+    }
+  }
+}
+
+}  // namespace radixsort_detail
+
+/**
+      \fn nvh::radixsortPairs
+
+      The radixsortPairs function sorts keys and their values by the
+      unsigned integer keys. Unlike nvh::radixsort it moves the pairs
+      themselves, so every pass streams through memory linearly.
+      
+      The keys are processed in 11-bit digits, passes in which all keys
+      share the same digit are skipped. The temp arrays must hold numPairs
+      elements, the sorted result is always returned in keys and values.
+      
+      When a jobSystem is provided, the arrays are split into one block per
+      worker slot. Each block builds its own histograms, the block-local
+      offsets are merged in block order, so every block scatters its pairs
+      independently and the sort stays stable.
+      
+      \code{.cpp}
+      std::vector<uint64_t> keys;     // e.g. depth | material
+      std::vector<uint32_t> drawItems;
+      
+      std::vector<uint64_t> keysTemp(keys.size());
+      std::vector<uint32_t> drawItemsTemp(keys.size());
+      
+      radixsortPairs(keys.size(), keys.data(), drawItems.data(), keysTemp.data(), drawItemsTemp.data(), &jobSystem);
+      \endcode
+    */
+
+template <typename TKey, typename TValue>
+void radixsortPairs(size_t numPairs, TKey* keys, TValue* values, TKey* keysTemp, TValue* valuesTemp, JobSystem* jobSystem = nullptr)
+{
+  static_assert(std::is_integral<TKey>::value && std::is_unsigned<TKey>::value, "keys must be unsigned integers");
+  static_assert(std::is_trivially_copyable<TValue>::value, "values are moved with memcpy");
+
+  const uint32_t DIGIT_BITS = 11;
+  const uint32_t DIGIT_SIZE = 1 << DIGIT_BITS;
+  const uint32_t DIGIT_MASK = DIGIT_SIZE - 1;
+  const uint32_t PASSES     = (sizeof(TKey) * 8 + DIGIT_BITS - 1) / DIGIT_BITS;
+  // blocks smaller than this are not worth their histogram
+  const size_t MIN_BLOCK_SIZE = 1 << 16;
+
+  if(numPairs < 2)
+    return;
+
+  size_t numBlocks = 1;
+  if(jobSystem)
+  {
+    numBlocks = std::min(size_t(jobSystem->getNumSlots()), (numPairs + MIN_BLOCK_SIZE - 1) / MIN_BLOCK_SIZE);
+  }
+  size_t blockSize = (numPairs + numBlocks - 1) / numBlocks;
+
+  auto forEachBlock = [&](const std::function<void(size_t block, size_t begin, size_t end)>& fn) {
+    if(numBlocks == 1)
+    {
+      fn(0, 0, numPairs);
+      return;
+    }
+    jobSystem->parallelFor(
+        0, numBlocks,
+        [&](size_t blockBegin, size_t blockEnd, uint32_t) {
+          for(size_t b = blockBegin; b < blockEnd; b++)
+          {
+            fn(b, b * blockSize, std::min(numPairs, (b + 1) * blockSize));
+          }
+        },
+        1);
+  };
+
+  // per-block histograms of all digits in one read, [block][pass][digit]
+  std::vector<size_t> histograms(numBlocks * PASSES * DIGIT_SIZE, 0);
+
+  forEachBlock([&](size_t block, size_t begin, size_t end) {
+    radixsort_detail::histogramDigits<TKey, DIGIT_BITS, PASSES>(keys + begin, end - begin,
+                                                                &histograms[block * PASSES * DIGIT_SIZE]);
+  });
+
+  TKey*   keysIn    = keys;
+  TValue* valuesIn  = values;
+  TKey*   keysOut   = keysTemp;
+  TValue* valuesOut = valuesTemp;
+
+  // [block][digit] scatter positions of the current pass
+  std::vector<size_t> offsets(numBlocks * DIGIT_SIZE);
+
+  for(uint32_t p = 0; p < PASSES; p++)
+  {
+    uint32_t shift = p * DIGIT_BITS;
+
+    // the digit histogram over all blocks tells us if this pass can be skipped
+    bool   constant = false;
+    size_t total[DIGIT_SIZE];
+    for(uint32_t d = 0; d < DIGIT_SIZE; d++)
+    {
+      total[d] = 0;
+      for(size_t b = 0; b < numBlocks; b++)
+      {
+        total[d] += histograms[(b * PASSES + p) * DIGIT_SIZE + d];
+      }
+      constant = constant || total[d] == numPairs;
+    }
+    if(constant)
+      continue;
+
+    // the first pass's block histograms match the current layout, later passes
+    // see the pairs moved across blocks and need the block counts again
+    if(p != 0 && numBlocks > 1)
+    {
+      forEachBlock([&](size_t block, size_t begin, size_t end) {
+        size_t* histogram = &histograms[(block * PASSES + p) * DIGIT_SIZE];
+        memset(histogram, 0, sizeof(size_t) * DIGIT_SIZE);
+        for(size_t i = begin; i < end; i++)
+        {
+          histogram[(keysIn[i] >> shift) & DIGIT_MASK]++;
+        }
+      });
+    }
+
+    // merge: digits in order, within a digit the blocks in order
+    size_t offset = 0;
+    for(uint32_t d = 0; d < DIGIT_SIZE; d++)
+    {
+      for(size_t b = 0; b < numBlocks; b++)
+      {
+        offsets[b * DIGIT_SIZE + d] = offset;
+        offset += histograms[(b * PASSES + p) * DIGIT_SIZE + d];
+      }
+    }
+    assert(offset == numPairs);
+
+    forEachBlock([&](size_t block, size_t begin, size_t end) {
+      size_t* offset = &offsets[block * DIGIT_SIZE];
+      for(size_t i = begin; i < end; i++)
+      {
+        TKey   key     = keysIn[i];
+        size_t pos     = offset[(key >> shift) & DIGIT_MASK]++;
+        keysOut[pos]   = key;
+        valuesOut[pos] = valuesIn[i];
+      }
+    });
+
+    std::swap(keysIn, keysOut);
+    std::swap(valuesIn, valuesOut);
+  }
+
+  // odd number of executed passes
+  if(keysIn != keys)
+  {
+    forEachBlock([&](size_t, size_t begin, size_t end) {
+      memcpy(keys + begin, keysIn + begin, sizeof(TKey) * (end - begin));
+      memcpy(values + begin, valuesIn + begin, sizeof(TValue) * (end - begin));
+    });
+  }
+}
+
+namespace radixsort_detail {
+
+template <typename TKey, typename TValue>
+inline void insertionSortPairs(size_t numPairs, TKey* keys, TValue* values)
+{
+  for(size_t i = 1; i < numPairs; i++)
+  {
+    TKey   key   = keys[i];
+    TValue value = values[i];
+    size_t j     = i;
+    for(; j > 0 && key < keys[j - 1]; j--)
+    {
+      keys[j]   = keys[j - 1];
+      values[j] = values[j - 1];
+    }
+    keys[j]   = key;
+    values[j] = value;
+  }
+}
+
+// American flag sort, the digit at shift is permuted in place, then every
+// bucket recurses into the next lower digit.
+// counts and heads provide DIGIT_SIZE entries per remaining digit.
+template <typename TKey, typename TValue, uint32_t DIGIT_BITS>
+void sortPairsInPlace(size_t numPairs, TKey* keys, TValue* values, int shift, size_t* counts, size_t* heads, JobSystem* jobSystem, JobSystem::Counter* counter)
+{
+  const uint32_t DIGIT_SIZE = 1 << DIGIT_BITS;
+  const uint32_t DIGIT_MASK = DIGIT_SIZE - 1;
+  // below this the bucket bookkeeping costs more than it saves
+  const size_t INSERTION_SIZE = 32;
+  // buckets that are handed to other workers
+  const size_t JOB_SIZE = 1 << 16;
+
+  if(numPairs <= INSERTION_SIZE)
+  {
+    insertionSortPairs(numPairs, keys, values);
+    return;
+  }
+
+  // skip digits that all keys share
+  for(; shift >= 0; shift -= DIGIT_BITS)
+  {
+    memset(counts, 0, sizeof(size_t) * DIGIT_SIZE);
+    for(size_t i = 0; i < numPairs; i++)
+    {
+      counts[(keys[i] >> shift) & DIGIT_MASK]++;
+    }
+    if(counts[(keys[0] >> shift) & DIGIT_MASK] != numPairs)
+      break;
+  }
+  if(shift < 0)
+    return;
+
+  size_t offset = 0;
+  for(uint32_t d = 0; d < DIGIT_SIZE; d++)
+  {
+    heads[d] = offset;
+    offset += counts[d];
+    // from now on counts holds the end of each bucket
+    counts[d] = offset;
+  }
+
+  // every swap moves one pair into its final bucket
+  for(uint32_t d = 0; d < DIGIT_SIZE; d++)
+  {
+    while(heads[d] < counts[d])
+    {
+      TKey     key   = keys[heads[d]];
+      TValue   value = values[heads[d]];
+      uint32_t digit = uint32_t((key >> shift) & DIGIT_MASK);
+      while(digit != d)
+      {
+        size_t pos = heads[digit]++;
+        std::swap(key, keys[pos]);
+        std::swap(value, values[pos]);
+        digit = uint32_t((key >> shift) & DIGIT_MASK);
+      }
+      keys[heads[d]]   = key;
+      values[heads[d]] = value;
+      heads[d]++;
+    }
+  }
+
+  if(shift == 0)
+    return;
+
+  size_t begin = 0;
+  for(uint32_t d = 0; d < DIGIT_SIZE; d++)
+  {
+    size_t end = counts[d];
+    size_t num = end - begin;
+    if(num > 1)
+    {
+      TKey*   bucketKeys   = keys + begin;
+      TValue* bucketValues = values + begin;
+      if(jobSystem && num >= JOB_SIZE)
+      {
+        jobSystem->run(
+            [=](uint32_t) {
+              std::vector<size_t> scratch(size_t(shift / DIGIT_BITS) * DIGIT_SIZE * 2);
+              sortPairsInPlace<TKey, TValue, DIGIT_BITS>(num, bucketKeys, bucketValues, shift - DIGIT_BITS, scratch.data(),
+                                                         scratch.data() + scratch.size() / 2, jobSystem, counter);
+            },
+            counter);
+      }
+      else
+      {
+        sortPairsInPlace<TKey, TValue, DIGIT_BITS>(num, bucketKeys, bucketValues, shift - DIGIT_BITS, counts + DIGIT_SIZE,
+                                                   heads + DIGIT_SIZE, jobSystem, counter);
+      }
+    }
+    begin = end;
+  }
+}
+
+}  // namespace radixsort_detail
+
+/**
+      \fn nvh::radixsortPairsInPlace
+
+      The radixsortPairsInPlace function sorts keys and their values by the
+      unsigned integer keys without temporary arrays, at the cost of
+      stability: pairs with equal keys end up in arbitrary order.
+      
+      It is a most-significant-digit-first radix sort over 11-bit digits,
+      every digit is permuted in place by swapping pairs into their buckets,
+      digits that all keys of a bucket share are skipped.
+      
+      When a jobSystem is provided, big buckets are sorted by the workers
+      while the calling thread helps out. The permutation of the first digit
+      itself is sequential, so radixsortPairs scales better if the temporary
+      memory is affordable.
+      
+      \code{.cpp}
+      radixsortPairsInPlace(keys.size(), keys.data(), drawItems.data(), &jobSystem);
+      \endcode
+    */
+
+template <typename TKey, typename TValue>
+void radixsortPairsInPlace(size_t numPairs, TKey* keys, TValue* values, JobSystem* jobSystem = nullptr)
+{
+  static_assert(std::is_integral<TKey>::value && std::is_unsigned<TKey>::value, "keys must be unsigned integers");
+
+  const uint32_t DIGIT_BITS = 11;
+  const uint32_t DIGIT_SIZE = 1 << DIGIT_BITS;
+  const uint32_t PASSES     = (sizeof(TKey) * 8 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+  if(numPairs < 2)
+    return;
+
+  // counts and heads for each digit level
+  std::vector<size_t> scratch(PASSES * DIGIT_SIZE * 2);
+
+  JobSystem::Counter counter;
+  radixsort_detail::sortPairsInPlace<TKey, TValue, DIGIT_BITS>(numPairs, keys, values, int((PASSES - 1) * DIGIT_BITS),
+                                                               scratch.data(), scratch.data() + PASSES * DIGIT_SIZE, jobSystem, &counter);
+  if(jobSystem)
+  {
+    jobSystem->wait(counter);
+  }
+}
+
 }  // namespace nvh
 
 #endif
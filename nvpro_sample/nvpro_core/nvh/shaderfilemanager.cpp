@@ -32,6 +32,13 @@
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 
 #include "fileoperations.hpp"
 
@@ -82,70 +89,338 @@ inline std::string ShaderFileManager::markerString(int line, std::string const&
   }
 }
 
-std::string ShaderFileManager::getIncludeContent(IncludeID idx, std::string& filename)
+uint64_t ShaderFileManager::hashContent(std::string const& content)
 {
-  IncludeEntry& entry = m_includes[idx];
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for(char c : content)
+  {
+    hash = (hash ^ uint8_t(c)) * 0x00000100000001B3ULL;
+  }
+  return hash;
+}
+
+ShaderFileManager::CachedFile& ShaderFileManager::statFile(std::string const& filename)
+{
+  CachedFile& file = m_fileCache[filename];
+  if(file.scan == m_fileScan)
+  {
+    return file;
+  }
+  file.scan = m_fileScan;
+
+  // Modification times with sub-second precision, so that quick successive
+  // saves of the same size are still noticed.
+  bool     exists   = false;
+  int64_t  time     = 0;
+  int64_t  timeNsec = 0;
+  uint64_t size     = 0;
+#if defined(_WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if(GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes)
+     && !(attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+  {
+    // FILETIME counts 100 ns intervals
+    uint64_t ticks = (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    exists         = true;
+    time           = int64_t(ticks / 10000000);
+    timeNsec       = int64_t(ticks % 10000000) * 100;
+    size           = (uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+  }
+#else
+  struct stat s;
+  if(stat(filename.c_str(), &s) == 0 && S_ISREG(s.st_mode))
+  {
+    exists = true;
+    time   = int64_t(s.st_mtime);
+#if defined(__APPLE__)
+    timeNsec = int64_t(s.st_mtimespec.tv_nsec);
+#else
+    timeNsec = int64_t(s.st_mtim.tv_nsec);
+#endif
+    size = uint64_t(s.st_size);
+  }
+#endif
+
+  if(exists != file.exists || time != file.time || timeNsec != file.timeNsec || size != file.size)
+  {
+    file.exists   = exists;
+    file.time     = time;
+    file.timeNsec = timeNsec;
+    file.size     = size;
+    file.loaded   = false;
+    file.content  = std::string();
+  }
+
+  return file;
+}
+
+std::string ShaderFileManager::findFileCached(std::string const& filename, std::vector<std::string> const& directories, bool warn)
+{
+  // same search order as nvh::findFile
+  if(statFile(filename).exists)
+  {
+    return filename;
+  }
+
+  for(const auto& directory : directories)
+  {
+    std::string candidate = directory + "/" + filename;
+    if(statFile(candidate).exists)
+    {
+      return candidate;
+    }
+  }
+
+  if(warn)
+  {
+    nvprintfLevel(LOGLEVEL_WARNING, "File not found: %s\n", filename.c_str());
+    nvprintfLevel(LOGLEVEL_WARNING, "In directories: \n");
+    for(const auto& directory : directories)
+    {
+      nvprintfLevel(LOGLEVEL_WARNING, " - %s\n", directory.c_str());
+    }
+    nvprintfLevel(LOGLEVEL_WARNING, "\n");
+  }
+
+  return std::string();
+}
 
-  filename = entry.filename;
+const std::string* ShaderFileManager::loadFileCached(std::string const& filenameFound, uint64_t& contentHash)
+{
+  contentHash = 0;
+  if(filenameFound.empty())
+  {
+    return nullptr;
+  }
 
-  if(m_forceIncludeContent)
+  CachedFile& file = statFile(filenameFound);
+  if(!file.exists)
   {
-    return entry.content;
+    return nullptr;
   }
 
-  if(!entry.content.empty() && !findFile(entry.filename, m_directories).empty())
+  if(!file.loaded)
   {
-    return entry.content;
+    file.content     = loadFile(filenameFound, false);
+    file.contentHash = hashContent(file.content);
+    file.loaded      = true;
   }
 
-  std::string content = loadFile(entry.filename, false, m_directories, filename, true);
-  return content.empty() ? entry.content : content;
+  contentHash = file.contentHash;
+  return &file.content;
 }
 
-std::string ShaderFileManager::getContent(std::string const& filename, std::string& filenameFound)
+const std::string* ShaderFileManager::findIncludeContent(IncludeID idx, std::string& filenameFound, uint64_t& contentHash, bool warn)
 {
-  if(filename.empty())
+  IncludeEntry& entry = m_includes[idx];
+
+  filenameFound = entry.filename;
+
+  if(m_forceIncludeContent || (!entry.content.empty() && !findFileCached(entry.filename, m_directories, false).empty()))
   {
-    return std::string();
+    contentHash = hashContent(entry.content);
+    return &entry.content;
   }
 
-  IncludeID idx = findInclude(filename);
+  filenameFound                  = findFileCached(entry.filename, m_directories, warn);
+  const std::string* fileContent = loadFileCached(filenameFound, contentHash);
+  if(!fileContent || fileContent->empty())
+  {
+    contentHash = hashContent(entry.content);
+    return &entry.content;
+  }
+  return fileContent;
+}
+
+const std::string* ShaderFileManager::findContent(std::string const& name,
+                                                  bool               relative,
+                                                  std::string const& requestingSource,
+                                                  std::string&       filenameFound,
+                                                  uint64_t&          contentHash,
+                                                  bool               warn)
+{
+  contentHash = 0;
+  if(name.empty())
+  {
+    return nullptr;
+  }
+
+  IncludeID idx = findInclude(name);
 
   if(idx.isValid())
   {
-    return getIncludeContent(idx, filenameFound);
+    return findIncludeContent(idx, filenameFound, contentHash, warn);
   }
 
-  // fall back
-  filenameFound = filename;
-  return loadFile(filename, false, m_directories, filenameFound, true);
+  if(relative)
+  {
+    // fall back; check requestingSource's directory first.
+    m_extendedDirectories.resize(m_directories.size() + 1);
+    m_extendedDirectories[0] = getDirectoryComponent(requestingSource);
+    for(size_t i = 0; i < m_directories.size(); ++i)
+    {
+      m_extendedDirectories[i + 1] = m_directories[i];
+    }
+    filenameFound = findFileCached(name, m_extendedDirectories, warn);
+  }
+  else
+  {
+    // fall back
+    filenameFound = findFileCached(name, m_directories, warn);
+  }
+
+  return loadFileCached(filenameFound, contentHash);
+}
+
+std::string ShaderFileManager::getIncludeContent(IncludeID idx, std::string& filename)
+{
+  uint64_t           contentHash;
+  const std::string* content = findIncludeContent(idx, filename, contentHash, true);
+  return content ? *content : std::string();
+}
+
+std::string ShaderFileManager::getContent(std::string const& filename, std::string& filenameFound)
+{
+  uint64_t           contentHash;
+  const std::string* content = findContent(filename, false, std::string(), filenameFound, contentHash, true);
+  return content ? *content : std::string();
 }
 
 std::string ShaderFileManager::getContentWithRequestingSourceDirectory(std::string const& filename,
                                                                        std::string&       filenameFound,
                                                                        std::string const& requestingSource)
 {
-  if(filename.empty())
+  uint64_t           contentHash;
+  const std::string* content = findContent(filename, true, requestingSource, filenameFound, contentHash, true);
+  return content ? *content : std::string();
+}
+
+bool ShaderFileManager::haveDependenciesChanged(const std::vector<FileDependency>& dependencies)
+{
+  if(dependencies.empty())
   {
-    return std::string();
+    return true;
   }
 
-  IncludeID idx = findInclude(filename);
+  std::string filenameFound;
+  for(const FileDependency& dependency : dependencies)
+  {
+    uint64_t contentHash;
+    filenameFound.clear();
+    findContent(dependency.name, dependency.relative, dependency.requestingSource, filenameFound, contentHash, false);
+    if(filenameFound != dependency.filenameFound || contentHash != dependency.contentHash)
+    {
+      return true;
+    }
+  }
 
-  if(idx.isValid())
+  return false;
+}
+
+void ShaderFileManager::removeDuplicateDependencies(std::vector<FileDependency>& dependencies)
+{
+  // files are typically included several times, the lists are short
+  size_t count = 0;
+  for(size_t i = 0; i < dependencies.size(); i++)
   {
-    return getIncludeContent(idx, filenameFound);
+    bool found = false;
+    for(size_t o = 0; o < count; o++)
+    {
+      const FileDependency& other = dependencies[o];
+      if(other.relative == dependencies[i].relative && other.name == dependencies[i].name
+         && other.requestingSource == dependencies[i].requestingSource)
+      {
+        found = true;
+        break;
+      }
+    }
+    if(!found)
+    {
+      if(count != i)
+      {
+        dependencies[count] = std::move(dependencies[i]);
+      }
+      count++;
+    }
+  }
+  dependencies.resize(count);
+}
+
+void ShaderFileManager::clearFileCache()
+{
+  m_fileCache.clear();
+  m_includeCache.clear();
+  m_fileScan++;
+}
+
+std::string ShaderFileManager::processInclude(std::string const&           name,
+                                              bool                         relative,
+                                              std::string const&           requestingSource,
+                                              std::string&                 filenameFound,
+                                              bool                         foundVersion,
+                                              std::vector<FileDependency>* dependencies)
+{
+  // everything besides the files that influences the processed text
+  std::string key = name;
+  key += '\n';
+  if(relative)
+  {
+    key += getDirectoryComponent(requestingSource);
+  }
+  key += '\n';
+  key += foundVersion ? '1' : '0';
+  key += m_lineMarkers ? '1' : '0';
+  key += (m_supportsExtendedInclude || m_forceLineFilenames) ? '1' : '0';
+  key += m_handleIncludePasting ? '1' : '0';
+  key += m_forceIncludeContent ? '1' : '0';
+
+  auto it = m_includeCache.find(key);
+  if(it != m_includeCache.end() && (it->second.scan == m_fileScan || !haveDependenciesChanged(it->second.dependencies)))
+  {
+    ProcessedInclude& include = it->second;
+    include.scan              = m_fileScan;
+    filenameFound             = include.filenameFound;
+    if(dependencies)
+    {
+      dependencies->insert(dependencies->end(), include.dependencies.begin(), include.dependencies.end());
+    }
+    return include.text;
+  }
+
+  ProcessedInclude include;
+  include.scan = m_fileScan;
+
+  FileDependency dependency;
+  dependency.name             = name;
+  dependency.relative         = relative;
+  dependency.requestingSource = requestingSource;
+
+  const std::string* content =
+      findContent(name, relative, requestingSource, dependency.filenameFound, dependency.contentHash, true);
+  filenameFound         = dependency.filenameFound;
+  include.filenameFound = dependency.filenameFound;
+  include.dependencies.push_back(std::move(dependency));
+
+  // the nested includes are memoized as well, so unchanged subtrees are not processed again
+  include.text = manualIncludeText(content ? *content : std::string(), include.filenameFound, std::string(),
+                                   foundVersion, &include.dependencies);
+  removeDuplicateDependencies(include.dependencies);
+
+  if(dependencies)
+  {
+    dependencies->insert(dependencies->end(), include.dependencies.begin(), include.dependencies.end());
   }
 
-  // fall back; check requestingSource's directory first.
-  filenameFound = filename;
-  m_extendedDirectories.resize(m_directories.size() + 1);
-  m_extendedDirectories[0] = getDirectoryComponent(requestingSource);
-  for(size_t i = 0; i < m_directories.size(); ++i)
+  // missing includes are not memoized, so they keep being reported
+  if(!content)
   {
-    m_extendedDirectories[i + 1] = m_directories[i];
+    return include.text;
   }
-  return loadFile(filename, false, m_extendedDirectories, filenameFound, true);
+
+  ProcessedInclude& stored = m_includeCache[key];
+  stored                   = std::move(include);
+  return stored.text;
 }
 
 std::string ShaderFileManager::getDirectoryComponent(std::string filename)
@@ -170,13 +445,32 @@ exitLoop:
   return filename;
 }
 
-std::string ShaderFileManager::manualInclude(std::string const& filename, std::string& filenameFound, std::string const& prepend, bool foundVersion)
+std::string ShaderFileManager::manualInclude(std::string const&           filename,
+                                             std::string&                 filenameFound,
+                                             std::string const&           prepend,
+                                             bool                         foundVersion,
+                                             std::vector<FileDependency>* dependencies)
 {
-  std::string source = getContent(filename, filenameFound);
-  return manualIncludeText(source, filenameFound, prepend, foundVersion);
+  FileDependency dependency;
+  dependency.name = filename;
+
+  const std::string* content = findContent(filename, false, std::string(), filenameFound, dependency.contentHash, true);
+  std::string        source  = content ? *content : std::string();
+
+  if(dependencies)
+  {
+    dependency.filenameFound = filenameFound;
+    dependencies->push_back(std::move(dependency));
+  }
+
+  return manualIncludeText(source, filenameFound, prepend, foundVersion, dependencies);
 }
 
-std::string ShaderFileManager::manualIncludeText(std::string const& sourceText, std::string const& textFilename, std::string const& prepend, bool foundVersion)
+std::string ShaderFileManager::manualIncludeText(std::string const&           sourceText,
+                                                 std::string const&           textFilename,
+                                                 std::string const&           prepend,
+                                                 bool                         foundVersion,
+                                                 std::vector<FileDependency>* dependencies)
 {
   if(sourceText.empty())
   {
@@ -239,7 +533,7 @@ std::string ShaderFileManager::manualIncludeText(std::string const& sourceText,
         std::string include = line.substr(firstQuote + 1, secondQuote - firstQuote - 1);
 
         std::string includeFound;
-        std::string includeContent = manualInclude(include, includeFound, std::string(), foundVersion);
+        std::string includeContent = processInclude(include, false, std::string(), includeFound, foundVersion, dependencies);
 
         if(!includeContent.empty())
         {
@@ -268,10 +562,14 @@ ShaderFileManager::IncludeID ShaderFileManager::registerInclude(std::string cons
     if(m_includes[i].name == name)
     {
       m_includes[i].content = content;
+      beginFileScan();
       return i;
     }
   }
 
+  // registered content is validated per scan
+  beginFileScan();
+
   IncludeEntry entry;
   entry.name     = name;
   entry.filename = filename.empty() ? name : filename;
@@ -301,6 +599,7 @@ bool ShaderFileManager::loadIncludeContent(IncludeID idx)
 {
   std::string filenameFound;
   m_includes[idx].content = getIncludeContent(idx, filenameFound);
+  beginFileScan();
   return !m_includes[idx].content.empty();
 }
 
@@ -311,6 +610,7 @@ const ShaderFileManager::IncludeEntry& ShaderFileManager::getIncludeEntry(Includ
 
 std::string ShaderFileManager::getProcessedContent(std::string const& filename, std::string& filenameFound)
 {
+  beginFileScan();
   return manualInclude(filename, filenameFound, "", false);
 }
 
@@ -22,8 +22,10 @@
 #define NV_SHADERFILEMANAGER_INCLUDED
 
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace nvh {
@@ -51,6 +53,18 @@ class ShaderFileManager
     for #defines) after the #version statement of GLSL files,
     regardless of m_handleIncludePasting's value.
 
+    Loaded files and processed includes are cached as an include graph.
+    A file is only reloaded when its modification time or size changed,
+    and the processed text of an include is reused as long as none of the
+    files it was built from changed, so unchanged subtrees are neither
+    reloaded nor scanned again. Files are checked at most once per scan,
+    derived classes begin a new scan whenever they create or reload
+    programs (beginFileScan).
+
+    Every Definition records the files its content depends on, which
+    allows to only reload the definitions whose include closure changed
+    (haveDependenciesChanged).
+
   */
 
 public:
@@ -71,6 +85,16 @@ public:
 
   typedef std::vector<IncludeEntry> IncludeRegistry;
 
+  struct FileDependency
+  {
+    std::string name;
+    // the directory of requestingSource was searched first
+    bool        relative = false;
+    std::string requestingSource;
+    std::string filenameFound;
+    uint64_t    contentHash = 0;
+  };
+
   static std::string format(const char* msg, ...);
 
 public:
@@ -125,6 +149,8 @@ public:
     FileType    filetype = FILETYPE_DEFAULT;
     std::string filenameFound;
     std::string content;
+    // files the content was loaded from, filled by the derived classes
+    std::vector<FileDependency> dependencies;
   };
 
 
@@ -171,6 +197,15 @@ public:
 
   std::string getProcessedContent(std::string const& filename, std::string& filenameFound);
 
+  // files are checked for modifications at most once per scan
+  void beginFileScan() { m_fileScan++; }
+  // also true if dependencies is empty, as nothing is known then
+  bool haveDependenciesChanged(const std::vector<FileDependency>& dependencies);
+  // releases all cached files and processed includes
+  void clearFileCache();
+
+  static uint64_t hashContent(std::string const& content);
+
 protected:
   std::string markerString(int line, std::string const& filename, int fileid);
   std::string getIncludeContent(IncludeID idx, std::string& filenameFound);
@@ -181,8 +216,27 @@ protected:
 
   static std::string getDirectoryComponent(std::string filename);
 
-  std::string manualInclude(std::string const& filename, std::string& filenameFound, std::string const& prepend, bool foundVersion);
-  std::string manualIncludeText(std::string const& sourceText, std::string const& textFilename, std::string const& prepend, bool foundVersion);
+  // dependencies is optional, the files used are appended to it
+  std::string manualInclude(std::string const&           filename,
+                            std::string&                 filenameFound,
+                            std::string const&           prepend,
+                            bool                         foundVersion,
+                            std::vector<FileDependency>* dependencies = nullptr);
+  std::string manualIncludeText(std::string const&           sourceText,
+                                std::string const&           textFilename,
+                                std::string const&           prepend,
+                                bool                         foundVersion,
+                                std::vector<FileDependency>* dependencies = nullptr);
+
+  // processes an included file with manualIncludeText, the result is memoized in the include graph
+  std::string processInclude(std::string const&           name,
+                             bool                         relative,
+                             std::string const&           requestingSource,
+                             std::string&                 filenameFound,
+                             bool                         foundVersion,
+                             std::vector<FileDependency>* dependencies);
+
+  static void removeDuplicateDependencies(std::vector<FileDependency>& dependencies);
 
   bool m_lineMarkers;
   bool m_forceLineFilenames;
@@ -195,6 +249,45 @@ protected:
 
   // Used as temporary storage in getContentWithRequestingSourceDirectory; saves on dynamic allocation.
   std::vector<std::string> m_extendedDirectories;
+
+private:
+  struct CachedFile
+  {
+    uint32_t    scan        = 0;
+    bool        exists      = false;
+    bool        loaded      = false;
+    int64_t     time        = 0;
+    int64_t     timeNsec    = 0;
+    uint64_t    size        = 0;
+    uint64_t    contentHash = 0;
+    std::string content;
+  };
+
+  struct ProcessedInclude
+  {
+    uint32_t                    scan = 0;
+    std::string                 text;
+    std::string                 filenameFound;
+    std::vector<FileDependency> dependencies;
+  };
+
+  // returns nullptr if nothing was found, filenameFound is left untouched for empty names
+  const std::string* findContent(std::string const& name,
+                                 bool               relative,
+                                 std::string const& requestingSource,
+                                 std::string&       filenameFound,
+                                 uint64_t&          contentHash,
+                                 bool               warn);
+  const std::string* findIncludeContent(IncludeID idx, std::string& filenameFound, uint64_t& contentHash, bool warn);
+  CachedFile&        statFile(std::string const& filename);
+  std::string        findFileCached(std::string const& filename, std::vector<std::string> const& directories, bool warn);
+  const std::string* loadFileCached(std::string const& filenameFound, uint64_t& contentHash);
+
+  // keyed by the filename as used for loading
+  std::unordered_map<std::string, CachedFile> m_fileCache;
+  // keyed by the include name, the directory searched first and the settings affecting the text
+  std::unordered_map<std::string, ProcessedInclude> m_includeCache;
+  uint32_t                                          m_fileScan = 1;
 };
 
 }  // namespace nvh
@@ -22,8 +22,11 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <map>
 #include <stdint.h>
 #include <stdio.h>
+#include <utility>
+#include <vector>
  
 #include <NvFoundation.h> // for NV_X86 and NV_X64
 
@@ -40,7 +43,10 @@ namespace nvh {
   maximum size. Ranges are allocated at GRANULARITY and are merged back on freeing.
   Its primary use is within allocators that sub-allocate from fixed-size blocks.
 
-  The implementation is based on [MakeID by Emil Persson](http://www.humus.name/3D/MakeID.h).
+  The free ranges are binned by size in two levels (TLSF), so finding a range
+  that fits takes constant time, and allocating from it does not need to search.
+  Freeing is O(log n) in the number of free ranges, to find the neighbors it is
+  merged with. Whenever a fitting range exists the allocation succeeds.
 
   Example :
 
@@ -81,15 +87,20 @@ template <uint32_t GRANULARITY = 256>
 class TRangeAllocator
 {
 private:
-  uint32_t m_size;
-  uint32_t m_used;
+  uint32_t m_size = 0;
+  uint32_t m_used = 0;
 
 public:
-  TRangeAllocator() {}
+  TRangeAllocator() { rangeDeinit(); }
   TRangeAllocator(uint32_t size) { init(size); }
 
   ~TRangeAllocator() { deinit(); }
 
+  TRangeAllocator(const TRangeAllocator& other) = default;
+  TRangeAllocator(TRangeAllocator&& other)      = default;
+  TRangeAllocator& operator=(const TRangeAllocator& other) = default;
+  TRangeAllocator& operator=(TRangeAllocator&& other) = default;
+
   static uint32_t alignedSize(uint32_t size) { return (size + GRANULARITY - 1) & (~(GRANULARITY - 1)); }
 
   void init(uint32_t size)
@@ -97,7 +108,13 @@ public:
     assert(size % GRANULARITY == 0 && "managed total size must be aligned to GRANULARITY");
 
     uint32_t pages = ((size + GRANULARITY - 1) / GRANULARITY);
-    rangeInit(pages - 1);
+    rangeDeinit();
+    if(pages)
+    {
+      uint32_t index = rangeCreate(0, pages);
+      m_rangesByEnd.emplace(pages, index);
+      binInsert(index);
+    }
     m_used = 0;
     m_size = size;
   }
@@ -105,36 +122,45 @@ public:
 
   bool isEmpty() const { return m_used == 0; }
 
-  bool isAvailable(uint32_t size, uint32_t align) const
-  {
-    uint32_t alignRest    = align - 1;
-    uint32_t sizeReserved = size;
+  uint32_t getUsedSize() const { return m_used; }
 
-    if(m_used >= m_size)
+  // size of the largest free range, an allocation of this size with
+  // alignment <= GRANULARITY is guaranteed to succeed
+  uint32_t getLargestFree() const
+  {
+    if(!m_largestValid)
     {
-      return false;
+      // only the ranges of the highest bin need to be looked at
+      m_largestCount = 0;
+      if(m_flBitmap)
+      {
+        uint32_t fl = bitScanReverse(m_flBitmap);
+        uint32_t sl = bitScanReverse(m_slBitmaps[fl]);
+        for(uint32_t i = m_binHeads[fl][sl]; i != INVALID_INDEX; i = m_ranges[i].binNext)
+        {
+          m_largestCount = std::max(m_largestCount, m_ranges[i].count);
+        }
+      }
+      m_largestValid = true;
     }
+    return m_largestCount * GRANULARITY;
+  }
 
-    if(m_used != 0 && align > GRANULARITY)
+  bool isAvailable(uint32_t size, uint32_t align) const
+  {
+    if(m_used >= m_size)
     {
-      sizeReserved += alignRest;
+      return false;
     }
 
-    uint32_t countReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
-    return isRangeAvailable(countReserved);
+    uint32_t aligned;
+    return findRange(size, align, aligned) != INVALID_INDEX;
   }
 
   bool subAllocate(uint32_t size, uint32_t align, uint32_t& outOffset, uint32_t& outAligned, uint32_t& outSize)
   {
-    uint32_t alignRest    = align - 1;
-    uint32_t sizeReserved = size;
-#if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
-    bool alignIsPOT = __popcnt(align) == 1;
-#else
-    bool alignIsPOT = __builtin_popcount(align) == 1;
-#endif
-
-    if(m_used >= m_size)
+    uint32_t index;
+    if(m_used >= m_size || (index = findRange(size, align, outAligned)) == INVALID_INDEX)
     {
       outSize    = 0;
       outOffset  = 0;
@@ -142,66 +168,60 @@ public:
       return false;
     }
 
-    if(m_used != 0 && (alignIsPOT ? (align > GRANULARITY) : ((alignRest + size) > GRANULARITY)))
-    {
-      sizeReserved += alignRest;
-    }
-
-    uint32_t countReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
+    uint32_t rangeFirst = m_ranges[index].first;
+    uint32_t rangeEnd   = m_ranges[index].first + m_ranges[index].count;
 
-    uint32_t startID;
-    if(createRangeID(startID, countReserved))
-    {
-      outOffset  = startID * GRANULARITY;
-      outAligned = ((outOffset + alignRest) / align) * align;
+    // only the pages touched by [outAligned, outAligned + size) are used,
+    // what remains in front and behind stays free
+    //
+    // range:      [     |     |     |     ] (GRANULARITY spacing)
+    // used:                [      ]         (custom alignment/size)
+    // allocated:        [     |     ]       (GRANULARITY spacing)
 
-      // due to custom alignment, we may be able to give
-      // pages back that we over-allocated
-      //
-      // reserved:   [     |     |     |     ] (GRANULARITY spacing)
-      // used:                [      ]         (custom alignment/size)
-      // corrected:        [     |     ]       (GRANULARITY spacing)
+    uint32_t first = outAligned / GRANULARITY;
+    uint32_t end   = std::max(first + 1, uint32_t((uint64_t(outAligned) + size + GRANULARITY - 1) / GRANULARITY));
+    assert(rangeFirst <= first && end <= rangeEnd);
 
-      // correct start (warning could yield more fragmentation)
+    binRemove(index);
+    if(end < rangeEnd)
+    {
+      // the range keeps its end and with that its entry in m_rangesByEnd
+      m_ranges[index].first = end;
+      m_ranges[index].count = rangeEnd - end;
+      binInsert(index);
 
-      uint32_t skipFront = (outAligned - outOffset) / GRANULARITY;
-      if(skipFront)
+      if(rangeFirst < first)
       {
-        destroyRangeID(startID, skipFront);
-        outOffset += skipFront * GRANULARITY;
-        startID += skipFront;
-        countReserved -= skipFront;
+        uint32_t front = rangeCreate(rangeFirst, first - rangeFirst);
+        m_rangesByEnd.emplace(first, front);
+        binInsert(front);
       }
+    }
+    else if(rangeFirst < first)
+    {
+      auto node  = m_rangesByEnd.extract(rangeEnd);
+      node.key() = first;
+      m_rangesByEnd.insert(std::move(node));
 
-      assert(outOffset <= outAligned);
-
-      // correct end
-      uint32_t outLast = alignedSize(outAligned + size);
-      outSize          = outLast - outOffset;
-
-      uint32_t usedCount = outSize / GRANULARITY;
-      assert(usedCount <= countReserved);
+      m_ranges[index].count = first - rangeFirst;
+      binInsert(index);
+    }
+    else
+    {
+      m_rangesByEnd.erase(rangeEnd);
+      rangeDestroy(index);
+    }
 
-      if(usedCount < countReserved)
-      {
-        destroyRangeID(startID + usedCount, countReserved - usedCount);
-      }
+    outOffset = first * GRANULARITY;
+    outSize   = (end - first) * GRANULARITY;
 
-      assert((outAligned + size) <= (outOffset + outSize));
+    assert((outAligned + size) <= (outOffset + outSize));
 
-      m_used += outSize;
+    m_used += outSize;
 
-      //checkRanges();
+    //checkRanges();
 
-      return true;
-    }
-    else
-    {
-      outSize    = 0;
-      outOffset  = 0;
-      outAligned = 0;
-      return false;
-    }
+    return true;
   }
 
   void subFree(uint32_t offset, uint32_t size)
@@ -210,332 +230,391 @@ public:
     assert(size % GRANULARITY == 0);
 
     m_used -= size;
-    destroyRangeID(offset / GRANULARITY, size / GRANULARITY);
 
-    //checkRanges();
-  }
+    uint32_t first = offset / GRANULARITY;
+    uint32_t end   = first + size / GRANULARITY;
 
-  TRangeAllocator& operator=(const TRangeAllocator& other)
-  {
-    m_size = other.m_size;
-    m_used = other.m_used;
+    // merge with the neighbors, the free range in front ends at first,
+    // the one behind is the next by end
+    auto next = m_rangesByEnd.lower_bound(first);
+    auto prev = m_rangesByEnd.end();
+    if(next != m_rangesByEnd.end() && next->first == first)
+    {
+      prev = next++;
+    }
+    assert(next == m_rangesByEnd.end() || end <= m_ranges[next->second].first);
 
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+    bool mergePrev = prev != m_rangesByEnd.end();
+    bool mergeNext = next != m_rangesByEnd.end() && m_ranges[next->second].first == end;
 
-    if(m_Ranges)
+    if(mergePrev && mergeNext)
+    {
+      uint32_t prevIndex = prev->second;
+      uint32_t nextIndex = next->second;
+      binRemove(prevIndex);
+      binRemove(nextIndex);
+      m_ranges[nextIndex].count += m_ranges[nextIndex].first - m_ranges[prevIndex].first;
+      m_ranges[nextIndex].first = m_ranges[prevIndex].first;
+      binInsert(nextIndex);
+
+      m_rangesByEnd.erase(prev);
+      rangeDestroy(prevIndex);
+    }
+    else if(mergePrev)
+    {
+      uint32_t prevIndex = prev->second;
+      binRemove(prevIndex);
+      m_ranges[prevIndex].count += end - first;
+      binInsert(prevIndex);
+
+      // the new end stays in front of next, so the hint is exact
+      auto node  = m_rangesByEnd.extract(prev);
+      node.key() = end;
+      m_rangesByEnd.insert(next, std::move(node));
+    }
+    else if(mergeNext)
     {
-      m_Ranges = static_cast<Range*>(::malloc(m_Capacity * sizeof(Range)));
-      memcpy(m_Ranges, other.m_Ranges, m_Capacity * sizeof(Range));
+      uint32_t nextIndex = next->second;
+      binRemove(nextIndex);
+      m_ranges[nextIndex].count += end - first;
+      m_ranges[nextIndex].first = first;
+      binInsert(nextIndex);
+    }
+    else
+    {
+      uint32_t index = rangeCreate(first, end - first);
+      m_rangesByEnd.emplace_hint(next, end, index);
+      binInsert(index);
     }
 
-    return *this;
+    //checkRanges();
   }
 
-  TRangeAllocator(const TRangeAllocator& other)
+  void printRanges() const
   {
-    m_size = other.m_size;
-    m_used = other.m_used;
-
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
-
-    if(m_Ranges)
+    const char* separator = "";
+    for(const auto& it : m_rangesByEnd)
     {
-      m_Ranges = static_cast<Range*>(::malloc(m_Capacity * sizeof(Range)));
-      memcpy(m_Ranges, other.m_Ranges, m_Capacity * sizeof(Range));
+      const Range& range = m_ranges[it.second];
+      if(range.count > 1)
+        printf("%s%u-%u", separator, range.first, it.first - 1);
+      else
+        printf("%s%u", separator, range.first);
+      separator = ", ";
     }
+    printf("\n");
   }
 
-  TRangeAllocator& operator=(TRangeAllocator&& other)
+  void checkRanges() const
   {
-    m_size = other.m_size;
-    m_used = other.m_used;
-
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+    uint32_t freePages = 0;
+    uint32_t lastEnd   = 0;
+    uint32_t largest   = 0;
+    for(const auto& it : m_rangesByEnd)
+    {
+      const Range& range = m_ranges[it.second];
+      assert(range.count > 0 && range.first + range.count == it.first);
+      // neighbors are always merged
+      assert(freePages == 0 || range.first > lastEnd);
+
+      uint32_t fl;
+      uint32_t sl;
+      binMapping(range.count, fl, sl);
+      bool binned = false;
+      for(uint32_t i = m_binHeads[fl][sl]; i != INVALID_INDEX; i = m_ranges[i].binNext)
+      {
+        binned = binned || i == it.second;
+      }
+      assert(binned);
 
-    other.m_Ranges = nullptr;
+      lastEnd = it.first;
+      freePages += range.count;
+      largest = std::max(largest, range.count);
+    }
+    assert(lastEnd <= m_size / GRANULARITY);
+    assert(freePages * GRANULARITY == m_size - m_used);
+    assert(!m_largestValid || m_largestCount == largest);
 
-    return *this;
+    uint32_t binnedCount = 0;
+    for(uint32_t fl = 0; fl < BIN_FL_COUNT; fl++)
+    {
+      assert(bool(m_flBitmap & (1u << fl)) == bool(m_slBitmaps[fl]));
+      for(uint32_t sl = 0; sl < BIN_SL_COUNT; sl++)
+      {
+        assert(bool(m_slBitmaps[fl] & (1u << sl)) == (m_binHeads[fl][sl] != INVALID_INDEX));
+        for(uint32_t i = m_binHeads[fl][sl]; i != INVALID_INDEX; i = m_ranges[i].binNext)
+        {
+          binnedCount++;
+        }
+      }
+    }
+    assert(binnedCount == m_rangesByEnd.size());
+    (void)freePages;
+    (void)lastEnd;
+    (void)largest;
+    (void)binnedCount;
   }
 
-  TRangeAllocator(TRangeAllocator&& other)
+private:
+  // Free ranges are binned by their page count, two-level segregated
+  // like STRATEGY_TLSF of nvvk::DeviceMemoryAllocator, so finding a range
+  // that fits is constant time. For merging on free they are also
+  // ordered by their end page, which does not change when allocating from
+  // the front of a range.
+
+  static const uint32_t BIN_FL_COUNT  = 32;
+  static const uint32_t BIN_SL_BITS   = 3;
+  static const uint32_t BIN_SL_COUNT  = 1 << BIN_SL_BITS;
+  static const uint32_t INVALID_INDEX = ~0u;
+
+  struct Range
   {
-    m_size = other.m_size;
-    m_used = other.m_used;
+    uint32_t first;
+    uint32_t count;
+    uint32_t binPrev;
+    uint32_t binNext;  // also links the unused entries
+  };
 
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+  typedef std::map<uint32_t, uint32_t> RangeEndMap;  // end page -> index into m_ranges
 
-    other.m_Ranges = nullptr;
-  }
+  std::vector<Range> m_ranges;
+  uint32_t           m_rangeFreeIndex = INVALID_INDEX;
+  RangeEndMap        m_rangesByEnd;
 
-private:
-  //////////////////////////////////////////////////////////////////////////
-  // most of the following code is taken from Emil Persson's MakeID
-  // http://www.humus.name/3D/MakeID.h (v1.02)
+  uint32_t m_flBitmap;
+  uint8_t  m_slBitmaps[BIN_FL_COUNT];
+  uint32_t m_binHeads[BIN_FL_COUNT][BIN_SL_COUNT];
 
-  struct Range
+  // page count of the largest range, recomputed lazily when that range shrinks
+  mutable uint32_t m_largestCount;
+  mutable bool     m_largestValid;
+
+  static uint32_t bitScanForward(uint32_t bits)
   {
-    uint32_t m_First;
-    uint32_t m_Last;
-  };
+#if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctz(bits));
+#endif
+  }
 
-  Range*   m_Ranges   = nullptr;  // Sorted array of ranges of free IDs
-  uint32_t m_Count    = 0;        // Number of ranges in list
-  uint32_t m_Capacity = 0;        // Total capacity of range list
-  uint32_t m_MaxID    = 0;
+  static uint32_t bitScanReverse(uint32_t bits)
+  {
+#if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, bits);
+    return uint32_t(index);
+#else
+    return uint32_t(31 - __builtin_clz(bits));
+#endif
+  }
 
-public:
-  void rangeInit(const uint32_t max_id)
+  // counts below 2^BIN_SL_BITS get a bin each
+  static void binMapping(uint32_t count, uint32_t& fl, uint32_t& sl)
   {
-    // Start with a single range, from 0 to max allowed ID (specified)
-    m_Ranges            = static_cast<Range*>(::malloc(sizeof(Range)));
-    m_Ranges[0].m_First = 0;
-    m_Ranges[0].m_Last  = max_id;
-    m_Count             = 1;
-    m_Capacity          = 1;
-    m_MaxID             = max_id;
+    fl = bitScanReverse(count);
+    sl = (fl < BIN_SL_BITS ? count << (BIN_SL_BITS - fl) : count >> (fl - BIN_SL_BITS)) & (BIN_SL_COUNT - 1);
   }
 
-  void rangeDeinit()
+  // next non-empty bin at or above fl/sl
+  bool binSearch(uint32_t& fl, uint32_t& sl) const
   {
-    if(m_Ranges)
+    uint32_t slBits = m_slBitmaps[fl] & (~0u << sl);
+    if(!slBits)
     {
-      ::free(m_Ranges);
-      m_Ranges = nullptr;
+      uint32_t flBits = fl + 1 < BIN_FL_COUNT ? m_flBitmap & (~0u << (fl + 1)) : 0;
+      if(!flBits)
+      {
+        return false;
+      }
+      fl     = bitScanForward(flBits);
+      slBits = m_slBitmaps[fl];
     }
+    sl = bitScanForward(slBits);
+    return true;
   }
 
-  bool createID(uint32_t& id)
+  void binInsert(uint32_t index)
   {
-    if(m_Ranges[0].m_First <= m_Ranges[0].m_Last)
+    Range&   range = m_ranges[index];
+    uint32_t fl;
+    uint32_t sl;
+    binMapping(range.count, fl, sl);
+
+    range.binPrev = INVALID_INDEX;
+    range.binNext = m_binHeads[fl][sl];
+    if(range.binNext != INVALID_INDEX)
     {
-      id = m_Ranges[0].m_First;
-
-      // If current range is full and there is another one, that will become the new current range
-      if(m_Ranges[0].m_First == m_Ranges[0].m_Last && m_Count > 1)
-      {
-        destroyRange(0);
-      }
-      else
-      {
-        ++m_Ranges[0].m_First;
-      }
-      return true;
+      m_ranges[range.binNext].binPrev = index;
     }
+    m_binHeads[fl][sl] = index;
+    m_slBitmaps[fl] |= uint8_t(1 << sl);
+    m_flBitmap |= 1u << fl;
 
-    // No availble ID left
-    return false;
+    if(m_largestValid)
+    {
+      m_largestCount = std::max(m_largestCount, range.count);
+    }
   }
 
-  bool createRangeID(uint32_t& id, const uint32_t count)
+  void binRemove(uint32_t index)
   {
-    uint32_t i = 0;
-    do
+    const Range& range = m_ranges[index];
+    uint32_t     fl;
+    uint32_t     sl;
+    binMapping(range.count, fl, sl);
+
+    if(range.binPrev != INVALID_INDEX)
     {
-      const uint32_t range_count = 1 + m_Ranges[i].m_Last - m_Ranges[i].m_First;
-      if(count <= range_count)
+      m_ranges[range.binPrev].binNext = range.binNext;
+    }
+    else
+    {
+      m_binHeads[fl][sl] = range.binNext;
+      if(range.binNext == INVALID_INDEX)
       {
-        id = m_Ranges[i].m_First;
-
-        // If current range is full and there is another one, that will become the new current range
-        if(count == range_count && i + 1 < m_Count)
-        {
-          destroyRange(i);
-        }
-        else
+        m_slBitmaps[fl] &= uint8_t(~(1 << sl));
+        if(!m_slBitmaps[fl])
         {
-          m_Ranges[i].m_First += count;
+          m_flBitmap &= ~(1u << fl);
         }
-        return true;
       }
-      ++i;
-    } while(i < m_Count);
+    }
+    if(range.binNext != INVALID_INDEX)
+    {
+      m_ranges[range.binNext].binPrev = range.binPrev;
+    }
 
-    // No range of free IDs was large enough to create the requested continuous ID sequence
-    return false;
+    if(range.count == m_largestCount)
+    {
+      m_largestValid = false;
+    }
   }
 
-  bool destroyID(const uint32_t id) { return destroyRangeID(id, 1); }
-
-  bool destroyRangeID(const uint32_t id, const uint32_t count)
+  uint32_t rangeCreate(uint32_t first, uint32_t count)
   {
-    const uint32_t end_id = id + count;
+    uint32_t index = m_rangeFreeIndex;
+    if(index != INVALID_INDEX)
+    {
+      m_rangeFreeIndex = m_ranges[index].binNext;
+    }
+    else
+    {
+      index = uint32_t(m_ranges.size());
+      m_ranges.push_back(Range());
+    }
+    m_ranges[index].first = first;
+    m_ranges[index].count = count;
+    return index;
+  }
 
-    assert(end_id <= m_MaxID + 1);
+  void rangeDestroy(uint32_t index)
+  {
+    m_ranges[index].binNext = m_rangeFreeIndex;
+    m_rangeFreeIndex        = index;
+  }
 
-    // Binary search of the range list
-    uint32_t i0 = 0;
-    uint32_t i1 = m_Count - 1;
+  void rangeDeinit()
+  {
+    m_ranges.clear();
+    m_rangeFreeIndex = INVALID_INDEX;
+    m_rangesByEnd.clear();
 
-    for(;;)
+    m_flBitmap = 0;
+    for(uint32_t fl = 0; fl < BIN_FL_COUNT; fl++)
     {
-      const uint32_t i = (i0 + i1) / 2;
-
-      if(id < m_Ranges[i].m_First)
-      {
-        // Before current range, check if neighboring
-        if(end_id >= m_Ranges[i].m_First)
-        {
-          if(end_id != m_Ranges[i].m_First)
-            return false;  // Overlaps a range of free IDs, thus (at least partially) invalid IDs
-
-          // Neighbor id, check if neighboring previous range too
-          if(i > i0 && id - 1 == m_Ranges[i - 1].m_Last)
-          {
-            // Merge with previous range
-            m_Ranges[i - 1].m_Last = m_Ranges[i].m_Last;
-            destroyRange(i);
-          }
-          else
-          {
-            // Just grow range
-            m_Ranges[i].m_First = id;
-          }
-          return true;
-        }
-        else
-        {
-          // Non-neighbor id
-          if(i != i0)
-          {
-            // Cull upper half of list
-            i1 = i - 1;
-          }
-          else
-          {
-            // Found our position in the list, insert the deleted range here
-            insertRange(i);
-            m_Ranges[i].m_First = id;
-            m_Ranges[i].m_Last  = end_id - 1;
-            return true;
-          }
-        }
-      }
-      else if(id > m_Ranges[i].m_Last)
-      {
-        // After current range, check if neighboring
-        if(id - 1 == m_Ranges[i].m_Last)
-        {
-          // Neighbor id, check if neighboring next range too
-          if(i < i1 && end_id == m_Ranges[i + 1].m_First)
-          {
-            // Merge with next range
-            m_Ranges[i].m_Last = m_Ranges[i + 1].m_Last;
-            destroyRange(i + 1);
-          }
-          else
-          {
-            // Just grow range
-            m_Ranges[i].m_Last += count;
-          }
-          return true;
-        }
-        else
-        {
-          // Non-neighbor id
-          if(i != i1)
-          {
-            // Cull bottom half of list
-            i0 = i + 1;
-          }
-          else
-          {
-            // Found our position in the list, insert the deleted range here
-            insertRange(i + 1);
-            m_Ranges[i + 1].m_First = id;
-            m_Ranges[i + 1].m_Last  = end_id - 1;
-            return true;
-          }
-        }
-      }
-      else
+      m_slBitmaps[fl] = 0;
+      for(uint32_t sl = 0; sl < BIN_SL_COUNT; sl++)
       {
-        // Inside a free block, not a valid ID
-        return false;
+        m_binHeads[fl][sl] = INVALID_INDEX;
       }
     }
+    m_largestCount = 0;
+    m_largestValid = true;
   }
 
-  bool isRangeAvailable(uint32_t searchCount) const
+  static uint64_t alignOffset(uint64_t offset, uint32_t align) { return ((offset + align - 1) / align) * align; }
+
+  bool rangeFits(const Range& range, uint32_t size, uint32_t align, uint32_t& outAligned) const
   {
-    uint32_t i = 0;
-    do
+    uint64_t aligned = alignOffset(uint64_t(range.first) * GRANULARITY, align);
+    if(aligned + size <= uint64_t(range.first + range.count) * GRANULARITY)
     {
-      uint32_t count = m_Ranges[i].m_Last - m_Ranges[i].m_First + 1;
-      if(count >= searchCount)
-        return true;
-
-      ++i;
-    } while(i < m_Count);
-
+      outAligned = uint32_t(aligned);
+      return true;
+    }
     return false;
   }
 
-  void printRanges() const
+  // good-fit: returns a fitting range whenever one exists
+  uint32_t findRange(uint32_t size, uint32_t align, uint32_t& outAligned) const
   {
-    uint32_t i = 0;
-    for(;;)
+    // pages needed if the start of a range happens to be aligned, and
+    // regardless of its start
+    uint64_t countMin      = std::max(uint64_t(1), (uint64_t(size) + GRANULARITY - 1) / GRANULARITY);
+    uint64_t countReserved = GRANULARITY % align ? (uint64_t(size) + align - 1 + GRANULARITY - 1) / GRANULARITY : countMin;
+    if(countMin > ~0u)
     {
-      if(m_Ranges[i].m_First < m_Ranges[i].m_Last)
-        printf("%u-%u", m_Ranges[i].m_First, m_Ranges[i].m_Last);
-      else if(m_Ranges[i].m_First == m_Ranges[i].m_Last)
-        printf("%u", m_Ranges[i].m_First);
-      else
-        printf("-");
+      return INVALID_INDEX;
+    }
 
-      ++i;
-      if(i >= m_Count)
-      {
-        printf("\n");
-        return;
-      }
+    uint32_t minFL;
+    uint32_t minSL;
+    binMapping(uint32_t(countMin), minFL, minSL);
 
-      printf(", ");
+    // exact bin first, its head is likely to fit as well
+    uint32_t index = m_binHeads[minFL][minSL];
+    if(index != INVALID_INDEX && rangeFits(m_ranges[index], size, align, outAligned))
+    {
+      return index;
     }
-  }
 
-  void checkRanges() const
-  {
-    for(uint32_t i = 0; i < m_Count; i++)
+    // rounded up to the next bin, every range within that bin or above fits
+    uint32_t fitFL;
+    uint32_t fitSL;
+    binMapping(uint32_t(std::min(countReserved, uint64_t(~0u))), fitFL, fitSL);
+    uint64_t search = countReserved + (fitFL < BIN_SL_BITS ? 0 : (uint64_t(1) << (fitFL - BIN_SL_BITS)) - 1);
+    if(search <= uint64_t(~0u))
     {
-      assert(m_Ranges[i].m_Last <= m_MaxID);
-
-      if(m_Ranges[i].m_First == m_Ranges[i].m_Last + 1)
+      uint32_t fl;
+      uint32_t sl;
+      binMapping(uint32_t(search), fl, sl);
+      if(binSearch(fl, sl))
       {
-        continue;
+        index = m_binHeads[fl][sl];
+        bool fits = rangeFits(m_ranges[index], size, align, outAligned);
+        assert(fits);
+        (void)fits;
+        return index;
       }
-      assert(m_Ranges[i].m_First <= m_Ranges[i].m_Last);
-      assert(m_Ranges[i].m_First <= m_MaxID);
     }
-  }
 
-  void insertRange(const uint32_t index)
-  {
-    if(m_Count >= m_Capacity)
+    // ranges between the minimum and the reservation may fit depending on
+    // their start, this is linear in the number of ranges within those bins
+    uint32_t fl = minFL;
+    uint32_t sl = minSL;
+    while(binSearch(fl, sl) && (fl < fitFL || (fl == fitFL && sl <= fitSL)))
     {
-      m_Capacity += m_Capacity;
-      m_Ranges = (Range*)realloc(m_Ranges, m_Capacity * sizeof(Range));
+      for(index = m_binHeads[fl][sl]; index != INVALID_INDEX; index = m_ranges[index].binNext)
+      {
+        if(rangeFits(m_ranges[index], size, align, outAligned))
+        {
+          return index;
+        }
+      }
+      if(++sl == BIN_SL_COUNT)
+      {
+        sl = 0;
+        if(++fl == BIN_FL_COUNT)
+        {
+          break;
+        }
+      }
     }
 
-    ::memmove(m_Ranges + index + 1, m_Ranges + index, (m_Count - index) * sizeof(Range));
-    ++m_Count;
-  }
-
-  void destroyRange(const uint32_t index)
-  {
-    --m_Count;
-    ::memmove(m_Ranges + index, m_Ranges + index + 1, (m_Count - index) * sizeof(Range));
+    return INVALID_INDEX;
   }
 };
 
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "dynamictlasKHR_vk.hpp"
+
+#include <algorithm>
+
+#include "nvh/alignment.hpp"
+#include "nvvk/debug_util_vk.hpp"
+#include "nvvk/stagingmemorymanager_vk.hpp"
+
+//--------------------------------------------------------------------------------------------------
+// Creating all resources for the maximum number of instances, so they never
+// have to be replaced while the acceleration structure may be in use.
+//
+void nvvk::DynamicTlasKHR::init(VkDevice                             device,
+                                nvvk::ResourceAllocator*             allocator,
+                                uint32_t                             capacity,
+                                VkBuildAccelerationStructureFlagsKHR flags)
+{
+  assert(!m_device && capacity);
+  m_device   = device;
+  m_alloc    = allocator;
+  m_capacity = capacity;
+  m_flags    = flags;
+
+  nvvk::DebugUtil debug(device);
+
+  m_instanceBuffer = m_alloc->createBuffer(VkDeviceSize(capacity) * sizeof(VkAccelerationStructureInstanceKHR),
+                                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                               | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+  VkBufferDeviceAddressInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, m_instanceBuffer.buffer};
+  m_instanceAddress = vkGetBufferDeviceAddress(m_device, &bufferInfo);
+  debug.setObjectName(m_instanceBuffer.buffer, "DynamicTlasKHR::instances");
+
+  // Sizes for the maximum instance count are sufficient for any smaller count
+  VkAccelerationStructureGeometryInstancesDataKHR instancesVk{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
+  VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geometry.geometryType       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances = instancesVk;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags         = m_flags;
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries   = &geometry;
+
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
+                                          &capacity, &sizeInfo);
+
+  VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+  createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  createInfo.size = sizeInfo.accelerationStructureSize;
+  m_tlas          = m_alloc->createAcceleration(createInfo);
+  debug.setObjectName(m_tlas.accel, "DynamicTlasKHR");
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &asProperties;
+  vkGetPhysicalDeviceProperties2(m_alloc->getPhysicalDevice(), &properties);
+  VkDeviceSize scratchAlignment = std::max(VkDeviceSize(asProperties.minAccelerationStructureScratchOffsetAlignment), VkDeviceSize(1));
+
+  // One scratch buffer for builds and refits
+  VkDeviceSize scratchSize = std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize);
+  m_scratchBuffer = m_alloc->createBuffer(scratchSize + scratchAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  bufferInfo.buffer = m_scratchBuffer.buffer;
+  m_scratchAddress  = nvh::align_up(vkGetBufferDeviceAddress(m_device, &bufferInfo), scratchAlignment);
+  debug.setObjectName(m_scratchBuffer.buffer, "DynamicTlasKHR::scratch");
+
+  m_instances.reserve(capacity);
+  m_isDirty.reserve(capacity);
+  m_isActive.reserve(capacity);
+
+  m_activeCount = 0;
+  m_builtCount  = 0;
+  m_refitCount  = 0;
+  m_rebuild     = true;
+}
+
+void nvvk::DynamicTlasKHR::deinit()
+{
+  if(!m_device)
+    return;
+
+  m_alloc->destroy(m_tlas);
+  m_alloc->destroy(m_instanceBuffer);
+  m_alloc->destroy(m_scratchBuffer);
+
+  m_instances.clear();
+  m_freeSlots.clear();
+  m_dirty.clear();
+  m_isDirty.clear();
+  m_isActive.clear();
+
+  m_device = VK_NULL_HANDLE;
+  m_alloc  = nullptr;
+}
+
+VkDeviceAddress nvvk::DynamicTlasKHR::getDeviceAddress() const
+{
+  VkAccelerationStructureDeviceAddressInfoKHR addressInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
+  addressInfo.accelerationStructure = m_tlas.accel;
+  return vkGetAccelerationStructureDeviceAddressKHR(m_device, &addressInfo);
+}
+
+void nvvk::DynamicTlasKHR::markDirty(uint32_t index)
+{
+  if(!m_isDirty[index])
+  {
+    m_isDirty[index] = true;
+    m_dirty.push_back(index);
+  }
+}
+
+uint32_t nvvk::DynamicTlasKHR::insertInstance(const VkAccelerationStructureInstanceKHR& instance)
+{
+  uint32_t index;
+  if(!m_freeSlots.empty())
+  {
+    index = m_freeSlots.back();
+    m_freeSlots.pop_back();
+  }
+  else if(m_instances.size() < m_capacity)
+  {
+    index = uint32_t(m_instances.size());
+    m_instances.push_back(instance);
+    m_isDirty.push_back(false);
+    m_isActive.push_back(false);
+  }
+  else
+  {
+    return INVALID_INDEX;
+  }
+
+  m_instances[index] = instance;
+  m_isActive[index]  = true;
+  m_activeCount++;
+  markDirty(index);
+
+  return index;
+}
+
+void nvvk::DynamicTlasKHR::removeInstance(uint32_t index)
+{
+  assert(index < m_instances.size() && m_isActive[index]);
+
+  // keeps the slot alive for the refit, but no ray will ever hit it
+  m_instances[index].mask = 0;
+  m_isActive[index]       = false;
+  m_activeCount--;
+  m_freeSlots.push_back(index);
+  markDirty(index);
+}
+
+void nvvk::DynamicTlasKHR::setInstance(uint32_t index, const VkAccelerationStructureInstanceKHR& instance)
+{
+  assert(index < m_instances.size() && m_isActive[index]);
+  m_instances[index] = instance;
+  markDirty(index);
+}
+
+void nvvk::DynamicTlasKHR::setTransform(uint32_t index, const VkTransformMatrixKHR& transform)
+{
+  assert(index < m_instances.size() && m_isActive[index]);
+  m_instances[index].transform = transform;
+  markDirty(index);
+}
+
+void nvvk::DynamicTlasKHR::setMask(uint32_t index, uint32_t mask)
+{
+  assert(index < m_instances.size() && m_isActive[index]);
+  m_instances[index].mask = mask;
+  markDirty(index);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Uploading the dirty instances as contiguous ranges and updating the acceleration structure
+//
+bool nvvk::DynamicTlasKHR::cmdUpdate(VkCommandBuffer cmd)
+{
+  uint32_t usedCount = uint32_t(m_instances.size());
+  bool     build     = m_rebuild || usedCount != m_builtCount
+                   || !(m_flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR);
+
+  if(m_dirty.empty() && !build)
+    return false;
+
+  if(!m_dirty.empty())
+  {
+    // The previous build or refit may still read the instances
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    nvvk::StagingMemoryManager* staging = m_alloc->getStaging();
+
+    std::sort(m_dirty.begin(), m_dirty.end());
+    for(size_t i = 0; i < m_dirty.size();)
+    {
+      uint32_t first = m_dirty[i];
+      uint32_t count = 1;
+      while(i + count < m_dirty.size() && m_dirty[i + count] == first + count)
+      {
+        count++;
+      }
+      for(uint32_t n = 0; n < count; n++)
+      {
+        m_isDirty[first + n] = false;
+      }
+
+      staging->cmdToBuffer(cmd, m_instanceBuffer.buffer, VkDeviceSize(first) * sizeof(VkAccelerationStructureInstanceKHR),
+                           VkDeviceSize(count) * sizeof(VkAccelerationStructureInstanceKHR), &m_instances[first]);
+      i += count;
+    }
+    m_dirty.clear();
+    if(staging->isRingMode())
+    {
+      staging->cmdFlush(cmd);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  VkAccelerationStructureGeometryInstancesDataKHR instancesVk{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
+  instancesVk.data.deviceAddress = m_instanceAddress;
+
+  VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geometry.geometryType       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances = instancesVk;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags         = m_flags;
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries   = &geometry;
+  buildInfo.mode = build ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+  buildInfo.srcAccelerationStructure  = build ? VK_NULL_HANDLE : m_tlas.accel;
+  buildInfo.dstAccelerationStructure  = m_tlas.accel;
+  buildInfo.scratchData.deviceAddress = m_scratchAddress;
+
+  VkAccelerationStructureBuildRangeInfoKHR        rangeInfo{usedCount, 0, 0, 0};
+  const VkAccelerationStructureBuildRangeInfoKHR* pRangeInfo = &rangeInfo;
+
+  // The scratch buffer may still be used by the previous build or refit
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &buildInfo, &pRangeInfo);
+
+  if(build)
+  {
+    m_builtCount = usedCount;
+    m_refitCount = 0;
+    m_rebuild    = false;
+  }
+  else
+  {
+    m_refitCount++;
+  }
+
+  return true;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/**
+
+\class nvvk::DynamicTlasKHR
+
+nvvk::DynamicTlasKHR is a persistent top-level acceleration structure for
+scenes where only a few instances change per frame.
+
+Unlike RaytracingBuilderKHR::buildTlas, which uploads all instances and
+waits for the queue on every call, it keeps the instance buffer, the
+scratch buffer and the acceleration structure alive for its whole lifetime.
+Instances are modified on the host and tracked as dirty, cmdUpdate only
+uploads the dirty instances and records a refit into the command buffer
+provided by the caller.
+
+- The capacity is fixed at init, slots of removed instances are recycled
+  through a free-list.
+- Removed instances are kept in the acceleration structure with a mask of
+  0, so the active state of an instance never changes between refits.
+- A full build is recorded instead of a refit when the number of used slots
+  changed, the flags lack ALLOW_UPDATE, or a rebuild was requested.
+- Uploads go through the StagingMemoryManager of the ResourceAllocator,
+  the staging resources must be finalized and released as usual.
+- The caller is responsible for the barrier between cmdUpdate and the
+  commands using the acceleration structure, as well as the ordering
+  against earlier commands still using it.
+
+\code{.cpp}
+m_tlas.init(device, &m_alloc, 1024);
+
+uint32_t id = m_tlas.insertInstance(rayInst);
+...
+
+// per frame
+m_tlas.setTransform(id, nvvk::toTransformMatrixKHR(matrix));
+m_tlas.cmdUpdate(cmdBuf);
+... barrier VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR to the ray tracing stage
+vkCmdTraceRaysKHR(...);
+...
+m_alloc.finalizeStaging(frameFence);
+\endcode
+*/
+
+#include <vulkan/vulkan_core.h>
+
+#if VK_KHR_acceleration_structure
+
+#include <vector>
+
+#include "nvvk/resourceallocator_vk.hpp"
+
+namespace nvvk {
+
+class DynamicTlasKHR
+{
+public:
+  static const uint32_t INVALID_INDEX = ~0u;
+
+  void init(VkDevice                             device,
+            nvvk::ResourceAllocator*             allocator,
+            uint32_t                             capacity,
+            VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                                                         | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR);
+  void deinit();
+
+  // returns INVALID_INDEX if the capacity is exhausted
+  uint32_t insertInstance(const VkAccelerationStructureInstanceKHR& instance);
+  void     removeInstance(uint32_t index);
+
+  void setInstance(uint32_t index, const VkAccelerationStructureInstanceKHR& instance);
+  void setTransform(uint32_t index, const VkTransformMatrixKHR& transform);
+  void setMask(uint32_t index, uint32_t mask);
+
+  const VkAccelerationStructureInstanceKHR& getInstance(uint32_t index) const { return m_instances[index]; }
+
+  // the next cmdUpdate will do a full build, e.g. after many refits degraded the quality
+  void requestRebuild() { m_rebuild = true; }
+
+  // uploads the dirty instances and records the refit or build,
+  // returns false if nothing was recorded
+  bool cmdUpdate(VkCommandBuffer cmd);
+
+  VkAccelerationStructureKHR getAccelerationStructure() const { return m_tlas.accel; }
+  VkDeviceAddress            getDeviceAddress() const;
+
+  uint32_t getCapacity() const { return m_capacity; }
+  uint32_t getActiveCount() const { return m_activeCount; }
+  uint32_t getDirtyCount() const { return uint32_t(m_dirty.size()); }
+  uint32_t getRefitCount() const { return m_refitCount; }
+
+protected:
+  void markDirty(uint32_t index);
+
+  VkDevice                             m_device{VK_NULL_HANDLE};
+  nvvk::ResourceAllocator*             m_alloc{nullptr};
+  VkBuildAccelerationStructureFlagsKHR m_flags{0};
+  uint32_t                             m_capacity{0};
+
+  nvvk::AccelKHR  m_tlas;
+  nvvk::Buffer    m_instanceBuffer;
+  VkDeviceAddress m_instanceAddress{0};
+  nvvk::Buffer    m_scratchBuffer;
+  VkDeviceAddress m_scratchAddress{0};
+
+  // host copy of all used slots, the device copy is updated from it
+  std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+  std::vector<uint32_t>                           m_freeSlots;
+  std::vector<uint32_t>                           m_dirty;
+  std::vector<bool>                               m_isDirty;
+  std::vector<bool>                               m_isActive;
+
+  uint32_t m_activeCount{0};
+  uint32_t m_builtCount{0};  // used slots at the last full build
+  uint32_t m_refitCount{0};  // refits since the last full build
+  bool     m_rebuild{true};
+};
+
+}  // namespace nvvk
+
+#else
+#error This include requires VK_KHR_acceleration_structure support in the Vulkan SDK.
+#endif
@@ -72,6 +72,28 @@ bool getMemoryInfo(const VkPhysicalDeviceMemoryProperties& memoryProperties,
   return false;
 }
 
+static inline uint32_t bitScanForward(uint32_t bits)
+{
+#if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, bits);
+  return uint32_t(index);
+#else
+  return uint32_t(__builtin_ctz(bits));
+#endif
+}
+
+static inline uint32_t bitScanReverse(uint32_t bits)
+{
+#if(defined(NV_X86) || defined(NV_X64)) && defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, bits);
+  return uint32_t(index);
+#else
+  return uint32_t(31 - __builtin_clz(bits));
+#endif
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 class DMAMemoryAllocator;
@@ -208,7 +230,7 @@ int DeviceMemoryAllocator::s_allocDebugBias = 0;
 
 //#define DEBUG_ALLOCID   8
 
-nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize)
+nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize, uint32_t alignment)
 {
   // find free slot
   if(m_freeAllocationIndex != INVALID_ID_INDEX)
@@ -220,6 +242,7 @@ nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, Block
     m_allocations[index].block       = block;
     m_allocations[index].blockOffset = blockOffset;
     m_allocations[index].blockSize   = blockSize;
+    m_allocations[index].alignment   = alignment;
 #if DEBUG_ALLOCID
     // debug some specific id, useful to track allocation leaks
     if(index == DEBUG_ALLOCID)
@@ -238,6 +261,7 @@ nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, Block
   info.block       = block;
   info.blockOffset = blockOffset;
   info.blockSize   = blockSize;
+  info.alignment   = alignment;
 
   m_allocations.push_back(info);
 
@@ -275,26 +299,43 @@ const float DeviceMemoryAllocator::DEFAULT_PRIORITY = 0.5f;
 
 void DeviceMemoryAllocator::init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize, VkDeviceSize maxSize)
 {
-  assert(!m_device);
-  m_device         = device;
-  m_physicalDevice = physicalDevice;
-  // always default to NVVK_DEFAULT_MEMORY_BLOCKSIZE
-  m_blockSize      = blockSize ? blockSize : NVVK_DEFAULT_MEMORY_BLOCKSIZE;
-
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 
   // Retrieving the max allocation size, can be lowered with maxSize
   VkPhysicalDeviceProperties2            prop2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
   VkPhysicalDeviceMaintenance3Properties vkProp{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES};
   prop2.pNext = &vkProp;
   vkGetPhysicalDeviceProperties2(physicalDevice, &prop2);
-  m_maxAllocationSize = maxSize > 0 ? std::min(maxSize, vkProp.maxMemoryAllocationSize) : vkProp.maxMemoryAllocationSize;
 
+  init(device, memoryProperties,
+       maxSize > 0 ? std::min(maxSize, vkProp.maxMemoryAllocationSize) : vkProp.maxMemoryAllocationSize, blockSize);
+  m_physicalDevice = physicalDevice;
+}
+
+void DeviceMemoryAllocator::init(VkDevice                                device,
+                                 const VkPhysicalDeviceMemoryProperties& memoryProperties,
+                                 VkDeviceSize                            maxAllocationSize,
+                                 VkDeviceSize                            blockSize)
+{
+  assert(!m_device);
+  m_device            = device;
+  m_memoryProperties  = memoryProperties;
+  m_maxAllocationSize = maxAllocationSize;
+  // always default to NVVK_DEFAULT_MEMORY_BLOCKSIZE
+  m_blockSize = blockSize ? blockSize : NVVK_DEFAULT_MEMORY_BLOCKSIZE;
 
   assert(m_blocks.empty());
   assert(m_allocations.empty());
 }
 
+void DeviceMemoryAllocator::setStrategy(Strategy strategy)
+{
+  m_strategy   = strategy;
+  m_binSubBits = strategy == STRATEGY_TLSF ? BIN_SL_BITS : 0;
+  rebuildBins();
+}
+
 void DeviceMemoryAllocator::freeAll()
 {
   for(const auto& it : m_blocks)
@@ -302,15 +343,21 @@ void DeviceMemoryAllocator::freeAll()
     if(!it.mem)
       continue;
 
+    if(it.defragBuffer)
+    {
+      destroyBlockBuffer(it.id, it.defragBuffer);
+    }
     if(it.mapped)
     {
       vkUnmapMemory(m_device, it.mem);
     }
-    vkFreeMemory(m_device, it.mem, nullptr);
+    freeBlockMemory(it.id, it.mem);
   }
 
   m_allocations.clear();
   m_blocks.clear();
+  m_blockPools.clear();
+  m_defragMoves.clear();
   resizeBlocks(0);
 
   m_freeBlockIndex      = INVALID_ID_INDEX;
@@ -332,11 +379,16 @@ void DeviceMemoryAllocator::deinit()
         vkUnmapMemory(m_device, it.mem);
       }
     }
+    if(it.defragBuffer)
+    {
+      assert(0 && "defragmentation not finished");
+      destroyBlockBuffer(it.id, it.defragBuffer);
+    }
     if(it.mem)
     {
       if(it.isFirst && m_keepFirst)
       {
-        vkFreeMemory(m_device, it.mem, nullptr);
+        freeBlockMemory(it.id, it.mem);
       }
       else
       {
@@ -357,6 +409,8 @@ void DeviceMemoryAllocator::deinit()
 
   m_allocations.clear();
   m_blocks.clear();
+  m_blockPools.clear();
+  m_defragMoves.clear();
   resizeBlocks(0);
 
   m_freeBlockIndex      = INVALID_ID_INDEX;
@@ -486,48 +540,27 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
     return AllocationID();
   }
 
-  float priority = m_supportsPriority ? state.priority : DEFAULT_PRIORITY;
-  bool  isFirst  = !dedicated;
+  float    priority  = m_supportsPriority ? state.priority : DEFAULT_PRIORITY;
+  uint32_t poolIndex = getPoolIndex(memInfo.memoryTypeIndex, isLinear, priority, state);
+  // if there is a compatible block, we are not "first" of a kind
+  bool isFirst = !dedicated && m_blockPools[poolIndex].blockCount == 0;
 
   if(!dedicated)
   {
     // First try to find an existing memory block that we can use
+    BlockID  blockID;
+    uint32_t blockSize;
+    uint32_t blockOffset;
+    uint32_t offset;
 
-    for(uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++)
+    if(subAllocate(poolIndex, (uint32_t)memReqs.size, (uint32_t)memReqs.alignment, blockID, blockOffset, offset, blockSize))
     {
-      Block& block = m_blocks[i];
-
-      // Ignore invalid or blocks with the wrong memory type
-      if(!block.mem || block.memoryTypeIndex != memInfo.memoryTypeIndex || isLinear != block.isLinear || block.priority != priority
-         || block.allocateFlags != state.allocateFlags || block.allocateDeviceMask != state.allocateDeviceMask)
-      {
-        continue;
-      }
-
-      // if there is a compatible block, we are not "first" of a kind
-      isFirst = false;
-
-      uint32_t blockSize;
-      uint32_t blockOffset;
-      uint32_t offset;
-
+      Allocation allocation;
+      allocation.mem    = getBlock(blockID).mem;
+      allocation.offset = offset;
+      allocation.size   = memReqs.size;
 
-      // Look for a block which has enough free space available
-
-      if(block.range.subAllocate((uint32_t)memReqs.size, (uint32_t)memReqs.alignment, blockOffset, offset, blockSize))
-      {
-        block.allocationCount++;
-        block.usedSize += blockSize;
-
-        Allocation allocation;
-        allocation.mem    = block.mem;
-        allocation.offset = offset;
-        allocation.size   = memReqs.size;
-
-        m_usedSize += blockSize;
-
-        return createID(allocation, block.id, blockOffset, blockSize);
-      }
+      return createID(allocation, blockID, blockOffset, blockSize, (uint32_t)memReqs.alignment);
     }
   }
 
@@ -584,6 +617,7 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
   }
 
   block.allocationSize  = block.range.alignedSize((uint32_t)block.allocationSize);
+  block.poolIndex       = poolIndex;
   block.priority        = priority;
   block.memoryTypeIndex = memInfo.memoryTypeIndex;
   block.range.init((uint32_t)block.allocationSize);
@@ -622,7 +656,13 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
 
     m_activeBlockCount++;
 
-    return createID(allocation, id, blockOffset, blockSize);
+    if(!block.isDedicated)
+    {
+      m_blockPools[poolIndex].blockCount++;
+      binInsert(block);
+    }
+
+    return createID(allocation, id, blockOffset, blockSize, (uint32_t)memReqs.alignment);
   }
   else
   {
@@ -651,24 +691,570 @@ void DeviceMemoryAllocator::free(AllocationID allocationID)
 
   destroyID(allocationID);
 
-  m_usedSize -= info.blockSize;
-  block.range.subFree(info.blockOffset, info.blockSize);
+  subFree(block, info.blockOffset, info.blockSize);
+}
+
+void DeviceMemoryAllocator::subFree(Block& block, uint32_t blockOffset, uint32_t blockSize)
+{
+  m_usedSize -= blockSize;
+  block.range.subFree(blockOffset, blockSize);
   block.allocationCount--;
-  block.usedSize -= info.blockSize;
+  block.usedSize -= blockSize;
+
+  // defragmentation sources are handled in defragFinish
+  if(block.allocationCount == 0 && !(block.isFirst && m_keepFirst) && !block.isDefragSource)
+  {
+    releaseBlock(block);
+  }
+  else
+  {
+    binUpdate(block);
+  }
+}
+
+void DeviceMemoryAllocator::releaseBlock(Block& block)
+{
+  assert(block.usedSize == 0);
+  assert(!block.mapped);
 
-  if(block.allocationCount == 0 && !(block.isFirst && m_keepFirst))
+  binRemove(block);
+  if(block.defragBuffer)
+  {
+    destroyBlockBuffer(block.id, block.defragBuffer);
+    block.defragBuffer = VK_NULL_HANDLE;
+  }
+  if(!block.isDedicated)
   {
-    assert(block.usedSize == 0);
-    assert(!block.mapped);
-    freeBlockMemory(info.block, block.mem);
-    block.mem     = VK_NULL_HANDLE;
-    block.isFirst = false;
+    m_blockPools[block.poolIndex].blockCount--;
+  }
 
-    m_allocatedSize -= block.allocationSize;
-    block.range.deinit();
+  freeBlockMemory(block.id, block.mem);
+  block.mem            = VK_NULL_HANDLE;
+  block.isFirst        = false;
+  block.isDefragSource = false;
 
-    m_freeBlockIndex = block.id.instantiate(m_freeBlockIndex);
-    m_activeBlockCount--;
+  m_allocatedSize -= block.allocationSize;
+  block.range.deinit();
+
+  m_freeBlockIndex = block.id.instantiate(m_freeBlockIndex);
+  m_activeBlockCount--;
+}
+
+uint32_t DeviceMemoryAllocator::getPoolIndex(uint32_t memoryTypeIndex, bool isLinear, float priority, const State& state)
+{
+  for(uint32_t i = 0; i < (uint32_t)m_blockPools.size(); i++)
+  {
+    const BlockPool& pool = m_blockPools[i];
+    if(pool.memoryTypeIndex == memoryTypeIndex && pool.isLinear == isLinear && pool.priority == priority
+       && pool.allocateFlags == state.allocateFlags && pool.allocateDeviceMask == state.allocateDeviceMask)
+    {
+      return i;
+    }
+  }
+
+  BlockPool pool;
+  pool.memoryTypeIndex    = memoryTypeIndex;
+  pool.isLinear           = isLinear;
+  pool.priority           = priority;
+  pool.allocateFlags      = state.allocateFlags;
+  pool.allocateDeviceMask = state.allocateDeviceMask;
+  pool.resetBins();
+
+  m_blockPools.push_back(pool);
+  return (uint32_t)m_blockPools.size() - 1;
+}
+
+bool DeviceMemoryAllocator::subAllocate(uint32_t  poolIndex,
+                                        uint32_t  size,
+                                        uint32_t  alignment,
+                                        BlockID&  outBlock,
+                                        uint32_t& outBlockOffset,
+                                        uint32_t& outOffset,
+                                        uint32_t& outBlockSize)
+{
+  uint32_t found = INVALID_ID_INDEX;
+
+  if(m_strategy == STRATEGY_FIRST_FIT)
+  {
+    for(uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++)
+    {
+      Block& block = m_blocks[i];
+
+      // Ignore invalid or incompatible blocks
+      if(!block.mem || block.poolIndex != poolIndex || block.isDedicated || block.isDefragSource)
+      {
+        continue;
+      }
+
+      // Look for a block which has enough free space available
+      if(block.range.subAllocate(size, alignment, outBlockOffset, outOffset, outBlockSize))
+      {
+        found = i;
+        break;
+      }
+    }
+  }
+  else
+  {
+    // worst-case reservation of TRangeAllocator::subAllocate
+    uint64_t reserved = (uint64_t(size) + (alignment > 256 ? alignment - 1 : 0) + 255) & ~uint64_t(255);
+    reserved          = std::max(reserved, uint64_t(256));
+    if(reserved > uint64_t(~0u))
+    {
+      return false;
+    }
+
+    // blocks in the bin of the reservation may or may not fit
+    uint32_t fitFL;
+    uint32_t fitSL;
+    binMapping(uint32_t(reserved), fitFL, fitSL);
+
+    // rounded up to the next bin, every block within that bin or above can provide it
+    uint64_t search = reserved + (uint64_t(1) << (fitFL - m_binSubBits)) - 1;
+    uint32_t fl     = BIN_FL_COUNT;
+    uint32_t sl     = 0;
+    if(search <= uint64_t(~0u))
+    {
+      binMapping(uint32_t(search), fl, sl);
+    }
+    bool fitSearched = fl == fitFL && sl == fitSL;
+
+    const BlockPool& pool = m_blockPools[poolIndex];
+    while(found == INVALID_ID_INDEX && fl < BIN_FL_COUNT)
+    {
+      // find the next non-empty bin
+      uint32_t slBits = pool.slBitmaps[fl] & (~0u << sl);
+      if(!slBits)
+      {
+        uint32_t flBits = fl + 1 < BIN_FL_COUNT ? pool.flBitmap & (~0u << (fl + 1)) : 0;
+        if(!flBits)
+        {
+          break;
+        }
+        fl     = bitScanForward(flBits);
+        slBits = pool.slBitmaps[fl];
+      }
+      sl = bitScanForward(slBits);
+
+      // the first block is expected to succeed, subsequent ones only matter for
+      // alignments that are not a power of two
+      for(uint32_t i = pool.binHeads[fl][sl]; i != INVALID_ID_INDEX; i = m_blocks[i].binNext)
+      {
+        if(m_blocks[i].range.subAllocate(size, alignment, outBlockOffset, outOffset, outBlockSize))
+        {
+          found = i;
+          break;
+        }
+      }
+
+      if(++sl == BIN_SL_MAX)
+      {
+        sl = 0;
+        fl++;
+      }
+    }
+
+    // before a new block gets allocated, look for a block that fits more closely
+    if(found == INVALID_ID_INDEX && !fitSearched)
+    {
+      for(uint32_t i = pool.binHeads[fitFL][fitSL]; i != INVALID_ID_INDEX; i = m_blocks[i].binNext)
+      {
+        if(m_blocks[i].range.subAllocate(size, alignment, outBlockOffset, outOffset, outBlockSize))
+        {
+          found = i;
+          break;
+        }
+      }
+    }
+  }
+
+  if(found == INVALID_ID_INDEX)
+  {
+    return false;
+  }
+
+  Block& block = m_blocks[found];
+  block.allocationCount++;
+  block.usedSize += outBlockSize;
+  m_usedSize += outBlockSize;
+
+  binUpdate(block);
+
+  outBlock = block.id;
+  return true;
+}
+
+void DeviceMemoryAllocator::binMapping(uint32_t size, uint32_t& fl, uint32_t& sl) const
+{
+  // sizes are at least 256, so there are always enough bits for the sub-level
+  fl = bitScanReverse(size);
+  sl = m_binSubBits ? (size >> (fl - m_binSubBits)) & ((1 << m_binSubBits) - 1) : 0;
+}
+
+void DeviceMemoryAllocator::binInsert(Block& block)
+{
+  assert(!block.isBinned);
+
+  if(m_strategy == STRATEGY_FIRST_FIT || !block.mem || block.isDedicated || block.isDefragSource)
+  {
+    return;
+  }
+
+  uint32_t largest = block.range.getLargestFree();
+  if(!largest)
+  {
+    return;
+  }
+
+  uint32_t fl;
+  uint32_t sl;
+  binMapping(largest, fl, sl);
+
+  BlockPool& pool  = m_blockPools[block.poolIndex];
+  uint32_t   index = block.id.index;
+
+  block.binFL    = uint8_t(fl);
+  block.binSL    = uint8_t(sl);
+  block.binPrev  = INVALID_ID_INDEX;
+  block.binNext  = pool.binHeads[fl][sl];
+  block.isBinned = true;
+  if(block.binNext != INVALID_ID_INDEX)
+  {
+    m_blocks[block.binNext].binPrev = index;
+  }
+
+  pool.binHeads[fl][sl] = index;
+  pool.slBitmaps[fl] |= 1 << sl;
+  pool.flBitmap |= 1 << fl;
+}
+
+void DeviceMemoryAllocator::binRemove(Block& block)
+{
+  if(!block.isBinned)
+  {
+    return;
+  }
+
+  BlockPool& pool = m_blockPools[block.poolIndex];
+  uint32_t   fl   = block.binFL;
+  uint32_t   sl   = block.binSL;
+
+  if(block.binPrev != INVALID_ID_INDEX)
+  {
+    m_blocks[block.binPrev].binNext = block.binNext;
+  }
+  else
+  {
+    pool.binHeads[fl][sl] = block.binNext;
+  }
+  if(block.binNext != INVALID_ID_INDEX)
+  {
+    m_blocks[block.binNext].binPrev = block.binPrev;
+  }
+
+  if(pool.binHeads[fl][sl] == INVALID_ID_INDEX)
+  {
+    pool.slBitmaps[fl] &= ~(1 << sl);
+    if(!pool.slBitmaps[fl])
+    {
+      pool.flBitmap &= ~(1 << fl);
+    }
+  }
+
+  block.binPrev  = INVALID_ID_INDEX;
+  block.binNext  = INVALID_ID_INDEX;
+  block.isBinned = false;
+}
+
+void DeviceMemoryAllocator::binUpdate(Block& block)
+{
+  if(block.isBinned)
+  {
+    uint32_t largest = block.range.getLargestFree();
+    if(largest)
+    {
+      uint32_t fl;
+      uint32_t sl;
+      binMapping(largest, fl, sl);
+      if(fl == block.binFL && sl == block.binSL)
+      {
+        return;
+      }
+    }
+  }
+
+  binRemove(block);
+  binInsert(block);
+}
+
+void DeviceMemoryAllocator::rebuildBins()
+{
+  for(auto& pool : m_blockPools)
+  {
+    pool.resetBins();
+  }
+  for(auto& block : m_blocks)
+  {
+    block.binPrev  = INVALID_ID_INDEX;
+    block.binNext  = INVALID_ID_INDEX;
+    block.isBinned = false;
+  }
+  for(auto& block : m_blocks)
+  {
+    binInsert(block);
+  }
+}
+
+VkResult DeviceMemoryAllocator::createBlockBuffer(BlockID id, VkBuffer& buffer)
+{
+  const Block& block = getBlock(id);
+
+  VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  createInfo.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  createInfo.size               = block.allocationSize;
+
+  VkResult result = createBufferInternal(m_device, &createInfo, &buffer);
+  if(result != VK_SUCCESS)
+  {
+    buffer = VK_NULL_HANDLE;
+    return result;
+  }
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(m_device, buffer, &memReqs);
+
+  if(!(memReqs.memoryTypeBits & (1 << block.memoryTypeIndex)) || memReqs.size > block.allocationSize)
+  {
+    result = VK_ERROR_FEATURE_NOT_PRESENT;
+  }
+  else
+  {
+    result = vkBindBufferMemory(m_device, buffer, block.mem, 0);
+  }
+
+  if(result != VK_SUCCESS)
+  {
+    vkDestroyBuffer(m_device, buffer, nullptr);
+    buffer = VK_NULL_HANDLE;
+  }
+
+  return result;
+}
+
+bool DeviceMemoryAllocator::defragBegin(std::vector<DefragMove>& moves, VkDeviceSize maxBytes, uint32_t maxMoves)
+{
+  assert(m_defragMoves.empty() && "previous defragmentation not finished");
+
+  moves.clear();
+
+  // free space per pool that can receive allocations
+  std::vector<VkDeviceSize> poolFree(m_blockPools.size(), 0);
+  std::vector<uint32_t>     sources;
+  for(uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++)
+  {
+    const Block& block = m_blocks[i];
+    if(!block.mem || block.isDedicated)
+    {
+      continue;
+    }
+
+    poolFree[block.poolIndex] += block.allocationSize - block.usedSize;
+    if(block.isLinear && block.allocationCount && !block.mapCount)
+    {
+      sources.push_back(i);
+    }
+  }
+
+  // emptying the least used blocks first is the cheapest
+  std::sort(sources.begin(), sources.end(), [&](uint32_t a, uint32_t b) {
+    return m_blocks[a].usedSize < m_blocks[b].usedSize || (m_blocks[a].usedSize == m_blocks[b].usedSize && a < b);
+  });
+
+  // linked-list of the allocations per block
+  std::vector<uint32_t> blockFirst(m_blocks.size(), INVALID_ID_INDEX);
+  std::vector<uint32_t> allocationNext(m_allocations.size(), INVALID_ID_INDEX);
+  for(uint32_t i = (uint32_t)m_allocations.size(); i-- > 0;)
+  {
+    const AllocationInfo& info = m_allocations[i];
+    if(info.id.index == i)
+    {
+      allocationNext[i]            = blockFirst[info.block.index];
+      blockFirst[info.block.index] = i;
+    }
+  }
+
+  std::vector<bool> isDestination(m_blocks.size(), false);
+  VkDeviceSize      bytesLeft = maxBytes;
+  uint32_t          movesLeft = maxMoves;
+
+  for(uint32_t s = 0; s < (uint32_t)sources.size() && bytesLeft && movesLeft; s++)
+  {
+    Block&       block     = m_blocks[sources[s]];
+    VkDeviceSize blockFree = block.allocationSize - block.usedSize;
+
+    // the other blocks must be able to take everything, otherwise the block cannot be released
+    if(isDestination[sources[s]] || poolFree[block.poolIndex] - blockFree < block.usedSize)
+    {
+      continue;
+    }
+    if(!block.defragBuffer && createBlockBuffer(block.id, block.defragBuffer) != VK_SUCCESS)
+    {
+      continue;
+    }
+
+    block.isDefragSource = true;
+    binRemove(block);
+    poolFree[block.poolIndex] -= blockFree;
+
+    for(uint32_t a = blockFirst[sources[s]]; a != INVALID_ID_INDEX && bytesLeft && movesLeft; a = allocationNext[a])
+    {
+      const AllocationInfo& info = m_allocations[a];
+      if(info.allocation.size > bytesLeft)
+      {
+        continue;
+      }
+
+      DefragMoveInternal internal;
+      uint32_t           offset;
+      if(!subAllocate(block.poolIndex, (uint32_t)info.allocation.size, info.alignment, internal.dstBlock,
+                      internal.dstBlockOffset, offset, internal.dstBlockSize))
+      {
+        continue;
+      }
+
+      Block& dstBlock = getBlock(internal.dstBlock);
+      if(!dstBlock.defragBuffer && createBlockBuffer(dstBlock.id, dstBlock.defragBuffer) != VK_SUCCESS)
+      {
+        subFree(dstBlock, internal.dstBlockOffset, internal.dstBlockSize);
+        continue;
+      }
+
+      isDestination[internal.dstBlock.index] = true;
+
+      internal.move.id         = info.id;
+      internal.move.src        = info.allocation;
+      internal.move.dst.mem    = dstBlock.mem;
+      internal.move.dst.offset = offset;
+      internal.move.dst.size   = info.allocation.size;
+
+      m_defragMoves.push_back(internal);
+      moves.push_back(internal.move);
+
+      poolFree[block.poolIndex] -= internal.dstBlockSize;
+      bytesLeft -= info.allocation.size;
+      movesLeft--;
+    }
+  }
+
+  if(m_defragMoves.empty())
+  {
+    defragFinish();
+    return false;
+  }
+
+  return true;
+}
+
+void DeviceMemoryAllocator::defragCmdCopy(VkCommandBuffer cmd)
+{
+  // moves are sorted by source block, batch the regions between the same pair of blocks
+  std::vector<VkBufferCopy> regions;
+  VkBuffer                  srcBuffer = VK_NULL_HANDLE;
+  VkBuffer                  dstBuffer = VK_NULL_HANDLE;
+
+  for(size_t i = 0; i <= m_defragMoves.size(); i++)
+  {
+    VkBuffer src = VK_NULL_HANDLE;
+    VkBuffer dst = VK_NULL_HANDLE;
+    if(i < m_defragMoves.size())
+    {
+      src = getBlock(getInfo(m_defragMoves[i].move.id).block).defragBuffer;
+      dst = getBlock(m_defragMoves[i].dstBlock).defragBuffer;
+    }
+
+    if(!regions.empty() && (src != srcBuffer || dst != dstBuffer))
+    {
+      vkCmdCopyBuffer(cmd, srcBuffer, dstBuffer, (uint32_t)regions.size(), regions.data());
+      regions.clear();
+    }
+
+    if(i < m_defragMoves.size())
+    {
+      const DefragMove& move = m_defragMoves[i].move;
+      regions.push_back({move.src.offset, move.dst.offset, move.src.size});
+      srcBuffer = src;
+      dstBuffer = dst;
+    }
+  }
+}
+
+void DeviceMemoryAllocator::defragEnd()
+{
+  for(const auto& internal : m_defragMoves)
+  {
+    AllocationInfo& info = m_allocations[internal.move.id.index];
+    assert(info.id.isEqual(internal.move.id) && "moved allocation was freed during defragmentation");
+
+    subFree(getBlock(info.block), info.blockOffset, info.blockSize);
+
+    info.allocation  = internal.move.dst;
+    info.block       = internal.dstBlock;
+    info.blockOffset = internal.dstBlockOffset;
+    info.blockSize   = internal.dstBlockSize;
+  }
+  m_defragMoves.clear();
+
+  defragFinish();
+}
+
+void DeviceMemoryAllocator::defragCancel()
+{
+  for(size_t i = m_defragMoves.size(); i-- > 0;)
+  {
+    const DefragMoveInternal& internal = m_defragMoves[i];
+    subFree(getBlock(internal.dstBlock), internal.dstBlockOffset, internal.dstBlockSize);
+  }
+  m_defragMoves.clear();
+
+  defragFinish();
+}
+
+void DeviceMemoryAllocator::defragFinish()
+{
+  for(auto& block : m_blocks)
+  {
+    if(block.defragBuffer)
+    {
+      destroyBlockBuffer(block.id, block.defragBuffer);
+      block.defragBuffer = VK_NULL_HANDLE;
+    }
+
+    if(!block.isDefragSource)
+    {
+      continue;
+    }
+    block.isDefragSource = false;
+
+    if(block.allocationCount == 0)
+    {
+      if(block.isFirst)
+      {
+        // pass on the "first" role, so that the pool keeps one block alive
+        for(auto& other : m_blocks)
+        {
+          if(other.mem && &other != &block && other.poolIndex == block.poolIndex && !other.isDedicated)
+          {
+            other.isFirst = true;
+            break;
+          }
+        }
+      }
+      releaseBlock(block);
+    }
+    else
+    {
+      binInsert(block);
+    }
   }
 }
 
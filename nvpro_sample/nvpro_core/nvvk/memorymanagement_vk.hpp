@@ -126,12 +126,41 @@ public:
   rather than the various create functions provided here, as we may deprecate them.
 
   > **WARNING** : The memory manager serves as proof of concept for some key concepts
-  > however it is not meant for production use and it currently lacks de-fragmentation logic
-  > as well. You may want to look at [VMA](https://github.com/GPUOpen-LibrariesAndSDKs/VulkanMemoryAllocator)
+  > however it is not meant for production use and its de-fragmentation logic is limited
+  > to linear (buffer) memory. You may want to look at [VMA](https://github.com/GPUOpen-LibrariesAndSDKs/VulkanMemoryAllocator)
   > for a more production-focused solution.
 
   You can derive from this class and overload a few functions to alter the
-  chunk allocation behavior.
+  chunk allocation behavior. When all of the block memory functions are overloaded,
+  the allocator can also be initialized without a physical device, which allows
+  running the allocation logic against a custom backend.
+
+  The search for a block with enough free space is controlled via `setStrategy`:
+  - STRATEGY_FIRST_FIT : linear scan over all blocks (default), the cost grows with the number of blocks.
+  - STRATEGY_SEGREGATED : blocks are binned in power-of-two size classes of their largest free range,
+    finding a block is constant time, but allocations may skip blocks that would just fit.
+  - STRATEGY_TLSF : two-level segregated fit, each power-of-two class is split into 8 sub-classes,
+    constant time and close to best fit.
+
+  An incremental defragmentation moves allocations out of the least utilized linear blocks,
+  so that these blocks can be released. The application re-creates its resources for
+  the returned moves:
+
+  \code{.cpp}
+  std::vector<nvvk::DeviceMemoryAllocator::DefragMove> moves;
+  // limit the amount of bytes copied per frame
+  if(memAllocator.defragBegin(moves, 64 * 1024 * 1024))
+  {
+    memAllocator.defragCmdCopy(cmd);
+    ... submit cmd and wait for completion
+    memAllocator.defragEnd();
+
+    for(auto& move : moves)
+    {
+      ... destroy the old buffer of move.id, create and bind a new one at move.dst
+    }
+  }
+  \endcode
 
   Example :
   \code{.cpp}
@@ -197,11 +226,29 @@ public:
             VkDeviceSize     blockSize = NVVK_DEFAULT_MEMORY_BLOCKSIZE,
             VkDeviceSize     maxSize   = 0);
 
+  // does not query the physical device, meant for derived classes that overload
+  // the block memory functions
+  void init(VkDevice                                device,
+            const VkPhysicalDeviceMemoryProperties& memoryProperties,
+            VkDeviceSize                            maxAllocationSize,
+            VkDeviceSize                            blockSize = NVVK_DEFAULT_MEMORY_BLOCKSIZE);
+
   void setDebugName(const std::string& name) { m_debugName = name; }
 
   // requires VK_EXT_memory_priority, default is false
   void setPrioritySupported(bool state) { m_supportsPriority = state; }
 
+  enum Strategy
+  {
+    STRATEGY_FIRST_FIT,
+    STRATEGY_SEGREGATED,
+    STRATEGY_TLSF,
+  };
+
+  // can be changed at any time, existing blocks are re-binned
+  void     setStrategy(Strategy strategy);
+  Strategy getStrategy() const { return m_strategy; }
+
   // frees all blocks independent of individual allocations
   // use only if you know the lifetime of all resources from this allocator.
   void freeAll();
@@ -409,6 +456,33 @@ public:
   }
 #endif
 
+  //////////////////////////////////////////////////////////////////////////
+
+  // incremental defragmentation of linear (buffer) blocks
+  //
+  // Between defragBegin and defragEnd the moved allocations must not be freed or written to,
+  // and only one defragmentation can be active. Mapped blocks are not moved.
+  // After defragEnd the AllocationIDs stay valid, but refer to the new location.
+
+  struct DefragMove
+  {
+    AllocationID id;
+    Allocation   src;
+    Allocation   dst;
+  };
+
+  // plans moves out of the least utilized blocks and reserves their destinations,
+  // returns false if nothing is worth moving
+  bool defragBegin(std::vector<DefragMove>& moves, VkDeviceSize maxBytes = ~VkDeviceSize(0), uint32_t maxMoves = ~0u);
+  // records the copies, cmd must support transfer operations
+  void defragCmdCopy(VkCommandBuffer cmd);
+  // call after the copies completed, remaps the AllocationIDs and frees emptied blocks
+  void defragEnd();
+  // releases the reserved destinations without moving anything
+  void defragCancel();
+
+  bool isDefragActive() const { return !m_defragMoves.empty(); }
+
 
 protected:
   static const VkMemoryDedicatedAllocateInfo* DEDICATED_PROXY;
@@ -432,12 +506,57 @@ protected:
     friend bool operator==(const BlockID& lhs, const BlockID& rhs) { return rhs.isEqual(lhs); }
   };
 
+  static const uint32_t BIN_FL_COUNT = 32;
+  static const uint32_t BIN_SL_MAX   = 8;
+  static const uint32_t BIN_SL_BITS  = 3;  // for STRATEGY_TLSF
+
+  // blocks that are compatible with each other, they are binned by their largest free range
+  struct BlockPool
+  {
+    uint32_t              memoryTypeIndex = 0;
+    bool                  isLinear        = false;
+    float                 priority        = 0.0f;
+    VkMemoryAllocateFlags allocateFlags{};
+    uint32_t              allocateDeviceMask = 0;
+
+    // active blocks that can be sub-allocated from
+    uint32_t blockCount = 0;
+
+    uint32_t flBitmap = 0;
+    uint32_t slBitmaps[BIN_FL_COUNT];
+    uint32_t binHeads[BIN_FL_COUNT][BIN_SL_MAX];
+
+    void resetBins()
+    {
+      flBitmap = 0;
+      for(uint32_t fl = 0; fl < BIN_FL_COUNT; fl++)
+      {
+        slBitmaps[fl] = 0;
+        for(uint32_t sl = 0; sl < BIN_SL_MAX; sl++)
+        {
+          binHeads[fl][sl] = INVALID_ID_INDEX;
+        }
+      }
+    }
+  };
+
   struct Block
   {
     BlockID                   id{};  // index to self, or next free item
     VkDeviceMemory            mem = VK_NULL_HANDLE;
     nvh::TRangeAllocator<256> range;
 
+    uint32_t poolIndex = INVALID_ID_INDEX;
+    // doubly-linked list of blocks within a bin of the pool
+    uint32_t binPrev  = INVALID_ID_INDEX;
+    uint32_t binNext  = INVALID_ID_INDEX;
+    uint8_t  binFL    = 0;
+    uint8_t  binSL    = 0;
+    bool     isBinned = false;
+
+    bool     isDefragSource = false;
+    VkBuffer defragBuffer   = VK_NULL_HANDLE;
+
     VkDeviceSize allocationSize = 0;
     VkDeviceSize usedSize       = 0;
 
@@ -468,17 +587,31 @@ protected:
     Allocation   allocation{};
     uint32_t     blockOffset = 0;
     uint32_t     blockSize   = 0;
+    uint32_t     alignment   = 0;
     BlockID      block{};
   };
 
+  struct DefragMoveInternal
+  {
+    DefragMove move;
+    BlockID    dstBlock{};
+    uint32_t   dstBlockOffset = 0;
+    uint32_t   dstBlockSize   = 0;
+  };
+
   VkDevice     m_device            = VK_NULL_HANDLE;
   VkDeviceSize m_blockSize         = 0;
   VkDeviceSize m_allocatedSize     = 0;
   VkDeviceSize m_usedSize          = 0;
   VkDeviceSize m_maxAllocationSize = 0;
 
-  std::vector<Block>          m_blocks;
-  std::vector<AllocationInfo> m_allocations;
+  std::vector<Block>              m_blocks;
+  std::vector<AllocationInfo>     m_allocations;
+  std::vector<BlockPool>          m_blockPools;
+  std::vector<DefragMoveInternal> m_defragMoves;
+
+  Strategy m_strategy   = STRATEGY_FIRST_FIT;
+  uint32_t m_binSubBits = 0;
 
   // linked-list to next free allocation
   uint32_t m_freeAllocationIndex = INVALID_ID_INDEX;
@@ -507,9 +640,28 @@ protected:
                              bool                                 preferDevice,
                              const State&                         state);
 
-  AllocationID createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize);
+  AllocationID createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize, uint32_t alignment);
   void         destroyID(AllocationID id);
 
+  uint32_t getPoolIndex(uint32_t memoryTypeIndex, bool isLinear, float priority, const State& state);
+  // sub-allocates from the existing blocks of a pool according to m_strategy
+  bool subAllocate(uint32_t  poolIndex,
+                   uint32_t  size,
+                   uint32_t  alignment,
+                   BlockID&  outBlock,
+                   uint32_t& outBlockOffset,
+                   uint32_t& outOffset,
+                   uint32_t& outBlockSize);
+  void subFree(Block& block, uint32_t blockOffset, uint32_t blockSize);
+  void releaseBlock(Block& block);
+  void defragFinish();
+
+  void binMapping(uint32_t size, uint32_t& fl, uint32_t& sl) const;
+  void binInsert(Block& block);
+  void binRemove(Block& block);
+  void binUpdate(Block& block);
+  void rebuildBins();
+
   const AllocationInfo& getInfo(AllocationID id) const
   {
     assert(m_allocations[id.index].id.isEqual(id));
@@ -549,6 +701,10 @@ protected:
   {
     return vkCreateImage(device, info, nullptr, image);
   }
+
+  // buffer covering a whole block, used as copy source or destination during defragmentation
+  virtual VkResult createBlockBuffer(BlockID id, VkBuffer& buffer);
+  virtual void     destroyBlockBuffer(BlockID /*id*/, VkBuffer buffer) { vkDestroyBuffer(m_device, buffer, nullptr); }
 };
 
 }  // namespace nvvk
@@ -70,6 +70,11 @@ void ProfilerVK::setLabelUsage(bool state)
   m_useLabels = state;
 }
 
+void ProfilerVK::setCalibratedTimestamps(bool state)
+{
+  m_useCalibrated = state;
+}
+
 void ProfilerVK::resize()
 {
   if(getRequiredTimers() < m_queryPoolSize)
@@ -188,6 +193,32 @@ bool ProfilerVK::getSectionTime(SectionID i, uint32_t queryFrame, double& gpuTim
   {
     uint64_t mask = m_queueFamilyMask;
     gpuTime       = (double((times[1] & mask) - (times[0] & mask)) * double(m_frequency)) / double(1000);
+
+    if(isTracing())
+    {
+      double gpuBegin = (double(times[0] & mask) * double(m_frequency)) / double(1000);
+
+      if(m_useCalibrated && m_calibrationFrame != getTotalFrames())
+      {
+        // recalibrate once per frame, device domain only, we sample our own clock around it
+        VkCalibratedTimestampInfoEXT info = {VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT};
+        info.timeDomain                   = VK_TIME_DOMAIN_DEVICE_EXT;
+
+        uint64_t gpuNow;
+        uint64_t maxDeviation;
+        double   cpuNow = getMicroSeconds();
+        if(vkGetCalibratedTimestampsEXT(m_device, 1, &info, &gpuNow, &maxDeviation) == VK_SUCCESS)
+        {
+          cpuNow             = (cpuNow + getMicroSeconds()) * 0.5;
+          m_gpuClockOffset   = cpuNow - (double(gpuNow & mask) * double(m_frequency)) / double(1000);
+          m_calibrationFrame = getTotalFrames();
+        }
+      }
+
+      bool calibrated = m_useCalibrated && m_calibrationFrame == getTotalFrames();
+      setGpuBeginTime(i, queryFrame, calibrated ? gpuBegin + m_gpuClockOffset : gpuBegin, calibrated);
+    }
+
     return true;
   }
   else
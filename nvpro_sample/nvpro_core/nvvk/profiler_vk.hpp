@@ -146,6 +146,10 @@ public:
   // enable debug label per section, requires VK_EXT_debug_utils
   void setLabelUsage(bool state);
 
+  // place gpu sections precisely in traces, requires VK_EXT_calibrated_timestamps
+  // otherwise they are aligned to the cpu timeline per frame
+  void setCalibratedTimestamps(bool state);
+
   SectionID beginSection(const char* name, VkCommandBuffer cmd, bool singleShot = false, bool hostReset = false);
   void      endSection(SectionID slot, VkCommandBuffer cmd);
 
@@ -153,7 +157,12 @@ public:
 
 private:
   void resize();
-  bool m_useLabels = false;
+  bool m_useLabels     = false;
+  bool m_useCalibrated = false;
+
+  // maps device timestamps onto getMicroSeconds() for traces
+  uint32_t m_calibrationFrame = ~0u;
+  double   m_gpuClockOffset   = 0;
 #if 0
   bool m_useCoreHostReset = false;
 #endif
@@ -18,6 +18,8 @@
  */
 
 #include "raytraceKHR_vk.hpp"
+#include "nvh/alignment.hpp"
+#include "nvh/timesampler.hpp"
 #include <numeric>
 
 //--------------------------------------------------------------------------------------------------
@@ -84,26 +86,9 @@ void nvvk::RaytracingBuilderKHR::buildBlas(const std::vector<BlasInput>& input,
 
   // Preparing the information for the acceleration build commands.
   std::vector<BuildAccelerationStructure> buildAs(nbBlas);
+  prepareBlas(input, flags, buildAs);
   for(uint32_t idx = 0; idx < nbBlas; idx++)
   {
-    // Filling partially the VkAccelerationStructureBuildGeometryInfoKHR for querying the build sizes.
-    // Other information will be filled in the createBlas (see #2)
-    buildAs[idx].buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    buildAs[idx].buildInfo.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    buildAs[idx].buildInfo.flags         = input[idx].flags | flags;
-    buildAs[idx].buildInfo.geometryCount = static_cast<uint32_t>(input[idx].asGeometry.size());
-    buildAs[idx].buildInfo.pGeometries   = input[idx].asGeometry.data();
-
-    // Build range information
-    buildAs[idx].rangeInfo = input[idx].asBuildOffsetInfo.data();
-
-    // Finding sizes to create acceleration structures and scratch
-    std::vector<uint32_t> maxPrimCount(input[idx].asBuildOffsetInfo.size());
-    for(auto tt = 0; tt < input[idx].asBuildOffsetInfo.size(); tt++)
-      maxPrimCount[tt] = input[idx].asBuildOffsetInfo[tt].primitiveCount;  // Number of primitives/triangles
-    vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-                                            &buildAs[idx].buildInfo, maxPrimCount.data(), &buildAs[idx].sizeInfo);
-
     // Extra info
     asTotalSize += buildAs[idx].sizeInfo.accelerationStructureSize;
     maxScratchSize = std::max(maxScratchSize, buildAs[idx].sizeInfo.buildScratchSize);
@@ -182,6 +167,372 @@ void nvvk::RaytracingBuilderKHR::buildBlas(const std::vector<BlasInput>& input,
   m_cmdPool.deinit();
 }
 
+//--------------------------------------------------------------------------------------------------
+// Filling the build information and querying the sizes of all BLAS
+//
+void nvvk::RaytracingBuilderKHR::prepareBlas(const std::vector<BlasInput>&            input,
+                                             VkBuildAccelerationStructureFlagsKHR     flags,
+                                             std::vector<BuildAccelerationStructure>& buildAs)
+{
+  for(uint32_t idx = 0; idx < static_cast<uint32_t>(input.size()); idx++)
+  {
+    // Filling partially the VkAccelerationStructureBuildGeometryInfoKHR for querying the build sizes.
+    // Other information will be filled in the createBlas (see #2)
+    buildAs[idx].buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    buildAs[idx].buildInfo.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    buildAs[idx].buildInfo.flags         = input[idx].flags | flags;
+    buildAs[idx].buildInfo.geometryCount = static_cast<uint32_t>(input[idx].asGeometry.size());
+    buildAs[idx].buildInfo.pGeometries   = input[idx].asGeometry.data();
+
+    // Build range information
+    buildAs[idx].rangeInfo = input[idx].asBuildOffsetInfo.data();
+
+    // Finding sizes to create acceleration structures and scratch
+    std::vector<uint32_t> maxPrimCount(input[idx].asBuildOffsetInfo.size());
+    for(auto tt = 0; tt < input[idx].asBuildOffsetInfo.size(); tt++)
+      maxPrimCount[tt] = input[idx].asBuildOffsetInfo[tt].primitiveCount;  // Number of primitives/triangles
+    vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                            &buildAs[idx].buildInfo, maxPrimCount.data(), &buildAs[idx].sizeInfo);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create all the BLAS like buildBlas, but streaming through batches
+// - a batch is limited by the scratch budget (half of it when compacting, as two batches
+//   are in flight) and by half the memory budget
+// - all BLAS of a batch are built with a single command, each with its own scratch range
+// - while batch N is built, batch N-1 is compacted, the non-compacted versions are
+//   destroyed as soon as the copies finished or when the memory budget requires it
+// - the host only waits on the timeline semaphore, never on the queue
+//
+void nvvk::RaytracingBuilderKHR::buildBlasBudgeted(const std::vector<BlasInput>&        input,
+                                                   VkBuildAccelerationStructureFlagsKHR flags,
+                                                   const BlasBuildBudget&               budget,
+                                                   BlasBuildStats*                      stats)
+{
+  nvh::Stopwatch swTotal;
+  nvh::Stopwatch sw;
+  BlasBuildStats st;
+
+  auto nbBlas = static_cast<uint32_t>(input.size());
+  if(!nbBlas)
+  {
+    if(stats)
+      *stats = st;
+    return;
+  }
+
+  std::vector<BuildAccelerationStructure> buildAs(nbBlas);
+  prepareBlas(input, flags, buildAs);
+
+  uint32_t nbCompactions{0};
+  for(auto& b : buildAs)
+  {
+    nbCompactions += hasFlag(b.buildInfo.flags, VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
+    st.originalSize += b.sizeInfo.accelerationStructureSize;
+  }
+  assert(nbCompactions == 0 || nbCompactions == nbBlas);  // Don't allow mix of on/off compaction
+  bool compaction = nbCompactions > 0;
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &asProperties;
+  vkGetPhysicalDeviceProperties2(m_alloc->getPhysicalDevice(), &properties);
+  VkDeviceSize scratchAlignment = std::max(VkDeviceSize(asProperties.minAccelerationStructureScratchOffsetAlignment), VkDeviceSize(1));
+
+  // Forming the batches, consecutive BLAS so queries can be reset and written as one range
+  struct Batch
+  {
+    uint32_t     first{0};
+    uint32_t     count{0};
+    VkDeviceSize scratchSize{0};
+    VkDeviceSize memorySize{0};
+    uint64_t     buildValue{0};
+    uint64_t     compactValue{0};
+  };
+  uint32_t     slots         = compaction ? 2 : 1;
+  VkDeviceSize slotBudget    = budget.scratchBudget / slots;
+  VkDeviceSize batchMemLimit = compaction ? budget.memoryBudget / 2 : ~VkDeviceSize(0);
+
+  std::vector<Batch> batches(1);
+  for(uint32_t idx = 0; idx < nbBlas; idx++)
+  {
+    VkDeviceSize scratchSize = nvh::align_up(buildAs[idx].sizeInfo.buildScratchSize, scratchAlignment);
+    VkDeviceSize memorySize  = buildAs[idx].sizeInfo.accelerationStructureSize;
+    Batch*       batch       = &batches.back();
+    if(batch->count
+       && (batch->scratchSize + scratchSize > slotBudget || batch->memorySize + memorySize > batchMemLimit))
+    {
+      batches.push_back({idx});
+      batch = &batches.back();
+    }
+    batch->count++;
+    batch->scratchSize += scratchSize;
+    batch->memorySize += memorySize;
+  }
+  slots = std::min(slots, uint32_t(batches.size()));
+
+  VkDeviceSize slotSize{0};
+  for(auto& batch : batches)
+  {
+    slotSize = std::max(slotSize, batch.scratchSize);
+  }
+
+  // One scratch buffer for all slots, aligned manually as the buffer address may not be
+  // aligned to minAccelerationStructureScratchOffsetAlignment
+  st.scratchSize = slotSize * slots + scratchAlignment;
+  nvvk::Buffer scratchBuffer =
+      m_alloc->createBuffer(st.scratchSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  VkBufferDeviceAddressInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, scratchBuffer.buffer};
+  VkDeviceAddress           scratchAddress = nvh::align_up(vkGetBufferDeviceAddress(m_device, &bufferInfo), scratchAlignment);
+  NAME_VK(scratchBuffer.buffer);
+
+  VkQueryPool queryPool{VK_NULL_HANDLE};
+  if(compaction)
+  {
+    VkQueryPoolCreateInfo qpci{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    qpci.queryCount = nbBlas;
+    qpci.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+    vkCreateQueryPool(m_device, &qpci, nullptr, &queryPool);
+  }
+
+  VkSemaphoreTypeCreateInfo timelineInfo{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+  semaphoreInfo.pNext = &timelineInfo;
+  VkSemaphore timeline{VK_NULL_HANDLE};
+  vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &timeline);
+  uint64_t timelineValue{0};
+
+  VkQueue queue = budget.queue;
+  if(!queue)
+  {
+    vkGetDeviceQueue(m_device, m_queueIndex, 0, &queue);
+  }
+  // local pool, so the function can be used from any thread
+  nvvk::CommandPool cmdPool(m_device, m_queueIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queue);
+
+  auto submit = [&](VkCommandBuffer cmdBuf) {
+    vkEndCommandBuffer(cmdBuf);
+    timelineValue++;
+    VkTimelineSemaphoreSubmitInfo timelineSubmit{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineSubmit.signalSemaphoreValueCount = 1;
+    timelineSubmit.pSignalSemaphoreValues    = &timelineValue;
+    VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submitInfo.pNext                = &timelineSubmit;
+    submitInfo.commandBufferCount   = 1;
+    submitInfo.pCommandBuffers      = &cmdBuf;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &timeline;
+    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    return timelineValue;
+  };
+  auto wait = [&](uint64_t value) {
+    VkSemaphoreWaitInfo waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &timeline;
+    waitInfo.pValues        = &value;
+    vkWaitSemaphores(m_device, &waitInfo, ~uint64_t(0));
+  };
+
+  VkDeviceSize aliveSize{0};   // all acceleration structures alive
+  VkDeviceSize inFlight{0};    // non-compacted acceleration structures alive
+  size_t       nextCompact{0};  // oldest batch not compacted yet
+  size_t       nextRetire{0};   // oldest batch with non-compacted acceleration structures
+
+  auto updatePeak = [&]() { st.peakMemorySize = std::max(st.peakMemorySize, st.scratchSize + aliveSize); };
+
+  st.timePrepare = sw.elapsed().count();
+
+  auto compactBatch = [&](Batch& batch) {
+    sw.reset();
+    wait(batch.buildValue);
+    st.timeBuild += sw.elapsed().count();
+    sw.reset();
+
+    // the build completed, no need to wait for the results
+    std::vector<VkDeviceSize> compactSizes(batch.count);
+    vkGetQueryPoolResults(m_device, queryPool, batch.first, batch.count, batch.count * sizeof(VkDeviceSize),
+                          compactSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+    VkCommandBuffer cmdBuf = cmdPool.createCommandBuffer();
+
+    // Make the builds visible to the copies
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    for(uint32_t i = 0; i < batch.count; i++)
+    {
+      uint32_t idx                                    = batch.first + i;
+      buildAs[idx].cleanupAS                          = buildAs[idx].as;
+      buildAs[idx].sizeInfo.accelerationStructureSize = compactSizes[i];
+
+      VkAccelerationStructureCreateInfoKHR asCreateInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+      asCreateInfo.size = compactSizes[i];
+      asCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+      buildAs[idx].as   = m_alloc->createAcceleration(asCreateInfo);
+      NAME_IDX_VK(buildAs[idx].as.accel, idx);
+      NAME_IDX_VK(buildAs[idx].as.buffer.buffer, idx);
+      aliveSize += compactSizes[i];
+      st.compactSize += compactSizes[i];
+
+      VkCopyAccelerationStructureInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR};
+      copyInfo.src  = buildAs[idx].cleanupAS.accel;
+      copyInfo.dst  = buildAs[idx].as.accel;
+      copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+      vkCmdCopyAccelerationStructureKHR(cmdBuf, &copyInfo);
+    }
+    updatePeak();
+
+    batch.compactValue = submit(cmdBuf);
+    st.timeCompact += sw.elapsed().count();
+  };
+
+  auto retireBatch = [&](Batch& batch) {
+    sw.reset();
+    wait(batch.compactValue);
+    for(uint32_t i = 0; i < batch.count; i++)
+    {
+      m_alloc->destroy(buildAs[batch.first + i].cleanupAS);
+    }
+    aliveSize -= batch.memorySize;
+    inFlight -= batch.memorySize;
+    st.timeCompact += sw.elapsed().count();
+  };
+
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangeInfos;
+  std::vector<VkAccelerationStructureKHR>                      accels;
+
+  for(size_t b = 0; b < batches.size(); b++)
+  {
+    Batch& batch = batches[b];
+
+    if(compaction)
+    {
+      // Stay within the memory budget
+      while(nextRetire < b && inFlight + batch.memorySize > budget.memoryBudget)
+      {
+        if(nextCompact == nextRetire)
+          compactBatch(batches[nextCompact++]);
+        retireBatch(batches[nextRetire++]);
+      }
+      // The scratch slot is free once the build of its previous user completed,
+      // compacting waits for exactly that
+      while(b >= slots && nextCompact <= b - slots)
+      {
+        compactBatch(batches[nextCompact++]);
+      }
+    }
+
+    sw.reset();
+    VkDeviceAddress slotAddress = scratchAddress + slotSize * (b % slots);
+    VkDeviceSize    slotOffset{0};
+    buildInfos.clear();
+    rangeInfos.clear();
+    accels.clear();
+    for(uint32_t idx = batch.first; idx < batch.first + batch.count; idx++)
+    {
+      VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+      createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+      createInfo.size = buildAs[idx].sizeInfo.accelerationStructureSize;
+      buildAs[idx].as = m_alloc->createAcceleration(createInfo);
+      NAME_IDX_VK(buildAs[idx].as.accel, idx);
+      NAME_IDX_VK(buildAs[idx].as.buffer.buffer, idx);
+
+      buildAs[idx].buildInfo.dstAccelerationStructure  = buildAs[idx].as.accel;
+      buildAs[idx].buildInfo.scratchData.deviceAddress = slotAddress + slotOffset;
+      slotOffset += nvh::align_up(buildAs[idx].sizeInfo.buildScratchSize, scratchAlignment);
+
+      buildInfos.push_back(buildAs[idx].buildInfo);
+      rangeInfos.push_back(buildAs[idx].rangeInfo);
+      accels.push_back(buildAs[idx].as.accel);
+    }
+    aliveSize += batch.memorySize;
+    inFlight += compaction ? batch.memorySize : 0;
+    updatePeak();
+
+    VkCommandBuffer cmdBuf = cmdPool.createCommandBuffer();
+
+    // The scratch slot was used by an earlier submission
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // All builds of the batch are independent and can run in parallel
+    vkCmdBuildAccelerationStructuresKHR(cmdBuf, batch.count, buildInfos.data(), rangeInfos.data());
+
+    if(queryPool)
+    {
+      vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                           VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+      vkCmdResetQueryPool(cmdBuf, queryPool, batch.first, batch.count);
+      vkCmdWriteAccelerationStructuresPropertiesKHR(cmdBuf, batch.count, accels.data(),
+                                                    VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                                    queryPool, batch.first);
+    }
+
+    batch.buildValue = submit(cmdBuf);
+    st.timeBuild += sw.elapsed().count();
+
+    if(compaction)
+    {
+      // Compact the previous batch while this one is built
+      while(nextCompact < b)
+      {
+        compactBatch(batches[nextCompact++]);
+      }
+      // Release what already completed without waiting
+      uint64_t completedValue{0};
+      vkGetSemaphoreCounterValue(m_device, timeline, &completedValue);
+      while(nextRetire < nextCompact && batches[nextRetire].compactValue <= completedValue)
+      {
+        retireBatch(batches[nextRetire++]);
+      }
+    }
+  }
+
+  if(compaction)
+  {
+    while(nextCompact < batches.size())
+    {
+      compactBatch(batches[nextCompact++]);
+    }
+    while(nextRetire < batches.size())
+    {
+      retireBatch(batches[nextRetire++]);
+    }
+  }
+  else
+  {
+    sw.reset();
+    wait(timelineValue);
+    st.timeBuild += sw.elapsed().count();
+    st.compactSize = st.originalSize;
+  }
+
+  // Keeping all the created acceleration structures
+  for(auto& b : buildAs)
+  {
+    m_blas.emplace_back(b.as);
+  }
+
+  // Clean up
+  cmdPool.deinit();
+  vkDestroySemaphore(m_device, timeline, nullptr);
+  vkDestroyQueryPool(m_device, queryPool, nullptr);
+  m_alloc->destroy(scratchBuffer);
+
+  st.batchCount = static_cast<uint32_t>(batches.size());
+  st.timeTotal  = swTotal.elapsed().count();
+  if(stats)
+    *stats = st;
+}
 
 //--------------------------------------------------------------------------------------------------
 // Creating the bottom level acceleration structure for all indices of `buildAs` vector.
@@ -61,6 +61,24 @@ m_rtBuilder.buildTlas(instances);
 // Retrieve the handle to the acceleration structure.
 const VkAccelerationStructureKHR tlas = m.rtBuilder.getAccelerationStructure()
 \endcode
+
+For large scenes buildBlasBudgeted is an alternative to buildBlas.
+It splits the BLAS into batches that respect a scratch and a memory
+budget. While one batch is built on the device, the previous batch is
+compacted. Synchronization happens with a timeline semaphore only, so
+the queue is never idled. The function can be called from a loader
+thread as long as the queue passed (or queue 0 of the family) and the
+allocator are not used by other threads at the same time.
+
+\code{.cpp}
+nvvk::RaytracingBuilderKHR::BlasBuildBudget budget;
+budget.scratchBudget = 32 * 1024 * 1024;
+budget.memoryBudget  = 128 * 1024 * 1024;
+
+nvvk::RaytracingBuilderKHR::BlasBuildStats stats;
+m_rtBuilder.buildBlasBudgeted(inputs, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                                      | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR, budget, &stats);
+\endcode
 */
 
 #include <mutex>
@@ -118,6 +136,39 @@ public:
   void buildBlas(const std::vector<BlasInput>&        input,
                  VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
 
+  // Limits for buildBlasBudgeted
+  struct BlasBuildBudget
+  {
+    // scratch memory of all builds in flight, a single BLAS exceeding it is still built
+    VkDeviceSize scratchBudget{64'000'000};
+    // non-compacted acceleration structures in flight (compaction only)
+    VkDeviceSize memoryBudget{256'000'000};
+    // queue of the family passed to setup, default is queue 0
+    VkQueue queue{VK_NULL_HANDLE};
+  };
+
+  // Results of buildBlasBudgeted, times are host-side in milliseconds
+  struct BlasBuildStats
+  {
+    uint32_t     batchCount{0};
+    VkDeviceSize scratchSize{0};
+    // peak of scratch and all acceleration structures alive
+    VkDeviceSize peakMemorySize{0};
+    VkDeviceSize originalSize{0};
+    VkDeviceSize compactSize{0};
+    double       timePrepare{0};  // size queries and scratch allocation
+    double       timeBuild{0};    // recording builds and waiting for them
+    double       timeCompact{0};  // recording compaction copies and waiting for them
+    double       timeTotal{0};
+  };
+
+  // Create all the BLAS from the vector of BlasInput in batches limited by budget,
+  // building a batch overlaps with the compaction of the previous one
+  void buildBlasBudgeted(const std::vector<BlasInput>&        input,
+                         VkBuildAccelerationStructureFlagsKHR flags,
+                         const BlasBuildBudget&               budget,
+                         BlasBuildStats*                      stats = nullptr);
+
   // Refit BLAS number blasIdx from updated buffer contents.
   void updateBlas(uint32_t blasIdx, BlasInput& blas, VkBuildAccelerationStructureFlagsKHR flags);
 
@@ -226,6 +277,9 @@ protected:
   };
 
 
+  void prepareBlas(const std::vector<BlasInput>&            input,
+                   VkBuildAccelerationStructureFlagsKHR     flags,
+                   std::vector<BuildAccelerationStructure>& buildAs);
   void cmdCreateBlas(VkCommandBuffer                          cmdBuf,
                      std::vector<uint32_t>                    indices,
                      std::vector<BuildAccelerationStructure>& buildAs,
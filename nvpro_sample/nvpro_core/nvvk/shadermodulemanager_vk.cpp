@@ -21,13 +21,16 @@
 #include "shadermodulemanager_vk.hpp"
 #include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <thread>
 
 #include <nvh/fileoperations.hpp>
+#include <nvh/jobsystem.hpp>
 #include <nvh/nvprint.hpp>
 
 #if NVP_SUPPORTS_SHADERC
@@ -41,8 +44,66 @@ namespace nvvk {
 
 const VkShaderModule ShaderModuleManager::PREPROCESS_ONLY_MODULE = (VkShaderModule)~0;
 
+struct ShaderModuleManager::CompileTask
+{
+  ShaderModule* module   = nullptr;
+  bool          compiled = false;
+  // compiled GLSL, FILETYPE_SPIRV modules use the definition's content
+  std::string spirv;
 #if NVP_SUPPORTS_SHADERC
-// Shared shaderc compiler, and reference count + mutex protecting it.
+  uint32_t                  shaderKind = 0;
+  shaderc_compile_options_t options    = nullptr;  // borrowed
+  // 128-bit key of the cache entry (its filename) and everything it was
+  // hashed from, only valid if useCache
+  bool        useCache = false;
+  uint64_t    cacheKey[2]{};
+  std::string cacheSource;
+  // the files shaderc included
+  std::vector<FileDependency> dependencies;
+#endif
+};
+
+// Collects everything a cache entry depends on. The entry stores all of it and
+// compares it on load, the 128-bit hash (FNV-1a with two different bases and
+// primes) only names the file.
+struct SPIRVCacheSource
+{
+  std::string data;
+
+  void add(const void* src, size_t size) { data.append((const char*)src, size); }
+  // strings are prefixed with their size, so consecutive strings can't alias
+  void add(const std::string& str)
+  {
+    uint64_t size = str.size();
+    add(&size, sizeof(size));
+    data.append(str);
+  }
+  void add(uint32_t v) { add(&v, sizeof(v)); }
+
+  void hash(uint64_t value[2]) const
+  {
+    value[0] = 0xcbf29ce484222325ULL;
+    value[1] = 0x84222325cbf29ce4ULL;
+    for(char c : data)
+    {
+      value[0] = (value[0] ^ uint8_t(c)) * 0x00000100000001B3ULL;
+      value[1] = (value[1] ^ uint8_t(c)) * 0x9E3779B97F4A7C15ULL;
+    }
+  }
+};
+
+static const char   SPIRV_CACHE_MAGIC[8]   = {'N', 'V', 'S', 'P', 'V', 'C', '0', '3'};
+static const char   SPIRV_CACHE_EXTENSION[] = ".spvcache";
+static const size_t SPIRV_CACHE_HEADER_SIZE = sizeof(SPIRV_CACHE_MAGIC) + sizeof(uint64_t) * 2 + sizeof(uint32_t) * 2;
+
+#if NVP_SUPPORTS_SHADERC
+// Shared shaderc compiler and its reference count. The mutex is only locked
+// by the constructor and destructor, which create and release the compiler.
+// compileShaderModule runs on several threads without it: shaderc allows
+// concurrent calls on the same compiler and options as long as they are
+// passed as const, which shaderc_compile_into_spv and
+// shaderc_compile_options_clone do, and the shared options are only modified
+// in prepareShaderModule, before the compile jobs start.
 shaderc_compiler_t ShaderModuleManager::s_shadercCompiler = nullptr;
 uint32_t           ShaderModuleManager::s_shadercCompilerUsers{0};
 std::mutex         ShaderModuleManager::s_shadercCompilerMutex;
@@ -54,8 +115,10 @@ class ShadercIncludeBridge : public shaderc::CompileOptions::IncluderInterface
   nvvk::ShaderModuleManager* m_pShaderFileManager;
 
   // Inputs/outputs reused for manualInclude.
-  std::string       m_filenameFound;
-  const std::string m_emptyString;
+  std::string m_filenameFound;
+
+  // Records the includes, for reloading changed modules and the SPIR-V cache.
+  std::vector<ShaderModuleManager::FileDependency>* m_dependencies;
 
   // Subtype of shaderc_include_result that holds the include data
   // we found; MUST be static_cast to this type before delete-ing as
@@ -81,7 +144,11 @@ class ShadercIncludeBridge : public shaderc::CompileOptions::IncluderInterface
   };
 
 public:
-  ShadercIncludeBridge(nvvk::ShaderModuleManager* pShaderFileManager) { m_pShaderFileManager = pShaderFileManager; }
+  ShadercIncludeBridge(nvvk::ShaderModuleManager* pShaderFileManager, std::vector<ShaderModuleManager::FileDependency>* dependencies)
+  {
+    m_pShaderFileManager = pShaderFileManager;
+    m_dependencies       = dependencies;
+  }
 
   // Handles shaderc_include_resolver_fn callbacks.
   virtual shaderc_include_result* GetInclude(const char*          requested_source,
@@ -89,18 +156,14 @@ public:
                                              const char*          requesting_source,
                                              size_t /*include_depth*/) override
   {
-    std::string filename = requested_source;
-    std::string includeFileText;
-    bool versionFound = false;  // Trying to match glslc behavior: it doesn't allow #version directives in include files.
-    if(type == shaderc_include_type_relative)  // "header.h"
-    {
-      includeFileText = m_pShaderFileManager->getContentWithRequestingSourceDirectory(filename, m_filenameFound, requesting_source);
-    }
-    else  // shaderc_include_type_standard <header.h>
+    const bool  relative = type == shaderc_include_type_relative;  // "header.h" or <header.h>
+    std::string content;
     {
-      includeFileText = m_pShaderFileManager->getContent(filename, m_filenameFound);
+      // Several modules may be compiled in parallel.
+      std::lock_guard<std::mutex> lock(m_pShaderFileManager->m_includeMutex);
+      content = m_pShaderFileManager->resolveInclude(requested_source, relative, requesting_source, m_filenameFound, m_dependencies);
     }
-    std::string content = m_pShaderFileManager->manualIncludeText(includeFileText, m_filenameFound, m_emptyString, versionFound);
+
     return new Result(std::move(content), std::move(m_filenameFound));
   }
 
@@ -213,7 +276,17 @@ uint32_t ShaderModuleManager::DefaultInterface::getTypeShadercKind(uint32_t type
 #endif
 }
 
-bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
+std::string ShaderModuleManager::resolveInclude(std::string const&           requestedSource,
+                                                bool                         relative,
+                                                std::string const&           requestingSource,
+                                                std::string&                 filenameFound,
+                                                std::vector<FileDependency>* dependencies)
+{
+  bool versionFound = false;  // Trying to match glslc behavior: it doesn't allow #version directives in include files.
+  return processInclude(requestedSource, relative, requestingSource, filenameFound, versionFound, dependencies);
+}
+
+bool ShaderModuleManager::prepareShaderModule(ShaderModule& module, CompileTask& task)
 {
   Definition& definition = module.definition;
 
@@ -223,11 +296,6 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
     definition.filetype = m_filetype;
   }
 
-  std::string combinedPrepend = m_prepend;
-  std::string combinedFilenames;
-  combinedPrepend += definition.prepend;
-  combinedFilenames += definition.filename;
-
   if(definition.filetype == FILETYPE_SPIRV)
   {
     std::string filenameFound;
@@ -237,8 +305,9 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
   {
     std::string prepend = m_usedSetupIF->getTypeDefine(definition.type);
 
-    definition.content =
-        manualInclude(definition.filename, definition.filenameFound, prepend + m_prepend + definition.prepend, false);
+    definition.dependencies.clear();
+    definition.content = manualInclude(definition.filename, definition.filenameFound,
+                                       prepend + m_prepend + definition.prepend, false, &definition.dependencies);
   }
 
   if(definition.content.empty())
@@ -249,121 +318,403 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
   if(m_preprocessOnly)
   {
     module.module = PREPROCESS_ONLY_MODULE;
-    return true;
+    return false;
   }
-  else
-  {
-    VkResult                 vkresult         = VK_ERROR_INVALID_SHADER_NV;
-    VkShaderModuleCreateInfo shaderModuleInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+
+  task.module = &module;
 
 #if NVP_SUPPORTS_SHADERC
-    shaderc_compilation_result_t result = nullptr;
-    if(definition.filetype == FILETYPE_GLSL)
+  if(definition.filetype == FILETYPE_GLSL)
+  {
+    task.shaderKind = m_usedSetupIF->getTypeShadercKind(definition.type);
+    task.options    = (shaderc_compile_options_t)m_usedSetupIF->getShadercCompileOption(s_shadercCompiler);
+    if(!task.options)
     {
-      std::lock_guard<std::mutex> guard(s_shadercCompilerMutex);
-      shaderc_shader_kind shaderkind = (shaderc_shader_kind)m_usedSetupIF->getTypeShadercKind(definition.type);
-      shaderc_compile_options_t options = (shaderc_compile_options_t)m_usedSetupIF->getShadercCompileOption(s_shadercCompiler);
-      if(!options)
+      uint32_t envVersion = 0;
+      if(m_apiMajor == 1 && m_apiMinor == 0)
       {
-        if(m_apiMajor == 1 && m_apiMinor == 0)
-        {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
-        }
-        else if(m_apiMajor == 1 && m_apiMinor == 1)
-        {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
-        }
-        else if(m_apiMajor == 1 && m_apiMinor == 2)
-        {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
-        }
+        envVersion = shaderc_env_version_vulkan_1_0;
+      }
+      else if(m_apiMajor == 1 && m_apiMinor == 1)
+      {
+        envVersion = shaderc_env_version_vulkan_1_1;
+      }
+      else if(m_apiMajor == 1 && m_apiMinor == 2)
+      {
+        envVersion = shaderc_env_version_vulkan_1_2;
+      }
+      if(envVersion)
+      {
+        shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, envVersion);
+      }
 
-        shaderc_compile_options_set_optimization_level(m_shadercOptions, m_shadercOptimizationLevel);
+      shaderc_compile_options_set_optimization_level(m_shadercOptions, m_shadercOptimizationLevel);
 
-        // Keep debug info, doesn't cost shader execution perf, only compile-time and memory size.
-        // Improves usage for debugging tools, not recommended for shipping application,
-        // but good for developmenent builds.
-        shaderc_compile_options_set_generate_debug_info(m_shadercOptions);
+      // Keep debug info, doesn't cost shader execution perf, only compile-time and memory size.
+      // Improves usage for debugging tools, not recommended for shipping application,
+      // but good for developmenent builds.
+      shaderc_compile_options_set_generate_debug_info(m_shadercOptions);
 
-        options = m_shadercOptions;
+      task.options = m_shadercOptions;
+
+      // Custom options are opaque, so only the default ones can be part of the key.
+      // The source filename is part of the debug info, and the base of relative includes.
+      if(!m_spirvCacheDirectory.empty())
+      {
+        unsigned int spvVersion  = 0;
+        unsigned int spvRevision = 0;
+        shaderc_get_spv_version(&spvVersion, &spvRevision);
+
+        SPIRVCacheSource source;
+        source.add(SPIRV_CACHE_MAGIC, sizeof(SPIRV_CACHE_MAGIC));
+        source.add(uint32_t(spvVersion));
+        source.add(uint32_t(spvRevision));
+        source.add(envVersion);
+        source.add(uint32_t(m_shadercOptimizationLevel));
+        source.add(task.shaderKind);
+        source.add(definition.filenameFound);
+        source.add(definition.content);
+
+        task.useCache = true;
+        source.hash(task.cacheKey);
+        task.cacheSource = std::move(source.data);
       }
+    }
+  }
+#endif
 
-      // Tell shaderc to use this class (really our base class, nvh::ShaderFileManager) to load include files.
-      ShadercIncludeBridge shadercIncludeBridge(this);
-      shadercIncludeBridge.setAsIncluder(options);
+  return true;
+}
 
-      // Note: need filenameFound, not filename, so that relative includes work.
-      result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
-                                        shaderkind, definition.filenameFound.c_str(), "main", options);
+void ShaderModuleManager::compileShaderModule(CompileTask& task)
+{
+  const Definition& definition = task.module->definition;
 
-      if(!result)
+#if NVP_SUPPORTS_SHADERC
+  if(definition.filetype == FILETYPE_GLSL)
+  {
+    if(task.useCache)
+    {
+      if(loadCachedSPIRV(task))
       {
-        return false;
+        m_spirvCacheHits++;
+        task.compiled = true;
+        return;
       }
+      m_spirvCacheMisses++;
+    }
 
-      if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
-      {
-        bool failedToOptimize = strstr(shaderc_result_get_error_message(result), "failed to optimize");
-        int  level            = failedToOptimize ? LOGLEVEL_WARNING : LOGLEVEL_ERROR;
-        nvprintfLevel(level, "%s: optimization_level_performance\n", definition.filename.c_str());
-        nvprintfLevel(level, "  %s\n", definition.prepend.c_str());
-        nvprintfLevel(level, "  %s\n", shaderc_result_get_error_message(result));
-        shaderc_result_release(result);
-
-        if(!failedToOptimize || options != m_shadercOptions)
-        {
-          return false;
-        }
+    // The options are cloned so that every compilation has its own includer,
+    // the compiler itself can be used from several threads.
+    shaderc_compile_options_t options = shaderc_compile_options_clone(task.options);
 
+    ShadercIncludeBridge shadercIncludeBridge(this, &task.dependencies);
+    shadercIncludeBridge.setAsIncluder(options);
+
+    const shaderc_shader_kind shaderkind = (shaderc_shader_kind)task.shaderKind;
+
+    // Note: need filenameFound, not filename, so that relative includes work.
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
+                                                                   shaderkind, definition.filenameFound.c_str(), "main", options);
+
+    if(result && shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+    {
+      bool failedToOptimize = strstr(shaderc_result_get_error_message(result), "failed to optimize");
+      int  level            = failedToOptimize ? LOGLEVEL_WARNING : LOGLEVEL_ERROR;
+      nvprintfLevel(level, "%s: optimization_level_performance\n", definition.filename.c_str());
+      nvprintfLevel(level, "  %s\n", definition.prepend.c_str());
+      nvprintfLevel(level, "  %s\n", shaderc_result_get_error_message(result));
+      shaderc_result_release(result);
+      result = nullptr;
+
+      if(failedToOptimize && task.options == m_shadercOptions)
+      {
         // try again without optimization
-        shaderc_compile_options_set_optimization_level(m_shadercOptions, shaderc_optimization_level_zero);
+        shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_zero);
 
+        task.dependencies.clear();
         result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
-                                          shaderkind, definition.filename.c_str(), "main", options);
+                                          shaderkind, definition.filenameFound.c_str(), "main", options);
+
+        if(result && shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+        {
+          LOGE("%s: optimization_level_zero\n", definition.filename.c_str());
+          LOGE("  %s\n", definition.prepend.c_str());
+          LOGE("  %s\n", shaderc_result_get_error_message(result));
+          shaderc_result_release(result);
+          result = nullptr;
+        }
       }
+    }
 
-      if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+    if(result)
+    {
+      task.spirv.assign(shaderc_result_get_bytes(result), shaderc_result_get_length(result));
+      task.compiled = true;
+      shaderc_result_release(result);
+
+      if(task.useCache)
       {
-        LOGE("%s: optimization_level_zero\n", definition.filename.c_str());
-        LOGE("  %s\n", definition.prepend.c_str());
-        LOGE("  %s\n", shaderc_result_get_error_message(result));
-        shaderc_result_release(result);
-        return false;
+        storeCachedSPIRV(task);
       }
-
-      shaderModuleInfo.codeSize = shaderc_result_get_length(result);
-      shaderModuleInfo.pCode    = (const uint32_t*)shaderc_result_get_bytes(result);
     }
-    else
+
+    shaderc_compile_options_release(options);
+  }
+  else
 #else
-    if(definition.filetype == FILETYPE_GLSL)
+  if(definition.filetype == FILETYPE_GLSL)
+  {
+    LOGW("No direct GLSL support\n");
+  }
+  else
+#endif
+  {
+    task.compiled = true;
+  }
+}
+
+bool ShaderModuleManager::finishShaderModule(CompileTask& task)
+{
+  ShaderModule& module     = *task.module;
+  Definition&   definition = module.definition;
+
+#if NVP_SUPPORTS_SHADERC
+  // also for failed compilations, so that fixing an include is detected
+  definition.dependencies.insert(definition.dependencies.end(), task.dependencies.begin(), task.dependencies.end());
+  removeDuplicateDependencies(definition.dependencies);
+#endif
+
+  if(!task.compiled)
+  {
+    return false;
+  }
+
+  VkShaderModuleCreateInfo shaderModuleInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  if(definition.filetype == FILETYPE_GLSL)
+  {
+    shaderModuleInfo.codeSize = task.spirv.size();
+    shaderModuleInfo.pCode    = (const uint32_t*)task.spirv.data();
+  }
+  else
+  {
+    shaderModuleInfo.codeSize = definition.content.size();
+    shaderModuleInfo.pCode    = (const uint32_t*)definition.content.c_str();
+  }
+
+  VkResult vkresult = ::vkCreateShaderModule(m_device, &shaderModuleInfo, nullptr, &module.module);
+
+  if(vkresult == VK_SUCCESS && m_keepModuleSPIRV)
+  {
+    module.moduleSPIRV = std::string((const char*)shaderModuleInfo.pCode, shaderModuleInfo.codeSize);
+  }
+
+  return vkresult == VK_SUCCESS;
+}
+
+bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
+{
+  CompileTask task;
+  if(!prepareShaderModule(module, task))
+  {
+    return module.module == PREPROCESS_ONLY_MODULE;
+  }
+  compileShaderModule(task);
+  return finishShaderModule(task);
+}
+
+void ShaderModuleManager::setupShaderModules(const std::vector<ShaderModule*>& modules, const std::vector<bool>& preprocessOnly)
+{
+  std::vector<CompileTask> tasks(modules.size());
+  std::vector<size_t>      compiling;
+
+  bool old = m_preprocessOnly;
+  for(size_t i = 0; i < modules.size(); i++)
+  {
+    m_preprocessOnly = preprocessOnly.empty() ? old : preprocessOnly[i];
+    if(prepareShaderModule(*modules[i], tasks[i]))
+    {
+      compiling.push_back(i);
+    }
+  }
+  m_preprocessOnly = old;
+
+  auto compileRange = [&](size_t begin, size_t end, uint32_t) {
+    for(size_t i = begin; i < end; i++)
+    {
+      compileShaderModule(tasks[compiling[i]]);
+    }
+  };
+
+  if(compiling.size() > 1)
+  {
+    nvh::JobSystem  localJobSystem;
+    nvh::JobSystem* jobSystem = m_jobSystem;
+    if(!jobSystem)
+    {
+      localJobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+      jobSystem = &localJobSystem;
+    }
+    jobSystem->parallelFor(0, compiling.size(), compileRange, 1);
+  }
+  else
+  {
+    compileRange(0, compiling.size(), 0);
+  }
+
+  for(size_t i : compiling)
+  {
+    finishShaderModule(tasks[i]);
+  }
+}
+
+bool ShaderModuleManager::loadCachedSPIRV(CompileTask& task)
+{
+#if NVP_SUPPORTS_SHADERC
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx%016llx", (unsigned long long)task.cacheKey[0], (unsigned long long)task.cacheKey[1]);
+  std::string data = nvh::loadFile(m_spirvCacheDirectory + name + SPIRV_CACHE_EXTENSION, true);
+
+  // header: magic, key, number of dependencies, spirv size,
+  // followed by the key's source, the dependencies and the spirv
+  if(data.size() < SPIRV_CACHE_HEADER_SIZE || memcmp(data.data(), SPIRV_CACHE_MAGIC, sizeof(SPIRV_CACHE_MAGIC)) != 0)
+  {
+    return false;
+  }
+
+  size_t offset  = sizeof(SPIRV_CACHE_MAGIC);
+  auto   readRaw = [&](void* dst, size_t size) {
+    if(offset + size > data.size())
     {
-      LOGW("No direct GLSL support\n");
       return false;
     }
-    else
-#endif
+    memcpy(dst, data.data() + offset, size);
+    offset += size;
+    return true;
+  };
+  auto readString = [&](std::string& str) {
+    uint32_t size = 0;
+    if(!readRaw(&size, sizeof(size)) || offset + size > data.size())
     {
-      shaderModuleInfo.codeSize = definition.content.size();
-      shaderModuleInfo.pCode    = (const uint32_t*)definition.content.c_str();
+      return false;
     }
+    str.assign(data.data() + offset, size);
+    offset += size;
+    return true;
+  };
 
-    vkresult = ::vkCreateShaderModule(m_device, &shaderModuleInfo, nullptr, &module.module);
+  uint64_t key[2];
+  uint32_t numDependencies;
+  uint32_t spirvSize;
+  readRaw(key, sizeof(key));
+  readRaw(&numDependencies, sizeof(numDependencies));
+  readRaw(&spirvSize, sizeof(spirvSize));
+  if(key[0] != task.cacheKey[0] || key[1] != task.cacheKey[1])
+  {
+    return false;
+  }
+
+  // don't trust the hash, a collision would silently use the wrong module
+  std::string source;
+  if(!readString(source) || source != task.cacheSource)
+  {
+    return false;
+  }
 
-    if(vkresult == VK_SUCCESS && m_keepModuleSPIRV)
+  std::vector<FileDependency> dependencies(numDependencies);
+  for(FileDependency& dependency : dependencies)
+  {
+    uint32_t relative = 0;
+    if(!readRaw(&relative, sizeof(relative)) || !readString(dependency.name)
+       || !readString(dependency.requestingSource) || !readString(dependency.filenameFound)
+       || !readRaw(&dependency.contentHash, sizeof(dependency.contentHash)))
     {
-      module.moduleSPIRV = std::string((const char*)shaderModuleInfo.pCode, shaderModuleInfo.codeSize);
+      return false;
     }
+    dependency.relative = relative != 0;
+  }
 
-#if NVP_SUPPORTS_SHADERC
-    if(result)
+  if(offset + spirvSize != data.size())
+  {
+    return false;
+  }
+
+  // the entry is only valid if all includes still resolve to the same files and content
+  if(!dependencies.empty())
+  {
+    std::lock_guard<std::mutex> lock(m_includeMutex);
+    if(haveDependenciesChanged(dependencies))
     {
-      shaderc_result_release(result);
+      return false;
     }
+  }
+
+  task.spirv.assign(data.data() + offset, spirvSize);
+  task.dependencies = std::move(dependencies);
+  return true;
+#else
+  return false;
 #endif
+}
 
-    return vkresult == VK_SUCCESS;
+void ShaderModuleManager::storeCachedSPIRV(CompileTask& task)
+{
+#if NVP_SUPPORTS_SHADERC
+  // files can be included several times
+  removeDuplicateDependencies(task.dependencies);
+
+  std::string data;
+  auto        writeRaw    = [&](const void* src, size_t size) { data.append((const char*)src, size); };
+  auto        writeString = [&](const std::string& str) {
+    uint32_t size = uint32_t(str.size());
+    writeRaw(&size, sizeof(size));
+    data.append(str);
+  };
+
+  uint32_t numDependencies = uint32_t(task.dependencies.size());
+  uint32_t spirvSize       = uint32_t(task.spirv.size());
+  writeRaw(SPIRV_CACHE_MAGIC, sizeof(SPIRV_CACHE_MAGIC));
+  writeRaw(task.cacheKey, sizeof(task.cacheKey));
+  writeRaw(&numDependencies, sizeof(numDependencies));
+  writeRaw(&spirvSize, sizeof(spirvSize));
+  writeString(task.cacheSource);
+  for(const FileDependency& dependency : task.dependencies)
+  {
+    uint32_t relative = dependency.relative ? 1 : 0;
+    writeRaw(&relative, sizeof(relative));
+    writeString(dependency.name);
+    writeString(dependency.requestingSource);
+    writeString(dependency.filenameFound);
+    writeRaw(&dependency.contentHash, sizeof(dependency.contentHash));
+  }
+  data.append(task.spirv);
+
+  // write to a temporary file first, so that other threads or processes never see partial entries
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx%016llx", (unsigned long long)task.cacheKey[0], (unsigned long long)task.cacheKey[1]);
+  std::string filename = m_spirvCacheDirectory + name + SPIRV_CACHE_EXTENSION;
+  std::string tempname = filename + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()))
+                         + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+
+  FILE* f = fopen(tempname.c_str(), "wb");
+  if(!f)
+  {
+    LOGW("could not write SPIR-V cache entry %s\n", tempname.c_str());
+    return;
   }
+  bool written = fwrite(data.data(), data.size(), 1, f) == 1;
+  written      = (fclose(f) == 0) && written;
+
+  if(!written || rename(tempname.c_str(), filename.c_str()) != 0)
+  {
+    // another process may have written the same entry in the meantime
+    remove(filename.c_str());
+    if(!written || rename(tempname.c_str(), filename.c_str()) != 0)
+    {
+      remove(tempname.c_str());
+    }
+  }
+#endif
 }
 
 void ShaderModuleManager::init(VkDevice device, int apiMajor, int apiMinor)
@@ -381,12 +732,20 @@ void ShaderModuleManager::deinit()
 }
 
 ShaderModuleID ShaderModuleManager::createShaderModule(const Definition& definition)
+{
+  ShaderModuleID id = allocateShaderModule(definition);
+
+  beginFileScan();
+  setupShaderModule(m_shadermodules[id]);
+
+  return id;
+}
+
+ShaderModuleID ShaderModuleManager::allocateShaderModule(const Definition& definition)
 {
   ShaderModule module;
   module.definition = definition;
 
-  setupShaderModule(module);
-
   // find unused
   for(size_t i = 0; i < m_shadermodules.size(); i++)
   {
@@ -401,6 +760,24 @@ ShaderModuleID ShaderModuleManager::createShaderModule(const Definition& definit
   return m_shadermodules.size() - 1;
 }
 
+void ShaderModuleManager::createShaderModules(size_t count, const Definition* definitions, ShaderModuleID* ids)
+{
+  // allocate all first, so the module pointers stay valid
+  for(size_t i = 0; i < count; i++)
+  {
+    ids[i] = allocateShaderModule(definitions[i]);
+  }
+
+  std::vector<ShaderModule*> modules(count);
+  for(size_t i = 0; i < count; i++)
+  {
+    modules[i] = &m_shadermodules[ids[i]];
+  }
+
+  beginFileScan();
+  setupShaderModules(modules, {});
+}
+
 ShaderModuleID ShaderModuleManager::createShaderModule(uint32_t           type,
                                                        std::string const& filename,
                                                        std::string const& prepend,
@@ -451,6 +828,7 @@ void ShaderModuleManager::reloadModule(ShaderModuleID idx)
   }
   if(module.definition.type != 0)
   {
+    beginFileScan();
     setupShaderModule(module);
   }
 
@@ -461,12 +839,53 @@ void ShaderModuleManager::reloadShaderModules()
 {
   LOGI("Reloading programs...\n");
 
+  beginFileScan();
+  reloadShaderModules(false);
+
+  LOGI("done\n");
+}
+
+size_t ShaderModuleManager::reloadChangedShaderModules()
+{
+  beginFileScan();
+  size_t reloaded = reloadShaderModules(true);
+
+  if(reloaded)
+  {
+    LOGI("Reloaded %d changed programs\n", int(reloaded));
+  }
+
+  return reloaded;
+}
+
+size_t ShaderModuleManager::reloadShaderModules(bool onlyChanged)
+{
+  std::vector<ShaderModule*> modules;
+  std::vector<bool>          preprocessOnly;
   for(size_t i = 0; i < m_shadermodules.size(); i++)
   {
-    reloadModule((ShaderModuleID)i);
+    if(!isValid(i))
+      continue;
+
+    ShaderModule& module = getShaderModule(i);
+    if(onlyChanged && (module.definition.type == 0 || !haveDependenciesChanged(module.definition.dependencies)))
+      continue;
+
+    if(module.module && module.module != PREPROCESS_ONLY_MODULE)
+    {
+      vkDestroyShaderModule(m_device, module.module, nullptr);
+    }
+    if(module.definition.type != 0)
+    {
+      preprocessOnly.push_back(module.module == PREPROCESS_ONLY_MODULE);
+      modules.push_back(&module);
+    }
+    module.module = nullptr;
   }
 
-  LOGI("done\n");
+  setupShaderModules(modules, preprocessOnly);
+
+  return modules.size();
 }
 
 bool ShaderModuleManager::isValid(ShaderModuleID idx) const
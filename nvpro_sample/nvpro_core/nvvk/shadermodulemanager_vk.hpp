@@ -21,6 +21,7 @@
 #ifndef NV_SHADERMODULEMANAGER_INCLUDED
 #define NV_SHADERMODULEMANAGER_INCLUDED
 
+#include <atomic>
 #include <mutex>
 #include <stdio.h>
 #include <string>
@@ -35,6 +36,9 @@
 
 #include <nvh/shaderfilemanager.hpp>
 
+namespace nvh {
+class JobSystem;
+}
 
 namespace nvvk {
 
@@ -74,6 +78,35 @@ namespace nvvk {
   // ... later use module
   info.module = mgr.get(vid);
   \endcode
+
+  GLSL compilation results can be cached on disk with setSPIRVCacheDirectory.
+  Entries are keyed on the preprocessed source (including all prepends),
+  the shader stage and the compile options, which are stored in the entry
+  and compared on load, so hash collisions can't return a wrong module.
+  Entries also record every file shaderc included together with a hash of
+  its content. An entry is only used when
+  all of these includes still resolve to the same content, so editing an
+  include invalidates all modules using it. Modules found in the cache
+  do not invoke shaderc at all.
+
+  createShaderModules and reloadShaderModules compile several modules at
+  once, cache misses are compiled in parallel on the nvh::JobSystem provided
+  with setJobSystem (or a temporary one).
+
+  reloadChangedShaderModules only reloads the modules for which any of the
+  files they were loaded from (includes as well) changed, changes to
+  m_prepend or other state still require reloadShaderModules.
+
+  \code{.cpp}
+  mgr.setSPIRVCacheDirectory("spv_cache");  // must exist
+
+  nvvk::ShaderModuleManager::Definition defs[] = {
+      {VK_SHADER_STAGE_VERTEX_BIT, "object.vert.glsl"},
+      {VK_SHADER_STAGE_FRAGMENT_BIT, "object.frag.glsl"},
+  };
+  nvvk::ShaderModuleID ids[2];
+  mgr.createShaderModules(2, defs, ids);
+  \endcode
 */
 
 class ShaderModuleID
@@ -130,17 +163,33 @@ public:
                                     FileType           fileType  = FILETYPE_DEFAULT,
                                     std::string const& entryname = "main");
 
+  // creates count modules, compiling them in parallel
+  void createShaderModules(size_t count, const Definition* definitions, ShaderModuleID* ids);
+
   void destroyShaderModule(ShaderModuleID idx);
   void reloadModule(ShaderModuleID idx);
 
-  void reloadShaderModules();
-  void deleteShaderModules();
-  bool areShaderModulesValid();
+  void   reloadShaderModules();
+  // only reloads modules for which any of the files they were loaded from changed,
+  // returns the number of reloaded modules
+  size_t reloadChangedShaderModules();
+  void   deleteShaderModules();
+  bool   areShaderModulesValid();
 
 #if NVP_SUPPORTS_SHADERC
   void setOptimizationLevel(shaderc_optimization_level level) { m_shadercOptimizationLevel = level; }
 #endif
 
+  // directory for cached SPIR-V of GLSL modules, empty disables the cache (default)
+  void               setSPIRVCacheDirectory(const std::string& directory) { m_spirvCacheDirectory = directory; }
+  const std::string& getSPIRVCacheDirectory() const { return m_spirvCacheDirectory; }
+  uint32_t           getSPIRVCacheHits() const { return m_spirvCacheHits; }
+  uint32_t           getSPIRVCacheMisses() const { return m_spirvCacheMisses; }
+
+  // optional, used to compile modules in parallel,
+  // without it a temporary one is created when several modules are compiled
+  void setJobSystem(nvh::JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+
 
   bool                isValid(ShaderModuleID idx) const;
   VkShaderModule      get(ShaderModuleID idx) const;
@@ -232,9 +281,35 @@ public:
   friend class ShadercIncludeBridge;
 
 private:
+  struct CompileTask;
+
   ShaderModuleID createShaderModule(const Definition& def);
+  ShaderModuleID allocateShaderModule(const Definition& def);
   bool           setupShaderModule(ShaderModule& prog);
 
+  // setupShaderModule is split in three phases, so that the compilation of
+  // several modules can run in parallel:
+  // prepare loads the source (not thread-safe), returns false if nothing needs to be compiled
+  bool prepareShaderModule(ShaderModule& module, CompileTask& task);
+  // compile is thread-safe
+  void compileShaderModule(CompileTask& task);
+  // finish creates the VkShaderModule
+  bool finishShaderModule(CompileTask& task);
+  // preprocessOnly is per module, empty uses m_preprocessOnly for all
+  void setupShaderModules(const std::vector<ShaderModule*>& modules, const std::vector<bool>& preprocessOnly);
+
+  // resolves an include for shaderc, lock m_includeMutex
+  std::string resolveInclude(std::string const&           requestedSource,
+                             bool                         relative,
+                             std::string const&           requestingSource,
+                             std::string&                 filenameFound,
+                             std::vector<FileDependency>* dependencies);
+  // returns the number of reloaded modules
+  size_t reloadShaderModules(bool onlyChanged);
+
+  bool loadCachedSPIRV(CompileTask& task);
+  void storeCachedSPIRV(CompileTask& task);
+
 
   struct DefaultInterface : public SetupInterface
   {
@@ -252,9 +327,18 @@ private:
   int m_apiMajor = 1;
   int m_apiMinor = 1;
 
+  nvh::JobSystem* m_jobSystem = nullptr;
+
+  // ShaderFileManager is not thread-safe, parallel compilations lock this to resolve includes
+  std::mutex m_includeMutex;
+
+  std::string           m_spirvCacheDirectory;
+  std::atomic<uint32_t> m_spirvCacheHits{0};
+  std::atomic<uint32_t> m_spirvCacheMisses{0};
+
 #if NVP_SUPPORTS_SHADERC
   static uint32_t            s_shadercCompilerUsers;
-  static shaderc_compiler_t  s_shadercCompiler;  // Lock mutex below while using.
+  static shaderc_compiler_t  s_shadercCompiler;  // Lock mutex below while creating or releasing, compiling is thread-safe.
   static std::mutex          s_shadercCompilerMutex;
   shaderc_compile_options_t  m_shadercOptions           = nullptr;
   shaderc_optimization_level m_shadercOptimizationLevel = shaderc_optimization_level_performance;
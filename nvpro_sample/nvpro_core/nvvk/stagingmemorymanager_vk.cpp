@@ -19,6 +19,8 @@
 
 #include <nvvk/stagingmemorymanager_vk.hpp>
 
+#include <algorithm>
+
 #include <nvh/nvprint.hpp>
 #include <nvvk/debug_util_vk.hpp>
 #include <nvvk/error_vk.hpp>
@@ -47,6 +49,9 @@ void StagingMemoryManager::deinit()
   if(!m_device)
     return;
 
+  deinitRings();
+  m_ringMode = false;
+
   free(false);
 
   m_subFromDevice.deinit();
@@ -58,9 +63,241 @@ void StagingMemoryManager::deinit()
 
 bool StagingMemoryManager::fitsInAllocated(VkDeviceSize size, bool toDevice /*= true*/) const
 {
+  if(m_ringMode && fitsInRing(m_rings[toDevice ? 0 : 1], size))
+    return true;
+
   return toDevice ? m_subToDevice.fitsInAllocated(size) : m_subFromDevice.fitsInAllocated(size);
 }
 
+void StagingMemoryManager::setRingMode(bool enabled, VkDeviceSize toDeviceSize, VkDeviceSize fromDeviceSize)
+{
+  assert(m_device);
+  assert(!hasPendingCopies() && "cmdFlush missing");
+  assert(m_ringFrames.empty() && !m_sets[m_stagingIndex].usesRing && "ring still in use");
+
+  deinitRings();
+  m_ringMode = enabled;
+  if(enabled)
+  {
+    initRings(toDeviceSize, fromDeviceSize);
+  }
+}
+
+void StagingMemoryManager::initRings(VkDeviceSize toDeviceSize, VkDeviceSize fromDeviceSize)
+{
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    VkDeviceSize size = i == 0 ? toDeviceSize : fromDeviceSize;
+    if(!size)
+      continue;
+
+    BufferSubAllocator& sub  = i == 0 ? m_subToDevice : m_subFromDevice;
+    Ring&               ring = m_rings[i];
+
+    ring.size   = (size + RING_ALIGNMENT - 1) & ~VkDeviceSize(RING_ALIGNMENT - 1);
+    ring.handle = sub.subAllocate(ring.size);
+    assert(ring.handle);
+
+    BufferSubAllocator::Binding info = sub.getSubBinding(ring.handle);
+    ring.buffer                      = info.buffer;
+    ring.offset                      = info.offset;
+    ring.mapping                     = (uint8_t*)sub.getSubMapping(ring.handle);
+    ring.head                        = 0;
+    ring.tail                        = 0;
+  }
+}
+
+void StagingMemoryManager::deinitRings()
+{
+  for(uint32_t i = 0; i < 2; i++)
+  {
+    if(m_rings[i].handle)
+    {
+      if(i == 0)
+      {
+        m_subToDevice.subFree(m_rings[i].handle);
+      }
+      else
+      {
+        m_subFromDevice.subFree(m_rings[i].handle);
+      }
+    }
+    m_rings[i] = Ring();
+  }
+
+  for(auto& itset : m_sets)
+  {
+    itset.usesRing  = false;
+    itset.ringFrame = ~uint64_t(0);
+  }
+
+  m_ringFrameFirst += m_ringFrames.size();
+  m_ringFrames.clear();
+  m_pendingCopies.clear();
+}
+
+bool StagingMemoryManager::fitsInRing(const Ring& ring, VkDeviceSize size) const
+{
+  if(!ring.mapping)
+    return false;
+
+  VkDeviceSize alignedSize = (size + RING_ALIGNMENT - 1) & ~VkDeviceSize(RING_ALIGNMENT - 1);
+  VkDeviceSize pos         = ring.head % ring.size;
+  // allocations never wrap, the remainder of the ring is skipped instead
+  VkDeviceSize padding = pos + alignedSize > ring.size ? ring.size - pos : 0;
+
+  return alignedSize <= ring.size && (ring.head + padding + alignedSize - ring.tail) <= ring.size;
+}
+
+void* StagingMemoryManager::getRingSpace(Ring& ring, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset)
+{
+  VkDeviceSize alignedSize = (size + RING_ALIGNMENT - 1) & ~VkDeviceSize(RING_ALIGNMENT - 1);
+  VkDeviceSize pos         = ring.head % ring.size;
+  if(pos + alignedSize > ring.size)
+  {
+    ring.head += ring.size - pos;
+    pos = 0;
+  }
+  ring.head += alignedSize;
+
+  buffer = ring.buffer;
+  offset = ring.offset + pos;
+
+  return ring.mapping + pos;
+}
+
+void StagingMemoryManager::finalizeRingFrame(StagingSet& set)
+{
+  if(!set.usesRing)
+    return;
+
+  set.ringFrame = m_ringFrameFirst + m_ringFrames.size();
+  m_ringFrames.push_back({{m_rings[0].head, m_rings[1].head}, false});
+}
+
+void StagingMemoryManager::releaseRingFrame(StagingSet& set)
+{
+  if(set.ringFrame == ~uint64_t(0))
+  {
+    // not finalized, everything up to the current heads can be recycled
+    // once the preceding frames are released
+    m_ringFrames.push_back({{m_rings[0].head, m_rings[1].head}, true});
+  }
+  else
+  {
+    assert(set.ringFrame >= m_ringFrameFirst && set.ringFrame < m_ringFrameFirst + m_ringFrames.size());
+    m_ringFrames[size_t(set.ringFrame - m_ringFrameFirst)].released = true;
+  }
+
+  while(!m_ringFrames.empty() && m_ringFrames.front().released)
+  {
+    m_rings[0].tail = m_ringFrames.front().end[0];
+    m_rings[1].tail = m_ringFrames.front().end[1];
+    m_ringFrames.pop_front();
+    m_ringFrameFirst++;
+  }
+
+  set.usesRing  = false;
+  set.ringFrame = ~uint64_t(0);
+}
+
+void StagingMemoryManager::appendCopy(VkCommandBuffer cmd, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region)
+{
+  PendingCopies* target = nullptr;
+  PendingCopies* unused = nullptr;
+
+  VkDeviceSize dstBegin = region.dstOffset;
+  VkDeviceSize dstEnd   = region.dstOffset + region.size;
+
+  for(auto& pending : m_pendingCopies)
+  {
+    if(!pending.cmd)
+    {
+      unused = unused ? unused : &pending;
+      continue;
+    }
+    if(pending.cmd != cmd || pending.dstBuffer != dstBuffer)
+      continue;
+
+    // regions within a vkCmdCopyBuffer must not overlap, and writes to the same
+    // destination range must stay in order, so record the older copies first
+    if(dstBegin < pending.dstEnd)
+    {
+      for(const auto& it : pending.regions)
+      {
+        if(dstBegin < it.dstOffset + it.size && it.dstOffset < dstEnd)
+        {
+          recordCopies(pending);
+          unused = unused ? unused : &pending;
+          break;
+        }
+      }
+    }
+
+    if(pending.cmd && pending.srcBuffer == srcBuffer)
+    {
+      target = &pending;
+    }
+  }
+
+  if(!target)
+  {
+    if(!unused)
+    {
+      m_pendingCopies.push_back({});
+      unused = &m_pendingCopies.back();
+    }
+    target            = unused;
+    target->cmd       = cmd;
+    target->srcBuffer = srcBuffer;
+    target->dstBuffer = dstBuffer;
+    target->dstEnd    = 0;
+  }
+
+  VkBufferCopy* last = target->regions.empty() ? nullptr : &target->regions.back();
+  if(last && last->srcOffset + last->size == region.srcOffset && last->dstOffset + last->size == region.dstOffset)
+  {
+    last->size += region.size;
+  }
+  else
+  {
+    target->regions.push_back(region);
+  }
+  target->dstEnd = std::max(target->dstEnd, dstEnd);
+}
+
+void StagingMemoryManager::recordCopies(PendingCopies& pending)
+{
+  vkCmdCopyBuffer(pending.cmd, pending.srcBuffer, pending.dstBuffer, uint32_t(pending.regions.size()), pending.regions.data());
+  m_stats.copyCommands++;
+  m_stats.copyRegions += uint32_t(pending.regions.size());
+
+  // keep the group for re-use
+  pending.cmd = VK_NULL_HANDLE;
+  pending.regions.clear();
+}
+
+bool StagingMemoryManager::hasPendingCopies() const
+{
+  for(const auto& pending : m_pendingCopies)
+  {
+    if(pending.cmd)
+      return true;
+  }
+  return false;
+}
+
+void StagingMemoryManager::cmdFlush(VkCommandBuffer cmd)
+{
+  for(auto& pending : m_pendingCopies)
+  {
+    if(pending.cmd == cmd)
+    {
+      recordCopies(pending);
+    }
+  }
+}
+
 void* StagingMemoryManager::cmdToImage(VkCommandBuffer                 cmd,
                                     VkImage                         image,
                                     const VkOffset3D&               offset,
@@ -94,6 +331,9 @@ void* StagingMemoryManager::cmdToImage(VkCommandBuffer                 cmd,
   cpy.imageExtent       = extent;
 
   vkCmdCopyBufferToImage(cmd, srcBuffer, image, layout, 1, &cpy);
+  m_stats.bytesToDevice += size;
+  m_stats.copyCommands++;
+  m_stats.copyRegions++;
 
   return data ? nullptr : mapping;
 }
@@ -122,7 +362,17 @@ void* StagingMemoryManager::cmdToBuffer(VkCommandBuffer cmd, VkBuffer buffer, Vk
   cpy.srcOffset = srcOffset;
   cpy.dstOffset = offset;
 
-  vkCmdCopyBuffer(cmd, srcBuffer, buffer, 1, &cpy);
+  m_stats.bytesToDevice += size;
+  if(m_ringMode)
+  {
+    appendCopy(cmd, srcBuffer, buffer, cpy);
+  }
+  else
+  {
+    vkCmdCopyBuffer(cmd, srcBuffer, buffer, 1, &cpy);
+    m_stats.copyCommands++;
+    m_stats.copyRegions++;
+  }
 
   return data ? nullptr : (void*)mapping;
 }
@@ -139,6 +389,9 @@ const void* StagingMemoryManager::cmdFromBuffer(VkCommandBuffer cmd, VkBuffer bu
   cpy.dstOffset = dstOffset;
 
   vkCmdCopyBuffer(cmd, buffer, dstBuffer, 1, &cpy);
+  m_stats.bytesFromDevice += size;
+  m_stats.copyCommands++;
+  m_stats.copyRegions++;
 
   return mapping;
 }
@@ -164,15 +417,21 @@ const void* StagingMemoryManager::cmdFromImage(VkCommandBuffer                 c
   cpy.imageExtent       = extent;
 
   vkCmdCopyImageToBuffer(cmd, image, layout, dstBuffer, 1, &cpy);
+  m_stats.bytesFromDevice += size;
+  m_stats.copyCommands++;
+  m_stats.copyRegions++;
 
   return mapping;
 }
 
 void StagingMemoryManager::finalizeResources(VkFence fence)
 {
-  if(m_sets[m_stagingIndex].entries.empty())
+  assert(!hasPendingCopies() && "cmdFlush missing");
+  if(m_sets[m_stagingIndex].isEmpty())
     return;
 
+  finalizeRingFrame(m_sets[m_stagingIndex]);
+
   m_sets[m_stagingIndex].fence     = fence;
   m_sets[m_stagingIndex].manualSet = false;
   m_stagingIndex                   = newStagingIndex();
@@ -182,9 +441,11 @@ StagingMemoryManager::SetID StagingMemoryManager::finalizeResourceSet()
 {
   SetID setID;
 
-  if(m_sets[m_stagingIndex].entries.empty())
+  if(m_sets[m_stagingIndex].isEmpty())
     return setID;
 
+  finalizeRingFrame(m_sets[m_stagingIndex]);
+
   setID.index = m_stagingIndex;
 
   m_sets[m_stagingIndex].fence     = nullptr;
@@ -198,6 +459,20 @@ void* StagingMemoryManager::getStagingSpace(VkDeviceSize size, VkBuffer& buffer,
 {
   assert(m_sets[m_stagingIndex].index == m_stagingIndex && "illegal index, did you forget finalizeResources");
 
+  if(m_ringMode)
+  {
+    Ring& ring = m_rings[toDevice ? 0 : 1];
+    if(fitsInRing(ring, size))
+    {
+      m_sets[m_stagingIndex].usesRing = true;
+      return getRingSpace(ring, size, buffer, offset);
+    }
+    else if(ring.mapping)
+    {
+      m_stats.ringFallbacks++;
+    }
+  }
+
   BufferSubAllocator::Handle handle = toDevice ? m_subToDevice.subAllocate(size) : m_subFromDevice.subAllocate(size);
   assert(handle);
 
@@ -233,6 +508,11 @@ void StagingMemoryManager::releaseResources(uint32_t stagingID)
   }
   set.entries.clear();
 
+  if(set.usesRing)
+  {
+    releaseRingFrame(set);
+  }
+
   // update the set.index with the current head of the free list
   // pop its old value
   m_freeStagingIndex = setIndexValue(set.index, m_freeStagingIndex);
@@ -242,7 +522,7 @@ void StagingMemoryManager::releaseResources()
 {
   for(auto& itset : m_sets)
   {
-    if(!itset.entries.empty() && !itset.manualSet && (!itset.fence || vkGetFenceStatus(m_device, itset.fence) == VK_SUCCESS))
+    if(!itset.isEmpty() && !itset.manualSet && (!itset.fence || vkGetFenceStatus(m_device, itset.fence) == VK_SUCCESS))
     {
       releaseResources(itset.index);
       itset.fence     = NULL;
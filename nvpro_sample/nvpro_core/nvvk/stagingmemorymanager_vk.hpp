@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -28,6 +29,7 @@
 namespace nvvk {
 
 #define NVVK_DEFAULT_STAGING_BLOCKSIZE (VkDeviceSize(64) * 1024 * 1024)
+#define NVVK_DEFAULT_STAGING_RINGSIZE (VkDeviceSize(32) * 1024 * 1024)
 
 //////////////////////////////////////////////////////////////////
 /**
@@ -101,6 +103,31 @@ namespace nvvk {
   staging.releaseResourceSet(sid);
 
   \endcode
+
+  For per-frame streaming the frame-ring mode avoids the sub-allocation
+  churn. Staging space is taken from one persistently mapped ring per direction
+  and every finalize closes a frame within it. Frames are recycled in order
+  once released. Requests that do not fit into the ring fall back to the
+  regular sub-allocation.
+  In this mode cmdToBuffer only batches the copies, those with the same
+  source and destination buffer are recorded as a single vkCmdCopyBuffer.
+  cmdFlush must be called prior to recording commands that depend on them
+  (e.g. the barrier) and prior to ending the command buffer.
+
+  \code{.cpp}
+  staging.setRingMode(true);
+
+  // per frame
+  staging.cmdToBuffer(cmd, matrixBuffer, 0, matrixSize, matrices);
+  staging.cmdToBuffer(cmd, particleBuffer, 0, particleSize, particles);
+  staging.cmdFlush(cmd);
+  ... barrier, draw etc.
+  staging.finalizeResources(frameFence);
+  ... submit cmd with frameFence
+
+  // at the begin of the next frame
+  staging.releaseResources();
+  \endcode
 */
 
 class StagingMemoryManager
@@ -229,6 +256,27 @@ public:
 
   float getUtilization(VkDeviceSize& allocatedSize, VkDeviceSize& usedSize) const;
 
+  // enables the frame-ring mode, a size of 0 disables the ring for that direction
+  // must not be changed while staging resources are in use
+  void setRingMode(bool enabled, VkDeviceSize toDeviceSize = NVVK_DEFAULT_STAGING_RINGSIZE, VkDeviceSize fromDeviceSize = 0);
+  bool isRingMode() const { return m_ringMode; }
+
+  // records the batched buffer copies for this command buffer (frame-ring mode only)
+  void cmdFlush(VkCommandBuffer cmd);
+
+  struct Stats
+  {
+    uint64_t bytesToDevice   = 0;
+    uint64_t bytesFromDevice = 0;
+    uint32_t copyCommands    = 0;
+    uint32_t copyRegions     = 0;
+    // requests that did not fit into the ring
+    uint32_t ringFallbacks = 0;
+  };
+
+  const Stats& getStats() const { return m_stats; }
+  void         resetStats() { m_stats = Stats(); }
+
 protected:
   // The implementation uses two major arrays:
   // - Block stores VkBuffers that we sub-allocate the staging space from
@@ -252,7 +300,45 @@ protected:
     uint32_t                                index     = INVALID_ID_INDEX;
     VkFence                                 fence     = VK_NULL_HANDLE;
     bool                                    manualSet = false;
+    bool                                    usesRing  = false;
+    uint64_t                                ringFrame = ~uint64_t(0);
     std::vector<Entry> entries;
+
+    bool isEmpty() const { return entries.empty() && !usesRing; }
+  };
+
+  // In frame-ring mode every StagingSet that used ring space becomes a RingFrame
+  // when finalized. Frames are kept in submission order, the tail of a ring
+  // only advances over the leading frames that were released.
+
+  // same as the base alignment of BufferSubAllocator
+  static const uint32_t RING_ALIGNMENT = 16;
+
+  struct Ring
+  {
+    BufferSubAllocator::Handle handle;
+    VkBuffer                   buffer  = VK_NULL_HANDLE;
+    VkDeviceSize               offset  = 0;  // of the ring within buffer
+    VkDeviceSize               size    = 0;
+    uint8_t*                   mapping = nullptr;
+    // monotonic positions, modulo size yields the offset within the ring
+    uint64_t head = 0;
+    uint64_t tail = 0;
+  };
+
+  struct RingFrame
+  {
+    uint64_t end[2];
+    bool     released;
+  };
+
+  struct PendingCopies
+  {
+    VkCommandBuffer           cmd;
+    VkBuffer                  srcBuffer;
+    VkBuffer                  dstBuffer;
+    VkDeviceSize              dstEnd;  // max end of all regions
+    std::vector<VkBufferCopy> regions;
   };
 
   VkDevice            m_device         = VK_NULL_HANDLE;
@@ -262,6 +348,14 @@ protected:
 
   std::vector<StagingSet> m_sets;
 
+  bool                       m_ringMode = false;
+  Ring                       m_rings[2];  // to and from device
+  std::deque<RingFrame>      m_ringFrames;
+  uint64_t                   m_ringFrameFirst = 0;  // frame number of m_ringFrames.front()
+  std::vector<PendingCopies> m_pendingCopies;
+
+  Stats m_stats;
+
   // active staging Index, must be valid at all items
   uint32_t m_stagingIndex;
   // linked-list to next free staging set
@@ -281,6 +375,17 @@ protected:
   uint32_t newStagingIndex();
 
   void* getStagingSpace(VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset, bool toDevice);
+  void* getRingSpace(Ring& ring, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset);
+  bool  fitsInRing(const Ring& ring, VkDeviceSize size) const;
+
+  void appendCopy(VkCommandBuffer cmd, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region);
+  void recordCopies(PendingCopies& pending);
+
+  void initRings(VkDeviceSize toDeviceSize, VkDeviceSize fromDeviceSize);
+  void deinitRings();
+  void finalizeRingFrame(StagingSet& set);
+  void releaseRingFrame(StagingSet& set);
+  bool hasPendingCopies() const;
 
   void releaseResources(uint32_t stagingID);
 };
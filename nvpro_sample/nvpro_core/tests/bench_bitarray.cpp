@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Throughput of the nvh::BitArray bulk operations, counting, rank/select and
+// traversal on 16M-bit masks. The bulk operations are measured with the
+// scalar fallback and, if the CPU supports it, with AVX2.
+
+#include <nvh/bitarray.hpp>
+#include <nvh/cpufeatures.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+template <typename Fn>
+static double bestMs(Fn fn)
+{
+  double best = 1e30;
+  for(int run = 0; run < 10; run++)
+  {
+    Clock::time_point begin = Clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+  }
+  return best;
+}
+
+struct CountVisitor
+{
+  std::atomic<size_t> count{0};
+  void                operator()(size_t) { count++; }
+};
+
+struct LocalVisitor
+{
+  size_t count = 0;
+  void   operator()(size_t) { count++; }
+};
+
+int main()
+{
+  const size_t numBits = 16 * 1024 * 1024;
+  // bytes of one mask
+  const double bytes = double(numBits / 8);
+
+  nvh::JobSystem jobSystem;
+  jobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+
+  std::mt19937_64 rng(7);
+  nvh::BitArray   a(numBits);
+  nvh::BitArray   b(numBits);
+  for(size_t i = 0; i < numBits; i++)
+  {
+    uint64_t r = rng();
+    a.setBit(i, (r & 1) != 0);
+    // sparse mask, 1 in 64
+    b.setBit(i, ((r >> 1) & 63) == 0);
+  }
+  nvh::BitArray result(a);
+
+  printf("%u threads, %zu bits\n\n", jobSystem.getNumSlots(), numBits);
+
+  bool hasAVX2 = nvh::cpuSupportsAVX2();
+  for(int avx2 = 0; avx2 <= (hasAVX2 ? 1 : 0); avx2++)
+  {
+    nvh::cpuDisableAVX2(avx2 == 0);
+    const char* path = avx2 ? "avx2  " : "scalar";
+    // reads two masks, writes one
+    printf("and    %s %8.2f GB/s\n", path, bytes * 3 / bestMs([&] { result &= b; }) * 1e-6);
+    printf("or     %s %8.2f GB/s\n", path, bytes * 3 / bestMs([&] { result |= b; }) * 1e-6);
+    printf("xor    %s %8.2f GB/s\n", path, bytes * 3 / bestMs([&] { result ^= b; }) * 1e-6);
+    printf("andNot %s %8.2f GB/s\n", path, bytes * 3 / bestMs([&] { result.andNot(b); }) * 1e-6);
+  }
+  if(!hasAVX2)
+  {
+    printf("avx2 not supported by this CPU\n");
+  }
+  printf("\n");
+
+  size_t count = 0;
+  printf("countBits   %8.2f GB/s\n", bytes / bestMs([&] { count += a.countBits(); }) * 1e-6);
+  printf("setBits     %8.2f GB/s\n", bytes / bestMs([&] { result.setBits(1, numBits - 1, true); }) * 1e-6);
+
+  nvh::BitRankIndex rankIndex;
+  printf("rank build  %8.2f GB/s\n", bytes / bestMs([&] { rankIndex.build(a); }) * 1e-6);
+
+  const size_t          numQueries = 1 << 20;
+  std::vector<uint32_t> queries(numQueries);
+  for(auto& q : queries)
+  {
+    q = uint32_t(rng() % numBits);
+  }
+  printf("rank        %8.2f ns/query\n", bestMs([&] {
+           for(uint32_t q : queries)
+             count += rankIndex.rank(q);
+         }) * 1e6 / numQueries);
+  size_t numSet = rankIndex.getCount();
+  printf("select      %8.2f ns/query\n", bestMs([&] {
+           for(uint32_t q : queries)
+             count += rankIndex.select(q % numSet);
+         }) * 1e6 / numQueries);
+
+  // traversal costs are per set bit
+  size_t numSparse = b.countBits();
+  printf("traverse dense            %6.2f ns/bit\n", bestMs([&] {
+           LocalVisitor visitor;
+           a.traverseBits(std::ref(visitor));
+           count += visitor.count;
+         }) * 1e6 / numSet);
+  printf("traverse sparse           %6.2f ns/bit\n", bestMs([&] {
+           LocalVisitor visitor;
+           b.traverseBits(std::ref(visitor));
+           count += visitor.count;
+         }) * 1e6 / numSparse);
+  printf("traverse parallel sparse  %6.2f ns/bit\n", bestMs([&] {
+           CountVisitor visitor;
+           b.traverseBitsParallel(visitor, jobSystem);
+           count += visitor.count;
+         }) * 1e6 / numSparse);
+
+  return count == 0 ? 1 : 0;
+}
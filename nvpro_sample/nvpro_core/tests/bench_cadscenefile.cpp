@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Serial vs parallel loading of a synthetic .csf scene with one million node
+// parts, see CSFLoaderConfig::numThreads. The scene is saved next to the
+// executable's working directory, once plain and once as .csf.gz when zlib
+// is available. Every load is checked to produce identical content.
+
+#define CSF_IMPLEMENTATION
+#define CSF_SUPPORT_FILEMAPPING 1
+#include <fileformats/cadscenefile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const int NUM_GEOMETRIES   = 1000;
+static const int PARTS_PER_GEO    = 10;
+static const int VERTICES_PER_GEO = 256;
+static const int GROUPS           = 1000;
+static const int NODES_PER_GROUP  = 100;
+
+static int s_failed = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("FAILED: %s (line %d)\n", #cond, __LINE__);                                                                 \
+    s_failed++;                                                                                                        \
+  }
+
+struct Scene
+{
+  std::vector<CSFGeometry>     geometries;
+  std::vector<CSFGeometryPart> geometryParts;
+  std::vector<float>           vertices;
+  std::vector<float>           normals;
+  std::vector<unsigned int>    indices;
+  std::vector<CSFMaterial>     materials;
+  std::vector<CSFNode>         nodes;
+  std::vector<CSFNodePart>     nodeParts;
+  std::vector<int>             children;
+  CSFile                       csf;
+};
+
+static void buildScene(Scene& scene)
+{
+  const int numTris         = VERTICES_PER_GEO - 2;
+  const int indicesPerPart  = (numTris / PARTS_PER_GEO) * 3;
+  const int indicesPerGeo   = indicesPerPart * PARTS_PER_GEO;
+  const int numNodes        = 1 + GROUPS + GROUPS * NODES_PER_GROUP;
+  const int numNodeParts    = GROUPS * NODES_PER_GROUP * PARTS_PER_GEO;
+  const int numGroupParents = GROUPS + 1;
+
+  // all geometries share the same arrays, content only differs in the vertices
+  scene.vertices.resize(size_t(NUM_GEOMETRIES) * VERTICES_PER_GEO * 3);
+  scene.normals.resize(size_t(VERTICES_PER_GEO) * 3);
+  scene.indices.resize(indicesPerGeo);
+  scene.geometryParts.resize(PARTS_PER_GEO);
+  for(size_t i = 0; i < scene.vertices.size(); i++)
+  {
+    scene.vertices[i] = float(i % 1013) * 0.25f;
+  }
+  for(int v = 0; v < VERTICES_PER_GEO; v++)
+  {
+    scene.normals[v * 3 + 0] = 0.0f;
+    scene.normals[v * 3 + 1] = 0.0f;
+    scene.normals[v * 3 + 2] = 1.0f;
+  }
+  for(int t = 0; t < indicesPerGeo / 3; t++)
+  {
+    scene.indices[t * 3 + 0] = t;
+    scene.indices[t * 3 + 1] = t + 1;
+    scene.indices[t * 3 + 2] = t + 2;
+  }
+  for(int p = 0; p < PARTS_PER_GEO; p++)
+  {
+    CSFGeometryPart& part = scene.geometryParts[p];
+    memset(&part, 0, sizeof(part));
+    part.numIndexSolid = indicesPerPart;
+  }
+
+  scene.geometries.resize(NUM_GEOMETRIES);
+  for(int g = 0; g < NUM_GEOMETRIES; g++)
+  {
+    CSFGeometry& geo = scene.geometries[g];
+    memset(&geo, 0, sizeof(geo));
+    geo.numNormalChannels = 1;
+    geo.numParts          = PARTS_PER_GEO;
+    geo.numVertices       = VERTICES_PER_GEO;
+    geo.numIndexSolid     = indicesPerGeo;
+    geo.vertex            = scene.vertices.data() + size_t(g) * VERTICES_PER_GEO * 3;
+    geo.normal            = scene.normals.data();
+    geo.indexSolid        = scene.indices.data();
+    geo.parts             = scene.geometryParts.data();
+  }
+
+  scene.materials.resize(4);
+  for(int m = 0; m < 4; m++)
+  {
+    CSFMaterial& mtl = scene.materials[m];
+    memset(&mtl, 0, sizeof(mtl));
+    snprintf(mtl.name, sizeof(mtl.name), "material%d", m);
+    mtl.color[0] = float(m) / 4.0f;
+    mtl.color[3] = 1.0f;
+  }
+
+  // root -> groups -> leaf nodes, every leaf references a geometry
+  scene.nodes.resize(numNodes);
+  scene.nodeParts.resize(numNodeParts);
+  scene.children.resize(numNodes - 1);
+  for(int n = 0; n < numNodes; n++)
+  {
+    CSFNode& node = scene.nodes[n];
+    memset(&node, 0, sizeof(node));
+    CSFMatrix_identity(node.objectTM);
+    CSFMatrix_identity(node.worldTM);
+    node.objectTM[12] = float(n % 97);
+    node.worldTM[12]  = float(n % 89);
+    node.geometryIDX  = -1;
+  }
+  for(int i = 0; i < numNodes - 1; i++)
+  {
+    scene.children[i] = i + 1;
+  }
+  scene.nodes[0].numChildren = GROUPS;
+  scene.nodes[0].children    = scene.children.data();
+  for(int grp = 0; grp < GROUPS; grp++)
+  {
+    CSFNode& group    = scene.nodes[1 + grp];
+    group.numChildren = NODES_PER_GROUP;
+    group.children    = scene.children.data() + numGroupParents - 1 + grp * NODES_PER_GROUP;
+  }
+  for(int leaf = 0; leaf < GROUPS * NODES_PER_GROUP; leaf++)
+  {
+    CSFNode& node    = scene.nodes[numGroupParents + leaf];
+    node.geometryIDX = leaf % NUM_GEOMETRIES;
+    node.numParts    = PARTS_PER_GEO;
+    node.parts       = scene.nodeParts.data() + size_t(leaf) * PARTS_PER_GEO;
+    for(int p = 0; p < PARTS_PER_GEO; p++)
+    {
+      node.parts[p].active      = 1;
+      node.parts[p].materialIDX = (leaf + p) % 4;
+      node.parts[p].nodeIDX     = -1;
+    }
+  }
+
+  CSFile& csf = scene.csf;
+  memset(&csf, 0, sizeof(csf));
+  csf.fileFlags     = CADSCENEFILE_FLAG_UNIQUENODES;
+  csf.numGeometries = NUM_GEOMETRIES;
+  csf.numMaterials  = int(scene.materials.size());
+  csf.numNodes      = numNodes;
+  csf.rootIDX       = 0;
+  csf.geometries    = scene.geometries.data();
+  csf.materials     = scene.materials.data();
+  csf.nodes         = scene.nodes.data();
+}
+
+struct Hasher
+{
+  uint64_t value = 14695981039346656037ull;
+
+  void add(const void* data, size_t size)
+  {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < size; i++)
+    {
+      value = (value ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+  template <typename T>
+  void addValue(const T& v)
+  {
+    add(&v, sizeof(T));
+  }
+};
+
+static uint64_t hashContent(const CSFile* csf)
+{
+  Hasher hasher;
+  hasher.addValue(csf->numGeometries);
+  hasher.addValue(csf->numMaterials);
+  hasher.addValue(csf->numNodes);
+  hasher.addValue(csf->rootIDX);
+  for(int g = 0; g < csf->numGeometries; g++)
+  {
+    const CSFGeometry* geo = &csf->geometries[g];
+    hasher.addValue(geo->numParts);
+    hasher.addValue(geo->numVertices);
+    hasher.addValue(geo->numIndexSolid);
+    hasher.addValue(geo->numIndexWire);
+    hasher.add(geo->vertex, sizeof(float) * 3 * geo->numVertices);
+    hasher.add(CSFGeometry_getNormalChannel(geo, CSFGEOMETRY_NORMALCHANNEL_NORMAL), sizeof(float) * 3 * geo->numVertices);
+    hasher.add(geo->indexSolid, sizeof(unsigned int) * geo->numIndexSolid);
+    if(geo->numIndexWire)
+    {
+      hasher.add(geo->indexWire, sizeof(unsigned int) * geo->numIndexWire);
+    }
+    for(int p = 0; p < geo->numParts; p++)
+    {
+      hasher.addValue(geo->parts[p].numIndexSolid);
+      hasher.addValue(geo->parts[p].numIndexWire);
+    }
+  }
+  for(int m = 0; m < csf->numMaterials; m++)
+  {
+    hasher.add(csf->materials[m].name, sizeof(csf->materials[m].name));
+    hasher.add(csf->materials[m].color, sizeof(csf->materials[m].color));
+  }
+  for(int n = 0; n < csf->numNodes; n++)
+  {
+    const CSFNode* node = &csf->nodes[n];
+    hasher.add(node->objectTM, sizeof(node->objectTM));
+    hasher.add(node->worldTM, sizeof(node->worldTM));
+    hasher.addValue(node->geometryIDX);
+    hasher.addValue(node->numParts);
+    hasher.addValue(node->numChildren);
+    if(node->numParts)
+    {
+      hasher.add(node->parts, sizeof(CSFNodePart) * node->numParts);
+    }
+    if(node->numChildren)
+    {
+      hasher.add(node->children, sizeof(int) * node->numChildren);
+    }
+  }
+  return hasher.value;
+}
+
+static void benchLoad(const char* filename, int secondariesReadOnly, uint64_t expectedHash)
+{
+  int numThreadsHW = int(std::max(1u, std::thread::hardware_concurrency()));
+
+  // 1 is the serial path
+  std::vector<int> threadCounts = {1, 2, 4, numThreadsHW};
+  std::sort(threadCounts.begin(), threadCounts.end());
+  threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+  double serialMs = 0;
+  for(int numThreads : threadCounts)
+  {
+    double best = 1e30;
+    for(int run = 0; run < 5; run++)
+    {
+      CSFLoaderConfig config          = {0};
+      config.secondariesReadOnly      = secondariesReadOnly;
+      config.gltfFindUniqueGeometries = 0;
+      config.numThreads               = numThreads;
+
+      CSFileMemoryPTR mem = CSFileMemory_newCfg(&config);
+      CSFile*         csf = nullptr;
+
+      Clock::time_point begin  = Clock::now();
+      int               result = CSFile_loadExt(&csf, filename, mem);
+      double            ms     = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+      best                     = std::min(best, ms);
+
+      CHECK(result == CADSCENEFILE_NOERROR);
+      if(run == 0 && result == CADSCENEFILE_NOERROR)
+      {
+        CHECK(hashContent(csf) == expectedHash);
+      }
+      CSFileMemory_delete(mem);
+    }
+    if(numThreads == 1)
+    {
+      serialMs = best;
+    }
+    printf("%-26s %s threads %2d: %8.2f ms (%.2fx)\n", filename, secondariesReadOnly ? "mapped" : "copied", numThreads,
+           best, serialMs / best);
+  }
+}
+
+int main()
+{
+  Scene scene;
+  buildScene(scene);
+  uint64_t expectedHash = hashContent(&scene.csf);
+
+  printf("scene: %d geometries, %d nodes, %d node parts\n", scene.csf.numGeometries, scene.csf.numNodes,
+         int(scene.nodeParts.size()));
+
+  const char* filename = "bench_cadscenefile.csf";
+  CHECK(CSFile_save(&scene.csf, filename) == CADSCENEFILE_NOERROR);
+  benchLoad(filename, 0, expectedHash);
+  benchLoad(filename, 1, expectedHash);
+  remove(filename);
+
+#if CSF_SUPPORT_ZLIB
+  const char* filenameGZ = "bench_cadscenefile.csf.gz";
+  CHECK(CSFile_saveExt(&scene.csf, filenameGZ) == CADSCENEFILE_NOERROR);
+  benchLoad(filenameGZ, 0, expectedHash);
+  remove(filenameGZ);
+#endif
+
+  return s_failed ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Throughput of nvh::decodeAttribute for typical vertex attribute layouts,
+// compared against converting each component on its own, as getAttribute
+// did before. decodeAttribute is measured with the SSE path and, if the CPU
+// supports it, with AVX2.
+
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include "gltfdecodereference.hpp"
+
+#include <nvh/cpufeatures.hpp>
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct Layout
+{
+  const char* name;
+  int         componentType;
+  uint32_t    srcComponents;
+  uint32_t    dstComponents;
+  size_t      stride;
+  bool        normalized;
+};
+
+int main()
+{
+  const Layout layouts[] = {
+      {"float3 position, stride 12", TINYGLTF_COMPONENT_TYPE_FLOAT, 3, 3, 12, false},
+      {"float3 interleaved, stride 32", TINYGLTF_COMPONENT_TYPE_FLOAT, 3, 3, 32, false},
+      {"short3 position, stride 8", TINYGLTF_COMPONENT_TYPE_SHORT, 3, 3, 8, false},
+      {"ushort3 position, stride 8", TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 3, 3, 8, false},
+      {"byte3 normal normalized, stride 4", TINYGLTF_COMPONENT_TYPE_BYTE, 3, 3, 4, true},
+      {"byte4 tangent normalized, stride 4", TINYGLTF_COMPONENT_TYPE_BYTE, 4, 4, 4, true},
+      {"short4 tangent normalized, stride 8", TINYGLTF_COMPONENT_TYPE_SHORT, 4, 4, 8, true},
+      {"ushort2 uv normalized, stride 4", TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 2, 2, 4, true},
+      {"ubyte4 color normalized, stride 4", TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, 4, 4, 4, true},
+      {"ubyte3 color normalized to vec4", TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, 3, 4, 4, true},
+  };
+
+  const size_t numElements = 1 << 21;
+  std::mt19937 rng(1);
+
+  bool hasAVX2 = nvh::cpuSupportsAVX2();
+  printf("%-38s | per component Melem/s | SSE Melem/s | AVX2 Melem/s | speedup\n", "layout");
+
+  bool identical = true;
+  for(const Layout& layout : layouts)
+  {
+    std::vector<uint8_t> src(numElements * layout.stride);
+    for(auto& b : src)
+    {
+      // small values, so float sources are neither NaN nor denormal
+      b = uint8_t(rng() & 0x3f);
+    }
+    std::vector<float> expected(numElements * layout.dstComponents);
+    std::vector<float> decoded(numElements * layout.dstComponents);
+
+    // per component, SSE, AVX2
+    double best[3] = {1e9, 1e9, 1e9};
+    for(int repeat = 0; repeat < 5; repeat++)
+    {
+      Clock::time_point begin = Clock::now();
+      decodeAttributeReference(expected.data(), layout.dstComponents, src.data(), layout.stride, layout.srcComponents,
+                               layout.componentType, layout.normalized, numElements);
+      Clock::time_point end = Clock::now();
+      best[0]               = std::min(best[0], std::chrono::duration<double>(end - begin).count());
+
+      for(int avx2 = 0; avx2 <= (hasAVX2 ? 1 : 0); avx2++)
+      {
+        nvh::cpuDisableAVX2(avx2 == 0);
+        begin = Clock::now();
+        nvh::decodeAttribute(decoded.data(), layout.dstComponents, src.data(), layout.stride, layout.srcComponents,
+                             layout.componentType, layout.normalized, numElements);
+        end            = Clock::now();
+        best[1 + avx2] = std::min(best[1 + avx2], std::chrono::duration<double>(end - begin).count());
+        identical      = identical && expected == decoded;
+      }
+    }
+
+    double fastest = std::min(best[1], best[2]);
+    printf("%-38s | %21.1f | %11.1f | %12.1f | %7.1f\n", layout.name, numElements / best[0] / 1e6,
+           numElements / best[1] / 1e6, hasAVX2 ? numElements / best[2] / 1e6 : 0.0, best[0] / fastest);
+  }
+
+  if(!identical)
+  {
+    printf("results differ\n");
+  }
+  return identical ? 0 : 1;
+}
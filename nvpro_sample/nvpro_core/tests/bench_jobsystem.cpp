@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Scheduling overhead of nvh::JobSystem per task, compared against handing out
+// work under a shared lock, which is what the threaded renderers did before.
+
+#include <nvh/jobsystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double nsPer(Clock::time_point begin, Clock::time_point end, size_t count)
+{
+  return std::chrono::duration<double, std::nano>(end - begin).count() / double(count);
+}
+
+// dummy work, so the tasks are not entirely free
+static inline uint32_t work(size_t i, uint32_t spin)
+{
+  uint32_t v = uint32_t(i);
+  for(uint32_t s = 0; s < spin; s++)
+  {
+    v = v * 1664525u + 1013904223u;
+  }
+  return v;
+}
+
+// threads take batches from a shared counter protected by a mutex
+static double lockedCounter(uint32_t numThreads, size_t numItems, size_t grainSize, uint32_t spin, std::atomic_uint32_t& sink)
+{
+  std::mutex mutex;
+  size_t     next = 0;
+
+  auto runThread = [&]() {
+    uint32_t local = 0;
+    while(true)
+    {
+      size_t begin;
+      size_t end;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(next >= numItems)
+          break;
+        begin = next;
+        end   = std::min(numItems, next + grainSize);
+        next  = end;
+      }
+      for(size_t i = begin; i < end; i++)
+      {
+        local += work(i, spin);
+      }
+    }
+    sink += local;
+  };
+
+  Clock::time_point        begin = Clock::now();
+  std::vector<std::thread> threads;
+  for(uint32_t t = 1; t < numThreads; t++)
+  {
+    threads.emplace_back(runThread);
+  }
+  runThread();
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+  return nsPer(begin, Clock::now(), numItems);
+}
+
+int main()
+{
+  const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t   numTasks   = 200000;
+  const size_t   numItems   = 1 << 20;
+  const uint32_t spin       = 64;
+
+  std::atomic_uint32_t sink{0};
+
+  printf("threads | run ns/task | runAfter chain ns/task | parallelFor(1) ns/item | parallelFor(64) ns/item | locked counter(64) ns/item\n");
+
+  for(uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+  {
+    nvh::JobSystem jobs;
+    jobs.init(numThreads - 1);
+
+    // independent tasks, all enqueued by the external thread and stolen by the workers
+    Clock::time_point       begin = Clock::now();
+    nvh::JobSystem::Counter counter;
+    for(size_t i = 0; i < numTasks; i++)
+    {
+      jobs.run([&sink](uint32_t workerIndex) { sink += workerIndex; }, &counter);
+    }
+    jobs.wait(counter);
+    double runTime = nsPer(begin, Clock::now(), numTasks);
+
+    // dependencies, every task waits on the previous one
+    const size_t            numChain = 10000;
+    nvh::JobSystem::Counter chain[2];
+    begin = Clock::now();
+    jobs.run([](uint32_t) {}, &chain[0]);
+    for(size_t i = 1; i < numChain; i++)
+    {
+      jobs.runAfter(chain[(i - 1) % 2], [](uint32_t) {}, &chain[i % 2]);
+      jobs.wait(chain[(i - 1) % 2]);
+    }
+    jobs.wait(chain[(numChain - 1) % 2]);
+    double chainTime = nsPer(begin, Clock::now(), numChain);
+
+    std::vector<uint32_t> perWorker(jobs.getNumSlots() * 16, 0);
+    auto                  rangeFn = [&](size_t rangeBegin, size_t rangeEnd, uint32_t workerIndex) {
+      uint32_t local = 0;
+      for(size_t i = rangeBegin; i < rangeEnd; i++)
+      {
+        local += work(i, spin);
+      }
+      perWorker[workerIndex * 16] += local;
+    };
+
+    begin = Clock::now();
+    jobs.parallelFor(0, numTasks, rangeFn, 1);
+    double forTime1 = nsPer(begin, Clock::now(), numTasks);
+
+    begin = Clock::now();
+    jobs.parallelFor(0, numItems, rangeFn, 64);
+    double forTime64 = nsPer(begin, Clock::now(), numItems);
+
+    double lockedTime = lockedCounter(numThreads, numItems, 64, spin, sink);
+
+    for(uint32_t v : perWorker)
+    {
+      sink += v;
+    }
+
+    printf("%7u | %11.1f | %22.1f | %22.1f | %23.2f | %26.2f\n", numThreads, runTime, chainTime, forTime1, forTime64, lockedTime);
+
+    jobs.deinit();
+  }
+
+  return sink == 0xFFFFFFFF ? 1 : 0;
+}
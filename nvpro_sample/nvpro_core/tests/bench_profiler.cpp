@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Cost of a recurring nvh::Profiler section on a thread other than the
+// frame thread, next to the cost of the raw timestamps it takes. Also checks
+// that the sections of all threads reach the stats.
+
+#include <nvh/profiler.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+int main()
+{
+  const size_t numSections = 1000000;
+
+  nvh::Profiler profiler;
+
+  double sectionNs = 0;
+  double clockNs   = 0;
+  std::thread([&]() {
+    Clock::time_point begin = Clock::now();
+    for(size_t i = 0; i < numSections; i++)
+    {
+      nvh::Profiler::Section section(profiler, "Bench");
+    }
+    Clock::time_point end = Clock::now();
+    sectionNs             = std::chrono::duration<double, std::nano>(end - begin).count() / double(numSections);
+
+    // two clock queries, what every section needed before
+    double sink = 0;
+    begin       = Clock::now();
+    for(size_t i = 0; i < numSections; i++)
+    {
+      sink += profiler.getMicroSeconds();
+      sink -= profiler.getMicroSeconds();
+    }
+    end     = Clock::now();
+    clockNs = std::chrono::duration<double, std::nano>(end - begin).count() / double(numSections);
+    if(sink > 1.0e9)
+      printf("%f\n", sink);
+  }).join();
+
+  printf("worker section: %.1f ns, two getMicroSeconds: %.1f ns\n", sectionNs, clockNs);
+
+  // a few frames with nested sections on workers
+  const uint32_t   numThreads = 3;
+  std::atomic_uint frameIndex{0};
+  std::atomic_uint numDone{0};
+  std::atomic_bool stop{false};
+
+  std::vector<std::thread> threads;
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    threads.emplace_back([&, t]() {
+      uint32_t frame = 1;
+      while(true)
+      {
+        while(frameIndex.load() < frame && !stop)
+          std::this_thread::yield();
+        if(stop)
+          break;
+        {
+          nvh::Profiler::Section worker(profiler, "Worker");
+          for(int c = 0; c < 4; c++)
+          {
+            nvh::Profiler::Section chunk(profiler, "Chunk");
+            volatile double        v = 0;
+            for(uint32_t i = 0; i < 10000 * (t + 1); i++)
+              v = v + double(i);
+          }
+        }
+        frame++;
+        numDone++;
+      }
+    });
+  }
+
+  for(uint32_t f = 1; f <= 40; f++)
+  {
+    profiler.beginFrame();
+    {
+      nvh::Profiler::Section section(profiler, "Frame");
+      numDone    = 0;
+      frameIndex = f;
+      while(numDone < numThreads)
+        std::this_thread::yield();
+    }
+    profiler.endFrame();
+  }
+  stop = true;
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  std::string stats;
+  profiler.print(stats);
+  printf("%s", stats.c_str());
+
+  return 0;
+}
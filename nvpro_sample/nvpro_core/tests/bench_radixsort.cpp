@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Sorts 64-bit keys with 32-bit values, 1M up to 64M pairs, with std::sort
+// and the radix sorts. The largest size in millions can be passed as argument,
+// 64M pairs need about 1.6 GB.
+
+#include <nvh/radixsort.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double msSince(Clock::time_point begin)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+}
+
+struct Pair
+{
+  uint64_t key;
+  uint32_t value;
+};
+
+int main(int argc, char** argv)
+{
+  size_t maxMillions = argc > 1 ? size_t(atoi(argv[1])) : 64;
+
+  nvh::JobSystem jobSystem;
+  jobSystem.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+
+  std::mt19937_64 rng(1);
+
+  printf("threads: %u\n", jobSystem.getNumSlots());
+  printf("pairs | std::sort ms | radixsortPairs ms | parallel ms | inPlace ms | inPlace parallel ms | histogram scalar ms | histogram simd ms\n");
+
+  for(size_t millions = 1; millions <= maxMillions; millions *= 4)
+  {
+    size_t num = millions * 1024 * 1024;
+
+    std::vector<uint64_t> keys(num);
+    for(size_t i = 0; i < num; i++)
+    {
+      keys[i] = rng();
+    }
+
+    std::vector<Pair> pairs(num);
+    for(size_t i = 0; i < num; i++)
+    {
+      pairs[i] = {keys[i], uint32_t(i)};
+    }
+    Clock::time_point begin = Clock::now();
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) { return a.key < b.key; });
+    double stdTime = msSince(begin);
+
+    std::vector<uint64_t> sortKeys(num);
+    std::vector<uint32_t> sortValues(num);
+    std::vector<uint64_t> keysTemp(num);
+    std::vector<uint32_t> valuesTemp(num);
+    double                times[4];
+    for(int run = 0; run < 4; run++)
+    {
+      sortKeys = keys;
+      for(size_t i = 0; i < num; i++)
+      {
+        sortValues[i] = uint32_t(i);
+      }
+
+      nvh::JobSystem* jobs = (run & 1) ? &jobSystem : nullptr;
+      begin                = Clock::now();
+      if(run < 2)
+      {
+        nvh::radixsortPairs(num, sortKeys.data(), sortValues.data(), keysTemp.data(), valuesTemp.data(), jobs);
+      }
+      else
+      {
+        nvh::radixsortPairsInPlace(num, sortKeys.data(), sortValues.data(), jobs);
+      }
+      times[run] = msSince(begin);
+
+      for(size_t i = 0; i < num; i++)
+      {
+        if(sortKeys[i] != pairs[i].key)
+        {
+          printf("sort %d failed\n", run);
+          return 1;
+        }
+      }
+    }
+
+    // the histogram pass over all six 11-bit digits on its own
+    const uint32_t      DIGIT_SIZE = 1 << 11;
+    std::vector<size_t> histogram(6 * DIGIT_SIZE, 0);
+    begin = Clock::now();
+    for(size_t i = 0; i < num; i++)
+    {
+      uint64_t key = keys[i];
+      for(uint32_t p = 0; p < 6; p++)
+      {
+        histogram[p * DIGIT_SIZE + ((key >> (p * 11)) & (DIGIT_SIZE - 1))]++;
+      }
+    }
+    double histScalar = msSince(begin);
+    size_t check      = histogram[DIGIT_SIZE / 2];
+
+    std::fill(histogram.begin(), histogram.end(), 0);
+    begin = Clock::now();
+    nvh::radixsort_detail::histogramDigits<uint64_t, 11, 6>(keys.data(), num, histogram.data());
+    double histSimd = msSince(begin);
+    if(histogram[DIGIT_SIZE / 2] != check)
+    {
+      printf("histogram mismatch\n");
+      return 1;
+    }
+
+    printf("%4zuM | %12.1f | %17.1f | %11.1f | %10.1f | %19.1f | %19.1f | %17.1f\n", millions, stdTime, times[0], times[1],
+           times[2], times[3], histScalar, histSimd);
+  }
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Throughput and number of copy commands of nvvk::StagingMemoryManager for
+// per-frame streaming updates, regular sub-allocation against the frame-ring
+// mode with batched copies. The Vulkan entry points are defined here and run
+// on host memory, so the timings are the CPU cost of the staging manager plus
+// the memcpy of the copies, and the destination contents are verified.
+
+#include <nvvk/stagingmemorymanager_vk.hpp>
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+//////////////////////////////////////////////////////////////////////////
+// fake device
+
+struct FakeMemory : nvvk::MemHandleBase
+{
+  std::vector<uint8_t> data;
+};
+
+struct FakeBuffer
+{
+  VkDeviceSize          size   = 0;
+  std::vector<uint8_t>* memory = nullptr;
+  VkDeviceSize          offset = 0;
+};
+
+static uint32_t s_copyCommands = 0;
+
+static FakeBuffer* fromHandle(VkBuffer buffer)
+{
+  return (FakeBuffer*)(uintptr_t)buffer;
+}
+
+static VkBuffer toHandle(FakeBuffer* buffer)
+{
+  return (VkBuffer)(uintptr_t)buffer;
+}
+
+static void unexpectedCall(const char* name)
+{
+  printf("unexpected call of %s\n", name);
+  abort();
+}
+
+class FakeMemAllocator : public nvvk::MemAllocator
+{
+public:
+  nvvk::MemHandle allocMemory(const nvvk::MemAllocateInfo& allocInfo, VkResult* pResult = nullptr) override
+  {
+    FakeMemory* memory = new FakeMemory;
+    memory->data.resize(size_t(allocInfo.getMemoryRequirements().size));
+    if(pResult)
+    {
+      *pResult = VK_SUCCESS;
+    }
+    return memory;
+  }
+  void    freeMemory(nvvk::MemHandle memHandle) override { delete(FakeMemory*)memHandle; }
+  MemInfo getMemoryInfo(nvvk::MemHandle memHandle) const override
+  {
+    return {(VkDeviceMemory)(uintptr_t)memHandle, 0, ((FakeMemory*)memHandle)->data.size()};
+  }
+  void* map(nvvk::MemHandle memHandle, VkDeviceSize offset, VkDeviceSize, VkResult* pResult) override
+  {
+    if(pResult)
+    {
+      *pResult = VK_SUCCESS;
+    }
+    return ((FakeMemory*)memHandle)->data.data() + offset;
+  }
+  void             unmap(nvvk::MemHandle) override {}
+  VkDevice         getDevice() const override { return (VkDevice)(uintptr_t)1; }
+  VkPhysicalDevice getPhysicalDevice() const override { return (VkPhysicalDevice)(uintptr_t)1; }
+};
+
+extern "C" {
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkBuffer* pBuffer)
+{
+  FakeBuffer* buffer = new FakeBuffer;
+  buffer->size       = pCreateInfo->size;
+  *pBuffer           = toHandle(buffer);
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+{
+  delete fromHandle(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements2(VkDevice, const VkBufferMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements)
+{
+  pMemoryRequirements->memoryRequirements.size           = fromHandle(pInfo->buffer)->size;
+  pMemoryRequirements->memoryRequirements.alignment      = 256;
+  pMemoryRequirements->memoryRequirements.memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory2(VkDevice, uint32_t bindInfoCount, const VkBindBufferMemoryInfo* pBindInfos)
+{
+  for(uint32_t i = 0; i < bindInfoCount; i++)
+  {
+    FakeBuffer* buffer = fromHandle(pBindInfos[i].buffer);
+    buffer->memory     = &((FakeMemory*)(uintptr_t)pBindInfos[i].memory)->data;
+    buffer->offset     = pBindInfos[i].memoryOffset;
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+  memset(pMemoryProperties, 0, sizeof(VkPhysicalDeviceMemoryProperties));
+  pMemoryProperties->memoryTypeCount = 1;
+  pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  pMemoryProperties->memoryHeapCount = 1;
+  pMemoryProperties->memoryHeaps[0].size = 1ull << 34;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBuffer(VkCommandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions)
+{
+  // executed immediately, the regions of one command must not overlap
+  s_copyCommands++;
+  FakeBuffer* src = fromHandle(srcBuffer);
+  FakeBuffer* dst = fromHandle(dstBuffer);
+  for(uint32_t i = 0; i < regionCount; i++)
+  {
+    const VkBufferCopy& region = pRegions[i];
+    if(region.srcOffset + region.size > src->size || region.dstOffset + region.size > dst->size)
+    {
+      printf("copy region out of bounds\n");
+      abort();
+    }
+    memcpy(dst->memory->data() + dst->offset + region.dstOffset,
+           src->memory->data() + src->offset + region.srcOffset, size_t(region.size));
+  }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice, VkFence)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBufferToImage(VkCommandBuffer, VkBuffer, VkImage, VkImageLayout, uint32_t, const VkBufferImageCopy*)
+{
+  unexpectedCall("vkCmdCopyBufferToImage");
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyImageToBuffer(VkCommandBuffer, VkImage, VkImageLayout, VkBuffer, uint32_t, const VkBufferImageCopy*)
+{
+  unexpectedCall("vkCmdCopyImageToBuffer");
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements2(VkDevice, const VkImageMemoryRequirementsInfo2*, VkMemoryRequirements2*)
+{
+  unexpectedCall("vkGetImageMemoryRequirements2");
+}
+
+VKAPI_ATTR VkDeviceAddress VKAPI_CALL vkGetBufferDeviceAddress(VkDevice, const VkBufferDeviceAddressInfo*)
+{
+  unexpectedCall("vkGetBufferDeviceAddress");
+  return 0;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkSetDebugUtilsObjectNameEXT(VkDevice, const VkDebugUtilsObjectNameInfoEXT*)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginDebugUtilsLabelEXT(VkCommandBuffer, const VkDebugUtilsLabelEXT*) {}
+VKAPI_ATTR void VKAPI_CALL vkCmdEndDebugUtilsLabelEXT(VkCommandBuffer) {}
+VKAPI_ATTR void VKAPI_CALL vkCmdInsertDebugUtilsLabelEXT(VkCommandBuffer, const VkDebugUtilsLabelEXT*) {}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// Every frame updates the destination buffers with many small writes to
+// consecutive ranges, some random ones that may overlap, and every now and
+// then the whole buffer. A few frames are in flight.
+static bool runFrames(bool ringMode, uint32_t updatesPerFrame)
+{
+  const uint32_t     numFrames   = 2000;
+  const uint32_t     numInFlight = 3;
+  const uint32_t     numBuffers  = 4;
+  const VkDeviceSize bufferSize  = 64 * 1024;
+
+  FakeMemAllocator           memAllocator;
+  nvvk::StagingMemoryManager staging;
+  staging.init(&memAllocator, 1024 * 1024);
+  if(ringMode)
+  {
+    staging.setRingMode(true, 256 * 1024);
+  }
+
+  std::vector<uint8_t> dstMemory[numBuffers];
+  std::vector<uint8_t> reference[numBuffers];
+  FakeBuffer           dstBuffers[numBuffers];
+  for(uint32_t b = 0; b < numBuffers; b++)
+  {
+    dstMemory[b].resize(bufferSize);
+    reference[b].resize(bufferSize);
+    dstBuffers[b].size   = bufferSize;
+    dstBuffers[b].memory = &dstMemory[b];
+  }
+
+  std::mt19937 rng(1);
+
+  // prepared up front, so only the staging is measured
+  struct Update
+  {
+    uint32_t     buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+  };
+  std::vector<Update>  updates;
+  std::vector<uint8_t> data(bufferSize);
+  for(auto& d : data)
+  {
+    d = uint8_t(rng());
+  }
+
+  std::vector<nvvk::StagingMemoryManager::SetID> inFlight;
+  const VkCommandBuffer                          cmd = (VkCommandBuffer)(uintptr_t)1;
+
+  s_copyCommands = 0;
+  double time    = 0;
+  for(uint32_t frame = 0; frame < numFrames; frame++)
+  {
+    updates.clear();
+    for(uint32_t u = 0; u < updatesPerFrame; u++)
+    {
+      Update update;
+      update.buffer = rng() % numBuffers;
+      if(frame % 97 == 0 && u == 0)
+      {
+        update.offset = 0;
+        update.size   = bufferSize;
+      }
+      else if(u % 16 == 15)
+      {
+        update.size   = rng() % 4096 + 1;
+        update.offset = rng() % (bufferSize - update.size);
+      }
+      else
+      {
+        update.size   = 64;
+        update.offset = ((u % 16) * 64 + (frame % 8) * 1024 + (u / 16) * 8192) % bufferSize;
+      }
+      updates.push_back(update);
+    }
+
+    Clock::time_point begin = Clock::now();
+    if(inFlight.size() == numInFlight)
+    {
+      staging.releaseResourceSet(inFlight.front());
+      inFlight.erase(inFlight.begin());
+    }
+    for(const Update& update : updates)
+    {
+      staging.cmdToBuffer(cmd, toHandle(&dstBuffers[update.buffer]), update.offset, update.size, data.data());
+    }
+    staging.cmdFlush(cmd);
+    inFlight.push_back(staging.finalizeResourceSet());
+    time += std::chrono::duration<double, std::micro>(Clock::now() - begin).count();
+
+    for(const Update& update : updates)
+    {
+      memcpy(reference[update.buffer].data() + update.offset, data.data(), size_t(update.size));
+    }
+  }
+  for(auto& setID : inFlight)
+  {
+    staging.releaseResourceSet(setID);
+  }
+
+  bool identical = true;
+  for(uint32_t b = 0; b < numBuffers; b++)
+  {
+    identical = identical && dstMemory[b] == reference[b];
+  }
+
+  const nvvk::StagingMemoryManager::Stats& stats = staging.getStats();
+  printf("%-7s | %7u | %12.2f | %9.0f | %13u | %12u | %14u | %s\n", ringMode ? "ring" : "regular", updatesPerFrame,
+         time / numFrames, double(stats.bytesToDevice) / time, s_copyCommands, stats.copyRegions, stats.ringFallbacks,
+         identical ? "ok" : "MISMATCH");
+
+  staging.deinit();
+  return identical;
+}
+
+int main()
+{
+  printf("mode    | updates | us per frame | MB per s | copy commands | copy regions | ring fallbacks | contents\n");
+
+  bool identical = true;
+  for(uint32_t updatesPerFrame : {16u, 64u, 256u})
+  {
+    identical = runFrames(false, updatesPerFrame) && identical;
+    identical = runFrames(true, updatesPerFrame) && identical;
+  }
+
+  return identical ? 0 : 1;
+}
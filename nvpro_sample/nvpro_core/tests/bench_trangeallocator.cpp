@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Cost of nvh::TRangeAllocator under churn: a number of small allocations is
+// kept alive and random ones are freed and replaced by new ones with varying
+// alignment.
+
+#include <nvh/trangeallocator.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct Allocation
+{
+  uint32_t offset;
+  uint32_t size;
+};
+
+int main()
+{
+  const int ops = 200000;
+
+  printf("live allocations | free ranges | ns per free+alloc\n");
+
+  for(uint32_t numLive : {100u, 1000u, 10000u, 100000u})
+  {
+    std::mt19937              rng(1);
+    uint32_t                  total = uint32_t(std::min<uint64_t>(uint64_t(numLive) * 16 * 1024, 0xFFFFFF00u));
+    nvh::TRangeAllocator<256> range;
+    range.init(total);
+
+    std::vector<Allocation> live;
+    uint32_t                aligned;
+    for(uint32_t i = 0; i < numLive; i++)
+    {
+      Allocation a;
+      if(range.subAllocate(256 + rng() % 8192, 256, a.offset, aligned, a.size))
+      {
+        live.push_back(a);
+      }
+    }
+
+    Clock::time_point begin = Clock::now();
+    for(int i = 0; i < ops; i++)
+    {
+      size_t k = rng() % live.size();
+      range.subFree(live[k].offset, live[k].size);
+      if(!range.subAllocate(256 + rng() % 8192, 256 << (rng() % 3), live[k].offset, aligned, live[k].size))
+      {
+        live[k] = live.back();
+        live.pop_back();
+      }
+    }
+    double time = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / double(ops);
+
+    // count the free ranges by walking the free space
+    uint32_t freeRanges = 0;
+    std::sort(live.begin(), live.end(), [](const Allocation& a, const Allocation& b) { return a.offset < b.offset; });
+    uint32_t lastEnd = 0;
+    for(const Allocation& a : live)
+    {
+      freeRanges += a.offset > lastEnd;
+      lastEnd = a.offset + a.size;
+    }
+    freeRanges += lastEnd < total;
+
+    printf("%16u | %11u | %17.0f\n", numLive, freeRanges, time);
+  }
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Per-element, per-component conversion of glTF attributes, as done before
+// nvh::decodeAttribute, shared by test_gltfscene and bench_gltfscene.
+
+#pragma once
+
+#include <nvh/gltfscene.hpp>
+
+#include <string.h>
+
+inline void decodeAttributeReference(float*         dst,
+                                     uint32_t       dstComponents,
+                                     const uint8_t* src,
+                                     size_t         srcStride,
+                                     uint32_t       srcComponents,
+                                     int            componentType,
+                                     bool           normalized,
+                                     size_t         count)
+{
+  uint32_t numComponents = std::min(srcComponents, dstComponents);
+  for(size_t i = 0; i < count; i++)
+  {
+    const uint8_t* element = src + i * srcStride;
+    for(uint32_t c = 0; c < dstComponents; c++)
+    {
+      float value = c == 3 ? 1.f : 0.f;
+      if(c < numComponents)
+      {
+        switch(componentType)
+        {
+          case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+            float v;
+            memcpy(&v, element + 4 * c, 4);
+            value = v;
+            break;
+          }
+          case TINYGLTF_COMPONENT_TYPE_BYTE: {
+            int8_t v;
+            memcpy(&v, element + c, 1);
+            value = normalized ? std::max(v / 127.f, -1.f) : v;
+            break;
+          }
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+            uint8_t v;
+            memcpy(&v, element + c, 1);
+            value = normalized ? v / 255.f : v;
+            break;
+          }
+          case TINYGLTF_COMPONENT_TYPE_SHORT: {
+            int16_t v;
+            memcpy(&v, element + 2 * c, 2);
+            value = normalized ? std::max(v / 32767.f, -1.f) : v;
+            break;
+          }
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t v;
+            memcpy(&v, element + 2 * c, 2);
+            value = normalized ? v / 65535.f : v;
+            break;
+          }
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+            uint32_t v;
+            memcpy(&v, element + 4 * c, 4);
+            value = normalized ? v / 4294967295.f : float(v);
+            break;
+          }
+        }
+      }
+      dst[i * dstComponents + c] = value;
+    }
+  }
+}
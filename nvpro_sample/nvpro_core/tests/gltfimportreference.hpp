@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Serial import of the triangle primitives of a glTF model, appending one
+// primitive after the other as importDrawableNodes did before it sized all
+// primitives up front and decoded them in parallel. Attributes are read with
+// decodeAttributeReference. Used by test_gltfscene.
+
+#pragma once
+
+#include "gltfdecodereference.hpp"
+
+#include <cmath>
+#include <map>
+
+struct GltfImportReference
+{
+  std::vector<nvh::GltfPrimMesh> primMeshes;
+  std::vector<nvmath::vec3f>     positions;
+  std::vector<uint32_t>          indices;
+  std::vector<nvmath::vec3f>     normals;
+  std::vector<nvmath::vec4f>     tangents;
+  std::vector<nvmath::vec2f>     texcoords0;
+  std::vector<nvmath::vec4f>     colors0;
+
+  std::map<std::string, nvh::GltfPrimMesh> cachePrimMesh;
+};
+
+template <typename T>
+inline bool appendAttributeReference(const tinygltf::Model& tmodel, const tinygltf::Primitive& primitive, std::vector<T>& attribVec, const char* attribName)
+{
+  auto it = primitive.attributes.find(attribName);
+  if(it == primitive.attributes.end())
+    return false;
+
+  const auto&  accessor = tmodel.accessors[it->second];
+  const auto&  bufView  = tmodel.bufferViews[accessor.bufferView];
+  const auto&  buffer   = tmodel.buffers[bufView.buffer];
+  const size_t offset   = attribVec.size();
+  attribVec.resize(offset + accessor.count);
+  decodeAttributeReference(reinterpret_cast<float*>(attribVec.data() + offset), uint32_t(sizeof(T) / sizeof(float)),
+                           &buffer.data[accessor.byteOffset + bufView.byteOffset], size_t(accessor.ByteStride(bufView)),
+                           uint32_t(tinygltf::GetNumComponentsInType(accessor.type)), accessor.componentType,
+                           accessor.normalized, accessor.count);
+  return true;
+}
+
+inline void importPrimitiveReference(GltfImportReference&       ref,
+                                     const tinygltf::Model&     tmodel,
+                                     const tinygltf::Primitive& tmesh,
+                                     nvh::GltfAttributes        attributes,
+                                     const std::string&         name)
+{
+  using nvh::GltfAttributes;
+  if(tmesh.mode != 4)
+    return;
+
+  nvh::GltfPrimMesh resultMesh;
+  resultMesh.name          = name;
+  resultMesh.materialIndex = std::max(0, tmesh.material);
+  resultMesh.vertexOffset  = static_cast<uint32_t>(ref.positions.size());
+  resultMesh.firstIndex    = static_cast<uint32_t>(ref.indices.size());
+
+  std::string key;
+  for(auto& a : tmesh.attributes)
+  {
+    key += a.first + std::to_string(a.second) + ";";
+  }
+  bool primMeshCached = false;
+  auto it             = ref.cachePrimMesh.find(key);
+  if(it != ref.cachePrimMesh.end())
+  {
+    primMeshCached          = true;
+    resultMesh.vertexCount  = it->second.vertexCount;
+    resultMesh.vertexOffset = it->second.vertexOffset;
+  }
+
+  // INDICES
+  if(tmesh.indices > -1)
+  {
+    const tinygltf::Accessor&   indexAccessor = tmodel.accessors[tmesh.indices];
+    const tinygltf::BufferView& bufferView    = tmodel.bufferViews[indexAccessor.bufferView];
+    const uint8_t* data = &tmodel.buffers[bufferView.buffer].data[indexAccessor.byteOffset + bufferView.byteOffset];
+
+    if(indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT
+       && indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT
+       && indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE)
+      return;
+
+    resultMesh.indexCount = static_cast<uint32_t>(indexAccessor.count);
+    for(size_t i = 0; i < indexAccessor.count; i++)
+    {
+      uint32_t index = data[i];
+      if(indexAccessor.componentType == TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT)
+      {
+        memcpy(&index, data + i * 4, 4);
+      }
+      else if(indexAccessor.componentType == TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT)
+      {
+        uint16_t index16;
+        memcpy(&index16, data + i * 2, 2);
+        index = index16;
+      }
+      ref.indices.push_back(index);
+    }
+  }
+  else
+  {
+    const auto& accessor = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
+    for(size_t i = 0; i < accessor.count; i++)
+      ref.indices.push_back(uint32_t(i));
+    resultMesh.indexCount = static_cast<uint32_t>(accessor.count);
+  }
+
+  if(!primMeshCached)
+  {
+    // POSITION
+    appendAttributeReference(tmodel, tmesh, ref.positions, "POSITION");
+    const auto& accessor   = tmodel.accessors[tmesh.attributes.find("POSITION")->second];
+    resultMesh.vertexCount = static_cast<uint32_t>(accessor.count);
+    if(!accessor.minValues.empty())
+      resultMesh.posMin = nvmath::vec3f(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+    if(!accessor.maxValues.empty())
+      resultMesh.posMax = nvmath::vec3f(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+
+    // NORMAL, generated from the faces if missing
+    if((attributes & GltfAttributes::Normal) == GltfAttributes::Normal
+       && !appendAttributeReference(tmodel, tmesh, ref.normals, "NORMAL"))
+    {
+      std::vector<nvmath::vec3f> geonormal(resultMesh.vertexCount);
+      for(size_t i = 0; i < resultMesh.indexCount; i += 3)
+      {
+        uint32_t    ind0 = ref.indices[resultMesh.firstIndex + i + 0];
+        uint32_t    ind1 = ref.indices[resultMesh.firstIndex + i + 1];
+        uint32_t    ind2 = ref.indices[resultMesh.firstIndex + i + 2];
+        const auto& pos0 = ref.positions[ind0 + resultMesh.vertexOffset];
+        const auto& pos1 = ref.positions[ind1 + resultMesh.vertexOffset];
+        const auto& pos2 = ref.positions[ind2 + resultMesh.vertexOffset];
+        const auto  v1   = nvmath::normalize(pos1 - pos0);
+        const auto  v2   = nvmath::normalize(pos2 - pos0);
+        const auto  n    = nvmath::cross(v2, v1);
+        geonormal[ind0] += n;
+        geonormal[ind1] += n;
+        geonormal[ind2] += n;
+      }
+      for(auto& n : geonormal)
+        n = nvmath::normalize(n);
+      ref.normals.insert(ref.normals.end(), geonormal.begin(), geonormal.end());
+    }
+
+    // TEXCOORD_0, cube map projection if missing
+    if((attributes & GltfAttributes::Texcoord_0) == GltfAttributes::Texcoord_0
+       && !appendAttributeReference(tmodel, tmesh, ref.texcoords0, "TEXCOORD_0"))
+    {
+      for(uint32_t i = 0; i < resultMesh.vertexCount; i++)
+      {
+        const auto& pos  = ref.positions[resultMesh.vertexOffset + i];
+        float       absX = fabs(pos.x);
+        float       absY = fabs(pos.y);
+        float       absZ = fabs(pos.z);
+        float       maxAxis = 0, uc = 0, vc = 0;
+        if(pos.x > 0 && absX >= absY && absX >= absZ)
+        {
+          maxAxis = absX;
+          uc      = -pos.z;
+          vc      = pos.y;
+        }
+        if(!(pos.x > 0) && absX >= absY && absX >= absZ)
+        {
+          maxAxis = absX;
+          uc      = pos.z;
+          vc      = pos.y;
+        }
+        if(pos.y > 0 && absY >= absX && absY >= absZ)
+        {
+          maxAxis = absY;
+          uc      = pos.x;
+          vc      = -pos.z;
+        }
+        if(!(pos.y > 0) && absY >= absX && absY >= absZ)
+        {
+          maxAxis = absY;
+          uc      = pos.x;
+          vc      = pos.z;
+        }
+        if(pos.z > 0 && absZ >= absX && absZ >= absY)
+        {
+          maxAxis = absZ;
+          uc      = pos.x;
+          vc      = pos.y;
+        }
+        if(!(pos.z > 0) && absZ >= absX && absZ >= absY)
+        {
+          maxAxis = absZ;
+          uc      = -pos.x;
+          vc      = pos.y;
+        }
+        ref.texcoords0.emplace_back(0.5f * (uc / maxAxis + 1.0f), 0.5f * (vc / maxAxis + 1.0f));
+      }
+    }
+
+    // TANGENT, from positions and texcoords if missing
+    if((attributes & GltfAttributes::Tangent) == GltfAttributes::Tangent
+       && !appendAttributeReference(tmodel, tmesh, ref.tangents, "TANGENT"))
+    {
+      std::vector<nvmath::vec3f> tangent(resultMesh.vertexCount);
+      std::vector<nvmath::vec3f> bitangent(resultMesh.vertexCount);
+      for(size_t i = 0; i < resultMesh.indexCount; i += 3)
+      {
+        uint32_t i0  = ref.indices[resultMesh.firstIndex + i + 0];
+        uint32_t i1  = ref.indices[resultMesh.firstIndex + i + 1];
+        uint32_t i2  = ref.indices[resultMesh.firstIndex + i + 2];
+        uint32_t gi0 = i0 + resultMesh.vertexOffset;
+        uint32_t gi1 = i1 + resultMesh.vertexOffset;
+        uint32_t gi2 = i2 + resultMesh.vertexOffset;
+
+        nvmath::vec3f e1    = ref.positions[gi1] - ref.positions[gi0];
+        nvmath::vec3f e2    = ref.positions[gi2] - ref.positions[gi0];
+        nvmath::vec2f duvE1 = ref.texcoords0[gi1] - ref.texcoords0[gi0];
+        nvmath::vec2f duvE2 = ref.texcoords0[gi2] - ref.texcoords0[gi0];
+
+        float r = 1.0F;
+        float a = duvE1.x * duvE2.y - duvE2.x * duvE1.y;
+        if(fabs(a) > 0)
+        {
+          r = 1.0f / a;
+        }
+
+        nvmath::vec3f t = (e1 * duvE2.y - e2 * duvE1.y) * r;
+        nvmath::vec3f b = (e2 * duvE1.x - e1 * duvE2.x) * r;
+        tangent[i0] += t;
+        tangent[i1] += t;
+        tangent[i2] += t;
+        bitangent[i0] += b;
+        bitangent[i1] += b;
+        bitangent[i2] += b;
+      }
+      for(uint32_t a = 0; a < resultMesh.vertexCount; a++)
+      {
+        const auto& t = tangent[a];
+        const auto& b = bitangent[a];
+        const auto& n = ref.normals[resultMesh.vertexOffset + a];
+
+        // Gram-Schmidt orthogonalize
+        nvmath::vec3f otangent = nvmath::normalize(t - (nvmath::dot(n, t) * n));
+        if(otangent == nvmath::vec3f(0, 0, 0))
+        {
+          if(std::abs(n.x) > std::abs(n.y))
+            otangent = nvmath::vec3f(n.z, 0, -n.x) / std::sqrt(n.x * n.x + n.z * n.z);
+          else
+            otangent = nvmath::vec3f(0, -n.z, n.y) / std::sqrt(n.y * n.y + n.z * n.z);
+        }
+        float handedness = (nvmath::dot(nvmath::cross(n, t), b) < 0.0F) ? -1.0F : 1.0F;
+        ref.tangents.emplace_back(otangent.x, otangent.y, otangent.z, handedness);
+      }
+    }
+
+    // COLOR_0, white if missing
+    if((attributes & GltfAttributes::Color_0) == GltfAttributes::Color_0
+       && !appendAttributeReference(tmodel, tmesh, ref.colors0, "COLOR_0"))
+    {
+      ref.colors0.insert(ref.colors0.end(), resultMesh.vertexCount, nvmath::vec4f(1, 1, 1, 1));
+    }
+  }
+
+  ref.cachePrimMesh[key] = resultMesh;
+  ref.primMeshes.emplace_back(resultMesh);
+}
+
+inline void importReference(GltfImportReference& ref, const tinygltf::Model& tmodel, nvh::GltfAttributes attributes)
+{
+  for(const auto& tmesh : tmodel.meshes)
+  {
+    for(const auto& tprimitive : tmesh.primitives)
+    {
+      importPrimitiveReference(ref, tmodel, tprimitive, attributes, tmesh.name);
+    }
+  }
+}
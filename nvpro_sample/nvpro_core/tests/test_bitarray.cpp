@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Checks the bulk operations, range fill, rank/select and traversal of
+// nvh::BitArray against a std::vector<bool> on random arrays. The bulk
+// operations alternate between the AVX2 path, if supported, and the scalar one.
+
+#include <nvh/bitarray.hpp>
+#include <nvh/cpufeatures.hpp>
+
+#include <atomic>
+#include <functional>
+#include <random>
+#include <stdio.h>
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_bitarray: %s failed, size %zu\n", #cond, num);                                                        \
+    return 1;                                                                                                          \
+  }
+
+struct SumVisitor
+{
+  std::atomic<size_t> sum{0};
+  std::atomic<size_t> count{0};
+
+  void operator()(size_t index)
+  {
+    sum += index;
+    count++;
+  }
+};
+
+int main()
+{
+  std::mt19937   rng(3);
+  nvh::JobSystem jobSystem;
+  jobSystem.init(3);
+
+  for(int iteration = 0; iteration < 300; iteration++)
+  {
+    size_t num = rng() % 3000 + 1;
+    nvh::cpuDisableAVX2((iteration & 1) != 0);
+
+    nvh::BitArray     a(num);
+    nvh::BitArray     b(num);
+    std::vector<bool> refA(num);
+    std::vector<bool> refB(num);
+    for(size_t i = 0; i < num; i++)
+    {
+      refA[i] = rng() & 1;
+      refB[i] = rng() & 1;
+      a.setBit(i, refA[i]);
+      b.setBit(i, refB[i]);
+    }
+
+    size_t begin = rng() % (num + 1);
+    size_t end   = begin + rng() % (num - begin + 1);
+    bool   value = rng() & 1;
+    a.setBits(begin, end, value);
+    for(size_t i = begin; i < end; i++)
+    {
+      refA[i] = value;
+    }
+    for(size_t i = 0; i < num; i++)
+    {
+      CHECK(a.getBit(i) == refA[i]);
+    }
+
+    nvh::BitArray bitAnd = a & b;
+    nvh::BitArray bitOr  = a | b;
+    nvh::BitArray bitXor = a ^ b;
+    nvh::BitArray bitAndNot(a);
+    bitAndNot.andNot(b);
+
+    size_t count = 0;
+    size_t sum   = 0;
+    for(size_t i = 0; i < num; i++)
+    {
+      CHECK(bitAnd.getBit(i) == (refA[i] && refB[i]));
+      CHECK(bitOr.getBit(i) == (refA[i] || refB[i]));
+      CHECK(bitXor.getBit(i) == (refA[i] != refB[i]));
+      bool andNot = refA[i] && !refB[i];
+      CHECK(bitAndNot.getBit(i) == andNot);
+      count += andNot ? 1 : 0;
+      sum += andNot ? i : 0;
+    }
+    CHECK(bitAndNot.countBits() == count);
+
+    nvh::BitRankIndex rankIndex;
+    rankIndex.build(bitAndNot);
+    size_t rank = 0;
+    for(size_t i = 0; i <= num; i++)
+    {
+      CHECK(rankIndex.rank(i) == rank);
+      if(i < num && bitAndNot.getBit(i))
+      {
+        CHECK(rankIndex.select(rank) == i);
+        rank++;
+      }
+    }
+    CHECK(rankIndex.select(rank) == num);
+
+    SumVisitor serial;
+    bitAndNot.traverseBits(std::ref(serial));
+    CHECK(serial.sum == sum && serial.count == count);
+
+    SumVisitor parallel;
+    bitAndNot.traverseBitsParallel(parallel, jobSystem, 1);
+    CHECK(parallel.sum == sum && parallel.count == count);
+
+    // single element traversal for all unsigned widths
+    SumVisitor bits8;
+    SumVisitor bits64;
+    SumVisitor bitsSize;
+    uint64_t   element = (uint64_t(rng()) << 32) | rng();
+    nvh::bitTraverse(uint8_t(element), bits8);
+    nvh::bitTraverse(element, bits64);
+    nvh::bitTraverse(size_t(element), bitsSize);
+    CHECK(bits8.count == nvh::popcount(element & 0xFF));
+    CHECK(bits64.count == nvh::popcount(element) && bitsSize.sum == bits64.sum);
+  }
+
+  printf("test_bitarray: passed\n");
+  return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// nvh::decodeAttribute against the per-component reference for all component
+// types, source/destination component counts, strides, normalization and
+// element counts around the SIMD widths, as well as all 16 bit normalized
+// values. Source buffers are exactly sized, so sanitizers catch over-reads.
+// Every case is decoded with the SSE and, if supported, the AVX2 path.
+// GltfScene::importDrawableNodes is compared against a serial import of
+// synthetic models with shared accessors, generated normals, texcoords and
+// tangents, and 8/16/32 bit or missing indices.
+
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include "gltfimportreference.hpp"
+
+#include <nvh/cpufeatures.hpp>
+#include <nvh/jobsystem.hpp>
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+
+// appends the data as a new buffer view with an accessor on it
+static int addAccessor(tinygltf::Model& model, const void* data, size_t bytes, int componentType, int type, size_t count, bool normalized = false)
+{
+  auto& buffer = model.buffers[0].data;
+  buffer.resize((buffer.size() + 3) & ~size_t(3));
+
+  tinygltf::BufferView view;
+  view.buffer     = 0;
+  view.byteOffset = buffer.size();
+  view.byteLength = bytes;
+  buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)data + bytes);
+  model.bufferViews.push_back(view);
+
+  tinygltf::Accessor accessor;
+  accessor.bufferView    = int(model.bufferViews.size() - 1);
+  accessor.componentType = componentType;
+  accessor.type          = type;
+  accessor.count         = count;
+  accessor.normalized    = normalized;
+  model.accessors.push_back(accessor);
+  return int(model.accessors.size() - 1);
+}
+
+template <typename T>
+static std::vector<T> randomValues(std::mt19937& rng, size_t count, float minValue, float maxValue)
+{
+  std::vector<T> values(count);
+  for(auto& v : values)
+  {
+    v = T(std::uniform_real_distribution<float>(minValue, maxValue)(rng));
+  }
+  return values;
+}
+
+// Primitives pick from a few vertex sets and index accessors, so vertices and
+// indices are shared between primitives. Attributes are float or quantized,
+// missing ones are generated by the import.
+static tinygltf::Model makeModel(uint32_t seed, int numMeshes)
+{
+  const size_t numVertices = 300;
+  const size_t numIndices  = 3 * 400;
+  const int    numSets     = 6;
+
+  std::mt19937    rng(seed);
+  tinygltf::Model model;
+  model.buffers.resize(1);
+
+  std::vector<int> positions, normals, texcoords, tangents, colors, indices;
+  for(int k = 0; k < numSets; k++)
+  {
+    // no zero coordinates, the cube map projection of generated texcoords divides by them
+    std::vector<float> pos = randomValues<float>(rng, numVertices * 3, 0.1f, 2.0f);
+    for(auto& p : pos)
+    {
+      p = (rng() & 1) ? p : -p;
+    }
+    positions.push_back(addAccessor(model, pos.data(), pos.size() * 4, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, numVertices));
+    if(k & 1)
+    {
+      model.accessors.back().minValues = {-2, -2, -2};
+      model.accessors.back().maxValues = {2, 2, 2};
+    }
+
+    if(k < 3)
+    {
+      std::vector<float> nrm = randomValues<float>(rng, numVertices * 3, -1.0f, 1.0f);
+      normals.push_back(addAccessor(model, nrm.data(), nrm.size() * 4, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, numVertices));
+      std::vector<float> uv = randomValues<float>(rng, numVertices * 2, 0.0f, 1.0f);
+      texcoords.push_back(addAccessor(model, uv.data(), uv.size() * 4, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, numVertices));
+      std::vector<float> tan = randomValues<float>(rng, numVertices * 4, -1.0f, 1.0f);
+      tangents.push_back(addAccessor(model, tan.data(), tan.size() * 4, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, numVertices));
+    }
+    else
+    {
+      // KHR_mesh_quantization
+      std::vector<int8_t> nrm = randomValues<int8_t>(rng, numVertices * 3, -127.0f, 127.0f);
+      normals.push_back(addAccessor(model, nrm.data(), nrm.size(), TINYGLTF_COMPONENT_TYPE_BYTE, TINYGLTF_TYPE_VEC3, numVertices, true));
+      std::vector<uint16_t> uv = randomValues<uint16_t>(rng, numVertices * 2, 0.0f, 65535.0f);
+      texcoords.push_back(addAccessor(model, uv.data(), uv.size() * 2, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC2, numVertices, true));
+      std::vector<int16_t> tan = randomValues<int16_t>(rng, numVertices * 4, -32767.0f, 32767.0f);
+      tangents.push_back(addAccessor(model, tan.data(), tan.size() * 2, TINYGLTF_COMPONENT_TYPE_SHORT, TINYGLTF_TYPE_VEC4, numVertices, true));
+    }
+    std::vector<uint8_t> col = randomValues<uint8_t>(rng, numVertices * 4, 0.0f, 255.0f);
+    colors.push_back(addAccessor(model, col.data(), col.size(), TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_VEC4, numVertices, true));
+  }
+
+  // two 8, 16 and 32 bit index accessors, triangles use three different vertices
+  for(int k = 0; k < 6; k++)
+  {
+    uint32_t              range = k < 2 ? 256 : uint32_t(numVertices);
+    std::vector<uint32_t> idx(numIndices);
+    for(size_t i = 0; i < numIndices; i += 3)
+    {
+      idx[i + 0] = rng() % range;
+      idx[i + 1] = (idx[i + 0] + 1 + rng() % (range - 2)) % range;
+      do
+      {
+        idx[i + 2] = rng() % range;
+      } while(idx[i + 2] == idx[i + 0] || idx[i + 2] == idx[i + 1]);
+    }
+    if(k < 2)
+    {
+      std::vector<uint8_t> idx8(idx.begin(), idx.end());
+      indices.push_back(addAccessor(model, idx8.data(), idx8.size(), TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_SCALAR, numIndices));
+    }
+    else if(k < 4)
+    {
+      std::vector<uint16_t> idx16(idx.begin(), idx.end());
+      indices.push_back(addAccessor(model, idx16.data(), idx16.size() * 2, TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, numIndices));
+    }
+    else
+    {
+      indices.push_back(addAccessor(model, idx.data(), idx.size() * 4, TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, numIndices));
+    }
+  }
+
+  tinygltf::Scene scene;
+  for(int m = 0; m < numMeshes; m++)
+  {
+    tinygltf::Mesh mesh;
+    mesh.name = "mesh" + std::to_string(m);
+    for(uint32_t p = 0, numPrimitives = 1 + rng() % 3; p < numPrimitives; p++)
+    {
+      tinygltf::Primitive prim;
+      // some lines, which are skipped
+      prim.mode                   = (rng() % 10 == 0) ? 1 : 4;
+      prim.material               = int(rng() % 3) - 1;
+      int k                       = rng() % numSets;
+      prim.attributes["POSITION"] = positions[k];
+      uint32_t present            = rng();
+      if(present & 1)
+        prim.attributes["NORMAL"] = normals[k];
+      if(present & 2)
+        prim.attributes["TEXCOORD_0"] = texcoords[rng() % numSets];
+      if(present & 4)
+        prim.attributes["TANGENT"] = tangents[k];
+      if(present & 8)
+        prim.attributes["COLOR_0"] = colors[k];
+      uint32_t idx = rng() % 8;
+      prim.indices = idx < 6 ? indices[idx] : -1;
+      mesh.primitives.push_back(prim);
+    }
+    model.meshes.push_back(mesh);
+
+    tinygltf::Node node;
+    node.mesh = m;
+    model.nodes.push_back(node);
+    scene.nodes.push_back(m);
+  }
+  model.scenes.push_back(scene);
+  return model;
+}
+
+template <typename T>
+static bool sameData(const std::vector<T>& a, const std::vector<T>& b)
+{
+  return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool samePrimMeshes(const std::vector<nvh::GltfPrimMesh>& a, const std::vector<nvh::GltfPrimMesh>& b)
+{
+  if(a.size() != b.size())
+    return false;
+  for(size_t i = 0; i < a.size(); i++)
+  {
+    if(a[i].firstIndex != b[i].firstIndex || a[i].indexCount != b[i].indexCount || a[i].vertexOffset != b[i].vertexOffset
+       || a[i].vertexCount != b[i].vertexCount || a[i].materialIndex != b[i].materialIndex || a[i].name != b[i].name
+       || memcmp(&a[i].posMin, &b[i].posMin, sizeof(a[i].posMin)) || memcmp(&a[i].posMax, &b[i].posMax, sizeof(a[i].posMax)))
+      return false;
+  }
+  return true;
+}
+
+static size_t testImport(size_t& tests)
+{
+  using nvh::GltfAttributes;
+  const GltfAttributes attributeSets[] = {
+      GltfAttributes::Normal | GltfAttributes::Color_0,
+      GltfAttributes::Normal | GltfAttributes::Texcoord_0 | GltfAttributes::Tangent | GltfAttributes::Color_0,
+  };
+
+  nvh::JobSystem jobSystem;
+  jobSystem.init(3);
+
+  size_t failures = 0;
+  for(int numMeshes : {1, 7, 300})
+  {
+    tinygltf::Model model = makeModel(uint32_t(numMeshes), numMeshes);
+    for(GltfAttributes attributes : attributeSets)
+    {
+      GltfImportReference ref;
+      importReference(ref, model, attributes);
+
+      // the temporary job system and a given one
+      for(int withJobs = 0; withJobs < 2; withJobs++)
+      {
+        nvh::GltfScene scene;
+        scene.importDrawableNodes(model, attributes, withJobs ? &jobSystem : nullptr);
+
+        tests++;
+        if(!samePrimMeshes(scene.m_primMeshes, ref.primMeshes) || !sameData(scene.m_indices, ref.indices)
+           || !sameData(scene.m_positions, ref.positions) || !sameData(scene.m_normals, ref.normals)
+           || !sameData(scene.m_texcoords0, ref.texcoords0) || !sameData(scene.m_tangents, ref.tangents)
+           || !sameData(scene.m_colors0, ref.colors0)
+           || scene.m_nodes.size() != ref.primMeshes.size())
+        {
+          printf("test_gltfscene: import mismatch, %d meshes, attributes %d, job system %d\n", numMeshes, int(attributes), withJobs);
+          failures++;
+        }
+      }
+    }
+  }
+  return failures;
+}
+
+int main()
+{
+  std::mt19937 rng(1);
+  const int    types[] = {TINYGLTF_COMPONENT_TYPE_FLOAT,          TINYGLTF_COMPONENT_TYPE_BYTE,
+                       TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,  TINYGLTF_COMPONENT_TYPE_SHORT,
+                       TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT};
+
+  size_t tests    = 0;
+  size_t failures = 0;
+  bool   hasAVX2  = nvh::cpuSupportsAVX2();
+  for(int type : types)
+  {
+    size_t componentSize = tinygltf::GetComponentSizeInBytes(type);
+    for(uint32_t srcComponents = 1; srcComponents <= 4; srcComponents++)
+    {
+      for(uint32_t dstComponents = 1; dstComponents <= 4; dstComponents++)
+      {
+        for(int pad = 0; pad < 3; pad++)
+        {
+          for(int normalized = 0; normalized < 2; normalized++)
+          {
+            for(size_t count : {0, 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 33, 100, 1001})
+            {
+              size_t stride = srcComponents * componentSize + pad * (pad == 2 ? 4 : componentSize);
+              size_t bytes  = count ? (count - 1) * stride + srcComponents * componentSize : 0;
+
+              std::vector<uint8_t> src(bytes);
+              for(auto& b : src)
+              {
+                b = uint8_t(rng());
+              }
+              if(type == TINYGLTF_COMPONENT_TYPE_FLOAT)
+              {
+                // no NaNs, they would not compare
+                for(size_t i = 0; i + 4 <= bytes; i += 4)
+                {
+                  float f = std::uniform_real_distribution<float>(-10, 10)(rng);
+                  memcpy(&src[i], &f, 4);
+                }
+              }
+
+              std::vector<float> expected(count * dstComponents);
+              std::vector<float> decoded(count * dstComponents);
+              decodeAttributeReference(expected.data(), dstComponents, src.data(), stride, srcComponents, type, normalized, count);
+              for(int avx2 = 0; avx2 <= (hasAVX2 ? 1 : 0); avx2++)
+              {
+                nvh::cpuDisableAVX2(avx2 == 0);
+                std::fill(decoded.begin(), decoded.end(), -1234.f);
+                bool ok = nvh::decodeAttribute(decoded.data(), dstComponents, src.data(), stride, srcComponents, type,
+                                               normalized, count);
+
+                tests++;
+                if(!ok || memcmp(expected.data(), decoded.data(), expected.size() * sizeof(float)))
+                {
+                  if(failures++ < 10)
+                  {
+                    printf("test_gltfscene: mismatch type %d src %u dst %u stride %zu normalized %d count %zu avx2 %d\n",
+                           type, srcComponents, dstComponents, stride, normalized, count, avx2);
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // all normalized 16 bit values
+  std::vector<uint16_t> values(65536);
+  for(uint32_t i = 0; i < 65536; i++)
+  {
+    values[i] = uint16_t(i);
+  }
+  for(int type : {TINYGLTF_COMPONENT_TYPE_SHORT, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT})
+  {
+    std::vector<float> expected(65536);
+    std::vector<float> decoded(65536);
+    decodeAttributeReference(expected.data(), 4, (const uint8_t*)values.data(), 8, 4, type, true, 16384);
+    for(int avx2 = 0; avx2 <= (hasAVX2 ? 1 : 0); avx2++)
+    {
+      nvh::cpuDisableAVX2(avx2 == 0);
+      nvh::decodeAttribute(decoded.data(), 4, (const uint8_t*)values.data(), 8, 4, type, true, 16384);
+      tests++;
+      if(memcmp(expected.data(), decoded.data(), expected.size() * sizeof(float)))
+      {
+        printf("test_gltfscene: mismatch in normalized 16 bit values, type %d avx2 %d\n", type, avx2);
+        failures++;
+      }
+    }
+  }
+
+  failures += testImport(tests);
+
+  printf("test_gltfscene: %zu tests, %zu failures\n", tests, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Checks that nv_ktx::KTXImage::readFromMemory and readFromMappedFile decode
+// the same subresources as readFromStream, for every thread count, mip range
+// and with ReadSettings::subresource_destination, and that truncated input
+// fails on all paths. The KTX2 files are written by KTXImage itself, with
+// Zstandard and Basis Universal if nvpro_core was configured with them; the
+// KTX1 file is built by hand.
+
+#include <fileformats/nv_ktx.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace nv_ktx;
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_ktx: %s failed (line %d, %s)\n", #cond, __LINE__, s_currentName);                                     \
+    s_failures++;                                                                                                      \
+  }
+
+static const char* s_currentName = "";
+
+struct TestImage
+{
+  const char*               name;
+  VkFormat                  format;
+  uint32_t                  width;
+  uint32_t                  height;
+  uint32_t                  mips;
+  uint32_t                  layers;
+  uint32_t                  faces;
+  WriteSupercompressionType supercompression;
+  EncodeRGBA8ToFormat       encode;
+};
+
+static const TestImage s_images[] = {
+    {"rgba8 array", VK_FORMAT_B8G8R8A8_SRGB, 67, 45, 7, 3, 1, WriteSupercompressionType::NONE, EncodeRGBA8ToFormat::NO},
+    {"rgba16f cube", VK_FORMAT_R16G16B16A16_SFLOAT, 32, 32, 6, 0, 6, WriteSupercompressionType::NONE, EncodeRGBA8ToFormat::NO},
+#ifdef NVP_SUPPORTS_ZSTD
+    {"rgba8 array zstd", VK_FORMAT_B8G8R8A8_SRGB, 67, 45, 7, 3, 1, WriteSupercompressionType::ZSTD, EncodeRGBA8ToFormat::NO},
+    {"rgba16f cube zstd", VK_FORMAT_R16G16B16A16_SFLOAT, 32, 32, 6, 0, 6, WriteSupercompressionType::ZSTD, EncodeRGBA8ToFormat::NO},
+#endif
+#ifdef NVP_SUPPORTS_BASISU
+    {"uastc", VK_FORMAT_B8G8R8A8_SRGB, 64, 40, 7, 2, 1, WriteSupercompressionType::NONE, EncodeRGBA8ToFormat::UASTC},
+    {"etc1s", VK_FORMAT_B8G8R8A8_SRGB, 64, 64, 7, 2, 1, WriteSupercompressionType::NONE, EncodeRGBA8ToFormat::ETC1S_RGBA},
+#endif
+#if defined(NVP_SUPPORTS_ZSTD) && defined(NVP_SUPPORTS_BASISU)
+    {"uastc zstd", VK_FORMAT_B8G8R8A8_SRGB, 64, 40, 7, 2, 1, WriteSupercompressionType::ZSTD, EncodeRGBA8ToFormat::UASTC},
+#endif
+};
+
+static uint32_t numLayers(const KTXImage& image)
+{
+  return std::max(1u, image.num_layers_possibly_0);
+}
+
+static bool writeImage(const TestImage& test, std::string& bytes)
+{
+  KTXImage image;
+  image.format       = test.format;
+  image.mip_0_width  = test.width;
+  image.mip_0_height = test.height;
+  if(image.allocate(test.mips, test.layers, test.faces))
+  {
+    return false;
+  }
+
+  size_t   texelSize = test.format == VK_FORMAT_R16G16B16A16_SFLOAT ? 8 : 4;
+  uint32_t seed      = 1;
+  for(uint32_t mip = 0; mip < test.mips; mip++)
+  {
+    size_t size = size_t(std::max(1u, test.width >> mip)) * std::max(1u, test.height >> mip) * texelSize;
+    for(uint32_t layer = 0; layer < numLayers(image); layer++)
+    {
+      for(uint32_t face = 0; face < test.faces; face++)
+      {
+        std::vector<char>& subresource = image.subresource(mip, layer, face);
+        subresource.resize(size);
+        for(size_t i = 0; i < size; i++)
+        {
+          // smooth with some noise, so that the encoders have some work to do
+          seed           = seed * 1664525u + 1013904223u;
+          subresource[i] = char(((i * 7 + layer * 31 + face * 5) & 0xff) ^ (seed >> 30));
+        }
+      }
+    }
+  }
+
+  WriteSettings settings;
+  settings.supercompression       = test.supercompression;
+  settings.encode_rgba8_to_format = test.encode;
+  settings.uastc_encoding_quality = UASTCEncodingQuality::FASTEST;
+  settings.etc1s_encoding_level   = 1;
+
+  std::ostringstream output(std::ios::binary);
+  if(image.writeKTX2Stream(output, settings))
+  {
+    return false;
+  }
+  bytes = output.str();
+  return true;
+}
+
+// RGBA8 15x7, 2 layers, 4 mips
+static std::string makeKTX1()
+{
+  std::string bytes;
+  auto        u32 = [&](uint32_t v) { bytes.append(reinterpret_cast<const char*>(&v), 4); };
+
+  const uint8_t identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+  bytes.append(reinterpret_cast<const char*>(identifier), 12);
+  // endianness, GL_UNSIGNED_BYTE, type size, GL_RGBA, GL_RGBA8, GL_RGBA,
+  // width, height, depth, array elements, faces, mips, key/value bytes
+  for(uint32_t v : {0x04030201u, 0x1401u, 1u, 0x1908u, 0x8058u, 0x1908u, 15u, 7u, 0u, 2u, 1u, 4u, 0u})
+  {
+    u32(v);
+  }
+
+  for(uint32_t mip = 0; mip < 4; mip++)
+  {
+    uint32_t rowSize = std::max(1u, 15u >> mip) * 4;
+    uint32_t rows    = std::max(1u, 7u >> mip);
+    u32(rowSize * rows * 2);
+    for(uint32_t layer = 0; layer < 2; layer++)
+    {
+      for(uint32_t i = 0; i < rowSize * rows; i++)
+      {
+        bytes.push_back(char(mip * 50 + layer * 13 + i));
+      }
+    }
+  }
+  return bytes;
+}
+
+static bool sameImage(const KTXImage& a, const KTXImage& b)
+{
+  if(a.format != b.format || a.mip_0_width != b.mip_0_width || a.mip_0_height != b.mip_0_height
+     || a.mip_0_depth != b.mip_0_depth || a.num_mips != b.num_mips
+     || a.num_layers_possibly_0 != b.num_layers_possibly_0 || a.num_faces != b.num_faces
+     || a.key_value_data != b.key_value_data)
+  {
+    return false;
+  }
+  for(uint32_t mip = 0; mip < a.num_mips; mip++)
+  {
+    for(uint32_t layer = 0; layer < numLayers(a); layer++)
+    {
+      for(uint32_t face = 0; face < a.num_faces; face++)
+      {
+        if(const_cast<KTXImage&>(a).subresource(mip, layer, face) != const_cast<KTXImage&>(b).subresource(mip, layer, face))
+        {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static ErrorWithText readStream(KTXImage& image, const std::string& bytes, const ReadSettings& settings)
+{
+  std::istringstream input(bytes, std::ios::binary);
+  return image.readFromStream(input, settings);
+}
+
+static void testReaders(const std::string& bytes, const std::string& filename)
+{
+  KTXImage     reference;
+  ReadSettings settings;
+  CHECK(!readStream(reference, bytes, settings));
+
+  for(uint32_t numThreads : {1u, 3u, 0u})
+  {
+    settings.num_threads = numThreads;
+
+    KTXImage memory;
+    CHECK(!memory.readFromMemory(bytes.data(), bytes.size(), settings));
+    CHECK(sameImage(memory, reference));
+
+#if NV_KTX_SUPPORTS_FILEMAPPING
+    KTXImage mapped;
+    CHECK(!mapped.readFromMappedFile(filename.c_str(), settings));
+    CHECK(sameImage(mapped, reference));
+#endif
+  }
+}
+
+typedef std::tuple<uint32_t, uint32_t, uint32_t> SubresourceIndex;
+
+// every mip range on the stream and memory reader, the latter also with some
+// subresources written to application memory
+static void testMipRanges(const std::string& bytes)
+{
+  KTXImage reference;
+  CHECK(!readStream(reference, bytes, ReadSettings()));
+
+  std::vector<char> arena;
+  for(uint32_t firstMip = 0; firstMip <= reference.num_mips; firstMip++)
+  {
+    for(uint32_t mipCount : {0u, 1u, 2u, 100u, UINT32_MAX})
+    {
+      // stream, memory, memory with destination callback
+      for(int mode = 0; mode < 3; mode++)
+      {
+        ReadSettings settings;
+        settings.first_mip   = firstMip;
+        settings.mip_count   = mipCount;
+        settings.num_threads = 4;
+
+        std::mutex                                                     destinationMutex;
+        std::map<SubresourceIndex, std::pair<const char*, size_t>>     destinations;
+        std::atomic<size_t>                                            arenaUsed{0};
+        bool                                                           duplicateCall = false;
+        arena.resize(bytes.size() * 8 + (16 << 20));
+        if(mode == 2)
+        {
+          // called from the decoding threads
+          settings.subresource_destination = [&](uint32_t mip, uint32_t layer, uint32_t face, size_t size) -> char* {
+            if((mip + layer + face) % 3 == 0)
+            {
+              // these stay in the KTXImage
+              return nullptr;
+            }
+            char* destination = arena.data() + arenaUsed.fetch_add(size);
+
+            std::lock_guard<std::mutex> lock(destinationMutex);
+            duplicateCall = duplicateCall || destinations.count({mip, layer, face}) != 0;
+            destinations[{mip, layer, face}] = {destination, size};
+            return destination;
+          };
+        }
+
+        KTXImage image;
+        if(mode == 0)
+        {
+          CHECK(!readStream(image, bytes, settings));
+        }
+        else
+        {
+          CHECK(!image.readFromMemory(bytes.data(), bytes.size(), settings));
+        }
+        CHECK(!duplicateCall);
+        CHECK(arenaUsed.load() <= arena.size());
+        CHECK(image.num_mips == reference.num_mips);
+        if(image.num_mips != reference.num_mips)
+        {
+          continue;
+        }
+
+        uint64_t endMip = std::min<uint64_t>(reference.num_mips, uint64_t(firstMip) + mipCount);
+        for(uint32_t mip = 0; mip < reference.num_mips; mip++)
+        {
+          bool inRange = mip >= firstMip && mip < endMip;
+          for(uint32_t layer = 0; layer < numLayers(reference); layer++)
+          {
+            for(uint32_t face = 0; face < reference.num_faces; face++)
+            {
+              const std::vector<char>& subresource = image.subresource(mip, layer, face);
+              const std::vector<char>& expected    = reference.subresource(mip, layer, face);
+
+              auto it = destinations.find({mip, layer, face});
+              if(it != destinations.end())
+              {
+                CHECK(inRange && subresource.empty() && it->second.second == expected.size()
+                      && memcmp(it->second.first, expected.data(), expected.size()) == 0);
+              }
+              else if(inRange)
+              {
+                CHECK(subresource == expected);
+              }
+              else
+              {
+                CHECK(subresource.empty());
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// truncated input must fail on both paths, whether or not the size is validated up front
+static void testTruncated(const std::string& bytes)
+{
+  for(bool validate : {true, false})
+  {
+    ReadSettings settings;
+    settings.validate_input_size = validate;
+    for(size_t cut : {bytes.size() - 1, bytes.size() / 2, size_t(200), size_t(80), size_t(12), size_t(0)})
+    {
+      KTXImage memory;
+      CHECK(memory.readFromMemory(bytes.data(), cut, settings).has_value());
+
+      KTXImage stream;
+      CHECK(readStream(stream, bytes.substr(0, cut), settings).has_value());
+    }
+  }
+}
+
+static void testFile(const char* name, const std::string& bytes)
+{
+  s_currentName        = name;
+  std::string filename = std::string("test_ktx_") + name + ".ktx";
+  std::replace(filename.begin(), filename.end(), ' ', '_');
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+  }
+
+  testReaders(bytes, filename);
+  testMipRanges(bytes);
+  testTruncated(bytes);
+
+  remove(filename.c_str());
+}
+
+int main()
+{
+  for(const TestImage& test : s_images)
+  {
+    std::string bytes;
+    s_currentName = test.name;
+    CHECK(writeImage(test, bytes));
+    testFile(test.name, bytes);
+  }
+  testFile("ktx1", makeKTX1());
+
+  if(s_failures)
+  {
+    printf("test_ktx: %d failures\n", s_failures);
+    return 1;
+  }
+  printf("test_ktx: passed\n");
+  return 0;
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// nvvk::DeviceMemoryAllocator without a GPU. The Vulkan entry points it calls
+// are defined here and back device memory with host memory, so allocation,
+// binning, mapping and defragmentation (including the copies) are exercised
+// for all strategies, and the data of every allocation is verified.
+
+#include <nvvk/memorymanagement_vk.hpp>
+
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failed = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    if(s_failed++ < 10)                                                                                                \
+      printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond);                                                 \
+  }
+
+//////////////////////////////////////////////////////////////////////////
+// fake device
+
+struct FakeMemory
+{
+  std::vector<uint8_t> data;
+};
+
+struct FakeBuffer
+{
+  VkDeviceSize size   = 0;
+  FakeMemory*  memory = nullptr;
+  VkDeviceSize offset = 0;
+};
+
+static int s_liveMemory  = 0;
+static int s_liveBuffers = 0;
+
+template <typename T>
+static T* fromHandle(uint64_t handle)
+{
+  return (T*)(uintptr_t)handle;
+}
+
+static FakeMemory* fromHandle(VkDeviceMemory memory)
+{
+  return fromHandle<FakeMemory>((uint64_t)memory);
+}
+
+static FakeBuffer* fromHandle(VkBuffer buffer)
+{
+  return fromHandle<FakeBuffer>((uint64_t)buffer);
+}
+
+static void unexpectedCall(const char* name)
+{
+  printf("unexpected call of %s\n", name);
+  abort();
+}
+
+extern "C" {
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+{
+  FakeMemory* memory = new FakeMemory;
+  memory->data.resize(size_t(pAllocateInfo->allocationSize));
+  *pMemory = (VkDeviceMemory)(uintptr_t)memory;
+  s_liveMemory++;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+  delete fromHandle(memory);
+  s_liveMemory--;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData)
+{
+  *ppData = fromHandle(memory)->data.data() + offset;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkBuffer* pBuffer)
+{
+  FakeBuffer* buffer = new FakeBuffer;
+  buffer->size       = pCreateInfo->size;
+  *pBuffer           = (VkBuffer)(uintptr_t)buffer;
+  s_liveBuffers++;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+{
+  delete fromHandle(buffer);
+  s_liveBuffers--;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements)
+{
+  pMemoryRequirements->size           = fromHandle(buffer)->size;
+  pMemoryRequirements->alignment      = 256;
+  pMemoryRequirements->memoryTypeBits = 3;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements2(VkDevice device, const VkBufferMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements)
+{
+  vkGetBufferMemoryRequirements(device, pInfo->buffer, &pMemoryRequirements->memoryRequirements);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+{
+  FakeBuffer* fake = fromHandle(buffer);
+  fake->memory     = fromHandle(memory);
+  fake->offset     = memoryOffset;
+  CHECK(fake->offset + fake->size <= fake->memory->data.size());
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory2(VkDevice device, uint32_t bindInfoCount, const VkBindBufferMemoryInfo* pBindInfos)
+{
+  for(uint32_t i = 0; i < bindInfoCount; i++)
+  {
+    vkBindBufferMemory(device, pBindInfos[i].buffer, pBindInfos[i].memory, pBindInfos[i].memoryOffset);
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBuffer(VkCommandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions)
+{
+  // executed immediately, the allocator only records copies between block buffers
+  FakeBuffer* src = fromHandle(srcBuffer);
+  FakeBuffer* dst = fromHandle(dstBuffer);
+  for(uint32_t i = 0; i < regionCount; i++)
+  {
+    const VkBufferCopy& region = pRegions[i];
+    CHECK(region.srcOffset + region.size <= src->size && region.dstOffset + region.size <= dst->size);
+    memcpy(dst->memory->data.data() + dst->offset + region.dstOffset,
+           src->memory->data.data() + src->offset + region.srcOffset, size_t(region.size));
+  }
+}
+
+// not used by the paths tested here
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo*, const VkAllocationCallbacks*, VkImage*)
+{
+  unexpectedCall("vkCreateImage");
+  return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage, const VkAllocationCallbacks*)
+{
+  unexpectedCall("vkDestroyImage");
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements2(VkDevice, const VkImageMemoryRequirementsInfo2*, VkMemoryRequirements2*)
+{
+  unexpectedCall("vkGetImageMemoryRequirements2");
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory2(VkDevice, uint32_t, const VkBindImageMemoryInfo*)
+{
+  unexpectedCall("vkBindImageMemory2");
+  return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties*)
+{
+  unexpectedCall("vkGetPhysicalDeviceMemoryProperties");
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties2(VkPhysicalDevice, VkPhysicalDeviceProperties2*)
+{
+  unexpectedCall("vkGetPhysicalDeviceProperties2");
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkSetDebugUtilsObjectNameEXT(VkDevice, const VkDebugUtilsObjectNameInfoEXT*)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginDebugUtilsLabelEXT(VkCommandBuffer, const VkDebugUtilsLabelEXT*) {}
+VKAPI_ATTR void VKAPI_CALL vkCmdEndDebugUtilsLabelEXT(VkCommandBuffer) {}
+VKAPI_ATTR void VKAPI_CALL vkCmdInsertDebugUtilsLabelEXT(VkCommandBuffer, const VkDebugUtilsLabelEXT*) {}
+
+#if VK_NV_ray_tracing
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateAccelerationStructureNV(VkDevice, const VkAccelerationStructureCreateInfoNV*, const VkAllocationCallbacks*, VkAccelerationStructureNV*)
+{
+  unexpectedCall("vkCreateAccelerationStructureNV");
+  return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyAccelerationStructureNV(VkDevice, VkAccelerationStructureNV, const VkAllocationCallbacks*)
+{
+  unexpectedCall("vkDestroyAccelerationStructureNV");
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetAccelerationStructureMemoryRequirementsNV(VkDevice, const VkAccelerationStructureMemoryRequirementsInfoNV*, VkMemoryRequirements2KHR*)
+{
+  unexpectedCall("vkGetAccelerationStructureMemoryRequirementsNV");
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindAccelerationStructureMemoryNV(VkDevice, uint32_t, const VkBindAccelerationStructureMemoryInfoNV*)
+{
+  unexpectedCall("vkBindAccelerationStructureMemoryNV");
+  return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+class TestAllocator : public nvvk::DeviceMemoryAllocator
+{
+public:
+  uint8_t* getPointer(nvvk::AllocationID id)
+  {
+    const nvvk::Allocation& allocation = getAllocation(id);
+    return fromHandle(allocation.mem)->data.data() + allocation.offset;
+  }
+
+  // internal consistency, live holds all allocations that were not freed
+  void validate(const std::vector<nvvk::AllocationID>& live)
+  {
+    for(uint32_t i = 0; i < uint32_t(m_blocks.size()); i++)
+    {
+      Block& block     = m_blocks[i];
+      bool   shouldBin = m_strategy != STRATEGY_FIRST_FIT && block.mem && !block.isDedicated && !block.isDefragSource
+                       && block.range.getLargestFree();
+      CHECK(block.isBinned == shouldBin);
+      if(block.isBinned && shouldBin)
+      {
+        uint32_t fl;
+        uint32_t sl;
+        binMapping(block.range.getLargestFree(), fl, sl);
+        CHECK(fl == block.binFL && sl == block.binSL);
+
+        const BlockPool& pool = m_blockPools[block.poolIndex];
+        bool             found = false;
+        for(uint32_t b = pool.binHeads[fl][sl]; b != nvvk::INVALID_ID_INDEX; b = m_blocks[b].binNext)
+        {
+          found = found || b == i;
+        }
+        CHECK(found);
+      }
+      if(block.mem)
+      {
+        CHECK(block.usedSize == block.range.getUsedSize());
+      }
+    }
+
+    for(const BlockPool& pool : m_blockPools)
+    {
+      for(uint32_t fl = 0; fl < BIN_FL_COUNT; fl++)
+      {
+        CHECK(bool(pool.flBitmap & (1u << fl)) == bool(pool.slBitmaps[fl]));
+        for(uint32_t sl = 0; sl < BIN_SL_MAX; sl++)
+        {
+          CHECK(bool(pool.slBitmaps[fl] & (1u << sl)) == (pool.binHeads[fl][sl] != nvvk::INVALID_ID_INDEX));
+        }
+      }
+    }
+
+    // allocations are aligned, within their block and do not overlap
+    std::map<std::pair<uint64_t, VkDeviceSize>, VkDeviceSize> ranges;
+    VkDeviceSize                                              usedSize = 0;
+    for(const nvvk::AllocationID& id : live)
+    {
+      const AllocationInfo& info = getInfo(id);
+      CHECK(info.allocation.offset % info.alignment == 0);
+      CHECK(info.allocation.mem == getBlock(info.block).mem);
+      CHECK(info.allocation.offset + info.allocation.size <= fromHandle(info.allocation.mem)->data.size());
+      ranges[{(uint64_t)info.allocation.mem, info.allocation.offset}] = info.allocation.size;
+      usedSize += info.blockSize;
+    }
+    for(const DefragMoveInternal& move : m_defragMoves)
+    {
+      usedSize += move.dstBlockSize;
+    }
+    CHECK(usedSize == m_usedSize);
+
+    uint64_t     lastMem = 0;
+    VkDeviceSize lastEnd = 0;
+    for(auto& it : ranges)
+    {
+      if(it.first.first == lastMem)
+      {
+        CHECK(it.first.second >= lastEnd);
+      }
+      lastMem = it.first.first;
+      lastEnd = it.first.second + it.second;
+    }
+  }
+};
+
+static VkPhysicalDeviceMemoryProperties makeMemoryProperties()
+{
+  VkPhysicalDeviceMemoryProperties properties = {};
+  properties.memoryTypeCount                  = 2;
+  properties.memoryTypes[0].propertyFlags     = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  properties.memoryTypes[0].heapIndex         = 0;
+  properties.memoryTypes[1].propertyFlags     = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  properties.memoryTypes[1].heapIndex         = 1;
+  properties.memoryHeapCount                  = 2;
+  properties.memoryHeaps[0].size              = 1ull << 34;
+  properties.memoryHeaps[1].size              = 1ull << 34;
+  return properties;
+}
+
+struct LiveAllocation
+{
+  nvvk::AllocationID id;
+  uint32_t           size;
+  uint8_t            tag;
+};
+
+static bool verifyContent(TestAllocator& allocator, const LiveAllocation& live)
+{
+  const uint8_t* data = allocator.getPointer(live.id);
+  for(uint32_t i = 0; i < live.size; i++)
+  {
+    if(data[i] != live.tag)
+      return false;
+  }
+  return true;
+}
+
+static std::vector<nvvk::AllocationID> getIDs(const std::vector<LiveAllocation>& live)
+{
+  std::vector<nvvk::AllocationID> ids;
+  for(const LiveAllocation& it : live)
+  {
+    ids.push_back(it.id);
+  }
+  return ids;
+}
+
+static void testStrategy(nvvk::DeviceMemoryAllocator::Strategy strategy, const char* name)
+{
+  const VkDevice device = (VkDevice)(uintptr_t)1;
+
+  TestAllocator allocator;
+  allocator.init(device, makeMemoryProperties(), 1ull << 32, 1024 * 1024);
+  allocator.setStrategy(strategy);
+
+  std::mt19937                rng(42);
+  std::vector<LiveAllocation> live;
+
+  // random alloc/free churn, every allocation is filled with its own tag
+  for(int iteration = 0; iteration < 20000; iteration++)
+  {
+    if(live.size() < 1000 && (rng() % 3 != 0 || live.empty()))
+    {
+      VkMemoryRequirements req = {};
+      req.size                 = 1 + rng() % ((rng() % 8) ? 16384 : 400000);
+      req.alignment            = VkDeviceSize(1) << (rng() % 12);
+      req.memoryTypeBits       = 3;
+
+      bool host   = rng() % 4 == 0;
+      bool linear = rng() % 5 != 0;
+
+      LiveAllocation allocation;
+      allocation.id   = allocator.alloc(req, host ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, linear);
+      allocation.size = uint32_t(req.size);
+      allocation.tag  = uint8_t(rng());
+      CHECK(allocation.id.isValid());
+      if(!allocation.id.isValid())
+        continue;
+
+      memset(allocator.getPointer(allocation.id), allocation.tag, allocation.size);
+      live.push_back(allocation);
+    }
+    else
+    {
+      size_t i = rng() % live.size();
+      allocator.free(live[i].id);
+      live[i] = live.back();
+      live.pop_back();
+    }
+
+    if(iteration % 997 == 0)
+    {
+      allocator.validate(getIDs(live));
+    }
+    if(iteration == 10000)
+    {
+      // re-binning of the existing blocks
+      allocator.setStrategy(nvvk::DeviceMemoryAllocator::Strategy((strategy + 1) % 3));
+      allocator.validate(getIDs(live));
+      allocator.setStrategy(strategy);
+      allocator.validate(getIDs(live));
+    }
+  }
+
+  for(const LiveAllocation& it : live)
+  {
+    CHECK(verifyContent(allocator, it));
+  }
+
+  // mapping a host visible buffer
+  {
+    nvvk::AllocationID id;
+    VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    createInfo.size               = 1000;
+    createInfo.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    VkBuffer buffer               = allocator.createBuffer(createInfo, id, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    CHECK(buffer != VK_NULL_HANDLE && id.isValid());
+
+    uint8_t* mapped = allocator.mapT<uint8_t>(id);
+    CHECK(mapped == allocator.getPointer(id));
+    allocator.unmap(id);
+
+    vkDestroyBuffer(device, buffer, nullptr);
+    allocator.free(id);
+  }
+
+  // fragment the blocks, then defragment incrementally
+  for(size_t i = 0; i < live.size();)
+  {
+    if(rng() % 10 < 7)
+    {
+      allocator.free(live[i].id);
+      live[i] = live.back();
+      live.pop_back();
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  VkDeviceSize allocatedSize;
+  VkDeviceSize usedSize;
+  float        utilBefore   = allocator.getUtilization(allocatedSize, usedSize);
+  uint32_t     blocksBefore = allocator.getActiveBlockCount();
+
+  std::vector<nvvk::DeviceMemoryAllocator::DefragMove> moves;
+  size_t                                               numMoves  = 0;
+  int                                                  numRounds = 0;
+  bool                                                 cancelled = false;
+  while(allocator.defragBegin(moves, 4 * 1024 * 1024) && numRounds < 1000)
+  {
+    allocator.validate(getIDs(live));
+    allocator.defragCmdCopy((VkCommandBuffer)(uintptr_t)1);
+
+    if(!cancelled)
+    {
+      // the sources must stay untouched
+      cancelled = true;
+      allocator.defragCancel();
+      allocator.validate(getIDs(live));
+      for(const LiveAllocation& it : live)
+      {
+        CHECK(verifyContent(allocator, it));
+      }
+      continue;
+    }
+
+    allocator.defragEnd();
+    allocator.validate(getIDs(live));
+    CHECK(s_liveBuffers == 0);
+    for(const nvvk::DeviceMemoryAllocator::DefragMove& move : moves)
+    {
+      const nvvk::Allocation& allocation = allocator.getAllocation(move.id);
+      CHECK(allocation.mem == move.dst.mem && allocation.offset == move.dst.offset);
+    }
+    numMoves += moves.size();
+    numRounds++;
+  }
+  CHECK(numRounds < 1000);
+  CHECK(s_liveBuffers == 0);
+
+  for(const LiveAllocation& it : live)
+  {
+    CHECK(verifyContent(allocator, it));
+  }
+
+  float utilAfter = allocator.getUtilization(allocatedSize, usedSize);
+  printf("%-10s: blocks %u -> %u, utilization %.2f -> %.2f, %zu moves in %d rounds\n", name, blocksBefore,
+         allocator.getActiveBlockCount(), utilBefore, utilAfter, numMoves, numRounds);
+  CHECK(utilAfter >= utilBefore);
+
+  for(const LiveAllocation& it : live)
+  {
+    allocator.free(it.id);
+  }
+  allocator.validate({});
+  allocator.deinit();
+  CHECK(s_liveMemory == 0);
+}
+
+int main()
+{
+  testStrategy(nvvk::DeviceMemoryAllocator::STRATEGY_FIRST_FIT, "first-fit");
+  testStrategy(nvvk::DeviceMemoryAllocator::STRATEGY_SEGREGATED, "segregated");
+  testStrategy(nvvk::DeviceMemoryAllocator::STRATEGY_TLSF, "tlsf");
+
+  printf(s_failed ? "FAILED\n" : "passed\n");
+  return s_failed ? 1 : 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Checks the asynchronous mode of nvprint: with a full queue messages are
+// dropped and counted, or the callers wait when blockWhenFull is set, no
+// message gets lost when async mode is turned off while other threads print,
+// and log rotation keeps the files within the size limit in either mode.
+//
+// The console output goes to the null device, results are printed to stderr.
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    fprintf(stderr, "test_nvprint: %s failed (line %d)\n", #cond, __LINE__);                                           \
+    s_failures++;                                                                                                      \
+  }
+
+static const uint32_t NUM_THREADS = 4;
+
+// messages "t<thread> <index>" seen by the callback, per thread
+static std::mutex                         s_receivedMutex;
+static std::vector<std::vector<uint32_t>> s_received(NUM_THREADS);
+// the callback holds the output back while the gate is closed
+static std::atomic<bool>     s_gateOpen{true};
+static std::atomic<uint32_t> s_printed{0};
+
+static void printCallback(int /*level*/, const char* text)
+{
+  uint32_t thread;
+  uint32_t index;
+  if(sscanf(text, "t%u %u", &thread, &index) != 2 || thread >= NUM_THREADS)
+  {
+    return;
+  }
+
+  while(!s_gateOpen.load())
+  {
+    std::this_thread::yield();
+  }
+
+  std::lock_guard<std::mutex> lock(s_receivedMutex);
+  s_received[thread].push_back(index);
+}
+
+static void resetReceived()
+{
+  std::lock_guard<std::mutex> lock(s_receivedMutex);
+  for(auto& received : s_received)
+  {
+    received.clear();
+  }
+  s_printed = 0;
+}
+
+// padding makes formatting slower and widens the window between checking
+// for async mode and publishing the message
+static void printThreads(uint32_t numMessages, std::vector<std::thread>& threads, int padding = 0)
+{
+  for(uint32_t t = 0; t < NUM_THREADS; t++)
+  {
+    threads.emplace_back([t, numMessages, padding] {
+      for(uint32_t i = 0; i < numMessages; i++)
+      {
+        LOGI("t%u %u%*s\n", t, i, padding, "");
+        s_printed++;
+      }
+    });
+  }
+}
+
+static void joinThreads(std::vector<std::thread>& threads)
+{
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+  threads.clear();
+}
+
+// counts the received messages, each thread's must be in order
+static uint64_t countReceivedInOrder()
+{
+  std::lock_guard<std::mutex> lock(s_receivedMutex);
+  uint64_t                    count = 0;
+  for(auto& received : s_received)
+  {
+    CHECK(std::is_sorted(received.begin(), received.end()));
+    CHECK(std::adjacent_find(received.begin(), received.end()) == received.end());
+    count += received.size();
+  }
+  return count;
+}
+
+static void testDrop()
+{
+  const uint32_t numMessages = 2000;
+  resetReceived();
+
+  // the writer is stuck in the callback, so the small queue overflows
+  s_gateOpen = false;
+  nvprintSetAsync(true, 512, false);
+  uint64_t droppedBegin = nvprintGetNumDropped();
+
+  std::vector<std::thread> threads;
+  printThreads(numMessages, threads);
+  joinThreads(threads);
+
+  s_gateOpen = true;
+  nvprintFlush();
+  uint64_t dropped = nvprintGetNumDropped() - droppedBegin;
+  nvprintSetAsync(false);
+
+  uint64_t received = countReceivedInOrder();
+  CHECK(dropped > 0);
+  CHECK(received > 0);
+  CHECK(received + dropped == uint64_t(NUM_THREADS) * numMessages);
+}
+
+static void testBlock()
+{
+  const uint32_t numMessages = 2000;
+  resetReceived();
+
+  s_gateOpen = false;
+  nvprintSetAsync(true, 512, true);
+  uint64_t droppedBegin = nvprintGetNumDropped();
+
+  std::vector<std::thread> threads;
+  printThreads(numMessages, threads);
+
+  // the producers must wait for the writer
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  uint32_t printedBeforeOpen = s_printed.load();
+  s_gateOpen                 = true;
+  joinThreads(threads);
+
+  nvprintFlush();
+  uint64_t dropped = nvprintGetNumDropped() - droppedBegin;
+  nvprintSetAsync(false);
+
+  CHECK(printedBeforeOpen < NUM_THREADS * numMessages);
+  CHECK(dropped == 0);
+  CHECK(countReceivedInOrder() == uint64_t(NUM_THREADS) * numMessages);
+}
+
+// async mode is turned off while the threads print, messages that are in
+// flight at that moment must still come out exactly once
+static void testShutdownRace()
+{
+  const uint32_t numMessages = 300;
+  const uint32_t numRounds   = 100;
+
+  for(uint32_t round = 0; round < numRounds; round++)
+  {
+    resetReceived();
+    nvprintSetAsync(true, 1 << 20, true);
+
+    std::vector<std::thread> threads;
+    printThreads(numMessages, threads, 8192);
+
+    uint32_t stopAfter = (round * 37) % (NUM_THREADS * numMessages);
+    while(s_printed.load() < stopAfter)
+    {
+      std::this_thread::yield();
+    }
+    nvprintSetAsync(false);
+    joinThreads(threads);
+
+    // messages printed synchronously may overtake queued ones, so only check completeness
+    std::lock_guard<std::mutex> lock(s_receivedMutex);
+    for(auto& received : s_received)
+    {
+      std::sort(received.begin(), received.end());
+      bool complete = received.size() == numMessages;
+      for(uint32_t i = 0; complete && i < numMessages; i++)
+      {
+        complete = received[i] == i;
+      }
+      CHECK(complete);
+    }
+  }
+}
+
+static bool readLines(const std::string& filename, std::vector<std::string>& lines, size_t& size)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if(!file)
+  {
+    return false;
+  }
+  std::string line;
+  size = 0;
+  while(std::getline(file, line))
+  {
+    size += line.size() + 1;
+    lines.push_back(line);
+  }
+  return true;
+}
+
+static void testRotation(bool async)
+{
+  const std::string name     = async ? "test_nvprint_rotation_async.txt" : "test_nvprint_rotation.txt";
+  const size_t      maxSize  = 1000;
+  const uint32_t    numLines = 100;
+  for(uint32_t i = 0; i <= 3; i++)
+  {
+    remove(i ? (name + "." + std::to_string(i)).c_str() : name.c_str());
+  }
+
+  nvprintSetLogFileName(name.c_str());
+  nvprintSetLogRotation(maxSize, 2);
+  if(async)
+  {
+    nvprintSetAsync(true, 1 << 20, true);
+  }
+
+  // 32 bytes each, 31 lines fit into one file
+  for(uint32_t i = 0; i < numLines; i++)
+  {
+    LOGI("rotation %05u abcdefghijklmnop\n", i);
+  }
+
+  nvprintFlush();
+  nvprintSetAsync(false);
+  nvprintSetLogRotation(0);
+  // closes the file
+  nvprintSetLogFileName("test_nvprint.txt");
+
+  // oldest first
+  std::vector<std::string> lines;
+  const char*              suffixes[] = {".2", ".1", ""};
+  for(const char* suffix : suffixes)
+  {
+    size_t size = 0;
+    CHECK(readLines(name + suffix, lines, size));
+    CHECK(size > 0 && size <= maxSize);
+  }
+  std::vector<std::string> unused;
+  size_t                   unusedSize;
+  CHECK(!readLines(name + ".3", unused, unusedSize));
+
+  // the files hold the newest lines 31..99 without gaps
+  CHECK(lines.size() == numLines - 31);
+  for(size_t i = 0; i < lines.size(); i++)
+  {
+    char expected[64];
+    snprintf(expected, sizeof(expected), "rotation %05u abcdefghijklmnop", uint32_t(numLines - lines.size() + i));
+    CHECK(lines[i] == expected);
+  }
+
+  for(uint32_t i = 0; i <= 2; i++)
+  {
+    remove(i ? (name + "." + std::to_string(i)).c_str() : name.c_str());
+  }
+}
+
+int main()
+{
+  if(!freopen(NULL_DEVICE, "w", stdout))
+  {
+    fprintf(stderr, "test_nvprint: cannot redirect stdout\n");
+    return 1;
+  }
+  nvprintSetLogFileName("test_nvprint.txt");
+  nvprintSetCallback(printCallback);
+
+  testDrop();
+  testBlock();
+  testShutdownRace();
+  testRotation(false);
+  testRotation(true);
+
+  nvprintSetCallback(nullptr);
+  nvprintSetLogFileName("test_nvprint_end.txt");
+  remove("test_nvprint.txt");
+
+  if(s_failures)
+  {
+    fprintf(stderr, "test_nvprint: %d failures\n", s_failures);
+    return 1;
+  }
+  fprintf(stderr, "test_nvprint: passed\n");
+  return 0;
+}
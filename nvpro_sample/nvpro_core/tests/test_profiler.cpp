@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Checks that nvh::Profiler traces are well-formed json with properly nested
+// sections, that the sections of other threads survive many wraparounds of
+// their ring buffer and are dropped, not corrupted, when it overflows, and the
+// percentiles of the timer histogram on known distributions.
+
+#include <nvh/profiler.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <ctype.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_profiler: %s failed (line %d)\n", #cond, __LINE__);                                                   \
+    s_failures++;                                                                                                      \
+  }
+
+//////////////////////////////////////////////////////////////////////////
+// minimal strict json parser
+
+struct JsonValue
+{
+  enum Type
+  {
+    NUL,
+    BOOL,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT,
+  } type = NUL;
+
+  double                           number = 0;
+  std::string                      string;
+  std::vector<JsonValue>           array;
+  std::map<std::string, JsonValue> object;
+
+  const JsonValue* get(const char* key) const
+  {
+    auto it = object.find(key);
+    return it != object.end() ? &it->second : nullptr;
+  }
+};
+
+struct JsonParser
+{
+  const char* ptr;
+  const char* end;
+
+  void skipSpace()
+  {
+    while(ptr < end && (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t'))
+      ptr++;
+  }
+
+  bool literal(const char* text)
+  {
+    size_t len = strlen(text);
+    if(size_t(end - ptr) < len || strncmp(ptr, text, len) != 0)
+      return false;
+    ptr += len;
+    return true;
+  }
+
+  bool parseString(std::string& result)
+  {
+    if(ptr >= end || *ptr != '"')
+      return false;
+    for(ptr++; ptr < end; ptr++)
+    {
+      unsigned char c = *ptr;
+      if(c == '"')
+      {
+        ptr++;
+        return true;
+      }
+      // control characters must be escaped
+      if(c < 0x20)
+        return false;
+      if(c == '\\')
+      {
+        if(++ptr >= end)
+          return false;
+        switch(*ptr)
+        {
+          case '"':
+          case '\\':
+          case '/':
+            result += *ptr;
+            break;
+          case 'n':
+            result += '\n';
+            break;
+          case 't':
+            result += '\t';
+            break;
+          default:
+            // \b \f \r \uXXXX are never written by the profiler
+            return false;
+        }
+      }
+      else
+      {
+        result += char(c);
+      }
+    }
+    return false;
+  }
+
+  bool parseValue(JsonValue& value)
+  {
+    skipSpace();
+    if(ptr >= end)
+      return false;
+    if(*ptr == '{')
+    {
+      value.type = JsonValue::OBJECT;
+      ptr++;
+      skipSpace();
+      if(ptr < end && *ptr == '}')
+      {
+        ptr++;
+        return true;
+      }
+      for(;;)
+      {
+        std::string key;
+        skipSpace();
+        if(!parseString(key))
+          return false;
+        skipSpace();
+        if(ptr >= end || *ptr++ != ':')
+          return false;
+        // no duplicate keys
+        if(value.object.count(key) || !parseValue(value.object[key]))
+          return false;
+        skipSpace();
+        if(ptr < end && *ptr == ',')
+        {
+          ptr++;
+          continue;
+        }
+        return ptr < end && *ptr++ == '}';
+      }
+    }
+    if(*ptr == '[')
+    {
+      value.type = JsonValue::ARRAY;
+      ptr++;
+      skipSpace();
+      if(ptr < end && *ptr == ']')
+      {
+        ptr++;
+        return true;
+      }
+      for(;;)
+      {
+        value.array.emplace_back();
+        if(!parseValue(value.array.back()))
+          return false;
+        skipSpace();
+        if(ptr < end && *ptr == ',')
+        {
+          ptr++;
+          continue;
+        }
+        return ptr < end && *ptr++ == ']';
+      }
+    }
+    if(*ptr == '"')
+    {
+      value.type = JsonValue::STRING;
+      return parseString(value.string);
+    }
+    if(literal("true") || literal("false"))
+    {
+      value.type = JsonValue::BOOL;
+      return true;
+    }
+    if(literal("null"))
+    {
+      return true;
+    }
+    // json numbers have no leading '+', no leading zeros, no trailing '.'
+    const char* begin = ptr;
+    if(ptr < end && *ptr == '-')
+      ptr++;
+    if(ptr >= end || !isdigit((unsigned char)*ptr) || (*ptr == '0' && ptr + 1 < end && isdigit((unsigned char)ptr[1])))
+      return false;
+    while(ptr < end && isdigit((unsigned char)*ptr))
+      ptr++;
+    if(ptr < end && *ptr == '.')
+    {
+      ptr++;
+      if(ptr >= end || !isdigit((unsigned char)*ptr))
+        return false;
+      while(ptr < end && isdigit((unsigned char)*ptr))
+        ptr++;
+    }
+    value.type   = JsonValue::NUMBER;
+    value.number = strtod(std::string(begin, ptr).c_str(), nullptr);
+    return true;
+  }
+
+  bool parseDocument(JsonValue& value)
+  {
+    if(!parseValue(value))
+      return false;
+    skipSpace();
+    return ptr == end;
+  }
+};
+
+static bool loadJson(const char* filename, JsonValue& value)
+{
+  FILE* file = fopen(filename, "rb");
+  if(!file)
+    return false;
+  std::string text;
+  char        buffer[4096];
+  size_t      read;
+  while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    text.append(buffer, read);
+  }
+  fclose(file);
+
+  JsonParser parser = {text.data(), text.data() + text.size()};
+  return parser.parseDocument(value);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+struct TraceEvent
+{
+  std::string name;
+  uint32_t    tid;
+  double      ts;
+  double      dur;
+};
+
+static void testTrace()
+{
+  const char* filename       = "test_profiler.json";
+  const char* innerName      = "Inner \"quoted\" \\ back";
+  const char* controlName    = "Control\x01\x1f";
+  const int   numFrames      = 40;
+  const int   overflowFrame  = 20;
+  const int   threadSections = 700;
+  const int   overflowCount  = 3000;
+
+  nvh::Profiler profiler;
+  CHECK(profiler.beginTrace(filename));
+
+  // records the sections of a frame while the frame thread waits
+  std::atomic<int> requested{-1};
+  std::atomic<int> done{-1};
+  std::thread      worker([&]() {
+    for(int frame = 0; frame < numFrames; frame++)
+    {
+      while(requested.load() != frame)
+        std::this_thread::yield();
+      int count = frame == overflowFrame ? overflowCount : threadSections;
+      for(int i = 0; i < count; i++)
+      {
+        nvh::Profiler::Section section(profiler, "Work");
+      }
+      done.store(frame);
+    }
+  });
+
+  std::string stats;
+  std::string overflowStats;
+  for(int frame = 0; frame < numFrames; frame++)
+  {
+    profiler.beginFrame();
+    {
+      nvh::Profiler::Section outer(profiler, "Outer");
+      {
+        nvh::Profiler::Section inner(profiler, innerName);
+      }
+      {
+        nvh::Profiler::Section control(profiler, controlName);
+      }
+      requested.store(frame);
+      while(done.load() != frame)
+        std::this_thread::yield();
+    }
+    profiler.endFrame();
+
+    if(frame == overflowFrame)
+    {
+      profiler.print(overflowStats);
+    }
+  }
+  worker.join();
+  profiler.print(stats);
+  profiler.endTrace();
+  CHECK(!profiler.isTracing());
+
+  // dropped sections are reported for the frame they were dropped in
+  char dropped[128];
+  snprintf(dropped, sizeof(dropped), "dropped sections %d last frame", overflowCount - int(nvh::Profiler::THREAD_SECTIONS));
+  CHECK(overflowStats.find(dropped) != std::string::npos);
+  CHECK(stats.find("dropped") == std::string::npos);
+
+  nvh::Profiler::TimerInfo info;
+  CHECK(profiler.getNumThreads() == 1);
+  CHECK(profiler.getThreadTimerInfo(0, "Work", info));
+
+  JsonValue root;
+  CHECK(loadJson(filename, root));
+  remove(filename);
+
+  const JsonValue* events = root.get("traceEvents");
+  CHECK(root.type == JsonValue::OBJECT && events && events->type == JsonValue::ARRAY);
+  if(!events || events->type != JsonValue::ARRAY)
+    return;
+
+  std::vector<TraceEvent>         sections;
+  std::map<uint32_t, std::string> threadNames;
+  std::map<std::string, int>      counts;
+  for(const JsonValue& event : events->array)
+  {
+    const JsonValue* name = event.get("name");
+    const JsonValue* ph   = event.get("ph");
+    const JsonValue* tid  = event.get("tid");
+    CHECK(name && name->type == JsonValue::STRING && ph && ph->type == JsonValue::STRING && tid && tid->type == JsonValue::NUMBER);
+    if(!name || !ph || !tid)
+      continue;
+
+    if(ph->string == "M")
+    {
+      const JsonValue* args = event.get("args");
+      CHECK(name->string == "thread_name" && args && args->get("name"));
+      if(args && args->get("name"))
+        threadNames[uint32_t(tid->number)] = args->get("name")->string;
+    }
+    else
+    {
+      const JsonValue* ts  = event.get("ts");
+      const JsonValue* dur = event.get("dur");
+      CHECK(ph->string == "X" && ts && ts->type == JsonValue::NUMBER && dur && dur->type == JsonValue::NUMBER);
+      if(!ts || !dur)
+        continue;
+      CHECK(dur->number >= 0);
+      sections.push_back({name->string, uint32_t(tid->number), ts->number, dur->number});
+      counts[name->string]++;
+    }
+  }
+
+  CHECK(threadNames[0] == "Frame" && threadNames[1] == "GPU" && threadNames[16] == "Thread 0");
+
+  // control characters are removed, quotes and backslashes escaped
+  CHECK(counts["Frame"] == numFrames);
+  CHECK(counts["Outer"] == numFrames);
+  CHECK(counts[innerName] == numFrames);
+  CHECK(counts["Control"] == numFrames);
+  // every section that fit into the ring buffer
+  CHECK(counts["Work"] == (numFrames - 1) * threadSections + int(nvh::Profiler::THREAD_SECTIONS));
+
+  // frame thread sections nest within their parents, printed with 3 decimals
+  const double      epsilon    = 0.002;
+  const TraceEvent* frameEvent = nullptr;
+  const TraceEvent* outerEvent = nullptr;
+  for(const TraceEvent& event : sections)
+  {
+    if(event.tid == 16)
+    {
+      CHECK(event.name == "Work");
+      continue;
+    }
+    CHECK(event.tid == 0);
+    if(event.name == "Frame")
+    {
+      frameEvent = &event;
+    }
+    else if(event.name == "Outer")
+    {
+      CHECK(frameEvent && event.ts + epsilon >= frameEvent->ts && event.ts + event.dur <= frameEvent->ts + frameEvent->dur + epsilon);
+      outerEvent = &event;
+    }
+    else
+    {
+      CHECK(outerEvent && event.ts + epsilon >= outerEvent->ts && event.ts + event.dur <= outerEvent->ts + outerEvent->dur + epsilon);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+struct TimeValuesAccess : nvh::Profiler
+{
+  using nvh::Profiler::TimeValues;
+};
+typedef TimeValuesAccess::TimeValues TimeValues;
+
+// bucket centers are within 1/16 power of two of the values in the bucket
+static bool nearValue(double value, double expected)
+{
+  const double tolerance = 1.0444;  // 2^(1/16)
+  return value <= expected * tolerance && value >= expected / tolerance;
+}
+
+static void testPercentiles()
+{
+  TimeValues                values;
+  nvh::Profiler::TimerStats stats;
+
+  values.getStats(stats);
+  CHECK(stats.p50 == 0 && stats.p99 == 0);
+
+  // constant, clamped to the observed range
+  for(int i = 0; i < 1000; i++)
+  {
+    values.add(100.0);
+  }
+  values.getStats(stats);
+  CHECK(stats.p50 == 100.0 && stats.p95 == 100.0 && stats.p99 == 100.0);
+  CHECK(values.getAveraged() == 100.0);
+
+  // uniform
+  values.reset();
+  for(int i = 1; i <= 10000; i++)
+  {
+    values.add(double(i));
+  }
+  values.getStats(stats);
+  CHECK(nearValue(stats.p50, 5000.0));
+  CHECK(nearValue(stats.p95, 9500.0));
+  CHECK(nearValue(stats.p99, 9900.0));
+  CHECK(stats.absMinValue == 1.0 && stats.absMaxValue == 10000.0);
+
+  // bimodal, 90% fast and 10% slow
+  values.reset();
+  for(int i = 0; i < 1000; i++)
+  {
+    values.add(i % 10 == 9 ? 1000.0 : 10.0);
+  }
+  values.getStats(stats);
+  CHECK(nearValue(stats.p50, 10.0));
+  CHECK(nearValue(stats.p95, 1000.0) && stats.p95 <= 1000.0);
+  CHECK(stats.p99 <= 1000.0 && nearValue(stats.p99, 1000.0));
+
+  // exponential, p = -mean * ln(1 - fraction)
+  values.reset();
+  const int    numExp = 100000;
+  const double mean   = 50.0;
+  for(int i = 0; i < numExp; i++)
+  {
+    values.add(-mean * log(1.0 - (double(i) + 0.5) / double(numExp)));
+  }
+  values.getStats(stats);
+  CHECK(nearValue(stats.p50, -mean * log(0.50)));
+  CHECK(nearValue(stats.p95, -mean * log(0.05)));
+  CHECK(nearValue(stats.p99, -mean * log(0.01)));
+
+  // outside of the histogram range, reported as its first and last bucket
+  values.reset();
+  values.add(0.0);
+  values.add(1.0e12);
+  values.getStats(stats);
+  CHECK(nearValue(stats.p50, exp2(TimeValues::HISTOGRAM_MIN_LOG2)));
+  CHECK(nearValue(stats.p99, exp2(TimeValues::HISTOGRAM_MIN_LOG2 + double(TimeValues::HISTOGRAM_SIZE) / TimeValues::HISTOGRAM_STEPS)));
+
+  // the average is over the cyclic window, the histogram over all values
+  values.init(16);
+  for(int i = 1; i <= 100; i++)
+  {
+    values.add(double(i));
+  }
+  CHECK(values.getAveraged() == (85.0 + 100.0) / 2.0);
+  values.getStats(stats);
+  CHECK(nearValue(stats.p50, 50.0) && stats.absMinValue == 1.0);
+}
+
+int main()
+{
+  testTrace();
+  testPercentiles();
+
+  if(s_failures)
+  {
+    printf("test_profiler: %d failures\n", s_failures);
+    return 1;
+  }
+  printf("test_profiler: passed\n");
+  return 0;
+}
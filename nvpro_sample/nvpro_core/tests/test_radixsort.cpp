@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Compares the radix sorts against std::stable_sort on random inputs of
+// varying size, key width and digit distribution.
+
+#include <nvh/radixsort.hpp>
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <utility>
+
+template <typename TKey, typename TValue>
+static bool testPairs(size_t num, std::mt19937_64& rng, int keyShift, nvh::JobSystem* jobSystem)
+{
+  std::vector<TKey>   keys(num);
+  std::vector<TValue> values(num);
+  for(size_t i = 0; i < num; i++)
+  {
+    keys[i]   = TKey(rng() >> keyShift);
+    values[i] = TValue(i);
+  }
+
+  std::vector<std::pair<TKey, TValue>> reference(num);
+  for(size_t i = 0; i < num; i++)
+  {
+    reference[i] = {keys[i], values[i]};
+  }
+  std::stable_sort(reference.begin(), reference.end(),
+                   [](const std::pair<TKey, TValue>& a, const std::pair<TKey, TValue>& b) { return a.first < b.first; });
+
+  // stable variant must match exactly
+  std::vector<TKey>   sortedKeys   = keys;
+  std::vector<TValue> sortedValues = values;
+  std::vector<TKey>   keysTemp(num);
+  std::vector<TValue> valuesTemp(num);
+  nvh::radixsortPairs(num, sortedKeys.data(), sortedValues.data(), keysTemp.data(), valuesTemp.data(), jobSystem);
+  for(size_t i = 0; i < num; i++)
+  {
+    if(sortedKeys[i] != reference[i].first || sortedValues[i] != reference[i].second)
+    {
+      printf("radixsortPairs: mismatch at %zu of %zu, key bytes %zu\n", i, num, sizeof(TKey));
+      return false;
+    }
+  }
+
+  // in-place variant keeps the pairs together but not their order within equal keys
+  sortedKeys   = keys;
+  sortedValues = values;
+  nvh::radixsortPairsInPlace(num, sortedKeys.data(), sortedValues.data(), jobSystem);
+  std::vector<std::pair<TKey, TValue>> result(num);
+  for(size_t i = 0; i < num; i++)
+  {
+    result[i] = {sortedKeys[i], sortedValues[i]};
+    if(sortedKeys[i] != reference[i].first)
+    {
+      printf("radixsortPairsInPlace: key mismatch at %zu of %zu, key bytes %zu\n", i, num, sizeof(TKey));
+      return false;
+    }
+  }
+  std::sort(result.begin(), result.end());
+  std::sort(reference.begin(), reference.end());
+  if(result != reference)
+  {
+    printf("radixsortPairsInPlace: pairs got lost, %zu pairs, key bytes %zu\n", num, sizeof(TKey));
+    return false;
+  }
+
+  return true;
+}
+
+static bool testIndices(size_t num, std::mt19937_64& rng)
+{
+  struct Item
+  {
+    uint32_t id;
+    uint16_t key;
+  };
+  std::vector<Item>     items(num);
+  std::vector<uint32_t> indices(num);
+  std::vector<uint32_t> indicesTemp(num);
+  for(size_t i = 0; i < num; i++)
+  {
+    items[i].id  = uint32_t(i);
+    items[i].key = uint16_t(rng());
+    indices[i]   = uint32_t(i);
+  }
+
+  uint32_t* result = nvh::radixsort<4, 2>(uint32_t(num), items.data(), indices.data(), indicesTemp.data());
+  for(size_t i = 1; i < num; i++)
+  {
+    if(items[result[i - 1]].key > items[result[i]].key)
+    {
+      printf("radixsort: unsorted at %zu of %zu\n", i, num);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  std::mt19937_64 rng(1);
+  nvh::JobSystem  jobSystem;
+  jobSystem.init(3);
+
+  const size_t sizes[] = {0, 1, 2, 3, 31, 33, 1000, 4097, 100000, 300001};
+
+  bool ok = true;
+  for(size_t num : sizes)
+  {
+    for(int useJobs = 0; useJobs < 2; useJobs++)
+    {
+      nvh::JobSystem* jobs = useJobs ? &jobSystem : nullptr;
+      // full range keys, few distinct keys and keys with constant upper digits
+      for(int keyShift : {0, 40, 58})
+      {
+        ok = ok && testPairs<uint64_t, uint32_t>(num, rng, keyShift, jobs);
+        ok = ok && testPairs<uint32_t, uint32_t>(num, rng, keyShift / 2 + 32, jobs);
+        ok = ok && testPairs<uint16_t, uint64_t>(num, rng, 48, jobs);
+      }
+    }
+    ok = ok && testIndices(num, rng);
+  }
+
+  printf("test_radixsort: %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
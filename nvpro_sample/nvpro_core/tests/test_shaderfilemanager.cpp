@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Checks the include graph of nvh::ShaderFileManager: after every kind of
+// change the memoized result of manualInclude equals the one of a new
+// manager, and haveDependenciesChanged only reports the files that depend on
+// the change. The modification times are set explicitly, so that a nested
+// include edited within the same second is covered, as well as files whose
+// time and size did not change, which must not be read again.
+
+#include <nvh/shaderfilemanager.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_shaderfilemanager: %s failed (line %d)\n", #cond, __LINE__);                                          \
+    s_failures++;                                                                                                      \
+  }
+
+namespace fs = std::filesystem;
+
+static const std::string s_directory = "test_shaderfilemanager";
+static const std::string s_dirA      = s_directory + "/a";
+static const std::string s_dirB      = s_directory + "/b";
+
+// a whole second, so that offsets below one second keep the same st_mtime
+static fs::file_time_type s_baseTime;
+
+static void writeFile(const std::string& filename, const std::string& content, int milliseconds)
+{
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file << content;
+  }
+  fs::last_write_time(filename, s_baseTime + std::chrono::milliseconds(milliseconds));
+}
+
+class TestFileManager : public nvh::ShaderFileManager
+{
+public:
+  TestFileManager(bool lineMarkers, bool registerOther)
+      : ShaderFileManager(true)
+  {
+    m_lineMarkers             = lineMarkers;
+    m_supportsExtendedInclude = lineMarkers;
+    addDirectory(s_dirA);
+    addDirectory(s_dirB);
+    if(registerOther)
+    {
+      registerInclude("other.h", "", "REGISTERED OTHER\n");
+    }
+  }
+
+  std::string load(const std::string& filename, std::vector<FileDependency>* dependencies = nullptr)
+  {
+    std::string filenameFound;
+    return manualInclude(filename, filenameFound, "#define PREPEND 1\n", false, dependencies);
+  }
+};
+
+// p0 and p1 include inner.h through common.h, p1 also through sub/s.h and
+// p2 neither
+static const char* s_programs[] = {"p0.glsl", "p1.glsl", "p2.glsl"};
+
+static void writeFiles()
+{
+  fs::remove_all(s_directory);
+  fs::create_directories(s_dirA + "/sub");
+  fs::create_directories(s_dirB);
+
+  writeFile(s_dirA + "/p0.glsl", "#version 450\n#include \"common.h\"\nvoid main() {}\n", 200);
+  writeFile(s_dirA + "/p1.glsl", "#version 460\n#include \"common.h\"\n#include \"sub/s.h\"\n#include \"missing.h\"\n", 200);
+  writeFile(s_dirA + "/p2.glsl", "#version 450\n#include \"other.h\"\n", 200);
+  writeFile(s_dirA + "/common.h", "COMMON\n#include \"inner.h\"\n#include \"inner.h\"\n", 200);
+  writeFile(s_dirA + "/sub/s.h", "SUB\n#include \"inner.h\"\n", 200);
+  writeFile(s_dirA + "/other.h", "OTHER\n", 200);
+  writeFile(s_dirB + "/inner.h", "INNER 1\n", 200);
+}
+
+struct Loaded
+{
+  std::string                                        text[3];
+  std::vector<nvh::ShaderFileManager::FileDependency> dependencies[3];
+};
+
+static void loadAll(TestFileManager& manager, Loaded& loaded)
+{
+  for(int i = 0; i < 3; i++)
+  {
+    loaded.dependencies[i].clear();
+    loaded.text[i] = manager.load(s_programs[i], &loaded.dependencies[i]);
+  }
+}
+
+// compares against a manager without any cached state
+static bool sameAsNewManager(const Loaded& loaded, bool lineMarkers, bool registerOther)
+{
+  TestFileManager manager(lineMarkers, registerOther);
+  for(int i = 0; i < 3; i++)
+  {
+    if(manager.load(s_programs[i]) != loaded.text[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool changed(TestFileManager& manager, const Loaded& loaded, int program)
+{
+  return manager.haveDependenciesChanged(loaded.dependencies[program]);
+}
+
+static void testIncludeGraph(bool lineMarkers)
+{
+  writeFiles();
+
+  TestFileManager manager(lineMarkers, false);
+  Loaded          loaded;
+  loadAll(manager, loaded);
+  CHECK(loaded.text[0].find("INNER 1") != std::string::npos);
+  CHECK(loaded.text[1].find("SUB") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+
+  // nothing changed, the memoized includes give the same text
+  manager.beginFileScan();
+  for(int i = 0; i < 3; i++)
+  {
+    CHECK(!changed(manager, loaded, i));
+  }
+  Loaded reloaded;
+  loadAll(manager, reloaded);
+  for(int i = 0; i < 3; i++)
+  {
+    CHECK(reloaded.text[i] == loaded.text[i]);
+  }
+
+  // the nested include is edited 400 ms later, within the same second and with the same size
+  writeFile(s_dirB + "/inner.h", "INNER 2\n", 600);
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 0) && changed(manager, loaded, 1) && !changed(manager, loaded, 2));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[0].find("INNER 2") != std::string::npos && loaded.text[1].find("INNER 2") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+
+  // same time and size: the file is not read again, so the old content stays
+  writeFile(s_dirB + "/inner.h", "INNER 3\n", 600);
+  manager.beginFileScan();
+  CHECK(!changed(manager, loaded, 0) && !changed(manager, loaded, 1));
+  CHECK(manager.load(s_programs[0]) == loaded.text[0]);
+  writeFile(s_dirB + "/inner.h", "INNER 3\n", 700);
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 0) && changed(manager, loaded, 1) && !changed(manager, loaded, 2));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[0].find("INNER 3") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+
+  // files are only checked once per scan
+  writeFile(s_dirA + "/other.h", "OTHER CHANGED\n", 800);
+  CHECK(!changed(manager, loaded, 2));
+  CHECK(manager.load(s_programs[2]) == loaded.text[2]);
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 2) && !changed(manager, loaded, 0));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[2].find("OTHER CHANGED") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+
+  // a file earlier in the search path shadows inner.h, common.h and sub/s.h search their own directory first
+  writeFile(s_dirA + "/inner.h", "SHADOW\n", 800);
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 0) && changed(manager, loaded, 1) && !changed(manager, loaded, 2));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[0].find("SHADOW") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+  fs::remove(s_dirA + "/inner.h");
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 0));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[0].find("INNER 3") != std::string::npos);
+
+  // a missing include appears
+  CHECK(loaded.text[1].find("FOUND MISSING") == std::string::npos);
+  writeFile(s_dirB + "/missing.h", "FOUND MISSING\n", 800);
+  manager.beginFileScan();
+  CHECK(changed(manager, loaded, 1) && !changed(manager, loaded, 0) && !changed(manager, loaded, 2));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[1].find("FOUND MISSING") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, false));
+
+  // registered content replaces the file
+  manager.registerInclude("other.h", "", "REGISTERED OTHER\n");
+  CHECK(changed(manager, loaded, 2) && !changed(manager, loaded, 0));
+  loadAll(manager, loaded);
+  CHECK(loaded.text[2].find("REGISTERED OTHER") != std::string::npos);
+  CHECK(sameAsNewManager(loaded, lineMarkers, true));
+
+  // nothing is known about a definition without dependencies
+  CHECK(manager.haveDependenciesChanged({}));
+
+  // dropping the cache gives the same result
+  Loaded cleared;
+  manager.clearFileCache();
+  loadAll(manager, cleared);
+  for(int i = 0; i < 3; i++)
+  {
+    CHECK(cleared.text[i] == loaded.text[i]);
+  }
+
+  fs::remove_all(s_directory);
+}
+
+int main()
+{
+  auto now   = fs::file_time_type::clock::now();
+  s_baseTime = fs::file_time_type(std::chrono::duration_cast<fs::file_time_type::duration>(
+      std::chrono::floor<std::chrono::seconds>(now.time_since_epoch())));
+
+  testIncludeGraph(false);
+  testIncludeGraph(true);
+
+  if(s_failures)
+  {
+    printf("test_shaderfilemanager: %d failures\n", s_failures);
+    return 1;
+  }
+  printf("test_shaderfilemanager: passed\n");
+  return 0;
+}
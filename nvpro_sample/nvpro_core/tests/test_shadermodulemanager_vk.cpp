@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Checks the on-disk SPIR-V cache of nvvk::ShaderModuleManager: the second
+// run of the same shaders only has cache hits and yields the SPIR-V of a
+// fresh compilation, editing a shader or a nested include only recompiles
+// the shaders depending on it, and stale, truncated, corrupt or colliding
+// entries are ignored and replaced. Serial and job system compilation are
+// both covered. vkCreateShaderModule and vkDestroyShaderModule are defined
+// here, the GLSL is compiled with shaderc.
+
+#include <nvh/jobsystem.hpp>
+#include <nvvk/shadermodulemanager_vk.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_shadermodulemanager_vk: %s failed (line %d)\n", #cond, __LINE__);                                     \
+    s_failures++;                                                                                                      \
+  }
+
+//////////////////////////////////////////////////////////////////////////
+// fake device, a shader module keeps a copy of its code
+
+static int s_liveModules = 0;
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateShaderModule(VkDevice, const VkShaderModuleCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkShaderModule* pShaderModule)
+{
+  *pShaderModule = (VkShaderModule)(uintptr_t) new std::string((const char*)pCreateInfo->pCode, pCreateInfo->codeSize);
+  s_liveModules++;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyShaderModule(VkDevice, VkShaderModule shaderModule, const VkAllocationCallbacks*)
+{
+  delete (std::string*)(uintptr_t)shaderModule;
+  s_liveModules--;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace fs = std::filesystem;
+
+static const std::string s_directory = "test_shadermodulemanager_vk";
+static const std::string s_sources   = s_directory + "/src/";
+static const std::string s_cache     = s_directory + "/cache";
+
+static void writeFile(const std::string& filename, const std::string& content)
+{
+  std::ofstream file(filename, std::ios::binary);
+  file << content;
+}
+
+static std::string readFile(const fs::path& filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::vector<fs::path> cacheEntries()
+{
+  std::vector<fs::path> entries;
+  for(const fs::directory_entry& entry : fs::directory_iterator(s_cache))
+  {
+    entries.push_back(entry.path());
+  }
+  return entries;
+}
+
+// a.vert includes common.h, which includes inner.h, and the registered mem.h;
+// b.frag only common.h, c.comp nothing
+static void writeShaders(const char* innerValue, const char* computeValue)
+{
+  writeFile(s_sources + "a.vert.glsl",
+            "#version 450\n#include \"common.h\"\n#include \"mem.h\"\n"
+            "void main() { gl_Position = vec4(COMMON_VALUE + MEM_VALUE); }\n");
+  writeFile(s_sources + "b.frag.glsl",
+            "#version 450\n#include \"common.h\"\n"
+            "layout(location = 0) out vec4 color;\nvoid main() { color = vec4(COMMON_VALUE); }\n");
+  writeFile(s_sources + "c.comp.glsl", std::string("#version 450\nlayout(local_size_x = 1) in;\n")
+                                           + "layout(binding = 0) buffer Data { float value; };\n"
+                                           + "void main() { value = " + computeValue + "; }\n");
+  writeFile(s_sources + "common.h", "#include \"inner.h\"\n#define COMMON_VALUE (INNER_VALUE * 2.0)\n");
+  writeFile(s_sources + "inner.h", std::string("#define INNER_VALUE ") + innerValue + "\n");
+}
+
+struct RunResult
+{
+  std::vector<std::string> spirv;
+  uint32_t                 hits   = 0;
+  uint32_t                 misses = 0;
+};
+
+static RunResult run(nvh::JobSystem* jobSystem, bool useCache, const std::string& prepend = "")
+{
+  nvvk::ShaderModuleManager manager((VkDevice)(uintptr_t)1);
+  manager.addDirectory(s_sources);
+  manager.registerInclude("mem.h", "", "#define MEM_VALUE 3.0\n");
+  manager.m_keepModuleSPIRV = true;
+  manager.m_prepend         = prepend;
+  manager.setJobSystem(jobSystem);
+  if(useCache)
+  {
+    manager.setSPIRVCacheDirectory(s_cache);
+  }
+
+  nvvk::ShaderModuleManager::Definition definitions[] = {{VK_SHADER_STAGE_VERTEX_BIT, "a.vert.glsl"},
+                                                         {VK_SHADER_STAGE_FRAGMENT_BIT, "b.frag.glsl"},
+                                                         {VK_SHADER_STAGE_COMPUTE_BIT, "c.comp.glsl"}};
+  nvvk::ShaderModuleID ids[3];
+  manager.createShaderModules(3, definitions, ids);
+
+  RunResult result;
+  for(nvvk::ShaderModuleID id : ids)
+  {
+    CHECK(manager.isValid(id));
+    result.spirv.push_back(manager.isValid(id) ? manager.getShaderModule(id).moduleSPIRV : std::string());
+  }
+  result.hits   = manager.getSPIRVCacheHits();
+  result.misses = manager.getSPIRVCacheMisses();
+  return result;
+}
+
+static void testCache(nvh::JobSystem* jobSystem)
+{
+  fs::remove_all(s_directory);
+  fs::create_directories(s_sources);
+  fs::create_directories(s_cache);
+  writeShaders("1.0", "5.0");
+
+  RunResult reference = run(jobSystem, false);
+  CHECK(reference.hits == 0 && reference.misses == 0);
+
+  // first run fills the cache, the second only hits it
+  RunResult result = run(jobSystem, true);
+  CHECK(result.hits == 0 && result.misses == 3);
+  CHECK(result.spirv == reference.spirv);
+  CHECK(cacheEntries().size() == 3);
+  result = run(jobSystem, true);
+  CHECK(result.hits == 3 && result.misses == 0);
+  CHECK(result.spirv == reference.spirv);
+
+  // a nested include changes, a.vert and b.frag are stale
+  writeShaders("2.0", "5.0");
+  RunResult edited = run(jobSystem, false);
+  CHECK(edited.spirv[0] != reference.spirv[0] && edited.spirv[1] != reference.spirv[1]);
+  result = run(jobSystem, true);
+  CHECK(result.hits == 1 && result.misses == 2);
+  CHECK(result.spirv == edited.spirv);
+  result = run(jobSystem, true);
+  CHECK(result.hits == 3 && result.misses == 0);
+  CHECK(result.spirv == edited.spirv);
+
+  // an edited shader gets a new key, the entry of the old version stays valid
+  writeShaders("2.0", "6.0");
+  result = run(jobSystem, true);
+  CHECK(result.hits == 2 && result.misses == 1);
+  CHECK(result.spirv[0] == edited.spirv[0] && result.spirv[1] == edited.spirv[1]);
+  CHECK(result.spirv[2] != edited.spirv[2]);
+  writeShaders("2.0", "5.0");
+  result = run(jobSystem, true);
+  CHECK(result.hits == 3 && result.spirv == edited.spirv);
+
+  // the key only covers the shader itself, so the entries of a.vert and b.frag
+  // were replaced and are stale again
+  writeShaders("1.0", "5.0");
+  result = run(jobSystem, true);
+  CHECK(result.hits == 1 && result.misses == 2);
+  CHECK(result.spirv == reference.spirv);
+
+  // the prepend is part of the key
+  result = run(jobSystem, true, "#define UNUSED_VALUE 1\n");
+  CHECK(result.hits == 0 && result.misses == 3);
+  result = run(jobSystem, true);
+  CHECK(result.hits == 3);
+
+  // truncated, extended and garbage entries are recompiled and replaced,
+  // starting from a cache with just the current entries
+  fs::remove_all(s_cache);
+  fs::create_directories(s_cache);
+  result = run(jobSystem, true);
+  CHECK(result.misses == 3);
+
+  std::vector<fs::path> entries = cacheEntries();
+  CHECK(entries.size() == 3);
+  for(size_t i = 0; i < entries.size(); i++)
+  {
+    std::string data = readFile(entries[i]);
+    switch(i % 3)
+    {
+      case 0:
+        data.resize(data.size() / 2);
+        break;
+      case 1:
+        data += "trailing";
+        break;
+      default:
+        data = "garbage";
+        break;
+    }
+    writeFile(entries[i].string(), data);
+  }
+  result = run(jobSystem, true);
+  CHECK(result.hits == 0 && result.misses == 3);
+  CHECK(result.spirv == reference.spirv);
+  result = run(jobSystem, true);
+  CHECK(result.hits == 3 && result.spirv == reference.spirv);
+
+  // a different source under the same key, as after a hash collision, is not used
+  for(const fs::path& entry : cacheEntries())
+  {
+    std::string data     = readFile(entry);
+    size_t      position = data.find("void main()");
+    CHECK(position != std::string::npos);
+    if(position != std::string::npos)
+    {
+      data[position] = 'V';
+      writeFile(entry.string(), data);
+    }
+  }
+  result = run(jobSystem, true);
+  CHECK(result.hits == 0 && result.misses == 3);
+  CHECK(result.spirv == reference.spirv);
+
+  fs::remove_all(s_directory);
+}
+
+int main()
+{
+  testCache(nullptr);
+
+  nvh::JobSystem jobSystem;
+  jobSystem.init(3);
+  testCache(&jobSystem);
+  jobSystem.deinit();
+
+  CHECK(s_liveModules == 0);
+
+  if(s_failures)
+  {
+    printf("test_shadermodulemanager_vk: %d failures\n", s_failures);
+    return 1;
+  }
+  printf("test_shadermodulemanager_vk: passed\n");
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Random sub-allocations and frees on nvh::TRangeAllocator with power-of-two
+// and odd alignments, every allocation is checked against a page occupancy
+// shadow, as well as getLargestFree() against the longest free run and
+// isAvailable() against subAllocate().
+
+#include <nvh/trangeallocator.hpp>
+
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#define CHECK(cond)                                                                                                    \
+  if(!(cond))                                                                                                          \
+  {                                                                                                                    \
+    printf("test_trangeallocator: %s failed, seed %d iteration %d\n", #cond, seed, iteration);                       \
+    return 1;                                                                                                          \
+  }
+
+struct Allocation
+{
+  uint32_t offset;
+  uint32_t aligned;
+  uint32_t size;
+  uint32_t request;
+  uint32_t align;
+};
+
+int main()
+{
+  const uint32_t granularity = 256;
+  const uint32_t total       = 64 * 1024 * 1024;
+
+  for(int seed = 0; seed < 20; seed++)
+  {
+    std::mt19937                      rng(seed);
+    nvh::TRangeAllocator<granularity> range;
+    range.init(total);
+
+    std::vector<uint8_t>    occupied(total / granularity, 0);
+    std::vector<Allocation> live;
+
+    int iteration = 0;
+    for(; iteration < 20000; iteration++)
+    {
+      if(rng() % 2 || live.empty())
+      {
+        Allocation a;
+        a.request = 1 + rng() % ((rng() % 16) ? 20000 : 4000000);
+        a.align   = (rng() % 7 == 0) ? (1 + rng() % 1000) : (1u << (rng() % 16));
+
+        bool available = range.isAvailable(a.request, a.align);
+        bool allocated = range.subAllocate(a.request, a.align, a.offset, a.aligned, a.size);
+        CHECK(available == allocated);
+        if(!allocated)
+          continue;
+
+        CHECK(a.aligned % a.align == 0 && a.offset % granularity == 0 && a.size % granularity == 0);
+        CHECK(a.offset <= a.aligned && uint64_t(a.aligned) + a.request <= uint64_t(a.offset) + a.size);
+        CHECK(a.offset + a.size <= total);
+        // only the pages touched by the aligned request are used
+        CHECK(a.size == ((a.aligned % granularity + a.request + granularity - 1) / granularity) * granularity);
+
+        for(uint32_t p = a.offset / granularity; p < (a.offset + a.size) / granularity; p++)
+        {
+          CHECK(!occupied[p]);
+          occupied[p] = 1;
+        }
+        live.push_back(a);
+      }
+      else
+      {
+        size_t     i = rng() % live.size();
+        Allocation a = live[i];
+        for(uint32_t p = a.offset / granularity; p < (a.offset + a.size) / granularity; p++)
+        {
+          occupied[p] = 0;
+        }
+        range.subFree(a.offset, a.size);
+        live[i] = live.back();
+        live.pop_back();
+      }
+
+      if(iteration % 501 == 0)
+      {
+        range.checkRanges();
+
+        uint32_t largest = 0;
+        uint32_t run     = 0;
+        uint32_t used    = 0;
+        for(uint8_t o : occupied)
+        {
+          run     = o ? 0 : run + 1;
+          largest = std::max(largest, run);
+          used += o;
+        }
+        CHECK(range.getLargestFree() == largest * granularity);
+        CHECK(range.getUsedSize() == used * granularity);
+
+        // the largest free range is guaranteed to be allocatable
+        if(largest)
+        {
+          CHECK(range.isAvailable(largest * granularity, granularity));
+          CHECK(!range.isAvailable(largest * granularity + 1, 1));
+        }
+      }
+    }
+
+    for(const Allocation& a : live)
+    {
+      range.subFree(a.offset, a.size);
+    }
+    range.checkRanges();
+    CHECK(range.isEmpty() && range.getLargestFree() == total);
+
+    // a copy is independent of the original
+    nvh::TRangeAllocator<granularity> copy = range;
+    Allocation                        a;
+    CHECK(copy.subAllocate(total, 1, a.offset, a.aligned, a.size) && a.size == total);
+    CHECK(range.getLargestFree() == total && copy.getLargestFree() == 0);
+  }
+
+  printf("test_trangeallocator: passed\n");
+  return 0;
+}
@@ -500,7 +500,7 @@ public:
       exit(-1);
     }
 
-    m_shaderManager.reloadShaderModules();
+    m_shaderManager.reloadChangedShaderModules();
     initTestPipeline();
   }
 
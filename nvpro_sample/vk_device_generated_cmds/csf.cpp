@@ -21,6 +21,9 @@
 #define CSF_IMPLEMENTATION
 #define CSF_SUPPORT_GLTF2       1
 #define CSF_SUPPORT_FILEMAPPING 1
+#ifdef NVP_SUPPORTS_ZSTD
+#define CSF_SUPPORT_ZSTD        1
+#endif
 
 #include <fileformats/cadscenefile.h>
 
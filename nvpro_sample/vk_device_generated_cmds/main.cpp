@@ -33,7 +33,7 @@
 #include <algorithm>
 
 #include "renderer.hpp"
-#include "threadpool.hpp"
+#include <thread>
 
 namespace generatedcmds {
 int const SAMPLE_SIZE_WIDTH(1024);
@@ -142,7 +142,8 @@ public:
   Sample()
       : AppWindowProfilerVK(false)
   {
-    m_maxThreads          = ThreadPool::sysGetNumCores();
+    // the threaded renderer records with workerThreads-1 workers plus the main thread
+    m_maxThreads          = std::max(1u, std::thread::hardware_concurrency());
     m_tweak.workerThreads = m_maxThreads;
 
     setupConfigParameters();
@@ -686,6 +687,7 @@ void Sample::setupConfigParameters()
 {
   m_parameterList.addFilename(".csf", &m_modelFilename);
   m_parameterList.addFilename(".csf.gz", &m_modelFilename);
+  m_parameterList.addFilename(".csfz", &m_modelFilename);
   m_parameterList.addFilename(".gltf", &m_modelFilename);
 
   m_parameterList.add("vkdevice", &m_contextInfo.compatibleDeviceIndex);
@@ -724,6 +726,8 @@ using namespace generatedcmds;
 int main(int argc, const char** argv)
 {
   NVPSystem system(PROJECT_NAME);
+  // worker threads log their stats, keep console and file output off their path
+  nvprintSetAsync(true);
 
 #if defined(_WIN32) && defined(NDEBUG)
   //SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
@@ -21,11 +21,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <mutex>
-#include <queue>
 
 #include "renderer.hpp"
 #include "resources_vk.hpp"
-#include "threadpool.hpp"
+#include <nvh/jobsystem.hpp>
 #include <nvh/nvprint.hpp>
 #include <nvmath/nvmath_glsltypes.h>
 #include <nvpwindow.hpp>
@@ -84,23 +83,23 @@ private:
   };
 
 
+  // per-worker state of the job system, accessed without locking
   struct ThreadJob
   {
-    RendererThreadedVK* renderer;
-    int                 index;
-
     nvvk::RingCommandPool m_pool;
 
-    int                     m_frame;
-    std::condition_variable m_hasWorkCond;
-    std::mutex              m_hasWorkMutex;
-    volatile int            m_hasWork;
-
     size_t                  m_scIdx;
     std::vector<DrawSetup*> m_scs;
+    DrawSetup*              m_batched;
 
+    size_t m_dispatches;
 
-    void resetFrame() { m_scIdx = 0; }
+
+    void resetFrame()
+    {
+      m_scIdx   = 0;
+      m_batched = nullptr;
+    }
 
     DrawSetup* getFrameCommand()
     {
@@ -127,67 +126,31 @@ private:
   ResourcesVK* NV_RESTRICT m_resources;
   int                      m_numThreads;
 
-  ThreadPool m_threadpool;
+  nvh::JobSystem m_jobSystem;
+  ThreadJob*     m_jobs;
 
   bool     m_workerBatched;
   int      m_workingSet;
   int      m_frame;
   uint32_t m_cycleCurrent;
 
-  ThreadJob* m_jobs;
-
-  volatile uint32_t m_ready;
-  volatile uint32_t m_stopThreads;
-  volatile size_t   m_numCurItems;
-
-  std::condition_variable m_readyCond;
-  std::mutex              m_readyMutex;
-
-  size_t                 m_numEnqueues;
-  std::queue<DrawSetup*> m_drawQueue;
+  // non-batched: one setup per workingSet chunk, executed in list order
+  // as soon as all chunks before it are done
+  std::vector<DrawSetup*> m_chunkSetups;
+  size_t                  m_chunkNext;
 
-  std::mutex              m_workMutex;
-  std::mutex              m_drawMutex;
-  std::condition_variable m_drawMutexCondition;
+  size_t     m_numEnqueues;
+  uint32_t   m_numCmdBuffers;
+  std::mutex m_drawMutex;
 
   VkCommandBuffer m_primary;
 
-  static void threadMaster(void* arg)
-  {
-    ThreadJob* job = (ThreadJob*)arg;
-    job->renderer->RunThread(job->index);
-  }
-
-  bool getWork_ts(size_t& start, size_t& num)
-  {
-    std::lock_guard<std::mutex> lock(m_workMutex);
-    bool                        hasWork = false;
+  int    m_timerFrames;
+  double m_timePrint;
 
-    const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
+  void RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex);
 
-    if(m_numCurItems < total)
-    {
-      size_t batch = std::min(total - m_numCurItems, chunkSize);
-      start        = m_numCurItems;
-      num          = batch;
-      m_numCurItems += batch;
-      hasWork = true;
-    }
-    else
-    {
-      hasWork = false;
-      start   = 0;
-      num     = 0;
-    }
-
-    return hasWork;
-  }
-
-  void         RunThread(int index);
-  unsigned int RunThreadFrame(ThreadJob& job);
-
-  void enqueueShadeCommand_ts(DrawSetup* sc);
+  void executeChunks_ts(size_t chunkIndex, DrawSetup* sc);
   void submitShadeCommand_ts(DrawSetup* sc);
 
   void drawThreaded(const Resources::Global& global, VkCommandBuffer cmd, Stats& stats);
@@ -325,56 +288,28 @@ void RendererThreadedVK::init(const CadScene* NV_RESTRICT scene, Resources* reso
     fillRandomPermutation(m_drawItems.size(), m_seqIndices.data(), m_drawItems.data(), stats);
   }
 
-  m_threadpool.init(m_config.workerThreads);
-
-  // make jobs
-  m_ready       = 0;
-  m_jobs        = new ThreadJob[m_config.workerThreads];
-  m_stopThreads = 0;
+  // the thread calling draw records as well
+  m_jobSystem.init(std::max(m_config.workerThreads, 1u) - 1);
+  m_jobs = new ThreadJob[m_jobSystem.getNumSlots()];
 
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
-    ThreadJob& job = m_jobs[i];
-    job.index      = i;
-    job.renderer   = this;
-    job.m_hasWork  = -1;
-    job.m_frame    = 0;
+    ThreadJob& job   = m_jobs[i];
+    job.m_scIdx      = 0;
+    job.m_batched    = nullptr;
+    job.m_dispatches = 0;
 
     job.m_pool.init(res->m_device, res->m_context->m_queueGCT);
-
-    m_threadpool.activateJob(i, threadMaster, &m_jobs[i]);
   }
 
-  m_frame = 0;
+  m_frame       = 0;
+  m_timerFrames = 0;
+  m_timePrint   = NVPSystem::getTime();
 }
 
 void RendererThreadedVK::deinit()
 {
-  m_stopThreads = 1;
-  m_ready       = 0;
-
-  NV_BARRIER();
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
-  {
-    std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-    m_jobs[i].m_hasWork = m_frame;
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
-  m_drawMutexCondition.notify_all();
-
-  std::this_thread::yield();
-
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    while(m_ready < m_config.workerThreads)
-    {
-      m_readyCond.wait(lock);
-    }
-  }
-
-  NV_BARRIER();
-
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
     for(size_t s = 0; s < m_jobs[i].m_scs.size(); s++)
     {
@@ -385,17 +320,32 @@ void RendererThreadedVK::deinit()
 
   delete[] m_jobs;
 
-  m_threadpool.deinit();
+  // workers are idle outside of draw
+  m_jobSystem.deinit();
 
   m_drawItems.clear();
+  m_chunkSetups.clear();
 }
 
-void RendererThreadedVK::enqueueShadeCommand_ts(DrawSetup* sc)
+void RendererThreadedVK::executeChunks_ts(size_t chunkIndex, DrawSetup* sc)
 {
-  std::unique_lock<std::mutex> lock(m_drawMutex);
+  // whoever completes the next chunk in list order appends it and all
+  // consecutive finished ones to the primary, so the primary is built
+  // while the remaining chunks are still being recorded
+  std::lock_guard<std::mutex> lock(m_drawMutex);
 
-  m_drawQueue.push(sc);
-  m_drawMutexCondition.notify_one();
+  m_chunkSetups[chunkIndex] = sc;
+  while(m_chunkNext < m_chunkSetups.size() && m_chunkSetups[m_chunkNext])
+  {
+    DrawSetup* next = m_chunkSetups[m_chunkNext++];
+    if(!next->cmdbuffers.empty())
+    {
+      m_numEnqueues++;
+      vkCmdExecuteCommands(m_primary, (uint32_t)next->cmdbuffers.size(), next->cmdbuffers.data());
+      m_numCmdBuffers += (uint32_t)next->cmdbuffers.size();
+      next->cmdbuffers.clear();
+    }
+  }
 }
 
 
@@ -414,207 +364,92 @@ void RendererThreadedVK::submitShadeCommand_ts(DrawSetup* sc)
   sc->cmdbuffers.clear();
 }
 
-unsigned int RendererThreadedVK::RunThreadFrame(ThreadJob& job)
+void RendererThreadedVK::RunThreadChunk(size_t begin, size_t end, uint32_t workerIndex)
 {
-  unsigned int dispatches = 0;
-
-  bool   first = true;
-  size_t tnum  = 0;
-  size_t begin = 0;
-  size_t num   = 0;
+  ThreadJob& job = m_jobs[workerIndex];
 
-  size_t offset = 0;
-
-  job.resetFrame();
-  job.m_pool.setCycle(m_cycleCurrent);
+  // recorded per thread, shows up in the profiler stats
+  nvh::Profiler::Section section(m_resources->m_profilerVK, "Worker");
 
   if(m_workerBatched)
   {
-    DrawSetup* sc = job.getFrameCommand();
-    while(getWork_ts(begin, num))
+    // collects all secondaries of this thread, they are executed once the frame's chunks are done
+    if(!job.m_batched)
     {
-      setupCmdBuffer(*sc, job.m_pool, &m_drawItems[begin], num);
-      tnum += num;
-    }
-    if(!sc->cmdbuffers.empty())
-    {
-      enqueueShadeCommand_ts(sc);
-      dispatches += 1;
+      job.m_batched = job.getFrameCommand();
     }
+    setupCmdBuffer(*job.m_batched, job.m_pool, &m_drawItems[begin], end - begin);
   }
   else
   {
-    while(getWork_ts(begin, num))
-    {
-      DrawSetup* sc = job.getFrameCommand();
-      setupCmdBuffer(*sc, job.m_pool, &m_drawItems[begin], num);
-
-      if(!sc->cmdbuffers.empty())
-      {
-        enqueueShadeCommand_ts(sc);
-        dispatches += 1;
-      }
-      tnum += num;
-    }
-  }
-
-  // NULL signals we are done
-  enqueueShadeCommand_ts(NULL);
-
-  return dispatches;
-}
-
-void RendererThreadedVK::RunThread(int tid)
-{
-  ThreadJob& job = m_jobs[tid];
-
-  double timeWork    = 0;
-  double timeFrame   = 0;
-  int    timerFrames = 0;
-  size_t dispatches  = 0;
-
-  double timePrint = NVPSystem::getTime();
-
-  while(!m_stopThreads)
-  {
-    //NV_BARRIER();
-
-    double beginFrame = NVPSystem::getTime();
-    timeFrame -= NVPSystem::getTime();
-    {
-      std::unique_lock<std::mutex> lock(job.m_hasWorkMutex);
-      while(job.m_hasWork != job.m_frame)
-      {
-        job.m_hasWorkCond.wait(lock);
-      }
-    }
-
-    if(m_stopThreads)
-    {
-      break;
-    }
-
-    double beginWork = NVPSystem::getTime();
-    timeWork -= NVPSystem::getTime();
-
-    dispatches += RunThreadFrame(job);
-
-    job.m_frame++;
-
-    timeWork += NVPSystem::getTime();
-
-    double currentTime = NVPSystem::getTime();
-    timeFrame += currentTime;
-
-    timerFrames++;
-
-    if(timerFrames && (currentTime - timePrint) > 2.0)
-    {
-      timeFrame /= double(timerFrames);
-      timeWork /= double(timerFrames);
-
-      timeFrame *= 1000000.0;
-      timeWork *= 1000000.0;
-
-      timePrint = currentTime;
-
-      float avgdispatch = float(double(dispatches) / double(timerFrames));
-
-#if 1
-      LOGI("thread %d: work %6d [us] dispatches %5.1f\n", tid, uint32_t(timeWork), avgdispatch);
-#endif
-      timeFrame = 0;
-      timeWork  = 0;
-
-      timerFrames = 0;
-      dispatches  = 0;
-    }
-  }
+    DrawSetup* sc = job.getFrameCommand();
+    setupCmdBuffer(*sc, job.m_pool, &m_drawItems[begin], end - begin);
+    job.m_dispatches++;
 
-  {
-    std::unique_lock<std::mutex> lock(m_readyMutex);
-    m_ready++;
-    m_readyCond.notify_all();
+    executeChunks_ts(begin / m_workingSet, sc);
   }
 }
 
-
 void RendererThreadedVK::drawThreaded(const Resources::Global& global, VkCommandBuffer primary, Stats& stats)
 {
   ResourcesVK* res = m_resources;
 
-  m_workingSet    = global.workingSet;
+  m_workingSet    = std::max(global.workingSet, 1);
   m_workerBatched = global.workerBatched;
-  m_numCurItems   = 0;
   m_numEnqueues   = 0;
+  m_numCmdBuffers = 0;
   m_cycleCurrent  = res->m_ringFences.getCycleIndex();
+  m_primary       = primary;
 
-  stats.cmdBuffers = 0;
-
-  // generate & cmdbuffers in parallel
-
-  NV_BARRIER();
-
-  // start to dispatch threads
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
+  for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
   {
-    {
-      std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-      m_jobs[i].m_hasWork = m_frame;
-    }
-    m_jobs[i].m_hasWorkCond.notify_one();
+    m_jobs[i].resetFrame();
+    m_jobs[i].m_pool.setCycle(m_cycleCurrent);
   }
+  m_chunkSetups.assign((m_drawItems.size() + m_workingSet - 1) / m_workingSet, nullptr);
+  m_chunkNext = 0;
 
-  // collect secondaries here
-  {
-    int numTerminated = 0;
-    while(true)
-    {
-      bool       hadEntry = false;
-      DrawSetup* sc       = NULL;
-      {
-        std::unique_lock<std::mutex> lock(m_drawMutex);
-        if(m_drawQueue.empty())
-        {
-          m_drawMutexCondition.wait(lock);
-        }
-        if(!m_drawQueue.empty())
-        {
-
-          sc = m_drawQueue.front();
-          m_drawQueue.pop();
+  // generate cmdbuffers in parallel, idle workers steal chunks of workingSet drawitems
+  // from the busy ones, this thread records as well until all are done
 
-          hadEntry = true;
-        }
-      }
-
-      if(hadEntry)
-      {
-        if(sc)
-        {
-          m_numEnqueues++;
-          NV_BARRIER();
-          vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
-          stats.cmdBuffers += (uint32_t)sc->cmdbuffers.size();
-          sc->cmdbuffers.clear();
-        }
-        else
-        {
-          numTerminated++;
-        }
-      }
+  m_jobSystem.parallelFor(
+      0, m_drawItems.size(), [&](size_t begin, size_t end, uint32_t workerIndex) { RunThreadChunk(begin, end, workerIndex); },
+      m_workingSet);
 
-      if(numTerminated == m_config.workerThreads)
+  if(m_workerBatched)
+  {
+    for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
+    {
+      DrawSetup* sc = m_jobs[i].m_batched;
+      if(sc && !sc->cmdbuffers.empty())
       {
-        break;
+        m_numEnqueues++;
+        m_jobs[i].m_dispatches++;
+        vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+        m_numCmdBuffers += (uint32_t)sc->cmdbuffers.size();
+        sc->cmdbuffers.clear();
       }
-      std::this_thread::yield();
     }
   }
 
+  stats.cmdBuffers = m_numCmdBuffers;
+
   m_frame++;
+  m_timerFrames++;
 
-  NV_BARRIER();
+  double currentTime = NVPSystem::getTime();
+  if(currentTime - m_timePrint > 2.0)
+  {
+    for(uint32_t i = 0; i < m_jobSystem.getNumSlots(); i++)
+    {
+#if PRINT_TIMER_STATS
+      LOGI("thread %d: dispatches %5.1f\n", i, float(double(m_jobs[i].m_dispatches) / double(m_timerFrames)));
+#endif
+      m_jobs[i].m_dispatches = 0;
+    }
+    m_timePrint   = currentTime;
+    m_timerFrames = 0;
+  }
 }
 
 void RendererThreadedVK::draw(const Resources::Global& global, Stats& stats)
@@ -22,6 +22,7 @@
 #include "backends/imgui_vk_extra.h"
 #include "nvh/nvprint.hpp"
 #include <algorithm>
+#include <filesystem>
 
 namespace generatedcmds {
 
@@ -343,7 +344,19 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
 
   m_shaderManager.m_prepend = prepend;
 
+  // compiled SPIR-V is kept between runs, only modules whose source changed are compiled again
+  std::string     cacheDirectory = path + "spirv_cache_" PROJECT_NAME;
+  std::error_code cacheError;
+  std::filesystem::create_directories(cacheDirectory, cacheError);
+  if(!cacheError)
+  {
+    m_shaderManager.setSPIRVCacheDirectory(cacheDirectory);
+  }
+
   ///////////////////////////////////////////////////////////////////////////////////////////
+  // all permutations are created at once, so that cache misses are compiled in parallel
+  std::vector<nvvk::ShaderModuleManager::Definition> definitions;
+  std::vector<nvvk::ShaderModuleID*>                 ids;
   for(uint32_t i = 0; i < NUM_BINDINGMODES; i++)
   {
     for(uint32_t m = 0; m < NUM_MATERIAL_SHADERS; m++)
@@ -352,13 +365,22 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
                             + nvh::ShaderFileManager::format("#define SHADER_PERMUTATION %d\n", m)
                             + nvh::ShaderFileManager::format("#define UNIFORMS_TECHNIQUE %d\n", i);
 
-      m_drawShading[i].vertexIDs[m] = m_shaderManager.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl", defines);
-      m_drawShading[i].fragmentIDs[m] =
-          m_shaderManager.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "scene.frag.glsl", defines);
+      definitions.emplace_back(VK_SHADER_STAGE_VERTEX_BIT, defines, "scene.vert.glsl");
+      ids.push_back(&m_drawShading[i].vertexIDs[m]);
+      definitions.emplace_back(VK_SHADER_STAGE_FRAGMENT_BIT, defines, "scene.frag.glsl");
+      ids.push_back(&m_drawShading[i].fragmentIDs[m]);
     }
   }
 
-  m_animShading.shaderModuleID = m_shaderManager.createShaderModule(VK_SHADER_STAGE_COMPUTE_BIT, "animation.comp.glsl");
+  definitions.emplace_back(VK_SHADER_STAGE_COMPUTE_BIT, "animation.comp.glsl");
+  ids.push_back(&m_animShading.shaderModuleID);
+
+  std::vector<nvvk::ShaderModuleID> createdIDs(definitions.size());
+  m_shaderManager.createShaderModules(definitions.size(), definitions.data(), createdIDs.data());
+  for(size_t d = 0; d < definitions.size(); d++)
+  {
+    *ids[d] = createdIDs[d];
+  }
 
   bool valid = m_shaderManager.areShaderModulesValid();
 
@@ -372,8 +394,16 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
 
 void ResourcesVK::reloadPrograms(const std::string& prepend)
 {
-  m_shaderManager.m_prepend = prepend;
-  m_shaderManager.reloadShaderModules();
+  // with the same defines, only the modules whose files changed need to be compiled again
+  if(m_shaderManager.m_prepend == prepend)
+  {
+    m_shaderManager.reloadChangedShaderModules();
+  }
+  else
+  {
+    m_shaderManager.m_prepend = prepend;
+    m_shaderManager.reloadShaderModules();
+  }
   updatedPrograms();
 }
 
@@ -321,8 +321,16 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
 
 void ResourcesVK::reloadPrograms(const std::string& prepend)
 {
-  m_shaderManager.m_prepend = prepend;
-  m_shaderManager.reloadShaderModules();
+  // with the same defines, only the modules whose files changed need to be compiled again
+  if(m_shaderManager.m_prepend == prepend)
+  {
+    m_shaderManager.reloadChangedShaderModules();
+  }
+  else
+  {
+    m_shaderManager.m_prepend = prepend;
+    m_shaderManager.reloadShaderModules();
+  }
   updatedPrograms();
 }
 
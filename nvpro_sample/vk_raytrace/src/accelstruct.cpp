@@ -122,8 +122,17 @@ void AccelStructure::createBottomLevelAS(nvh::GltfScene&                  gltfSc
     prim_idx++;
   }
   LOGI(" BLAS(%d)", allBlas.size());
-  m_rtBuilder.buildBlas(allBlas, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
-                                     | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
+
+  // Building in batches within the memory budget, compacting while building the next batch
+  nvvk::RaytracingBuilderKHR::BlasBuildBudget budget;
+  nvvk::RaytracingBuilderKHR::BlasBuildStats  stats;
+  m_rtBuilder.buildBlasBudgeted(allBlas,
+                                VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                                    | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR,
+                                budget, &stats);
+  LOGI(" batches(%u) peak(%.1f MB) compacted(%.1f -> %.1f MB) build(%.1f ms) compact(%.1f ms)", stats.batchCount,
+       stats.peakMemorySize / (1024. * 1024.), stats.originalSize / (1024. * 1024.), stats.compactSize / (1024. * 1024.),
+       stats.timeBuild, stats.timeCompact);
 }
 
 //--------------------------------------------------------------------------------------------------
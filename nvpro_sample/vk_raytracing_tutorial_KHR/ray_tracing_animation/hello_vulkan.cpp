@@ -385,6 +385,7 @@ void HelloVulkan::destroyResources()
 
   // #VKRay
   m_rtBuilder.destroy();
+  m_tlas.deinit();
   m_sbtWrapper.destroy();
   vkDestroyPipeline(m_device, m_rtPipeline, nullptr);
   vkDestroyPipelineLayout(m_device, m_rtPipelineLayout, nullptr);
@@ -670,6 +671,10 @@ void HelloVulkan::createBottomLevelAS()
 //
 void HelloVulkan::createTopLevelAS()
 {
+  // The TLAS is refit every frame, see updateTopLevelAS()
+  m_rtFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+  m_tlas.init(m_device, &m_alloc, static_cast<uint32_t>(m_instances.size()), m_rtFlags);
+
   for(const HelloVulkan::ObjInstance& inst : m_instances)
   {
     VkAccelerationStructureInstanceKHR rayInst{};
@@ -679,11 +684,15 @@ void HelloVulkan::createTopLevelAS()
     rayInst.flags                          = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
     rayInst.mask                           = 0xFF;       //  Only be hit if rayMask & instance.mask != 0
     rayInst.instanceShaderBindingTableRecordOffset = 0;  // We will use the same hit group for all objects
-    m_tlas.emplace_back(rayInst);
+    m_tlas.insertInstance(rayInst);                      // Slots are assigned in order, same as m_instances
   }
 
-  m_rtFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
-  m_rtBuilder.buildTlas(m_tlas, m_rtFlags);
+  // Initial build
+  nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
+  VkCommandBuffer   cmdBuf = genCmdBuf.createCommandBuffer();
+  m_tlas.cmdUpdate(cmdBuf);
+  genCmdBuf.submitAndWait(cmdBuf);
+  m_alloc.finalizeAndReleaseStaging();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -708,7 +717,7 @@ void HelloVulkan::createRtDescriptorSet()
   vkAllocateDescriptorSets(m_device, &allocateInfo, &m_rtDescSet);
 
 
-  VkAccelerationStructureKHR                   tlas = m_rtBuilder.getAccelerationStructure();
+  VkAccelerationStructureKHR                   tlas = m_tlas.getAccelerationStructure();
   VkWriteDescriptorSetAccelerationStructureKHR descASInfo{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR};
   descASInfo.accelerationStructureCount = 1;
   descASInfo.pAccelerationStructures    = &tlas;
@@ -889,12 +898,35 @@ void HelloVulkan::animationInstances(float time)
     auto& transform = m_instances[wusonIdx].transform;
     transform       = nvmath::rotation_mat4_y(i * deltaAngle + offset) * nvmath::translation_mat4(radius, 0.f, 0.f);
 
-    VkAccelerationStructureInstanceKHR& tinst = m_tlas[wusonIdx];
-    tinst.transform                           = nvvk::toTransformMatrixKHR(transform);
+    // Only marks the instance, the TLAS is refit in updateTopLevelAS()
+    m_tlas.setTransform(wusonIdx, nvvk::toTransformMatrixKHR(transform));
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Refitting the TLAS with the modified instances, recorded into the frame's command buffer
+// instead of uploading all instances and waiting for the queue
+//
+void HelloVulkan::updateTopLevelAS(const VkCommandBuffer& cmdBuf)
+{
+  // Staging space of completed frames can be reused
+  m_alloc.releaseStaging();
+
+  // The previous frame may still trace rays against the TLAS
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  if(m_tlas.cmdUpdate(cmdBuf))
+  {
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
   }
 
-  // Updating the top level acceleration structure
-  m_rtBuilder.buildTlas(m_tlas, m_rtFlags, true);
+  // The uploads are kept until this frame completed
+  m_alloc.finalizeStaging(m_waitFences[getCurFrame()]);
 }
 
 //--------------------------------------------------------------------------------------------------
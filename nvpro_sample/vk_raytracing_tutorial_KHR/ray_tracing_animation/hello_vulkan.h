@@ -27,6 +27,7 @@
 #include "shaders/host_device.h"
 
 // #VKRay
+#include "nvvk/dynamictlasKHR_vk.hpp"
 #include "nvvk/raytraceKHR_vk.hpp"
 #include "nvvk/sbtwrapper_vk.hpp"
 
@@ -146,7 +147,7 @@ public:
   VkPipeline                                        m_rtPipeline;
   nvvk::SBTWrapper                                  m_sbtWrapper;
 
-  std::vector<VkAccelerationStructureInstanceKHR>    m_tlas;
+  nvvk::DynamicTlasKHR                               m_tlas;
   std::vector<nvvk::RaytracingBuilderKHR::BlasInput> m_blas;
 
   // Push constant for ray tracer
@@ -155,6 +156,7 @@ public:
   // #VK_animation
   void animationInstances(float time);
   void animationObject(float time);
+  void updateTopLevelAS(const VkCommandBuffer& cmdBuf);
 
   // #VK_compute
   void createCompDescriptors();
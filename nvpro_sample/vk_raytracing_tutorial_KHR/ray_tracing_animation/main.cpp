@@ -243,6 +243,9 @@ int main(int argc, char** argv)
     // Updating camera buffer
     helloVk.updateUniformBuffer(cmdBuf);
 
+    // #VK_animation
+    helloVk.updateTopLevelAS(cmdBuf);
+
     // Clearing screen
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color        = {{clearColor[0], clearColor[1], clearColor[2], clearColor[3]}};
@@ -44,6 +44,7 @@ using Allocator = nvvk::ResourceAllocatorDedicated;
 #include "shaders/host_device.h"
 
 // #VKRay
+#include "nvvk/dynamictlasKHR_vk.hpp"
 #include "nvvk/raytraceKHR_vk.hpp"
 #include "nvvk/sbtwrapper_vk.hpp"
 
@@ -163,6 +164,7 @@ public:
   VkPipelineLayout                                  m_rtPipelineLayout;
   VkPipeline                                        m_rtPipeline;
   nvvk::SBTWrapper                                  m_sbtWrapper;
+  nvvk::DynamicTlasKHR                              m_tlas;
 
   // Push constant for ray tracer
   PushConstantRay m_pcRay{};